@@ -233,7 +233,8 @@ LeaveProtected:
 	call 	SystemsFail
 
 Finish16Bit:
-	; Save
+	; Save, the size is replaced by the unpacked size for compressed ramdisks
+	mov 	dword [BootHeader + MultiBoot.RamdiskSize], eax
 	mov		eax, MEMLOCATION_RAMDISK_UPPER
 	mov 	dword [BootHeader + MultiBoot.RamdiskAddress], eax
 
@@ -333,6 +334,15 @@ Entry32:
 	; But we cli aswell
 	cli
 
+	; Version 2 ramdisks are stored with compressed modules and are
+	; relocated as they are, the kernel unpacks the modules
+	mov		esi, MEMLOCATION_FLOAD_LOWER
+	cmp		dword [esi], 0x3144524D
+	jne		.UnpackRamdisk
+	cmp		dword [esi + 4], 2
+	jae		.RelocateRamdisk
+
+.UnpackRamdisk:
 	; Unpack ramdisk - new size returned in eax
 	mov		esi, MEMLOCATION_FLOAD_LOWER
 	mov		edi, MEMLOCATION_UNPACK_AREA
@@ -340,9 +350,10 @@ Entry32:
 	cmp		eax, -1
 	je		EndOfStage
 	mov		dword [BootHeader + MultiBoot.RamdiskSize], eax
+	mov 	esi, MEMLOCATION_UNPACK_AREA
 
+.RelocateRamdisk:
 	; RamDisk Relocation to 2mb
-	mov 	esi, MEMLOCATION_UNPACK_AREA
 	mov 	edi, MEMLOCATION_RAMDISK_UPPER
 	mov		ecx, dword [BootHeader + MultiBoot.RamdiskSize]
 	shr		ecx, 2
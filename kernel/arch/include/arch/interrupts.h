@@ -47,6 +47,14 @@ InterruptConfigure(
     _In_ SystemInterrupt_t* Descriptor,
     _In_ int                Enable);
 
+/* InterruptSetDestination
+ * Retargets the interrupt at the given core and updates the message of MSI interrupts. Only
+ * io-apic lines and MSI-X entries can be moved while they are enabled. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptSetDestination(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             CoreId);
+
 /* InterruptDisable
  * Disables interrupts and returns the state before disabling */
 KERNELAPI IntStatus_t KERNELABI
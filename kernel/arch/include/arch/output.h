@@ -63,6 +63,12 @@ VideoGetTerminal(void);
 KERNELAPI void KERNELABI
 VideoClear(void);
 
+/* VideoFlush
+ * Copies all pending changes to the screen. Rendering is batched in memory, so
+ * this must be called once a batch of output has been rendered. */
+KERNELAPI void KERNELABI
+VideoFlush(void);
+
 /* VideoDrawPixel
  * Draws a pixel of the given color at the specifiedpixel-position */
 KERNELAPI OsStatus_t KERNELABI
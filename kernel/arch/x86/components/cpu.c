@@ -55,6 +55,11 @@ extern void CpuEnableAvx(void);
 extern void CpuEnableSse(void);
 extern void CpuEnableGpe(void);
 extern void CpuEnableFpu(void);
+extern void CpuEnableWriteProtect(void);
+#if defined(amd64) || defined(__amd64__)
+extern void CpuEnablePcid(void);
+extern void EnableVirtualSpaceIdentifiers(void);
+#endif
 
 /* TrimWhitespaces
  * Trims leading and trailing whitespaces in-place on the given string. This is neccessary
@@ -170,12 +175,25 @@ ArchProcessorSendInterrupt(
 void
 CpuInitializeFeatures(void)
 {
+    // The kernel must respect read-only pages as well, otherwise kernel writes to
+    // copy-on-write pages would modify the shared page
+    CpuEnableWriteProtect();
+
     // Can we use global pages? We will use this for kernel mappings
     // to speed up refill performance
     if (CpuHasFeatures(0, CPUID_FEAT_EDX_PGE) == OsSuccess) {
         CpuEnableGpe();
     }
 
+#if defined(amd64) || defined(__amd64__)
+    // Process-context identifiers keep the translations of other address spaces in the
+    // tlb across switches. They require global pages, as kernel mappings must not be tagged
+    if (CpuHasFeatures(CPUID_FEAT_ECX_PCID, CPUID_FEAT_EDX_PGE) == OsSuccess) {
+        CpuEnablePcid();
+        EnableVirtualSpaceIdentifiers();
+    }
+#endif
+
 	// Can we enable FPU?
 	if (CpuHasFeatures(0, CPUID_FEAT_EDX_FPU) == OsSuccess) {
 		CpuEnableFpu();
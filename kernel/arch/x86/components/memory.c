@@ -27,7 +27,10 @@
 #include <multiboot.h>
 #include <machine.h>
 #include <assert.h>
+#include <threading.h>
 #include <memory.h>
+#include <string.h>
+#include <thread.h>
 #include <debug.h>
 #include <arch.h>
 #include <apic.h>
@@ -39,15 +42,41 @@ extern PAGE_MASTER_LEVEL* MmVirtualGetMasterTable(SystemMemorySpace_t* MemorySpa
     PAGE_MASTER_LEVEL** ParentDirectory, int* IsCurrent);
 extern PageTable_t* MmVirtualGetTable(PAGE_MASTER_LEVEL* ParentPageMasterTable, PAGE_MASTER_LEVEL* PageMasterTable,
     VirtualAddress_t VirtualAddress, int IsCurrent, int CreateIfMissing, int* Update);
+extern uintptr_t MmVirtualGetLargePage(PAGE_MASTER_LEVEL* ParentPageMasterTable, PAGE_MASTER_LEVEL* PageMasterTable,
+    VirtualAddress_t VirtualAddress, int IsCurrent);
 
 extern void memory_invalidate_addr(uintptr_t pda);
 extern void memory_load_cr3(uintptr_t pda);
 extern void memory_reload_cr3(void);
+extern void memory_stream_zero(void* Address, size_t Length);
+extern void memory_stream_copy(void* Destination, const void* Source, size_t Length);
+extern void save_fpu(uintptr_t* Buffer);
+extern void load_fpu(uintptr_t* Buffer);
+extern void set_ts(void);
+extern void clear_ts(void);
 
 // Global static storage for the memory
 static size_t BlockmapBytes       = 0;
 uintptr_t     LastReservedAddress = 0;
 
+#if defined(amd64) || defined(__amd64__)
+#define PCID_CORE_COUNT 256 // Cores are identified by their 8 bit apic id
+#define PCID_SLOT_COUNT 8
+#define CR3_NOFLUSH     0x8000000000000000ULL
+
+// Every core tags the translations of its most recently used memory spaces with a pcid of
+// its own. A slot is only reused without a flush if both the tables and the generation of
+// the space are unchanged since it was loaded on the core.
+typedef struct {
+    int       Enabled;
+    int       NextSlot;
+    uintptr_t Tables[PCID_SLOT_COUNT];
+    size_t    Generations[PCID_SLOT_COUNT];
+} VirtualSpaceIdentifiers_t;
+
+static VirtualSpaceIdentifiers_t SpaceIdentifiers[PCID_CORE_COUNT] = { { 0 } };
+#endif
+
 // Disable the atomic wrong alignment, as they are aligned and are sanitized
 // in the arch-specific layer
 #if defined(__clang__)
@@ -165,7 +194,10 @@ ConvertSystemSpaceToPaging(Flags_t Flags)
     if (Flags & MAPPING_NOCACHE) {
         NativeFlags |= PAGE_CACHE_DISABLE;
     }
-    if (!(Flags & MAPPING_READONLY)) {
+    if (Flags & MAPPING_COPYONWRITE) {
+        NativeFlags |= PAGE_COPYONWRITE;
+    }
+    else if (!(Flags & MAPPING_READONLY)) {
         NativeFlags |= PAGE_WRITE;
     }
     if (Flags & MAPPING_ISDIRTY) {
@@ -189,7 +221,10 @@ ConvertPagingToSystemSpace(Flags_t Flags)
         if (Flags & PAGE_PRESENT) {
             GenericFlags |= MAPPING_COMMIT;
         }
-        if (!(Flags & PAGE_WRITE)) {
+        if (Flags & PAGE_COPYONWRITE) {
+            GenericFlags |= MAPPING_COPYONWRITE;
+        }
+        else if (!(Flags & PAGE_WRITE)) {
             GenericFlags |= MAPPING_READONLY;
         }
         if (Flags & PAGE_USER) {
@@ -208,6 +243,57 @@ ConvertPagingToSystemSpace(Flags_t Flags)
     return GenericFlags;
 }
 
+#if defined(amd64) || defined(__amd64__)
+/* EnableVirtualSpaceIdentifiers
+ * Marks process-context identifiers as enabled on the calling core, must only be called
+ * once the core has enabled them in cr4. */
+void
+EnableVirtualSpaceIdentifiers(void)
+{
+    SpaceIdentifiers[ArchGetProcessorCoreId() & 0xFF].Enabled = 1;
+}
+
+/* GetVirtualSpaceIdentifier
+ * Retrieves the cr3 value that loads the memory space on the calling core. Spaces without a
+ * generation, like the kernel space, always use pcid 0 which is flushed on every load. */
+static uintptr_t
+GetVirtualSpaceIdentifier(
+    _In_ SystemMemorySpace_t* SystemMemorySpace)
+{
+    VirtualSpaceIdentifiers_t* Identifiers = &SpaceIdentifiers[ArchGetProcessorCoreId() & 0xFF];
+    uintptr_t                  Tables      = SystemMemorySpace->Data[MEMORY_SPACE_CR3];
+    size_t                     Generation;
+    int                        i;
+
+    if (!Identifiers->Enabled) {
+        return Tables;
+    }
+
+    Generation = GetMemorySpaceGeneration(SystemMemorySpace);
+    if (Generation == 0) {
+        return Tables;
+    }
+
+    for (i = 0; i < PCID_SLOT_COUNT; i++) {
+        if (Identifiers->Tables[i] == Tables) {
+            if (Identifiers->Generations[i] == Generation) {
+                return Tables | (i + 1) | CR3_NOFLUSH;
+            }
+            Identifiers->Generations[i] = Generation;
+            return Tables | (i + 1);
+        }
+    }
+
+    // Take over the next slot, loading without the no-flush bit discards the translations
+    // of the space that previously owned it
+    i                           = Identifiers->NextSlot;
+    Identifiers->NextSlot       = (i + 1) % PCID_SLOT_COUNT;
+    Identifiers->Tables[i]      = Tables;
+    Identifiers->Generations[i] = Generation;
+    return Tables | (i + 1);
+}
+#endif
+
 /* SwitchVirtualSpace
  * Updates the currently active memory space for the calling core. */
 OsStatus_t
@@ -220,7 +306,11 @@ SwitchVirtualSpace(
     assert(SystemMemorySpace->Data[MEMORY_SPACE_DIRECTORY] != 0);
 
     // Update current page-directory
+#if defined(amd64) || defined(__amd64__)
+    memory_load_cr3(GetVirtualSpaceIdentifier(SystemMemorySpace));
+#else
     memory_load_cr3(SystemMemorySpace->Data[MEMORY_SPACE_CR3]);
+#endif
     return OsSuccess;
 }
 
@@ -248,7 +338,7 @@ SetVirtualPageAttributes(
     }
  
     // For kernel mappings we would like to mark the mappings global
-    if (Address < MEMORY_LOCATION_KERNEL_END) {
+    if (Address < MEMORY_LOCATION_KERNEL_END && !(Flags & MAPPING_LOCAL)) {
         if (CpuHasFeatures(0, CPUID_FEAT_EDX_PGE) == OsSuccess) {
             ConvertedFlags |= PAGE_GLOBAL;
         }
@@ -274,12 +364,21 @@ GetVirtualPageAttributes(
     PAGE_MASTER_LEVEL* ParentDirectory;
     PAGE_MASTER_LEVEL* Directory;
     PageTable_t*       Table;
+    uintptr_t          LargeMapping;
     int                IsCurrent, Update;
     Flags_t            OriginalFlags;
     int                Index = PAGE_TABLE_INDEX(Address);
 
-    Directory = MmVirtualGetMasterTable(MemorySpace, Address, &ParentDirectory, &IsCurrent);
-    Table     = MmVirtualGetTable(ParentDirectory, Directory, Address, IsCurrent, 0, &Update);
+    Directory    = MmVirtualGetMasterTable(MemorySpace, Address, &ParentDirectory, &IsCurrent);
+    LargeMapping = MmVirtualGetLargePage(ParentDirectory, Directory, Address, IsCurrent);
+    if (LargeMapping != 0) {
+        if (Flags != NULL) {
+            *Flags = ConvertPagingToSystemSpace(LargeMapping & ATTRIBUTE_MASK);
+        }
+        return OsSuccess;
+    }
+
+    Table = MmVirtualGetTable(ParentDirectory, Directory, Address, IsCurrent, 0, &Update);
     if (Table == NULL) {
         return OsError;
     }
@@ -292,11 +391,15 @@ GetVirtualPageAttributes(
     return OsSuccess;
 }
 
+/* CommitVirtualPageMapping
+ * Commits a reserved page with the attributes it was reserved with. A copy-on-write commit
+ * maps the page without write access, and only applies if no page was attached at reservation. */
 OsStatus_t
 CommitVirtualPageMapping(
     _In_ SystemMemorySpace_t* MemorySpace,
     _In_ PhysicalAddress_t    pAddress,
-    _In_ VirtualAddress_t     vAddress)
+    _In_ VirtualAddress_t     vAddress,
+    _In_ Flags_t              Flags)
 {
     PAGE_MASTER_LEVEL* ParentDirectory;
     PAGE_MASTER_LEVEL* Directory;
@@ -309,7 +412,11 @@ CommitVirtualPageMapping(
 
     vAddress &= PAGE_MASK;
     Directory = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
-    Table     = MmVirtualGetTable(ParentDirectory, Directory, vAddress, IsCurrent, 0, &Update);
+    if (MmVirtualGetLargePage(ParentDirectory, Directory, vAddress, IsCurrent) != 0) {
+        return OsExists;
+    }
+
+    Table = MmVirtualGetTable(ParentDirectory, Directory, vAddress, IsCurrent, 0, &Update);
     if (Table == NULL) {
         return OsDoesNotExist;
     }
@@ -332,6 +439,12 @@ SyncTable:
     }
     else {
         pAddress = (pAddress & PAGE_MASK) | (Mapping & ATTRIBUTE_MASK) | PAGE_PRESENT;
+        if (Flags & MAPPING_COPYONWRITE) {
+            pAddress = (pAddress & ~(PAGE_WRITE)) | PAGE_COPYONWRITE;
+        }
+        if (Flags & MAPPING_PERSISTENT) {
+            pAddress |= PAGE_PERSISTENT;
+        }
     }
     pAddress &= ~(PAGE_RESERVED);
 
@@ -374,7 +487,7 @@ SetVirtualPageMapping(
     Table          = MmVirtualGetTable(ParentDirectory, Directory, vAddress, IsCurrent, 1, &Update);
 
     // For kernel mappings we would like to mark the mappings global
-    if (vAddress < MEMORY_LOCATION_KERNEL_END) {
+    if (vAddress < MEMORY_LOCATION_KERNEL_END && !(Flags & MAPPING_LOCAL)) {
         if (CpuHasFeatures(0, CPUID_FEAT_EDX_PGE) == OsSuccess) {
             ConvertedFlags |= PAGE_GLOBAL;
         }
@@ -408,6 +521,133 @@ LeaveFunction:
     return Status;
 }
 
+/* SetVirtualPageMappings
+ * Maps a range of pages that must not be mapped already, the page-tables are only walked once
+ * for each table the range touches. Physical pages are taken from <pAddressValues> if given,
+ * otherwise they are contigious from <pAddressBase>. Stops at the first existing mapping. */
+OsStatus_t
+SetVirtualPageMappings(
+    _In_  SystemMemorySpace_t* MemorySpace,
+    _In_  PhysicalAddress_t*   pAddressValues,
+    _In_  PhysicalAddress_t    pAddressBase,
+    _In_  VirtualAddress_t     vAddress,
+    _In_  int                  PageCount,
+    _In_  Flags_t              Flags,
+    _Out_ int*                 PagesUpdated)
+{
+    PAGE_MASTER_LEVEL* ParentDirectory;
+    PAGE_MASTER_LEVEL* Directory;
+    PageTable_t*       Table;
+    uintptr_t          Mapping;
+    uintptr_t          pAddress = 0;
+    Flags_t            ConvertedFlags;
+    int                Update;
+    int                IsCurrent;
+    int                Index;
+    int                i      = 0;
+    OsStatus_t         Status = OsSuccess;
+
+    vAddress      &= PAGE_MASK;
+    ConvertedFlags = ConvertSystemSpaceToPaging(Flags);
+
+    // For kernel mappings we would like to mark the mappings global
+    if (vAddress < MEMORY_LOCATION_KERNEL_END && !(Flags & MAPPING_LOCAL)) {
+        if (CpuHasFeatures(0, CPUID_FEAT_EDX_PGE) == OsSuccess) {
+            ConvertedFlags |= PAGE_GLOBAL;
+        }
+    }
+
+    while (i < PageCount && Status == OsSuccess) {
+        Directory = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
+        Table     = MmVirtualGetTable(ParentDirectory, Directory, vAddress, IsCurrent, 1, &Update);
+        assert(Table != NULL);
+        if (Update) {
+            memory_reload_cr3();
+            memory_invalidate_addr(vAddress);
+        }
+
+        // The entries were not present before, so they can not be cached and need no invalidation
+        for (Index = PAGE_TABLE_INDEX(vAddress); Index < ENTRIES_PER_PAGE && i < PageCount; Index++) {
+            if (Flags & MAPPING_COMMIT) {
+                pAddress = (pAddressValues != NULL) ? pAddressValues[i] : pAddressBase + (i * PAGE_SIZE);
+            }
+
+            // Make sure value is not mapped already, NEVER overwrite a mapping
+            Mapping = 0;
+            if (!atomic_compare_exchange_strong(&Table->Pages[Index], &Mapping, 
+                    (pAddress & PAGE_MASK) | ConvertedFlags)) {
+                Status = OsExists;
+                break;
+            }
+            vAddress += PAGE_SIZE;
+            i++;
+        }
+    }
+
+    if (PagesUpdated != NULL) {
+        *PagesUpdated = i;
+    }
+    return Status;
+}
+
+/* ClearVirtualPageMappings
+ * Removes all mappings in a range of pages and frees the physical pages that are not persistent,
+ * the page-tables are only walked once for each table the range touches and tables that are
+ * not present are skipped. Returns OsError if any page in the range was not mapped. */
+OsStatus_t
+ClearVirtualPageMappings(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     vAddress,
+    _In_ int                  PageCount)
+{
+    PAGE_MASTER_LEVEL* ParentDirectory;
+    PAGE_MASTER_LEVEL* Directory;
+    PageTable_t*       Table;
+    uintptr_t          Mapping;
+    int                Update;
+    int                IsCurrent;
+    int                Index;
+    int                i      = 0;
+    OsStatus_t         Status = OsSuccess;
+
+    vAddress &= PAGE_MASK;
+    while (i < PageCount) {
+        Directory = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
+        Table     = MmVirtualGetTable(ParentDirectory, Directory, vAddress, IsCurrent, 0, &Update);
+        if (Table == NULL) {
+            Index     = MIN(ENTRIES_PER_PAGE - PAGE_TABLE_INDEX(vAddress), PageCount - i);
+            vAddress += Index * PAGE_SIZE;
+            i        += Index;
+            Status    = OsError;
+            continue;
+        }
+        if (Update) {
+            memory_reload_cr3();
+            memory_invalidate_addr(vAddress);
+        }
+
+        for (Index = PAGE_TABLE_INDEX(vAddress); Index < ENTRIES_PER_PAGE && i < PageCount; Index++) {
+            Mapping = atomic_exchange(&Table->Pages[Index], 0);
+            if (Mapping == 0) {
+                Status = OsError;
+            }
+
+            // The translation must be gone from the tlb before the page can be reused
+            if (Mapping & PAGE_PRESENT) {
+                if (IsCurrent) {
+                    memory_invalidate_addr(vAddress);
+                }
+                if (!(Mapping & PAGE_PERSISTENT)) {
+                    FreeMemorySpacePage(Mapping & PAGE_MASK);
+                }
+            }
+            vAddress += PAGE_SIZE;
+            i++;
+        }
+    }
+    return Status;
+}
+
 OsStatus_t
 ClearVirtualPageMapping(
     _In_ SystemMemorySpace_t* MemorySpace,
@@ -446,13 +686,96 @@ SyncTable:
         // should not free the physical page. We only do this if the memory
         // is marked as present, otherwise we don't
         if ((Mapping & PAGE_PRESENT) && !(Mapping & PAGE_PERSISTENT)) {
-            FreeSystemMemory(Mapping & PAGE_MASK, PAGE_SIZE);
+            FreeMemorySpacePage(Mapping & PAGE_MASK);
         }
         return OsSuccess;
     }
     return OsError;
 }
 
+/* ReplaceVirtualPageMapping
+ * Replaces the physical page of a present mapping with a new page and new attributes, the
+ * replacement only happens if the mapping still refers to the expected physical page. */
+OsStatus_t
+ReplaceVirtualPageMapping(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     vAddress,
+    _In_ PhysicalAddress_t    ExpectedAddress,
+    _In_ PhysicalAddress_t    pAddress,
+    _In_ Flags_t              Flags)
+{
+    PAGE_MASTER_LEVEL* ParentDirectory;
+    PAGE_MASTER_LEVEL* Directory;
+    PageTable_t*       Table;
+    uintptr_t          Mapping;
+    int                Update;
+    int                IsCurrent;
+    int                Index = PAGE_TABLE_INDEX(vAddress);
+
+    vAddress  &= PAGE_MASK;
+    Directory = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
+    Table     = MmVirtualGetTable(ParentDirectory, Directory, vAddress, IsCurrent, 0, &Update);
+    if (Table == NULL) {
+        return OsDoesNotExist;
+    }
+
+    pAddress = (pAddress & PAGE_MASK) | ConvertSystemSpaceToPaging(Flags);
+    Mapping  = atomic_load(&Table->Pages[Index]);
+SyncTable:
+    if (!(Mapping & PAGE_PRESENT) || (Mapping & PAGE_MASK) != (ExpectedAddress & PAGE_MASK)) {
+        return OsError;
+    }
+    if (!atomic_compare_exchange_weak(&Table->Pages[Index], &Mapping, pAddress)) {
+        goto SyncTable;
+    }
+
+    if (IsCurrent || Update) {
+        if (Update) {
+            memory_reload_cr3();
+        }
+        memory_invalidate_addr(vAddress);
+    }
+    return OsSuccess;
+}
+
+/* FindVirtualPageMapping
+ * Locates the first page in the range [Start, End) that has a mapping of any kind, present,
+ * reserved or large. Page-tables that are not present are skipped entirely. Returns 0 if none. */
+VirtualAddress_t
+FindVirtualPageMapping(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     Start,
+    _In_ VirtualAddress_t     End)
+{
+    PAGE_MASTER_LEVEL* ParentDirectory;
+    PAGE_MASTER_LEVEL* Directory;
+    PageTable_t*       Table;
+    VirtualAddress_t   Address = Start & PAGE_MASK;
+    int                IsCurrent, Update;
+    int                Index;
+
+    while (Address < End) {
+        Directory = MmVirtualGetMasterTable(MemorySpace, Address, &ParentDirectory, &IsCurrent);
+        if (MmVirtualGetLargePage(ParentDirectory, Directory, Address, IsCurrent) != 0) {
+            return Address;
+        }
+
+        Table = MmVirtualGetTable(ParentDirectory, Directory, Address, IsCurrent, 0, &Update);
+        if (Table != NULL) {
+            for (Index = PAGE_TABLE_INDEX(Address); Index < ENTRIES_PER_PAGE && Address < End; Index++) {
+                if (atomic_load_explicit(&Table->Pages[Index], memory_order_relaxed) != 0) {
+                    return Address;
+                }
+                Address += PAGE_SIZE;
+            }
+        }
+        else {
+            Address = (Address + TABLE_SPACE_SIZE) & ~((VirtualAddress_t)TABLE_SPACE_SIZE - 1);
+        }
+    }
+    return 0;
+}
+
 uintptr_t
 GetVirtualPageMapping(
     _In_ SystemMemorySpace_t* MemorySpace,
@@ -461,12 +784,17 @@ GetVirtualPageMapping(
     PAGE_MASTER_LEVEL* ParentDirectory;
     PAGE_MASTER_LEVEL* Directory;
     PageTable_t*       Table;
-    uint32_t           Mapping;
+    uintptr_t          Mapping;
     int                IsCurrent, Update;
     int                Index = PAGE_TABLE_INDEX(Address);
 
     Directory = MmVirtualGetMasterTable(MemorySpace, Address, &ParentDirectory, &IsCurrent);
-    Table     = MmVirtualGetTable(ParentDirectory, Directory, Address, IsCurrent, 0, &Update);
+    Mapping   = MmVirtualGetLargePage(ParentDirectory, Directory, Address, IsCurrent);
+    if (Mapping != 0) {
+        return (Mapping & LARGE_PAGE_MASK) + (Address & (LARGE_PAGE_SIZE - 1));
+    }
+
+    Table = MmVirtualGetTable(ParentDirectory, Directory, Address, IsCurrent, 0, &Update);
     if (Table == NULL) {
         return 0;
     }
@@ -481,6 +809,62 @@ GetVirtualPageMapping(
     return ((Mapping & PAGE_MASK) + (Address & ATTRIBUTE_MASK));
 }
 
+/* ZeroVirtualMemory
+ * Fills the memory with zeros using non-temporal stores, so zeroing memory that is not
+ * going to be used right away does not evict the working set from the caches. */
+void
+ZeroVirtualMemory(
+    _In_ VirtualAddress_t Address,
+    _In_ size_t           Length)
+{
+    if (Length != 0 && (Length % 64) == 0 && 
+        CpuHasFeatures(0, CPUID_FEAT_EDX_SSE2) == OsSuccess) {
+        memory_stream_zero((void*)Address, Length);
+    }
+    else {
+        memset((void*)Address, 0, Length);
+    }
+}
+
+/* CopyVirtualMemory
+ * Copies whole pages with non-temporal sse2 stores. The kernel itself never uses the sse
+ * registers, so a state of the current thread that is live in them is saved around the copy,
+ * otherwise the lazy switch is armed again so the thread faults its own state back in. The
+ * legacy sse instructions leave the upper halves of the avx registers untouched. */
+void
+CopyVirtualMemory(
+    _In_ VirtualAddress_t Destination,
+    _In_ VirtualAddress_t Source,
+    _In_ size_t           Length)
+{
+    uint8_t        FpuBuffer[512 + 16];
+    uintptr_t*     FpuState = (uintptr_t*)ALIGN((uintptr_t)&FpuBuffer[0], 16, 1);
+    MCoreThread_t* Thread;
+    IntStatus_t    IntStatus;
+
+    if (Length == 0 || (Length % 64) != 0 || ((Destination | Source) & 0xF) != 0 ||
+        CpuHasFeatures(0, CPUID_FEAT_EDX_SSE2) != OsSuccess) {
+        memcpy((void*)Destination, (const void*)Source, Length);
+        return;
+    }
+
+    IntStatus = InterruptDisable();
+    Thread    = GetCurrentThreadForCore(ArchGetProcessorCoreId());
+    if (Thread != NULL && (Thread->Data[THREAD_DATA_FLAGS] & X86_THREAD_USEDFPU)) {
+        save_fpu(FpuState);
+        memory_stream_copy((void*)Destination, (const void*)Source, Length);
+        load_fpu(FpuState);
+    }
+    else {
+        clear_ts();
+        memory_stream_copy((void*)Destination, (const void*)Source, Length);
+        if (Thread != NULL) {
+            set_ts();
+        }
+    }
+    InterruptRestoreState(IntStatus);
+}
+
 OsStatus_t
 SetDirectIoAccess(
     _In_ UUId_t               CoreId,
@@ -21,13 +21,51 @@
  *     funnels all logging out to com ports
  */
 
+#include <memoryspace.h>
 #include <machine.h>
 #include <arch/output.h>
 #include <arch/io.h>
+#include <console.h>
 #include <string.h>
+#include <heap.h>
 #include <vbe.h>
 
-static BootTerminal_t Terminal = { 0 };
+// The shadow framebuffer is a copy of the screen kept in normal memory. All rendering
+// is done into the shadow buffer, and only the dirty rectangle is copied to the video memory
+// on flush. Scrolling of the console region is done by rotating a ring offset.
+#define GLYPH_CACHE_ENTRIES 128
+#define GLYPH_WIDTH         8
+#define GLYPH_LOOKUP_SIZE   0x10000
+#define GLYPH_NOT_PRESENT   0xFFFF
+
+typedef struct _GlyphCacheEntry {
+    int       Glyph;
+    uint32_t  FgColor;
+    uint32_t  BgColor;
+    uint32_t* Pixels;
+} GlyphCacheEntry_t;
+
+typedef struct _ShadowFramebuffer {
+    uint32_t*         Buffer;
+    size_t            Size;
+    size_t            Pitch;
+    
+    unsigned          RegionStart;
+    unsigned          RegionEnd;
+    unsigned          RingOffset;
+
+    unsigned          DirtyLeft;
+    unsigned          DirtyTop;
+    unsigned          DirtyRight;
+    unsigned          DirtyBottom;
+
+    uint16_t*         GlyphLookup;
+    uint32_t*         GlyphPixels;
+    GlyphCacheEntry_t GlyphCache[GLYPH_CACHE_ENTRIES];
+} ShadowFramebuffer_t;
+
+static BootTerminal_t      Terminal = { 0 };
+static ShadowFramebuffer_t Shadow   = { 0 };
 
 extern const uint8_t  MCoreFontBitmaps[];
 extern const uint32_t MCoreFontNumChars;
@@ -38,6 +76,184 @@ extern const uint32_t MCoreFontWidth;
 extern const uint16_t MCoreFontIndex[];
 #endif
 
+/* VesaGetGlyphIndex
+ * Retrieves the index of the character in the font bitmap. Uses the direct lookup
+ * table if it has been built, otherwise it falls back to searching the font index. */
+static int
+VesaGetGlyphIndex(
+    _In_ int Character)
+{
+#ifdef UNICODE
+    unsigned i;
+    if (Shadow.GlyphLookup != NULL && (unsigned)Character < GLYPH_LOOKUP_SIZE) {
+        i = Shadow.GlyphLookup[Character];
+        return (i == GLYPH_NOT_PRESENT) ? -1 : (int)i;
+    }
+
+    for (i = 0; i < MCoreFontNumChars; i++) {
+        if (MCoreFontIndex[i] == (uint16_t)Character) {
+            return (int)i;
+        }
+    }
+    return -1;
+#else
+    return ((unsigned)Character < MCoreFontNumChars) ? Character : -1;
+#endif
+}
+
+/* VesaGetShadowRow
+ * Retrieves a pointer to the shadow buffer row that contains the screen row <Y>. Rows
+ * inside the scroll region are offset by the ring offset. */
+static inline uint32_t*
+VesaGetShadowRow(
+    _In_ unsigned Y)
+{
+    if (Y >= Shadow.RegionStart && Y < Shadow.RegionEnd) {
+        Y = Shadow.RegionStart + ((Y - Shadow.RegionStart + Shadow.RingOffset) 
+            % (Shadow.RegionEnd - Shadow.RegionStart));
+    }
+    return &Shadow.Buffer[Y * Shadow.Pitch];
+}
+
+/* VesaMarkDirty
+ * Extends the dirty rectangle to include the given area, clamped to the screen. */
+static void
+VesaMarkDirty(
+    _In_ unsigned X,
+    _In_ unsigned Y,
+    _In_ unsigned Width,
+    _In_ unsigned Height)
+{
+    unsigned Right  = MIN(X + Width, Terminal.Info.Width);
+    unsigned Bottom = MIN(Y + Height, Terminal.Info.Height);
+    if (X >= Right || Y >= Bottom) {
+        return;
+    }
+
+    if (Shadow.DirtyLeft >= Shadow.DirtyRight) {
+        Shadow.DirtyLeft   = X;
+        Shadow.DirtyTop    = Y;
+        Shadow.DirtyRight  = Right;
+        Shadow.DirtyBottom = Bottom;
+    }
+    else {
+        Shadow.DirtyLeft   = MIN(Shadow.DirtyLeft, X);
+        Shadow.DirtyTop    = MIN(Shadow.DirtyTop, Y);
+        Shadow.DirtyRight  = MAX(Shadow.DirtyRight, Right);
+        Shadow.DirtyBottom = MAX(Shadow.DirtyBottom, Bottom);
+    }
+}
+
+/* VesaRotateScrollRegion
+ * Moves the ring offset back to zero by rotating the rows of the scroll region in
+ * place. This is needed before the scroll region can be changed. */
+static void
+VesaRotateScrollRegion(void)
+{
+    unsigned Rows = Shadow.RegionEnd - Shadow.RegionStart;
+    unsigned Offset = Shadow.RingOffset;
+    unsigned Low, High;
+
+    // Rotate by three reversals, which only requires swapping rows
+    unsigned Ranges[3][2] = { { 0, Offset }, { Offset, Rows }, { 0, Rows } };
+    int      i;
+
+    for (i = 0; i < 3; i++) {
+        Low  = Ranges[i][0];
+        High = Ranges[i][1];
+        while (Low + 1 < High) {
+            uint32_t* RowLow  = &Shadow.Buffer[(Shadow.RegionStart + Low) * Shadow.Pitch];
+            uint32_t* RowHigh = &Shadow.Buffer[(Shadow.RegionStart + High - 1) * Shadow.Pitch];
+            size_t    j;
+            for (j = 0; j < Shadow.Pitch; j++) {
+                uint32_t Pixel = RowLow[j];
+                RowLow[j]      = RowHigh[j];
+                RowHigh[j]     = Pixel;
+            }
+            Low++;
+            High--;
+        }
+    }
+    Shadow.RingOffset = 0;
+}
+
+/* VesaUpdateScrollRegion
+ * Synchronizes the ring scroll region with the current terminal limits. */
+static void
+VesaUpdateScrollRegion(void)
+{
+    unsigned Start = Terminal.CursorStartY;
+    unsigned End   = MIN(Terminal.CursorLimitY, Terminal.Info.Height);
+    if (Shadow.RegionStart == Start && Shadow.RegionEnd == End) {
+        return;
+    }
+
+    if (Shadow.RingOffset != 0) {
+        VesaRotateScrollRegion();
+    }
+    Shadow.RegionStart = Start;
+    Shadow.RegionEnd   = End;
+}
+
+/* VesaGetGlyph
+ * Retrieves the rendered pixels of the glyph in the given colors. Glyphs are
+ * rendered once into a direct-mapped cache keyed by glyph index. */
+static uint32_t*
+VesaGetGlyph(
+    _In_ int      Glyph,
+    _In_ uint32_t FgColor,
+    _In_ uint32_t BgColor)
+{
+    GlyphCacheEntry_t* Entry = &Shadow.GlyphCache[Glyph % GLYPH_CACHE_ENTRIES];
+    uint8_t*           Bitmap;
+    uint32_t*          Pixels;
+    unsigned           Row, i;
+
+    FgColor |= 0xFF000000;
+    BgColor |= 0xFF000000;
+    if (Entry->Glyph == Glyph && Entry->FgColor == FgColor && Entry->BgColor == BgColor) {
+        return Entry->Pixels;
+    }
+
+    Bitmap = (uint8_t*)&MCoreFontBitmaps[Glyph * MCoreFontHeight];
+    Pixels = Entry->Pixels;
+    for (Row = 0; Row < MCoreFontHeight; Row++) {
+        uint8_t BmpData = Bitmap[Row];
+        for (i = 0; i < GLYPH_WIDTH; i++) {
+            *Pixels++ = (BmpData >> (7 - i)) & 0x1 ? FgColor : BgColor;
+        }
+    }
+
+    Entry->Glyph   = Glyph;
+    Entry->FgColor = FgColor;
+    Entry->BgColor = BgColor;
+    return Entry->Pixels;
+}
+
+/* VesaFlush
+ * Copies the dirty rectangle of the shadow buffer to the video memory. Each row
+ * is written with a single sequential copy to take advantage of write-combining. */
+static void
+VesaFlush(void)
+{
+    size_t   BytesPerRow;
+    unsigned Y;
+
+    if (Shadow.Buffer == NULL || Shadow.DirtyLeft >= Shadow.DirtyRight) {
+        return;
+    }
+
+    BytesPerRow = (Shadow.DirtyRight - Shadow.DirtyLeft) * sizeof(uint32_t);
+    for (Y = Shadow.DirtyTop; Y < Shadow.DirtyBottom; Y++) {
+        uint8_t* VideoPtr = (uint8_t*)(Terminal.FrameBufferAddress 
+            + (Y * Terminal.Info.BytesPerScanline)
+            + (Shadow.DirtyLeft * sizeof(uint32_t)));
+        memcpy(VideoPtr, VesaGetShadowRow(Y) + Shadow.DirtyLeft, BytesPerRow);
+    }
+    Shadow.DirtyLeft  = 0;
+    Shadow.DirtyRight = 0;
+}
+
 /* VesaDrawPixel
  * Uses the vesa-interface to plot a single pixel */
 static OsStatus_t
@@ -48,6 +264,14 @@ VesaDrawPixel(
 {
     uint32_t* VideoPtr;
     
+    if (Shadow.Buffer != NULL) {
+        if (X < Terminal.Info.Width && Y < Terminal.Info.Height) {
+            VesaGetShadowRow(Y)[X] = (0xFF000000 | Color);
+            VesaMarkDirty(X, Y, 1, 1);
+        }
+        return OsSuccess;
+    }
+
     // Calculate the video-offset
     VideoPtr = (uint32_t*)(Terminal.FrameBufferAddress 
         + ((Y * Terminal.Info.BytesPerScanline)
@@ -70,27 +294,38 @@ VesaDrawCharacter(
     // Variables
     uint32_t *vPtr = NULL;
     uint8_t *ChPtr = NULL;
-    unsigned Row, i = (unsigned)Character;
+    unsigned Row, i;
+    int Glyph;
+
+    Glyph = VesaGetGlyphIndex(Character);
+    if (Glyph == -1) {
+        // Not found
+        return OsError;
+    }
+
+    // Render through the glyph cache into the shadow buffer
+    if (Shadow.Buffer != NULL) {
+        uint32_t* Pixels = VesaGetGlyph(Glyph, FgColor, BgColor);
+        if (CursorX + GLYPH_WIDTH > Terminal.Info.Width || 
+            CursorY + MCoreFontHeight > Terminal.Info.Height) {
+            return OsError;
+        }
+
+        for (Row = 0; Row < MCoreFontHeight; Row++) {
+            memcpy(VesaGetShadowRow(CursorY + Row) + CursorX, 
+                &Pixels[Row * GLYPH_WIDTH], GLYPH_WIDTH * sizeof(uint32_t));
+        }
+        VesaMarkDirty(CursorX, CursorY, GLYPH_WIDTH, MCoreFontHeight);
+        return OsSuccess;
+    }
 
     // Calculate the video-offset
     vPtr = (uint32_t*)(Terminal.FrameBufferAddress 
         + ((CursorY * Terminal.Info.BytesPerScanline)
         + (CursorX * (Terminal.Info.Depth / 8))));
 
-    // If it's unicode lookup index
-#ifdef UNICODE
-    for (i = 0; i < MCoreFontNumChars; i++) {
-        if (MCoreFontIndex[i] == (uint16_t)Character)
-            break;
-    }
-    if (i == MCoreFontNumChars) {
-        // Not found
-        return OsError;
-    }
-#endif
-
     // Lookup bitmap
-    ChPtr = (uint8_t*)&MCoreFontBitmaps[i * MCoreFontHeight];
+    ChPtr = (uint8_t*)&MCoreFontBitmaps[Glyph * MCoreFontHeight];
 
     // Iterate bitmap rows
     for (Row = 0; Row < MCoreFontHeight; Row++) {
@@ -112,6 +347,37 @@ VesaDrawCharacter(
     return OsSuccess;
 }
 
+/* VesaScrollShadow
+ * Scrolls the terminal <n> lines up by advancing the ring offset of the scroll
+ * region and clearing the lines that become visible at the bottom. */
+static OsStatus_t
+VesaScrollShadow(
+    _In_ int ByLines)
+{
+    unsigned Rows;
+    unsigned ScrollRows = MCoreFontHeight * ByLines;
+    unsigned Y;
+
+    VesaUpdateScrollRegion();
+    Rows = Shadow.RegionEnd - Shadow.RegionStart;
+    if (Rows == 0 || ScrollRows > Rows) {
+        return OsError;
+    }
+    Shadow.RingOffset = (Shadow.RingOffset + ScrollRows) % Rows;
+
+    // Clear out the lines that was scrolled
+    for (Y = Shadow.RegionEnd - ScrollRows; Y < Shadow.RegionEnd; Y++) {
+        memset(VesaGetShadowRow(Y) + Terminal.CursorStartX, 0xFF, 
+            (Terminal.CursorLimitX - Terminal.CursorStartX) * sizeof(uint32_t));
+    }
+    VesaMarkDirty(Terminal.CursorStartX, Shadow.RegionStart, 
+        Terminal.CursorLimitX - Terminal.CursorStartX, Rows);
+
+    // We did the scroll, modify cursor
+    Terminal.CursorY -= ScrollRows;
+    return OsSuccess;
+}
+
 /* VesaScroll
  * Scrolls the terminal <n> lines up by using the
  * vesa-interface */
@@ -125,6 +391,10 @@ VesaScroll(
     int Lines = 0;
     int i = 0, j = 0;
 
+    if (Shadow.Buffer != NULL) {
+        return VesaScrollShadow(ByLines);
+    }
+
     // How many lines do we need to modify?
     Lines = (Terminal.CursorLimitY - Terminal.CursorStartY);
 
@@ -432,6 +702,20 @@ VideoClear(void)
         void *Destination= (void*)Terminal.FrameBufferAddress;
         size_t ByteCount = Terminal.Info.BytesPerScanline * Terminal.Info.Height;
         memset(Destination, 0xFF, ByteCount);
+        if (Shadow.Buffer != NULL) {
+            memset(Shadow.Buffer, 0xFF, Shadow.Size);
+            Shadow.RingOffset = 0;
+            Shadow.DirtyLeft  = 0;
+            Shadow.DirtyRight = 0;
+        }
+    }
+}
+
+void
+VideoFlush(void)
+{
+    if (Terminal.AvailableOutputs & VIDEO_GRAPHICS) {
+        VesaFlush();
     }
 }
 
@@ -500,6 +784,71 @@ InitializeSerialOutput(void)
     return OsSuccess;
 }
 
+/* InitializeFramebufferShadow (@arch)
+ * Allocates the shadow framebuffer and the glyph lookup tables. After this call all
+ * graphical rendering is done in memory, and is copied to the screen by VideoFlush.
+ * Returns OsOutOfMemory if the shadow can't be allocated, rendering then stays direct. */
+OsStatus_t
+InitializeFramebufferShadow(void)
+{
+    VirtualAddress_t Address;
+    size_t           GlyphSize = MCoreFontHeight * GLYPH_WIDTH * sizeof(uint32_t);
+    OsStatus_t       Status;
+    int              i;
+
+    // Only support the shadow for the linear framebuffer in 32 bit depth
+    if (GetMachine()->BootInformation.VbeMode < 3 || Terminal.Info.Depth != 32 ||
+        Shadow.Buffer != NULL) {
+        return OsNotSupported;
+    }
+
+    Shadow.Pitch = Terminal.Info.Width;
+    Shadow.Size  = Shadow.Pitch * Terminal.Info.Height * sizeof(uint32_t);
+    Status       = CreateMemorySpaceMapping(GetCurrentMemorySpace(), NULL, &Address, Shadow.Size,
+        MAPPING_COMMIT | MAPPING_DOMAIN, MAPPING_PHYSICAL_DEFAULT | MAPPING_VIRTUAL_GLOBAL, __MASK);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    // If any of the tables can't be allocated, everything is released again and the
+    // console keeps drawing straight to the framebuffer
+    Shadow.GlyphPixels = (uint32_t*)kmalloc(GlyphSize * GLYPH_CACHE_ENTRIES);
+    if (Shadow.GlyphPixels == NULL) {
+        RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Address, Shadow.Size);
+        return OsOutOfMemory;
+    }
+
+#ifdef UNICODE
+    Shadow.GlyphLookup = (uint16_t*)kmalloc(GLYPH_LOOKUP_SIZE * sizeof(uint16_t));
+    if (Shadow.GlyphLookup == NULL) {
+        kfree(Shadow.GlyphPixels);
+        Shadow.GlyphPixels = NULL;
+        RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Address, Shadow.Size);
+        return OsOutOfMemory;
+    }
+
+    // Build the direct lookup from character to glyph index
+    memset(Shadow.GlyphLookup, 0xFF, GLYPH_LOOKUP_SIZE * sizeof(uint16_t));
+    for (i = (int)MCoreFontNumChars - 1; i >= 0; i--) {
+        Shadow.GlyphLookup[MCoreFontIndex[i]] = (uint16_t)i;
+    }
+#endif
+
+    for (i = 0; i < GLYPH_CACHE_ENTRIES; i++) {
+        Shadow.GlyphCache[i].Glyph  = -1;
+        Shadow.GlyphCache[i].Pixels = (uint32_t*)((uint8_t*)Shadow.GlyphPixels + (i * GlyphSize));
+    }
+
+    // Start out with the current content of the screen
+    for (i = 0; i < (int)Terminal.Info.Height; i++) {
+        memcpy((void*)(Address + (i * Shadow.Pitch * sizeof(uint32_t))),
+            (void*)(Terminal.FrameBufferAddress + (i * Terminal.Info.BytesPerScanline)),
+            Shadow.Pitch * sizeof(uint32_t));
+    }
+    Shadow.Buffer = (uint32_t*)Address;
+    return OsSuccess;
+}
+
 /* InitializeFramebufferOutput (@arch)
  * Initializes the video framebuffer of the operating system. This enables visual rendering
  * of the operating system debug console. */
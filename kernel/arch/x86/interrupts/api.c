@@ -34,7 +34,9 @@
 
 #define EFLAGS_INTERRUPT_FLAG        (1 << 9)
 #define APIC_FLAGS_DEFAULT            0x7F00000000000000
+#define APIC_FLAGS_DESTINATION        0xFF00000000000000
 #define NUM_ISA_INTERRUPTS            16
+#define MSIX_ENTRY_MASKED             0x1
 
 extern void  __cli(void);
 extern void  __sti(void);
@@ -150,6 +152,71 @@ AllocateSoftwareVector(
     return Result;
 }
 
+/* InterruptSetMessage
+ * Formats the MSI message for the vector. Without a core the message is delivered to the
+ * lowest priority core of all, otherwise it's fixed to the given core. */
+static void
+InterruptSetMessage(
+    _In_ DeviceInterrupt_t* Interrupt,
+    _In_ UUId_t             TableIndex,
+    _In_ UUId_t             CoreId)
+{
+    // MSI Message Address Register (0xFEE00000 LAPIC)
+    // Bits 31-20: Must be 0xFEE
+    // Bits 19-12: Destination ID
+    // Bits 11-04: Reserved
+    // Bit      3: 0 = Destination is ONE CPU, 1 = Destination is Group
+    // Bit      2: Destination Mode (1 Logical, 0 Physical)
+    // Bits 00-01: X
+    //
+    // Message Data Register Format
+    // Bits 31-16: Reserved
+    // Bit     15: Trigger Mode (1 Level, 0 Edge)
+    // Bit     14: If edge, this is not used, if level, 1 = Assert, 0 = Deassert
+    // Bits 13-11: Reserved
+    // Bits 10-08: Delivery Mode, standard
+    // Bits 07-00: Vector
+    if (CoreId == UUID_INVALID) {
+        Interrupt->MsiAddress = 0xFEE00000 | (0x0007F0000) | 0x8 | 0x4;
+        Interrupt->MsiValue   = (0x100 | (TableIndex & 0xFF));
+    }
+    else {
+        Interrupt->MsiAddress = 0xFEE00000 | ((CoreId & 0xFF) << 12);
+        Interrupt->MsiValue   = (TableIndex & 0xFF);
+    }
+}
+
+/* InterruptGetApicDestination
+ * Changes the io-apic configuration from lowest priority delivery to any core into
+ * fixed delivery to the given core. */
+static uint64_t
+InterruptGetApicDestination(
+    _In_ uint64_t ApicFlags,
+    _In_ UUId_t   CoreId)
+{
+    ApicFlags &= ~(APIC_FLAGS_DESTINATION | APIC_DELIVERY_MODE(0x7) | APIC_DESTINATION_LOGICAL);
+    return ApicFlags | ((uint64_t)(CoreId & 0xFF) << 56);
+}
+
+/* InterruptWriteMsiXEntry
+ * Writes the message of the interrupt to its MSI-X table entry. The entry is masked while
+ * it's changed, messages raised meanwhile are held pending by the device. */
+static void
+InterruptWriteMsiXEntry(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ int                Masked)
+{
+    volatile uint32_t* Entry = (volatile uint32_t*)Descriptor->MsiXMapping;
+
+    Entry[3] = Entry[3] | MSIX_ENTRY_MASKED;
+    Entry[0] = LODWORD(Descriptor->Interrupt.MsiAddress);
+    Entry[1] = 0;
+    Entry[2] = LODWORD(Descriptor->Interrupt.MsiValue);
+    if (!Masked) {
+        Entry[3] = Entry[3] & ~MSIX_ENTRY_MASKED;
+    }
+}
+
 OsStatus_t
 InterruptResolve(
     _In_    DeviceInterrupt_t*  Interrupt,
@@ -197,24 +264,7 @@ InterruptResolve(
 
     // In case of MSI interrupt, update msi format
     if (Flags & INTERRUPT_MSI) {
-        // Fill in MSI data
-        // MSI Message Address Register (0xFEE00000 LAPIC)
-        // Bits 31-20: Must be 0xFEE
-        // Bits 19-11: Destination ID
-        // Bits 11-04: Reserved
-        // Bit      3: 0 = Destination is ONE CPU, 1 = Destination is Group
-        // Bit      2: Destination Mode (1 Logical, 0 Physical)
-        // Bits 00-01: X
-        Interrupt->MsiAddress = 0xFEE00000 | (0x0007F0000) | 0x8 | 0x4;
-
-        // Message Data Register Format
-        // Bits 31-16: Reserved
-        // Bit     15: Trigger Mode (1 Level, 0 Edge)
-        // Bit     14: If edge, this is not used, if level, 1 = Assert, 0 = Deassert
-        // Bits 13-11: Reserved
-        // Bits 10-08: Delivery Mode, standard
-        // Bits 07-00: Vector
-        Interrupt->MsiValue = (0x100 | (*TableIndex & 0xFF));
+        InterruptSetMessage(Interrupt, *TableIndex, UUID_INVALID);
     }
     return OsSuccess;
 }
@@ -238,8 +288,12 @@ InterruptConfigure(
     // Debug
     TRACE("InterruptConfigure(Id 0x%" PRIxIN ", Enable %i)", Descriptor->Id, Enable);
 
-    // Is this a software interrupt? Don't install
+    // Is this a software interrupt? Don't install, MSI-X entries are
+    // programmed by us and can be masked individually
     if (Descriptor->Flags & (INTERRUPT_SOFT | INTERRUPT_MSI)) {
+        if (Descriptor->MsiXMapping != 0) {
+            InterruptWriteMsiXEntry(Descriptor, !Enable);
+        }
         return OsSuccess;
     }
 
@@ -252,6 +306,9 @@ InterruptConfigure(
     TableIndex  = (Descriptor->Id & 0xFF);
     ApicFlags   = InterruptGetApicConfiguration(&Descriptor->Interrupt);
     ApicFlags  |= TableIndex;
+    if (Descriptor->Affinity != UUID_INVALID) {
+        ApicFlags = InterruptGetApicDestination(ApicFlags, Descriptor->Affinity);
+    }
 
     // Trace
     TRACE("Calculated flags for interrupt: 0x%" PRIxIN " (TableIndex %" PRIuIN ")", LODWORD(ApicFlags), TableIndex);
@@ -304,6 +361,51 @@ UpdateEntry:
     return OsSuccess;
 }
 
+OsStatus_t
+InterruptSetDestination(
+    _In_ SystemInterrupt_t* Descriptor,
+    _In_ UUId_t             CoreId)
+{
+    SystemInterruptController_t* Ic;
+    uint64_t                     ApicExisting;
+    uint32_t                     Control;
+
+    TRACE("InterruptSetDestination(Id 0x%" PRIxIN ", Core %" PRIuIN ")", Descriptor->Id, CoreId);
+
+    if (CoreId == UUID_INVALID || (Descriptor->Flags & INTERRUPT_SOFT)) {
+        return OsInvalidParameters;
+    }
+
+    // The message is stored in the config space of plain MSI, which we don't own, so that
+    // can only be targeted before the driver programs it
+    if (Descriptor->Flags & INTERRUPT_MSI) {
+        InterruptSetMessage(&Descriptor->Interrupt, LOWORD(Descriptor->Id), CoreId);
+        if (Descriptor->MsiXMapping != 0) {
+            Control = ((volatile uint32_t*)Descriptor->MsiXMapping)[3];
+            InterruptWriteMsiXEntry(Descriptor, (Control & MSIX_ENTRY_MASKED) ? 1 : 0);
+        }
+        Descriptor->Affinity = CoreId;
+        return OsSuccess;
+    }
+
+    if (GetApicInterruptMode() == InterruptModePic) {
+        return OsNotSupported;
+    }
+
+    // Masked entries are targeted when they are configured. Enabled entries are changed
+    // in place without masking them, as edges raised while masked are lost
+    Descriptor->Affinity = CoreId;
+    Ic = GetInterruptControllerByLine(Descriptor->Source);
+    if (Ic == NULL) {
+        return OsError;
+    }
+    ApicExisting = ApicReadIoEntry(Ic, Descriptor->Source);
+    if (!(ApicExisting & APIC_MASKED)) {
+        ApicWriteIoEntry(Ic, Descriptor->Source, InterruptGetApicDestination(ApicExisting, CoreId));
+    }
+    return OsSuccess;
+}
+
 IntStatus_t
 InterruptDisable(void)
 {
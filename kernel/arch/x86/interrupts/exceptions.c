@@ -128,8 +128,9 @@ ExceptionEntry(
             for(;;);
         }
 
-        // Final step is to see if kernel can handle the unallocated address
-        if (DebugPageFault(Registers, Address) == OsSuccess) {
+        // Final step is to see if kernel can handle the unallocated address, bit 1
+        // of the error code is set for write accesses
+        if (DebugPageFault(Registers, Address, (Registers->ErrorCode & 0x2) ? 1 : 0) == OsSuccess) {
             IssueFixed = 1;
         }
         else {
@@ -49,6 +49,7 @@
 // OS Bitfields for pages, bits 9-11 are available
 #define PAGE_PERSISTENT         0x200
 #define PAGE_RESERVED           0x400
+#define PAGE_COPYONWRITE        0x800
 #define PAGE_NX                 0x8000000000000000 // amd64 + nx cpuid must be set
 
 // OS Bitfields for page tables, bits 9-11 are available
@@ -31,6 +31,7 @@ global _CpuEnableAvx
 global _CpuEnableSse
 global _CpuEnableFpu
 global _CpuEnableGpe
+global _CpuEnableWriteProtect
 
 ; No matter what, this is booted by multiboot, and thus
 ; We can assume the state when this point is reached.
@@ -95,6 +96,13 @@ _CpuEnableFpu:
 	finit
 	ret
 
+; Assembly routine to enable write protection of read-only pages in supervisor mode
+_CpuEnableWriteProtect:
+	mov eax, cr0
+	bts eax, 16		; Set Write Protect (Bit 16)
+	mov cr0, eax
+	ret
+
 ; Assembly routine to enable global page support
 _CpuEnableGpe:
 	mov eax, cr4
@@ -27,6 +27,8 @@ global _memory_reload_cr3
 global _memory_get_cr3
 global _memory_load_cr3
 global _memory_invalidate_addr
+global _memory_stream_zero
+global _memory_stream_copy
 
 ;void memory_set_paging(int enable)
 ;Either enables or disables paging
@@ -76,3 +78,56 @@ _memory_invalidate_addr:
     mov eax, [esp + 4]
 	invlpg [eax]
 	ret
+
+;void memory_stream_zero(void* address, size_t length)
+;Zeroes memory with non-temporal stores, length must be a non-zero multiple of 64
+_memory_stream_zero:
+	mov ecx, dword [esp + 4]
+	mov edx, dword [esp + 8]
+	xor eax, eax
+	.loop:
+		movnti [ecx], eax
+		movnti [ecx + 4], eax
+		movnti [ecx + 8], eax
+		movnti [ecx + 12], eax
+		movnti [ecx + 16], eax
+		movnti [ecx + 20], eax
+		movnti [ecx + 24], eax
+		movnti [ecx + 28], eax
+		movnti [ecx + 32], eax
+		movnti [ecx + 36], eax
+		movnti [ecx + 40], eax
+		movnti [ecx + 44], eax
+		movnti [ecx + 48], eax
+		movnti [ecx + 52], eax
+		movnti [ecx + 56], eax
+		movnti [ecx + 60], eax
+		add ecx, 64
+		sub edx, 64
+		jnz .loop
+	sfence
+	ret
+
+;void memory_stream_copy(void* destination, const void* source, size_t length)
+;Copies memory with sse2 non-temporal stores, length must be a non-zero multiple of 64
+;and both buffers 16 byte aligned. The caller must own the sse state.
+_memory_stream_copy:
+	mov ecx, dword [esp + 4]
+	mov edx, dword [esp + 8]
+	mov eax, dword [esp + 12]
+	.loop:
+		prefetchnta [edx + 256]
+		movdqa xmm0, [edx]
+		movdqa xmm1, [edx + 16]
+		movdqa xmm2, [edx + 32]
+		movdqa xmm3, [edx + 48]
+		movntdq [ecx], xmm0
+		movntdq [ecx + 16], xmm1
+		movntdq [ecx + 32], xmm2
+		movntdq [ecx + 48], xmm3
+		add ecx, 64
+		add edx, 64
+		sub eax, 64
+		jnz .loop
+	sfence
+	ret
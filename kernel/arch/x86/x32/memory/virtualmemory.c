@@ -210,6 +210,66 @@ SyncWithParent:
     return Table;
 }
 
+/* MmVirtualGetLargePage
+ * Large pages are not used on x32, addresses are always mapped by page-tables. */
+uintptr_t
+MmVirtualGetLargePage(
+    _In_ PageDirectory_t* ParentPageDirectory,
+    _In_ PageDirectory_t* PageDirectory,
+    _In_ uintptr_t        Address,
+    _In_ int              IsCurrent)
+{
+    _CRT_UNUSED(ParentPageDirectory);
+    _CRT_UNUSED(PageDirectory);
+    _CRT_UNUSED(Address);
+    _CRT_UNUSED(IsCurrent);
+    return 0;
+}
+
+/* GetVirtualLargePageSize
+ * Retrieves the size of large pages, or 0 if large pages are not supported. */
+size_t
+GetVirtualLargePageSize(void)
+{
+    return 0;
+}
+
+OsStatus_t
+SetVirtualLargePageMapping(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ PhysicalAddress_t    pAddress,
+    _In_ VirtualAddress_t     vAddress,
+    _In_ Flags_t              Flags)
+{
+    _CRT_UNUSED(MemorySpace);
+    _CRT_UNUSED(pAddress);
+    _CRT_UNUSED(vAddress);
+    _CRT_UNUSED(Flags);
+    return OsNotSupported;
+}
+
+OsStatus_t
+SetVirtualLargePageAttributes(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     vAddress,
+    _In_ Flags_t              Flags)
+{
+    _CRT_UNUSED(MemorySpace);
+    _CRT_UNUSED(vAddress);
+    _CRT_UNUSED(Flags);
+    return OsDoesNotExist;
+}
+
+OsStatus_t
+ClearVirtualLargePageMapping(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     vAddress)
+{
+    _CRT_UNUSED(MemorySpace);
+    _CRT_UNUSED(vAddress);
+    return OsDoesNotExist;
+}
+
 OsStatus_t
 CloneVirtualSpace(
     _In_ SystemMemorySpace_t*   MemorySpaceParent, 
@@ -317,7 +377,7 @@ DestroyVirtualSpace(
 
             // If it has a mapping - free it
             if ((CurrentMapping & PAGE_MASK) != 0) {
-                if (FreeSystemMemory(CurrentMapping & PAGE_MASK, PAGE_SIZE) != OsSuccess) {
+                if (FreeMemorySpacePage(CurrentMapping & PAGE_MASK) != OsSuccess) {
                     ERROR("Tried to free page %" PRIiIN " (0x%" PRIxIN "), but was not allocated", j, CurrentMapping);
                 }
             }
@@ -36,6 +36,11 @@
 #define TABLE_SPACE_SIZE        (PAGE_SIZE * ENTRIES_PER_PAGE)
 #define MEMORY_ALLOCATION_MASK  0x3FFFFF
 
+/* Large pages are mapped directly by the page-directory, and cover the space
+ * of an entire page-table. They are not used on x32. */
+#define LARGE_PAGE_SIZE         TABLE_SPACE_SIZE
+#define LARGE_PAGE_MASK         0xFFC00000
+
 /* Indices
  * 10 bits each are used for each part, with the first 12 bits reserved */
 #define PAGE_DIRECTORY_INDEX(x) (((x) >> 22) & 0x3FF)
@@ -31,6 +31,8 @@ global CpuEnableAvx
 global CpuEnableSse
 global CpuEnableFpu
 global CpuEnableGpe
+global CpuEnableWriteProtect
+global CpuEnablePcid
 
 ; No matter what, this is booted by multiboot, and thus
 ; We can assume the state when this point is reached.
@@ -96,6 +98,20 @@ CpuEnableFpu:
 	finit
 	ret
 
+; Assembly routine to enable write protection of read-only pages in supervisor mode
+CpuEnableWriteProtect:
+	mov rax, cr0
+	bts rax, 16		; Set Write Protect (Bit 16)
+	mov cr0, rax
+	ret
+
+; Assembly routine to enable process-context identifiers, cr3 must have pcid 0
+CpuEnablePcid:
+	mov rax, cr4
+	bts rax, 17		; Set PCID Enable (Bit 17)
+	mov cr4, rax
+	ret
+
 ; Assembly routine to enable global page support
 CpuEnableGpe:
 	mov rax, cr4
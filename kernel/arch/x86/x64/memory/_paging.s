@@ -26,6 +26,8 @@ global memory_reload_cr3
 global memory_get_cr3
 global memory_load_cr3
 global memory_invalidate_addr
+global memory_stream_zero
+global memory_stream_copy
 
 ;void memory_reload_cr3(void)
 ;Reloads the cr3 register
@@ -50,4 +52,44 @@ memory_load_cr3:
 ;Invalidates a page address
 memory_invalidate_addr:
 	invlpg [rcx]
-	ret
\ No newline at end of file
+	ret
+
+;void memory_stream_zero(void* address, size_t length)
+;Zeroes memory with non-temporal stores, length must be a non-zero multiple of 64
+memory_stream_zero:
+	xor rax, rax
+	.loop:
+		movnti [rcx], rax
+		movnti [rcx + 8], rax
+		movnti [rcx + 16], rax
+		movnti [rcx + 24], rax
+		movnti [rcx + 32], rax
+		movnti [rcx + 40], rax
+		movnti [rcx + 48], rax
+		movnti [rcx + 56], rax
+		add rcx, 64
+		sub rdx, 64
+		jnz .loop
+	sfence
+	ret
+
+;void memory_stream_copy(void* destination, const void* source, size_t length)
+;Copies memory with sse2 non-temporal stores, length must be a non-zero multiple of 64
+;and both buffers 16 byte aligned. The caller must own the sse state.
+memory_stream_copy:
+	.loop:
+		prefetchnta [rdx + 256]
+		movdqa xmm0, [rdx]
+		movdqa xmm1, [rdx + 16]
+		movdqa xmm2, [rdx + 32]
+		movdqa xmm3, [rdx + 48]
+		movntdq [rcx], xmm0
+		movntdq [rcx + 16], xmm1
+		movntdq [rcx + 32], xmm2
+		movntdq [rcx + 48], xmm3
+		add rcx, 64
+		add rdx, 64
+		sub r8, 64
+		jnz .loop
+	sfence
+	ret
@@ -42,6 +42,8 @@
 extern uintptr_t LastReservedAddress;
 
 extern OsStatus_t SwitchVirtualSpace(SystemMemorySpace_t*);
+extern void memory_invalidate_addr(uintptr_t pda);
+extern void memory_reload_cr3(void);
 
 STATIC_ASSERT(sizeof(PageDirectory_t) == 8192, Invalid_PageDirectory_Alignment);
 STATIC_ASSERT(sizeof(PageDirectoryTable_t) == 8192, Invalid_PageDirectoryTable_Alignment);
@@ -211,8 +213,11 @@ MmVirtualGetMasterTable(
     return Directory;
 }
 
-PageTable_t*
-MmVirtualGetTable(
+/* MmVirtualGetDirectory
+ * Retrieves the page-directory that covers the given address, and synchronizes the upper
+ * levels with the parent if neccessary. */
+static PageDirectory_t*
+MmVirtualGetDirectory(
 	_In_  PageMasterTable_t*    ParentPageMasterTable,
 	_In_  PageMasterTable_t*    PageMasterTable,
 	_In_  VirtualAddress_t      VirtualAddress,
@@ -222,7 +227,6 @@ MmVirtualGetTable(
 {
     PageDirectoryTable_t* DirectoryTable = NULL;
     PageDirectory_t*      Directory      = NULL;
-	PageTable_t*          Table          = NULL;
 	uintptr_t             Physical       = 0;
     Flags_t               CreateFlags    = PAGE_PRESENT | PAGE_WRITE;
     uint64_t              ParentMapping;
@@ -230,7 +234,6 @@ MmVirtualGetTable(
     // Initialize indices and variables
     int PmIndex     = PAGE_LEVEL_4_INDEX(VirtualAddress);
     int PdpIndex    = PAGE_DIRECTORY_POINTER_INDEX(VirtualAddress);
-    int PdIndex     = PAGE_DIRECTORY_INDEX(VirtualAddress);
     ParentMapping   = atomic_load(&PageMasterTable->pTables[PmIndex]);
     *Update         = 0;
 
@@ -285,7 +288,7 @@ SyncPmlWithParent:
 
             // Update our copy
             atomic_store(&PageMasterTable->pTables[PmIndex], Physical);
-            PageMasterTable->vTables[PmIndex] = (uintptr_t)Table;
+            PageMasterTable->vTables[PmIndex] = (uintptr_t)DirectoryTable;
             *Update                           = IsCurrent;
         }
     }
@@ -325,14 +328,73 @@ SyncPdp:
         *Update                           = IsCurrent;
     }
 
-    // Sanitize the status of the allocation/synchronization
+    return Directory;
+}
+
+/* MmVirtualSplitLargePage
+ * Demotes a large page into a page-table that maps the exact same memory with 4kb pages. The
+ * translation does not change, so only the entries that are modified afterwards must be invalidated. */
+static PageTable_t*
+MmVirtualSplitLargePage(
+    _In_ PageDirectory_t* Directory,
+    _In_ int              PdIndex,
+    _In_ uint64_t         Mapping,
+    _In_ Flags_t          CreateFlags)
+{
+    PageTable_t* Table;
+    uintptr_t    Physical;
+
+    Table = (PageTable_t*)kmalloc_p(sizeof(PageTable_t), &Physical);
+    assert(Table != NULL);
+    MmVirtualFillPageTable(Table, Mapping & LARGE_PAGE_MASK, 0, 
+        (Mapping & ATTRIBUTE_MASK) & ~(PAGETABLE_LARGE));
+
+    if (!atomic_compare_exchange_strong(&Directory->pTables[PdIndex], &Mapping, Physical | CreateFlags)) {
+        kfree((void*)Table);
+        return NULL;
+    }
+    Directory->vTables[PdIndex] = (uint64_t)Table;
+    return Table;
+}
+
+PageTable_t*
+MmVirtualGetTable(
+	_In_  PageMasterTable_t*    ParentPageMasterTable,
+	_In_  PageMasterTable_t*    PageMasterTable,
+	_In_  VirtualAddress_t      VirtualAddress,
+    _In_  int                   IsCurrent,
+    _In_  int                   CreateIfMissing,
+    _Out_ int*                  Update)
+{
+    PageDirectory_t* Directory;
+	PageTable_t*     Table       = NULL;
+	uintptr_t        Physical    = 0;
+    Flags_t          CreateFlags = PAGE_PRESENT | PAGE_WRITE;
+    uint64_t         ParentMapping;
+    int              PdIndex     = PAGE_DIRECTORY_INDEX(VirtualAddress);
+
+    if (VirtualAddress > MEMORY_LOCATION_KERNEL_END) {
+        CreateFlags |= PAGE_USER;
+    }
+
+    Directory = MmVirtualGetDirectory(ParentPageMasterTable, PageMasterTable, 
+        VirtualAddress, IsCurrent, CreateIfMissing, Update);
     if (Directory == NULL) {
         return NULL;
     }
 
     ParentMapping = atomic_load(&Directory->pTables[PdIndex]);
 SyncPd:
-    if (ParentMapping & PAGE_PRESENT) {
+    if ((ParentMapping & PAGE_PRESENT) && (ParentMapping & PAGETABLE_LARGE)) {
+        // Any access to the individual pages of a large page demotes it
+        Table = MmVirtualSplitLargePage(Directory, PdIndex, ParentMapping, CreateFlags);
+        if (Table == NULL) {
+            ParentMapping = atomic_load(&Directory->pTables[PdIndex]);
+            goto SyncPd;
+        }
+        *Update = IsCurrent;
+    }
+    else if (ParentMapping & PAGE_PRESENT) {
         Table = (PageTable_t*)Directory->vTables[PdIndex];
         assert(Table != NULL);
     }
@@ -357,6 +419,175 @@ SyncPd:
 	return Table;
 }
 
+/* MmVirtualGetLargePage
+ * Retrieves the page-directory entry of the address if it is mapped by a large page, otherwise 0. */
+uintptr_t
+MmVirtualGetLargePage(
+	_In_ PageMasterTable_t* ParentPageMasterTable,
+	_In_ PageMasterTable_t* PageMasterTable,
+	_In_ VirtualAddress_t   VirtualAddress,
+    _In_ int                IsCurrent)
+{
+    PageDirectory_t* Directory;
+    uint64_t         Mapping;
+    int              Update;
+
+    Directory = MmVirtualGetDirectory(ParentPageMasterTable, PageMasterTable, 
+        VirtualAddress, IsCurrent, 0, &Update);
+    if (Directory == NULL) {
+        return 0;
+    }
+
+    Mapping = atomic_load(&Directory->pTables[PAGE_DIRECTORY_INDEX(VirtualAddress)]);
+    if ((Mapping & PAGE_PRESENT) && (Mapping & PAGETABLE_LARGE)) {
+        return Mapping;
+    }
+    return 0;
+}
+
+/* GetVirtualLargePageSize
+ * Retrieves the size of large pages, or 0 if large pages are not supported. */
+size_t
+GetVirtualLargePageSize(void)
+{
+    return LARGE_PAGE_SIZE;
+}
+
+/* SetVirtualLargePageMapping
+ * Maps a large page at the given address, the address range must not contain any mappings
+ * or page-tables already. Large pages are always committed. */
+OsStatus_t
+SetVirtualLargePageMapping(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ PhysicalAddress_t    pAddress,
+    _In_ VirtualAddress_t     vAddress,
+    _In_ Flags_t              Flags)
+{
+    PageMasterTable_t* ParentDirectory;
+    PageMasterTable_t* MasterTable;
+    PageDirectory_t*   Directory;
+    uint64_t           Mapping = 0;
+    Flags_t            ConvertedFlags;
+    int                IsCurrent, Update;
+
+    assert((pAddress % LARGE_PAGE_SIZE) == 0 && (vAddress % LARGE_PAGE_SIZE) == 0);
+    ConvertedFlags = ConvertSystemSpaceToPaging(Flags);
+    if (!(ConvertedFlags & PAGE_PRESENT) || (ConvertedFlags & PAGE_COPYONWRITE)) {
+        return OsNotSupported;
+    }
+
+    // For kernel mappings we would like to mark the mappings global
+    if (vAddress < MEMORY_LOCATION_KERNEL_END) {
+        if (CpuHasFeatures(0, CPUID_FEAT_EDX_PGE) == OsSuccess) {
+            ConvertedFlags |= PAGE_GLOBAL;
+        }
+    }
+
+    MasterTable = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
+    Directory   = MmVirtualGetDirectory(ParentDirectory, MasterTable, vAddress, IsCurrent, 1, &Update);
+    assert(Directory != NULL);
+
+    if (!atomic_compare_exchange_strong(&Directory->pTables[PAGE_DIRECTORY_INDEX(vAddress)], 
+            &Mapping, pAddress | ConvertedFlags | PAGETABLE_LARGE)) {
+        return OsExists;
+    }
+
+    if (IsCurrent || Update) {
+        if (Update) {
+            memory_reload_cr3();
+        }
+        memory_invalidate_addr(vAddress);
+    }
+    return OsSuccess;
+}
+
+/* SetVirtualLargePageAttributes
+ * Changes the memory protection flags of an entire large page. Returns OsDoesNotExist if the
+ * address is not mapped by a large page. */
+OsStatus_t
+SetVirtualLargePageAttributes(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     vAddress,
+    _In_ Flags_t              Flags)
+{
+    PageMasterTable_t* ParentDirectory;
+    PageMasterTable_t* MasterTable;
+    PageDirectory_t*   Directory;
+    uint64_t           Mapping;
+    Flags_t            ConvertedFlags;
+    int                Index = PAGE_DIRECTORY_INDEX(vAddress);
+    int                IsCurrent, Update;
+
+    ConvertedFlags = ConvertSystemSpaceToPaging(Flags);
+    if (!(ConvertedFlags & PAGE_PRESENT) || (ConvertedFlags & PAGE_COPYONWRITE)) {
+        return OsNotSupported;
+    }
+    if (vAddress < MEMORY_LOCATION_KERNEL_END) {
+        if (CpuHasFeatures(0, CPUID_FEAT_EDX_PGE) == OsSuccess) {
+            ConvertedFlags |= PAGE_GLOBAL;
+        }
+    }
+
+    MasterTable = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
+    Directory   = MmVirtualGetDirectory(ParentDirectory, MasterTable, vAddress, IsCurrent, 0, &Update);
+    if (Directory == NULL) {
+        return OsDoesNotExist;
+    }
+
+    Mapping = atomic_load(&Directory->pTables[Index]);
+SyncTable:
+    if (!(Mapping & PAGE_PRESENT) || !(Mapping & PAGETABLE_LARGE)) {
+        return OsDoesNotExist;
+    }
+    if (!atomic_compare_exchange_weak(&Directory->pTables[Index], &Mapping,
+            (Mapping & LARGE_PAGE_MASK) | ConvertedFlags | PAGETABLE_LARGE)) {
+        goto SyncTable;
+    }
+    if (IsCurrent) {
+        memory_invalidate_addr(vAddress);
+    }
+    return OsSuccess;
+}
+
+/* ClearVirtualLargePageMapping
+ * Removes a large page mapping and frees the memory if it was not persistent. Returns 
+ * OsDoesNotExist if the address is not mapped by a large page. */
+OsStatus_t
+ClearVirtualLargePageMapping(
+    _In_ SystemMemorySpace_t* MemorySpace,
+    _In_ VirtualAddress_t     vAddress)
+{
+    PageMasterTable_t* ParentDirectory;
+    PageMasterTable_t* MasterTable;
+    PageDirectory_t*   Directory;
+    uint64_t           Mapping;
+    int                Index = PAGE_DIRECTORY_INDEX(vAddress);
+    int                IsCurrent, Update;
+
+    MasterTable = MmVirtualGetMasterTable(MemorySpace, vAddress, &ParentDirectory, &IsCurrent);
+    Directory   = MmVirtualGetDirectory(ParentDirectory, MasterTable, vAddress, IsCurrent, 0, &Update);
+    if (Directory == NULL) {
+        return OsDoesNotExist;
+    }
+
+    Mapping = atomic_load(&Directory->pTables[Index]);
+SyncTable:
+    if (!(Mapping & PAGE_PRESENT) || !(Mapping & PAGETABLE_LARGE)) {
+        return OsDoesNotExist;
+    }
+    if (!atomic_compare_exchange_weak(&Directory->pTables[Index], &Mapping, 0)) {
+        goto SyncTable;
+    }
+
+    if (IsCurrent) {
+        memory_invalidate_addr(vAddress);
+    }
+    if (!(Mapping & PAGE_PERSISTENT)) {
+        FreeSystemMemory(Mapping & LARGE_PAGE_MASK, LARGE_PAGE_SIZE);
+    }
+    return OsSuccess;
+}
+
 OsStatus_t
 CloneVirtualSpace(
     _In_ SystemMemorySpace_t*   MemorySpaceParent, 
@@ -469,7 +700,7 @@ MmVirtualDestroyPageTable(
         }
 
         if ((Mapping & PAGE_MASK) != 0) {
-            if (FreeSystemMemory(Mapping & PAGE_MASK, PAGE_SIZE) != OsSuccess) {
+            if (FreeMemorySpacePage(Mapping & PAGE_MASK) != OsSuccess) {
                 ERROR("Tried to free page %" PRIiIN " (0x%" PRIxIN "), but was not allocated", Index, Mapping);
             }
         }
@@ -492,6 +723,12 @@ MmVirtualDestroyPageDirectory(
         if ((Mapping & PAGETABLE_INHERITED) || !(Mapping & PAGE_PRESENT)) {
             continue;
         }
+
+        // Large pages map memory directly, the persistent bit is shared with the inherited bit
+        if (Mapping & PAGETABLE_LARGE) {
+            FreeSystemMemory(Mapping & LARGE_PAGE_MASK, LARGE_PAGE_SIZE);
+            continue;
+        }
         MmVirtualDestroyPageTable((PageTable_t*)PageDirectory->vTables[Index]);
     }
     kfree(PageDirectory);
@@ -39,6 +39,11 @@
 #define PML4_SPACE_SIZE            ((uint64_t)DIRECTORY_TABLE_SPACE_SIZE * (uint64_t)ENTRIES_PER_PAGE)
 #define MEMORY_ALLOCATION_MASK  0x3FFFFF
 
+/* Large pages are mapped directly by the page-directory, and cover the space
+ * of an entire page-table. */
+#define LARGE_PAGE_SIZE         TABLE_SPACE_SIZE
+#define LARGE_PAGE_MASK         0xFFFFFFFFFFE00000
+
 /* Indices
  * 9 bits each are used for each part, with the first 12 bits reserved */
 #define PAGE_LEVEL_4_INDEX(x)           (((x) >> 39) & 0x1FF)
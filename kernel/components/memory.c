@@ -35,6 +35,9 @@ AllocateSystemMemory(
     if (Flags & MEMORY_DOMAIN) {
         // GetCurrentDomain()->Memory.MemoryRange
     }
+    if (Flags & MEMORY_ALIGNED) {
+        return AllocateAlignedBlocksInBlockmap(&GetMachine()->PhysicalMemory, Mask, Size, Size);
+    }
     return AllocateBlocksInBlockmap(&GetMachine()->PhysicalMemory, Mask, Size);
 }
 
@@ -27,6 +27,7 @@
 #include <os/services/targets.h>
 #include <modules/manager.h>
 #include <arch/utils.h>
+#include <memorybuffer.h>
 #include <memoryspace.h>
 #include <interrupts.h>
 #include <deviceio.h>
@@ -78,7 +79,8 @@ DebugBreakpoint(
 OsStatus_t
 DebugPageFault(
     _In_ Context_t* Context,
-    _In_ uintptr_t  Address)
+    _In_ uintptr_t  Address,
+    _In_ int        IsWrite)
 {
     SystemMemorySpace_t* Space  = GetCurrentMemorySpace();
     OsStatus_t           Status;
@@ -88,6 +90,27 @@ DebugPageFault(
         if (DebugPageMemorySpaceHandlers(Context, Address) == OsSuccess) {
             return OsSuccess;
         }
+
+        // Scatter-gather buffers must be backed by their own pages
+        Status = HandleMemoryBufferPageFault(Space, Address);
+        if (Status != OsDoesNotExist) {
+            return Status;
+        }
+    }
+
+    // Writes to pages shared copy-on-write must be resolved before the commit, as
+    // those pages are already present
+    Status = HandleCopyOnWritePageFault(Space, Address);
+    if (Status != OsDoesNotExist) {
+        return Status;
+    }
+
+    // Memory that is only read does not need a page of its own yet
+    if (!IsWrite) {
+        Status = CommitMemorySpaceZeroPage(Space, Address);
+        if (Status != OsNotSupported) {
+            return (Status == OsExists) ? OsSuccess : Status;
+        }
     }
     Status = CommitMemorySpaceMapping(Space, NULL, Address, __MASK);
     if (Status == OsExists) {
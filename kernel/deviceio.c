@@ -289,11 +289,22 @@ ReleaseKernelSystemDeviceIo(
 uintptr_t
 ValidateDeviceIoMemoryAddress(
     _In_ uintptr_t Address)
+{
+    return ValidateDeviceIoMemoryRange(Address, 1);
+}
+
+/* ValidateDeviceIoMemoryRange (@interrupt_context)
+ * Validates the given virtual range like ValidateDeviceIoMemoryAddress, the
+ * whole range must be inside a single io-space of the process */
+uintptr_t
+ValidateDeviceIoMemoryRange(
+    _In_ uintptr_t Address,
+    _In_ size_t    Length)
 {
     SystemModule_t* Module = GetCurrentModule();
-    TRACE("ValidateDeviceIoMemoryAddress(Process %" PRIuIN ", Address 0x%" PRIxIN ")", Handle, Address);
+    TRACE("ValidateDeviceIoMemoryRange(Address 0x%" PRIxIN ", Length 0x%" PRIxIN ")", Address, Length);
 
-    if (Module == NULL) {
+    if (Module == NULL || Length == 0) {
         return 0;
     }
     
@@ -306,7 +317,8 @@ ValidateDeviceIoMemoryAddress(
         // is valid, it has to belong to the right process
         // and be in range 
         if (IoSpace->Owner == Module->Handle && IoSpace->Io.Type == DeviceIoMemoryBased &&
-            (Address >= VirtualBase && Address < (VirtualBase + IoSpace->Io.Access.Memory.Length))) {
+            Address >= VirtualBase && (Address - VirtualBase) < IoSpace->Io.Access.Memory.Length &&
+            Length <= (IoSpace->Io.Access.Memory.Length - (Address - VirtualBase))) {
             return IoSpace->Io.Access.Memory.PhysicalBase + (Address - VirtualBase);
         }
     }
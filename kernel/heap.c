@@ -30,9 +30,23 @@
 
 #define MEMORY_OVERRUN_PATTERN                      0xA5A5A5A5
 #define MEMORY_SLAB_ONSITE_THRESHOLD                512
-#define MEMORY_ATOMIC_CACHE(Cache, Core)            (MemoryAtomicCache_t*)(Cache->AtomicCaches + (Core * (sizeof(MemoryAtomicCache_t) + (Cache->ObjectCount * sizeof(void*)))))
-#define MEMORY_ATOMIC_ELEMENT(AtomicCache, Element) ((uintptr_t**)((uintptr_t)AtomicCache + sizeof(MemoryAtomicCache_t) + (Element * sizeof(void*))))
 #define MEMORY_SLAB_ELEMENT(Cache, Slab, Element)   (void*)((uintptr_t)Slab->Address + (Element * (Cache->ObjectSize + Cache->ObjectPadding)))
+#define MEMORY_SLAB_MAP_DIRECTORY                   256
+#define MEMORY_MAGAZINE_MAX_ROUNDS                  63
+#define MEMORY_DEPOT_CONTENTION_PERIOD              256 // Depot operations between resize checks
+#define MEMORY_DEPOT_CONTENTION_LIMIT               16  // Contended depot operations per period before growing
+
+// The slab map is a two-level table indexed by page of the global kernel memory region, 
+// the leaf tables are a page each and are allocated on demand
+static MemorySlab_t** SlabMap[MEMORY_SLAB_MAP_DIRECTORY] = { 0 };
+static size_t         SlabMapLeafEntries                 = 0;
+
+// All caches are registered, so they can be reaped under memory pressure
+static MemoryCache_t*   CacheRegistry     = NULL;
+static SafeMemoryLock_t CacheRegistryLock = { 0 };
+static _Atomic(int)     CacheReaping      = ATOMIC_VAR_INIT(0);
+
+static void cache_slab_free(MemoryCache_t* Cache, void* Object);
 
 // All the standard caches DO not use contigious memory
 static MemoryCache_t InitialCache = { 0 };
@@ -93,6 +107,68 @@ free_virtual_memory(uintptr_t Address, size_t PageCount)
     }
 }
 
+static MemorySlab_t**
+slab_map_entry(
+    _In_ uintptr_t Address,
+    _In_ int       Create)
+{
+    BlockBitmap_t*  Region = &GetMachine()->GlobalAccessMemory;
+    MemorySlab_t**  Leaf;
+    MemorySlab_t**  Expected = NULL;
+    size_t          Page;
+    size_t          Directory;
+
+    if (Address < Region->BlockStart || Address >= Region->BlockEnd) {
+        return NULL;
+    }
+
+    Page      = (Address - Region->BlockStart) / Region->BlockSize;
+    Directory = Page / SlabMapLeafEntries;
+    assert(Directory < MEMORY_SLAB_MAP_DIRECTORY);
+
+    Leaf = SlabMap[Directory];
+    if (Leaf == NULL) {
+        if (!Create) {
+            return NULL;
+        }
+
+        // Install a new leaf, somebody else might beat us to it
+        Leaf = (MemorySlab_t**)allocate_virtual_memory(0, 1);
+        assert(Leaf != NULL);
+        memset((void*)Leaf, 0, GetMemorySpacePageSize());
+        if (!atomic_compare_exchange_strong((_Atomic(MemorySlab_t**)*)&SlabMap[Directory], &Expected, Leaf)) {
+            free_virtual_memory((uintptr_t)Leaf, 1);
+            Leaf = Expected;
+        }
+    }
+    return &Leaf[Page % SlabMapLeafEntries];
+}
+
+static void
+slab_map_update(
+    _In_ uintptr_t     Address,
+    _In_ size_t        PageCount,
+    _In_ MemorySlab_t* Slab)
+{
+    size_t PageSize = GetMemorySpacePageSize();
+    size_t i;
+
+    for (i = 0; i < PageCount; i++) {
+        MemorySlab_t** Entry = slab_map_entry(Address + (i * PageSize), Slab != NULL);
+        if (Entry != NULL) {
+            *Entry = Slab;
+        }
+    }
+}
+
+static inline MemorySlab_t*
+slab_map_lookup(
+    _In_ uintptr_t Address)
+{
+    MemorySlab_t** Entry = slab_map_entry(Address, 0);
+    return (Entry != NULL) ? *Entry : NULL;
+}
+
 static inline struct FixedCache*
 cache_find_fixed_size(
     _In_ size_t Size)
@@ -200,6 +276,10 @@ slab_create(
     uintptr_t     DataAddress = allocate_virtual_memory(Cache->Flags, Cache->PageCount);
     TRACE("slab_create(%s): 0x%" PRIxIN "", Cache->Name, DataAddress);
 
+    if (!DataAddress) {
+        return NULL;
+    }
+
     if (Cache->SlabOnSite) {
         Slab          = (MemorySlab_t*)DataAddress;
         ObjectAddress = DataAddress + Cache->SlabStructureSize;
@@ -232,7 +312,9 @@ slab_create(
     Slab->NumberOfFreeObjects = Cache->ObjectCount;
     Slab->FreeBitmap          = (uint8_t*)((uintptr_t)Slab + sizeof(MemorySlab_t));
     Slab->Address             = (uintptr_t*)ObjectAddress;
+    Slab->Cache               = Cache;
     slab_initalize_objects(Cache, Slab);
+    slab_map_update(DataAddress, Cache->PageCount, Slab);
     return Slab;
 }
 
@@ -240,10 +322,12 @@ static void slab_destroy(MemoryCache_t* Cache, MemorySlab_t* Slab)
 {
     slab_destroy_objects(Cache, Slab);
     if (!Cache->SlabOnSite) {
+        slab_map_update((uintptr_t)Slab->Address, Cache->PageCount, NULL);
         free_virtual_memory((uintptr_t)Slab->Address, Cache->PageCount);
         kfree(Slab);
     }
     else {
+        slab_map_update((uintptr_t)Slab, Cache->PageCount, NULL);
         free_virtual_memory((uintptr_t)Slab, Cache->PageCount);
     }
 }
@@ -265,11 +349,25 @@ cache_dump_information(
     _In_ MemoryCache_t* Cache)
 {
     CollectionItem_t* Node;
+    size_t            Allocations = 0;
+    size_t            Frees       = 0;
+    size_t            Misses      = 0;
+    int               i;
     
     // Write cache information
     WRITELINE("%s: Object Size %" PRIuIN ", Alignment %" PRIuIN ", Padding %" PRIuIN ", Count %" PRIuIN ", FreeObjects %" PRIuIN "",
         Cache->Name, Cache->ObjectSize, Cache->ObjectAlignment, Cache->ObjectPadding,
         Cache->ObjectCount, Cache->NumberOfFreeObjects);
+    
+    // Write magazine statistics
+    for (i = 0; i < Cache->CpuCacheCount; i++) {
+        Allocations += Cache->CpuCaches[i].Allocations;
+        Frees       += Cache->CpuCaches[i].Frees;
+        Misses      += Cache->CpuCaches[i].Misses;
+    }
+    WRITELINE("Magazine Allocations %" PRIuIN ", Frees %" PRIuIN ", Misses %" PRIuIN ", Magazine Size %i, Depot %" PRIuIN "/%" PRIuIN " (full/empty), Contention %" PRIuIN ", Slabs Reaped %" PRIuIN "",
+        Allocations, Frees, Misses, Cache->Depot.MagazineSize, Cache->Depot.FullCount, Cache->Depot.EmptyCount, 
+        Cache->Depot.ContentionTotal + Cache->Depot.Contention, Cache->SlabsReaped);
         
     // Dump slabs
     WRITELINE("* full slabs");
@@ -289,40 +387,6 @@ cache_dump_information(
     WRITELINE("");
 }
 
-static int
-cache_contains_address(
-    _In_ MemoryCache_t* Cache,
-    _In_ uintptr_t      Address)
-{
-    CollectionItem_t* Node;
-    int               Found = 0;
-    TRACE("cache_contains_address(%s, 0x%" PRIxIN ")", Cache->Name, Address);
-
-    // Check partials first, we have to lock the cache as slabs can 
-    // get rearranged as we go, which is not ideal
-    dslock(&Cache->SyncObject);
-    _foreach(Node, &Cache->PartialSlabs) {
-        int Index = slab_contains_address(Cache, (MemorySlab_t*)Node, Address);
-        if (Index != -1) {
-            Found = 1;
-            break;
-        }
-    }
-
-    // Otherwise move on to the full slabs
-    if (!Found) {
-        _foreach(Node, &Cache->FullSlabs) {
-            int Index = slab_contains_address(Cache, (MemorySlab_t*)Node, Address);
-            if (Index != -1) {
-                Found = 1;
-                break;
-            }
-        }
-    }
-    dsunlock(&Cache->SyncObject);
-    return Found;
-}
-
 static inline size_t
 cache_calculate_slab_structure_size(
     _In_ size_t ObjectsPerSlab)
@@ -336,45 +400,345 @@ cache_calculate_slab_structure_size(
     return SlabStructure;
 }
 
-static size_t
-cache_calculate_atomic_cache(
+static int
+cache_calculate_magazine_size(
     _In_ MemoryCache_t* Cache)
 {
-    // number of cpu * cpu_cache_objects + number of cpu * objects per slab * pointer size
-    size_t BytesRequired = 0;
-    if (GetMachine()->NumberOfCores > 1) {
-        BytesRequired = (GetMachine()->NumberOfCores * 
-            (sizeof(MemoryAtomicCache_t) + (Cache->ObjectCount * sizeof(void*))));
-        if (cache_find_fixed_size(BytesRequired) == NULL) {
-            BytesRequired = 0;
-        }
+    // Start out with fewer rounds the larger the objects are, the depot grows them
+    // on demand when the depot is contended
+    if (Cache->ObjectSize <= 256) {
+        return 15;
     }
-    return BytesRequired;
+    else if (Cache->ObjectSize <= 4096) {
+        return 7;
+    }
+    else if (Cache->ObjectSize <= 32768) {
+        return 3;
+    }
+    return 1;
 }
 
 static void
 cache_initialize_atomic_cache(
     _In_ MemoryCache_t* Cache)
 {
-    size_t AtomicCacheSize = cache_calculate_atomic_cache(Cache);
-    int    i;
-    if (AtomicCacheSize) {
-        Cache->AtomicCaches = (uintptr_t)kmalloc(AtomicCacheSize);
-        memset((void*)Cache->AtomicCaches, 0, AtomicCacheSize);
-        for (i = 0; i < GetMachine()->NumberOfCores; i++) {
-            MemoryAtomicCache_t* AtomicCache = MEMORY_ATOMIC_CACHE(Cache, i);
-            AtomicCache->Available           = 0;
-            AtomicCache->Limit               = Cache->ObjectCount;
+    int               CoreCount = GetMachine()->NumberOfCores;
+    MemoryCpuCache_t* CpuCaches;
+
+    CpuCaches = (MemoryCpuCache_t*)kmalloc(CoreCount * sizeof(MemoryCpuCache_t));
+    memset(CpuCaches, 0, CoreCount * sizeof(MemoryCpuCache_t));
+    Cache->Depot.MagazineSize = cache_calculate_magazine_size(Cache);
+    Cache->CpuCaches          = CpuCaches;
+    Cache->CpuCacheCount      = CoreCount;
+}
+
+static MemoryMagazine_t*
+magazine_create(
+    _In_ int Capacity)
+{
+    MemoryMagazine_t* Magazine = (MemoryMagazine_t*)kmalloc(
+        sizeof(MemoryMagazine_t) + (Capacity * sizeof(void*)));
+    if (Magazine != NULL) {
+        Magazine->Link     = NULL;
+        Magazine->Capacity = Capacity;
+        Magazine->Rounds   = 0;
+    }
+    return Magazine;
+}
+
+static void
+magazine_destroy_list(
+    _In_ MemoryCache_t*    Cache,
+    _In_ MemoryMagazine_t* Magazine)
+{
+    while (Magazine != NULL) {
+        MemoryMagazine_t* Next = Magazine->Link;
+        while (Magazine->Rounds > 0) {
+            cache_slab_free(Cache, Magazine->Objects[--Magazine->Rounds]);
+        }
+        kfree(Magazine);
+        Magazine = Next;
+    }
+}
+
+static void
+depot_lock(
+    _In_ MemoryDepot_t* Depot)
+{
+    int Contended = atomic_load(&Depot->SyncObject.SyncObject) != 0;
+    dslock(&Depot->SyncObject);
+    
+    // Grow the magazines if the depot has been contended too often during the last period,
+    // the empty magazines of the old size are retired
+    Depot->Contention += Contended;
+    if (++Depot->Operations == MEMORY_DEPOT_CONTENTION_PERIOD) {
+        if (Depot->Contention >= MEMORY_DEPOT_CONTENTION_LIMIT && 
+            Depot->MagazineSize < MEMORY_MAGAZINE_MAX_ROUNDS) {
+            Depot->MagazineSize = MIN((Depot->MagazineSize * 2) + 1, MEMORY_MAGAZINE_MAX_ROUNDS);
+            while (Depot->Empty != NULL) {
+                MemoryMagazine_t* Magazine = Depot->Empty;
+                Depot->Empty   = Magazine->Link;
+                Magazine->Link = Depot->Stale;
+                Depot->Stale   = Magazine;
+            }
+            Depot->EmptyCount = 0;
+        }
+        Depot->ContentionTotal += Depot->Contention;
+        Depot->Operations       = 0;
+        Depot->Contention       = 0;
+    }
+}
+
+static MemoryMagazine_t*
+depot_exchange(
+    _In_ MemoryDepot_t*    Depot,
+    _In_ MemoryMagazine_t* Magazine,
+    _In_ int               WantFull)
+{
+    MemoryMagazine_t** List = WantFull ? &Depot->Full : &Depot->Empty;
+    MemoryMagazine_t*  Result;
+
+    depot_lock(Depot);
+    Result = *List;
+    if (Result != NULL) {
+        *List = Result->Link;
+        if (WantFull) Depot->FullCount--;
+        else          Depot->EmptyCount--;
+        Result->Link = NULL;
+        
+        // Only return the magazine we give in exchange when there was something to
+        // receive, otherwise the caller keeps it
+        if (Magazine != NULL) {
+            if (Magazine->Rounds != 0) {
+                Magazine->Link = Depot->Full;
+                Depot->Full    = Magazine;
+                Depot->FullCount++;
+            }
+            else if (Magazine->Capacity != Depot->MagazineSize) {
+                Magazine->Link = Depot->Stale;
+                Depot->Stale   = Magazine;
+            }
+            else {
+                Magazine->Link = Depot->Empty;
+                Depot->Empty   = Magazine;
+                Depot->EmptyCount++;
+            }
+        }
+    }
+    dsunlock(&Depot->SyncObject);
+    return Result;
+}
+
+static MemoryMagazine_t*
+depot_take_stale(
+    _In_ MemoryDepot_t* Depot)
+{
+    MemoryMagazine_t* Stale;
+    if (Depot->Stale == NULL) {
+        return NULL;
+    }
+    
+    dslock(&Depot->SyncObject);
+    Stale        = Depot->Stale;
+    Depot->Stale = NULL;
+    dsunlock(&Depot->SyncObject);
+    return Stale;
+}
+
+static void*
+cache_cpu_allocate(
+    _In_ MemoryCache_t* Cache)
+{
+    MemoryCpuCache_t* CpuCache;
+    MemoryMagazine_t* Magazine;
+    void*             Object = NULL;
+    int               CoreId = ArchGetProcessorCoreId();
+
+    if (Cache->CpuCaches == NULL || CoreId >= Cache->CpuCacheCount) {
+        return NULL;
+    }
+
+    // The lock also protects against being migrated while operating on the
+    // cache, another core will simply wait for it
+    CpuCache = &Cache->CpuCaches[CoreId];
+    dslock(&CpuCache->SyncObject);
+    if (CpuCache->Loaded == NULL || CpuCache->Loaded->Rounds == 0) {
+        if (CpuCache->Previous != NULL && CpuCache->Previous->Rounds != 0) {
+            Magazine           = CpuCache->Loaded;
+            CpuCache->Loaded   = CpuCache->Previous;
+            CpuCache->Previous = Magazine;
+        }
+        else {
+            // Exchange the empty previous magazine for a full one from the depot
+            Magazine = depot_exchange(&Cache->Depot, CpuCache->Previous, 1);
+            if (Magazine != NULL) {
+                CpuCache->Previous = CpuCache->Loaded;
+                CpuCache->Loaded   = Magazine;
+            }
+        }
+    }
+
+    if (CpuCache->Loaded != NULL && CpuCache->Loaded->Rounds != 0) {
+        Object = CpuCache->Loaded->Objects[--CpuCache->Loaded->Rounds];
+        CpuCache->Allocations++;
+    }
+    else {
+        CpuCache->Misses++;
+    }
+    dsunlock(&CpuCache->SyncObject);
+    return Object;
+}
+
+static int
+cache_cpu_free(
+    _In_ MemoryCache_t* Cache,
+    _In_ void*          Object)
+{
+    MemoryCpuCache_t* CpuCache;
+    MemoryMagazine_t* Magazine;
+    int               CoreId = ArchGetProcessorCoreId();
+    int               Attempt;
+    
+    if (Cache->CpuCaches == NULL || CoreId >= Cache->CpuCacheCount) {
+        return 0;
+    }
+
+    // Objects freed on other cores than they were allocated on are passed back
+    // through the depot as the magazines fill up
+    CpuCache = &Cache->CpuCaches[CoreId];
+    for (Attempt = 0; Attempt < 2; Attempt++) {
+        dslock(&CpuCache->SyncObject);
+        if (CpuCache->Loaded == NULL || CpuCache->Loaded->Rounds == CpuCache->Loaded->Capacity) {
+            if (CpuCache->Previous != NULL && CpuCache->Previous->Rounds == 0) {
+                Magazine           = CpuCache->Loaded;
+                CpuCache->Loaded   = CpuCache->Previous;
+                CpuCache->Previous = Magazine;
+            }
+            else {
+                // Exchange the full previous magazine for an empty one from the depot
+                Magazine = depot_exchange(&Cache->Depot, CpuCache->Previous, 0);
+                if (Magazine != NULL) {
+                    CpuCache->Previous = CpuCache->Loaded;
+                    CpuCache->Loaded   = Magazine;
+                }
+            }
+        }
+
+        if (CpuCache->Loaded != NULL && CpuCache->Loaded->Rounds < CpuCache->Loaded->Capacity) {
+            CpuCache->Loaded->Objects[CpuCache->Loaded->Rounds++] = Object;
+            CpuCache->Frees++;
+            dsunlock(&CpuCache->SyncObject);
+            return 1;
+        }
+        CpuCache->Misses++;
+        dsunlock(&CpuCache->SyncObject);
+        
+        // Out of empty magazines, allocate a new one for the depot while not holding 
+        // any locks as the magazine itself is allocated from the heap. Release any retired 
+        // magazines at the same time. While reaping no new magazines are created.
+        if (atomic_load(&CacheReaping)) {
+            break;
+        }
+        
+        magazine_destroy_list(Cache, depot_take_stale(&Cache->Depot));
+        if (Attempt == 0) {
+            Magazine = magazine_create(Cache->Depot.MagazineSize);
+            if (Magazine == NULL) {
+                break;
+            }
+            
+            dslock(&Cache->Depot.SyncObject);
+            Magazine->Link     = Cache->Depot.Empty;
+            Cache->Depot.Empty = Magazine;
+            Cache->Depot.EmptyCount++;
+            dsunlock(&Cache->Depot.SyncObject);
         }
     }
+    return 0;
 }
 
+// Moves all empty slabs of the cache onto the given list, this only takes the cache
+// lock so it can be done while holding the registry lock
 static void
-cache_drain_atomic_cache(MemoryCache_t* Cache)
+cache_unlink_free_slabs(
+    _In_ MemoryCache_t* Cache,
+    _In_ Collection_t*  Slabs)
 {
-    // Send out IPI to all cores to empty their caches and put them into the gloal
-    // cache, this should be done when attempting to free up memory.
-    // @todo
+    MemorySlab_t* Slab;
+
+    dslock(&Cache->SyncObject);
+    Slab = (MemorySlab_t*)CollectionPopFront(&Cache->FreeSlabs);
+    while (Slab != NULL) {
+        Cache->NumberOfFreeObjects -= Cache->ObjectCount;
+        Cache->SlabsReaped++;
+        CollectionAppend(Slabs, &Slab->Header);
+        Slab = (MemorySlab_t*)CollectionPopFront(&Cache->FreeSlabs);
+    }
+    dsunlock(&Cache->SyncObject);
+}
+
+// Destroys the unlinked slabs and releases their pages, this frees virtual memory
+// and must not be done with any heap locks held
+static int
+cache_release_slabs(
+    _In_ Collection_t* Slabs)
+{
+    MemorySlab_t* Slab;
+    int           PagesFreed = 0;
+
+    Slab = (MemorySlab_t*)CollectionPopFront(Slabs);
+    while (Slab != NULL) {
+        MemoryCache_t* Cache = Slab->Cache;
+        slab_destroy(Cache, Slab);
+        PagesFreed += (int)Cache->PageCount;
+        Slab = (MemorySlab_t*)CollectionPopFront(Slabs);
+    }
+    return PagesFreed;
+}
+
+static int
+cache_reap(
+    _In_ MemoryCache_t* Cache)
+{
+    Collection_t      Slabs     = COLLECTION_INIT(KeyInteger);
+    MemoryMagazine_t* Magazines = NULL;
+    MemoryMagazine_t* Magazine;
+    int               i;
+
+    // Collect all magazines from the cores and the depot, and return their objects
+    for (i = 0; i < Cache->CpuCacheCount; i++) {
+        MemoryCpuCache_t* CpuCache = &Cache->CpuCaches[i];
+        dslock(&CpuCache->SyncObject);
+        if (CpuCache->Loaded != NULL) {
+            CpuCache->Loaded->Link = Magazines;
+            Magazines              = CpuCache->Loaded;
+        }
+        if (CpuCache->Previous != NULL) {
+            CpuCache->Previous->Link = Magazines;
+            Magazines                = CpuCache->Previous;
+        }
+        CpuCache->Loaded   = NULL;
+        CpuCache->Previous = NULL;
+        dsunlock(&CpuCache->SyncObject);
+    }
+
+    dslock(&Cache->Depot.SyncObject);
+    while (Cache->Depot.Full != NULL || Cache->Depot.Empty != NULL || Cache->Depot.Stale != NULL) {
+        MemoryMagazine_t** List = Cache->Depot.Full != NULL ? &Cache->Depot.Full :
+            (Cache->Depot.Empty != NULL ? &Cache->Depot.Empty : &Cache->Depot.Stale);
+        Magazine       = *List;
+        *List          = Magazine->Link;
+        Magazine->Link = Magazines;
+        Magazines      = Magazine;
+    }
+    Cache->Depot.FullCount  = 0;
+    Cache->Depot.EmptyCount = 0;
+    dsunlock(&Cache->Depot.SyncObject);
+    magazine_destroy_list(Cache, Magazines);
+
+    // Release all the slabs that are now empty
+    cache_unlink_free_slabs(Cache, &Slabs);
+    return cache_release_slabs(&Slabs);
 }
 
 // Object size is the size of the actual object
@@ -493,6 +857,11 @@ MemoryCacheConstruct(
     if (!(Cache->Flags & (HEAP_CACHE_DEFAULT | HEAP_SLAB_NO_ATOMIC_CACHE))) {
         cache_initialize_atomic_cache(Cache);
     }
+
+    dslock(&CacheRegistryLock);
+    Cache->Link   = CacheRegistry;
+    CacheRegistry = Cache;
+    dsunlock(&CacheRegistryLock);
 }
 
 MemoryCache_t*
@@ -529,10 +898,31 @@ void
 MemoryCacheDestroy(
     _In_ MemoryCache_t* Cache)
 {
-    // If there are any cpu caches, free them, there is no need to drain the cpu caches
-    // here at this point as we assume that when destroying a cache we do it for good reason
-    if (Cache->AtomicCaches != 0) {
-        kfree((void*)Cache->AtomicCaches);
+    MemoryCache_t** Link;
+
+    dslock(&CacheRegistryLock);
+    Link = &CacheRegistry;
+    while (*Link != NULL && *Link != Cache) {
+        Link = &(*Link)->Link;
+    }
+    if (*Link != NULL) {
+        *Link = Cache->Link;
+    }
+    dsunlock(&CacheRegistryLock);
+
+    // A running reap might still hold a pin on the cache
+    while (atomic_load(&Cache->Pins) != 0) {
+        ArchProcessorIdle();
+    }
+
+    // Return all objects in the magazines before destroying the slabs, the magazines
+    // themselves are allocated from the heap
+    if (Cache->CpuCaches != NULL) {
+        MemoryCpuCache_t* CpuCaches = Cache->CpuCaches;
+        cache_reap(Cache);
+        Cache->CpuCacheCount = 0;
+        Cache->CpuCaches     = NULL;
+        kfree(CpuCaches);
     }
     cache_destroy_list(Cache, &Cache->FreeSlabs);
     cache_destroy_list(Cache, &Cache->PartialSlabs);
@@ -550,12 +940,9 @@ MemoryCacheAllocate(
     TRACE("MemoryCacheAllocate(%s)", Cache->Name);
 
     // Can we allocate from cpu cache?
-    if (Cache->AtomicCaches != 0) {
-        MemoryAtomicCache_t* AtomicCache = MEMORY_ATOMIC_CACHE(Cache, ArchGetProcessorCoreId());
-        if (AtomicCache->Available > 0) {
-            Allocated = MEMORY_ATOMIC_ELEMENT(AtomicCache, (--AtomicCache->Available))[0];
-            return Allocated;
-        }
+    Allocated = cache_cpu_allocate(Cache);
+    if (Allocated != NULL) {
+        return Allocated;
     }
 
     // Otherwise allocate from global cache  0x407018
@@ -584,6 +971,9 @@ MemoryCacheAllocate(
         // allocate and build new slab, put it into partial list right away
         // as we are allocating a new object immediately
         Slab = slab_create(Cache);
+        if (Slab == NULL && MemoryCacheReap() != 0) {
+            Slab = slab_create(Cache);
+        }
         assert(Slab != NULL);
         Index = slab_allocate_index(Cache, Slab);
         assert(Index != -1);
@@ -609,8 +999,6 @@ MemoryCacheFree(
     _In_ MemoryCache_t* Cache,
     _In_ void*          Object)
 {
-    CollectionItem_t* Node;
-    int CheckFull = 1;
     TRACE("MemoryCacheFree(%s, 0x%" PRIxIN ")", Cache->Name, Object);
 
     // Handle debug flags
@@ -619,61 +1007,89 @@ MemoryCacheFree(
     }
 
     // Can we push to cpu cache?
-    if (Cache->AtomicCaches != 0) {
-        MemoryAtomicCache_t* AtomicCache = MEMORY_ATOMIC_CACHE(Cache, ArchGetProcessorCoreId());
-        if (AtomicCache->Available < AtomicCache->Limit) {
-            MEMORY_ATOMIC_ELEMENT(AtomicCache, (AtomicCache->Available++))[0] = Object;
-            return;
-        }
+    if (!cache_cpu_free(Cache, Object)) {
+        cache_slab_free(Cache, Object);
     }
+}
 
-    dslock(&Cache->SyncObject);
+static void
+cache_slab_free(
+    _In_ MemoryCache_t* Cache,
+    _In_ void*          Object)
+{
+    MemorySlab_t* Slab;
+    int           WasFull;
+    int           Index;
 
-    // Check partials first, and move to free if neccessary
-    _foreach(Node, &Cache->PartialSlabs) {
-        MemorySlab_t* Slab  = (MemorySlab_t*)Node;
-        int           Index = slab_contains_address(Cache, Slab, (uintptr_t)Object);
-        if (Index != -1) {
-            slab_free_index(Cache, Slab, Index);
-            if (Slab->NumberOfFreeObjects == Cache->ObjectCount) {
-                CollectionRemoveByNode(&Cache->PartialSlabs, Node);
-                CollectionAppend(&Cache->FreeSlabs, Node);
-            }
-            CheckFull = 0;
-            Cache->NumberOfFreeObjects++;
-            break;
-        }
+    // Lookup the owning slab directly from the address
+    Slab = slab_map_lookup((uintptr_t)Object);
+    if (Slab == NULL || Slab->Cache != Cache) {
+        FATAL(FATAL_SCOPE_KERNEL, "cache_slab_free(%s): 0x%" PRIxIN " is not owned by the cache", 
+            Cache->Name, Object);
     }
+    Index = slab_contains_address(Cache, Slab, (uintptr_t)Object);
+    assert(Index != -1);
 
-    // Otherwise move on to the full slabs, and move to partial if neccessary
-    if (CheckFull) {
-        _foreach(Node, &Cache->FullSlabs) {
-            MemorySlab_t* Slab = (MemorySlab_t*)Node;
-            int           Index = slab_contains_address(Cache, Slab, (uintptr_t)Object);
-            if (Index != -1) {
-                slab_free_index(Cache, Slab, Index);
-                CollectionRemoveByNode(&Cache->FullSlabs, Node);
-                
-                // A slab can go directly from full to free if the count is 1
-                if (Cache->ObjectCount == 1) {
-                    CollectionAppend(&Cache->FreeSlabs, Node);
-                }
-                else {
-                    CollectionAppend(&Cache->PartialSlabs, Node);
-                }
-                Cache->NumberOfFreeObjects++;
-                break;
-            }
+    dslock(&Cache->SyncObject);
+    WasFull = (Slab->NumberOfFreeObjects == 0);
+    slab_free_index(Cache, Slab, Index);
+
+    // Move full slabs to partial (or free if the count is 1), and partial slabs to
+    // free if they are now empty
+    if (WasFull) {
+        CollectionRemoveByNode(&Cache->FullSlabs, &Slab->Header);
+        if (Cache->ObjectCount == 1) {
+            CollectionAppend(&Cache->FreeSlabs, &Slab->Header);
+        }
+        else {
+            CollectionAppend(&Cache->PartialSlabs, &Slab->Header);
         }
     }
+    else if (Slab->NumberOfFreeObjects == Cache->ObjectCount) {
+        CollectionRemoveByNode(&Cache->PartialSlabs, &Slab->Header);
+        CollectionAppend(&Cache->FreeSlabs, &Slab->Header);
+    }
+    Cache->NumberOfFreeObjects++;
     dsunlock(&Cache->SyncObject);
 }
 
 int MemoryCacheReap(void)
 {
-    // Iterate the caches in the system and drain their cpu caches
-    // Then start looking at the entirely free slabs, and free them.
-    return 0;
+    Collection_t   Slabs      = COLLECTION_INIT(KeyInteger);
+    MemoryCache_t* Pinned     = NULL;
+    MemoryCache_t* Cache;
+    int            PagesFreed = 0;
+    int            Expected   = 0;
+
+    // Reaping frees memory back into the caches, which might end up requesting new
+    // memory, so guard against recursion
+    if (!atomic_compare_exchange_strong(&CacheReaping, &Expected, 1)) {
+        return 0;
+    }
+
+    // Only unlink the empty slabs and pin the caches while the registry is locked,
+    // destroying slabs frees virtual memory which can require tlb shootdowns
+    dslock(&CacheRegistryLock);
+    Cache = CacheRegistry;
+    while (Cache != NULL) {
+        atomic_fetch_add(&Cache->Pins, 1);
+        Cache->ReapLink = Pinned;
+        Pinned          = Cache;
+        cache_unlink_free_slabs(Cache, &Slabs);
+        Cache = Cache->Link;
+    }
+    dsunlock(&CacheRegistryLock);
+    PagesFreed += cache_release_slabs(&Slabs);
+
+    // Flush the magazines of the pinned caches, which can empty out more slabs
+    while (Pinned != NULL) {
+        Cache  = Pinned;
+        Pinned = Cache->ReapLink;
+        PagesFreed += cache_reap(Cache);
+        atomic_fetch_sub(&Cache->Pins, 1);
+    }
+    atomic_store(&CacheReaping, 0);
+    return PagesFreed;
 }
 
 void* kmalloc(size_t Size)
@@ -709,25 +1125,13 @@ void* kmalloc_p(size_t Size, uintptr_t* DmaOut)
 
 void kfree(void* Object)
 {
-    struct FixedCache* Selected = NULL;
-    int                i = 0;
-
-    // Find the cache that the allocation was done in
-    while (DefaultCaches[i].ObjectSize != 0) {
-        if (DefaultCaches[i].Cache != NULL) {
-            if (cache_contains_address(DefaultCaches[i].Cache, (uintptr_t)Object)) {
-                Selected = &DefaultCaches[i];
-                break;
-            }
-        }
-        i++;
-    }
-    if (Selected == NULL) {
+    MemorySlab_t* Slab = slab_map_lookup((uintptr_t)Object);
+    if (Slab == NULL) {
         ERROR("Could not find a cache for object 0x%" PRIxIN "", Object);
         MemoryCacheDump(NULL);
         assert(0);   
     }
-    MemoryCacheFree(Selected->Cache, Object);
+    MemoryCacheFree(Slab->Cache, Object);
 }
 
 void
@@ -759,5 +1163,7 @@ MemoryCacheDump(
 void
 MemoryCacheInitialize(void)
 {
+    SlabMapLeafEntries = GetMemorySpacePageSize() / sizeof(MemorySlab_t*);
+    assert(DIVUP(GetMachine()->GlobalAccessMemory.BlockCount, SlabMapLeafEntries) <= MEMORY_SLAB_MAP_DIRECTORY);
     MemoryCacheConstruct(&InitialCache, "cache_cache", sizeof(MemoryCache_t), 0, 0, NULL, NULL);
 }
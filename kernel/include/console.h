@@ -39,6 +39,13 @@ InitializeSerialOutput(void);
 KERNELAPI OsStatus_t KERNELABI
 InitializeFramebufferOutput(void);
 
+/* InitializeFramebufferShadow (@arch)
+ * Allocates the shadow framebuffer and the glyph lookup tables. After this call all
+ * graphical rendering is done in memory, and is copied to the screen by VideoFlush.
+ * Returns OsOutOfMemory if the shadow can't be allocated, rendering then stays direct. */
+KERNELAPI OsStatus_t KERNELABI
+InitializeFramebufferShadow(void);
+
 /* InitializeConsole
  * Initializes the output environment. This enables either visual representation
  * and debugging of the kernel and enables a serial debugger. */
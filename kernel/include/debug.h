@@ -81,11 +81,13 @@ DebugBreakpoint(
 /* DebugPageFault
  * Handles page-fault and either validates or invalidates
  * that the address is valid. In case of valid address it automatically
- * maps in the page and returns OsSuccess */
+ * maps in the page and returns OsSuccess. Reads of untouched memory are
+ * backed by the shared zero page until the memory is written. */
 KERNELAPI OsStatus_t KERNELABI
 DebugPageFault(
     _In_ Context_t* Context,
-    _In_ uintptr_t  Address);
+    _In_ uintptr_t  Address,
+    _In_ int        IsWrite);
 
 /* DebugPanic
  * Kernel panic function - Call this to enter panic mode
@@ -88,4 +88,12 @@ KERNELAPI uintptr_t KERNELABI
 ValidateDeviceIoMemoryAddress(
     _In_ uintptr_t      Address);
 
+/* ValidateDeviceIoMemoryRange (@interrupt_context)
+ * Validates the given virtual range like ValidateDeviceIoMemoryAddress, the
+ * whole range must be inside a single io-space of the process */
+KERNELAPI uintptr_t KERNELABI
+ValidateDeviceIoMemoryRange(
+    _In_ uintptr_t      Address,
+    _In_ size_t         Length);
+
 #endif //!_MCORE_IOSPACE_H_
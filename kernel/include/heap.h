@@ -26,41 +26,78 @@
 
  // Slab size is equal to a page size, and memory layout of a slab is as below
  // FreeBitmap | Object | Object | Object |
+ // Every page of a slab is registered in the slab map, which allows the owning slab
+ // and cache of an object to be looked up directly from its address
 typedef struct {
-    CollectionItem_t Header;
-    volatile size_t  NumberOfFreeObjects;
-    uintptr_t*       Address;  // Points to first object
-    uint8_t*         FreeBitmap;
+    CollectionItem_t    Header;
+    volatile size_t     NumberOfFreeObjects;
+    uintptr_t*          Address;  // Points to first object
+    uint8_t*            FreeBitmap;
+    struct MemoryCache* Cache;
 } MemorySlab_t;
 
-// Memory Atomic Cache is followed directly by the buffer area for pointers
-// MemoryAtomicCache_t | Pointer | Pointer | Pointer | Pointer | MemoryAtomicCache_t ...
+// Magazines are stacks of object pointers that are exchanged between the per-core
+// caches and the depot as they fill up and empty out
+typedef struct MemoryMagazine {
+    struct MemoryMagazine* Link;
+    int                    Capacity;
+    int                    Rounds;
+    void*                  Objects[];
+} MemoryMagazine_t;
+
+// The per-core cache keeps a loaded and a previous magazine, the previous magazine
+// is always either completely full or completely empty
 typedef struct {
-    int Available;
-    int Limit;
-} MemoryAtomicCache_t;
+    SafeMemoryLock_t  SyncObject;
+    MemoryMagazine_t* Loaded;
+    MemoryMagazine_t* Previous;
+    size_t            Allocations;
+    size_t            Frees;
+    size_t            Misses;
+} MemoryCpuCache_t;
+
+// The depot holds full and empty magazines for all cores, the magazine size is grown
+// when the depot lock sees too much contention
+typedef struct {
+    SafeMemoryLock_t  SyncObject;
+    MemoryMagazine_t* Full;
+    MemoryMagazine_t* Empty;
+    MemoryMagazine_t* Stale;      // Magazines of an old size awaiting release
+    size_t            FullCount;
+    size_t            EmptyCount;
+    int               MagazineSize;
+    size_t            Operations;
+    size_t            Contention;
+    size_t            ContentionTotal;
+} MemoryDepot_t;
 
 typedef struct MemoryCache {
-    const char*      Name;
-    SafeMemoryLock_t SyncObject;
-    Flags_t          Flags;
-
-    size_t           ObjectSize;
-    size_t           ObjectAlignment;
-    size_t           ObjectPadding;
-    size_t           ObjectCount;      // Count per slab
-    size_t           PageCount;
-    volatile size_t  NumberOfFreeObjects;
-    void           (*ObjectConstructor)(struct MemoryCache*, void*);
-    void           (*ObjectDestructor)(struct MemoryCache*, void*);
-
-    int              SlabOnSite;
-    size_t           SlabStructureSize;
-    Collection_t     FreeSlabs;
-    Collection_t     PartialSlabs;
-    Collection_t     FullSlabs;
-
-    uintptr_t        AtomicCaches;
+    const char*         Name;
+    SafeMemoryLock_t    SyncObject;
+    Flags_t             Flags;
+    struct MemoryCache* Link;
+    struct MemoryCache* ReapLink;         // Set while the reaper holds a pin on the cache
+    _Atomic(int)        Pins;
+
+    size_t              ObjectSize;
+    size_t              ObjectAlignment;
+    size_t              ObjectPadding;
+    size_t              ObjectCount;      // Count per slab
+    size_t              PageCount;
+    volatile size_t     NumberOfFreeObjects;
+    void              (*ObjectConstructor)(struct MemoryCache*, void*);
+    void              (*ObjectDestructor)(struct MemoryCache*, void*);
+
+    int                 SlabOnSite;
+    size_t              SlabStructureSize;
+    Collection_t        FreeSlabs;
+    Collection_t        PartialSlabs;
+    Collection_t        FullSlabs;
+    size_t              SlabsReaped;
+
+    MemoryCpuCache_t*   CpuCaches;
+    int                 CpuCacheCount;
+    MemoryDepot_t       Depot;
 } MemoryCache_t;
 
 // Debug options for caches
@@ -103,8 +140,8 @@ void MemoryCacheFree(MemoryCache_t* Cache, void* Object);
 void MemoryCacheDestroy(MemoryCache_t* Cache);
 
 // MemoryCacheReap
-// Performs memory cleanup on all system caches, also shrinks them if possible
-// to free up memory. Returns number of pages freed.
+// Performs memory cleanup on all system caches, the per-core magazines and the depots
+// are emptied back into the slabs, and all empty slabs are released. Returns number of pages freed.
 int MemoryCacheReap(void);
 
 // MemoryCacheDump
@@ -43,8 +43,21 @@ typedef struct _SystemInterrupt {
     Flags_t                         Flags;
     int                             Source;
     struct _SystemInterrupt*        Link;
+
+    // Delivery of the interrupt, UUID_INVALID delivers to any core
+    UUId_t                          Affinity;
+    uintptr_t                       MsiXMapping;
+
+    // Event channel for userspace interrupts, the pending count also carries
+    // INTERRUPT_EVENT_CANCELLED so waiters can't miss the unregister
+    atomic_int                      Pending;
+    atomic_int                      References;
+    uint64_t                        PendingSince;
+    InterruptStatistics_t           Statistics;
 } SystemInterrupt_t;
 
+#define INTERRUPT_EVENT_CANCELLED       (1 << 30)
+
 /* InitializeInterruptTable
  * Initializes the static system interrupt table. This must be done before any driver interrupts
  * as they will rely on the system function table that gets passed along. */
@@ -108,6 +121,43 @@ InterruptHandle(
     _In_  int               TableIndex,
     _Out_ int*              Source);
 
+/* InterruptWaitForEvent
+ * Waits for the event of a userspace interrupt source to become signalled. Interrupts
+ * that occur while the event is pending are coalesced into the returned count. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptWaitForEvent(
+    _In_  UUId_t            Source,
+    _In_  size_t            Timeout,
+    _Out_ size_t*           EventsOut);
+
+/* InterruptGetStatistics
+ * Retrieves a copy of the event channel statistics for the interrupt source. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptGetStatistics(
+    _In_  UUId_t                 Source,
+    _Out_ InterruptStatistics_t* Statistics);
+
+/* InterruptGetCoreStatistics
+ * Retrieves the device interrupt load of the given core. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptGetCoreStatistics(
+    _In_  UUId_t                     CoreId,
+    _Out_ InterruptCoreStatistics_t* Statistics);
+
+/* InterruptSetAffinity
+ * Pins the vector of the interrupt source to the given core, or with UUID_INVALID
+ * leaves the placement of the vector to the balancer again. */
+KERNELAPI OsStatus_t KERNELABI
+InterruptSetAffinity(
+    _In_ UUId_t             Source,
+    _In_ UUId_t             CoreId);
+
+/* InitializeInterruptBalancer
+ * Starts the worker that samples the interrupt rate of each vector and moves vectors
+ * away from cores that are loaded more than the others. */
+KERNELAPI void KERNELABI
+InitializeInterruptBalancer(void);
+
 /* InterruptIncreasePenalty 
  * Increases the penalty for an interrupt source. This affects how the system allocates
  * interrupts when load balancing */
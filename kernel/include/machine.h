@@ -100,6 +100,7 @@ InitializeSystemMemory(
 
 // Flags for AllocateSystemMemory
 #define MEMORY_DOMAIN       (1 << 0)
+#define MEMORY_ALIGNED      (1 << 1) // Allocation is aligned to its own size, which must be a power of two
 
 /* AllocateSystemMemory 
  * Allocates a block of system memory with the given parameters. It's possible
@@ -19,7 +19,7 @@
  * MollenOS Memory Buffer Interface
  * - Implementation of the memory dma buffers. This provides a transfer buffer
  *   that is not bound to any specific virtual memory area but instead are bound
- *   to fixed physical addreses.
+ *   to fixed physical addreses. Scatter-gather buffers commit their pages lazily.
  */
 
 #ifndef __MEMORY_BUFFER_INTERFACE__
@@ -30,16 +30,19 @@
 #include <memoryspace.h>
 
 typedef struct {
-    uintptr_t Physical;
-    size_t    Capacity;
+    Flags_t           Flags;
+    size_t            Capacity;
+    int               PageCount;
+    atomic_uintptr_t  Pages[];  // 0 if the page is not committed yet
 } SystemMemoryBuffer_t;
 
 /* CreateMemoryBuffer 
  * Creates a new memory buffer instance of the given size. The allocation
  * of resources happens at this call, and reference is set to 1. Size is automatically
- * rounded up to a block-alignment */
+ * rounded up to a block-alignment. Scatter-gather buffers are only reserved. */
 KERNELAPI OsStatus_t KERNELABI
 CreateMemoryBuffer(
+    _In_  Flags_t       Flags,
     _In_  size_t        Size,
     _Out_ DmaBuffer_t*  MemoryBuffer);
 
@@ -60,6 +63,33 @@ QueryMemoryBuffer(
     _Out_ uintptr_t*    Dma,
     _Out_ size_t*       Capacity);
 
+/* QueryMemoryBufferSegments
+ * Retrieves the physical segments backing the given range of the memory buffer, and
+ * commits any pages in the range that were not committed yet. */
+KERNELAPI OsStatus_t KERNELABI
+QueryMemoryBufferSegments(
+    _In_    UUId_t        Handle,
+    _In_    size_t        Offset,
+    _In_    size_t        Length,
+    _In_    DmaSegment_t* Segments,
+    _InOut_ int*          SegmentCount);
+
+/* HandleMemoryBufferPageFault
+ * Commits the page of a scatter-gather buffer mapping that contains the faulting address.
+ * Returns OsDoesNotExist if the address is not part of any buffer mapping. */
+KERNELAPI OsStatus_t KERNELABI
+HandleMemoryBufferPageFault(
+    _In_ SystemMemorySpace_t* Space,
+    _In_ uintptr_t            Address);
+
+/* ReleaseMemoryBufferMapping
+ * Stops tracking the buffer mapping at the given address, must be called before the
+ * mapping is removed from the memory space. */
+KERNELAPI void KERNELABI
+ReleaseMemoryBufferMapping(
+    _In_ SystemMemorySpace_t* Space,
+    _In_ uintptr_t            Address);
+
 /* DestroyMemoryBuffer
  * Cleans up the resources associated with the handle. This function is registered
  * with the handle manager. */
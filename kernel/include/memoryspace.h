@@ -49,6 +49,8 @@ typedef struct _BlockBitmap BlockBitmap_t;
 #define MAPPING_DOMAIN                  0x00000040  // Memory allocated for mapping must be domain local
 #define MAPPING_COMMIT                  0x00000080  // Memory should be comitted immediately
 #define MAPPING_LOWFIRST                0x00000100  // Memory resources should be allocated by low-addresses first
+#define MAPPING_COPYONWRITE             0x00000200  // Memory is shared and will be copied on first write
+#define MAPPING_LOCAL                   0x00000400  // Memory is only accessed by the mapping core, never global
 
 #define MAPPING_PHYSICAL_DEFAULT        0x00000001  // (Physical) Mappings are default allocated
 #define MAPPING_PHYSICAL_CONTIGIOUS     0x00000002  // (Physical) Mappings are default allocated, as contigious
@@ -60,6 +62,8 @@ typedef struct _BlockBitmap BlockBitmap_t;
 #define MAPPING_VIRTUAL_FIXED           0x00000020  // (Virtual) Mapping is supplied
 #define MAPPING_VIRTUAL_MASK            0x00000038
 
+#define MAPPING_LARGEPAGES              0x00000040  // Mapping should be backed by large pages where possible
+
 typedef struct _SystemMemoryMappingHandler {
     CollectionItem_t Header;
     UUId_t           Handle;
@@ -68,9 +72,11 @@ typedef struct _SystemMemoryMappingHandler {
 } SystemMemoryMappingHandler_t;
 
 typedef struct _SystemMemorySpaceContext {
-    Collection_t*  MemoryHandlers;
-    BlockBitmap_t* HeapSpace;
-    uintptr_t      SignalHandler;
+    Collection_t*    MemoryHandlers;
+    Collection_t*    MemoryBuffers;
+    BlockBitmap_t*   HeapSpace;
+    uintptr_t        SignalHandler;
+    _Atomic(size_t)  Generation;
 } SystemMemorySpaceContext_t;
 
 typedef struct _SystemMemorySpace {
@@ -95,6 +101,16 @@ CreateMemorySpace(
     _In_  Flags_t Flags,
     _Out_ UUId_t* Handle);
 
+/* CloneMemorySpace
+ * Creates a new application memory space that is a copy of the user code and heap regions
+ * of the source space. Private pages are shared copy-on-write between the two spaces, so the
+ * clone is cheap and pages are only copied when either space writes to them. The source
+ * should be quiescent while it is being cloned. */
+KERNELAPI OsStatus_t KERNELABI
+CloneMemorySpace(
+    _In_  SystemMemorySpace_t* Source,
+    _Out_ UUId_t*              Handle);
+
 /* DestroyMemorySpace
  * Callback invoked by the handle system when references on a process reaches zero */
 KERNELAPI OsStatus_t KERNELABI
@@ -148,7 +164,9 @@ ChangeMemorySpaceProtection(
 /* CreateMemorySpaceMapping
  * Maps the given virtual address into the given address space
  * uses the given physical pages instead of automatic allocation
- * It returns the start address of the allocated physical region */
+ * It returns the start address of the allocated physical region. Committed ranges
+ * that are suitably aligned are mapped with large pages, for default allocated
+ * memory only if MAPPING_LARGEPAGES is given. */
 KERNELAPI OsStatus_t KERNELABI
 CreateMemorySpaceMapping(
     _In_        SystemMemorySpace_t* SystemMemorySpace,
@@ -161,7 +179,8 @@ CreateMemorySpaceMapping(
 
 /* CommitMemorySpaceMapping
  * Commits/finishes an already present memory mapping. If a physical address
- * is not already provided one will be allocated for the mapping. Flags must present. */
+ * is not already provided one will be allocated for the mapping. Flags must present.
+ * Pages committed for userspace memory are always zeroed. */
 KERNELAPI OsStatus_t KERNELABI
 CommitMemorySpaceMapping(
     _In_        SystemMemorySpace_t* SystemMemorySpace,
@@ -169,9 +188,20 @@ CommitMemorySpaceMapping(
     _In_        VirtualAddress_t     VirtualAddress,
     _In_        uintptr_t            PhysicalMask);
 
+/* CommitMemorySpaceZeroPage
+ * Commits the shared zero page for a reserved userspace page that is read before it has
+ * been written. The first write then gives the page a zeroed page of its own. Returns
+ * OsNotSupported if the page does not qualify. */
+KERNELAPI OsStatus_t KERNELABI
+CommitMemorySpaceZeroPage(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ VirtualAddress_t     VirtualAddress);
+
 /* CloneMemorySpaceMapping
  * Clones a region of memory mappings into the address space provided. The new mapping
- * will automatically be marked PERSISTANT and PROVIDED. */
+ * will automatically be marked PERSISTANT and PROVIDED. If MAPPING_COPYONWRITE is given the
+ * pages are instead shared copy-on-write, and both mappings keep their own copy of the
+ * memory once written to. */
 KERNELAPI OsStatus_t KERNELABI
 CloneMemorySpaceMapping(
     _In_        SystemMemorySpace_t* SourceSpace,
@@ -182,6 +212,21 @@ CloneMemorySpaceMapping(
     _In_        Flags_t              MemoryFlags,
     _In_        Flags_t              PlacementFlags);
 
+/* HandleCopyOnWritePageFault
+ * Resolves a write fault on a copy-on-write page by giving the space a private copy of
+ * the page. Returns OsDoesNotExist if the page at the address is not copy-on-write. */
+KERNELAPI OsStatus_t KERNELABI
+HandleCopyOnWritePageFault(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ VirtualAddress_t     Address);
+
+/* FreeMemorySpacePage
+ * Releases a physical page that was mapped by a memory space. Pages that are shared
+ * copy-on-write are only freed once the last mapping of them is released. */
+KERNELAPI OsStatus_t KERNELABI
+FreeMemorySpacePage(
+    _In_ PhysicalAddress_t Address);
+
 /* RemoveMemorySpaceMapping
  * Unmaps a virtual memory region from an address space */
 KERNELAPI OsStatus_t KERNELABI
@@ -226,4 +271,12 @@ IsMemorySpacePagePresent(
 KERNELAPI size_t KERNELABI
 GetMemorySpacePageSize(void);
 
+/* GetMemorySpaceGeneration
+ * Retrieves the translation generation of the memory space. The generation changes whenever
+ * translations of the space or its relatives are changed or removed, and is unique across
+ * all spaces. Spaces without a context, like the kernel space, always return 0. */
+KERNELAPI size_t KERNELABI
+GetMemorySpaceGeneration(
+    _In_ SystemMemorySpace_t* SystemMemorySpace);
+
 #endif //!__MEMORY_SPACE_INTERFACE__
@@ -54,17 +54,19 @@ InitializeModuleInheritationBlock(void);
 
 /* RegisterModule
  * Registers a new system module resource that is then available for the operating system
- * to use. The resource can be can be either an driver, service or a generic file. */
+ * to use. The resource can be can be either an driver, service or a generic file. Resources
+ * stored packed in the ramdisk are given by <PackedData> instead, and are unpacked on first use. */
 KERNELAPI OsStatus_t KERNELABI
 RegisterModule(
-    _In_ const char*        Path,
-    _In_ const void*        Data,
-    _In_ size_t             Length,
-    _In_ SystemModuleType_t Type,
-    _In_ DevInfo_t          VendorId,
-    _In_ DevInfo_t          DeviceId,
-    _In_ DevInfo_t          DeviceClass,
-    _In_ DevInfo_t          DeviceSubclass);
+    _In_     const char*        Path,
+    _In_Opt_ const void*        Data,
+    _In_Opt_ const void*        PackedData,
+    _In_     size_t             Length,
+    _In_     SystemModuleType_t Type,
+    _In_     DevInfo_t          VendorId,
+    _In_     DevInfo_t          DeviceId,
+    _In_     DevInfo_t          DeviceClass,
+    _In_     DevInfo_t          DeviceSubclass);
 
 /* SpawnServices
  * Loads all system services present in the initial ramdisk. */
@@ -44,11 +44,12 @@ typedef enum _SystemModuleType {
 } SystemModuleType_t;
 
 typedef struct {
-    CollectionItem_t ListHeader;
-    UUId_t           Handle;
-    MString_t*       Path;
-    const void*      Data;
-    size_t           Length;
+    CollectionItem_t     ListHeader;
+    UUId_t               Handle;
+    MString_t*           Path;
+    _Atomic(const void*) Data;
+    const void*          PackedData; // Set for modules that are unpacked on first use
+    size_t               Length;
 
     // Used by Module/Service type
     void*           InheritanceBlock;
@@ -29,6 +29,7 @@
  * This is the magic signature, must be present in the ramdisk image file */
 #define RAMDISK_MAGIC               0x3144524D
 #define RAMDISK_VERSION_1           0x01
+#define RAMDISK_VERSION_2           0x02
 
 /* Supported architectures, must of course match
  * the architecture the kernel has been compiled with */
@@ -62,7 +63,8 @@ PACKED_TYPESTRUCT(SystemRamdiskEntry, {
 });
 
 // The module header type is preceeding the actual data, and act
-// as a descriptor about the data
+// as a descriptor about the data. In version 2 the data is described by
+// a chunk table, and the checksum covers only the chunk table
 PACKED_TYPESTRUCT(SystemRamdiskModuleHeader, {
     uint32_t Flags;
     uint32_t LengthOfData; // Excluding this header
@@ -74,6 +76,22 @@ PACKED_TYPESTRUCT(SystemRamdiskModuleHeader, {
     uint32_t DeviceSubType;
 });
 
+/* Version 2 ramdisks store the data of every entry in independently compressed
+ * chunks of RAMDISK_CHUNK_SIZE bytes (the last chunk may be shorter), so entries
+ * can be unpacked when they are first used and the chunks of an entry in parallel */
+#define RAMDISK_CHUNK_SIZE          0x10000
+
+#define RAMDISK_CHUNK_LZ4           0x1 // The chunk is compressed, otherwise it is stored as is
+
+// The chunk table follows right after the module header. Identical chunks are
+// stored once, so the data of a chunk can be shared by several entries
+PACKED_TYPESTRUCT(SystemRamdiskChunk, {
+    uint32_t Flags;
+    uint32_t Offset;      // Offset of the stored data in the ramdisk
+    uint32_t Length;      // Length of the stored data
+    uint32_t Crc32OfData; // Of the stored data
+});
+
 /* ParseInitialRamdisk
  * Parses the supplied ramdisk by the bootloader. Without a ramdisk present only debug
  * functionality will be available. */
@@ -81,4 +99,13 @@ KERNELAPI OsStatus_t KERNELABI
 ParseInitialRamdisk(
     _In_ Multiboot_t* BootInformation);
 
+/* UnpackRamdiskModule
+ * Unpacks the data of a version 2 ramdisk entry into the buffer, which must be able to hold
+ * the length of the data. Chunks are validated as they are unpacked, and are unpacked in
+ * parallel on the application cores. */
+KERNELAPI OsStatus_t KERNELABI
+UnpackRamdiskModule(
+    _In_ const SystemRamdiskModuleHeader_t* Header,
+    _In_ void*                              Buffer);
+
 #endif //!__RAMDISK_H__
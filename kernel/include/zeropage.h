@@ -0,0 +1,60 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS Zero Pages
+ * - The shared zero page that backs memory that has only been read, and the
+ *   per-core pools of pre-zeroed pages that back memory once it is written.
+ */
+
+#ifndef _MCORE_ZEROPAGE_H_
+#define _MCORE_ZEROPAGE_H_
+
+#include <os/osdefs.h>
+
+/* InitializeZeroPages
+ * Allocates the shared zero page and starts the worker that keeps the pools of pre-zeroed
+ * pages filled. Until then zeroed pages are zeroed on demand. */
+KERNELAPI void KERNELABI
+InitializeZeroPages(void);
+
+/* GetZeroPage
+ * Retrieves the physical address of the shared zero page, or 0 if it is not available. The
+ * zero page must never be mapped writable. */
+KERNELAPI PhysicalAddress_t KERNELABI
+GetZeroPage(void);
+
+/* IsZeroPage
+ * Returns whether or not the physical address lies within the shared zero page. */
+KERNELAPI int KERNELABI
+IsZeroPage(
+    _In_ PhysicalAddress_t Address);
+
+/* AllocateZeroedPage
+ * Allocates a physical page that is filled with zeros. The page is taken from the pool of the
+ * calling core, and only zeroed on demand if the pool is empty or the mask is restricted. */
+KERNELAPI PhysicalAddress_t KERNELABI
+AllocateZeroedPage(
+    _In_ uintptr_t Mask);
+
+/* ReleaseZeroedPage
+ * Returns an unused page from AllocateZeroedPage, the page must not have been written to. */
+KERNELAPI void KERNELABI
+ReleaseZeroedPage(
+    _In_ PhysicalAddress_t Address);
+
+#endif //!_MCORE_ZEROPAGE_H_
@@ -24,6 +24,7 @@
 #define __MODULE        "INIF"
 //#define __TRACE
 
+#include <component/domain.h>
 #include <component/cpu.h>
 #include <modules/manager.h>
 #include <ddk/interrupt.h>
@@ -33,20 +34,42 @@
 #include <memoryspace.h>
 #include <interrupts.h>
 #include <threading.h>
+#include <scheduler.h>
+#include <timers.h>
 #include <deviceio.h>
+#include <machine.h>
 #include <debug.h>
 #include <heap.h>
 #include <arch.h>
 
+#define INTERRUPT_MAX_CORES         256
+#define INTERRUPT_MSIX_ENTRY_SIZE   16
+#define INTERRUPT_BALANCE_INTERVAL  1000    // Sampling period of the balancer in ms
+#define INTERRUPT_BALANCE_MINIMUM   200     // Interrupts per second before a core is balanced
+
 typedef struct _InterruptTableEntry {
     SystemInterrupt_t* Descriptor;
     int                Penalty;
     int                Sharable;
+
+    // Vector placement, the affinity is UUID_INVALID when delivered to any core
+    UUId_t             Affinity;
+    int                Pinned;
+    size_t             Count;
+    size_t             LastCount;
+    size_t             Rate;
 } InterruptTableEntry_t;
 
+typedef struct _InterruptCore {
+    InterruptCoreStatistics_t Statistics;
+    size_t                    LastInterrupts;
+} InterruptCore_t;
+
 static InterruptTableEntry_t InterruptTable[MAX_SUPPORTED_INTERRUPTS] = { { 0 } };
+static InterruptCore_t       InterruptCores[INTERRUPT_MAX_CORES]      = { { { 0 } } };
 static SafeMemoryLock_t      InterruptTableSyncObject = { 0 };
 static _Atomic(UUId_t)       InterruptIdGenerator     = ATOMIC_VAR_INIT(0);
+static UUId_t                InterruptBalancerHandle  = UUID_INVALID;
 
 /* InterruptIncreasePenalty 
  * Increases the penalty for an interrupt source. */
@@ -252,6 +275,64 @@ InterruptResolveMemoryResources(
     return Status;
 }
 
+/* InterruptCleanupMsiXEntry
+ * Releases the kernel mapping of the MSI-X table entry. */
+OsStatus_t
+InterruptCleanupMsiXEntry(
+    _In_ SystemInterrupt_t* Interrupt)
+{
+    uintptr_t Offset;
+    
+    if (Interrupt->MsiXMapping == 0) {
+        return OsSuccess;
+    }
+
+    Offset = Interrupt->MsiXMapping % GetMemorySpacePageSize();
+    if (RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Interrupt->MsiXMapping - Offset,
+            INTERRUPT_MSIX_ENTRY_SIZE + Offset) != OsSuccess) {
+        ERROR(" > failed to remove msi-x entry mapping");
+        return OsError;
+    }
+    Interrupt->MsiXMapping = 0;
+    return OsSuccess;
+}
+
+/* InterruptResolveMsiXEntry
+ * Maps the MSI-X table entry into kernel space, so the entry can be programmed when the
+ * vector moves. The entry must be aligned like the table entries are, and lie entirely
+ * inside an io-space the module has acquired. */
+OsStatus_t
+InterruptResolveMsiXEntry(
+    _In_ SystemInterrupt_t* Interrupt)
+{
+    uintptr_t  Physical;
+    uintptr_t  Virtual;
+    uintptr_t  Offset;
+    OsStatus_t Status;
+
+    if (!(Interrupt->Flags & INTERRUPT_MSI) || Interrupt->Interrupt.MsiXEntry == 0) {
+        return OsSuccess;
+    }
+
+    Physical = ValidateDeviceIoMemoryRange(Interrupt->Interrupt.MsiXEntry, INTERRUPT_MSIX_ENTRY_SIZE);
+    if (Physical == 0 || (Physical & (INTERRUPT_MSIX_ENTRY_SIZE - 1)) != 0) {
+        ERROR(" > msi-x entry is not inside an acquired io-space");
+        return OsError;
+    }
+
+    Offset    = Physical % GetMemorySpacePageSize();
+    Physical -= Offset;
+    Status    = CreateMemorySpaceMapping(GetCurrentMemorySpace(), &Physical, &Virtual,
+        INTERRUPT_MSIX_ENTRY_SIZE + Offset, MAPPING_COMMIT | MAPPING_NOCACHE | MAPPING_PERSISTENT,
+        MAPPING_PHYSICAL_FIXED | MAPPING_VIRTUAL_GLOBAL, __MASK);
+    if (Status != OsSuccess) {
+        ERROR(" > failed to map the msi-x entry");
+        return OsError;
+    }
+    Interrupt->MsiXMapping = Virtual + Offset;
+    return OsSuccess;
+}
+
 /* InterruptResolveResources
  * Maps the neccessary fast-interrupt resources into kernel space
  * and allowing the interrupt handler to access the requested memory spaces. */
@@ -297,6 +378,12 @@ InterruptResolveResources(
         ERROR(" > failed to remap interrupt memory resources");
         return OsError;
     }
+
+    TRACE(" > remapping msi-x entry");
+    if (InterruptResolveMsiXEntry(Interrupt) != OsSuccess) {
+        ERROR(" > failed to remap interrupt msi-x entry");
+        return OsError;
+    }
     return OsSuccess;
 }
 
@@ -335,6 +422,143 @@ InterruptReleaseResources(
         ERROR(" > failed to cleanup interrupt memory resources");
         return OsError;
     }
+
+    if (InterruptCleanupMsiXEntry(Interrupt) != OsSuccess) {
+        ERROR(" > failed to cleanup interrupt msi-x entry");
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+/* InterruptGetProcessor
+ * Retrieves the processor whose cores the interrupts are spread across. */
+static SystemCpu_t*
+InterruptGetProcessor(void)
+{
+    SystemDomain_t* Domain = GetCurrentDomain();
+    if (Domain != NULL) {
+        return &Domain->CoreGroup;
+    }
+    return &GetMachine()->Processor;
+}
+
+/* InterruptGetCore
+ * Retrieves the core at the given index of the processor, if it's running and can
+ * be targeted by interrupts. */
+static SystemCpuCore_t*
+InterruptGetCore(
+    _In_ SystemCpu_t* Processor,
+    _In_ int          Index)
+{
+    SystemCpuCore_t* Core = (Index == 0) ? &Processor->PrimaryCore : &Processor->ApplicationCores[Index - 1];
+    if (!(Core->State & CpuStateRunning) || Core->Id >= INTERRUPT_MAX_CORES) {
+        return NULL;
+    }
+    return Core;
+}
+
+/* InterruptSelectCore
+ * Selects the core with the lowest interrupt rate for a new vector, ties are broken
+ * by the number of vectors that already target the cores. */
+static UUId_t
+InterruptSelectCore(void)
+{
+    SystemCpu_t*     Processor = InterruptGetProcessor();
+    SystemCpuCore_t* Core;
+    InterruptCore_t* Selected  = NULL;
+    UUId_t           CoreId    = UUID_INVALID;
+    int              i;
+
+    for (i = 0; i < Processor->NumberOfCores; i++) {
+        Core = InterruptGetCore(Processor, i);
+        if (Core == NULL) {
+            continue;
+        }
+
+        if (Selected == NULL
+            || InterruptCores[Core->Id].Statistics.Rate < Selected->Statistics.Rate
+            || (InterruptCores[Core->Id].Statistics.Rate == Selected->Statistics.Rate
+                && InterruptCores[Core->Id].Statistics.Vectors < Selected->Statistics.Vectors)) {
+            Selected = &InterruptCores[Core->Id];
+            CoreId   = Core->Id;
+        }
+    }
+    return CoreId;
+}
+
+/* InterruptIsCoreAvailable
+ * Returns 1 if the core is running and can be targeted by interrupts. */
+static int
+InterruptIsCoreAvailable(
+    _In_ UUId_t CoreId)
+{
+    SystemCpu_t*     Processor = InterruptGetProcessor();
+    SystemCpuCore_t* Core;
+    int              i;
+
+    for (i = 0; i < Processor->NumberOfCores; i++) {
+        Core = InterruptGetCore(Processor, i);
+        if (Core != NULL && Core->Id == CoreId) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* InterruptCanMigrate
+ * A vector can move while it's enabled if it's targeted, and all its sources are io-apic
+ * lines or MSI-X entries. Plain MSI messages live in the device config space. */
+static int
+InterruptCanMigrate(
+    _In_ InterruptTableEntry_t* Vector)
+{
+    SystemInterrupt_t* Entry = Vector->Descriptor;
+
+    if (Vector->Affinity == UUID_INVALID || Entry == NULL) {
+        return 0;
+    }
+    while (Entry != NULL) {
+        if ((Entry->Flags & INTERRUPT_MSI) && Entry->MsiXMapping == 0) {
+            return 0;
+        }
+        Entry = Entry->Link;
+    }
+    return 1;
+}
+
+/* InterruptMigrate
+ * Moves all sources of the vector to the given core, the table lock must be held. */
+static OsStatus_t
+InterruptMigrate(
+    _In_ UUId_t TableIndex,
+    _In_ UUId_t CoreId)
+{
+    InterruptTableEntry_t* Vector = &InterruptTable[TableIndex];
+    SystemInterrupt_t*     Entry  = Vector->Descriptor;
+    SystemInterrupt_t*     Failed;
+
+    TRACE("InterruptMigrate(Vector %" PRIuIN ", Core %" PRIuIN " => %" PRIuIN ")",
+        TableIndex, Vector->Affinity, CoreId);
+    while (Entry != NULL) {
+        if (InterruptSetDestination(Entry, CoreId) != OsSuccess) {
+            ERROR("Failed to move vector %" PRIuIN " to core %" PRIuIN "", TableIndex, CoreId);
+
+            // Sources that already moved are put back, so the vector is delivered
+            // to the core the bookkeeping says it is
+            for (Failed = Entry, Entry = Vector->Descriptor; Entry != Failed; Entry = Entry->Link) {
+                if (InterruptSetDestination(Entry, Vector->Affinity) != OsSuccess) {
+                    ERROR("Failed to restore vector %" PRIuIN " on core %" PRIuIN "",
+                        TableIndex, Vector->Affinity);
+                }
+            }
+            return OsError;
+        }
+        Entry = Entry->Link;
+    }
+
+    InterruptCores[Vector->Affinity].Statistics.Vectors--;
+    InterruptCores[CoreId].Statistics.Vectors++;
+    Vector->Affinity = CoreId;
     return OsSuccess;
 }
 
@@ -360,6 +584,8 @@ InterruptRegister(
     Entry->ModuleHandle = UUID_INVALID;
     Entry->Thread       = GetCurrentThreadId();
     Entry->Flags        = Flags;
+    Entry->Affinity     = UUID_INVALID;
+    atomic_store(&Entry->References, 1);
 
     // Get process id?
     if (!(Flags & INTERRUPT_KERNEL)) {
@@ -414,6 +640,17 @@ InterruptRegister(
         InterruptTable[TableIndex].Descriptor = Entry;
         InterruptTable[TableIndex].Penalty    = 1;
         InterruptTable[TableIndex].Sharable   = (Flags & INTERRUPT_NOTSHARABLE) ? 0 : 1;
+        InterruptTable[TableIndex].Pinned     = 0;
+        InterruptTable[TableIndex].Affinity   = UUID_INVALID;
+
+        // Device interrupts are given a core of their own choosing, kernel interrupts
+        // keep being delivered to any core
+        if (!(Flags & (INTERRUPT_KERNEL | INTERRUPT_SOFT))) {
+            InterruptTable[TableIndex].Affinity = InterruptSelectCore();
+            if (InterruptTable[TableIndex].Affinity != UUID_INVALID) {
+                InterruptCores[InterruptTable[TableIndex].Affinity].Statistics.Vectors++;
+            }
+        }
     }
     else {
         // Insert and increase penalty
@@ -424,6 +661,18 @@ InterruptRegister(
         }
     }
 
+    // The vector is shared by all sources on it, so they share the core as well
+    if (InterruptTable[TableIndex].Affinity != UUID_INVALID) {
+        if (InterruptSetDestination(Entry, InterruptTable[TableIndex].Affinity) == OsSuccess) {
+            Interrupt->MsiAddress = Entry->Interrupt.MsiAddress;
+            Interrupt->MsiValue   = Entry->Interrupt.MsiValue;
+        }
+        else if (Entry->Link == NULL) {
+            InterruptCores[InterruptTable[TableIndex].Affinity].Statistics.Vectors--;
+            InterruptTable[TableIndex].Affinity = UUID_INVALID;
+        }
+    }
+
     // Enable the new interrupt
     if (InterruptConfigure(Entry, 1) != OsSuccess) {
         ERROR("Failed to enable source %" PRIiIN "", Entry->Source);
@@ -468,6 +717,14 @@ InterruptUnregister(
             else {
                 Previous->Link = Entry->Link;
             }
+
+            // Release the core of the vector once it's unused
+            if (InterruptTable[TableIndex].Descriptor == NULL
+                && InterruptTable[TableIndex].Affinity != UUID_INVALID) {
+                InterruptCores[InterruptTable[TableIndex].Affinity].Statistics.Vectors--;
+                InterruptTable[TableIndex].Affinity = UUID_INVALID;
+                InterruptTable[TableIndex].Pinned   = 0;
+            }
             break;
         }
         
@@ -488,9 +745,9 @@ InterruptUnregister(
     }
 
     // Entry is now unlinked, clean it up 
-    // mask the interrupt again if neccessary
+    // mask the interrupt again if neccessary, MSI-X entries are masked individually
     if (Found == 1) {
-        if (InterruptTable[Entry->Source].Penalty == 0) {
+        if ((Entry->Flags & INTERRUPT_MSI) || InterruptTable[Entry->Source].Penalty == 0) {
             InterruptConfigure(Entry, 0);
         }
         if (Entry->ModuleHandle != UUID_INVALID) {
@@ -498,7 +755,15 @@ InterruptUnregister(
                 ERROR(" > failed to cleanup interrupt resources");
             }
         }
-        kfree(Entry);
+
+        // Wake any threads waiting for events, the last reference cleans up. The
+        // cancel is part of the pending value, so a waiter that is about to sleep
+        // fails its sleep condition instead of missing the wakeup
+        atomic_fetch_or(&Entry->Pending, INTERRUPT_EVENT_CANCELLED);
+        SchedulerHandleSignalAll((uintptr_t*)&Entry->Pending);
+        if (atomic_fetch_sub(&Entry->References, 1) == 1) {
+            kfree(Entry);
+        }
     }
     return Result;
 }
@@ -515,10 +780,180 @@ InterruptGet(
         if (Iterator->Id == Source) {
             return Iterator;
         }
+        Iterator = Iterator->Link;
     }
     return NULL;
 }
 
+/* InterruptSignalEvent
+ * Raises the event of a userspace interrupt from interrupt context. If the event
+ * is already pending the interrupt is coalesced, and no wakeup is neccessary. */
+static void
+InterruptSignalEvent(
+    _In_ SystemInterrupt_t* Entry)
+{
+    LargeInteger_t Tick = { { 0 } };
+
+    TimersQueryPerformanceTick(&Tick);
+    Entry->Statistics.Raised++;
+    if (atomic_fetch_add(&Entry->Pending, 1) == 0) {
+        Entry->PendingSince = (uint64_t)Tick.QuadPart;
+        SchedulerHandleSignal((uintptr_t*)&Entry->Pending);
+    }
+    else {
+        Entry->Statistics.Coalesced++;
+    }
+}
+
+OsStatus_t
+InterruptWaitForEvent(
+    _In_  UUId_t  Source,
+    _In_  size_t  Timeout,
+    _Out_ size_t* EventsOut)
+{
+    SystemInterrupt_t* Entry;
+    OsStatus_t         Status = OsError;
+    LargeInteger_t     Tick   = { { 0 } };
+    uint64_t           Latency;
+    int                Expected;
+    int                Events;
+
+    if (LOWORD(Source) >= MAX_SUPPORTED_INTERRUPTS || EventsOut == NULL) {
+        return OsInvalidParameters;
+    }
+
+    // Take a reference on the entry while it's linked, so it stays valid
+    // across the sleep even if it's unregistered meanwhile
+    dslock(&InterruptTableSyncObject);
+    Entry = InterruptGet(Source);
+    if (Entry == NULL || GetCurrentModule() == NULL 
+        || Entry->ModuleHandle != GetCurrentModule()->Handle) {
+        dsunlock(&InterruptTableSyncObject);
+        return OsInvalidPermissions;
+    }
+    atomic_fetch_add(&Entry->References, 1);
+    dsunlock(&InterruptTableSyncObject);
+
+    while (1) {
+        // Take the pending events unless the source was cancelled
+        Events = atomic_load(&Entry->Pending);
+        while (Events != 0 && !(Events & INTERRUPT_EVENT_CANCELLED)
+            && !atomic_compare_exchange_weak(&Entry->Pending, &Events, 0));
+
+        if (Events & INTERRUPT_EVENT_CANCELLED) {
+            Status = OsError;
+            break;
+        }
+        if (Events != 0) {
+            TimersQueryPerformanceTick(&Tick);
+            Latency = (uint64_t)Tick.QuadPart - Entry->PendingSince;
+            Entry->Statistics.Delivered++;
+            Entry->Statistics.LatencyTotal += Latency;
+            Entry->Statistics.LatencyMax    = MAX(Entry->Statistics.LatencyMax, Latency);
+            *EventsOut = (size_t)Events;
+            Status     = OsSuccess;
+            break;
+        }
+
+        // Sleep fails with sync-failed if an interrupt or the cancel arrived meanwhile
+        Expected = 0;
+        if (SchedulerAtomicThreadSleep(&Entry->Pending, &Expected, Timeout) == SCHEDULER_SLEEP_TIMEOUT) {
+            Status = OsTimeout;
+            break;
+        }
+    }
+
+    if (atomic_fetch_sub(&Entry->References, 1) == 1) {
+        kfree(Entry);
+    }
+    return Status;
+}
+
+OsStatus_t
+InterruptGetStatistics(
+    _In_  UUId_t                 Source,
+    _Out_ InterruptStatistics_t* Statistics)
+{
+    SystemInterrupt_t* Entry;
+
+    if (LOWORD(Source) >= MAX_SUPPORTED_INTERRUPTS || Statistics == NULL) {
+        return OsInvalidParameters;
+    }
+
+    dslock(&InterruptTableSyncObject);
+    Entry = InterruptGet(Source);
+    if (Entry == NULL) {
+        dsunlock(&InterruptTableSyncObject);
+        return OsDoesNotExist;
+    }
+    memcpy(Statistics, &Entry->Statistics, sizeof(InterruptStatistics_t));
+    Statistics->Vector      = (int)LOWORD(Source);
+    Statistics->Core        = InterruptTable[LOWORD(Source)].Affinity;
+    Statistics->VectorCount = InterruptTable[LOWORD(Source)].Count;
+    Statistics->VectorRate  = InterruptTable[LOWORD(Source)].Rate;
+    dsunlock(&InterruptTableSyncObject);
+    return OsSuccess;
+}
+
+OsStatus_t
+InterruptGetCoreStatistics(
+    _In_  UUId_t                     CoreId,
+    _Out_ InterruptCoreStatistics_t* Statistics)
+{
+    if (CoreId >= INTERRUPT_MAX_CORES || Statistics == NULL) {
+        return OsInvalidParameters;
+    }
+
+    dslock(&InterruptTableSyncObject);
+    memcpy(Statistics, &InterruptCores[CoreId].Statistics, sizeof(InterruptCoreStatistics_t));
+    dsunlock(&InterruptTableSyncObject);
+    return OsSuccess;
+}
+
+OsStatus_t
+InterruptSetAffinity(
+    _In_ UUId_t Source,
+    _In_ UUId_t CoreId)
+{
+    InterruptTableEntry_t* Vector;
+    SystemInterrupt_t*     Entry;
+    OsStatus_t             Status = OsSuccess;
+
+    if (LOWORD(Source) >= MAX_SUPPORTED_INTERRUPTS) {
+        return OsInvalidParameters;
+    }
+    if (CoreId != UUID_INVALID && !InterruptIsCoreAvailable(CoreId)) {
+        return OsInvalidParameters;
+    }
+
+    dslock(&InterruptTableSyncObject);
+    Entry = InterruptGet(Source);
+    if (Entry == NULL || GetCurrentModule() == NULL 
+        || Entry->ModuleHandle != GetCurrentModule()->Handle) {
+        dsunlock(&InterruptTableSyncObject);
+        return OsInvalidPermissions;
+    }
+
+    Vector = &InterruptTable[LOWORD(Source)];
+    if (CoreId == UUID_INVALID) {
+        Vector->Pinned = 0;
+    }
+    else if (Vector->Affinity == CoreId) {
+        Vector->Pinned = 1;
+    }
+    else if (InterruptCanMigrate(Vector)) {
+        Status = InterruptMigrate(LOWORD(Source), CoreId);
+        if (Status == OsSuccess) {
+            Vector->Pinned = 1;
+        }
+    }
+    else {
+        Status = OsNotSupported;
+    }
+    dsunlock(&InterruptTableSyncObject);
+    return Status;
+}
+
 SystemInterrupt_t*
 InterruptGetIndex(
    _In_ UUId_t TableIndex)
@@ -577,6 +1012,10 @@ InterruptHandle(
     // Update current status
     InterruptSetActiveStatus(1);
     Entry = InterruptTable[TableIndex].Descriptor;
+    if (Entry != NULL) {
+        InterruptTable[TableIndex].Count++;
+        InterruptCores[ArchGetProcessorCoreId() & (INTERRUPT_MAX_CORES - 1)].Statistics.Interrupts++;
+    }
     while (Entry != NULL) {
         if (Entry->Flags & INTERRUPT_KERNEL) {
             void* Data  = (Entry->Flags & INTERRUPT_CONTEXT) != 0 ? (void*)Context : Entry->Interrupt.Context;
@@ -594,8 +1033,7 @@ InterruptHandle(
                 // We have the InterruptHandledStop as a marker to identify
                 // when it's not neccessary to further send an interrupt notification
                 if ((Entry->Flags & INTERRUPT_USERSPACE) != 0 && Result != InterruptHandledStop) {
-                    OsStatus_t Status = SendModuleInterrupt(Entry->ModuleHandle, Entry->Id, Entry->Interrupt.Context);
-                    assert(Status == OsSuccess);
+                    InterruptSignalEvent(Entry);
                 }
                 *Source = Entry->Source;
                 break;
@@ -606,3 +1044,101 @@ InterruptHandle(
     InterruptSetActiveStatus(0);
     return Result;
 }
+
+/* InterruptBalance
+ * Samples the rate of all vectors and cores, and moves the busiest vector that fits from
+ * the most loaded core to the least loaded one. Only one vector is moved per period, and
+ * only while it lowers the load of the busiest core, so vectors don't bounce between cores. */
+static void
+InterruptBalance(void)
+{
+    SystemCpu_t*           Processor = InterruptGetProcessor();
+    SystemCpuCore_t*       Core;
+    InterruptCore_t*       Busiest   = NULL;
+    InterruptCore_t*       Idlest    = NULL;
+    InterruptTableEntry_t* Vector;
+    UUId_t                 BusiestId = UUID_INVALID;
+    UUId_t                 IdlestId  = UUID_INVALID;
+    int                    Selected  = -1;
+    size_t                 Interrupts;
+    size_t                 Gap;
+    int                    i;
+
+    dslock(&InterruptTableSyncObject);
+    for (i = 0; i < MAX_SUPPORTED_INTERRUPTS; i++) {
+        Vector            = &InterruptTable[i];
+        Vector->Rate      = ((Vector->Count - Vector->LastCount) * 1000) / INTERRUPT_BALANCE_INTERVAL;
+        Vector->LastCount = Vector->Count;
+    }
+
+    for (i = 0; i < Processor->NumberOfCores; i++) {
+        Core = InterruptGetCore(Processor, i);
+        if (Core == NULL) {
+            continue;
+        }
+
+        Interrupts = InterruptCores[Core->Id].Statistics.Interrupts;
+        InterruptCores[Core->Id].Statistics.Rate = ((Interrupts - InterruptCores[Core->Id].LastInterrupts) * 1000)
+            / INTERRUPT_BALANCE_INTERVAL;
+        InterruptCores[Core->Id].LastInterrupts = Interrupts;
+
+        if (Busiest == NULL || InterruptCores[Core->Id].Statistics.Rate > Busiest->Statistics.Rate) {
+            Busiest   = &InterruptCores[Core->Id];
+            BusiestId = Core->Id;
+        }
+        if (Idlest == NULL || InterruptCores[Core->Id].Statistics.Rate < Idlest->Statistics.Rate) {
+            Idlest   = &InterruptCores[Core->Id];
+            IdlestId = Core->Id;
+        }
+    }
+
+    // Ignore light loads and differences of less than a quarter
+    if (Busiest == NULL || Busiest == Idlest || Busiest->Statistics.Rate < INTERRUPT_BALANCE_MINIMUM) {
+        goto Done;
+    }
+    Gap = Busiest->Statistics.Rate - Idlest->Statistics.Rate;
+    if (Gap < (Busiest->Statistics.Rate / 4)) {
+        goto Done;
+    }
+
+    for (i = 0; i < MAX_SUPPORTED_INTERRUPTS; i++) {
+        Vector = &InterruptTable[i];
+        if (Vector->Affinity != BusiestId || Vector->Pinned || Vector->Rate == 0 
+            || Vector->Rate >= Gap || !InterruptCanMigrate(Vector)) {
+            continue;
+        }
+        if (Selected == -1 || Vector->Rate > InterruptTable[Selected].Rate) {
+            Selected = i;
+        }
+    }
+
+    if (Selected != -1 && InterruptMigrate((UUId_t)Selected, IdlestId) == OsSuccess) {
+        Busiest->Statistics.Rate -= InterruptTable[Selected].Rate;
+        Idlest->Statistics.Rate  += InterruptTable[Selected].Rate;
+    }
+
+Done:
+    dsunlock(&InterruptTableSyncObject);
+}
+
+/* InterruptBalancerWorker
+ * Periodically rebalances the interrupt vectors. */
+static void
+InterruptBalancerWorker(
+    _In_Opt_ void* Unused)
+{
+    _CRT_UNUSED(Unused);
+    while (1) {
+        SchedulerThreadSleep(NULL, INTERRUPT_BALANCE_INTERVAL);
+        InterruptBalance();
+    }
+}
+
+void
+InitializeInterruptBalancer(void)
+{
+    if (CreateThread("irq-balancer", InterruptBalancerWorker, NULL, 0, UUID_INVALID, &InterruptBalancerHandle) != OsSuccess) {
+        ERROR("Failed to start the interrupt balancer");
+        InterruptBalancerHandle = UUID_INVALID;
+    }
+}
@@ -24,6 +24,7 @@
 #include <arch/io.h>
 #include <ddk/interrupt.h>
 #include <interrupts.h>
+#include <timers.h>
 
 static FastInterruptResources_t FastInterruptTable = { 0 };
 
@@ -61,9 +62,19 @@ TableFunctionWriteIoSpace(
     return OsError;
 }
 
+// ReadTimestamp
+static uint64_t
+TableFunctionReadTimestamp(void)
+{
+    LargeInteger_t Tick = { { 0 } };
+    TimersQueryPerformanceTick(&Tick);
+    return (uint64_t)Tick.QuadPart;
+}
+
 void
 InitializeInterruptTable(void)
 {
-    FastInterruptTable.ReadIoSpace  = TableFunctionReadIoSpace;
-    FastInterruptTable.WriteIoSpace = TableFunctionWriteIoSpace;
+    FastInterruptTable.ReadIoSpace   = TableFunctionReadIoSpace;
+    FastInterruptTable.WriteIoSpace  = TableFunctionWriteIoSpace;
+    FastInterruptTable.ReadTimestamp = TableFunctionReadTimestamp;
 }
@@ -34,6 +34,7 @@
 #include <interrupts.h>
 #include <scheduler.h>
 #include <threading.h>
+#include <zeropage.h>
 #include <console.h>
 #include <timers.h>
 #include <stdio.h>
@@ -124,6 +125,9 @@ InitializeMachine(
 #error "Kernel does not support non-mmio platforms"
 #endif
     MemoryCacheInitialize();
+#ifdef __OSCONFIG_HAS_VIDEO
+    InitializeFramebufferShadow();
+#endif
     Status = InitializeConsole();
     if (Status != OsSuccess) {
         ERROR("Failed to initialize output for system.");
@@ -178,6 +182,7 @@ InitializeMachine(
 
     // Last step is to enable timers that kickstart all other threads
     GcInitialize();
+    InitializeZeroPages();
     Status = InitializeSystemTimers();
     if (Status != OsSuccess) {
         ERROR("Failed to initialize timers for system.");
@@ -186,6 +191,7 @@ InitializeMachine(
     TimersSynchronizeTime();
 #ifdef __OSCONFIG_ENABLE_MULTIPROCESSORS
     EnableMultiProcessoringMode();
+    InitializeInterruptBalancer();
 #endif
 
     // Either of three things happen, testing phase can begin, we can enter
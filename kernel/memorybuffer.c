@@ -19,7 +19,8 @@
  * MollenOS Memory Buffer Interface
  * - Implementation of the memory dma buffers. This provides a transfer buffer
  *   that is not bound to any specific virtual memory area but instead are bound
- *   to fixed physical addreses.
+ *   to fixed physical addreses. Scatter-gather buffers are only reserved at creation,
+ *   and their pages are committed on first access or when queried for a transfer.
  */
 #define __MODULE "MBUF"
 //#define __TRACE
@@ -29,9 +30,88 @@
 #include <handle.h>
 #include <debug.h>
 #include <heap.h>
+#include <string.h>
+
+extern OsStatus_t CommitVirtualPageMapping(SystemMemorySpace_t*, PhysicalAddress_t, VirtualAddress_t, Flags_t);
+
+/* CommitMemoryBufferPage
+ * Retrieves the physical page at the given index of the buffer, the page is
+ * allocated if it has not been committed yet. Returns 0 if out of memory. */
+static uintptr_t
+CommitMemoryBufferPage(
+    _In_ SystemMemoryBuffer_t* SystemBuffer,
+    _In_ int                   Index)
+{
+    uintptr_t Physical = atomic_load(&SystemBuffer->Pages[Index]);
+    uintptr_t Expected = 0;
+    if (Physical != 0) {
+        return Physical;
+    }
+
+    Physical = AllocateSystemMemory(GetMemorySpacePageSize(), __MASK, 0);
+    if (Physical == 0) {
+        return 0;
+    }
+
+    // Someone else may commit the page at the same time, in that case we use theirs
+    if (!atomic_compare_exchange_strong(&SystemBuffer->Pages[Index], &Expected, Physical)) {
+        FreeSystemMemory(Physical, GetMemorySpacePageSize());
+        Physical = Expected;
+    }
+    return Physical;
+}
+
+/* MapScatterGatherBuffer
+ * Reserves a mapping of the buffer in the memory space, pages that are committed already
+ * are installed immediately. The remaining pages are installed by the page-fault handler,
+ * which requires the mapping to be tracked by the memory space context. */
+static OsStatus_t
+MapScatterGatherBuffer(
+    _In_  SystemMemorySpace_t*  Space,
+    _In_  UUId_t                Handle,
+    _In_  SystemMemoryBuffer_t* SystemBuffer,
+    _Out_ uintptr_t*            Virtual)
+{
+    SystemMemoryMappingHandler_t* Mapping;
+    OsStatus_t                    Status;
+    uintptr_t                     Physical;
+    int                           i;
+
+    Status = CreateMemorySpaceMapping(Space, NULL, Virtual, SystemBuffer->Capacity,
+        MAPPING_USERSPACE | MAPPING_PERSISTENT, MAPPING_PHYSICAL_DEFAULT | MAPPING_VIRTUAL_PROCESS, __MASK);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    for (i = 0; i < SystemBuffer->PageCount; i++) {
+        Physical = atomic_load(&SystemBuffer->Pages[i]);
+        if (Physical == 0 && Space->Context == NULL) {
+            Physical = CommitMemoryBufferPage(SystemBuffer, i);
+        }
+        if (Physical != 0) {
+            CommitVirtualPageMapping(Space, Physical, *Virtual + (i * GetMemorySpacePageSize()), 0);
+        }
+    }
+
+    if (Space->Context != NULL) {
+        Mapping = (SystemMemoryMappingHandler_t*)kmalloc(sizeof(SystemMemoryMappingHandler_t));
+        if (Mapping == NULL) {
+            RemoveMemorySpaceMapping(Space, *Virtual, SystemBuffer->Capacity);
+            return OsOutOfMemory;
+        }
+        memset(Mapping, 0, sizeof(SystemMemoryMappingHandler_t));
+        Mapping->Header.Key.Value.Id = Handle;
+        Mapping->Handle              = Handle;
+        Mapping->Address             = *Virtual;
+        Mapping->Length              = SystemBuffer->Capacity;
+        CollectionAppend(Space->Context->MemoryBuffers, &Mapping->Header);
+    }
+    return OsSuccess;
+}
 
 OsStatus_t
 CreateMemoryBuffer(
+    _In_  Flags_t       Flags,
     _In_  size_t        Size,
     _Out_ DmaBuffer_t*  MemoryBuffer)
 {
@@ -41,25 +121,52 @@ CreateMemoryBuffer(
     uintptr_t             DmaAddress = 0;
     uintptr_t             Virtual    = 0;
     size_t                Capacity;
+    int                   PageCount;
     UUId_t                Handle;
+    int                   i;
 
-    Capacity = DIVUP(Size, GetMemorySpacePageSize()) * GetMemorySpacePageSize();
-    Status   = CreateMemorySpaceMapping(Space, &DmaAddress, 
-        &Virtual, Capacity, MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_PERSISTENT,
-        MAPPING_PHYSICAL_CONTIGIOUS | MAPPING_VIRTUAL_PROCESS, __MASK);
-    if (Status != OsSuccess) {
-        ERROR("Failed to map system memory");
-        return Status;
+    PageCount    = DIVUP(Size, GetMemorySpacePageSize());
+    Capacity     = PageCount * GetMemorySpacePageSize();
+    SystemBuffer = (SystemMemoryBuffer_t*)kmalloc(
+        sizeof(SystemMemoryBuffer_t) + (PageCount * sizeof(atomic_uintptr_t)));
+    if (SystemBuffer == NULL) {
+        ERROR("Failed to allocate the memory buffer descriptor");
+        return OsOutOfMemory;
     }
-
-    SystemBuffer            = (SystemMemoryBuffer_t*)kmalloc(sizeof(SystemMemoryBuffer_t));
-    Handle                  = CreateHandle(HandleTypeMemoryBuffer, 0, SystemBuffer);
+    memset(SystemBuffer, 0, sizeof(SystemMemoryBuffer_t) + (PageCount * sizeof(atomic_uintptr_t)));
+    SystemBuffer->Flags     = Flags & __BUFFER_SCATTER_GATHER;
     SystemBuffer->Capacity  = Capacity;
-    SystemBuffer->Physical  = DmaAddress;
+    SystemBuffer->PageCount = PageCount;
+
+    if (SystemBuffer->Flags & __BUFFER_SCATTER_GATHER) {
+        Handle = CreateHandle(HandleTypeMemoryBuffer, 0, SystemBuffer);
+        Status = MapScatterGatherBuffer(Space, Handle, SystemBuffer, &Virtual);
+        if (Status != OsSuccess) {
+            ERROR("Failed to reserve system memory");
+            DestroyHandle(Handle);
+            return Status;
+        }
+    }
+    else {
+        Status = CreateMemorySpaceMapping(Space, &DmaAddress, 
+            &Virtual, Capacity, MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_PERSISTENT,
+            MAPPING_PHYSICAL_CONTIGIOUS | MAPPING_VIRTUAL_PROCESS, __MASK);
+        if (Status != OsSuccess) {
+            ERROR("Failed to map system memory");
+            kfree(SystemBuffer);
+            return Status;
+        }
+
+        for (i = 0; i < PageCount; i++) {
+            atomic_store(&SystemBuffer->Pages[i], DmaAddress + (i * GetMemorySpacePageSize()));
+        }
+        Handle = CreateHandle(HandleTypeMemoryBuffer, 0, SystemBuffer);
+    }
 
     // Update the user-provided structure
     if (MemoryBuffer != NULL) {
         MemoryBuffer->Handle   = Handle;
+        MemoryBuffer->Flags    = SystemBuffer->Flags;
         MemoryBuffer->Dma      = DmaAddress;
         MemoryBuffer->Capacity = Capacity;
         MemoryBuffer->Address  = Virtual;
@@ -74,6 +181,7 @@ AcquireMemoryBuffer(
 {
     SystemMemoryBuffer_t* SystemBuffer;
     OsStatus_t            Status;
+    uintptr_t             Physical = 0;
     uintptr_t             Virtual;
 
     // We acquire the buffer by mapping it into our address space
@@ -85,17 +193,25 @@ AcquireMemoryBuffer(
     }
 
     // Map it in to make sure we can do it
-    Status = CreateMemorySpaceMapping(GetCurrentMemorySpace(), &SystemBuffer->Physical, 
-        &Virtual, SystemBuffer->Capacity, MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_PERSISTENT,
-        MAPPING_PHYSICAL_FIXED | MAPPING_VIRTUAL_PROCESS, __MASK);
+    if (SystemBuffer->Flags & __BUFFER_SCATTER_GATHER) {
+        Status = MapScatterGatherBuffer(GetCurrentMemorySpace(), Handle, SystemBuffer, &Virtual);
+    }
+    else {
+        Physical = atomic_load(&SystemBuffer->Pages[0]);
+        Status   = CreateMemorySpaceMapping(GetCurrentMemorySpace(), &Physical, 
+            &Virtual, SystemBuffer->Capacity, MAPPING_COMMIT | MAPPING_USERSPACE | MAPPING_PERSISTENT,
+            MAPPING_PHYSICAL_FIXED | MAPPING_VIRTUAL_PROCESS, __MASK);
+    }
     if (Status != OsSuccess) {
         ERROR("Failed to map process memory");
+        DestroyHandle(Handle);
         return Status;
     }
 
     // Update the user-provided structure
     MemoryBuffer->Handle    = Handle;
-    MemoryBuffer->Dma       = SystemBuffer->Physical;
+    MemoryBuffer->Flags     = SystemBuffer->Flags;
+    MemoryBuffer->Dma       = Physical;
     MemoryBuffer->Capacity  = SystemBuffer->Capacity;
     MemoryBuffer->Address   = Virtual;
     return Status;
@@ -115,19 +231,137 @@ QueryMemoryBuffer(
     if (SystemBuffer == NULL) {
         return OsError;
     }
-    *Dma      = SystemBuffer->Physical;
+    *Dma      = (SystemBuffer->Flags & __BUFFER_SCATTER_GATHER) ? 0 : atomic_load(&SystemBuffer->Pages[0]);
     *Capacity = SystemBuffer->Capacity;
     return OsSuccess;
 }
 
+OsStatus_t
+QueryMemoryBufferSegments(
+    _In_    UUId_t        Handle,
+    _In_    size_t        Offset,
+    _In_    size_t        Length,
+    _In_    DmaSegment_t* Segments,
+    _InOut_ int*          SegmentCount)
+{
+    SystemMemoryBuffer_t* SystemBuffer;
+    size_t                PageSize = GetMemorySpacePageSize();
+    size_t                PageOffset;
+    uintptr_t             Physical;
+    int                   Count = 0;
+    int                   Index;
+
+    SystemBuffer = LookupHandleOfType(Handle, HandleTypeMemoryBuffer);
+    if (SystemBuffer == NULL || Offset >= SystemBuffer->Capacity) {
+        return OsInvalidParameters;
+    }
+
+    Length     = MIN(Length, SystemBuffer->Capacity - Offset);
+    Index      = (int)(Offset / PageSize);
+    PageOffset = Offset % PageSize;
+    while (Length > 0) {
+        size_t ChunkLength = MIN(PageSize - PageOffset, Length);
+        
+        Physical = CommitMemoryBufferPage(SystemBuffer, Index);
+        if (Physical == 0) {
+            break;
+        }
+        Physical += PageOffset;
+
+        // Merge pages that happen to be physically adjacent
+        if (Count != 0 && (Segments[Count - 1].Address + Segments[Count - 1].Length) == Physical) {
+            Segments[Count - 1].Length += ChunkLength;
+        }
+        else {
+            if (Count == *SegmentCount) {
+                break;
+            }
+            Segments[Count].Address = Physical;
+            Segments[Count].Length  = ChunkLength;
+            Count++;
+        }
+
+        Length    -= ChunkLength;
+        PageOffset = 0;
+        Index++;
+    }
+    *SegmentCount = Count;
+    return (Count != 0) ? OsSuccess : OsError;
+}
+
+OsStatus_t
+HandleMemoryBufferPageFault(
+    _In_ SystemMemorySpace_t* Space,
+    _In_ uintptr_t            Address)
+{
+    SystemMemoryBuffer_t* SystemBuffer;
+    OsStatus_t            Status;
+    uintptr_t             Physical;
+
+    if (Space->Context == NULL) {
+        return OsDoesNotExist;
+    }
+
+    foreach(Node, Space->Context->MemoryBuffers) {
+        SystemMemoryMappingHandler_t* Mapping = (SystemMemoryMappingHandler_t*)Node;
+        if (ISINRANGE(Address, Mapping->Address, (Mapping->Address + Mapping->Length) - 1)) {
+            SystemBuffer = LookupHandleOfType(Mapping->Handle, HandleTypeMemoryBuffer);
+            if (SystemBuffer == NULL) {
+                return OsError;
+            }
+
+            Physical = CommitMemoryBufferPage(SystemBuffer, 
+                (int)((Address - Mapping->Address) / GetMemorySpacePageSize()));
+            if (Physical == 0) {
+                return OsError;
+            }
+
+            Status = CommitVirtualPageMapping(Space, Physical, Address, 0);
+            return (Status == OsExists) ? OsSuccess : Status;
+        }
+    }
+    return OsDoesNotExist;
+}
+
+void
+ReleaseMemoryBufferMapping(
+    _In_ SystemMemorySpace_t* Space,
+    _In_ uintptr_t            Address)
+{
+    if (Space->Context == NULL) {
+        return;
+    }
+
+    foreach(Node, Space->Context->MemoryBuffers) {
+        SystemMemoryMappingHandler_t* Mapping = (SystemMemoryMappingHandler_t*)Node;
+        if (Mapping->Address == Address) {
+            CollectionRemoveByNode(Space->Context->MemoryBuffers, Node);
+            kfree(Mapping);
+            break;
+        }
+    }
+}
+
 OsStatus_t
 DestroyMemoryBuffer(
     _In_ void* Resource)
 {
     SystemMemoryBuffer_t* SystemBuffer = (SystemMemoryBuffer_t*)Resource;
     OsStatus_t            Status       = OsSuccess;
-    
-    Status = FreeSystemMemory(SystemBuffer->Physical, SystemBuffer->Capacity);
+    uintptr_t             Physical;
+    int                   i;
+
+    if (SystemBuffer->Flags & __BUFFER_SCATTER_GATHER) {
+        for (i = 0; i < SystemBuffer->PageCount; i++) {
+            Physical = atomic_load(&SystemBuffer->Pages[i]);
+            if (Physical != 0) {
+                FreeSystemMemory(Physical, GetMemorySpacePageSize());
+            }
+        }
+    }
+    else {
+        Status = FreeSystemMemory(atomic_load(&SystemBuffer->Pages[0]), SystemBuffer->Capacity);
+    }
     kfree(Resource);
     return Status;
 }
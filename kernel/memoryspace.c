@@ -26,6 +26,7 @@
 #include <arch/utils.h>
 #include <memoryspace.h>
 #include <threading.h>
+#include <zeropage.h>
 #include <machine.h>
 #include <handle.h>
 #include <assert.h>
@@ -44,9 +45,35 @@ extern OsStatus_t SetVirtualPageAttributes(SystemMemorySpace_t*, VirtualAddress_
 
 extern uintptr_t  GetVirtualPageMapping(SystemMemorySpace_t*, VirtualAddress_t);
 
-extern OsStatus_t CommitVirtualPageMapping(SystemMemorySpace_t*, PhysicalAddress_t, VirtualAddress_t);
+extern OsStatus_t CommitVirtualPageMapping(SystemMemorySpace_t*, PhysicalAddress_t, VirtualAddress_t, Flags_t);
 extern OsStatus_t SetVirtualPageMapping(SystemMemorySpace_t*, PhysicalAddress_t, VirtualAddress_t, Flags_t);
 extern OsStatus_t ClearVirtualPageMapping(SystemMemorySpace_t*, VirtualAddress_t);
+extern OsStatus_t SetVirtualPageMappings(SystemMemorySpace_t*, PhysicalAddress_t*, PhysicalAddress_t, VirtualAddress_t, int, Flags_t, int*);
+extern OsStatus_t ClearVirtualPageMappings(SystemMemorySpace_t*, VirtualAddress_t, int);
+extern OsStatus_t ReplaceVirtualPageMapping(SystemMemorySpace_t*, VirtualAddress_t, PhysicalAddress_t, PhysicalAddress_t, Flags_t);
+extern VirtualAddress_t FindVirtualPageMapping(SystemMemorySpace_t*, VirtualAddress_t, VirtualAddress_t);
+
+extern size_t     GetVirtualLargePageSize(void);
+extern OsStatus_t SetVirtualLargePageMapping(SystemMemorySpace_t*, PhysicalAddress_t, VirtualAddress_t, Flags_t);
+extern OsStatus_t SetVirtualLargePageAttributes(SystemMemorySpace_t*, VirtualAddress_t, Flags_t);
+extern OsStatus_t ClearVirtualLargePageMapping(SystemMemorySpace_t*, VirtualAddress_t);
+extern void       CopyVirtualMemory(VirtualAddress_t, VirtualAddress_t, size_t);
+
+#define SHARED_PAGE_BUCKETS  256
+#define MEMORY_MAPPING_BATCH 64 // Pages allocated and mapped at once for default allocated mappings
+
+// Physical pages that are mapped by more than one memory space, with the number of mappings
+// of the page. Pages that are not in the table have exactly one owner.
+typedef struct _SharedMemoryPage {
+    struct _SharedMemoryPage* Link;
+    PhysicalAddress_t         Address;
+    int                       References;
+} SharedMemoryPage_t;
+
+static SharedMemoryPage_t* SharedPages[SHARED_PAGE_BUCKETS] = { 0 };
+static SafeMemoryLock_t    SharedPageLock                   = { 0 };
+static _Atomic(int)        SharedPageCount                  = ATOMIC_VAR_INIT(0);
+static _Atomic(size_t)     MemorySpaceGeneration            = ATOMIC_VAR_INIT(1);
 
 typedef struct {
     volatile int CallsCompleted;
@@ -75,6 +102,19 @@ MemorySynchronizationHandler(
     Object->CallsCompleted++;
 }
 
+/* UpdateMemorySpaceGeneration
+ * Moves the space and its relatives to a new generation, so cores that still have translations
+ * of the space cached from an earlier switch discard them the next time they switch to it. */
+static void
+UpdateMemorySpaceGeneration(
+    _In_ SystemMemorySpace_t* SystemMemorySpace)
+{
+    if (SystemMemorySpace->Context != NULL) {
+        atomic_store(&SystemMemorySpace->Context->Generation, 
+            atomic_fetch_add(&MemorySpaceGeneration, 1) + 1);
+    }
+}
+
 static void
 SynchronizeMemoryRegion(
     _In_ SystemMemorySpace_t* SystemMemorySpace,
@@ -86,6 +126,9 @@ SynchronizeMemoryRegion(
     MemorySynchronizationObject_t Object = { 0 };
     int                           NumberOfCores;
 
+    // Cores that are not running the space are only told through the generation
+    UpdateMemorySpaceGeneration(SystemMemorySpace);
+
     // Skip this entire step if there is no multiple cores active
     if (GetMachine()->NumberOfActiveCores <= 1) {
         return;
@@ -121,7 +164,9 @@ CreateMemorySpaceContext(
         GetMachine()->MemoryMap.UserHeap.Start + GetMachine()->MemoryMap.UserHeap.Length, 
         GetMachine()->MemoryGranularity, &Context->HeapSpace);
     Context->MemoryHandlers = CollectionCreate(KeyId);
+    Context->MemoryBuffers  = CollectionCreate(KeyId);
     Context->SignalHandler  = 0;
+    Context->Generation     = atomic_fetch_add(&MemorySpaceGeneration, 1) + 1;
 
     MemorySpace->Context = Context;
 }
@@ -130,6 +175,7 @@ static void
 DestroyMemorySpaceContext(
     _In_ SystemMemorySpace_t* MemorySpace)
 {
+    CollectionItem_t* Mapping;
     assert(MemorySpace != NULL);
     assert(MemorySpace->Context != NULL);
     
@@ -140,10 +186,218 @@ DestroyMemorySpaceContext(
         DestroyHandle(Handler->Handle);
     }
     CollectionDestroy(MemorySpace->Context->MemoryHandlers);
+
+    // Buffer mappings are only tracked, the buffers are owned by their handles
+    Mapping = CollectionPopFront(MemorySpace->Context->MemoryBuffers);
+    while (Mapping != NULL) {
+        kfree(Mapping);
+        Mapping = CollectionPopFront(MemorySpace->Context->MemoryBuffers);
+    }
+    CollectionDestroy(MemorySpace->Context->MemoryBuffers);
     DestroyBlockmap(MemorySpace->Context->HeapSpace);
     kfree(MemorySpace->Context);
 }
 
+static SharedMemoryPage_t**
+FindSharedPage(
+    _In_ PhysicalAddress_t Address)
+{
+    SharedMemoryPage_t** Link = &SharedPages[(Address / GetMemorySpacePageSize()) % SHARED_PAGE_BUCKETS];
+    while (*Link != NULL && (*Link)->Address != Address) {
+        Link = &(*Link)->Link;
+    }
+    return Link;
+}
+
+/* AcquireSharedPage
+ * Adds a mapping to the physical page, a page that was not shared before now has two. */
+static OsStatus_t
+AcquireSharedPage(
+    _In_ PhysicalAddress_t Address)
+{
+    SharedMemoryPage_t*  Page = (SharedMemoryPage_t*)kmalloc(sizeof(SharedMemoryPage_t));
+    SharedMemoryPage_t** Link;
+    if (Page == NULL) {
+        return OsError;
+    }
+
+    dslock(&SharedPageLock);
+    Link = FindSharedPage(Address);
+    if (*Link != NULL) {
+        (*Link)->References++;
+    }
+    else {
+        Page->Link       = NULL;
+        Page->Address    = Address;
+        Page->References = 2;
+        *Link            = Page;
+        Page             = NULL;
+        atomic_fetch_add(&SharedPageCount, 1);
+    }
+    dsunlock(&SharedPageLock);
+
+    if (Page != NULL) {
+        kfree(Page);
+    }
+    return OsSuccess;
+}
+
+/* ReleaseSharedPage
+ * Removes a mapping from the physical page. Returns 0 if the page was not shared, in which
+ * case the caller was the only owner and must free it. */
+static int
+ReleaseSharedPage(
+    _In_ PhysicalAddress_t Address)
+{
+    SharedMemoryPage_t*  Page = NULL;
+    SharedMemoryPage_t** Link;
+    int                  Shared = 0;
+
+    dslock(&SharedPageLock);
+    Link = FindSharedPage(Address);
+    if (*Link != NULL) {
+        Shared = 1;
+        if (--(*Link)->References == 1) {
+            Page  = *Link;
+            *Link = Page->Link;
+            atomic_fetch_sub(&SharedPageCount, 1);
+        }
+    }
+    dsunlock(&SharedPageLock);
+
+    if (Page != NULL) {
+        kfree(Page);
+    }
+    return Shared;
+}
+
+static int
+IsSharedPage(
+    _In_ PhysicalAddress_t Address)
+{
+    int Shared;
+    if (atomic_load(&SharedPageCount) == 0) {
+        return 0;
+    }
+
+    dslock(&SharedPageLock);
+    Shared = *FindSharedPage(Address) != NULL;
+    dsunlock(&SharedPageLock);
+    return Shared;
+}
+
+OsStatus_t
+FreeMemorySpacePage(
+    _In_ PhysicalAddress_t Address)
+{
+    if (atomic_load(&SharedPageCount) != 0 && ReleaseSharedPage(Address)) {
+        return OsSuccess;
+    }
+    return FreeSystemMemory(Address, GetMemorySpacePageSize());
+}
+
+/* ShareMemorySpacePage
+ * Maps the page at the source address into the destination space with the given flags. Private
+ * pages are shared copy-on-write, persistent pages are shared as they are and pages that are
+ * only reserved are reserved in the destination as well. */
+static OsStatus_t
+ShareMemorySpacePage(
+    _In_ SystemMemorySpace_t* SourceSpace,
+    _In_ VirtualAddress_t     SourceAddress,
+    _In_ SystemMemorySpace_t* DestinationSpace,
+    _In_ VirtualAddress_t     DestinationAddress,
+    _In_ Flags_t              MemoryFlags)
+{
+    PhysicalAddress_t PhysicalPage;
+    OsStatus_t        Status;
+    Flags_t           SourceFlags = GetMemorySpaceAttributes(SourceSpace, SourceAddress);
+
+    if (!(SourceFlags & MAPPING_COMMIT)) {
+        if (SourceFlags == 0) {
+            return OsDoesNotExist;
+        }
+        return SetVirtualPageMapping(DestinationSpace, 0, DestinationAddress, MemoryFlags & ~(MAPPING_COMMIT));
+    }
+
+    PhysicalPage = GetMemorySpaceMapping(SourceSpace, SourceAddress);
+    if (SourceFlags & MAPPING_PERSISTENT) {
+        return SetVirtualPageMapping(DestinationSpace, PhysicalPage, DestinationAddress, 
+            MemoryFlags | MAPPING_PERSISTENT | MAPPING_COMMIT);
+    }
+
+    Status = AcquireSharedPage(PhysicalPage);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    // Both mappings must lose write access, the first write from either side will then
+    // give that side its own copy
+    if (!(SourceFlags & (MAPPING_READONLY | MAPPING_COPYONWRITE))) {
+        SetVirtualPageAttributes(SourceSpace, SourceAddress, SourceFlags | MAPPING_COPYONWRITE);
+    }
+    if (!(MemoryFlags & MAPPING_READONLY)) {
+        MemoryFlags |= MAPPING_COPYONWRITE;
+    }
+
+    Status = SetVirtualPageMapping(DestinationSpace, PhysicalPage, DestinationAddress,
+        (MemoryFlags & ~(MAPPING_PERSISTENT)) | MAPPING_COMMIT);
+    if (Status != OsSuccess) {
+        ReleaseSharedPage(PhysicalPage);
+    }
+    return Status;
+}
+
+/* IsMemorySpaceBufferAddress
+ * Memory handlers and buffer mappings are owned by their handles and can't be cloned. */
+static int
+IsMemorySpaceBufferAddress(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ VirtualAddress_t     Address)
+{
+    foreach(Node, SystemMemorySpace->Context->MemoryHandlers) {
+        SystemMemoryMappingHandler_t* Handler = (SystemMemoryMappingHandler_t*)Node;
+        if (ISINRANGE(Address, Handler->Address, (Handler->Address + Handler->Length) - 1)) {
+            return 1;
+        }
+    }
+    foreach(BufferNode, SystemMemorySpace->Context->MemoryBuffers) {
+        SystemMemoryMappingHandler_t* Mapping = (SystemMemoryMappingHandler_t*)BufferNode;
+        if (ISINRANGE(Address, Mapping->Address, (Mapping->Address + Mapping->Length) - 1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* CloneMemorySpaceRegion
+ * Shares all mappings in the region of the source space with the destination space
+ * at the same addresses. Returns the number of pages cloned. */
+static size_t
+CloneMemorySpaceRegion(
+    _In_ SystemMemorySpace_t* Source,
+    _In_ SystemMemorySpace_t* Destination,
+    _In_ VirtualAddress_t     Start,
+    _In_ size_t               Length,
+    _In_ BlockBitmap_t*       Blockmap)
+{
+    VirtualAddress_t Address = FindVirtualPageMapping(Source, Start, Start + Length);
+    size_t           Pages   = 0;
+
+    while (Address != 0) {
+        if (!IsMemorySpaceBufferAddress(Source, Address)) {
+            if (ShareMemorySpacePage(Source, Address, Destination, Address, 
+                    GetMemorySpaceAttributes(Source, Address)) == OsSuccess) {
+                if (Blockmap != NULL) {
+                    ReserveBlockmapRegion(Blockmap, Address, GetMemorySpacePageSize());
+                }
+                Pages++;
+            }
+        }
+        Address = FindVirtualPageMapping(Source, Address + GetMemorySpacePageSize(), Start + Length);
+    }
+    return Pages;
+}
+
 OsStatus_t
 InitializeMemorySpace(
     _In_ SystemMemorySpace_t* SystemMemorySpace)
@@ -206,6 +460,7 @@ CreateMemorySpace(
             CreateMemorySpaceContext(MemorySpace);
         }
         CloneVirtualSpace(Parent, MemorySpace, (Flags & MEMORY_SPACE_INHERIT) ? 1 : 0);
+        UpdateMemorySpaceGeneration(MemorySpace);
         *Handle = CreateHandle(HandleTypeMemorySpace, 0, MemorySpace);
     }
     else {
@@ -214,6 +469,49 @@ CreateMemorySpace(
     return OsSuccess;
 }
 
+OsStatus_t
+CloneMemorySpace(
+    _In_  SystemMemorySpace_t* Source,
+    _Out_ UUId_t*              Handle)
+{
+    SystemMemorySpace_t* MemorySpace;
+    SystemMemoryMap_t*   MemoryMap = &GetMachine()->MemoryMap;
+    size_t               Pages;
+    assert(Source != NULL);
+
+    // The user regions of inherited spaces are owned by the root space
+    if (Source->ParentHandle != UUID_INVALID) {
+        Source = (SystemMemorySpace_t*)LookupHandle(Source->ParentHandle);
+    }
+    if (Source->Context == NULL) {
+        return OsInvalidParameters;
+    }
+
+    MemorySpace = (SystemMemorySpace_t*)kmalloc(sizeof(SystemMemorySpace_t));
+    if (MemorySpace == NULL) {
+        return OsError;
+    }
+    memset((void*)MemorySpace, 0, sizeof(SystemMemorySpace_t));
+    MemorySpace->Flags        = MEMORY_SPACE_APPLICATION;
+    MemorySpace->ParentHandle = UUID_INVALID;
+    CreateMemorySpaceContext(MemorySpace);
+    CloneVirtualSpace(NULL, MemorySpace, 0);
+    MemorySpace->Context->SignalHandler = Source->Context->SignalHandler;
+
+    Pages  = CloneMemorySpaceRegion(Source, MemorySpace, MemoryMap->UserCode.Start, 
+        MemoryMap->UserCode.Length, NULL);
+    Pages += CloneMemorySpaceRegion(Source, MemorySpace, MemoryMap->UserHeap.Start, 
+        MemoryMap->UserHeap.Length, MemorySpace->Context->HeapSpace);
+    TRACE("CloneMemorySpace cloned %" PRIuIN " pages", Pages);
+
+    // Other cores running threads of the source may still have write access cached
+    SynchronizeMemoryRegion(Source, MemoryMap->UserCode.Start, MemoryMap->UserCode.Length);
+    SynchronizeMemoryRegion(Source, MemoryMap->UserHeap.Start, MemoryMap->UserHeap.Length);
+
+    *Handle = CreateHandle(HandleTypeMemorySpace, 0, MemorySpace);
+    return OsSuccess;
+}
+
 OsStatus_t
 DestroyMemorySpace(
     _In_ void* Resource)
@@ -328,6 +626,13 @@ ResolveVirtualSystemMemorySpaceAddress(
     _In_ Flags_t              PlacementFlags)
 {
     VirtualAddress_t VirtualBase = 0;
+    size_t           Alignment   = 0;
+
+    // Large page mappings must be aligned to the large page size to be of any use
+    if ((PlacementFlags & MAPPING_LARGEPAGES) && GetVirtualLargePageSize() != 0 &&
+        Size >= GetVirtualLargePageSize()) {
+        Alignment = GetVirtualLargePageSize();
+    }
 
     switch (PlacementFlags & MAPPING_VIRTUAL_MASK) {
         case MAPPING_VIRTUAL_FIXED: {
@@ -337,14 +642,24 @@ ResolveVirtualSystemMemorySpaceAddress(
 
         case MAPPING_VIRTUAL_PROCESS: {
             assert(SystemMemorySpace->Context != NULL);
-            VirtualBase = AllocateBlocksInBlockmap(SystemMemorySpace->Context->HeapSpace, __MASK, Size);
+            if (Alignment != 0) {
+                VirtualBase = AllocateAlignedBlocksInBlockmap(SystemMemorySpace->Context->HeapSpace, __MASK, Size, Alignment);
+            }
+            if (VirtualBase == 0) {
+                VirtualBase = AllocateBlocksInBlockmap(SystemMemorySpace->Context->HeapSpace, __MASK, Size);
+            }
             if (VirtualBase == 0) {
                 ERROR("Ran out of memory for allocation 0x%" PRIxIN " (heap)", Size);
             }
         } break;
 
         case MAPPING_VIRTUAL_GLOBAL: {
-            VirtualBase = AllocateBlocksInBlockmap(&GetMachine()->GlobalAccessMemory, __MASK, Size);
+            if (Alignment != 0) {
+                VirtualBase = AllocateAlignedBlocksInBlockmap(&GetMachine()->GlobalAccessMemory, __MASK, Size, Alignment);
+            }
+            if (VirtualBase == 0) {
+                VirtualBase = AllocateBlocksInBlockmap(&GetMachine()->GlobalAccessMemory, __MASK, Size);
+            }
             if (VirtualBase == 0) {
                 ERROR("Ran out of memory for allocation 0x%" PRIxIN " (ga-memory)", Size);
             }
@@ -362,24 +677,66 @@ ResolveVirtualSystemMemorySpaceAddress(
     return VirtualBase;
 }
 
+/* InstallMemoryMappings
+ * Maps a range of pages with a single walk per page-table. The physical pages are either
+ * taken from the given array, or are contigious from the given base. */
 static OsStatus_t
-InstallMemoryMapping(
+InstallMemoryMappings(
     _In_ SystemMemorySpace_t* SystemMemorySpace,
-    _In_ PhysicalAddress_t    PhysicalAddress,
+    _In_ PhysicalAddress_t*   PhysicalPages,
+    _In_ PhysicalAddress_t    PhysicalBase,
     _In_ VirtualAddress_t     VirtualAddress,
+    _In_ int                  PageCount,
     _In_ Flags_t              MemoryFlags,
-    _In_ Flags_t              PlacementFlags)
+    _In_ Flags_t              PlacementFlags,
+    _Out_ int*                PagesInstalled)
 {
-    OsStatus_t Status = SetVirtualPageMapping(SystemMemorySpace, PhysicalAddress, VirtualAddress, MemoryFlags);
+    OsStatus_t Status = SetVirtualPageMappings(SystemMemorySpace, PhysicalPages, PhysicalBase, 
+        VirtualAddress, PageCount, MemoryFlags, PagesInstalled);
     if (Status != OsSuccess) {
         if (Status == OsExists) {
-            ERROR("Memory mapping at 0x%" PRIxIN " already existed", VirtualAddress);
+            ERROR("Memory mapping at 0x%" PRIxIN " already existed", 
+                VirtualAddress + (*PagesInstalled * GetMemorySpacePageSize()));
             assert((PlacementFlags & MAPPING_VIRTUAL_FIXED) != 0);
         }
     }
     return Status;
 }
 
+/* InstallLargeMemoryMapping
+ * Tries to map a large page at the virtual address, either from the given physical page or
+ * from a new allocation if the physical page is __MASK. Returns OsSuccess only if the large
+ * page was installed, otherwise the caller must fall back to normal pages. */
+static OsStatus_t
+InstallLargeMemoryMapping(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ PhysicalAddress_t    PhysicalPage,
+    _In_ VirtualAddress_t     VirtualAddress,
+    _In_ Flags_t              MemoryFlags,
+    _In_ uintptr_t            PhysicalMask)
+{
+    size_t     LargePageSize = GetVirtualLargePageSize();
+    int        Allocated     = 0;
+    OsStatus_t Status;
+
+    if (PhysicalPage == __MASK) {
+        PhysicalPage = AllocateSystemMemory(LargePageSize, PhysicalMask, MEMORY_ALIGNED);
+        if (PhysicalPage == 0) {
+            return OsError;
+        }
+        Allocated = 1;
+    }
+    else if (PhysicalPage % LargePageSize) {
+        return OsNotSupported;
+    }
+
+    Status = SetVirtualLargePageMapping(SystemMemorySpace, PhysicalPage, VirtualAddress, MemoryFlags);
+    if (Status != OsSuccess && Allocated) {
+        FreeSystemMemory(PhysicalPage, LargePageSize);
+    }
+    return Status;
+}
+
 OsStatus_t
 CreateMemorySpaceMapping(
     _In_        SystemMemorySpace_t* SystemMemorySpace,
@@ -390,10 +747,12 @@ CreateMemorySpaceMapping(
     _In_        Flags_t              PlacementFlags,
     _In_        uintptr_t            PhysicalMask)
 {
+    PhysicalAddress_t PhysicalPages[MEMORY_MAPPING_BATCH];
     VirtualAddress_t  VirtualBase;
     PhysicalAddress_t PhysicalBase   = __MASK;
     OsStatus_t        Status         = OsError;
     int               PageCount      = DIVUP(Size, GetMemorySpacePageSize());
+    int               LargePageCount = (int)(GetVirtualLargePageSize() / GetMemorySpacePageSize());
     int               CleanupOnError = 0;
     int               i;
     assert(SystemMemorySpace != NULL);
@@ -416,38 +775,75 @@ CreateMemorySpaceMapping(
     // went wrong during the phase to figure out where to place
     VirtualBase = ResolveVirtualSystemMemorySpaceAddress(SystemMemorySpace, VirtualAddress, Size, PlacementFlags);
     if (VirtualBase != 0) {
-        for (i = 0; i < PageCount; i++) {
+        for (i = 0; i < PageCount; ) {
             uintptr_t VirtualPage  = VirtualBase + (i * GetMemorySpacePageSize());
             uintptr_t PhysicalPage = 0;
+            int       RunCount     = PageCount - i;
+            int       Installed    = 0;
+            int       j;
 
-            if (MemoryFlags & MAPPING_COMMIT) {
+            // Committed memory is mapped by large pages where the range allows it, supplied and
+            // contigious memory always qualifies, default allocated memory only when requested
+            if ((MemoryFlags & MAPPING_COMMIT) && LargePageCount != 0 && (PageCount - i) >= LargePageCount &&
+                (VirtualPage % GetVirtualLargePageSize()) == 0 &&
+                (PhysicalBase != __MASK || (PlacementFlags & MAPPING_LARGEPAGES))) {
+                PhysicalPage = __MASK;
                 if (PhysicalBase != __MASK) {
                     PhysicalPage = PhysicalBase + (i * GetMemorySpacePageSize());
                 }
-                else {
-                    PhysicalPage = AllocateSystemMemory(GetMemorySpacePageSize(), PhysicalMask, 0);
-                    assert(PhysicalPage != 0);
+                if (InstallLargeMemoryMapping(SystemMemorySpace, PhysicalPage, VirtualPage, 
+                        MemoryFlags, PhysicalMask) == OsSuccess) {
                     if (PhysicalAddress != NULL && *PhysicalAddress == __MASK) {
-                        *PhysicalAddress = PhysicalPage;
+                        *PhysicalAddress = GetVirtualPageMapping(SystemMemorySpace, VirtualPage);
                     }
+                    Status = OsSuccess;
+                    i     += LargePageCount;
+                    continue;
                 }
             }
 
-            Status = InstallMemoryMapping(SystemMemorySpace, PhysicalPage, VirtualPage, MemoryFlags, PlacementFlags);
-            if (Status != OsSuccess) {
-                if (PhysicalBase == __MASK) {
-                    FreeSystemMemory(PhysicalPage, GetMemorySpacePageSize());
+            // Runs of committed memory never cross a large page boundary, so the next large page can
+            // still be tried. This also makes every run fit in a single page-table
+            if ((MemoryFlags & MAPPING_COMMIT) && LargePageCount != 0) {
+                RunCount = MIN(RunCount, LargePageCount - 
+                    (int)((VirtualPage % GetVirtualLargePageSize()) / GetMemorySpacePageSize()));
+            }
+
+            // Supplied and contigious memory is mapped straight from the base, otherwise a batch
+            // of pages is allocated up front
+            if ((MemoryFlags & MAPPING_COMMIT) && PhysicalBase == __MASK) {
+                RunCount = MIN(RunCount, MEMORY_MAPPING_BATCH);
+                for (j = 0; j < RunCount; j++) {
+                    PhysicalPages[j] = AllocateSystemMemory(GetMemorySpacePageSize(), PhysicalMask, 0);
+                    assert(PhysicalPages[j] != 0);
+                }
+                if (PhysicalAddress != NULL && *PhysicalAddress == __MASK) {
+                    *PhysicalAddress = PhysicalPages[0];
+                }
+
+                Status = InstallMemoryMappings(SystemMemorySpace, &PhysicalPages[0], 0, VirtualPage, 
+                    RunCount, MemoryFlags, PlacementFlags, &Installed);
+                for (j = Installed; j < RunCount; j++) {
+                    FreeSystemMemory(PhysicalPages[j], GetMemorySpacePageSize());
+                }
+            }
+            else {
+                if (MemoryFlags & MAPPING_COMMIT) {
+                    PhysicalPage = PhysicalBase + (i * GetMemorySpacePageSize());
                 }
+                Status = InstallMemoryMappings(SystemMemorySpace, NULL, PhysicalPage, VirtualPage, 
+                    RunCount, MemoryFlags, PlacementFlags, &Installed);
+            }
+
+            i += Installed;
+            if (Status != OsSuccess) {
                 break;
             }
         }
 
         // If we don't reach end of loop, should we undo?
-        if (i != PageCount) {
-            for (i -= 1; i >= 0; i--) {
-                uintptr_t VirtualPage  = (VirtualBase + (i * GetMemorySpacePageSize()));
-                ClearVirtualPageMapping(SystemMemorySpace, VirtualPage);
-            }
+        if (i != PageCount && i != 0) {
+            ClearVirtualPageMappings(SystemMemorySpace, VirtualBase, i);
         }
     }
 
@@ -467,19 +863,80 @@ CommitMemorySpaceMapping(
 {
     uintptr_t  PhysicalPage;
     OsStatus_t Status = OsError;
+    int        Zeroed = 0;
     assert(SystemMemorySpace != NULL);
     assert(PhysicalAddress == NULL); // Not used for now
 
-    PhysicalPage = AllocateSystemMemory(GetMemorySpacePageSize(), PhysicalMask, 0);
+    // Userspace memory must never expose the previous contents of the page
+    if (GetMemorySpaceAttributes(SystemMemorySpace, VirtualAddress) & MAPPING_USERSPACE) {
+        PhysicalPage = AllocateZeroedPage(PhysicalMask);
+        Zeroed       = 1;
+    }
+    else {
+        PhysicalPage = AllocateSystemMemory(GetMemorySpacePageSize(), PhysicalMask, 0);
+    }
     assert(PhysicalPage != 0);
    
-    Status = CommitVirtualPageMapping(SystemMemorySpace, PhysicalPage, VirtualAddress);
+    Status = CommitVirtualPageMapping(SystemMemorySpace, PhysicalPage, VirtualAddress, 0);
     if (Status != OsSuccess) {
-        FreeSystemMemory(PhysicalPage, GetMemorySpacePageSize());
+        if (Zeroed) {
+            ReleaseZeroedPage(PhysicalPage);
+        }
+        else {
+            FreeSystemMemory(PhysicalPage, GetMemorySpacePageSize());
+        }
     }
     return Status;
 }
 
+OsStatus_t
+CommitMemorySpaceZeroPage(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ VirtualAddress_t     VirtualAddress)
+{
+    Flags_t Flags;
+    assert(SystemMemorySpace != NULL);
+
+    Flags = GetMemorySpaceAttributes(SystemMemorySpace, VirtualAddress);
+    if (GetZeroPage() == 0 || SystemMemorySpace->Context == NULL || 
+        !(Flags & MAPPING_USERSPACE) || (Flags & MAPPING_COMMIT)) {
+        return OsNotSupported;
+    }
+
+    // Read-only memory can map the zero page as it is, writable memory is given
+    // a page of its own on the first write
+    return CommitVirtualPageMapping(SystemMemorySpace, GetZeroPage(), VirtualAddress, 
+        MAPPING_PERSISTENT | ((Flags & MAPPING_READONLY) ? 0 : MAPPING_COPYONWRITE));
+}
+
+/* ReplaceZeroPage
+ * Replaces the zero page at the address with a zeroed page of its own, the page keeps
+ * its attributes except that it becomes writable if the memory is. */
+static OsStatus_t
+ReplaceZeroPage(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ VirtualAddress_t     Address,
+    _In_ Flags_t              Flags)
+{
+    PhysicalAddress_t Page;
+    OsStatus_t        Status;
+
+    Page = AllocateZeroedPage(__MASK);
+    if (Page == 0) {
+        return OsError;
+    }
+
+    // The mapping can have been resolved by another core in the meantime
+    Status = ReplaceVirtualPageMapping(SystemMemorySpace, Address, GetZeroPage(), Page,
+        Flags & ~(MAPPING_COPYONWRITE | MAPPING_PERSISTENT));
+    if (Status != OsSuccess) {
+        ReleaseZeroedPage(Page);
+        return (Status == OsError) ? OsSuccess : Status;
+    }
+    SynchronizeMemoryRegion(SystemMemorySpace, Address, GetMemorySpacePageSize());
+    return OsSuccess;
+}
+
 OsStatus_t
 CloneMemorySpaceMapping(
     _In_        SystemMemorySpace_t* SourceSpace,
@@ -505,12 +962,41 @@ CloneMemorySpaceMapping(
         return OsError;
     }
 
+    // Copy-on-write clones need the source pages to exist, the pages are then shared
+    // until either of the mappings write to them
+    if (MemoryFlags & MAPPING_COPYONWRITE) {
+        MemoryFlags &= ~(MAPPING_COPYONWRITE);
+        for (i = 0; i < PageCount; i++) {
+            uintptr_t SourcePage  = SourceAddress + (i * GetMemorySpacePageSize());
+            uintptr_t VirtualPage = VirtualBase + (i * GetMemorySpacePageSize());
+            
+            Status = CommitMemorySpaceMapping(SourceSpace, NULL, SourcePage, __MASK);
+            if (Status == OsSuccess || Status == OsExists) {
+                Status = ShareMemorySpacePage(SourceSpace, SourcePage, DestinationSpace, VirtualPage, MemoryFlags);
+            }
+            if (Status != OsSuccess) {
+                ERROR(" > failed to create virtual mapping for a copy-on-write clone mapping");
+                break;
+            }
+        }
+        SynchronizeMemoryRegion(SourceSpace, SourceAddress, Size);
+        return Status;
+    }
+
     // Add required memory flags
     MemoryFlags |= (MAPPING_PERSISTENT | MAPPING_COMMIT);
 
     for (i = 0; i < PageCount; i++) {
         uintptr_t VirtualPage   = (VirtualBase + (i * GetMemorySpacePageSize()));
-        uintptr_t PhysicalPage  = GetMemorySpaceMapping(SourceSpace, SourceAddress + (i * GetMemorySpacePageSize()));
+        uintptr_t SourcePage    = SourceAddress + (i * GetMemorySpacePageSize());
+        uintptr_t PhysicalPage  = GetMemorySpaceMapping(SourceSpace, SourcePage);
+
+        // The zero page is never shared writable, the source gets a page of its own first
+        if (IsZeroPage(PhysicalPage)) {
+            ReplaceZeroPage(SourceSpace, SourcePage & ~(GetMemorySpacePageSize() - 1), 
+                GetMemorySpaceAttributes(SourceSpace, SourcePage));
+            PhysicalPage = GetMemorySpaceMapping(SourceSpace, SourcePage);
+        }
         
         Status = SetVirtualPageMapping(DestinationSpace, PhysicalPage, VirtualPage, MemoryFlags);
         // The only reason this ever turns error if the mapping exists, in this case free the allocated
@@ -523,6 +1009,80 @@ CloneMemorySpaceMapping(
     return Status;
 }
 
+/* CopyMemorySpacePage
+ * Copies the contents of the page at the address in the current space into the physical page,
+ * the physical page is mapped only for the duration of the copy. */
+static OsStatus_t
+CopyMemorySpacePage(
+    _In_ VirtualAddress_t  Address,
+    _In_ PhysicalAddress_t PhysicalAddress)
+{
+    VirtualAddress_t CopyAddress;
+    OsStatus_t       Status;
+
+    Status = CreateMemorySpaceMapping(GetCurrentMemorySpace(), &PhysicalAddress, &CopyAddress,
+        GetMemorySpacePageSize(), MAPPING_COMMIT | MAPPING_PERSISTENT, 
+        MAPPING_PHYSICAL_FIXED | MAPPING_VIRTUAL_GLOBAL, __MASK);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    CopyVirtualMemory(CopyAddress, Address, GetMemorySpacePageSize());
+    return RemoveMemorySpaceMapping(GetCurrentMemorySpace(), CopyAddress, GetMemorySpacePageSize());
+}
+
+OsStatus_t
+HandleCopyOnWritePageFault(
+    _In_ SystemMemorySpace_t* SystemMemorySpace,
+    _In_ VirtualAddress_t     Address)
+{
+    PhysicalAddress_t PhysicalPage;
+    PhysicalAddress_t CopyPage;
+    OsStatus_t        Status;
+    Flags_t           Flags;
+    assert(SystemMemorySpace != NULL);
+
+    Address &= ~(GetMemorySpacePageSize() - 1);
+    Flags    = GetMemorySpaceAttributes(SystemMemorySpace, Address);
+    if (!(Flags & MAPPING_COMMIT) || !(Flags & MAPPING_COPYONWRITE)) {
+        return OsDoesNotExist;
+    }
+    Flags       &= ~(MAPPING_COPYONWRITE);
+    PhysicalPage = GetMemorySpaceMapping(SystemMemorySpace, Address);
+
+    // Memory that was only read so far is backed by the zero page, there is nothing to copy
+    if (IsZeroPage(PhysicalPage)) {
+        return ReplaceZeroPage(SystemMemorySpace, Address, Flags);
+    }
+
+    // If the other mappings of the page are gone by now we own it, and the page
+    // can simply be made writable again
+    if (!IsSharedPage(PhysicalPage)) {
+        Status = ReplaceVirtualPageMapping(SystemMemorySpace, Address, PhysicalPage, PhysicalPage, Flags);
+        return (Status == OsError) ? OsSuccess : Status;
+    }
+
+    CopyPage = AllocateSystemMemory(GetMemorySpacePageSize(), __MASK, 0);
+    if (CopyPage == 0) {
+        return OsError;
+    }
+
+    Status = CopyMemorySpacePage(Address, CopyPage);
+    if (Status == OsSuccess) {
+        Status = ReplaceVirtualPageMapping(SystemMemorySpace, Address, PhysicalPage, CopyPage, Flags);
+    }
+
+    // The mapping can have been resolved by another core in the meantime, in which
+    // case our copy is simply discarded
+    if (Status != OsSuccess) {
+        FreeSystemMemory(CopyPage, GetMemorySpacePageSize());
+        return (Status == OsError) ? OsSuccess : Status;
+    }
+    FreeMemorySpacePage(PhysicalPage);
+    SynchronizeMemoryRegion(SystemMemorySpace, Address, GetMemorySpacePageSize());
+    return OsSuccess;
+}
+
 OsStatus_t
 RemoveMemorySpaceMapping(
     _In_ SystemMemorySpace_t* SystemMemorySpace, 
@@ -530,17 +1090,31 @@ RemoveMemorySpaceMapping(
     _In_ size_t               Size)
 {
     OsStatus_t Status;
-    int        PageCount = DIVUP(Size, GetMemorySpacePageSize());
+    int        PageCount      = DIVUP(Size, GetMemorySpacePageSize());
+    int        LargePageCount = (int)(GetVirtualLargePageSize() / GetMemorySpacePageSize());
     int        i;
     assert(SystemMemorySpace != NULL);
 
-    // Free the underlying resources first, before freeing the upper resources
-    for (i = 0; i < PageCount; i++) {
+    // Free the underlying resources first, before freeing the upper resources. Pages are cleared
+    // in runs that stop at large page boundaries, so large pages can be removed as a whole
+    for (i = 0; i < PageCount; ) {
         uintptr_t VirtualPage = Address + (i * GetMemorySpacePageSize());
-        Status                = ClearVirtualPageMapping(SystemMemorySpace, VirtualPage);
+        int       RunCount    = PageCount - i;
+        if (LargePageCount != 0) {
+            if ((VirtualPage % GetVirtualLargePageSize()) == 0 && RunCount >= LargePageCount &&
+                ClearVirtualLargePageMapping(SystemMemorySpace, VirtualPage) == OsSuccess) {
+                i += LargePageCount;
+                continue;
+            }
+            RunCount = MIN(RunCount, LargePageCount - 
+                (int)((VirtualPage % GetVirtualLargePageSize()) / GetMemorySpacePageSize()));
+        }
+
+        Status = ClearVirtualPageMappings(SystemMemorySpace, VirtualPage, RunCount);
         if (Status != OsSuccess) {
-            WARNING("Failed to unmap address 0x%" PRIxIN "", VirtualPage);
+            WARNING("Failed to unmap range 0x%" PRIxIN "", VirtualPage);
         }
+        i += RunCount;
     }
     SynchronizeMemoryRegion(SystemMemorySpace, Address, Size);
 
@@ -566,7 +1140,8 @@ ChangeMemorySpaceProtection(
     _In_        Flags_t                 Flags,
     _Out_       Flags_t*                PreviousFlags)
 {
-    OsStatus_t Status = OsSuccess;
+    OsStatus_t Status         = OsSuccess;
+    int        LargePageCount = (int)(GetVirtualLargePageSize() / GetMemorySpacePageSize());
     int        PageCount;
     int        i;
     assert(SystemMemorySpace != NULL);
@@ -583,9 +1158,30 @@ ChangeMemorySpaceProtection(
     // Calculate the number of pages of this allocation
     PageCount = DIVUP((Size + (VirtualAddress % GetMemorySpacePageSize())), GetMemorySpacePageSize());
     for (i = 0; i < PageCount; i++) {
-        uintptr_t Block = VirtualAddress + (i * GetMemorySpacePageSize());
+        uintptr_t         Block      = VirtualAddress + (i * GetMemorySpacePageSize());
+        Flags_t           BlockFlags = Flags & ~(MAPPING_COPYONWRITE);
+        PhysicalAddress_t PhysicalPage;
+
+        // Large pages are never shared, so they are changed as a whole when the range covers them,
+        // a partial change splits the large page
+        if (LargePageCount != 0 && (PageCount - i) >= LargePageCount &&
+            (Block % GetVirtualLargePageSize()) == 0 &&
+            SetVirtualLargePageAttributes(SystemMemorySpace, Block, BlockFlags) == OsSuccess) {
+            i += LargePageCount - 1;
+            continue;
+        }
+
+        // Shared pages can never be made writable, only copy-on-write, and the zero page must
+        // stay persistent as it is never freed
+        PhysicalPage = GetMemorySpaceMapping(SystemMemorySpace, Block);
+        if (IsZeroPage(PhysicalPage)) {
+            BlockFlags |= MAPPING_PERSISTENT;
+        }
+        if (!(Flags & MAPPING_READONLY) && (IsSharedPage(PhysicalPage) || IsZeroPage(PhysicalPage))) {
+            BlockFlags |= MAPPING_COPYONWRITE;
+        }
         
-        Status = SetVirtualPageAttributes(SystemMemorySpace, Block, Flags);
+        Status = SetVirtualPageAttributes(SystemMemorySpace, Block, BlockFlags);
         if (Status != OsSuccess) {
             break;
         }
@@ -659,3 +1255,14 @@ GetMemorySpacePageSize(void)
 {
     return GetMachine()->MemoryGranularity;
 }
+
+size_t
+GetMemorySpaceGeneration(
+    _In_ SystemMemorySpace_t* SystemMemorySpace)
+{
+    assert(SystemMemorySpace != NULL);
+    if (SystemMemorySpace->Context == NULL) {
+        return 0;
+    }
+    return atomic_load(&SystemMemorySpace->Context->Generation);
+}
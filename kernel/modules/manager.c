@@ -24,6 +24,7 @@
 
 #include "../../librt/libc/stdio/local.h"
 #include "../../librt/libds/pe/pe.h"
+#include <modules/ramdisk.h>
 #include <memoryspace.h>
 #include <arch/interrupts.h>
 #include <arch/utils.h>
@@ -54,14 +55,15 @@ InitializeModuleInheritationBlock(void)
 
 OsStatus_t
 RegisterModule(
-    _In_ const char*        Path,
-    _In_ const void*        Data,
-    _In_ size_t             Length,
-    _In_ SystemModuleType_t Type,
-    _In_ DevInfo_t          VendorId,
-    _In_ DevInfo_t          DeviceId,
-    _In_ DevInfo_t          DeviceClass,
-    _In_ DevInfo_t          DeviceSubclass)
+    _In_     const char*        Path,
+    _In_Opt_ const void*        Data,
+    _In_Opt_ const void*        PackedData,
+    _In_     size_t             Length,
+    _In_     SystemModuleType_t Type,
+    _In_     DevInfo_t          VendorId,
+    _In_     DevInfo_t          DeviceId,
+    _In_     DevInfo_t          DeviceClass,
+    _In_     DevInfo_t          DeviceSubclass)
 {
     SystemModule_t* Module;
 
@@ -70,9 +72,10 @@ RegisterModule(
     memset(Module, 0, sizeof(SystemModule_t));
     Module->ListHeader.Key.Value.Integer = (int)Type;
 
-    Module->Handle = ModuleIdGenerator++;
-    Module->Data   = Data;
-    Module->Length = Length;
+    Module->Handle     = ModuleIdGenerator++;
+    Module->Data       = Data;
+    Module->PackedData = PackedData;
+    Module->Length     = Length;
     Module->Path   = MStringCreate("rd:/", StrUTF8);
     MStringAppendCharacters(Module->Path, Path, StrUTF8);
 
@@ -113,6 +116,42 @@ SpawnServices(void)
     InterruptRestoreState(IrqState);
 }
 
+/* UnpackModuleData
+ * Unpacks the data of a module that is stored packed in the ramdisk. Modules can be used by
+ * several threads at once, the first thread to finish the unpacking provides the data. */
+static OsStatus_t
+UnpackModuleData(
+    _In_ SystemModule_t* Module)
+{
+    const void* Expected = NULL;
+    uintptr_t   Data;
+    OsStatus_t  Status;
+
+    if (atomic_load(&Module->Data) != NULL) {
+        return OsSuccess;
+    }
+    assert(Module->PackedData != NULL);
+
+    // Modules are larger than the largest heap cache, so they get their own pages
+    Status = CreateMemorySpaceMapping(GetCurrentMemorySpace(), NULL, &Data, Module->Length,
+        MAPPING_COMMIT | MAPPING_DOMAIN, MAPPING_PHYSICAL_DEFAULT | MAPPING_VIRTUAL_GLOBAL, __MASK);
+    if (Status != OsSuccess) {
+        ERROR("Failed to allocate memory for module %s", MStringRaw(Module->Path));
+        return OsError;
+    }
+
+    if (UnpackRamdiskModule((const SystemRamdiskModuleHeader_t*)Module->PackedData, (void*)Data) != OsSuccess) {
+        ERROR("Failed to unpack module %s", MStringRaw(Module->Path));
+        RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Data, Module->Length);
+        return OsError;
+    }
+
+    if (!atomic_compare_exchange_strong(&Module->Data, &Expected, (const void*)Data)) {
+        RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Data, Module->Length);
+    }
+    return OsSuccess;
+}
+
 /* GetModuleDataByPath
  * Retrieve a pointer to the file-buffer and its length based on 
  * the given <rd:/> path */
@@ -130,10 +169,12 @@ GetModuleDataByPath(
         if (Module->Path != NULL) {
             TRACE("Comparing(%s)To(%s)", MStringRaw(Path), MStringRaw(Module->Path));
             if (MStringCompare(Path, Module->Path, 1) != MSTRING_NO_MATCH) {
-                assert(Module->Data != NULL && Module->Length != 0);
-                *Buffer = (void*)Module->Data;
-                *Length = Module->Length;
-                Result  = OsSuccess;
+                assert(Module->Length != 0);
+                Result = UnpackModuleData(Module);
+                if (Result == OsSuccess) {
+                    *Buffer = (void*)atomic_load(&Module->Data);
+                    *Length = Module->Length;
+                }
                 break;
             }
         }
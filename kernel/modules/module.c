@@ -76,7 +76,7 @@ SpawnModule(
 
     assert(Module != NULL);
     assert(Module->Executable == NULL);
-    assert(Module->Data != NULL && Module->Length != 0);
+    assert((Module->Data != NULL || Module->PackedData != NULL) && Module->Length != 0);
 
     Module->Rpc = CreateSystemPipe(PIPE_MPMC | PIPE_STRUCTURED_BUFFER, PIPE_DEFAULT_ENTRYCOUNT);
 
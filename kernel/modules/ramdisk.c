@@ -25,9 +25,186 @@
 
 #include <modules/ramdisk.h>
 #include <modules/manager.h>
+#include <threading.h>
+#include <machine.h>
+#include <string.h>
 #include <debug.h>
 #include <crc32.h>
 
+#define RAMDISK_UNPACK_WORKERS 4 // Maximum number of helper threads per module
+
+typedef struct _RamdiskUnpackJob {
+    const SystemRamdiskModuleHeader_t* Header;
+    const SystemRamdiskChunk_t*        Chunks;
+    int                                ChunkCount;
+    uint8_t*                           Buffer;
+    _Atomic(int)                       NextChunk;
+    _Atomic(int)                       Failed;
+} RamdiskUnpackJob_t;
+
+static uintptr_t RamdiskBase = 0;
+static size_t    RamdiskSize = 0;
+
+/* RamdiskDecompressChunk
+ * Decompresses a lz4 block. The block must decompress to exactly the length of the
+ * destination, and all lengths and offsets are validated against both buffers. */
+static OsStatus_t
+RamdiskDecompressChunk(
+    _In_ const uint8_t* Source,
+    _In_ size_t         SourceLength,
+    _In_ uint8_t*       Destination,
+    _In_ size_t         DestinationLength)
+{
+    const uint8_t* SourceEnd = Source + SourceLength;
+    uint8_t*       Output    = Destination;
+    uint8_t*       OutputEnd = Destination + DestinationLength;
+
+    while (Source < SourceEnd) {
+        unsigned int   Token  = *Source++;
+        size_t         Length = Token >> 4;
+        size_t         Offset;
+        const uint8_t* Match;
+        unsigned int   Byte;
+
+        if (Length == 15) {
+            do {
+                if (Source == SourceEnd) {
+                    return OsError;
+                }
+                Byte    = *Source++;
+                Length += Byte;
+            } while (Byte == 255);
+        }
+        if (Length > (size_t)(SourceEnd - Source) || Length > (size_t)(OutputEnd - Output)) {
+            return OsError;
+        }
+        memcpy(Output, Source, Length);
+        Output += Length;
+        Source += Length;
+
+        // The last sequence consists of literals only
+        if (Source == SourceEnd) {
+            break;
+        }
+        if ((SourceEnd - Source) < 2) {
+            return OsError;
+        }
+        Offset  = (size_t)Source[0] | ((size_t)Source[1] << 8);
+        Source += 2;
+        if (Offset == 0 || Offset > (size_t)(Output - Destination)) {
+            return OsError;
+        }
+
+        Length = Token & 0xF;
+        if (Length == 15) {
+            do {
+                if (Source == SourceEnd) {
+                    return OsError;
+                }
+                Byte    = *Source++;
+                Length += Byte;
+            } while (Byte == 255);
+        }
+        Length += 4;
+        if (Length > (size_t)(OutputEnd - Output)) {
+            return OsError;
+        }
+
+        // Matches may overlap the output they produce
+        Match = Output - Offset;
+        if (Offset >= Length) {
+            memcpy(Output, Match, Length);
+            Output += Length;
+        }
+        else {
+            while (Length--) {
+                *Output++ = *Match++;
+            }
+        }
+    }
+    return (Output == OutputEnd) ? OsSuccess : OsError;
+}
+
+/* RamdiskUnpackChunks
+ * Unpacks chunks of the job until all chunks have been claimed. Called by all threads
+ * that take part in unpacking the module. */
+static void
+RamdiskUnpackChunks(
+    _In_ RamdiskUnpackJob_t* Job)
+{
+    int Index = atomic_fetch_add(&Job->NextChunk, 1);
+    while (Index < Job->ChunkCount && !atomic_load(&Job->Failed)) {
+        const SystemRamdiskChunk_t* Chunk  = &Job->Chunks[Index];
+        const uint8_t*              Data   = (const uint8_t*)(RamdiskBase + Chunk->Offset);
+        size_t                      Length = MIN(RAMDISK_CHUNK_SIZE, 
+            Job->Header->LengthOfData - (Index * RAMDISK_CHUNK_SIZE));
+        OsStatus_t                  Status = OsError;
+
+        // The chunk must lie inside the ramdisk before any of it is read
+        if (Chunk->Offset < RamdiskSize && Chunk->Length <= (RamdiskSize - Chunk->Offset) &&
+            Crc32Generate(-1, (uint8_t*)Data, Chunk->Length) == Chunk->Crc32OfData) {
+            if (Chunk->Flags & RAMDISK_CHUNK_LZ4) {
+                Status = RamdiskDecompressChunk(Data, Chunk->Length, 
+                    Job->Buffer + (Index * RAMDISK_CHUNK_SIZE), Length);
+            }
+            else if (Chunk->Length == Length) {
+                memcpy(Job->Buffer + (Index * RAMDISK_CHUNK_SIZE), Data, Length);
+                Status = OsSuccess;
+            }
+        }
+
+        if (Status != OsSuccess) {
+            ERROR("Chunk %i of ramdisk module is corrupt", Index);
+            atomic_store(&Job->Failed, 1);
+            break;
+        }
+        Index = atomic_fetch_add(&Job->NextChunk, 1);
+    }
+}
+
+static void
+RamdiskUnpackWorker(
+    _In_ void* Context)
+{
+    RamdiskUnpackChunks((RamdiskUnpackJob_t*)Context);
+}
+
+OsStatus_t
+UnpackRamdiskModule(
+    _In_ const SystemRamdiskModuleHeader_t* Header,
+    _In_ void*                              Buffer)
+{
+    UUId_t             Workers[RAMDISK_UNPACK_WORKERS];
+    RamdiskUnpackJob_t Job;
+    int                WorkerCount;
+    int                i;
+
+    Job.Header     = Header;
+    Job.Chunks     = (const SystemRamdiskChunk_t*)(Header + 1);
+    Job.ChunkCount = (int)DIVUP(Header->LengthOfData, RAMDISK_CHUNK_SIZE);
+    Job.Buffer     = (uint8_t*)Buffer;
+    atomic_store(&Job.NextChunk, 0);
+    atomic_store(&Job.Failed, 0);
+
+    // The calling thread takes part in the unpacking, helpers are only started when there
+    // are more chunks than the caller has to do itself
+    WorkerCount = MIN(Job.ChunkCount, (int)GetMachine()->NumberOfActiveCores) - 1;
+    WorkerCount = MIN(WorkerCount, RAMDISK_UNPACK_WORKERS);
+    for (i = 0; i < WorkerCount; i++) {
+        if (CreateThread("rd-unpack", RamdiskUnpackWorker, &Job, 0, UUID_INVALID, &Workers[i]) != OsSuccess) {
+            Workers[i] = UUID_INVALID;
+        }
+    }
+
+    RamdiskUnpackChunks(&Job);
+    for (i = 0; i < WorkerCount; i++) {
+        if (Workers[i] != UUID_INVALID) {
+            ThreadingJoinThread(Workers[i]);
+        }
+    }
+    return atomic_load(&Job.Failed) ? OsError : OsSuccess;
+}
+
 /* ParseInitialRamdisk
  * Parses the supplied ramdisk by the bootloader. Without a ramdisk present only debug
  * functionality will be available. */
@@ -47,12 +224,14 @@ ParseInitialRamdisk(
     }
     
     // Initialize the pointer and read the signature value, must match
-    Ramdisk = (SystemRamdiskHeader_t*)(uintptr_t)BootInformation->RamdiskAddress;
+    Ramdisk     = (SystemRamdiskHeader_t*)(uintptr_t)BootInformation->RamdiskAddress;
+    RamdiskBase = (uintptr_t)BootInformation->RamdiskAddress;
+    RamdiskSize = (size_t)BootInformation->RamdiskSize;
     if (Ramdisk->Magic != RAMDISK_MAGIC) {
         ERROR("Invalid magic in ramdisk - 0x%" PRIxIN "", Ramdisk->Magic);
         return OsError;
     }
-    if (Ramdisk->Version != RAMDISK_VERSION_1) {
+    if (Ramdisk->Version != RAMDISK_VERSION_1 && Ramdisk->Version != RAMDISK_VERSION_2) {
         ERROR("Invalid ramdisk version - 0x%" PRIxIN "", Ramdisk->Version);
         return OsError;
     }
@@ -68,6 +247,7 @@ ParseInitialRamdisk(
                 (SystemRamdiskModuleHeader_t*)(uintptr_t)(BootInformation->RamdiskAddress + Entry->DataHeaderOffset);
             uint8_t* ModuleData;
             uint32_t CrcOfData;
+            size_t   LengthOfCrc = Header->LengthOfData;
 
             if (Entry->Type == RAMDISK_FILE) {
                 Type = FileResource;
@@ -81,13 +261,20 @@ ParseInitialRamdisk(
                 }
             }
 
-            // Perform CRC validation
+            // Perform CRC validation, for packed modules only the chunk table is validated
+            // here as every chunk is validated when it is unpacked
             ModuleData = (uint8_t*)(BootInformation->RamdiskAddress 
                 + Entry->DataHeaderOffset + sizeof(SystemRamdiskModuleHeader_t));
-            CrcOfData  = Crc32Generate(-1, ModuleData, Header->LengthOfData);
+            if (Ramdisk->Version == RAMDISK_VERSION_2) {
+                LengthOfCrc = DIVUP(Header->LengthOfData, RAMDISK_CHUNK_SIZE) * sizeof(SystemRamdiskChunk_t);
+            }
+            CrcOfData = Crc32Generate(-1, ModuleData, LengthOfCrc);
             if (CrcOfData == Header->Crc32OfData) {
-                if (RegisterModule((const char*)&Entry->Name[0], (const void*)ModuleData, Header->LengthOfData, 
-                    Type, Header->VendorId, Header->DeviceId, Header->DeviceType, Header->DeviceSubType) != OsSuccess) {
+                if (RegisterModule((const char*)&Entry->Name[0], 
+                    (Ramdisk->Version == RAMDISK_VERSION_2) ? NULL : (const void*)ModuleData, 
+                    (Ramdisk->Version == RAMDISK_VERSION_2) ? (const void*)Header : NULL,
+                    Header->LengthOfData, Type, Header->VendorId, Header->DeviceId, 
+                    Header->DeviceType, Header->DeviceSubType) != OsSuccess) {
                     // @todo ?
                     FATAL(FATAL_SCOPE_KERNEL, "failed to register module");
                 }
@@ -140,6 +140,7 @@ LogRenderMessages(void)
             printf("%s\n", &Line->Data[0]);
         }
     }
+    VideoFlush();
 	dsunlock(&LogObject.SyncObject);
 }
 
@@ -203,7 +203,7 @@ ScLoadDriver(
         // We did not have any, did the driver provide one for us?
         if (Module == NULL) {
             if (DriverBuffer != NULL && DriverBufferLength != 0) {
-                Status = RegisterModule("custom_module", DriverBuffer, DriverBufferLength, ModuleResource, 
+                Status = RegisterModule("custom_module", DriverBuffer, NULL, DriverBufferLength, ModuleResource, 
                     Device->VendorId, Device->DeviceId, Device->Class, Device->Subclass);
                 if (Status == OsSuccess) {
                     Module = GetModule(Device->VendorId, Device->DeviceId, Device->Class, Device->Subclass);
@@ -251,6 +251,51 @@ ScUnregisterInterrupt(
     return InterruptUnregister(Source);
 }
 
+OsStatus_t
+ScWaitForInterrupt(
+    _In_  UUId_t  Source,
+    _In_  size_t  Timeout,
+    _Out_ size_t* EventsOut)
+{
+    if (GetCurrentModule() == NULL) {
+        return OsInvalidPermissions;
+    }
+    return InterruptWaitForEvent(Source, Timeout, EventsOut);
+}
+
+OsStatus_t
+ScGetInterruptStatistics(
+    _In_  UUId_t                 Source,
+    _Out_ InterruptStatistics_t* Statistics)
+{
+    if (GetCurrentModule() == NULL) {
+        return OsInvalidPermissions;
+    }
+    return InterruptGetStatistics(Source, Statistics);
+}
+
+OsStatus_t
+ScGetInterruptCoreStatistics(
+    _In_  UUId_t                     CoreId,
+    _Out_ InterruptCoreStatistics_t* Statistics)
+{
+    if (GetCurrentModule() == NULL) {
+        return OsInvalidPermissions;
+    }
+    return InterruptGetCoreStatistics(CoreId, Statistics);
+}
+
+OsStatus_t
+ScSetInterruptAffinity(
+    _In_ UUId_t Source,
+    _In_ UUId_t CoreId)
+{
+    if (GetCurrentModule() == NULL) {
+        return OsInvalidPermissions;
+    }
+    return InterruptSetAffinity(Source, CoreId);
+}
+
 OsStatus_t
 ScRegisterEventTarget(
     _In_ UUId_t StdInputHandle,
@@ -261,29 +306,125 @@ ScRegisterEventTarget(
     return OsSuccess;
 }
 
+// Delivery statistics of the system input pipes, updated by every driver that
+// writes events, so the numbers are not exact under concurrent writers
+static InputStatistics_t KeyStatistics   = { 0 };
+static InputStatistics_t InputStatistics = { 0 };
+
+/* RecordInputLatency
+ * Accounts the input-to-delivery latency of a single event in the statistics. */
+static void
+RecordInputLatency(
+    _In_ InputStatistics_t* Statistics,
+    _In_ uint64_t           Now,
+    _In_ uint64_t           Timestamp)
+{
+    uint64_t Latency;
+    if (Timestamp == 0 || Timestamp > Now) {
+        return;
+    }
+
+    Latency = Now - Timestamp;
+    Statistics->Stamped++;
+    Statistics->LatencyTotal += Latency;
+    if (Latency > Statistics->LatencyMax) {
+        Statistics->LatencyMax = Latency;
+    }
+}
+
+/* InputPipeCapacity
+ * The number of events of the given size a single write to the input pipe can hold,
+ * the segment buffer of a pipe is (1 << (SegmentLgSize * 2)) bytes. Without a pipe the
+ * batch is limited as if it was a pipe of the default size. */
+static size_t
+InputPipeCapacity(
+    _In_ SystemPipe_t* Pipe,
+    _In_ size_t        EventSize)
+{
+    size_t LgSize = (Pipe != NULL) ? Pipe->SegmentLgSize : PIPE_DEFAULT_ENTRYCOUNT;
+    return ((size_t)1 << (LgSize * 2)) / EventSize;
+}
+
 OsStatus_t
 ScKeyEvent(
-    _In_ SystemKey_t* Key)
+    _In_ SystemKey_t* Keys,
+    _In_ size_t       Count)
 {
+    LargeInteger_t Tick = { { 0 } };
+
+    if (Keys == NULL || Count == 0 ||
+        Count > InputPipeCapacity(GetMachine()->StdInput, sizeof(SystemKey_t))) {
+        return OsInvalidParameters;
+    }
+
 #ifdef __OSCONFIG_ENABLE_DEBUG_SHORTCUTS
     // Handle debug key events
-    if ((Key->Flags & (KEY_MODIFIER_LCTRL | KEY_MODIFIER_RCTRL)) && 
-        (Key->Flags & KEY_MODIFIER_RELEASED)) {
-        DebugHandleShortcut(Key);
+    for (size_t i = 0; i < Count; i++) {
+        if ((Keys[i].Flags & (KEY_MODIFIER_LCTRL | KEY_MODIFIER_RCTRL)) && 
+            (Keys[i].Flags & KEY_MODIFIER_RELEASED)) {
+            DebugHandleShortcut(&Keys[i]);
+        }
     }
 #endif
     if (GetMachine()->StdInput != NULL) {
-        return WriteSystemPipe(GetMachine()->StdInput, (const uint8_t*)Key, sizeof(SystemKey_t));
+        WriteSystemPipe(GetMachine()->StdInput, (const uint8_t*)Keys, Count * sizeof(SystemKey_t));
     }
+
+    TimersQueryPerformanceTick(&Tick);
+    for (size_t i = 0; i < Count; i++) {
+        RecordInputLatency(&KeyStatistics, (uint64_t)Tick.QuadPart, Keys[i].Timestamp);
+    }
+    KeyStatistics.Batches++;
+    KeyStatistics.Events += Count;
+    TRACE("key batch of %u events, first event latency %u ticks", Count, 
+        (Keys[0].Timestamp != 0) ? LODWORD((uint64_t)Tick.QuadPart - Keys[0].Timestamp) : 0);
     return OsSuccess;
 }
 
 OsStatus_t
 ScInputEvent(
-    _In_ SystemInput_t* Input)
+    _In_ SystemInput_t* Inputs,
+    _In_ size_t         Count)
 {
+    LargeInteger_t Tick = { { 0 } };
+
+    if (Inputs == NULL || Count == 0 ||
+        Count > InputPipeCapacity(GetMachine()->WmInput, sizeof(SystemInput_t))) {
+        return OsInvalidParameters;
+    }
+
     if (GetMachine()->WmInput != NULL) {
-        return WriteSystemPipe(GetMachine()->WmInput, (const uint8_t*)Input, sizeof(SystemInput_t));
+        WriteSystemPipe(GetMachine()->WmInput, (const uint8_t*)Inputs, Count * sizeof(SystemInput_t));
+    }
+
+    TimersQueryPerformanceTick(&Tick);
+    for (size_t i = 0; i < Count; i++) {
+        RecordInputLatency(&InputStatistics, (uint64_t)Tick.QuadPart, Inputs[i].Timestamp);
+    }
+    InputStatistics.Batches++;
+    InputStatistics.Events += Count;
+    TRACE("input batch of %u events, first event latency %u ticks", Count, 
+        (Inputs[0].Timestamp != 0) ? LODWORD((uint64_t)Tick.QuadPart - Inputs[0].Timestamp) : 0);
+    return OsSuccess;
+}
+
+OsStatus_t
+ScGetInputStatistics(
+    _Out_ InputStatistics_t* Keys,
+    _Out_ InputStatistics_t* Inputs)
+{
+    if (GetCurrentModule() == NULL) {
+        return OsInvalidPermissions;
+    }
+    if (Keys == NULL && Inputs == NULL) {
+        return OsInvalidParameters;
+    }
+
+    if (Keys != NULL) {
+        memcpy(Keys, &KeyStatistics, sizeof(InputStatistics_t));
+    }
+    if (Inputs != NULL) {
+        memcpy(Inputs, &InputStatistics, sizeof(InputStatistics_t));
     }
     return OsSuccess;
 }
@@ -83,14 +83,18 @@ ScDestroyPipe(
 }
 
 /* ScReadPipe
- * Reads the requested number of bytes from the system-pipe. */
+ * Reads the requested number of bytes from the system-pipe. For raw pipes the read
+ * completes as soon as any data is available, and the number of bytes actually read
+ * is stored in <BytesRead> if provided. */
 OsStatus_t
 ScReadPipe(
-    _In_ UUId_t   Handle,
-    _In_ uint8_t* Message,
-    _In_ size_t   Length)
+    _In_  UUId_t   Handle,
+    _In_  uint8_t* Message,
+    _In_  size_t   Length,
+    _Out_ size_t*  BytesRead)
 {
     SystemPipe_t* Pipe = (SystemPipe_t*)LookupHandle(Handle);
+    size_t        BytesReadPipe = 0;
     if (Pipe == NULL) {
         ERROR("Thread %s trying to read from non-existing pipe handle %" PRIuIN "", 
             GetCurrentThreadForCore(ArchGetProcessorCoreId())->Name, Handle);
@@ -98,7 +102,10 @@ ScReadPipe(
     }
 
     if (Length != 0) {
-        ReadSystemPipe(Pipe, Message, Length);
+        BytesReadPipe = ReadSystemPipe(Pipe, Message, Length);
+    }
+    if (BytesRead != NULL) {
+        *BytesRead = BytesReadPipe;
     }
     return OsSuccess;
 }
@@ -89,6 +89,7 @@ ScMemoryFree(
     if (Address == 0 || Size == 0) {
         return OsInvalidParameters;
     }
+    ReleaseMemoryBufferMapping(Space, Address);
     return RemoveMemorySpaceMapping(Space, Address, Size);
 }
 
@@ -112,13 +113,14 @@ ScMemoryProtect(
 
 OsStatus_t
 ScCreateBuffer(
+    _In_  Flags_t       Flags,
     _In_  size_t        Size,
     _Out_ DmaBuffer_t*  MemoryBuffer)
 {
     if (MemoryBuffer == NULL || Size == 0) {
         return OsError;
     }
-    return CreateMemoryBuffer(Size, MemoryBuffer);
+    return CreateMemoryBuffer(Flags, Size, MemoryBuffer);
 }
 
 OsStatus_t
@@ -144,6 +146,21 @@ ScQueryBuffer(
     return QueryMemoryBuffer(Handle, Dma, Capacity);
 }
 
+OsStatus_t
+ScQueryBufferSegments(
+    _In_    UUId_t        Handle,
+    _In_    size_t        Offset,
+    _In_    size_t        Length,
+    _In_    DmaSegment_t* Segments,
+    _InOut_ int*          SegmentCount)
+{
+    if (Segments == NULL || SegmentCount == NULL || *SegmentCount <= 0 || 
+        Handle == UUID_INVALID || Length == 0) {
+        return OsError;
+    }
+    return QueryMemoryBufferSegments(Handle, Offset, Length, Segments, SegmentCount);
+}
+
 OsStatus_t 
 ScCreateMemorySpace(
     _In_  Flags_t Flags,
@@ -159,6 +176,27 @@ ScCreateMemorySpace(
     return CreateMemorySpace(Flags | MEMORY_SPACE_APPLICATION, Handle);
 }
 
+OsStatus_t 
+ScForkMemorySpace(
+    _In_  UUId_t  Source,
+    _Out_ UUId_t* Handle)
+{
+    SystemModule_t*      Module = GetCurrentModule();
+    SystemMemorySpace_t* MemorySpace;
+    if (Handle == NULL || Module == NULL) {
+        if (Module == NULL) {
+            return OsInvalidPermissions;
+        }
+        return OsError;
+    }
+
+    MemorySpace = (SystemMemorySpace_t*)LookupHandleOfType(Source, HandleTypeMemorySpace);
+    if (MemorySpace == NULL) {
+        return OsDoesNotExist;
+    }
+    return CloneMemorySpace(MemorySpace, Handle);
+}
+
 OsStatus_t 
 ScGetThreadMemorySpaceHandle(
     _In_  UUId_t  ThreadHandle,
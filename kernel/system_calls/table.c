@@ -76,9 +76,14 @@ extern OsStatus_t ScLoadDriver(MCoreDevice_t* Device, size_t Length);
 extern UUId_t     ScRegisterInterrupt(DeviceInterrupt_t* Interrupt, Flags_t Flags);
 extern OsStatus_t ScUnregisterInterrupt(UUId_t Source);
 extern OsStatus_t ScRegisterEventTarget(UUId_t StdInputHandle, UUId_t WmHandle);
-extern OsStatus_t ScKeyEvent(SystemKey_t* Key);
-extern OsStatus_t ScInputEvent(SystemInput_t* Input);
+extern OsStatus_t ScKeyEvent(SystemKey_t* Keys, size_t Count);
+extern OsStatus_t ScInputEvent(SystemInput_t* Inputs, size_t Count);
+extern OsStatus_t ScGetInputStatistics(InputStatistics_t* Keys, InputStatistics_t* Inputs);
 extern OsStatus_t ScGetProcessBaseAddress(uintptr_t* BaseAddress);
+extern OsStatus_t ScWaitForInterrupt(UUId_t Source, size_t Timeout, size_t* EventsOut);
+extern OsStatus_t ScGetInterruptStatistics(UUId_t Source, InterruptStatistics_t* Statistics);
+extern OsStatus_t ScGetInterruptCoreStatistics(UUId_t CoreId, InterruptCoreStatistics_t* Statistics);
+extern OsStatus_t ScSetInterruptAffinity(UUId_t Source, UUId_t CoreId);
 
 ///////////////////////////////////////////////
 // Operating System Interface
@@ -108,7 +113,7 @@ extern OsStatus_t ScWaitForObject(uintptr_t* Handle, size_t Timeout);
 // Communication system calls
 extern OsStatus_t ScCreatePipe(int Type, UUId_t* Handle);
 extern OsStatus_t ScDestroyPipe(UUId_t Handle);
-extern OsStatus_t ScReadPipe(UUId_t Handle, uint8_t* Message, size_t Length);
+extern OsStatus_t ScReadPipe(UUId_t Handle, uint8_t* Message, size_t Length, size_t* BytesRead);
 extern OsStatus_t ScWritePipe(UUId_t Handle, uint8_t* Message, size_t Length);
 extern OsStatus_t ScRpcResponse(MRemoteCall_t* RemoteCall);
 extern OsStatus_t ScRpcExecute(MRemoteCall_t* RemoteCall, int Async);
@@ -119,9 +124,11 @@ extern OsStatus_t ScRpcRespond(MRemoteCallAddress_t* RemoteAddress, const uint8_
 extern OsStatus_t ScMemoryAllocate(size_t Size, Flags_t Flags, uintptr_t* VirtualAddress, uintptr_t* PhysicalAddress);
 extern OsStatus_t ScMemoryFree(uintptr_t  Address, size_t Size);
 extern OsStatus_t ScMemoryProtect(void* MemoryPointer, size_t Length, Flags_t Flags, Flags_t* PreviousFlags);
-extern OsStatus_t ScCreateBuffer(size_t Size, DmaBuffer_t* MemoryBuffer);
+extern OsStatus_t ScCreateBuffer(Flags_t Flags, size_t Size, DmaBuffer_t* MemoryBuffer);
 extern OsStatus_t ScAcquireBuffer(UUId_t Handle, DmaBuffer_t* MemoryBuffer);
 extern OsStatus_t ScQueryBuffer(UUId_t Handle, uintptr_t* Dma, size_t* Capacity);
+extern OsStatus_t ScQueryBufferSegments(UUId_t Handle, size_t Offset, size_t Length, DmaSegment_t* Segments, int* SegmentCount);
+extern OsStatus_t ScForkMemorySpace(UUId_t Source, UUId_t* Handle);
 
 // Support system calls
 extern OsStatus_t ScDestroyHandle(UUId_t Handle);
@@ -138,7 +145,7 @@ extern OsStatus_t ScPerformanceTick(LargeInteger_t *Value);
 extern OsStatus_t ScIsServiceAvailable(UUId_t ServiceId);
 
 // The static system calls function table.
-uintptr_t GlbSyscallTable[77] = {
+uintptr_t GlbSyscallTable[84] = {
     ///////////////////////////////////////////////
     // Operating System Interface
     // - Protected, services/modules
@@ -241,5 +248,20 @@ uintptr_t GlbSyscallTable[77] = {
     DefineSyscall(73, ScPerformanceFrequency),
     DefineSyscall(74, ScPerformanceTick),
     DefineSyscall(75, ScSystemTime),
-    DefineSyscall(76, ScIsServiceAvailable)
+    DefineSyscall(76, ScIsServiceAvailable),
+
+    // Interrupt event system calls
+    DefineSyscall(77, ScWaitForInterrupt),
+    DefineSyscall(78, ScGetInterruptStatistics),
+
+    // Memory buffer system calls
+    DefineSyscall(79, ScQueryBufferSegments),
+
+    // Memory space system calls
+    DefineSyscall(80, ScForkMemorySpace),
+    DefineSyscall(81, ScGetInputStatistics),
+
+    // Interrupt placement system calls
+    DefineSyscall(82, ScGetInterruptCoreStatistics),
+    DefineSyscall(83, ScSetInterruptAffinity)
 };
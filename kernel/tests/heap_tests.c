@@ -0,0 +1,110 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * OS Testing Suite
+ *  - Heap tests to verify the correctness and measure the cost of kernel allocations.
+ */
+#define __MODULE "TEST"
+#define __TRACE
+
+#include <memoryspace.h>
+#include <timers.h>
+#include <debug.h>
+#include <heap.h>
+
+#define HEAP_TEST_OBJECTS     (1024 * 1024)
+#define HEAP_TEST_OBJECT_SIZE 64
+#define HEAP_TEST_STRIDE      4099 // Prime, visits every index when freeing out of order
+
+static uint64_t
+TestHeapTicksToNs(
+    _In_ uint64_t Ticks)
+{
+    LargeInteger_t Frequency;
+    TimersQueryPerformanceFrequency(&Frequency);
+    if (Frequency.QuadPart == 0) {
+        return 0;
+    }
+    return (Ticks * 1000000000ULL) / (uint64_t)Frequency.QuadPart;
+}
+
+static int
+TestHeapRun(
+    _In_ void** Objects,
+    _In_ int    Shuffled)
+{
+    LargeInteger_t Start, End;
+    uint64_t       AllocTicks;
+    uint64_t       FreeTicks;
+    size_t         i;
+
+    TimersQueryPerformanceTick(&Start);
+    for (i = 0; i < HEAP_TEST_OBJECTS; i++) {
+        Objects[i] = kmalloc(HEAP_TEST_OBJECT_SIZE);
+        if (Objects[i] == NULL) {
+            ERROR(" > allocation %" PRIuIN " failed", i);
+            while (i--) {
+                kfree(Objects[i]);
+            }
+            return -1;
+        }
+    }
+    TimersQueryPerformanceTick(&End);
+    AllocTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    TimersQueryPerformanceTick(&Start);
+    for (i = 0; i < HEAP_TEST_OBJECTS; i++) {
+        size_t Index = Shuffled ? ((i * HEAP_TEST_STRIDE) % HEAP_TEST_OBJECTS) : i;
+        kfree(Objects[Index]);
+    }
+    TimersQueryPerformanceTick(&End);
+    FreeTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    TRACE(" > %s: %u objects, alloc %u ns/op, free %u ns/op",
+        Shuffled ? "shuffled" : "sequential", HEAP_TEST_OBJECTS,
+        LODWORD(TestHeapTicksToNs(AllocTicks) / HEAP_TEST_OBJECTS),
+        LODWORD(TestHeapTicksToNs(FreeTicks) / HEAP_TEST_OBJECTS));
+    return 0;
+}
+
+/* TestHeap
+ * Allocates and frees a large number of small objects from the kernel heap and
+ * reports the cost per operation. Frees are done both in allocation order and
+ * scattered over all slabs. */
+void
+TestHeap(void *Unused)
+{
+    size_t     ArraySize = HEAP_TEST_OBJECTS * sizeof(void*);
+    uintptr_t  ArrayAddress;
+    OsStatus_t Status;
+    _CRT_UNUSED(Unused);
+    TRACE("TestHeap()");
+
+    // The object array is too large for the heap itself
+    Status = CreateMemorySpaceMapping(GetCurrentMemorySpace(), NULL, &ArrayAddress, ArraySize,
+        MAPPING_COMMIT | MAPPING_DOMAIN, MAPPING_PHYSICAL_DEFAULT | MAPPING_VIRTUAL_GLOBAL, __MASK);
+    if (Status != OsSuccess) {
+        ERROR(" > failed to allocate object array");
+        return;
+    }
+
+    if (TestHeapRun((void**)ArrayAddress, 0) == 0) {
+        TestHeapRun((void**)ArrayAddress, 1);
+    }
+    RemoveMemorySpaceMapping(GetCurrentMemorySpace(), ArrayAddress, ArraySize);
+}
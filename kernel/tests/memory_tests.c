@@ -0,0 +1,189 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * OS Testing Suite
+ *  - Memory tests to measure the cost of mapping and accessing large memory regions,
+ *    and the cost of zeroed pages from the pools and on demand.
+ */
+#define __MODULE "TEST"
+#define __TRACE
+
+#include <memoryspace.h>
+#include <scheduler.h>
+#include <zeropage.h>
+#include <machine.h>
+#include <timers.h>
+#include <debug.h>
+
+#define MEMORY_TEST_SIZE     (64 * 1024 * 1024)
+#define MEMORY_TEST_PASSES   16
+#define MEMORY_TEST_STRIDE   4099 // Prime, visits every page in an order that defeats prefetching
+#define MEMORY_TEST_MAP_SIZE (1024 * 1024 * 1024)
+#define MEMORY_TEST_ZEROED   16
+
+static uint64_t
+TestMemoryTicksToNs(
+    _In_ uint64_t Ticks)
+{
+    LargeInteger_t Frequency;
+    TimersQueryPerformanceFrequency(&Frequency);
+    if (Frequency.QuadPart == 0) {
+        return 0;
+    }
+    return (Ticks * 1000000000ULL) / (uint64_t)Frequency.QuadPart;
+}
+
+static void
+TestMemoryRun(
+    _In_ const char* Name,
+    _In_ Flags_t     PlacementFlags)
+{
+    LargeInteger_t   Start, End;
+    VirtualAddress_t Address;
+    uint64_t         MapTicks;
+    uint64_t         AccessTicks;
+    uint64_t         UnmapTicks;
+    size_t           PageCount = MEMORY_TEST_SIZE / GetMemorySpacePageSize();
+    size_t           i, j;
+    OsStatus_t       Status;
+
+    TimersQueryPerformanceTick(&Start);
+    Status = CreateMemorySpaceMapping(GetCurrentMemorySpace(), NULL, &Address, MEMORY_TEST_SIZE,
+        MAPPING_COMMIT | MAPPING_DOMAIN, MAPPING_PHYSICAL_DEFAULT | MAPPING_VIRTUAL_GLOBAL | PlacementFlags, __MASK);
+    TimersQueryPerformanceTick(&End);
+    if (Status != OsSuccess) {
+        ERROR(" > %s: failed to map test region", Name);
+        return;
+    }
+    MapTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    // Touch one word per page, scattered over the region so every access needs a translation
+    TimersQueryPerformanceTick(&Start);
+    for (j = 0; j < MEMORY_TEST_PASSES; j++) {
+        for (i = 0; i < PageCount; i++) {
+            size_t Index = (i * MEMORY_TEST_STRIDE) % PageCount;
+            ((volatile size_t*)(Address + (Index * GetMemorySpacePageSize())))[0] += j;
+        }
+    }
+    TimersQueryPerformanceTick(&End);
+    AccessTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    TimersQueryPerformanceTick(&Start);
+    RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Address, MEMORY_TEST_SIZE);
+    TimersQueryPerformanceTick(&End);
+    UnmapTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    TRACE(" > %s: map %u us, access %u ns/op, unmap %u us", Name,
+        LODWORD(TestMemoryTicksToNs(MapTicks) / 1000),
+        LODWORD(TestMemoryTicksToNs(AccessTicks) / (PageCount * MEMORY_TEST_PASSES)),
+        LODWORD(TestMemoryTicksToNs(UnmapTicks) / 1000));
+}
+
+static void
+TestMemoryMappingRun(
+    _In_ const char*       Name,
+    _In_ PhysicalAddress_t PhysicalBase,
+    _In_ Flags_t           MemoryFlags,
+    _In_ Flags_t           PlacementFlags)
+{
+    LargeInteger_t    Start, End;
+    VirtualAddress_t  Address   = GetMachine()->MemoryMap.UserHeap.Start;
+    PhysicalAddress_t Physical  = PhysicalBase;
+    size_t            PageCount = MEMORY_TEST_MAP_SIZE / GetMemorySpacePageSize();
+    uint64_t          MapTicks;
+    uint64_t          UnmapTicks;
+    OsStatus_t        Status;
+
+    TimersQueryPerformanceTick(&Start);
+    Status = CreateMemorySpaceMapping(GetCurrentMemorySpace(), &Physical, &Address, MEMORY_TEST_MAP_SIZE,
+        MemoryFlags, PlacementFlags | MAPPING_VIRTUAL_FIXED, __MASK);
+    TimersQueryPerformanceTick(&End);
+    if (Status != OsSuccess) {
+        ERROR(" > %s: failed to map test region", Name);
+        return;
+    }
+    MapTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    TimersQueryPerformanceTick(&Start);
+    RemoveMemorySpaceMapping(GetCurrentMemorySpace(), Address, MEMORY_TEST_MAP_SIZE);
+    TimersQueryPerformanceTick(&End);
+    UnmapTicks = (uint64_t)(End.QuadPart - Start.QuadPart);
+
+    TRACE(" > %s: 1gb map %u us (%u ns/page), unmap %u us (%u ns/page)", Name,
+        LODWORD(TestMemoryTicksToNs(MapTicks) / 1000), LODWORD(TestMemoryTicksToNs(MapTicks) / PageCount),
+        LODWORD(TestMemoryTicksToNs(UnmapTicks) / 1000), LODWORD(TestMemoryTicksToNs(UnmapTicks) / PageCount));
+}
+
+static void
+TestMemoryZeroedRun(
+    _In_ const char* Name,
+    _In_ uintptr_t   Mask)
+{
+    PhysicalAddress_t Pages[MEMORY_TEST_ZEROED];
+    LargeInteger_t    Start, End;
+    int               i;
+
+    TimersQueryPerformanceTick(&Start);
+    for (i = 0; i < MEMORY_TEST_ZEROED; i++) {
+        Pages[i] = AllocateZeroedPage(Mask);
+    }
+    TimersQueryPerformanceTick(&End);
+
+    for (i = 0; i < MEMORY_TEST_ZEROED; i++) {
+        if (Pages[i] != 0) {
+            FreeSystemMemory(Pages[i], GetMemorySpacePageSize());
+        }
+    }
+
+    TRACE(" > %s: zeroed page %u ns/page", Name,
+        LODWORD(TestMemoryTicksToNs((uint64_t)(End.QuadPart - Start.QuadPart)) / MEMORY_TEST_ZEROED));
+}
+
+/* TestMemory
+ * Maps a large region of memory with normal pages and with large pages, and reports
+ * the cost of mapping, accessing and unmapping the region in both cases. The cost of
+ * zeroed pages is reported for pages zeroed on demand and pages taken from the pools. The throughput
+ * of the mapping layer itself is measured on 1gb regions in the unused user heap region
+ * of the kernel space, the regions are never accessed. */
+void
+TestMemory(void *Unused)
+{
+    _CRT_UNUSED(Unused);
+    TRACE("TestMemory()");
+
+    TestMemoryRun("normal pages", 0);
+    TestMemoryRun("large pages", MAPPING_LARGEPAGES);
+
+    // A restricted mask bypasses the pools. The pool of this core is activated by its
+    // first allocation, and given time to fill before it is measured
+    ReleaseZeroedPage(AllocateZeroedPage(__MASK));
+    TestMemoryZeroedRun("on demand", 0xFFFFFFFF);
+    SchedulerThreadSleep(NULL, 100);
+    TestMemoryZeroedRun("pooled", __MASK);
+
+    if (GetMachine()->MemoryMap.UserHeap.Length < MEMORY_TEST_MAP_SIZE) {
+        return;
+    }
+
+    // The supplied physical range is offset by a page for the normal page run, otherwise
+    // the region would be promoted to large pages
+    TestMemoryMappingRun("reserved", 0, MAPPING_DOMAIN, MAPPING_PHYSICAL_DEFAULT);
+    TestMemoryMappingRun("fixed normal pages", GetMemorySpacePageSize(), 
+        MAPPING_READONLY, MAPPING_PHYSICAL_FIXED);
+    TestMemoryMappingRun("fixed large pages", 0, MAPPING_READONLY, MAPPING_PHYSICAL_FIXED);
+}
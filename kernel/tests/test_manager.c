@@ -28,6 +28,8 @@
 // Registered tests in the OS
 extern void TestDataStructures(void *Unused);
 extern void TestSynchronization(void *Unused);
+extern void TestHeap(void *Unused);
+extern void TestMemory(void *Unused);
 
 /* StartTestingPhase
  * Performs tests with systems used in the OS to verify stability and
@@ -50,4 +52,20 @@ StartTestingPhase(void)
         return;
     }
     ThreadingJoinThread(CurrentTest);
+
+    // Run heap tests
+    TRACE(" > Running heap tests");
+    if (CreateThread("TestHeap", TestHeap, NULL, 0, UUID_INVALID, &CurrentTest) != OsSuccess) {
+        ERROR(" > Failed to spawn test thread");
+        return;
+    }
+    ThreadingJoinThread(CurrentTest);
+
+    // Run memory tests
+    TRACE(" > Running memory tests");
+    if (CreateThread("TestMemory", TestMemory, NULL, 0, UUID_INVALID, &CurrentTest) != OsSuccess) {
+        ERROR(" > Failed to spawn test thread");
+        return;
+    }
+    ThreadingJoinThread(CurrentTest);
 }
@@ -0,0 +1,315 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS Zero Pages
+ * - The shared zero page that backs memory that has only been read, and the
+ *   per-core pools of pre-zeroed pages that back memory once it is written.
+ */
+#define __MODULE "ZERO"
+//#define __TRACE
+
+#include <semaphore_slim.h>
+#include <arch/interrupts.h>
+#include <arch/thread.h>
+#include <arch/utils.h>
+#include <memoryspace.h>
+#include <threading.h>
+#include <zeropage.h>
+#include <machine.h>
+#include <debug.h>
+
+extern void       ZeroVirtualMemory(VirtualAddress_t, size_t);
+extern OsStatus_t SetVirtualPageMappings(SystemMemorySpace_t*, PhysicalAddress_t*, PhysicalAddress_t, VirtualAddress_t, int, Flags_t, int*);
+extern OsStatus_t ClearVirtualPageMappings(SystemMemorySpace_t*, VirtualAddress_t, int);
+
+#define ZERO_POOL_CORES   256 // Cores are identified by their 8 bit apic id
+#define ZERO_POOL_MIN     16  // Pools never shrink below this target
+#define ZERO_POOL_DEFAULT 32
+#define ZERO_POOL_MAX     256 // Pools of busy cores grow up to this target
+#define ZERO_WINDOW_PAGES 16  // Pages zeroed under a single mapping of the scratch window
+
+typedef struct _ZeroPagePool {
+    SafeMemoryLock_t  SyncObject;
+    int               Active;
+    int               Count;
+    int               Target;    // Number of pages the worker keeps in the pool
+    int               Allocated; // Pages taken since the worker last looked at the pool
+    int               Drained;   // An allocation found the pool empty
+    PhysicalAddress_t Pages[ZERO_POOL_MAX];
+} ZeroPagePool_t;
+
+// Pools are only refilled for cores that have allocated zeroed pages, the worker
+// is woken once when any of them drops below half of its target
+static ZeroPagePool_t    ZeroPools[ZERO_POOL_CORES]   = { { { 0 } } };
+static VirtualAddress_t  ZeroWindows[ZERO_POOL_CORES] = { 0 };
+static PhysicalAddress_t ZeroPage                     = 0;
+static SlimSemaphore_t   RefillEvent;
+static _Atomic(int)      RefillPending                = ATOMIC_VAR_INIT(0);
+static UUId_t            WorkerHandle                 = UUID_INVALID;
+
+/* ZeroPhysicalPages
+ * Zeroes the range of physical pages through the scratch window of the current core. The window
+ * is mapped with non-global entries that only this core ever uses, so unmapping it only needs
+ * a local invalidation and never an invalidation of the other cores. */
+static OsStatus_t
+ZeroPhysicalPages(
+    _In_ PhysicalAddress_t Address,
+    _In_ int               PageCount)
+{
+    IntStatus_t      InterruptStatus;
+    VirtualAddress_t Window;
+    int              Count;
+    int              Mapped;
+    OsStatus_t       Status = OsSuccess;
+
+    // The window belongs to the core, the thread must not move while it is mapped
+    InterruptStatus = InterruptDisable();
+    Window          = ZeroWindows[ArchGetProcessorCoreId() & 0xFF];
+    if (Window == 0) {
+        Window = AllocateBlocksInBlockmap(&GetMachine()->GlobalAccessMemory, __MASK, 
+            ZERO_WINDOW_PAGES * GetMemorySpacePageSize());
+        ZeroWindows[ArchGetProcessorCoreId() & 0xFF] = Window;
+    }
+
+    while (Window != 0 && PageCount > 0 && Status == OsSuccess) {
+        Count  = MIN(PageCount, ZERO_WINDOW_PAGES);
+        Status = SetVirtualPageMappings(GetCurrentMemorySpace(), NULL, Address, Window, Count,
+            MAPPING_COMMIT | MAPPING_PERSISTENT | MAPPING_LOCAL, &Mapped);
+        if (Status == OsSuccess) {
+            ZeroVirtualMemory(Window, Count * GetMemorySpacePageSize());
+        }
+        ClearVirtualPageMappings(GetCurrentMemorySpace(), Window, Mapped);
+        Address   += Count * GetMemorySpacePageSize();
+        PageCount -= Count;
+    }
+    InterruptRestoreState(InterruptStatus);
+    return (Window == 0) ? OsError : Status;
+}
+
+static void
+SignalZeroPageWorker(void)
+{
+    if (WorkerHandle != UUID_INVALID && !atomic_exchange(&RefillPending, 1)) {
+        SlimSemaphoreSignal(&RefillEvent, 1);
+    }
+}
+
+/* UpdateZeroPagePoolTarget
+ * Sizes the pool by the demand seen since the last refill. Pools that ran dry double their
+ * target, pools that barely were used halve it and give the pages above the target back. */
+static void
+UpdateZeroPagePoolTarget(
+    _In_ ZeroPagePool_t* Pool)
+{
+    PhysicalAddress_t Excess[ZERO_WINDOW_PAGES];
+    int               ExcessCount;
+    int               i;
+
+    do {
+        ExcessCount = 0;
+        dslock(&Pool->SyncObject);
+        if (Pool->Drained) {
+            Pool->Target = MIN(Pool->Target * 2, ZERO_POOL_MAX);
+        }
+        else if (Pool->Allocated < (Pool->Target / 4)) {
+            Pool->Target = MAX(Pool->Target / 2, ZERO_POOL_MIN);
+        }
+        Pool->Drained   = 0;
+        Pool->Allocated = 0;
+        while (Pool->Count > Pool->Target && ExcessCount < ZERO_WINDOW_PAGES) {
+            Excess[ExcessCount++] = Pool->Pages[--Pool->Count];
+        }
+        dsunlock(&Pool->SyncObject);
+
+        for (i = 0; i < ExcessCount; i++) {
+            FreeSystemMemory(Excess[i], GetMemorySpacePageSize());
+        }
+    } while (ExcessCount == ZERO_WINDOW_PAGES);
+}
+
+/* RefillZeroPagePool
+ * Fills the pool with pre-zeroed pages up to its target. Pages are allocated and zeroed in
+ * contigious batches of the scratch window size, single pages are used if memory is fragmented. */
+static void
+RefillZeroPagePool(
+    _In_ ZeroPagePool_t* Pool)
+{
+    PhysicalAddress_t Pages;
+    int               Missing;
+    int               BatchCount;
+    int               Installed;
+
+    UpdateZeroPagePoolTarget(Pool);
+    while (1) {
+        dslock(&Pool->SyncObject);
+        Missing = Pool->Active ? MAX(Pool->Target - Pool->Count, 0) : 0;
+        dsunlock(&Pool->SyncObject);
+        if (Missing == 0) {
+            break;
+        }
+
+        BatchCount = MIN(Missing, ZERO_WINDOW_PAGES);
+        Pages      = AllocateSystemMemory(BatchCount * GetMemorySpacePageSize(), __MASK, 0);
+        if (Pages == 0) {
+            BatchCount = 1;
+            Pages      = AllocateSystemMemory(GetMemorySpacePageSize(), __MASK, 0);
+            if (Pages == 0) {
+                break;
+            }
+        }
+
+        if (ZeroPhysicalPages(Pages, BatchCount) != OsSuccess) {
+            FreeSystemMemory(Pages, BatchCount * GetMemorySpacePageSize());
+            break;
+        }
+
+        // The pool can have been filled by released pages in the meantime
+        dslock(&Pool->SyncObject);
+        for (Installed = 0; Installed < BatchCount && Pool->Count < Pool->Target; Installed++) {
+            Pool->Pages[Pool->Count++] = Pages + (Installed * GetMemorySpacePageSize());
+        }
+        dsunlock(&Pool->SyncObject);
+
+        if (Installed != BatchCount) {
+            FreeSystemMemory(Pages + (Installed * GetMemorySpacePageSize()),
+                (BatchCount - Installed) * GetMemorySpacePageSize());
+        }
+
+        // Zeroing is background work, give way to other threads between batches
+        ThreadingYield();
+    }
+}
+
+/* ZeroPageWorker
+ * Keeps the pools of pre-zeroed pages filled, the worker sleeps until a pool runs low. */
+static void
+ZeroPageWorker(
+    _In_Opt_ void* Unused)
+{
+    int i;
+    _CRT_UNUSED(Unused);
+
+    while (1) {
+        SlimSemaphoreWait(&RefillEvent, 0);
+        atomic_store(&RefillPending, 0);
+        for (i = 0; i < ZERO_POOL_CORES; i++) {
+            RefillZeroPagePool(&ZeroPools[i]);
+        }
+    }
+}
+
+void
+InitializeZeroPages(void)
+{
+    PhysicalAddress_t Page;
+    TRACE("InitializeZeroPages()");
+
+    Page = AllocateSystemMemory(GetMemorySpacePageSize(), __MASK, 0);
+    if (Page == 0 || ZeroPhysicalPages(Page, 1) != OsSuccess) {
+        ERROR("Failed to allocate the zero page");
+        if (Page != 0) {
+            FreeSystemMemory(Page, GetMemorySpacePageSize());
+        }
+        return;
+    }
+    ZeroPage = Page;
+
+    // The pool of the boot core is filled right away, the pools of other cores once
+    // they start to use them
+    SlimSemaphoreConstruct(&RefillEvent, 0, 1);
+    for (int i = 0; i < ZERO_POOL_CORES; i++) {
+        ZeroPools[i].Target = ZERO_POOL_DEFAULT;
+    }
+    ZeroPools[ArchGetProcessorCoreId() & 0xFF].Active = 1;
+    if (CreateThread("zero-worker", ZeroPageWorker, NULL, 0, UUID_INVALID, &WorkerHandle) != OsSuccess) {
+        ERROR("Failed to start the zero page worker");
+        WorkerHandle = UUID_INVALID;
+        return;
+    }
+    SignalZeroPageWorker();
+}
+
+PhysicalAddress_t
+GetZeroPage(void)
+{
+    return ZeroPage;
+}
+
+int
+IsZeroPage(
+    _In_ PhysicalAddress_t Address)
+{
+    return ZeroPage != 0 && (Address & ~(GetMemorySpacePageSize() - 1)) == ZeroPage;
+}
+
+PhysicalAddress_t
+AllocateZeroedPage(
+    _In_ uintptr_t Mask)
+{
+    ZeroPagePool_t*   Pool = &ZeroPools[ArchGetProcessorCoreId() & 0xFF];
+    PhysicalAddress_t Page = 0;
+    int               Refill;
+
+    // Pooled pages are allocated without restrictions
+    if (Mask == __MASK) {
+        dslock(&Pool->SyncObject);
+        Pool->Active = 1;
+        Pool->Allocated++;
+        if (Pool->Count != 0) {
+            Page = Pool->Pages[--Pool->Count];
+        }
+        else {
+            Pool->Drained = 1;
+        }
+        Refill = Pool->Count < (Pool->Target / 2);
+        dsunlock(&Pool->SyncObject);
+
+        if (Refill) {
+            SignalZeroPageWorker();
+        }
+        if (Page != 0) {
+            return Page;
+        }
+    }
+
+    Page = AllocateSystemMemory(GetMemorySpacePageSize(), Mask, 0);
+    if (Page != 0 && ZeroPhysicalPages(Page, 1) != OsSuccess) {
+        FreeSystemMemory(Page, GetMemorySpacePageSize());
+        Page = 0;
+    }
+    return Page;
+}
+
+void
+ReleaseZeroedPage(
+    _In_ PhysicalAddress_t Address)
+{
+    ZeroPagePool_t* Pool = &ZeroPools[ArchGetProcessorCoreId() & 0xFF];
+    int             Pooled = 0;
+
+    dslock(&Pool->SyncObject);
+    if (Pool->Count < Pool->Target) {
+        Pool->Pages[Pool->Count++] = Address;
+        Pooled = 1;
+    }
+    dsunlock(&Pool->SyncObject);
+
+    if (!Pooled) {
+        FreeSystemMemory(Address, GetMemorySpacePageSize());
+    }
+}
@@ -0,0 +1,274 @@
+; MollenOS
+; Copyright 2019, Philip Meulengracht
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation?, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+;
+; MollenOS x86-64 ERMS/AVX2 Memory Routines
+; - The avx2 routines only use ymm0-ymm5 which are volatile in the ms abi
+; - The avx2 copy/set routines require a length of at least 64 bytes, the
+;   compare routine at least 32 bytes
+
+bits 64
+segment .text
+
+global asm_xgetbv
+global asm_memcpy_erms
+global asm_memset_erms
+global asm_memcpy_avx2
+global asm_memcpy_avx2_nt
+global asm_memmove_avx2_backward
+global asm_memset_avx2
+global asm_memset_avx2_nt
+global asm_memcmp_avx2
+
+; Copies forward in 128 byte blocks to 32 byte aligned destinations, the unaligned
+; head and the tail are loaded before anything is stored, which makes the copy safe
+; for overlapping buffers as long as the destination is below the source.
+; rcx = destination, rdx = source, r8 = length, returns destination in rax
+%macro copy_forward 1
+	mov		rax, rcx
+	vmovdqu	ymm4, [rdx]
+	vmovdqu	ymm5, [rdx + r8 - 32]
+	lea		r9, [rcx + r8 - 32]
+
+	; Align the destination, r8 is the length from the aligned destination
+	mov		r10, rcx
+	add		rcx, 32
+	and		rcx, -32
+	mov		r11, rcx
+	sub		r11, r10
+	add		rdx, r11
+	sub		r8, r11
+
+	; The tail store covers the last 32 bytes
+%%Loop:
+	cmp		r8, 128
+	jbe		%%Blocks
+	vmovdqu	ymm0, [rdx]
+	vmovdqu	ymm1, [rdx + 32]
+	vmovdqu	ymm2, [rdx + 64]
+	vmovdqu	ymm3, [rdx + 96]
+	%1		[rcx], ymm0
+	%1		[rcx + 32], ymm1
+	%1		[rcx + 64], ymm2
+	%1		[rcx + 96], ymm3
+	add		rdx, 128
+	add		rcx, 128
+	sub		r8, 128
+	jmp		%%Loop
+
+%%Blocks:
+	cmp		r8, 32
+	jbe		%%Done
+	vmovdqu	ymm0, [rdx]
+	%1		[rcx], ymm0
+	add		rdx, 32
+	add		rcx, 32
+	sub		r8, 32
+	jmp		%%Blocks
+
+%%Done:
+	vmovdqu	[rax], ymm4
+	vmovdqu	[r9], ymm5
+%endmacro
+
+; Fills in 128 byte blocks to 32 byte aligned destinations
+; rcx = destination, edx = value, r8 = length, returns destination in rax
+%macro set_forward 1
+	mov		rax, rcx
+	movzx	edx, dl
+	vmovd	xmm0, edx
+	vpbroadcastb ymm0, xmm0
+	vmovdqu	[rcx], ymm0
+	vmovdqu	[rcx + r8 - 32], ymm0
+
+	; Align the destination, r8 is the length from the aligned destination
+	lea		r9, [rcx + r8]
+	add		rcx, 32
+	and		rcx, -32
+	mov		r8, r9
+	sub		r8, rcx
+
+%%Loop:
+	cmp		r8, 128
+	jbe		%%Blocks
+	%1		[rcx], ymm0
+	%1		[rcx + 32], ymm0
+	%1		[rcx + 64], ymm0
+	%1		[rcx + 96], ymm0
+	add		rcx, 128
+	sub		r8, 128
+	jmp		%%Loop
+
+%%Blocks:
+	cmp		r8, 32
+	jbe		%%Done
+	%1		[rcx], ymm0
+	add		rcx, 32
+	sub		r8, 32
+	jmp		%%Blocks
+%%Done:
+%endmacro
+
+; unsigned int asm_xgetbv(unsigned int Register <rcx>)
+; Reads the lower 32 bits of an extended control register
+asm_xgetbv:
+	xgetbv
+	ret
+
+; void* asm_memcpy_erms(void *Destination <rcx>, const void *Source <rdx>, size_t Length <r8>)
+; Copies memory with the enhanced rep movsb
+asm_memcpy_erms:
+	mov		rax, rcx
+	push	rdi
+	push	rsi
+	mov		rdi, rcx
+	mov		rsi, rdx
+	mov		rcx, r8
+	rep		movsb
+	pop		rsi
+	pop		rdi
+	ret
+
+; void* asm_memset_erms(void *Destination <rcx>, int Value <rdx>, size_t Length <r8>)
+; Fills memory with the enhanced rep stosb
+asm_memset_erms:
+	mov		r9, rcx
+	push	rdi
+	mov		rdi, rcx
+	movzx	eax, dl
+	mov		rcx, r8
+	rep		stosb
+	pop		rdi
+	mov		rax, r9
+	ret
+
+; void* asm_memcpy_avx2(void *Destination <rcx>, const void *Source <rdx>, size_t Length <r8>)
+; Copies memory through the cache with 32 byte vectors
+asm_memcpy_avx2:
+	copy_forward vmovdqa
+	vzeroupper
+	ret
+
+; void* asm_memcpy_avx2_nt(void *Destination <rcx>, const void *Source <rdx>, size_t Length <r8>)
+; Copies memory with non-temporal stores, for copies larger than the caches
+asm_memcpy_avx2_nt:
+	copy_forward vmovntdq
+	sfence
+	vzeroupper
+	ret
+
+; void* asm_memmove_avx2_backward(void *Destination <rcx>, const void *Source <rdx>, size_t Length <r8>)
+; Copies memory backwards from 32 byte aligned destinations, safe for overlapping
+; buffers where the destination is above the source.
+asm_memmove_avx2_backward:
+	mov		rax, rcx
+	vmovdqu	ymm4, [rdx]
+	vmovdqu	ymm5, [rdx + r8 - 32]
+	lea		r9, [rcx + r8 - 32]
+
+	; Align the destination end, r8 is the length up to the aligned end
+	lea		r10, [rcx + r8]
+	mov		r11, r10
+	and		r11, -32
+	sub		r10, r11
+	sub		r8, r10
+	add		rdx, r8
+
+	; The head store covers the first 32 bytes
+.Loop:
+	cmp		r8, 128
+	jbe		.Blocks
+	vmovdqu	ymm0, [rdx - 32]
+	vmovdqu	ymm1, [rdx - 64]
+	vmovdqu	ymm2, [rdx - 96]
+	vmovdqu	ymm3, [rdx - 128]
+	vmovdqa	[r11 - 32], ymm0
+	vmovdqa	[r11 - 64], ymm1
+	vmovdqa	[r11 - 96], ymm2
+	vmovdqa	[r11 - 128], ymm3
+	sub		rdx, 128
+	sub		r11, 128
+	sub		r8, 128
+	jmp		.Loop
+
+.Blocks:
+	cmp		r8, 32
+	jbe		.Done
+	vmovdqu	ymm0, [rdx - 32]
+	vmovdqa	[r11 - 32], ymm0
+	sub		rdx, 32
+	sub		r11, 32
+	sub		r8, 32
+	jmp		.Blocks
+
+.Done:
+	vmovdqu	[rax], ymm4
+	vmovdqu	[r9], ymm5
+	vzeroupper
+	ret
+
+; void* asm_memset_avx2(void *Destination <rcx>, int Value <rdx>, size_t Length <r8>)
+; Fills memory through the cache with 32 byte vectors
+asm_memset_avx2:
+	set_forward vmovdqa
+	vzeroupper
+	ret
+
+; void* asm_memset_avx2_nt(void *Destination <rcx>, int Value <rdx>, size_t Length <r8>)
+; Fills memory with non-temporal stores, for fills larger than the caches
+asm_memset_avx2_nt:
+	set_forward vmovntdq
+	sfence
+	vzeroupper
+	ret
+
+; int asm_memcmp_avx2(const void *First <rcx>, const void *Second <rdx>, size_t Length <r8>)
+; Compares memory 32 bytes at the time, the last block overlaps the previous one
+asm_memcmp_avx2:
+	lea		r9, [rcx + r8 - 32]
+	sub		rdx, rcx
+
+.Loop:
+	cmp		rcx, r9
+	jae		.Last
+	vmovdqu	ymm0, [rcx]
+	vpcmpeqb ymm0, ymm0, [rcx + rdx]
+	vpmovmskb eax, ymm0
+	not		eax
+	test	eax, eax
+	jnz		.Found
+	add		rcx, 32
+	jmp		.Loop
+
+.Last:
+	mov		rcx, r9
+	vmovdqu	ymm0, [rcx]
+	vpcmpeqb ymm0, ymm0, [rcx + rdx]
+	vpmovmskb eax, ymm0
+	not		eax
+	test	eax, eax
+	jnz		.Found
+	vzeroupper
+	ret
+
+.Found:
+	bsf		eax, eax
+	add		rcx, rax
+	movzx	eax, byte [rcx]
+	movzx	r8d, byte [rcx + rdx]
+	sub		eax, r8d
+	vzeroupper
+	ret
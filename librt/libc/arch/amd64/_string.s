@@ -0,0 +1,355 @@
+; MollenOS
+; Copyright 2019, Philip Meulengracht
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation?, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+;
+; MollenOS x86-64 SSE2/AVX2 String Scanning
+; - Strings of unknown length are only read by aligned vectors, an aligned vector
+;   never crosses a page boundary, so nothing is read from a page the string does
+;   not touch. strcmp reads unaligned and takes bytes near the end of a page.
+; - Only xmm0-xmm5/ymm0-ymm5 are used, they are volatile in the ms abi
+; - Every routine is generated twice, once for each vector size
+
+bits 64
+segment .text
+
+; The routines are written once against these, VEC is set before each expansion
+%macro vload 2
+%if VEC == 32
+	vmovdqa	%1, %2
+%else
+	movdqa	%1, %2
+%endif
+%endmacro
+
+%macro vloadu 2
+%if VEC == 32
+	vmovdqu	%1, %2
+%else
+	movdqu	%1, %2
+%endif
+%endmacro
+
+%macro vcmpeq 2
+%if VEC == 32
+	vpcmpeqb %1, %1, %2
+%else
+	pcmpeqb	%1, %2
+%endif
+%endmacro
+
+%macro vor 2
+%if VEC == 32
+	vpor	%1, %1, %2
+%else
+	por		%1, %2
+%endif
+%endmacro
+
+%macro vand 2
+%if VEC == 32
+	vpand	%1, %1, %2
+%else
+	pand	%1, %2
+%endif
+%endmacro
+
+%macro vzero 1
+%if VEC == 32
+	vpxor	%1, %1, %1
+%else
+	pxor	%1, %1
+%endif
+%endmacro
+
+%macro vmask 2
+%if VEC == 32
+	vpmovmskb %1, %2
+%else
+	pmovmskb %1, %2
+%endif
+%endmacro
+
+; vbroadcast vector, xmm-of-vector, gpr32
+%macro vbroadcast 3
+%if VEC == 32
+	vmovd	%2, %3
+	vpbroadcastb %1, %2
+%else
+	movd	%1, %3
+	punpcklbw %1, %1
+	punpcklwd %1, %1
+	pshufd	%1, %1, 0
+%endif
+%endmacro
+
+%macro vend 0
+%if VEC == 32
+	vzeroupper
+%endif
+%endmacro
+
+%macro string_routines 1
+global asm_strlen_%1
+global asm_strchr_%1
+global asm_memchr_%1
+global asm_strcmp_%1
+global asm_strstr_scan_%1
+
+; size_t asm_strlen(const char *String <rcx>)
+asm_strlen_%1:
+	mov		r9, rcx
+	mov		rax, rcx
+	and		rax, -VEC
+	and		ecx, VEC - 1
+	vzero	V0
+	vload	V1, [rax]
+	vcmpeq	V1, V0
+	vmask	edx, V1
+	shr		edx, cl
+	test	edx, edx
+	jnz		%%StrlenFirst
+
+%%StrlenLoop:
+	add		rax, VEC
+	vload	V1, [rax]
+	vcmpeq	V1, V0
+	vmask	edx, V1
+	test	edx, edx
+	jz		%%StrlenLoop
+	bsf		edx, edx
+	add		rax, rdx
+	sub		rax, r9
+	vend
+	ret
+
+%%StrlenFirst:
+	bsf		eax, edx
+	vend
+	ret
+
+; char* asm_strchr(const char *String <rcx>, int Character <rdx>)
+; The first terminator or character found decides the result
+asm_strchr_%1:
+	mov		r9, rcx
+	movzx	r8d, dl
+	vbroadcast V2, V2x, r8d
+	vzero	V0
+	mov		rax, rcx
+	and		rax, -VEC
+	and		ecx, VEC - 1
+	vload	V1, [rax]
+	vload	V3, [rax]
+	vcmpeq	V1, V0
+	vcmpeq	V3, V2
+	vor		V1, V3
+	vmask	edx, V1
+	shr		edx, cl
+	test	edx, edx
+	jnz		%%StrchrFirst
+
+%%StrchrLoop:
+	add		rax, VEC
+	vload	V1, [rax]
+	vload	V3, [rax]
+	vcmpeq	V1, V0
+	vcmpeq	V3, V2
+	vor		V1, V3
+	vmask	edx, V1
+	test	edx, edx
+	jz		%%StrchrLoop
+	bsf		edx, edx
+	add		rax, rdx
+	jmp		%%StrchrCheck
+
+%%StrchrFirst:
+	bsf		edx, edx
+	lea		rax, [r9 + rdx]
+
+%%StrchrCheck:
+	cmp		byte [rax], r8b
+	je		%%StrchrDone
+	xor		eax, eax
+%%StrchrDone:
+	vend
+	ret
+
+; void* asm_memchr(const void *Memory <rcx>, int Character <rdx>, size_t Length <r8>)
+asm_memchr_%1:
+	test	r8, r8
+	jz		%%MemchrNone
+	movzx	edx, dl
+	vbroadcast V2, V2x, edx
+	mov		rax, rcx
+	and		rax, -VEC
+	and		ecx, VEC - 1
+
+	; r8 is the length from the aligned block, saturated for lengths near SIZE_MAX
+	add		r8, rcx
+	jnc		%%MemchrStart
+	mov		r8, -1
+
+%%MemchrStart:
+	vload	V1, [rax]
+	vcmpeq	V1, V2
+	vmask	edx, V1
+	shr		edx, cl
+	shl		edx, cl
+	jmp		%%MemchrCheck
+
+%%MemchrLoop:
+	add		rax, VEC
+	vload	V1, [rax]
+	vcmpeq	V1, V2
+	vmask	edx, V1
+
+%%MemchrCheck:
+	test	edx, edx
+	jnz		%%MemchrFound
+	cmp		r8, VEC
+	jbe		%%MemchrNone
+	sub		r8, VEC
+	jmp		%%MemchrLoop
+
+%%MemchrFound:
+	bsf		edx, edx
+	cmp		rdx, r8
+	jae		%%MemchrNone
+	add		rax, rdx
+	vend
+	ret
+
+%%MemchrNone:
+	xor		eax, eax
+	vend
+	ret
+
+; int asm_strcmp(const char *First <rcx>, const char *Second <rdx>)
+; Vectors are only read when neither of them crosses into the next page, otherwise
+; a vector worth of bytes is compared one at a time to move both strings past it
+asm_strcmp_%1:
+	vzero	V0
+
+%%StrcmpLoop:
+	mov		eax, ecx
+	and		eax, 4095
+	cmp		eax, 4096 - VEC
+	ja		%%StrcmpBytes
+	mov		eax, edx
+	and		eax, 4095
+	cmp		eax, 4096 - VEC
+	ja		%%StrcmpBytes
+
+	vloadu	V1, [rcx]
+	vloadu	V2, [rdx]
+	vcmpeq	V2, V1
+	vcmpeq	V1, V0
+	vmask	eax, V2
+	vmask	r8d, V1
+	xor		eax, (1 << VEC) - 1
+	or		eax, r8d
+	jnz		%%StrcmpDiff
+	add		rcx, VEC
+	add		rdx, VEC
+	jmp		%%StrcmpLoop
+
+%%StrcmpDiff:
+	bsf		eax, eax
+	movzx	r8d, byte [rcx + rax]
+	movzx	eax, byte [rdx + rax]
+	sub		r8d, eax
+	mov		eax, r8d
+	vend
+	ret
+
+%%StrcmpBytes:
+	mov		r9d, VEC
+%%StrcmpByteLoop:
+	movzx	eax, byte [rcx]
+	movzx	r8d, byte [rdx]
+	sub		eax, r8d
+	jnz		%%StrcmpByteDone
+	test	r8d, r8d
+	jz		%%StrcmpByteDone
+	inc		rcx
+	inc		rdx
+	dec		r9d
+	jnz		%%StrcmpByteLoop
+	jmp		%%StrcmpLoop
+
+%%StrcmpByteDone:
+	vend
+	ret
+
+; const char* asm_strstr_scan(const char *Haystack <rcx>, size_t Count <rdx>, int First <r8>,
+;                             int Last <r9>, size_t Distance <stack>)
+; Finds the first position below Count where the haystack has the first character, and the last
+; character at Distance from it. Count must be at least VEC and the haystack readable up to
+; Count + Distance, the final vector overlaps the previous one.
+asm_strstr_scan_%1:
+	mov		r10, qword [rsp + 40]
+	movzx	r8d, r8b
+	movzx	r9d, r9b
+	vbroadcast V2, V2x, r8d
+	vbroadcast V3, V3x, r9d
+	lea		r8, [rcx + rdx - VEC]
+	mov		rax, rcx
+
+%%ScanLoop:
+	vloadu	V1, [rax]
+	vloadu	V4, [rax + r10]
+	vcmpeq	V1, V2
+	vcmpeq	V4, V3
+	vand	V1, V4
+	vmask	edx, V1
+	test	edx, edx
+	jnz		%%ScanFound
+	cmp		rax, r8
+	jae		%%ScanNone
+	add		rax, VEC
+	cmp		rax, r8
+	jbe		%%ScanLoop
+	mov		rax, r8
+	jmp		%%ScanLoop
+
+%%ScanFound:
+	bsf		edx, edx
+	add		rax, rdx
+	vend
+	ret
+
+%%ScanNone:
+	xor		eax, eax
+	vend
+	ret
+%endmacro
+
+%assign VEC 16
+%define V0 xmm0
+%define V1 xmm1
+%define V2 xmm2
+%define V3 xmm3
+%define V4 xmm4
+%define V2x xmm2
+%define V3x xmm3
+string_routines sse2
+
+%assign VEC 32
+%define V0 ymm0
+%define V1 ymm1
+%define V2 ymm2
+%define V3 ymm3
+%define V4 ymm4
+string_routines avx2
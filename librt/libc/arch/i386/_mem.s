@@ -0,0 +1,297 @@
+; MollenOS
+; Copyright 2019, Philip Meulengracht
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation?, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+;
+; MollenOS x86 ERMS/AVX2 Memory Routines
+; - The avx2 copy/set routines require a length of at least 64 bytes, the
+;   compare routine at least 32 bytes
+
+bits 32
+segment .text
+
+global _asm_xgetbv
+global _asm_memcpy_erms
+global _asm_memset_erms
+global _asm_memcpy_avx2
+global _asm_memcpy_avx2_nt
+global _asm_memmove_avx2_backward
+global _asm_memset_avx2
+global _asm_memset_avx2_nt
+global _asm_memcmp_avx2
+
+; Copies forward in 128 byte blocks to 32 byte aligned destinations, the unaligned
+; head and the tail are loaded before anything is stored, which makes the copy safe
+; for overlapping buffers as long as the destination is below the source.
+%macro copy_forward 1
+	push	esi
+	push	edi
+	push	ebx
+	mov		edi, dword [esp + 16]
+	mov		esi, dword [esp + 20]
+	mov		ecx, dword [esp + 24]
+	vmovdqu	ymm4, [esi]
+	vmovdqu	ymm5, [esi + ecx - 32]
+	lea		ebx, [edi + ecx - 32]
+
+	; Align the destination, ecx is the length from the aligned destination
+	mov		edx, edi
+	add		edi, 32
+	and		edi, -32
+	mov		eax, edi
+	sub		eax, edx
+	add		esi, eax
+	sub		ecx, eax
+
+	; The tail store covers the last 32 bytes
+%%Loop:
+	cmp		ecx, 128
+	jbe		%%Blocks
+	vmovdqu	ymm0, [esi]
+	vmovdqu	ymm1, [esi + 32]
+	vmovdqu	ymm2, [esi + 64]
+	vmovdqu	ymm3, [esi + 96]
+	%1		[edi], ymm0
+	%1		[edi + 32], ymm1
+	%1		[edi + 64], ymm2
+	%1		[edi + 96], ymm3
+	add		esi, 128
+	add		edi, 128
+	sub		ecx, 128
+	jmp		%%Loop
+
+%%Blocks:
+	cmp		ecx, 32
+	jbe		%%Done
+	vmovdqu	ymm0, [esi]
+	%1		[edi], ymm0
+	add		esi, 32
+	add		edi, 32
+	sub		ecx, 32
+	jmp		%%Blocks
+
+%%Done:
+	vmovdqu	[edx], ymm4
+	vmovdqu	[ebx], ymm5
+	mov		eax, edx
+	pop		ebx
+	pop		edi
+	pop		esi
+%endmacro
+
+; Fills in 128 byte blocks to 32 byte aligned destinations
+%macro set_forward 1
+	mov		edx, dword [esp + 4]
+	movzx	eax, byte [esp + 8]
+	mov		ecx, dword [esp + 12]
+	vmovd	xmm0, eax
+	vpbroadcastb ymm0, xmm0
+	vmovdqu	[edx], ymm0
+	vmovdqu	[edx + ecx - 32], ymm0
+
+	; Align the destination, ecx is the length from the aligned destination
+	lea		eax, [edx + ecx]
+	add		edx, 32
+	and		edx, -32
+	mov		ecx, eax
+	sub		ecx, edx
+
+%%Loop:
+	cmp		ecx, 128
+	jbe		%%Blocks
+	%1		[edx], ymm0
+	%1		[edx + 32], ymm0
+	%1		[edx + 64], ymm0
+	%1		[edx + 96], ymm0
+	add		edx, 128
+	sub		ecx, 128
+	jmp		%%Loop
+
+%%Blocks:
+	cmp		ecx, 32
+	jbe		%%Done
+	%1		[edx], ymm0
+	add		edx, 32
+	sub		ecx, 32
+	jmp		%%Blocks
+%%Done:
+	mov		eax, dword [esp + 4]
+%endmacro
+
+; unsigned int asm_xgetbv(unsigned int Register)
+; Reads the lower 32 bits of an extended control register
+_asm_xgetbv:
+	mov		ecx, dword [esp + 4]
+	xgetbv
+	ret
+
+; void* asm_memcpy_erms(void *Destination, const void *Source, size_t Length)
+; Copies memory with the enhanced rep movsb
+_asm_memcpy_erms:
+	push	esi
+	push	edi
+	mov		edi, dword [esp + 12]
+	mov		esi, dword [esp + 16]
+	mov		ecx, dword [esp + 20]
+	rep		movsb
+	mov		eax, dword [esp + 12]
+	pop		edi
+	pop		esi
+	ret
+
+; void* asm_memset_erms(void *Destination, int Value, size_t Length)
+; Fills memory with the enhanced rep stosb
+_asm_memset_erms:
+	push	edi
+	mov		edi, dword [esp + 8]
+	movzx	eax, byte [esp + 12]
+	mov		ecx, dword [esp + 16]
+	rep		stosb
+	mov		eax, dword [esp + 8]
+	pop		edi
+	ret
+
+; void* asm_memcpy_avx2(void *Destination, const void *Source, size_t Length)
+; Copies memory through the cache with 32 byte vectors
+_asm_memcpy_avx2:
+	copy_forward vmovdqa
+	vzeroupper
+	ret
+
+; void* asm_memcpy_avx2_nt(void *Destination, const void *Source, size_t Length)
+; Copies memory with non-temporal stores, for copies larger than the caches
+_asm_memcpy_avx2_nt:
+	copy_forward vmovntdq
+	sfence
+	vzeroupper
+	ret
+
+; void* asm_memmove_avx2_backward(void *Destination, const void *Source, size_t Length)
+; Copies memory backwards from 32 byte aligned destinations, safe for overlapping
+; buffers where the destination is above the source.
+_asm_memmove_avx2_backward:
+	push	esi
+	push	edi
+	push	ebx
+	mov		edx, dword [esp + 16]
+	mov		esi, dword [esp + 20]
+	mov		ecx, dword [esp + 24]
+	vmovdqu	ymm4, [esi]
+	vmovdqu	ymm5, [esi + ecx - 32]
+	lea		ebx, [edx + ecx - 32]
+
+	; Align the destination end, ecx is the length up to the aligned end
+	lea		eax, [edx + ecx]
+	mov		edi, eax
+	and		edi, -32
+	sub		eax, edi
+	sub		ecx, eax
+	add		esi, ecx
+
+	; The head store covers the first 32 bytes
+.Loop:
+	cmp		ecx, 128
+	jbe		.Blocks
+	vmovdqu	ymm0, [esi - 32]
+	vmovdqu	ymm1, [esi - 64]
+	vmovdqu	ymm2, [esi - 96]
+	vmovdqu	ymm3, [esi - 128]
+	vmovdqa	[edi - 32], ymm0
+	vmovdqa	[edi - 64], ymm1
+	vmovdqa	[edi - 96], ymm2
+	vmovdqa	[edi - 128], ymm3
+	sub		esi, 128
+	sub		edi, 128
+	sub		ecx, 128
+	jmp		.Loop
+
+.Blocks:
+	cmp		ecx, 32
+	jbe		.Done
+	vmovdqu	ymm0, [esi - 32]
+	vmovdqa	[edi - 32], ymm0
+	sub		esi, 32
+	sub		edi, 32
+	sub		ecx, 32
+	jmp		.Blocks
+
+.Done:
+	vmovdqu	[edx], ymm4
+	vmovdqu	[ebx], ymm5
+	vzeroupper
+	mov		eax, edx
+	pop		ebx
+	pop		edi
+	pop		esi
+	ret
+
+; void* asm_memset_avx2(void *Destination, int Value, size_t Length)
+; Fills memory through the cache with 32 byte vectors
+_asm_memset_avx2:
+	set_forward vmovdqa
+	vzeroupper
+	ret
+
+; void* asm_memset_avx2_nt(void *Destination, int Value, size_t Length)
+; Fills memory with non-temporal stores, for fills larger than the caches
+_asm_memset_avx2_nt:
+	set_forward vmovntdq
+	sfence
+	vzeroupper
+	ret
+
+; int asm_memcmp_avx2(const void *First, const void *Second, size_t Length)
+; Compares memory 32 bytes at the time, the last block overlaps the previous one
+_asm_memcmp_avx2:
+	push	ebx
+	mov		ecx, dword [esp + 8]
+	mov		edx, dword [esp + 12]
+	mov		ebx, dword [esp + 16]
+	lea		ebx, [ecx + ebx - 32]
+	sub		edx, ecx
+
+.Loop:
+	cmp		ecx, ebx
+	jae		.Last
+	vmovdqu	ymm0, [ecx]
+	vpcmpeqb ymm0, ymm0, [ecx + edx]
+	vpmovmskb eax, ymm0
+	not		eax
+	test	eax, eax
+	jnz		.Found
+	add		ecx, 32
+	jmp		.Loop
+
+.Last:
+	mov		ecx, ebx
+	vmovdqu	ymm0, [ecx]
+	vpcmpeqb ymm0, ymm0, [ecx + edx]
+	vpmovmskb eax, ymm0
+	not		eax
+	test	eax, eax
+	jnz		.Found
+	vzeroupper
+	pop		ebx
+	ret
+
+.Found:
+	bsf		eax, eax
+	add		ecx, eax
+	movzx	eax, byte [ecx]
+	movzx	ebx, byte [ecx + edx]
+	sub		eax, ebx
+	vzeroupper
+	pop		ebx
+	ret
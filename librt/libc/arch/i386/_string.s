@@ -0,0 +1,377 @@
+; MollenOS
+; Copyright 2019, Philip Meulengracht
+;
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation?, either version 3 of the License, or
+; (at your option) any later version.
+;
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+;
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <http://www.gnu.org/licenses/>.
+;
+;
+; MollenOS x86 SSE2/AVX2 String Scanning
+; - Strings of unknown length are only read by aligned vectors, an aligned vector
+;   never crosses a page boundary, so nothing is read from a page the string does
+;   not touch. strcmp reads unaligned and takes bytes near the end of a page.
+; - Every routine is generated twice, once for each vector size
+
+bits 32
+segment .text
+
+; The routines are written once against these, VEC is set before each expansion
+%macro vload 2
+%if VEC == 32
+	vmovdqa	%1, %2
+%else
+	movdqa	%1, %2
+%endif
+%endmacro
+
+%macro vloadu 2
+%if VEC == 32
+	vmovdqu	%1, %2
+%else
+	movdqu	%1, %2
+%endif
+%endmacro
+
+%macro vcmpeq 2
+%if VEC == 32
+	vpcmpeqb %1, %1, %2
+%else
+	pcmpeqb	%1, %2
+%endif
+%endmacro
+
+%macro vor 2
+%if VEC == 32
+	vpor	%1, %1, %2
+%else
+	por		%1, %2
+%endif
+%endmacro
+
+%macro vand 2
+%if VEC == 32
+	vpand	%1, %1, %2
+%else
+	pand	%1, %2
+%endif
+%endmacro
+
+%macro vzero 1
+%if VEC == 32
+	vpxor	%1, %1, %1
+%else
+	pxor	%1, %1
+%endif
+%endmacro
+
+%macro vmask 2
+%if VEC == 32
+	vpmovmskb %1, %2
+%else
+	pmovmskb %1, %2
+%endif
+%endmacro
+
+; vbroadcast vector, xmm-of-vector, gpr32
+%macro vbroadcast 3
+%if VEC == 32
+	vmovd	%2, %3
+	vpbroadcastb %1, %2
+%else
+	movd	%1, %3
+	punpcklbw %1, %1
+	punpcklwd %1, %1
+	pshufd	%1, %1, 0
+%endif
+%endmacro
+
+%macro vend 0
+%if VEC == 32
+	vzeroupper
+%endif
+%endmacro
+
+%macro string_routines 1
+global _asm_strlen_%1
+global _asm_strchr_%1
+global _asm_memchr_%1
+global _asm_strcmp_%1
+global _asm_strstr_scan_%1
+
+; size_t asm_strlen(const char *String)
+_asm_strlen_%1:
+	mov		ecx, dword [esp + 4]
+	mov		eax, ecx
+	and		eax, -VEC
+	and		ecx, VEC - 1
+	vzero	V0
+	vload	V1, [eax]
+	vcmpeq	V1, V0
+	vmask	edx, V1
+	shr		edx, cl
+	test	edx, edx
+	jnz		%%StrlenFirst
+
+%%StrlenLoop:
+	add		eax, VEC
+	vload	V1, [eax]
+	vcmpeq	V1, V0
+	vmask	edx, V1
+	test	edx, edx
+	jz		%%StrlenLoop
+	bsf		edx, edx
+	add		eax, edx
+	sub		eax, dword [esp + 4]
+	vend
+	ret
+
+%%StrlenFirst:
+	bsf		eax, edx
+	vend
+	ret
+
+; char* asm_strchr(const char *String, int Character)
+; The first terminator or character found decides the result
+_asm_strchr_%1:
+	push	ebx
+	mov		ecx, dword [esp + 8]
+	movzx	ebx, byte [esp + 12]
+	vbroadcast V2, V2x, ebx
+	vzero	V0
+	mov		eax, ecx
+	and		eax, -VEC
+	and		ecx, VEC - 1
+	vload	V1, [eax]
+	vload	V3, [eax]
+	vcmpeq	V1, V0
+	vcmpeq	V3, V2
+	vor		V1, V3
+	vmask	edx, V1
+	shr		edx, cl
+	test	edx, edx
+	jnz		%%StrchrFirst
+
+%%StrchrLoop:
+	add		eax, VEC
+	vload	V1, [eax]
+	vload	V3, [eax]
+	vcmpeq	V1, V0
+	vcmpeq	V3, V2
+	vor		V1, V3
+	vmask	edx, V1
+	test	edx, edx
+	jz		%%StrchrLoop
+	bsf		edx, edx
+	add		eax, edx
+	jmp		%%StrchrCheck
+
+%%StrchrFirst:
+	bsf		edx, edx
+	mov		eax, dword [esp + 8]
+	add		eax, edx
+
+%%StrchrCheck:
+	cmp		byte [eax], bl
+	je		%%StrchrDone
+	xor		eax, eax
+%%StrchrDone:
+	pop		ebx
+	vend
+	ret
+
+; void* asm_memchr(const void *Memory, int Character, size_t Length)
+_asm_memchr_%1:
+	push	ebx
+	mov		ebx, dword [esp + 16]
+	test	ebx, ebx
+	jz		%%MemchrNone
+	movzx	edx, byte [esp + 12]
+	vbroadcast V2, V2x, edx
+	mov		ecx, dword [esp + 8]
+	mov		eax, ecx
+	and		eax, -VEC
+	and		ecx, VEC - 1
+
+	; ebx is the length from the aligned block, saturated for lengths near SIZE_MAX
+	add		ebx, ecx
+	jnc		%%MemchrStart
+	mov		ebx, -1
+
+%%MemchrStart:
+	vload	V1, [eax]
+	vcmpeq	V1, V2
+	vmask	edx, V1
+	shr		edx, cl
+	shl		edx, cl
+	jmp		%%MemchrCheck
+
+%%MemchrLoop:
+	add		eax, VEC
+	vload	V1, [eax]
+	vcmpeq	V1, V2
+	vmask	edx, V1
+
+%%MemchrCheck:
+	test	edx, edx
+	jnz		%%MemchrFound
+	cmp		ebx, VEC
+	jbe		%%MemchrNone
+	sub		ebx, VEC
+	jmp		%%MemchrLoop
+
+%%MemchrFound:
+	bsf		edx, edx
+	cmp		edx, ebx
+	jae		%%MemchrNone
+	add		eax, edx
+	pop		ebx
+	vend
+	ret
+
+%%MemchrNone:
+	xor		eax, eax
+	pop		ebx
+	vend
+	ret
+
+; int asm_strcmp(const char *First, const char *Second)
+; Vectors are only read when neither of them crosses into the next page, otherwise
+; a vector worth of bytes is compared one at a time to move both strings past it
+_asm_strcmp_%1:
+	push	ebx
+	push	esi
+	mov		ecx, dword [esp + 12]
+	mov		edx, dword [esp + 16]
+	vzero	V0
+
+%%StrcmpLoop:
+	mov		eax, ecx
+	and		eax, 4095
+	cmp		eax, 4096 - VEC
+	ja		%%StrcmpBytes
+	mov		eax, edx
+	and		eax, 4095
+	cmp		eax, 4096 - VEC
+	ja		%%StrcmpBytes
+
+	vloadu	V1, [ecx]
+	vloadu	V2, [edx]
+	vcmpeq	V2, V1
+	vcmpeq	V1, V0
+	vmask	eax, V2
+	vmask	ebx, V1
+	xor		eax, (1 << VEC) - 1
+	or		eax, ebx
+	jnz		%%StrcmpDiff
+	add		ecx, VEC
+	add		edx, VEC
+	jmp		%%StrcmpLoop
+
+%%StrcmpDiff:
+	bsf		eax, eax
+	movzx	ebx, byte [ecx + eax]
+	movzx	eax, byte [edx + eax]
+	sub		ebx, eax
+	mov		eax, ebx
+	pop		esi
+	pop		ebx
+	vend
+	ret
+
+%%StrcmpBytes:
+	mov		esi, VEC
+%%StrcmpByteLoop:
+	movzx	eax, byte [ecx]
+	movzx	ebx, byte [edx]
+	sub		eax, ebx
+	jnz		%%StrcmpByteDone
+	test	ebx, ebx
+	jz		%%StrcmpByteDone
+	inc		ecx
+	inc		edx
+	dec		esi
+	jnz		%%StrcmpByteLoop
+	jmp		%%StrcmpLoop
+
+%%StrcmpByteDone:
+	pop		esi
+	pop		ebx
+	vend
+	ret
+
+; const char* asm_strstr_scan(const char *Haystack, size_t Count, int First, int Last, size_t Distance)
+; Finds the first position below Count where the haystack has the first character, and the last
+; character at Distance from it. Count must be at least VEC and the haystack readable up to
+; Count + Distance, the final vector overlaps the previous one.
+_asm_strstr_scan_%1:
+	push	esi
+	push	edi
+	mov		eax, dword [esp + 12]
+	mov		edx, dword [esp + 16]
+	movzx	ecx, byte [esp + 20]
+	vbroadcast V2, V2x, ecx
+	movzx	ecx, byte [esp + 24]
+	vbroadcast V3, V3x, ecx
+	mov		esi, dword [esp + 28]
+	lea		edi, [eax + edx - VEC]
+
+%%ScanLoop:
+	vloadu	V1, [eax]
+	vloadu	V4, [eax + esi]
+	vcmpeq	V1, V2
+	vcmpeq	V4, V3
+	vand	V1, V4
+	vmask	edx, V1
+	test	edx, edx
+	jnz		%%ScanFound
+	cmp		eax, edi
+	jae		%%ScanNone
+	add		eax, VEC
+	cmp		eax, edi
+	jbe		%%ScanLoop
+	mov		eax, edi
+	jmp		%%ScanLoop
+
+%%ScanFound:
+	bsf		edx, edx
+	add		eax, edx
+	pop		edi
+	pop		esi
+	vend
+	ret
+
+%%ScanNone:
+	xor		eax, eax
+	pop		edi
+	pop		esi
+	vend
+	ret
+%endmacro
+
+
+%assign VEC 16
+%define V0 xmm0
+%define V1 xmm1
+%define V2 xmm2
+%define V3 xmm3
+%define V4 xmm4
+%define V2x xmm2
+%define V3x xmm3
+string_routines sse2
+
+%assign VEC 32
+%define V0 ymm0
+%define V1 ymm1
+%define V2 ymm2
+%define V3 ymm3
+%define V4 ymm4
+string_routines avx2
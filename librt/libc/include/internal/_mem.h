@@ -0,0 +1,62 @@
+#ifndef __INTERNAL_MEM_INC__
+#define __INTERNAL_MEM_INC__
+
+#include <crtdefs.h>
+#include <stddef.h>
+
+/* Processor features the memory routines are selected by */
+#define MEM_FEATURE_SSE2            0x1
+#define MEM_FEATURE_AVX2            0x2     // Also requires the os to save the ymm state
+#define MEM_FEATURE_ERMS            0x4     // Enhanced rep movsb/stosb
+#define MEM_FEATURE_DETECTED        0x80000000
+
+/* Sizes up to this are moved with overlapping word loads/stores, no loops. */
+#define MEM_SMALL_LIMIT             64
+
+/* From this size rep movsb/stosb outruns the vector loops on erms processors. */
+#define MEM_ERMS_THRESHOLD          2048
+
+/* Used as the non-temporal threshold when the cache size can't be read. */
+#define MEM_DEFAULT_CACHE_SIZE      (1024 * 1024)
+
+extern unsigned int __mem_features(void);
+extern size_t       __mem_nontemporal_threshold(void);
+extern void*        __mem_move_small(void *Destination, const void *Source, size_t Count);
+extern void*        __mem_set_small(void *Destination, int Value, size_t Count);
+
+/* The word at the time string routines, used when the cpu has no vector support.
+ * Exported so the benchmarks can measure the vector versions against them. */
+_CODE_BEGIN
+extern size_t __strlen_base(const char *String);
+extern char*  __strchr_base(const char *String, int Character);
+extern void*  __memchr_base(const void *Memory, int Character, size_t Count);
+extern int    __strcmp_base(const char *First, const char *Second);
+extern char*  __strstr_base(const char *Haystack, const char *Needle);
+_CODE_END
+
+extern void* asm_memcpy_erms(void *Destination, const void *Source, size_t Count);
+extern void* asm_memset_erms(void *Destination, int Value, size_t Count);
+
+#ifndef LIBC_KERNEL
+extern unsigned int asm_xgetbv(unsigned int Register);
+extern void* asm_memcpy_avx2(void *Destination, const void *Source, size_t Count);
+extern void* asm_memcpy_avx2_nt(void *Destination, const void *Source, size_t Count);
+extern void* asm_memmove_avx2_backward(void *Destination, const void *Source, size_t Count);
+extern void* asm_memset_avx2(void *Destination, int Value, size_t Count);
+extern void* asm_memset_avx2_nt(void *Destination, int Value, size_t Count);
+extern int   asm_memcmp_avx2(const void *First, const void *Second, size_t Count);
+
+/* String scanning, strings of unknown length are only read with aligned vectors */
+extern size_t      asm_strlen_sse2(const char *String);
+extern size_t      asm_strlen_avx2(const char *String);
+extern char*       asm_strchr_sse2(const char *String, int Character);
+extern char*       asm_strchr_avx2(const char *String, int Character);
+extern void*       asm_memchr_sse2(const void *Memory, int Character, size_t Count);
+extern void*       asm_memchr_avx2(const void *Memory, int Character, size_t Count);
+extern int         asm_strcmp_sse2(const char *First, const char *Second);
+extern int         asm_strcmp_avx2(const char *First, const char *Second);
+extern const char* asm_strstr_scan_sse2(const char *Haystack, size_t Count, int First, int Last, size_t Distance);
+extern const char* asm_strstr_scan_avx2(const char *Haystack, size_t Count, int First, int Last, size_t Distance);
+#endif
+
+#endif
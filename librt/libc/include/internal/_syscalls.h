@@ -57,8 +57,8 @@ _CODE_END
 #define Syscall_InterruptAdd(Descriptor, Flags) (UUId_t)syscall2(29, SCPARAM(Descriptor), SCPARAM(Flags))
 #define Syscall_InterruptRemove(InterruptId) (OsStatus_t)syscall1(30, SCPARAM(InterruptId))
 #define Syscall_RegisterEventTarget(StdInputHandle, WmHandle) (OsStatus_t)syscall2(31, SCPARAM(StdInputHandle), SCPARAM(WmHandle))
-#define Syscall_KeyEvent(SystemKey) (OsStatus_t)syscall1(32, SCPARAM(SystemKey))
-#define Syscall_InputEvent(SystemInput) (OsStatus_t)syscall1(33, SCPARAM(SystemInput))
+#define Syscall_KeyEvent(SystemKeys, Count) (OsStatus_t)syscall2(32, SCPARAM(SystemKeys), SCPARAM(Count))
+#define Syscall_InputEvent(SystemInputs, Count) (OsStatus_t)syscall2(33, SCPARAM(SystemInputs), SCPARAM(Count))
 #define Syscall_GetProcessBaseAddress(BaseAddressOut) (OsStatus_t)syscall1(34, SCPARAM(BaseAddressOut))
 
 ///////////////////////////////////////////////
@@ -84,7 +84,7 @@ _CODE_END
 
 #define Syscall_CreatePipe(Flags, HandleOut) (OsStatus_t)syscall2(52, SCPARAM(Flags), SCPARAM(HandleOut))
 #define Syscall_DestroyPipe(Handle) (OsStatus_t)syscall1(53, SCPARAM(Handle))
-#define Syscall_ReadPipe(Handle, Buffer, Length) (OsStatus_t)syscall3(54, SCPARAM(Handle), SCPARAM(Buffer), SCPARAM(Length))
+#define Syscall_ReadPipe(Handle, Buffer, Length, BytesRead) (OsStatus_t)syscall4(54, SCPARAM(Handle), SCPARAM(Buffer), SCPARAM(Length), SCPARAM(BytesRead))
 #define Syscall_WritePipe(Handle, Buffer, Length) (OsStatus_t)syscall3(55, SCPARAM(Handle), SCPARAM(Buffer), SCPARAM(Length))
 
 #define Syscall_RemoteCall(RemoteCall, Asynchronous) (OsStatus_t)syscall2(56, SCPARAM(RemoteCall), SCPARAM(Asynchronous))
@@ -95,7 +95,7 @@ _CODE_END
 #define Syscall_MemoryAllocate(Size, Flags, Virtual, Physical) (OsStatus_t)syscall4(60, SCPARAM(Size), SCPARAM(Flags), SCPARAM(Virtual), SCPARAM(Physical))
 #define Syscall_MemoryFree(Pointer, Size) (OsStatus_t)syscall2(61, SCPARAM(Pointer), SCPARAM(Size))
 #define Syscall_MemoryProtect(MemoryPointer, Length, Flags, PreviousFlags) (OsStatus_t)syscall4(62, SCPARAM(MemoryPointer), SCPARAM(Length), SCPARAM(Flags), SCPARAM(PreviousFlags))
-#define Syscall_CreateBuffer(Size, DmaBufferPointer) (OsStatus_t)syscall2(63, SCPARAM(Size), SCPARAM(DmaBufferPointer))
+#define Syscall_CreateBuffer(Flags, Size, DmaBufferPointer) (OsStatus_t)syscall3(63, SCPARAM(Flags), SCPARAM(Size), SCPARAM(DmaBufferPointer))
 #define Syscall_AcquireBuffer(Handle, DmaBufferPointer) (OsStatus_t)syscall2(64, SCPARAM(Handle), SCPARAM(DmaBufferPointer))
 #define Syscall_QueryBuffer(Handle, DmaOut, CapacityOut) (OsStatus_t)syscall3(65, SCPARAM(Handle), SCPARAM(DmaOut), SCPARAM(CapacityOut))
 
@@ -111,4 +111,16 @@ _CODE_END
 #define Syscall_SystemTime(Time) (OsStatus_t)syscall1(75, SCPARAM(Time))
 #define Syscall_IsServiceAvailable(ServiceId) (OsStatus_t)syscall1(76, SCPARAM(ServiceId))
 
+#define Syscall_WaitForInterrupt(Source, Timeout, EventsOut) (OsStatus_t)syscall3(77, SCPARAM(Source), SCPARAM(Timeout), SCPARAM(EventsOut))
+#define Syscall_GetInterruptStatistics(Source, Statistics) (OsStatus_t)syscall2(78, SCPARAM(Source), SCPARAM(Statistics))
+
+#define Syscall_QueryBufferSegments(Handle, Offset, Length, Segments, SegmentCount) (OsStatus_t)syscall5(79, SCPARAM(Handle), SCPARAM(Offset), SCPARAM(Length), SCPARAM(Segments), SCPARAM(SegmentCount))
+
+#define Syscall_ForkMemorySpace(Source, HandleOut) (OsStatus_t)syscall2(80, SCPARAM(Source), SCPARAM(HandleOut))
+
+#define Syscall_GetInputStatistics(Keys, Inputs) (OsStatus_t)syscall2(81, SCPARAM(Keys), SCPARAM(Inputs))
+
+#define Syscall_GetInterruptCoreStatistics(CoreId, Statistics) (OsStatus_t)syscall2(82, SCPARAM(CoreId), SCPARAM(Statistics))
+#define Syscall_SetInterruptAffinity(Source, CoreId) (OsStatus_t)syscall2(83, SCPARAM(Source), SCPARAM(CoreId))
+
 #endif //!__INTERNAL_CRT_SYSCALLS__
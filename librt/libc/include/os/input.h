@@ -49,11 +49,19 @@ typedef enum _DeviceInputType {
 
 #define KEY_MODIFIER_RELEASED   0x1000
 
+// Input modes for the process's stdin handle. In raw mode every key is delivered
+// as soon as it is available, in cooked mode reads are line-buffered.
+#define STDIN_MODE_RAW          0
+#define STDIN_MODE_COOKED       1
+
+// The timestamp of key and input events is the performance tick (see QueryPerformanceTimer)
+// at which the driver captured the event, or 0 if the driver does not stamp its events.
 PACKED_TYPESTRUCT(SystemKey, {
     uint8_t     KeyAscii;
     uint8_t     KeyCode;
     uint16_t    Flags;
     uint32_t    KeyUnicode;
+    uint64_t    Timestamp;
 });
 
 PACKED_TYPESTRUCT(SystemInput, {
@@ -63,8 +71,21 @@ PACKED_TYPESTRUCT(SystemInput, {
     int16_t     RelativeY;
     int16_t     RelativeZ;
     uint32_t    Buttons;
+    uint64_t    Timestamp;
 });
 
+/* InputStatistics
+ * Delivery statistics of key or input events to the system input pipes. Latencies are
+ * measured from the event timestamp until the event is written to the pipe, and are
+ * given in performance ticks. Events without a timestamp are not part of the latency. */
+typedef struct _InputStatistics {
+    size_t      Batches;        // Number of event writes by drivers
+    size_t      Events;         // Number of events written
+    size_t      Stamped;        // Number of events that carried a timestamp
+    uint64_t    LatencyTotal;   // Accumulated input-to-delivery latency
+    uint64_t    LatencyMax;     // Worst input-to-delivery latency
+} InputStatistics_t;
+
 _CODE_BEGIN
 /* ReadSystemKey
  * Reads a system key from the process's stdin handle. This returns
@@ -79,6 +100,29 @@ ReadSystemKey(
 CRTDECL(OsStatus_t,
 TranslateSystemKey(
     _In_ SystemKey_t* Key));
+
+/* ReadSystemKeys
+ * Reads up to <MaxKeys> system keys from the process's stdin handle in one call. This
+ * blocks until atleast one key is available, and returns the raw system keys. */
+CRTDECL(OsStatus_t,
+ReadSystemKeys(
+    _In_  SystemKey_t* Keys,
+    _In_  size_t       MaxKeys,
+    _Out_ size_t*      KeysRead));
+
+/* TranslateSystemKeys
+ * Performs the translation of a batch of system keys, see TranslateSystemKey. */
+CRTDECL(OsStatus_t,
+TranslateSystemKeys(
+    _In_ SystemKey_t* Keys,
+    _In_ size_t       Count));
+
+/* SetStdinMode
+ * Changes the input mode of the process's stdin handle, STDIN_MODE_RAW or
+ * STDIN_MODE_COOKED. Any partially assembled line is discarded on change. */
+CRTDECL(OsStatus_t,
+SetStdinMode(
+    _In_ int Mode));
 _CODE_END
 
 #endif //!__INPUT_INTERFACE_H__
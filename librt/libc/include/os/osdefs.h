@@ -92,7 +92,8 @@ typedef enum {
     OsInvalidParameters, // Error - Bad parameters given
     OsInvalidPermissions,// Error - Bad permissions
     OsTimeout,           // Error - Timeout
-    OsNotSupported       // Error - Feature not supported
+    OsNotSupported,      // Error - Feature not supported
+    OsOutOfMemory        // Error - Out of memory
 } OsStatus_t;
 
 typedef enum {
@@ -161,7 +162,7 @@ static inline int LastSetBit(size_t Value)
 #define MIN(a,b)                                (((a)<(b))?(a):(b))
 #define MAX(a,b)                                (((a)>(b))?(a):(b))
 #define ISINRANGE(val, min, max)                (((val) >= (min)) && ((val) <= (max)))
-#define DIVUP(a, b)                             ((a / b) + (((a % b) > 0) ? 1 : 0))
+#define DIVUP(a, b)                             (((a) / (b)) + ((((a) % (b)) > 0) ? 1 : 0))
 #define INCLIMIT(i, limit)                      i++; if (i == limit) i = 0;
 #define ADDLIMIT(Base, Current, Step, Limit)    ((Current + Step) >= Limit) ? Base : (Current + Step) 
 #define ALIGN(Val, Alignment, Roundup)          ((Val & (Alignment-1)) > 0 ? (Roundup == 1 ? ((Val + Alignment) & ~(Alignment-1)) : Val & ~(Alignment-1)) : Val)
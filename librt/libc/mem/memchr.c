@@ -39,6 +39,7 @@ QUICKREF
 #include <string.h>
 #include <limits.h>
 #include <stddef.h>
+#include <internal/_mem.h>
 
 /* Nonzero if either X or Y is not aligned on a "long" boundary.  */
 #define _memchrUNALIGNED(X) ((long)X & (sizeof (long) - 1))
@@ -68,7 +69,7 @@ QUICKREF
    to fill (long)MASK. */
 #define DETECTCHAR(X,MASK) (DETECTNULL(X ^ MASK))
 
-void* memchr(const void* src_void, int c, size_t length)
+void* __memchr_base(const void* src_void, int c, size_t length)
 {
 	const unsigned char *src = (const unsigned char *)src_void;
 	unsigned char d = (unsigned char)c;
@@ -127,3 +128,35 @@ void* memchr(const void* src_void, int c, size_t length)
 
 	return NULL;
 }
+
+#ifndef LIBC_KERNEL
+typedef void*(*MemChrTemplate)(const void* src_void, int c, size_t length);
+static void* memchr_select(const void* src_void, int c, size_t length);
+static MemChrTemplate __GlbMemChrInstance = memchr_select;
+
+/* memchr_select
+ * Selects the widest vector scan the cpu supports on first use */
+static void* memchr_select(const void* src_void, int c, size_t length)
+{
+	unsigned int Features = __mem_features();
+	if (Features & MEM_FEATURE_AVX2) {
+		__GlbMemChrInstance = asm_memchr_avx2;
+	}
+	else if (Features & MEM_FEATURE_SSE2) {
+		__GlbMemChrInstance = asm_memchr_sse2;
+	}
+	else {
+		__GlbMemChrInstance = __memchr_base;
+	}
+	return __GlbMemChrInstance(src_void, c, length);
+}
+#endif
+
+void* memchr(const void* src_void, int c, size_t length)
+{
+#ifdef LIBC_KERNEL
+	return __memchr_base(src_void, c, length);
+#else
+	return __GlbMemChrInstance(src_void, c, length);
+#endif
+}
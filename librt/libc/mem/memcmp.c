@@ -36,6 +36,7 @@ QUICKREF
 	memcmp ansi pure
 */
 #include <string.h>
+#include <internal/_mem.h>
 
 /* Nonzero if either X or Y is not aligned on a "long" boundary.  */
 #define MEMCMP_UNALIGNED(X, Y) \
@@ -47,11 +48,7 @@ QUICKREF
 /* Threshhold for punting to the byte copier.  */
 #define TOO_SMALL(LEN)  ((LEN) < LBLOCKSIZE)
 
-#if defined(_MSC_VER) && !defined(__clang__)
-#pragma function(memcmp)
-#endif
-
-int memcmp(const void* ptr1, const void* ptr2, size_t num)
+static int memcmp_base(const void* ptr1, const void* ptr2, size_t num)
 {
 	unsigned char *s1 = (unsigned char *) ptr1;
 	unsigned char *s2 = (unsigned char *) ptr2;
@@ -93,4 +90,18 @@ int memcmp(const void* ptr1, const void* ptr2, size_t num)
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma function(memcmp)
+#endif
+
+int memcmp(const void* ptr1, const void* ptr2, size_t num)
+{
+#ifndef LIBC_KERNEL
+	if (num >= 32 && (__mem_features() & MEM_FEATURE_AVX2)) {
+		return asm_memcmp_avx2(ptr1, ptr2, num);
+	}
+#endif
+	return memcmp_base(ptr1, ptr2, num);
+}
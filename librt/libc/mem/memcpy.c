@@ -22,11 +22,18 @@
 #include <string.h>
 #include <stdint.h>
 #include <internal/_string.h>
+#include <internal/_mem.h>
 #include <stddef.h>
+#if !defined(LIBC_KERNEL) && (defined(i386) || defined(__i386__))
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
 
 #define CPUID_FEAT_EDX_MMX      1 << 23
 #define CPUID_FEAT_EDX_SSE		1 << 25
-#define CPUID_FEAT_EDX_SSE2     1 << 26
 #define MEMCPY_ACCEL_THRESHOLD	10      // Must be worth the extra overhead
 
 /* memcpy_base
@@ -75,46 +82,57 @@ memcpy_base(
 	return Destination;
 }
 
-// Don't use SSE/MMX instructions in kernel environment
-// it's way to fragile on task-switches as we can heavily use memcpy
+// Don't use SSE/MMX/AVX instructions in kernel environment
+// it's way to fragile on task-switches as we can heavily use memcpy,
+// rep movsb does not touch any of the extended state
 #ifdef LIBC_KERNEL
 #if defined(_MSC_VER) && !defined(__clang__)
 #pragma function(memcpy)
 #endif
 void* memcpy(void *destination, const void *source, size_t count) {
-	return memcpy_base(destination, source, count);
-}
-#elif defined(__amd64__) || defined(amd64)
-// Use the sse2 by default as all 64 bit cpus support sse
-extern void asm_memcpy_sse2(void *Dest, const void *Source, int Loops, int RemainingBytes);
-void *memcpy(void *destination, const void *source, size_t count) {
-	int Loops        = count / 128;
-	int Remaining    = count % 128;
-	if (Loops < MEMCPY_ACCEL_THRESHOLD) {
-		return memcpy_base(destination, source, count);
+	if (count <= MEM_SMALL_LIMIT) {
+		return __mem_move_small(destination, source, count);
 	}
-	asm_memcpy_sse2(destination, source, Loops, Remaining);
-	return destination;
+	if (count >= MEM_ERMS_THRESHOLD && (__mem_features() & MEM_FEATURE_ERMS)) {
+		return asm_memcpy_erms(destination, source, count);
+	}
+	return memcpy_base(destination, source, count);
 }
 #else
-#if defined(_MSC_VER) && !defined(__clang__)
-#include <intrin.h>
-#else
-#include <cpuid.h>
-#endif
 typedef void *(*MemCpyTemplate)(void *Destination, const void *Source, size_t Count);
 void *memcpy_select(void *Destination, const void *Source, size_t Count);
-extern void asm_memcpy_mmx(void *Dest, const void *Source, int Loops, int RemainingBytes);
-extern void asm_memcpy_sse(void *Dest, const void *Source, int Loops, int RemainingBytes);
 extern void asm_memcpy_sse2(void *Dest, const void *Source, int Loops, int RemainingBytes);
 static MemCpyTemplate __GlbMemCpyInstance = memcpy_select;
 
+/* This is the AVX2 optimized version of memcpy. Small copies are done with
+ * overlapping loads, large copies with rep movsb if the cpu has fast strings,
+ * and copies that won't fit in the cache are streamed past it. */
+void *memcpy_avx2(void *Destination, const void *Source, size_t Count) {
+	if (Count <= MEM_SMALL_LIMIT) {
+		return __mem_move_small(Destination, Source, Count);
+	}
+	if (Count >= __mem_nontemporal_threshold()) {
+		return asm_memcpy_avx2_nt(Destination, Source, Count);
+	}
+	if (Count >= MEM_ERMS_THRESHOLD && (__mem_features() & MEM_FEATURE_ERMS)) {
+		return asm_memcpy_erms(Destination, Source, Count);
+	}
+	return asm_memcpy_avx2(Destination, Source, Count);
+}
+
 /* This is the SSE2 optimized version of memcpy, but there is a fallback
  * to the normal one, in case there isn't enough loops for overhead to be
  * worth it. */
 void *memcpy_sse2(void *Destination, const void *Source, size_t Count) {
 	int Loops        = Count / 128;
 	int Remaining    = Count % 128;
+	if (Count <= MEM_SMALL_LIMIT) {
+		return __mem_move_small(Destination, Source, Count);
+	}
+	if (Count >= MEM_ERMS_THRESHOLD && Count < __mem_nontemporal_threshold() &&
+		(__mem_features() & MEM_FEATURE_ERMS)) {
+		return asm_memcpy_erms(Destination, Source, Count);
+	}
 	if (Loops < MEMCPY_ACCEL_THRESHOLD) {
 		return memcpy_base(Destination, Source, Count);
 	}
@@ -122,6 +140,10 @@ void *memcpy_sse2(void *Destination, const void *Source, size_t Count) {
 	return Destination;
 }
 
+#if defined(i386) || defined(__i386__)
+extern void asm_memcpy_mmx(void *Dest, const void *Source, int Loops, int RemainingBytes);
+extern void asm_memcpy_sse(void *Dest, const void *Source, int Loops, int RemainingBytes);
+
 /* This is the SSE optimized version of memcpy, but there is a fallback
  * to the normal one, in case there isn't enough loops for overhead to be
  * worth it. */
@@ -147,41 +169,44 @@ void *memcpy_mmx(void *Destination, const void *Source, size_t Count) {
 	asm_memcpy_mmx(Destination, Source, MmxLoops, mBytes);
 	return Destination;
 }
+#endif
 
 /* MemCpySelect
  * This is the default, initial routine, it selects the best
- * optimized memcpy for this system. It can be either SSE or MMX
- * or just the byte copier */
+ * optimized memcpy for this system. It can be either AVX2, SSE2, SSE
+ * or MMX or just the byte copier */
 void *memcpy_select(void *Destination, const void *Source, size_t Count) {
-	// Variables
-	int CpuRegisters[4] = { 0 };
-	int CpuFeatEcx = 0;
-	int CpuFeatEdx = 0;
+	unsigned int Features = __mem_features();
 
-	// Now extract the cpu information 
-	// so we can select a memcpy
+	if (Features & MEM_FEATURE_AVX2) {
+		__GlbMemCpyInstance = memcpy_avx2;
+	}
+	else if (Features & MEM_FEATURE_SSE2) {
+		__GlbMemCpyInstance = memcpy_sse2;
+	}
+#if defined(i386) || defined(__i386__)
+	else {
+		int CpuRegisters[4] = { 0 };
 #if defined(_MSC_VER) && !defined(__clang__)
-	__cpuid(CpuRegisters, 1);
+		__cpuid(CpuRegisters, 1);
 #else
-    __cpuid(1, CpuRegisters[0], CpuRegisters[1], CpuRegisters[2], CpuRegisters[3]);
+		__cpuid(1, CpuRegisters[0], CpuRegisters[1], CpuRegisters[2], CpuRegisters[3]);
 #endif
-    // Features are in ecx/edx
-    CpuFeatEcx = CpuRegisters[2];
-    CpuFeatEdx = CpuRegisters[3];
-
-    // Choose between SSE2, SSE, MMX and base
-    if (CpuFeatEdx & CPUID_FEAT_EDX_SSE2) {
-		__GlbMemCpyInstance = memcpy_sse2;
-	}
-	else if (CpuFeatEdx & CPUID_FEAT_EDX_SSE) {
-		__GlbMemCpyInstance = memcpy_sse;
-	}
-	else if (CpuFeatEdx & CPUID_FEAT_EDX_MMX) {
-		__GlbMemCpyInstance = memcpy_mmx;
+		if (CpuRegisters[3] & CPUID_FEAT_EDX_SSE) {
+			__GlbMemCpyInstance = memcpy_sse;
+		}
+		else if (CpuRegisters[3] & CPUID_FEAT_EDX_MMX) {
+			__GlbMemCpyInstance = memcpy_mmx;
+		}
+		else {
+			__GlbMemCpyInstance = memcpy_base;
+		}
 	}
+#else
 	else {
 		__GlbMemCpyInstance = memcpy_base;
 	}
+#endif
 	return __GlbMemCpyInstance(Destination, Source, Count);
 }
 
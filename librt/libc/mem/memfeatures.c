@@ -0,0 +1,231 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - Memory routine selection
+ *  - Detects the processor features the mem* routines are selected by, and
+ *    implements the small-size paths shared by all of them.
+ */
+
+#include <internal/_mem.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MEM_CPUID(Leaf, Subleaf, Registers) __cpuidex((int*)Registers, Leaf, Subleaf)
+#else
+#include <cpuid.h>
+#define MEM_CPUID(Leaf, Subleaf, Registers) __cpuid_count(Leaf, Subleaf, Registers[0], Registers[1], Registers[2], Registers[3])
+#endif
+
+#define CPUID_FEAT_ECX_OSXSAVE      (1 << 27)
+#define CPUID_FEAT_ECX_AVX          (1 << 28)
+#define CPUID_FEAT_EDX_SSE2         (1 << 26)
+#define CPUID_EXTFEAT_EBX_AVX2      (1 << 5)
+#define CPUID_EXTFEAT_EBX_ERMS      (1 << 9)
+#define XCR0_SSE_AVX                0x6
+
+// Unaligned word accesses for the small paths, the compiler must not assume
+// neither alignment nor type of the memory behind them
+typedef uint64_t __attribute__((__may_alias__, __aligned__(1))) mem_u64_t;
+typedef uint32_t __attribute__((__may_alias__, __aligned__(1))) mem_u32_t;
+typedef uint16_t __attribute__((__may_alias__, __aligned__(1))) mem_u16_t;
+
+static unsigned int __GlbMemFeatures          = 0;
+static size_t       __GlbMemNonTemporalLimit = 0;
+
+/* MemDetectCacheSize
+ * Retrieves the size of the largest data cache, from the deterministic cache
+ * parameters on intel, and from the extended l2/l3 information on amd. */
+static size_t
+MemDetectCacheSize(void)
+{
+    unsigned int Registers[4] = { 0 };
+    size_t       CacheSize    = 0;
+    unsigned int MaxLeaf;
+    unsigned int i;
+
+    MEM_CPUID(0, 0, Registers);
+    MaxLeaf = Registers[0];
+    if (MaxLeaf >= 4) {
+        for (i = 0; i < 16; i++) {
+            MEM_CPUID(4, i, Registers);
+            if ((Registers[0] & 0x1F) == 0) {
+                break;
+            }
+
+            // Skip instruction caches, ways * partitions * line size * sets
+            if ((Registers[0] & 0x1F) != 2) {
+                size_t Size = (size_t)((Registers[1] >> 22) + 1) *
+                    (((Registers[1] >> 12) & 0x3FF) + 1) *
+                    ((Registers[1] & 0xFFF) + 1) * (Registers[2] + 1);
+                if (Size > CacheSize) {
+                    CacheSize = Size;
+                }
+            }
+        }
+    }
+
+    if (CacheSize == 0) {
+        MEM_CPUID(0x80000000, 0, Registers);
+        if (Registers[0] >= 0x80000006) {
+            MEM_CPUID(0x80000006, 0, Registers);
+            CacheSize = (size_t)(Registers[3] >> 18) * 512 * 1024;
+            if (CacheSize == 0) {
+                CacheSize = (size_t)(Registers[2] >> 16) * 1024;
+            }
+        }
+    }
+    return (CacheSize != 0) ? CacheSize : MEM_DEFAULT_CACHE_SIZE;
+}
+
+/* MemDetectFeatures
+ * Reads the processor features once, racing initializers all store the same values. */
+static void
+MemDetectFeatures(void)
+{
+    unsigned int Registers[4] = { 0 };
+    unsigned int Features     = MEM_FEATURE_DETECTED;
+    unsigned int MaxLeaf;
+    unsigned int FeatEcx;
+
+    MEM_CPUID(0, 0, Registers);
+    MaxLeaf = Registers[0];
+
+    MEM_CPUID(1, 0, Registers);
+    FeatEcx = Registers[2];
+    if (Registers[3] & CPUID_FEAT_EDX_SSE2) {
+        Features |= MEM_FEATURE_SSE2;
+    }
+
+    if (MaxLeaf >= 7) {
+        MEM_CPUID(7, 0, Registers);
+        if (Registers[1] & CPUID_EXTFEAT_EBX_ERMS) {
+            Features |= MEM_FEATURE_ERMS;
+        }
+#ifndef LIBC_KERNEL
+        // The ymm registers are only usable if the os saves them on task switches
+        if ((Registers[1] & CPUID_EXTFEAT_EBX_AVX2) &&
+            (FeatEcx & (CPUID_FEAT_ECX_OSXSAVE | CPUID_FEAT_ECX_AVX)) == (CPUID_FEAT_ECX_OSXSAVE | CPUID_FEAT_ECX_AVX) &&
+            (asm_xgetbv(0) & XCR0_SSE_AVX) == XCR0_SSE_AVX) {
+            Features |= MEM_FEATURE_AVX2;
+        }
+#endif
+    }
+    (void)FeatEcx;
+
+    // Stream stores once the copy no longer fits in three quarters of the cache
+    __GlbMemNonTemporalLimit = (MemDetectCacheSize() / 4) * 3;
+    __GlbMemFeatures         = Features;
+}
+
+unsigned int
+__mem_features(void)
+{
+    if (!(__GlbMemFeatures & MEM_FEATURE_DETECTED)) {
+        MemDetectFeatures();
+    }
+    return __GlbMemFeatures;
+}
+
+size_t
+__mem_nontemporal_threshold(void)
+{
+    if (!(__GlbMemFeatures & MEM_FEATURE_DETECTED)) {
+        MemDetectFeatures();
+    }
+    return __GlbMemNonTemporalLimit;
+}
+
+/* __mem_move_small
+ * Moves up to MEM_SMALL_LIMIT bytes with overlapping loads from both ends. All loads
+ * are done before the first store, which also makes it safe for overlapping buffers. */
+void*
+__mem_move_small(
+    _In_ void*       Destination,
+    _In_ const void* Source,
+    _In_ size_t      Count)
+{
+    uint8_t*       Dst = (uint8_t*)Destination;
+    const uint8_t* Src = (const uint8_t*)Source;
+
+    if (Count >= 32) {
+        uint64_t H0 = *(const mem_u64_t*)(Src),      H1 = *(const mem_u64_t*)(Src + 8);
+        uint64_t H2 = *(const mem_u64_t*)(Src + 16), H3 = *(const mem_u64_t*)(Src + 24);
+        uint64_t T0 = *(const mem_u64_t*)(Src + Count - 32), T1 = *(const mem_u64_t*)(Src + Count - 24);
+        uint64_t T2 = *(const mem_u64_t*)(Src + Count - 16), T3 = *(const mem_u64_t*)(Src + Count - 8);
+        *(mem_u64_t*)(Dst)      = H0; *(mem_u64_t*)(Dst + 8)  = H1;
+        *(mem_u64_t*)(Dst + 16) = H2; *(mem_u64_t*)(Dst + 24) = H3;
+        *(mem_u64_t*)(Dst + Count - 32) = T0; *(mem_u64_t*)(Dst + Count - 24) = T1;
+        *(mem_u64_t*)(Dst + Count - 16) = T2; *(mem_u64_t*)(Dst + Count - 8)  = T3;
+    }
+    else if (Count >= 16) {
+        uint64_t H0 = *(const mem_u64_t*)(Src), H1 = *(const mem_u64_t*)(Src + 8);
+        uint64_t T0 = *(const mem_u64_t*)(Src + Count - 16), T1 = *(const mem_u64_t*)(Src + Count - 8);
+        *(mem_u64_t*)(Dst)     = H0; *(mem_u64_t*)(Dst + 8) = H1;
+        *(mem_u64_t*)(Dst + Count - 16) = T0; *(mem_u64_t*)(Dst + Count - 8) = T1;
+    }
+    else if (Count >= 8) {
+        uint64_t H = *(const mem_u64_t*)(Src), T = *(const mem_u64_t*)(Src + Count - 8);
+        *(mem_u64_t*)(Dst) = H; *(mem_u64_t*)(Dst + Count - 8) = T;
+    }
+    else if (Count >= 4) {
+        uint32_t H = *(const mem_u32_t*)(Src), T = *(const mem_u32_t*)(Src + Count - 4);
+        *(mem_u32_t*)(Dst) = H; *(mem_u32_t*)(Dst + Count - 4) = T;
+    }
+    else if (Count >= 2) {
+        uint16_t H = *(const mem_u16_t*)(Src), T = *(const mem_u16_t*)(Src + Count - 2);
+        *(mem_u16_t*)(Dst) = H; *(mem_u16_t*)(Dst + Count - 2) = T;
+    }
+    else if (Count == 1) {
+        *Dst = *Src;
+    }
+    return Destination;
+}
+
+/* __mem_set_small
+ * Fills up to MEM_SMALL_LIMIT bytes with word stores, the last store of each size
+ * overlaps the previous ones instead of falling back to bytes. */
+void*
+__mem_set_small(
+    _In_ void*  Destination,
+    _In_ int    Value,
+    _In_ size_t Count)
+{
+    uint8_t* Dst     = (uint8_t*)Destination;
+    uint64_t Pattern = 0x0101010101010101ULL * (uint8_t)Value;
+    size_t   i;
+
+    if (Count >= 8) {
+        for (i = 0; i + 8 < Count; i += 8) {
+            *(mem_u64_t*)(Dst + i) = Pattern;
+        }
+        *(mem_u64_t*)(Dst + Count - 8) = Pattern;
+    }
+    else if (Count >= 4) {
+        *(mem_u32_t*)(Dst) = (uint32_t)Pattern;
+        *(mem_u32_t*)(Dst + Count - 4) = (uint32_t)Pattern;
+    }
+    else if (Count >= 2) {
+        *(mem_u16_t*)(Dst) = (uint16_t)Pattern;
+        *(mem_u16_t*)(Dst + Count - 2) = (uint16_t)Pattern;
+    }
+    else if (Count == 1) {
+        *Dst = (uint8_t)Value;
+    }
+    return Destination;
+}
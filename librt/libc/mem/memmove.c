@@ -37,6 +37,7 @@ QUICKREF
 
 #include <string.h>
 #include <internal/_string.h>
+#include <internal/_mem.h>
 #include <stdint.h>
 
 void* memmove(void *destination, const void* source, size_t count)
@@ -46,6 +47,22 @@ void* memmove(void *destination, const void* source, size_t count)
 	long *aligned_dst;
 	const long *aligned_src;
 
+	/* Small moves load everything before storing anything */
+	if (count <= MEM_SMALL_LIMIT) {
+		return __mem_move_small(destination, source, count);
+	}
+
+	/* Moves where the destination does not start inside the source are
+		safe to do forward, which is what memcpy does */
+	if ((uintptr_t)dst - (uintptr_t)src >= count) {
+		return memcpy(destination, source, count);
+	}
+#ifndef LIBC_KERNEL
+	if (__mem_features() & MEM_FEATURE_AVX2) {
+		return asm_memmove_avx2_backward(destination, source, count);
+	}
+#endif
+
 	if (src < dst && dst < src + count)
 	{
 		/* Destructive overlap...have to copy backwards */
@@ -4,16 +4,16 @@
  */
 
 #include <string.h>
+#include <internal/_mem.h>
 
 #define LBLOCKSIZE (sizeof(long))
 #define UNALIGNED(X)   ((long)X & (LBLOCKSIZE - 1))
 #define TOO_SMALL(LEN) ((LEN) < LBLOCKSIZE)
 
-#if defined(_MSC_VER) && !defined(__clang__)
-#pragma function(memset)
-#endif
-
-void *memset(void *dest, int c, size_t count)
+/* memset_base
+ * This is the default non-accelerated filler, it fills words at the time
+ * once the destination has been aligned. */
+static void *memset_base(void *dest, int c, size_t count)
 {
 	char *s = (char *)dest;
 	int i;
@@ -65,4 +65,45 @@ void *memset(void *dest, int c, size_t count)
 		*s++ = (char) c;
 
 	return dest;
-}
\ No newline at end of file
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma function(memset)
+#endif
+
+#ifdef LIBC_KERNEL
+// Only rep stosb is used in kernel environment, it does not touch any
+// of the extended state
+void *memset(void *dest, int c, size_t count)
+{
+	if (count <= MEM_SMALL_LIMIT) {
+		return __mem_set_small(dest, c, count);
+	}
+	if (count >= MEM_ERMS_THRESHOLD && (__mem_features() & MEM_FEATURE_ERMS)) {
+		return asm_memset_erms(dest, c, count);
+	}
+	return memset_base(dest, c, count);
+}
+#else
+/* memset
+ * Large fills use rep stosb if the cpu has fast strings, fills that won't
+ * fit in the cache are streamed past it. */
+void *memset(void *dest, int c, size_t count)
+{
+	unsigned int Features = __mem_features();
+
+	if (count <= MEM_SMALL_LIMIT) {
+		return __mem_set_small(dest, c, count);
+	}
+	if ((Features & MEM_FEATURE_AVX2) && count >= __mem_nontemporal_threshold()) {
+		return asm_memset_avx2_nt(dest, c, count);
+	}
+	if (count >= MEM_ERMS_THRESHOLD && (Features & MEM_FEATURE_ERMS)) {
+		return asm_memset_erms(dest, c, count);
+	}
+	if (Features & MEM_FEATURE_AVX2) {
+		return asm_memset_avx2(dest, c, count);
+	}
+	return memset_base(dest, c, count);
+}
+#endif
@@ -93,6 +93,7 @@ thrd_t thrd_current(void) {
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <io.h>
 #include "../local.h"
@@ -544,9 +545,9 @@ StdioHandleReadFile(
 
     // There is a time when reading more than a couple of times is considerably slower
     // than just reading the entire thing at once. When? Who knows, but in our case anything
-    // more than 5 transfers is useless
+    // more than 5 transfers is useless. The buffer does not need to be physically contiguous
     if (Length >= (OriginalSize * 5)) {
-        DmaBuffer_t *TransferBuffer     = CreateBuffer(UUID_INVALID, Length);
+        DmaBuffer_t *TransferBuffer     = CreateScatterGatherBuffer(Length);
         size_t BytesReadFs              = 0, BytesIndex = 0;
         FileSystemCode_t FsCode;
 
@@ -598,6 +599,22 @@ StdioHandleReadFile(
 
 extern OsStatus_t GetKeyFromSystemKeyEnUs(SystemKey_t* Key);
 
+// Stdin is read in batches of keys, and in cooked mode keys are assembled
+// into lines before any data is handed out to the reader.
+#define STDIN_KEY_BATCH     64
+#define STDIN_LINE_LENGTH   INTERNAL_BUFSIZ
+
+static struct {
+    int         Mode;
+    SystemKey_t Keys[STDIN_KEY_BATCH];
+    size_t      KeyIndex;
+    size_t      KeyCount;
+    char        Line[STDIN_LINE_LENGTH];
+    size_t      LineIndex;
+    size_t      LineLength;
+    int         LineReady;
+} StdinState = { STDIN_MODE_RAW, { { 0 } }, 0, 0, { 0 }, 0, 0, 0 };
+
 /* TranslateSystemKey
  * Performs the translation on the keycode in the system key structure. This fills
  * in the <KeyUnicode> and <KeyAscii> members by translation of the active keymap. */
@@ -611,6 +628,55 @@ TranslateSystemKey(
     return OsError;
 }
 
+/* TranslateSystemKeys
+ * Performs the translation of a batch of system keys, see TranslateSystemKey. */
+OsStatus_t
+TranslateSystemKeys(
+    _In_ SystemKey_t* Keys,
+    _In_ size_t       Count)
+{
+    size_t i;
+    for (i = 0; i < Count; i++) {
+        if (Keys[i].KeyCode != VK_INVALID) {
+            GetKeyFromSystemKeyEnUs(&Keys[i]);
+        }
+    }
+    return OsSuccess;
+}
+
+/* ReadSystemKeys
+ * Reads up to <MaxKeys> system keys from the process's stdin handle in one call. This
+ * blocks until atleast one key is available, and returns the raw system keys. */
+OsStatus_t
+ReadSystemKeys(
+    _In_  SystemKey_t* Keys,
+    _In_  size_t       MaxKeys,
+    _Out_ size_t*      KeysRead)
+{
+    StdioHandle_t* Handle    = StdioFdToHandle(STDIN_FILENO);
+    size_t         BytesRead = 0;
+    size_t         BytesPartial;
+    OsStatus_t     Status;
+
+    if (Handle->InheritationType == STDIO_HANDLE_FILE) {
+        Status = StdioHandleReadFile(Handle, (char*)Keys, MaxKeys * sizeof(SystemKey_t), &BytesRead);
+    }
+    else {
+        Status = ReadPipeAvailable(Handle->InheritationHandle, Keys, 
+            MaxKeys * sizeof(SystemKey_t), &BytesRead);
+        
+        // Never hand out partial keys, the producer commits whole keys so the
+        // remainder of a split key will be available shortly
+        while (Status == OsSuccess && (BytesRead % sizeof(SystemKey_t)) != 0) {
+            Status = ReadPipeAvailable(Handle->InheritationHandle, (uint8_t*)Keys + BytesRead,
+                sizeof(SystemKey_t) - (BytesRead % sizeof(SystemKey_t)), &BytesPartial);
+            BytesRead += BytesPartial;
+        }
+    }
+    *KeysRead = BytesRead / sizeof(SystemKey_t);
+    return Status;
+}
+
 /* ReadSystemKey
  * Reads a system key from the process's stdin handle. This returns
  * the raw system key with no processing performed on the key. */
@@ -618,13 +684,123 @@ OsStatus_t
 ReadSystemKey(
     _In_ SystemKey_t*   Key)
 {
-    StdioHandle_t *Handle = StdioFdToHandle(STDIN_FILENO);
-    if (Handle->InheritationType == STDIO_HANDLE_FILE) {
-        return StdioHandleReadFile(Handle, (char*)Key, sizeof(SystemKey_t), NULL);
+    size_t     KeysRead = 0;
+    OsStatus_t Status   = ReadSystemKeys(Key, 1, &KeysRead);
+    if (Status == OsSuccess && KeysRead == 0) {
+        return OsError;
     }
-    else {
-        return ReadPipe(Handle->InheritationHandle, Key, sizeof(SystemKey_t));
+    return Status;
+}
+
+/* SetStdinMode
+ * Changes the input mode of the process's stdin handle, STDIN_MODE_RAW or
+ * STDIN_MODE_COOKED. Any partially assembled line is discarded on change. */
+OsStatus_t
+SetStdinMode(
+    _In_ int Mode)
+{
+    if (Mode != STDIN_MODE_RAW && Mode != STDIN_MODE_COOKED) {
+        _set_errno(EINVAL);
+        return OsInvalidParameters;
+    }
+    
+    if (StdinState.Mode != Mode) {
+        StdinState.Mode       = Mode;
+        StdinState.LineIndex  = 0;
+        StdinState.LineLength = 0;
+        StdinState.LineReady  = 0;
+    }
+    return OsSuccess;
+}
+
+/* StdioReadStdinRaw
+ * Reads a single batch of keys and hands out their translated characters. */
+static OsStatus_t
+StdioReadStdinRaw(
+    _In_  char*   Buffer, 
+    _In_  size_t  Length,
+    _Out_ size_t* BytesRead)
+{
+    SystemKey_t* Keys     = &StdinState.Keys[0];
+    size_t       KeysRead = 0;
+    size_t       i;
+
+    // Empty out any keys left over from cooked mode first
+    if (StdinState.KeyIndex == StdinState.KeyCount) {
+        if (ReadSystemKeys(Keys, MIN(Length, STDIN_KEY_BATCH), &KeysRead) != OsSuccess) {
+            return OsError;
+        }
+        TranslateSystemKeys(Keys, KeysRead);
+        StdinState.KeyIndex = 0;
+        StdinState.KeyCount = KeysRead;
+    }
+
+    for (i = 0; i < Length && StdinState.KeyIndex < StdinState.KeyCount; i++) {
+        *Buffer++ = (char)Keys[StdinState.KeyIndex++].KeyAscii;
+        (*BytesRead)++;
+    }
+    return OsSuccess;
+}
+
+/* StdioReadStdinCooked
+ * Assembles translated keys into a line, handling erase, and only hands out
+ * data once the line has been terminated or the line buffer is full. */
+static OsStatus_t
+StdioReadStdinCooked(
+    _In_  char*   Buffer, 
+    _In_  size_t  Length,
+    _Out_ size_t* BytesRead)
+{
+    size_t BytesToCopy;
+
+    while (!StdinState.LineReady) {
+        SystemKey_t* Key;
+        
+        if (StdinState.KeyIndex == StdinState.KeyCount) {
+            size_t KeysRead = 0;
+            if (ReadSystemKeys(&StdinState.Keys[0], STDIN_KEY_BATCH, &KeysRead) != OsSuccess) {
+                return OsError;
+            }
+            TranslateSystemKeys(&StdinState.Keys[0], KeysRead);
+            StdinState.KeyIndex = 0;
+            StdinState.KeyCount = KeysRead;
+            continue;
+        }
+
+        Key = &StdinState.Keys[StdinState.KeyIndex++];
+        if ((Key->Flags & KEY_MODIFIER_RELEASED) || Key->KeyCode == VK_INVALID) {
+            continue;
+        }
+
+        if (Key->KeyCode == VK_BACK) {
+            if (StdinState.LineLength > 0) {
+                StdinState.LineLength--;
+            }
+            continue;
+        }
+
+        if (Key->KeyAscii == 0) {
+            continue;
+        }
+
+        StdinState.Line[StdinState.LineLength++] = (char)Key->KeyAscii;
+        if (Key->KeyAscii == '\n' || StdinState.LineLength == STDIN_LINE_LENGTH) {
+            StdinState.LineReady = 1;
+        }
+    }
+
+    BytesToCopy = MIN(Length, StdinState.LineLength - StdinState.LineIndex);
+    memcpy(Buffer, &StdinState.Line[StdinState.LineIndex], BytesToCopy);
+    StdinState.LineIndex += BytesToCopy;
+    *BytesRead           += BytesToCopy;
+
+    // Start on a new line once the reader has consumed this one
+    if (StdinState.LineIndex == StdinState.LineLength) {
+        StdinState.LineIndex  = 0;
+        StdinState.LineLength = 0;
+        StdinState.LineReady  = 0;
     }
+    return OsSuccess;
 }
 
 /* StdioReadInternal
@@ -636,26 +812,17 @@ StdioReadInternal(
     _In_  size_t        Length,
     _Out_ size_t*       BytesRead)
 {
-    // Variables
     StdioHandle_t *Handle   = StdioFdToHandle(fd);
-    SystemKey_t Key;
 
     if (Handle->InheritationType == STDIO_HANDLE_FILE) {
         return StdioHandleReadFile(Handle, Buffer, Length, BytesRead);
     }
     else if (Handle->InheritationType == STDIO_HANDLE_PIPE) {
-        if (fd == STDIN_FILENO) {
-            while (Length--) { // @todo handle wide?
-                if (ReadSystemKey(&Key) != OsSuccess) {
-                    break;   
-                }
-
-                // Perform key translation
-                TranslateSystemKey(&Key);
-                *Buffer++ = (char)Key.KeyAscii;
-                (*BytesRead)++;
+        if (fd == STDIN_FILENO) { // @todo handle wide?
+            if (StdinState.Mode == STDIN_MODE_COOKED) {
+                return StdioReadStdinCooked(Buffer, Length, BytesRead);
             }
-            return OsSuccess;
+            return StdioReadStdinRaw(Buffer, Length, BytesRead);
         }
         else if (ReadPipe(Handle->InheritationHandle, Buffer, Length) == OsSuccess) {
             *BytesRead = Length;
@@ -36,6 +36,7 @@ QUICKREF
 #include <stddef.h>
 #include <string.h>
 #include <limits.h>
+#include <internal/_mem.h>
 
 /* Nonzero if X is not aligned on a "long" boundary.  */
 #define _strchrUNALIGNED(X) ((long)X & (sizeof (long) - 1))
@@ -58,7 +59,7 @@ QUICKREF
    to fill (long)MASK. */
 #define DETECTCHAR(X,MASK) (DETECTNULL(X ^ MASK))
 
-char *strchr(const char *s1, int i)
+char *__strchr_base(const char *s1, int i)
 {
 	const unsigned char *s = (const unsigned char *)s1;
 	unsigned char c = (unsigned char)i;
@@ -114,3 +115,35 @@ char *strchr(const char *s1, int i)
 		return (char *)s;
 	return NULL;
 }
+
+#ifndef LIBC_KERNEL
+typedef char*(*StrChrTemplate)(const char *s1, int i);
+static char *strchr_select(const char *s1, int i);
+static StrChrTemplate __GlbStrChrInstance = strchr_select;
+
+/* strchr_select
+ * Selects the widest vector scan the cpu supports on first use */
+static char *strchr_select(const char *s1, int i)
+{
+	unsigned int Features = __mem_features();
+	if (Features & MEM_FEATURE_AVX2) {
+		__GlbStrChrInstance = asm_strchr_avx2;
+	}
+	else if (Features & MEM_FEATURE_SSE2) {
+		__GlbStrChrInstance = asm_strchr_sse2;
+	}
+	else {
+		__GlbStrChrInstance = __strchr_base;
+	}
+	return __GlbStrChrInstance(s1, i);
+}
+#endif
+
+char *strchr(const char *s1, int i)
+{
+#ifdef LIBC_KERNEL
+	return __strchr_base(s1, i);
+#else
+	return __GlbStrChrInstance(s1, i);
+#endif
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <internal/_string.h>
 #include <limits.h>
+#include <internal/_mem.h>
 
 /* DETECTNULL returns nonzero if (long)X contains a NULL byte. */
 #if LONG_MAX == 2147483647L
@@ -18,11 +19,7 @@
 #endif
 #endif
 
-#if defined(_MSC_VER) && !defined(__clang__)
-#pragma function(strcmp)
-#endif
-
-int strcmp(const char* str1, const char* str2)
+int __strcmp_base(const char* str1, const char* str2)
 {
 	unsigned long *a1;
 	unsigned long *a2;
@@ -61,4 +58,40 @@ int strcmp(const char* str1, const char* str2)
 //for(; *str1 == *str2; ++str1, ++str2)
 //	if(*str1 == 0)
 //		return 0;
-//return *(unsigned char *)str1 < *(unsigned char *)str2 ? -1 : 1;
\ No newline at end of file
+//return *(unsigned char *)str1 < *(unsigned char *)str2 ? -1 : 1;
+
+#ifndef LIBC_KERNEL
+typedef int(*StrCmpTemplate)(const char* str1, const char* str2);
+static int strcmp_select(const char* str1, const char* str2);
+static StrCmpTemplate __GlbStrCmpInstance = strcmp_select;
+
+/* strcmp_select
+ * Selects the widest vector compare the cpu supports on first use */
+static int strcmp_select(const char* str1, const char* str2)
+{
+	unsigned int Features = __mem_features();
+	if (Features & MEM_FEATURE_AVX2) {
+		__GlbStrCmpInstance = asm_strcmp_avx2;
+	}
+	else if (Features & MEM_FEATURE_SSE2) {
+		__GlbStrCmpInstance = asm_strcmp_sse2;
+	}
+	else {
+		__GlbStrCmpInstance = __strcmp_base;
+	}
+	return __GlbStrCmpInstance(str1, str2);
+}
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma function(strcmp)
+#endif
+
+int strcmp(const char* str1, const char* str2)
+{
+#ifdef LIBC_KERNEL
+	return __strcmp_base(str1, str2);
+#else
+	return __GlbStrCmpInstance(str1, str2);
+#endif
+}
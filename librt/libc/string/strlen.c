@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <internal/_mem.h>
 
 #define LBLOCKSIZE   (sizeof (long))
 #define UNALIGNED(X) ((long)X & (LBLOCKSIZE - 1))
@@ -25,11 +26,7 @@
 #error long int is not a 32bit or 64bit byte
 #endif
 
-#if defined(_MSC_VER) && !defined(__clang__)
-#pragma function(strlen)
-#endif
-
-size_t strlen(const char *str)
+size_t __strlen_base(const char *str)
 {
 	const char *start = str;
 	unsigned long *aligned_addr;
@@ -56,4 +53,40 @@ size_t strlen(const char *str)
 		str++;
 
 	return str - start;
-}
\ No newline at end of file
+}
+
+#ifndef LIBC_KERNEL
+typedef size_t(*StrLenTemplate)(const char *str);
+static size_t strlen_select(const char *str);
+static StrLenTemplate __GlbStrLenInstance = strlen_select;
+
+/* strlen_select
+ * Selects the widest vector scan the cpu supports on first use */
+static size_t strlen_select(const char *str)
+{
+	unsigned int Features = __mem_features();
+	if (Features & MEM_FEATURE_AVX2) {
+		__GlbStrLenInstance = asm_strlen_avx2;
+	}
+	else if (Features & MEM_FEATURE_SSE2) {
+		__GlbStrLenInstance = asm_strlen_sse2;
+	}
+	else {
+		__GlbStrLenInstance = __strlen_base;
+	}
+	return __GlbStrLenInstance(str);
+}
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma function(strlen)
+#endif
+
+size_t strlen(const char *str)
+{
+#ifdef LIBC_KERNEL
+	return __strlen_base(str);
+#else
+	return __GlbStrLenInstance(str);
+#endif
+}
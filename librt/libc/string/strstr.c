@@ -34,6 +34,7 @@ QUICKREF
 	strstr ansi pure
 */
 
+#include <internal/_mem.h>
 #include <string.h>
 #include <stddef.h>
 
@@ -43,7 +44,91 @@ QUICKREF
    && ((h_l) = (j) + (n_l)))
 #include "str-two-way.h"
 
-char *strstr(const char *searchee, const char *lookfor)
+#ifndef LIBC_KERNEL
+/* Candidates verified before the scan gives up on a haystack that keeps matching
+ * the first and last character, and leaves the rest to two-way instead. */
+#define STRSTR_VECTOR_CANDIDATES 64
+
+/* The haystack is measured this many bytes at the time, a match near the start of a
+ * long haystack is found without reading the rest of it. */
+#define STRSTR_VECTOR_WINDOW 4096
+
+/* strstr_vector
+ * Finds the needle by scanning for positions that match both its first and last
+ * character a vector at the time, each candidate is then verified with memcmp.
+ * The scan never passes the part of the haystack that is known to be terminated
+ * later, which is extended a window at the time. needle_len must be at least 2. */
+static char *strstr_vector(const char *haystack, const char *needle, size_t needle_len)
+{
+	const char* (*scan)(const char*, size_t, int, int, size_t);
+	const char *terminator = NULL;
+	size_t vector_size;
+	size_t haystack_len = 0;
+	size_t count;
+	size_t position = 0;
+	size_t verified = 0;
+
+	if (__mem_features() & MEM_FEATURE_AVX2) {
+		scan = asm_strstr_scan_avx2;
+		vector_size = 32;
+	}
+	else {
+		scan = asm_strstr_scan_sse2;
+		vector_size = 16;
+	}
+
+	for (;;) {
+		/* Extend the known part of the haystack by a window */
+		if (!terminator) {
+			terminator = memchr(haystack + haystack_len, '\0', STRSTR_VECTOR_WINDOW);
+			haystack_len = terminator ? (size_t)(terminator - haystack)
+				: haystack_len + STRSTR_VECTOR_WINDOW;
+		}
+		if (haystack_len < needle_len) {
+			if (terminator)
+				return NULL;
+			continue;
+		}
+		count = haystack_len - needle_len + 1;
+
+		while (count - position >= vector_size) {
+			const char *candidate = scan(haystack + position, count - position,
+				needle[0], needle[needle_len - 1], needle_len - 1);
+			if (!candidate) {
+				position = count;
+				break;
+			}
+			if (!memcmp(candidate + 1, needle + 1, needle_len - 2))
+				return (char *) candidate;
+			position = (candidate - haystack) + 1;
+
+			/* The filter is not filtering, two-way keeps it linear */
+			if (++verified > STRSTR_VECTOR_CANDIDATES && verified * 16 > position) {
+				if (needle_len < LONG_NEEDLE_THRESHOLD)
+					return two_way_short_needle ((const unsigned char *) haystack + position, needle_len,
+												 (const unsigned char *) needle, needle_len);
+				return two_way_long_needle ((const unsigned char *) haystack + position, needle_len,
+											(const unsigned char *) needle, needle_len);
+			}
+		}
+
+		/* Positions too few for a vector wait for the next window, unless there is none */
+		if (terminator)
+			break;
+	}
+
+	for (; position < count; position++) {
+		if (haystack[position] == needle[0] &&
+			!memcmp(haystack + position + 1, needle + 1, needle_len - 1))
+			return (char *) haystack + position;
+	}
+	return NULL;
+}
+#endif
+
+/* strstr_search
+ * The two-way search, with the vector scan in front of it when allowed. */
+static char *strstr_search(const char *searchee, const char *lookfor, int vector)
 {
 	/* Larger code size, but guaranteed linear performance.  */
 	const char *haystack = searchee;
@@ -67,7 +152,11 @@ char *strstr(const char *searchee, const char *lookfor)
 	/* Reduce the size of haystack using strchr, since it has a smaller
 		linear coefficient than the Two-Way algorithm.  */
 	needle_len = needle - lookfor;
-	haystack = strchr (searchee + 1, *lookfor);
+#ifndef LIBC_KERNEL
+	if (vector && needle_len > 1 && (__mem_features() & (MEM_FEATURE_SSE2 | MEM_FEATURE_AVX2)))
+		return strstr_vector (searchee + 1, lookfor, needle_len);
+#endif
+	haystack = vector ? strchr (searchee + 1, *lookfor) : __strchr_base (searchee + 1, *lookfor);
 	if (!haystack || needle_len == 1)
 		return (char *) haystack;
 	
@@ -81,3 +170,13 @@ char *strstr(const char *searchee, const char *lookfor)
 	return two_way_long_needle ((const unsigned char *) haystack, haystack_len,
 					(const unsigned char *) lookfor, needle_len);
 }
+
+char *__strstr_base(const char *searchee, const char *lookfor)
+{
+	return strstr_search(searchee, lookfor, 0);
+}
+
+char *strstr(const char *searchee, const char *lookfor)
+{
+	return strstr_search(searchee, lookfor, 1);
+}
@@ -48,16 +48,25 @@ void __CrtModuleEntry(void)
     // Initialize environment
     __CrtInitialize(&Tls, 1, NULL);
 
+    // Interrupts are delivered through the interrupt event channel,
+    // install the handler before the driver registers any sources
+    SetInterruptEventHandler(OnInterrupt);
+
     // Call the driver load function 
     // - This will be run once, before loop
+    AcquireDriverLock();
     if (OnLoad() != OsSuccess) {
         exit(-1);
     }
+    ReleaseDriverLock();
 
     // Initialize the driver event loop
     ArgumentBuffer = (char*)malloc(IPC_MAX_MESSAGELENGTH);
     while (IsRunning) {
         if (RPCListen(UUID_INVALID, &Message, ArgumentBuffer) == OsSuccess) {
+            // Interrupt events run on their own threads, drivers are written for
+            // one callback at a time so every callback holds the driver lock
+            AcquireDriverLock();
             switch (Message.Function) {
                 case __DRIVER_REGISTERINSTANCE: {
                     OnRegister((MCoreDevice_t*)Message.Arguments[0].Data.Buffer);
@@ -85,8 +94,11 @@ void __CrtModuleEntry(void)
                     break;
                 }
             }
+            ReleaseDriverLock();
         }
     }
+    AcquireDriverLock();
     OnUnload();
+    ReleaseDriverLock();
     exit(-1);
 }
@@ -26,17 +26,118 @@
 #include <os/mollenos.h>
 #include <ddk/buffer.h>
 #include <ddk/utils.h>
+#include <threads.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* CreateBuffer 
- * Creates a new buffer object with the given size, 
- * this allows hardware drivers to interact with the buffer */
-DmaBuffer_t*
-CreateBuffer(
-    _In_ UUId_t FromHandle,
-    _In_ size_t Length)
+#define BUFFER_POOL_SIZE         8
+#define BUFFER_POOL_MAX_CAPACITY (1024 * 1024)
+#define BUFFER_POOL_SLACK        (64 * 1024)
+
+// Buffers are often created and destroyed for every single transfer, so recently
+// destroyed buffers are kept mapped and reused by the next matching CreateBuffer
+static DmaBuffer_t* BufferPool[BUFFER_POOL_SIZE] = { 0 };
+static int          BufferPoolNext               = 0;
+static mtx_t        BufferPoolLock               = MUTEX_INIT(mtx_plain);
+
+/* BufferPoolTake
+ * Retrieves a pooled buffer for the handle, or if no handle is given a pooled buffer
+ * of our own with the same flags that fits <Length> without wasting too much memory. */
+static DmaBuffer_t*
+BufferPoolTake(
+    _In_ UUId_t  FromHandle,
+    _In_ size_t  Length,
+    _In_ Flags_t Flags)
+{
+    DmaBuffer_t* Buffer = NULL;
+    int          i;
+
+    mtx_lock(&BufferPoolLock);
+    for (i = 0; i < BUFFER_POOL_SIZE; i++) {
+        DmaBuffer_t* Entry = BufferPool[i];
+        if (Entry == NULL) {
+            continue;
+        }
+
+        if (FromHandle != UUID_INVALID) {
+            if ((Entry->Flags & __BUFFER_ACQUIRED) && Entry->Handle == FromHandle) {
+                Buffer = Entry;
+            }
+        }
+        else if (!(Entry->Flags & __BUFFER_ACQUIRED) && 
+                 (Entry->Flags & __BUFFER_SCATTER_GATHER) == Flags &&
+                 Entry->Capacity >= Length && (Entry->Capacity - Length) < BUFFER_POOL_SLACK) {
+            Buffer = Entry;
+        }
+
+        if (Buffer != NULL) {
+            BufferPool[i] = NULL;
+            break;
+        }
+    }
+    mtx_unlock(&BufferPoolLock);
+
+    if (Buffer != NULL) {
+        Buffer->Position = 0;
+    }
+    return Buffer;
+}
+
+/* BufferPoolPut
+ * Stores the buffer in the pool, the buffer that has been in the pool the longest
+ * is returned if the pool is full and must be released by the caller. */
+static DmaBuffer_t*
+BufferPoolPut(
+    _In_ DmaBuffer_t* Buffer)
+{
+    DmaBuffer_t* Evicted = NULL;
+    int          i;
+
+    mtx_lock(&BufferPoolLock);
+    for (i = 0; i < BUFFER_POOL_SIZE; i++) {
+        if (BufferPool[i] == NULL) {
+            BufferPool[i] = Buffer;
+            break;
+        }
+    }
+
+    if (i == BUFFER_POOL_SIZE) {
+        Evicted                    = BufferPool[BufferPoolNext];
+        BufferPool[BufferPoolNext] = Buffer;
+        BufferPoolNext             = (BufferPoolNext + 1) % BUFFER_POOL_SIZE;
+    }
+    mtx_unlock(&BufferPoolLock);
+    return Evicted;
+}
+
+/* ReleaseBuffer
+ * Unmaps the buffer and releases our reference to the buffer handle. */
+static OsStatus_t
+ReleaseBuffer(
+    _In_ DmaBuffer_t* BufferObject)
+{
+    OsStatus_t Status;
+
+    // First step is to unmap the virtual space
+    if (BufferObject->Address != 0) {
+        Status = MemoryFree((void*)BufferObject->Address, BufferObject->Capacity);
+        if (Status != OsSuccess) {
+            return OsError;
+        }
+    }
+
+    // Cleanup the handle
+    Status = Syscall_DestroyHandle(BufferObject->Handle);
+    free(BufferObject);
+    return Status;
+}
+
+static DmaBuffer_t*
+CreateBufferWithFlags(
+    _In_ UUId_t  FromHandle,
+    _In_ size_t  Length,
+    _In_ Flags_t Flags)
 {
     DmaBuffer_t* Buffer;
 
@@ -46,6 +147,11 @@ CreateBuffer(
         return NULL;
     }
 
+    Buffer = BufferPoolTake(FromHandle, Length, Flags);
+    if (Buffer != NULL) {
+        return Buffer;
+    }
+
     Buffer = (DmaBuffer_t*)malloc(sizeof(DmaBuffer_t));
     memset((void*)Buffer, 0, sizeof(DmaBuffer_t));
     if (FromHandle != UUID_INVALID) {
@@ -53,9 +159,10 @@ CreateBuffer(
             free(Buffer);
             return NULL;
         }
+        Buffer->Flags |= __BUFFER_ACQUIRED;
     }
     else {
-        if (Syscall_CreateBuffer(Length, Buffer) != OsSuccess) {
+        if (Syscall_CreateBuffer(Flags, Length, Buffer) != OsSuccess) {
             free(Buffer);
             return NULL;
         }
@@ -63,6 +170,27 @@ CreateBuffer(
     return Buffer;
 }
 
+/* CreateBuffer 
+ * Creates a new buffer object with the given size, 
+ * this allows hardware drivers to interact with the buffer */
+DmaBuffer_t*
+CreateBuffer(
+    _In_ UUId_t FromHandle,
+    _In_ size_t Length)
+{
+    return CreateBufferWithFlags(FromHandle, Length, 0);
+}
+
+/* CreateScatterGatherBuffer
+ * Creates a new buffer with the given length that is not physically contiguous. The
+ * pages of the buffer are committed when they are first accessed or transferred. */
+DmaBuffer_t*
+CreateScatterGatherBuffer(
+    _In_ size_t Length)
+{
+    return CreateBufferWithFlags(UUID_INVALID, Length, __BUFFER_SCATTER_GATHER);
+}
+
 /* DestroyBuffer
  * Destroys the given buffer object and release resources
  * allocated with the CreateBuffer function */
@@ -70,25 +198,19 @@ OsStatus_t
 DestroyBuffer(
     _In_ DmaBuffer_t* BufferObject)
 {
-    OsStatus_t Status;
-
     // Sanitize the parameter
     if (BufferObject == NULL) {
         return OsError;
     }
 
-    // First step is to unmap the virtual space
-    if (BufferObject->Address != 0) {
-        Status = MemoryFree((void*)BufferObject->Address, BufferObject->Capacity);
-        if (Status != OsSuccess) {
-            return OsError;
+    // Keep smaller buffers mapped for reuse, larger ones would pin too much memory
+    if (BufferObject->Capacity <= BUFFER_POOL_MAX_CAPACITY) {
+        BufferObject = BufferPoolPut(BufferObject);
+        if (BufferObject == NULL) {
+            return OsSuccess;
         }
     }
-
-    // Cleanup the handle
-    Status = Syscall_DestroyHandle(BufferObject->Handle);
-    free(BufferObject);
-    return Status;
+    return ReleaseBuffer(BufferObject);
 }
 
 /* ZeroBuffer 
@@ -284,6 +406,20 @@ GetBufferDma(
     return (BufferObject != NULL) ? BufferObject->Dma : 0;
 }
 
+/* GetBufferSegments
+ * Retrieves the physical segments of the buffer range given, pages that are not yet
+ * committed are committed. */
+OsStatus_t
+GetBufferSegments(
+    _In_    UUId_t        Handle,
+    _In_    size_t        Offset,
+    _In_    size_t        Length,
+    _In_    DmaSegment_t* Segments,
+    _InOut_ int*          SegmentCount)
+{
+    return Syscall_QueryBufferSegments(Handle, Offset, Length, Segments, SegmentCount);
+}
+
 /* GetBufferDataPointer
  * Retrieves the data pointer to the physical memory. This can be used to access
  * the physical memory as this pointer is mapped to the dma. */
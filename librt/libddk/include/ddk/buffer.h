@@ -26,17 +26,32 @@
 
 #include <ddk/ddkdefs.h>
 
+/* DmaBuffer Definitions
+ * Flags for the dma buffer objects, scatter-gather buffers are not physically
+ * contiguous and their pages are committed on first access or transfer. */
+#define __BUFFER_SCATTER_GATHER 0x00000001
+#define __BUFFER_ACQUIRED       0x00000100 // Set by CreateBuffer for buffers created from a handle
+
 // System dma buffer
 // Contains information about a dma buffer for use with transfers,
-// shared memory or hardware interaction.
+// shared memory or hardware interaction. Dma is only valid for buffers
+// that are not scatter-gather, otherwise the segments must be queried.
 typedef struct _DmaBuffer {
     UUId_t    Handle;
+    Flags_t   Flags;
     uintptr_t Address;
     uintptr_t Dma;
     size_t    Capacity;
     size_t    Position;
 } DmaBuffer_t;
 
+// System dma segment
+// Describes a physically contiguous part of a dma buffer.
+typedef struct _DmaSegment {
+    uintptr_t Address;
+    size_t    Length;
+} DmaSegment_t;
+
 _CODE_BEGIN
 /* CreateBuffer
  * Creates a new buffer either from an existing handle (Length will be ignored),
@@ -46,9 +61,16 @@ CreateBuffer(
     _In_ UUId_t FromHandle,
     _In_ size_t Length));
 
+/* CreateScatterGatherBuffer
+ * Creates a new buffer with the given length that is not physically contiguous. The
+ * pages of the buffer are committed when they are first accessed or transferred. */
+DDKDECL(DmaBuffer_t*,
+CreateScatterGatherBuffer(
+    _In_ size_t Length));
+
 /* DestroyBuffer
- * Destroys the given buffer object and release resources
- * allocated with the CreateBuffer function */
+ * Destroys the given buffer object and release resources allocated with the CreateBuffer
+ * function. Small buffers are kept mapped in a pool and reused by CreateBuffer. */
 DDKDECL(OsStatus_t,
 DestroyBuffer(
     _In_ DmaBuffer_t* BufferObject));
@@ -118,6 +140,18 @@ DDKDECL(uintptr_t,
 GetBufferDma(
     _In_ DmaBuffer_t* BufferObject));
 
+/* GetBufferSegments
+ * Retrieves the physical segments of the buffer range given, pages that are not yet
+ * committed are committed. SegmentCount must be set to the capacity of Segments and
+ * is updated to the number of segments filled, which may cover less than <Length>. */
+DDKDECL(OsStatus_t,
+GetBufferSegments(
+    _In_    UUId_t        Handle,
+    _In_    size_t        Offset,
+    _In_    size_t        Length,
+    _In_    DmaSegment_t* Segments,
+    _InOut_ int*          SegmentCount));
+
 /* GetBufferDataPointer
  * Retrieves the data pointer to the physical memory. This can be used to access
  * the physical memory as this pointer is mapped to the dma.  */
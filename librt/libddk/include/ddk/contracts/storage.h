@@ -51,7 +51,8 @@ PACKED_TYPESTRUCT(StorageDescriptor, {
 PACKED_TYPESTRUCT(StorageOperation, {
     int       Direction;
     uint64_t  AbsoluteSector;
-    uintptr_t PhysicalBuffer;
+    UUId_t    BufferHandle;
+    size_t    BufferOffset;
     size_t    SectorCount;
 });
 
@@ -86,14 +87,15 @@ StorageQuery(
  * Sends a read request to the given storage-medium, and attempts to
  * read the number of bytes requested into the given buffer 
  * at the absolute sector given 
- * @PhysicalAddress - Must be the contigious physical address
- *                    buffer to read data into */
+ * @BufferHandle - The dma buffer to read data into, at <BufferOffset>. The
+ *                 buffer does not need to be physically contiguous */
 SERVICEAPI OsStatus_t SERVICEABI
 StorageRead(
     _In_  UUId_t    DriverId, 
     _In_  UUId_t    StorageDeviceId,
     _In_  uint64_t  Sector, 
-    _In_  uintptr_t PhysicalAddress, 
+    _In_  UUId_t    BufferHandle,
+    _In_  size_t    BufferOffset,
     _In_  size_t    SectorCount,
     _Out_ size_t*   SectorsRead)
 {
@@ -109,7 +111,8 @@ StorageRead(
     // Initialize operation details
     Operation.Direction      = __STORAGE_OPERATION_READ;
     Operation.AbsoluteSector = Sector;
-    Operation.PhysicalBuffer = PhysicalAddress;
+    Operation.BufferHandle   = BufferHandle;
+    Operation.BufferOffset   = BufferOffset;
     Operation.SectorCount    = SectorCount;
     
     // Perform the query
@@ -125,14 +128,15 @@ StorageRead(
  * Sends a write request to the given storage-medium, and attempts to
  * write the number of bytes requested from the given buffer
  * at the absolute sector given. 
- * @PhysicalAddress - Must be the contigious physical address
- *                    buffer that contains the data to write */
+ * @BufferHandle - The dma buffer that contains the data to write, at <BufferOffset>.
+ *                 The buffer does not need to be physically contiguous */
 SERVICEAPI OsStatus_t SERVICEABI
 StorageWrite(
     _In_  UUId_t    Driver,
     _In_  UUId_t    StorageDevice,
     _In_  uint64_t  Sector, 
-    _In_  uintptr_t PhysicalAddress,
+    _In_  UUId_t    BufferHandle,
+    _In_  size_t    BufferOffset,
     _In_  size_t    SectorCount,
     _Out_ size_t*   SectorsWritten)
 {
@@ -148,7 +152,8 @@ StorageWrite(
     // Initialize operation details
     Operation.Direction      = __STORAGE_OPERATION_WRITE;
     Operation.AbsoluteSector = Sector;
-    Operation.PhysicalBuffer = PhysicalAddress;
+    Operation.BufferHandle   = BufferHandle;
+    Operation.BufferOffset   = BufferOffset;
     Operation.SectorCount    = SectorCount;
 
     QueryDriver(&Contract, __STORAGE_QUERY_WRITE,
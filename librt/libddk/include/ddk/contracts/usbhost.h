@@ -52,6 +52,7 @@
 #define __USBHOST_RESETPORT                     IPC_DECL_FUNCTION(3)
 #define __USBHOST_QUERYPORT                     IPC_DECL_FUNCTION(4)
 #define __USBHOST_RESETENDPOINT                 IPC_DECL_FUNCTION(5)
+#define __USBHOST_CANCELTRANSFER                IPC_DECL_FUNCTION(6)
 
 /* UsbControllerRegister
  * Registers a new controller with the given type and setup */
@@ -93,6 +93,11 @@ PACKED_TYPESTRUCT(MCoreDevice, {
     DevInfo_t           Bus;
     DevInfo_t           Slot;
     DevInfo_t           Function;
+
+    // Offsets of the message signaled interrupt capabilities
+    // in the config space, 0 if the device doesn't support them
+    DevInfo_t           MsiCapability;
+    DevInfo_t           MsiXCapability;
 });
 
 /* RegisterDevice
@@ -132,6 +137,20 @@ IoctlDeviceEx(
     _InOut_ Flags_t* Value,
     _In_    size_t   Width));
 
+/* RegisterMessageInterrupts
+ * Registers message signaled interrupts for the device, a source for each of the <Count>
+ * prepared descriptors. MSI-X is preferred as every vector then is placed on a core of its
+ * own, it requires the io-space of the MSI-X table to be acquired. Otherwise a single MSI
+ * vector is used. <Count> is updated with the number of sources that were registered, and
+ * OsNotSupported is returned if the device supports neither. */
+DDKDECL(OsStatus_t,
+RegisterMessageInterrupts(
+    _In_    MCoreDevice_t*     Device,
+    _In_    DeviceInterrupt_t* Interrupts,
+    _In_    Flags_t            Flags,
+    _InOut_ int*               Count,
+    _Out_   UUId_t*            Sources));
+
 /* InstallDriver 
  * Tries to find a suitable driver for the given device
  * by searching storage-medias for the vendorid/deviceid 
@@ -72,6 +72,7 @@ typedef struct _FastInterruptResources {
     // System Functions
     size_t                          (*ReadIoSpace)(DeviceIo_t*, size_t Offset, size_t Length);
     OsStatus_t                      (*WriteIoSpace)(DeviceIo_t*, size_t Offset, size_t Value, size_t Length);
+    uint64_t                        (*ReadTimestamp)(void); // Current performance tick
 } FastInterruptResources_t;
 
 #define INTERRUPT_IOSPACE(Resources, Index)     Resources->ResourceTable->IoResources[Index]
@@ -109,8 +110,39 @@ typedef struct _DeviceInterrupt {
     // Read-Only
     uintptr_t                       MsiAddress;     // INTERRUPT_MSI - The address of MSI
     uintptr_t                       MsiValue;       // INTERRUPT_MSI - The value of MSI
+
+    // INTERRUPT_MSI - Mapped address of the MSI-X table entry, must be inside an acquired
+    // io-space. The system then programs the entry, and can move the vector between cores.
+    uintptr_t                       MsiXEntry;
 } DeviceInterrupt_t;
 
+/* InterruptStatistics
+ * Per-registration statistics of the interrupt event channel. Latencies are measured
+ * from the first interrupt of an event until the driver thread picks it up, and are
+ * given in performance ticks (see QueryPerformanceFrequency). */
+typedef struct _InterruptStatistics {
+    size_t                          Raised;         // Interrupts raised for the registration
+    size_t                          Coalesced;      // Interrupts merged into an already pending event
+    size_t                          Delivered;      // Events picked up by the driver
+    uint64_t                        LatencyTotal;   // Accumulated interrupt-to-handler latency
+    uint64_t                        LatencyMax;     // Worst interrupt-to-handler latency
+
+    // The vector is shared by all registrations on it
+    int                             Vector;         // Vector the interrupt is delivered on
+    UUId_t                          Core;           // Core the vector targets, UUID_INVALID for any core
+    size_t                          VectorCount;    // Interrupts handled on the vector
+    size_t                          VectorRate;     // Interrupts per second on the vector
+} InterruptStatistics_t;
+
+/* InterruptCoreStatistics
+ * Device interrupt load of a single core. Rates are sampled by the interrupt balancer and are
+ * given in interrupts per second. */
+typedef struct _InterruptCoreStatistics {
+    size_t                          Interrupts;     // Interrupts handled by the core
+    size_t                          Rate;           // Interrupts per second
+    int                             Vectors;        // Vectors that target the core
+} InterruptCoreStatistics_t;
+
 /* RegisterFastInterruptHandler
  * Registers a fast interrupt handler associated with the interrupt. */
 DDKDECL(void,
@@ -155,4 +187,55 @@ DDKDECL(OsStatus_t,
 UnregisterInterruptSource(
     _In_ UUId_t             Source));
 
+/* WaitForInterrupt
+ * Waits for an interrupt event on the given interrupt source, interrupts that occur
+ * while an event is pending are coalesced and the number of them is returned in <EventsOut>.
+ * Returns OsTimeout on time-out and OsError if the source was unregistered. */
+DDKDECL(OsStatus_t,
+WaitForInterrupt(
+    _In_  UUId_t            Source,
+    _In_  size_t            Timeout,
+    _Out_ size_t*           EventsOut));
+
+/* GetInterruptStatistics
+ * Retrieves the event channel statistics for the given interrupt source. */
+DDKDECL(OsStatus_t,
+GetInterruptStatistics(
+    _In_  UUId_t                 Source,
+    _Out_ InterruptStatistics_t* Statistics));
+
+/* GetInterruptCoreStatistics
+ * Retrieves the device interrupt load of the given core. */
+DDKDECL(OsStatus_t,
+GetInterruptCoreStatistics(
+    _In_  UUId_t                     CoreId,
+    _Out_ InterruptCoreStatistics_t* Statistics));
+
+/* SetInterruptAffinity
+ * Pins the vector of the interrupt source to the given core, the balancer will no longer move
+ * it. Passing UUID_INVALID returns the vector to the balancer. */
+DDKDECL(OsStatus_t,
+SetInterruptAffinity(
+    _In_ UUId_t             Source,
+    _In_ UUId_t             CoreId));
+
+/* SetInterruptEventHandler
+ * Installs the handler that is invoked from the interrupt event threads, this is done
+ * by the module runtime before any interrupt sources are registered. */
+DDKDECL(void,
+SetInterruptEventHandler(
+    _In_ InterruptStatus_t (*Handler)(void*, size_t, size_t, size_t)));
+
+/* AcquireDriverLock
+ * Serialises the driver callbacks. The module runtime holds it around OnLoad, OnRegister,
+ * OnUnregister, OnQuery and OnUnload, and the interrupt event threads around OnInterrupt,
+ * so drivers keep seeing one callback at a time. The lock is recursive. */
+DDKDECL(void,
+AcquireDriverLock(void));
+
+/* ReleaseDriverLock
+ * Releases the lock taken by AcquireDriverLock. */
+DDKDECL(void,
+ReleaseDriverLock(void));
+
 #endif //!_INTERRUPT_INTERFACE_H_
@@ -54,6 +54,17 @@ ReadPipe(
     _In_ void*  Buffer,
     _In_ size_t Length));
 
+/* ReadPipeAvailable
+ * Reads up to <Length> bytes from a raw pipe in a single call. This blocks until
+ * atleast one byte is available and returns the number of bytes read in <BytesRead>. */
+DDKDECL(
+OsStatus_t,
+ReadPipeAvailable(
+    _In_  UUId_t  Handle,
+    _In_  void*   Buffer,
+    _In_  size_t  Length,
+    _Out_ size_t* BytesRead));
+
 /* WritePipe
  * Writes the provided data by length to the pipe handle. */
 DDKDECL(
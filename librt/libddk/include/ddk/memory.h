@@ -40,6 +40,14 @@ CreateMemorySpace(
     _In_  Flags_t Flags,
     _Out_ UUId_t* Handle));
 
+/* ForkMemorySpace
+ * Creates a copy of the code and heap of the source memory space. The memory is shared
+ * copy-on-write, so the copy is cheap and remains unaffected by later writes to the source. */
+DDKDECL(OsStatus_t,
+ForkMemorySpace(
+    _In_  UUId_t  Source,
+    _Out_ UUId_t* Handle));
+
 /* GetMemorySpaceForThread
  * Retrieves the memory space that is currently running for the thread handle. */
 DDKDECL(OsStatus_t,
@@ -80,6 +80,9 @@ PACKED_TYPESTRUCT(UsbHcEndpointDescriptor, {
 	size_t                              MaxPacketSize;
 	size_t                              Bandwidth;
 	size_t                              Interval;
+	size_t                              MaxBurst;       // SuperSpeed only
+	size_t                              MaxStreams;     // SuperSpeed bulk only
+	size_t                              PipeUsage;      // Class specific pipe id, 0 if not described
 });
 
 /* UsbHcInterfaceVersion 
@@ -87,6 +90,8 @@ PACKED_TYPESTRUCT(UsbHcEndpointDescriptor, {
 PACKED_TYPESTRUCT(UsbHcInterfaceVersion, {
 	int                                 Id;
 	int                                 EndpointCount;
+	size_t                              Protocol;       // Protocol of the interface in this setting
+	int                                 EndpointIndex;  // Index of the first endpoint of this setting
 });
 
 /* UsbHcInterface 
@@ -189,7 +194,8 @@ typedef enum _UsbTransferStatus {
 	TransferInvalidToggles,
     TransferBufferError,
 	TransferNAK,
-	TransferBabble
+	TransferBabble,
+    TransferCancelled
 } UsbTransferStatus_t;
 
 /* UsbTransaction
@@ -220,6 +226,8 @@ PACKED_TYPESTRUCT(UsbTransfer, {
 
 	// Endpoint Information
 	UsbHcEndpointDescriptor_t           Endpoint;
+	size_t                              StreamId;       // 0 if the endpoint has no streams
+    UsbPacket_t                         SetupPacket;    // Copy of the setup stage if USB_TRANSFER_SETUP_INLINE
 
 	// Periodic Information
     const void*                         PeriodicData;
@@ -230,6 +238,7 @@ PACKED_TYPESTRUCT(UsbTransfer, {
  * Bit-definitions and declarations for the field. */
 #define USB_TRANSFER_NO_NOTIFICATION    0x00000001
 #define USB_TRANSFER_SHORT_NOT_OK       0x00000002
+#define USB_TRANSFER_SETUP_INLINE       0x00000004 // Set by UsbTransferQueue, SetupPacket is valid
 
 /* UsbTransferResult
  * Describes the result of an usb-transfer */
@@ -351,6 +360,17 @@ UsbTransferDequeuePeriodic(
 	_In_ UUId_t                     Device,
 	_In_ UUId_t                     TransferId);
 
+/* UsbTransferCancel
+ * Cancels a control or bulk transfer that is still pending on the controller. The transfer
+ * is matched by its target, stream and first buffer, and the caller waiting for it is
+ * answered with TransferCancelled. Returns TransferInvalid if no pending transfer matched. */
+__EXTERN
+UsbTransferStatus_t
+UsbTransferCancel(
+	_In_ UUId_t                     Driver,
+	_In_ UUId_t                     Device,
+	_In_ UsbTransfer_t*             Transfer);
+
 /* UsbHubResetPort
  * Resets the given port on the given hub and queries it's
  * status afterwards. This returns an updated status of the port after
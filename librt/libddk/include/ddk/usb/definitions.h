@@ -144,6 +144,7 @@ PACKED_TYPESTRUCT(UsbPacket, {
 #define USB_DESCRIPTOR_DEV_CAPS         0x10
 #define USB_DESCRIPTOR_SS_EP_CPN        0x30
 #define USB_DESCRIPTOR_SS_ISO_EP_CPN    0x31
+#define USB_DESCRIPTOR_PIPE_USAGE       0x24    //Pipe Usage (Class specific)
 
 /* UsbPacket Definitions
  * Contains the common feature code numbers */
@@ -231,6 +232,32 @@ PACKED_TYPESTRUCT(UsbEndpointDescriptor, {
 #define USB_ENDPOINT_ATTRIBUTES_SYNC(Attributes)    ((UsbEndpointSynchronization_t)((Attributes >> 2) & 0x3))
 #define USB_ENDPOINT_ATTRIBUTES_FEEDBACK            0x10
 
+/* UsbSsEndpointCompanionDescriptor (Shared)
+ * Follows each endpoint descriptor of a superspeed device and describes the
+ * bursting and streams of the endpoint */
+PACKED_TYPESTRUCT(UsbSsEndpointCompanionDescriptor, {
+    uint8_t             Length;             // Header - Length
+    uint8_t             Type;               // Header - Type
+
+    uint8_t             MaxBurst;           // Number of packets per burst - 1
+    uint8_t             Attributes;         // Bulk: log2(max streams), Isoc: Mult
+    uint16_t            BytesPerInterval;   // Periodic endpoints only
+});
+
+#define USB_SS_COMPANION_MAXSTREAMS(Attributes)     (Attributes & 0x1F)
+#define USB_SS_COMPANION_MULT(Attributes)           (Attributes & 0x3)
+
+/* UsbPipeUsageDescriptor (Shared)
+ * Follows the endpoint descriptors of interfaces that assign fixed roles to
+ * their pipes, like the usb attached scsi interface */
+PACKED_TYPESTRUCT(UsbPipeUsageDescriptor, {
+    uint8_t             Length;             // Header - Length
+    uint8_t             Type;               // Header - Type
+
+    uint8_t             PipeId;             // Class specific role of the pipe
+    uint8_t             Reserved;
+});
+
 /* UsbStringDescriptor (Shared)
  * Contains the structure of the string-descriptor returned 
  * by an usb device */
@@ -0,0 +1,87 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Usb Human Input Device Report Decoding
+ * - Describes the precompiled report fields and how values are extracted
+ *   from a report, shared by the hid driver and its tests
+ */
+
+#ifndef _USB_HID_REPORT_H_
+#define _USB_HID_REPORT_H_
+
+#include <ddk/ddkdefs.h>
+#include <os/input.h>
+
+/* HidReportField
+ * A precompiled input field, generated once from the collection tree when the
+ * device is set up. Each field describes exactly one value in a report, with
+ * the byte location, shift and mask precomputed so decoding is a single pass. */
+typedef struct _HidReportField {
+    size_t                          ByteOffset;
+    size_t                          ByteCount;
+    uint32_t                        Shift;
+    uint32_t                        Size;
+    uint32_t                        Mask;
+    int                             ReportId;
+    int                             Handler;
+    int                             Index;
+    int                             Flags;
+    int                             Signed;
+    DeviceInputType_t               InputType;
+} HidReportField_t;
+
+/* HidSetFieldLocation
+ * Computes the byte location of a field that starts at the given bit offset in the
+ * report. Fields need not be byte aligned, so the bytes spanned include the shift. */
+static inline void
+HidSetFieldLocation(
+    _In_ HidReportField_t *Field,
+    _In_ size_t BitOffset,
+    _In_ size_t Length)
+{
+    Field->ByteOffset = BitOffset / 8;
+    Field->Shift      = (uint32_t)(BitOffset % 8);
+    Field->ByteCount  = (Field->Shift + Length + 7) / 8;
+    Field->Size       = (uint32_t)Length;
+    Field->Mask       = (Length == 32) ? 0xFFFFFFFF : ((1U << Length) - 1);
+}
+
+/* HidLoadField
+ * Extracts the unsigned value of a compiled field from the report data. */
+static inline uint32_t
+HidLoadField(
+    _In_ const uint8_t *Data,
+    _In_ HidReportField_t *Field)
+{
+    uint64_t Raw = 0;
+    size_t i;
+
+    for (i = 0; i < Field->ByteCount; i++) {
+        Raw |= (uint64_t)Data[Field->ByteOffset + i] << (i * 8);
+    }
+    return (uint32_t)(Raw >> Field->Shift) & Field->Mask;
+}
+
+/* HidReportField::Handler
+ * Describes what the field value should be applied to in the input event. */
+#define HID_FIELD_AXIS_X                    0x0
+#define HID_FIELD_AXIS_Y                    0x1
+#define HID_FIELD_AXIS_Z                    0x2
+#define HID_FIELD_BUTTON                    0x3
+
+#endif //!_USB_HID_REPORT_H_
@@ -120,6 +120,14 @@ DDKDECL(OsStatus_t,
 WriteSystemInput(
     _In_ SystemInput_t* Input));
 
+/* WriteSystemInputs
+ * Batched version of WriteSystemInput, all the inputs are written to the system's
+ * standard input in a single operation. */
+DDKDECL(OsStatus_t,
+WriteSystemInputs(
+    _In_ SystemInput_t* Inputs,
+    _In_ size_t         Count));
+
 /* WriteSystemKey
  * Notifies the operating system of new key-event, this key is written to the system's
  * standard input, which is then sent to the window-manager if present. */
@@ -127,6 +135,22 @@ DDKDECL(OsStatus_t,
 WriteSystemKey(
     _In_ SystemKey_t* Key));
 
+/* WriteSystemKeys
+ * Batched version of WriteSystemKey, all the keys are written to the system's
+ * standard input in a single operation. */
+DDKDECL(OsStatus_t,
+WriteSystemKeys(
+    _In_ SystemKey_t* Keys,
+    _In_ size_t       Count));
+
+/* GetInputStatistics
+ * Retrieves the delivery statistics of key events and input events to the system's
+ * input pipes, either of the pointers can be NULL. */
+DDKDECL(OsStatus_t,
+GetInputStatistics(
+    _Out_ InputStatistics_t* Keys,
+    _Out_ InputStatistics_t* Inputs));
+
 _CODE_END
 
 #endif //!_UTILS_INTERFACE_H_
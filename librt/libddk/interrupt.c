@@ -22,7 +22,84 @@
  */
 
 #include <internal/_syscalls.h>
+#include <ddk/device.h>
 #include <ddk/driver.h>
+#include <threads.h>
+#include <stdlib.h>
+
+#define PCI_COMMAND_REGISTER        0x04
+#define PCI_COMMAND_INTX_DISABLE    (1 << 10)
+#define PCI_BAR_REGISTER(Index)     (0x10 + ((Index) << 2))
+#define PCI_BAR_64BIT               0x4
+
+#define PCI_MSI_ENABLE              (1 << 0)
+#define PCI_MSI_MULTIPLE_ENABLE     0x70
+#define PCI_MSI_64BIT               (1 << 7)
+
+#define PCI_MSIX_TABLE_SIZE(Control) (((Control) & 0x7FF) + 1)
+#define PCI_MSIX_FUNCTION_MASK      (1 << 14)
+#define PCI_MSIX_ENABLE             (1 << 15)
+#define PCI_MSIX_ENTRY_SIZE         16
+
+typedef struct _InterruptEventContext {
+    struct _InterruptEventContext* Link;
+    UUId_t                         Source;
+    void*                          Context;
+    int                            Removed;
+} InterruptEventContext_t;
+
+static InterruptStatus_t (*InterruptEventHandler)(void*, size_t, size_t, size_t) = NULL;
+static InterruptEventContext_t* InterruptEventContexts = NULL;
+static mtx_t                    DriverLock;
+static int                      DriverLockInitialized  = 0;
+
+/* InterruptEventUnlink
+ * Removes the event context from the list of active sources, the driver lock is held. */
+static void
+InterruptEventUnlink(
+    _In_ InterruptEventContext_t* EventContext)
+{
+    InterruptEventContext_t** Iterator = &InterruptEventContexts;
+    while (*Iterator != NULL) {
+        if (*Iterator == EventContext) {
+            *Iterator = EventContext->Link;
+            break;
+        }
+        Iterator = &(*Iterator)->Link;
+    }
+}
+
+/* InterruptEventThread
+ * Dedicated thread for an interrupt source, waits on the interrupt event and invokes
+ * the event handler for each (possibly coalesced) event. Exits when the source is removed. */
+static int
+InterruptEventThread(
+    _In_ void* Argument)
+{
+    InterruptEventContext_t* EventContext = (InterruptEventContext_t*)Argument;
+    size_t                   Events;
+
+    // The handler runs under the driver lock like every other driver callback. A
+    // source unregistered while we waited for the lock must not be delivered, its
+    // context may already be gone
+    while (WaitForInterrupt(EventContext->Source, 0, &Events) == OsSuccess) {
+        AcquireDriverLock();
+        if (EventContext->Removed) {
+            ReleaseDriverLock();
+            break;
+        }
+        InterruptEventHandler(EventContext->Context, Events, 0, 0);
+        ReleaseDriverLock();
+    }
+
+    AcquireDriverLock();
+    if (!EventContext->Removed) {
+        InterruptEventUnlink(EventContext);
+    }
+    ReleaseDriverLock();
+    free(EventContext);
+    return 0;
+}
 
 /* RegisterFastInterruptHandler
  * Registers a fast interrupt handler associated with the interrupt. */
@@ -88,11 +165,217 @@ RegisterInterruptSource(
     _In_ DeviceInterrupt_t* Interrupt,
     _In_ Flags_t            Flags)
 {
+    InterruptEventContext_t* EventContext;
+    UUId_t                   Source;
+    thrd_t                   Thread;
+
 	// Sanitize input
 	if (Interrupt == NULL) {
 		return UUID_INVALID;
 	}
-	return Syscall_InterruptAdd(Interrupt, Flags);
+
+    Source = Syscall_InterruptAdd(Interrupt, Flags);
+    if (Source == UUID_INVALID || !(Flags & INTERRUPT_USERSPACE) || InterruptEventHandler == NULL) {
+        return Source;
+    }
+
+    // Userspace notifications are delivered through the event channel of the
+    // interrupt, spawn the thread that waits for them
+    EventContext = (InterruptEventContext_t*)malloc(sizeof(InterruptEventContext_t));
+    if (EventContext != NULL) {
+        EventContext->Source  = Source;
+        EventContext->Context = Interrupt->Context;
+        EventContext->Removed = 0;
+
+        AcquireDriverLock();
+        EventContext->Link     = InterruptEventContexts;
+        InterruptEventContexts = EventContext;
+        if (thrd_create(&Thread, InterruptEventThread, EventContext) == thrd_success) {
+            ReleaseDriverLock();
+            thrd_detach(Thread);
+            return Source;
+        }
+        InterruptEventUnlink(EventContext);
+        ReleaseDriverLock();
+        free(EventContext);
+    }
+    Syscall_InterruptRemove(Source);
+    return UUID_INVALID;
+}
+
+/* MessageInterruptsDisableLegacy
+ * A function using messages must not assert its interrupt pin, disable it to be sure. */
+static void
+MessageInterruptsDisableLegacy(
+    _In_ MCoreDevice_t* Device)
+{
+    Flags_t Command = 0;
+    if (IoctlDeviceEx(Device->Id, 0, PCI_COMMAND_REGISTER, &Command, 2) == OsSuccess) {
+        Command |= PCI_COMMAND_INTX_DISABLE;
+        IoctlDeviceEx(Device->Id, 1, PCI_COMMAND_REGISTER, &Command, 2);
+    }
+}
+
+/* MessageInterruptsFindTable
+ * Locates the mapped address of the MSI-X table, the table lives in one of the memory bars
+ * that must have been acquired by the driver. Returns 0 if it's not mapped. */
+static uintptr_t
+MessageInterruptsFindTable(
+    _In_ MCoreDevice_t* Device,
+    _In_ Flags_t        TableInfo)
+{
+    Flags_t  Bar      = 0;
+    Flags_t  BarUpper = 0;
+    uint64_t Physical;
+    int      i;
+
+    if (IoctlDeviceEx(Device->Id, 0, PCI_BAR_REGISTER(TableInfo & 0x7), &Bar, 4) != OsSuccess) {
+        return 0;
+    }
+    Physical = Bar & ~0xF;
+    if ((Bar & PCI_BAR_64BIT) && (TableInfo & 0x7) < 5) {
+        if (IoctlDeviceEx(Device->Id, 0, PCI_BAR_REGISTER((TableInfo & 0x7) + 1), &BarUpper, 4) != OsSuccess) {
+            return 0;
+        }
+        Physical |= ((uint64_t)BarUpper << 32);
+    }
+
+    // Bars are stored by their address, as 64 bit bars take up two indices
+    for (i = 0; i < __DEVICEMANAGER_MAX_IOSPACES; i++) {
+        if (Device->IoSpaces[i].Type == DeviceIoMemoryBased
+            && (uint64_t)Device->IoSpaces[i].Access.Memory.PhysicalBase == Physical
+            && Device->IoSpaces[i].Access.Memory.VirtualBase != 0) {
+            return Device->IoSpaces[i].Access.Memory.VirtualBase + (TableInfo & ~0x7);
+        }
+    }
+    return 0;
+}
+
+/* MessageInterruptsEnableMsiX
+ * Registers a vector for each interrupt, the system programs the table entries itself, and
+ * enables the capability. */
+static OsStatus_t
+MessageInterruptsEnableMsiX(
+    _In_    MCoreDevice_t*     Device,
+    _In_    DeviceInterrupt_t* Interrupts,
+    _In_    Flags_t            Flags,
+    _InOut_ int*               Count,
+    _Out_   UUId_t*            Sources)
+{
+    Flags_t   Capability = Device->MsiXCapability;
+    Flags_t   Control    = 0;
+    Flags_t   TableInfo  = 0;
+    uintptr_t Table;
+    int       i;
+
+    if (IoctlDeviceEx(Device->Id, 0, Capability + 2, &Control, 2) != OsSuccess ||
+        IoctlDeviceEx(Device->Id, 0, Capability + 4, &TableInfo, 4) != OsSuccess) {
+        return OsError;
+    }
+
+    Table = MessageInterruptsFindTable(Device, TableInfo);
+    if (Table == 0) {
+        return OsNotSupported;
+    }
+
+    *Count = MIN(*Count, (int)PCI_MSIX_TABLE_SIZE(Control));
+    for (i = 0; i < *Count; i++) {
+        Interrupts[i].MsiXEntry = Table + (i * PCI_MSIX_ENTRY_SIZE);
+        Sources[i]              = RegisterInterruptSource(&Interrupts[i], Flags | INTERRUPT_MSI);
+        if (Sources[i] == UUID_INVALID) {
+            while (i--) {
+                UnregisterInterruptSource(Sources[i]);
+            }
+            return OsError;
+        }
+    }
+
+    Control = (Control & ~PCI_MSIX_FUNCTION_MASK) | PCI_MSIX_ENABLE;
+    if (IoctlDeviceEx(Device->Id, 1, Capability + 2, &Control, 2) != OsSuccess) {
+        for (i = 0; i < *Count; i++) {
+            UnregisterInterruptSource(Sources[i]);
+        }
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+/* MessageInterruptsEnableMsi
+ * Registers a single vector and programs the message of it. Multiple messages are not used
+ * as they must share the destination core. */
+static OsStatus_t
+MessageInterruptsEnableMsi(
+    _In_  MCoreDevice_t*     Device,
+    _In_  DeviceInterrupt_t* Interrupt,
+    _In_  Flags_t            Flags,
+    _Out_ UUId_t*            Source)
+{
+    Flags_t Capability = Device->MsiCapability;
+    Flags_t Control    = 0;
+    Flags_t Address;
+    Flags_t Value;
+    Flags_t Zero       = 0;
+
+    if (IoctlDeviceEx(Device->Id, 0, Capability + 2, &Control, 2) != OsSuccess) {
+        return OsError;
+    }
+
+    Interrupt->MsiXEntry = 0;
+    *Source = RegisterInterruptSource(Interrupt, Flags | INTERRUPT_MSI);
+    if (*Source == UUID_INVALID) {
+        return OsError;
+    }
+
+    Address = LODWORD(Interrupt->MsiAddress);
+    Value   = Interrupt->MsiValue & 0xFFFF;
+    IoctlDeviceEx(Device->Id, 1, Capability + 4, &Address, 4);
+    if (Control & PCI_MSI_64BIT) {
+        IoctlDeviceEx(Device->Id, 1, Capability + 8, &Zero, 4);
+        IoctlDeviceEx(Device->Id, 1, Capability + 0xC, &Value, 2);
+    }
+    else {
+        IoctlDeviceEx(Device->Id, 1, Capability + 8, &Value, 2);
+    }
+
+    Control = (Control & ~PCI_MSI_MULTIPLE_ENABLE) | PCI_MSI_ENABLE;
+    if (IoctlDeviceEx(Device->Id, 1, Capability + 2, &Control, 2) != OsSuccess) {
+        UnregisterInterruptSource(*Source);
+        *Source = UUID_INVALID;
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+/* RegisterMessageInterrupts
+ * Registers message signaled interrupts for the device, MSI-X is preferred over MSI. */
+OsStatus_t
+RegisterMessageInterrupts(
+    _In_    MCoreDevice_t*     Device,
+    _In_    DeviceInterrupt_t* Interrupts,
+    _In_    Flags_t            Flags,
+    _InOut_ int*               Count,
+    _Out_   UUId_t*            Sources)
+{
+    OsStatus_t Status = OsNotSupported;
+
+    if (Device == NULL || Interrupts == NULL || Count == NULL || *Count <= 0 || Sources == NULL) {
+        return OsInvalidParameters;
+    }
+
+    if (Device->MsiXCapability != 0) {
+        Status = MessageInterruptsEnableMsiX(Device, Interrupts, Flags, Count, Sources);
+    }
+    if (Status != OsSuccess && Device->MsiCapability != 0) {
+        *Count = 1;
+        Status = MessageInterruptsEnableMsi(Device, &Interrupts[0], Flags, &Sources[0]);
+    }
+
+    if (Status != OsSuccess) {
+        *Count = 0;
+        return Status;
+    }
+    MessageInterruptsDisableLegacy(Device);
+    return OsSuccess;
 }
 
 /* UnregisterInterruptSource 
@@ -102,9 +385,110 @@ OsStatus_t
 UnregisterInterruptSource(
     _In_ UUId_t             Source)
 {
+    InterruptEventContext_t* EventContext;
+
 	// Sanitize input
 	if (Source == UUID_INVALID) {
 		return OsError;
 	}
+
+    // Stop delivery before the source is removed, the event thread cleans up
+    // the context once it notices
+    AcquireDriverLock();
+    for (EventContext = InterruptEventContexts; EventContext != NULL; EventContext = EventContext->Link) {
+        if (EventContext->Source == Source) {
+            EventContext->Removed = 1;
+            InterruptEventUnlink(EventContext);
+            break;
+        }
+    }
+    ReleaseDriverLock();
 	return Syscall_InterruptRemove(Source);
 }
+
+/* WaitForInterrupt
+ * Waits for an interrupt event on the given interrupt source, interrupts that occur
+ * while an event is pending are coalesced and the number of them is returned in <EventsOut>. */
+OsStatus_t
+WaitForInterrupt(
+    _In_  UUId_t  Source,
+    _In_  size_t  Timeout,
+    _Out_ size_t* EventsOut)
+{
+    if (Source == UUID_INVALID || EventsOut == NULL) {
+        return OsInvalidParameters;
+    }
+    return Syscall_WaitForInterrupt(Source, Timeout, EventsOut);
+}
+
+/* GetInterruptStatistics
+ * Retrieves the event channel statistics for the given interrupt source. */
+OsStatus_t
+GetInterruptStatistics(
+    _In_  UUId_t                 Source,
+    _Out_ InterruptStatistics_t* Statistics)
+{
+    if (Source == UUID_INVALID || Statistics == NULL) {
+        return OsInvalidParameters;
+    }
+    return Syscall_GetInterruptStatistics(Source, Statistics);
+}
+
+/* GetInterruptCoreStatistics
+ * Retrieves the device interrupt load of the given core. */
+OsStatus_t
+GetInterruptCoreStatistics(
+    _In_  UUId_t                     CoreId,
+    _Out_ InterruptCoreStatistics_t* Statistics)
+{
+    if (CoreId == UUID_INVALID || Statistics == NULL) {
+        return OsInvalidParameters;
+    }
+    return Syscall_GetInterruptCoreStatistics(CoreId, Statistics);
+}
+
+/* SetInterruptAffinity
+ * Pins the vector of the interrupt source to the given core, or returns it to the balancer. */
+OsStatus_t
+SetInterruptAffinity(
+    _In_ UUId_t Source,
+    _In_ UUId_t CoreId)
+{
+    if (Source == UUID_INVALID) {
+        return OsInvalidParameters;
+    }
+    return Syscall_SetInterruptAffinity(Source, CoreId);
+}
+
+/* SetInterruptEventHandler
+ * Installs the handler that is invoked from the interrupt event threads. */
+void
+SetInterruptEventHandler(
+    _In_ InterruptStatus_t (*Handler)(void*, size_t, size_t, size_t))
+{
+    if (!DriverLockInitialized) {
+        mtx_init(&DriverLock, mtx_recursive);
+        DriverLockInitialized = 1;
+    }
+    InterruptEventHandler = Handler;
+}
+
+/* AcquireDriverLock
+ * Serialises the driver callbacks. */
+void
+AcquireDriverLock(void)
+{
+    if (DriverLockInitialized) {
+        mtx_lock(&DriverLock);
+    }
+}
+
+/* ReleaseDriverLock
+ * Releases the lock taken by AcquireDriverLock. */
+void
+ReleaseDriverLock(void)
+{
+    if (DriverLockInitialized) {
+        mtx_unlock(&DriverLock);
+    }
+}
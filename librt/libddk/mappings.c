@@ -37,6 +37,19 @@ CreateMemorySpace(
     return Syscall_CreateMemorySpace(Flags, Handle);
 }
 
+/* ForkMemorySpace
+ * Creates a copy of the code and heap of the source memory space, the memory is shared copy-on-write. */
+OsStatus_t
+ForkMemorySpace(
+    _In_  UUId_t  Source,
+    _Out_ UUId_t* Handle)
+{
+    if (Handle == NULL) {
+        return OsError;
+    }
+    return Syscall_ForkMemorySpace(Source, Handle);
+}
+
 /* GetMemorySpaceForThread
  * Retrieves the memory space that is currently running for the thread handle. */
 OsStatus_t
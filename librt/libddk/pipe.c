@@ -51,7 +51,20 @@ ReadPipe(
 {
     assert(Buffer != NULL);
     assert(Length > 0);
-	return Syscall_ReadPipe(Handle, Buffer, Length);
+	return Syscall_ReadPipe(Handle, Buffer, Length, NULL);
+}
+
+OsStatus_t
+ReadPipeAvailable(
+    _In_  UUId_t  Handle,
+    _In_  void*   Buffer,
+    _In_  size_t  Length,
+    _Out_ size_t* BytesRead)
+{
+    assert(Buffer != NULL);
+    assert(Length > 0);
+    assert(BytesRead != NULL);
+	return Syscall_ReadPipe(Handle, Buffer, Length, BytesRead);
 }
 
 OsStatus_t
@@ -56,7 +56,17 @@ WriteSystemInput(
     _In_ SystemInput_t* Input)
 {
     assert(Input != NULL);
-    return Syscall_InputEvent(Input);
+    return Syscall_InputEvent(Input, 1);
+}
+
+OsStatus_t
+WriteSystemInputs(
+    _In_ SystemInput_t* Inputs,
+    _In_ size_t         Count)
+{
+    assert(Inputs != NULL);
+    assert(Count > 0);
+    return Syscall_InputEvent(Inputs, Count);
 }
 
 OsStatus_t
@@ -64,7 +74,28 @@ WriteSystemKey(
     _In_ SystemKey_t* Key)
 {
     assert(Key != NULL);
-    return Syscall_KeyEvent(Key);
+    return Syscall_KeyEvent(Key, 1);
+}
+
+OsStatus_t
+WriteSystemKeys(
+    _In_ SystemKey_t* Keys,
+    _In_ size_t       Count)
+{
+    assert(Keys != NULL);
+    assert(Count > 0);
+    return Syscall_KeyEvent(Keys, Count);
+}
+
+OsStatus_t
+GetInputStatistics(
+    _Out_ InputStatistics_t* Keys,
+    _Out_ InputStatistics_t* Inputs)
+{
+    if (Keys == NULL && Inputs == NULL) {
+        return OsInvalidParameters;
+    }
+    return Syscall_GetInputStatistics(Keys, Inputs);
 }
 
 OsStatus_t
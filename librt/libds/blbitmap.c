@@ -134,6 +134,45 @@ AllocateBlocksInBlockmap(
     return Block;
 }
 
+/* AllocateAlignedBlocksInBlockmap
+ * Allocates a number of bytes in the bitmap (rounded up in blocks) where the start of the
+ * allocation is aligned to the given alignment, which must be a multiple of the block size */
+uintptr_t
+AllocateAlignedBlocksInBlockmap(
+    _In_ BlockBitmap_t* Blockmap,
+    _In_ size_t         AllocationMask,
+    _In_ size_t         Size,
+    _In_ size_t         Alignment)
+{
+    uintptr_t Block = 0;
+    size_t    BitCount;
+    size_t    BitStep;
+    size_t    Index;
+    
+    assert(Blockmap != NULL);
+    assert(Size > 0);
+    assert(Alignment >= Blockmap->BlockSize && (Alignment % Blockmap->BlockSize) == 0);
+
+    // Calculate number of bits, and the first aligned index
+    BitCount = DIVUP(Size, Blockmap->BlockSize);
+    BitStep  = Alignment / Blockmap->BlockSize;
+    Index    = ((DIVUP(Blockmap->BlockStart, Alignment) * Alignment) - Blockmap->BlockStart) / Blockmap->BlockSize;
+
+    // Locked operation
+    dslock(&Blockmap->SyncObject);
+    for (; Index + BitCount <= Blockmap->BlockCount; Index += BitStep) {
+        if (BitmapAreBitsClear(&Blockmap->Base, (int)Index, (int)BitCount)) {
+            BitmapSetBits(&Blockmap->Base, NULL, (int)Index, (int)BitCount);
+            Block = Blockmap->BlockStart + (uintptr_t)(Index * Blockmap->BlockSize);
+            Blockmap->BlocksAllocated += BitCount;
+            Blockmap->NumAllocations++;
+            break;
+        }
+    }
+    dsunlock(&Blockmap->SyncObject);
+    return Block;
+}
+
 /* ReserveBlockmapRegion
  * Reserves a region of the blockmap. This sets the given region to allocated. The
  * region and size must be within boundaries of the blockmap. */
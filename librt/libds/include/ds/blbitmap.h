@@ -111,6 +111,16 @@ AllocateBlocksInBlockmap(
     _In_ size_t         AllocationMask,
     _In_ size_t         Size));
 
+/* AllocateAlignedBlocksInBlockmap
+ * Allocates a number of bytes in the bitmap (rounded up in blocks) where the start of the
+ * allocation is aligned to the given alignment, which must be a multiple of the block size */
+CRTDECL(uintptr_t,
+AllocateAlignedBlocksInBlockmap(
+    _In_ BlockBitmap_t* Blockmap,
+    _In_ size_t         AllocationMask,
+    _In_ size_t         Size,
+    _In_ size_t         Alignment));
+
 /* ReserveBlockmapRegion
  * Reserves a region of the blockmap. This sets the given region to allocated. The
  * region and size must be within boundaries of the blockmap. */
@@ -38,6 +38,7 @@ typedef struct _SectionMapping {
     uint8_t*          BasePointer;
     uintptr_t         RVA;
     size_t            Size;
+    Flags_t           Flags;
 } SectionMapping_t;
 
 #define OFFSET_IN_SECTION(Section, _RVA) (uintptr_t)(Section->BasePointer + ((_RVA) - Section->RVA))
@@ -198,6 +199,7 @@ PeHandleSections(
         SectionHandles[i].BasePointer = Destination;
         SectionHandles[i].RVA         = Section->VirtualAddress;
         SectionHandles[i].Size        = SectionSize;
+        SectionHandles[i].Flags       = PageFlags;
 
         // Store first code segment we encounter
         if (Section->Flags & PE_SECTION_CODE) {
@@ -536,6 +538,7 @@ PeHandleExports(
         ExFunc->Name         = NameBuffer;
         FunctionNameLengths += FunctionLength;
     }
+    Image->ExportedFunctionNamesLength = FunctionNameLengths;
     return OsSuccess;
 }
 
@@ -564,6 +567,34 @@ PeHandleImports(
     return OsSuccess;
 }
 
+/* PeSnapshotRegion
+ * Records the final contents of a mapped region if the root image is being snapshotted.
+ * Must be called just before the mapping is released. */
+static void
+PeSnapshotRegion(
+    _In_ PeExecutable_t* Parent,
+    _In_ PeExecutable_t* Image,
+    _In_ uintptr_t       Address,
+    _In_ const void*     Data,
+    _In_ size_t          Length,
+    _In_ Flags_t         Flags)
+{
+    PeExecutable_t*  Root = (Parent == NULL) ? Image : Parent;
+    PeImageRegion_t* Region;
+    DataKey_t        Key = { 0 };
+
+    if (Root->Regions == NULL) {
+        return;
+    }
+
+    Region = (PeImageRegion_t*)dsalloc(sizeof(PeImageRegion_t) + Length);
+    Region->Address = Address;
+    Region->Length  = Length;
+    Region->Flags   = Flags;
+    memcpy(&Region->Data[0], Data, Length);
+    CollectionAppend(Root->Regions, CollectionCreateNode(Key, Region));
+}
+
 static OsStatus_t
 PeParseAndMapImage(
     _In_ PeExecutable_t*    Parent,
@@ -591,6 +622,8 @@ PeParseAndMapImage(
         return OsError;
     }
     memcpy((void*)VirtualAddress, ImageBuffer, SizeOfMetaData);
+    PeSnapshotRegion(Parent, Image, Image->VirtualAddress, (const void*)VirtualAddress,
+        SizeOfMetaData, MEMORY_READ | MEMORY_WRITE);
     ReleaseImageMapping(MapHandle);
 
     // Allocate an array of mappings that we can keep sections in
@@ -651,6 +684,8 @@ PeParseAndMapImage(
     // Free all the section mappings
     for (i = 0; i < SectionCount; i++) {
         if (SectionMappings[i].Handle != NULL) {
+            PeSnapshotRegion(Parent, Image, Image->VirtualAddress + SectionMappings[i].RVA,
+                SectionMappings[i].BasePointer, SectionMappings[i].Size, SectionMappings[i].Flags);
             ReleaseImageMapping(SectionMappings[i].Handle);
         }
     }
@@ -690,11 +725,12 @@ ResolvePeImagePath(
     return PeValidateImageBuffer(Buffer, Length);
 }
 
-OsStatus_t
-PeLoadImage(
+static OsStatus_t
+PeLoadImageInternal(
     _In_  UUId_t           Owner,
     _In_  PeExecutable_t*  Parent,
     _In_  MString_t*       Path,
+    _In_  int              Snapshot,
     _Out_ PeExecutable_t** ImageOut)
 {
     MzHeader_t*           DosHeader;
@@ -788,9 +824,16 @@ PeLoadImage(
     }
 
     if (Parent == NULL) {
+        if (Snapshot) {
+            Image->Regions = CollectionCreate(KeyInteger);
+        }
+
         Status = CreateImageSpace(&Image->MemorySpace);
         if (Status != OsSuccess) {
             dserror("Failed to create pe's memory space");
+            if (Image->Regions != NULL) {
+                CollectionDestroy(Image->Regions);
+            }
             CollectionDestroy(Image->Libraries);
             MStringDestroy(Image->Name);
             MStringDestroy(Image->FullPath);
@@ -814,6 +857,182 @@ PeLoadImage(
     return OsSuccess;
 }
 
+OsStatus_t
+PeLoadImage(
+    _In_  UUId_t           Owner,
+    _In_  PeExecutable_t*  Parent,
+    _In_  MString_t*       Path,
+    _Out_ PeExecutable_t** ImageOut)
+{
+    return PeLoadImageInternal(Owner, Parent, Path, 0, ImageOut);
+}
+
+
+/* PeCloneExecutable
+ * Duplicates the image description and the descriptions of its libraries, the
+ * duplicates describe the same layout but in the given memory space. */
+static PeExecutable_t*
+PeCloneExecutable(
+    _In_ UUId_t              Owner,
+    _In_ PeExecutable_t*     Source,
+    _In_ MemorySpaceHandle_t MemorySpace)
+{
+    PeExecutable_t* Image = (PeExecutable_t*)dsalloc(sizeof(PeExecutable_t));
+    DataKey_t       Key   = { 0 };
+    int             i;
+
+    memcpy(Image, Source, sizeof(PeExecutable_t));
+    Image->Owner       = Owner;
+    Image->Name        = MStringClone(Source->Name);
+    Image->FullPath    = MStringClone(Source->FullPath);
+    Image->MemorySpace = MemorySpace;
+    Image->Libraries   = CollectionCreate(KeyInteger);
+    Image->Regions     = NULL;
+
+    if (Source->ExportedFunctions != NULL) {
+        Image->ExportedFunctions = (PeExportedFunction_t*)dsalloc(
+            sizeof(PeExportedFunction_t) * Source->NumberOfExportedFunctions);
+        memcpy(Image->ExportedFunctions, Source->ExportedFunctions,
+            sizeof(PeExportedFunction_t) * Source->NumberOfExportedFunctions);
+    }
+
+    // Rebase the names of the exports into the new name buffer
+    if (Source->ExportedFunctionNames != NULL) {
+        Image->ExportedFunctionNames = (char*)dsalloc(Source->ExportedFunctionNamesLength);
+        memcpy(Image->ExportedFunctionNames, Source->ExportedFunctionNames,
+            Source->ExportedFunctionNamesLength);
+        for (i = 0; i < Image->NumberOfExportedFunctions; i++) {
+            if (Source->ExportedFunctions[i].Name != NULL) {
+                Image->ExportedFunctions[i].Name = Image->ExportedFunctionNames + 
+                    (Source->ExportedFunctions[i].Name - Source->ExportedFunctionNames);
+            }
+        }
+    }
+
+    foreach(Node, Source->Libraries) {
+        PeExecutable_t* Library = PeCloneExecutable(Owner, (PeExecutable_t*)Node->Data, MemorySpace);
+        CollectionAppend(Image->Libraries, CollectionCreateNode(Key, Library));
+    }
+    return Image;
+}
+
+/* PeDestroyRegions
+ * Frees the recorded region contents of a snapshot. */
+static void
+PeDestroyRegions(
+    _In_ PeExecutable_t* Snapshot)
+{
+    CollectionItem_t* Node;
+    while ((Node = CollectionPopFront(Snapshot->Regions)) != NULL) {
+        dsfree(Node->Data);
+        CollectionDestroyNode(Snapshot->Regions, Node);
+    }
+    CollectionDestroy(Snapshot->Regions);
+    Snapshot->Regions = NULL;
+}
+
+OsStatus_t
+PeLoadImageSnapshot(
+    _In_  UUId_t           Owner,
+    _In_  MString_t*       Path,
+    _Out_ PeExecutable_t** ImageOut,
+    _Out_ PeExecutable_t** SnapshotOut)
+{
+    PeExecutable_t* Image;
+    PeExecutable_t* Snapshot;
+    OsStatus_t      Status;
+
+    Status = PeLoadImageInternal(Owner, NULL, Path, 1, &Image);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    // Move the recorded regions to the snapshot, so libraries loaded into
+    // the image later on are not recorded
+    Snapshot          = PeCloneExecutable(Owner, Image, NULL);
+    Snapshot->Regions = Image->Regions;
+    Image->Regions    = NULL;
+
+    // Keep a copy-on-write copy of the freshly loaded space as template, clones
+    // then share its pages instead of copying the regions. The recorded regions
+    // are only needed if the space can't be forked
+    if (ForkImageSpace(Image->MemorySpace, &Snapshot->MemorySpace) == OsSuccess) {
+        PeDestroyRegions(Snapshot);
+    }
+    else {
+        Snapshot->MemorySpace = NULL;
+    }
+
+    *ImageOut    = Image;
+    *SnapshotOut = Snapshot;
+    return OsSuccess;
+}
+
+OsStatus_t
+PeCloneImage(
+    _In_  UUId_t           Owner,
+    _In_  PeExecutable_t*  Snapshot,
+    _Out_ PeExecutable_t** ImageOut)
+{
+    MemorySpaceHandle_t MemorySpace;
+    MemoryMapHandle_t   MapHandle;
+    OsStatus_t          Status;
+
+    if (Snapshot == NULL || (Snapshot->MemorySpace == NULL && Snapshot->Regions == NULL)) {
+        return OsInvalidParameters;
+    }
+
+    // Share the pages of the template space copy-on-write
+    if (Snapshot->MemorySpace != NULL) {
+        Status = ForkImageSpace(Snapshot->MemorySpace, &MemorySpace);
+        if (Status != OsSuccess) {
+            dserror("Failed to fork pe's memory space");
+            return Status;
+        }
+        *ImageOut = PeCloneExecutable(Owner, Snapshot, MemorySpace);
+        return OsSuccess;
+    }
+
+    Status = CreateImageSpace(&MemorySpace);
+    if (Status != OsSuccess) {
+        dserror("Failed to create pe's memory space");
+        return Status;
+    }
+
+    // The regions already contain the relocated and linked contents, so
+    // recreating the image is a plain copy of each region
+    foreach(Node, Snapshot->Regions) {
+        PeImageRegion_t* Region  = (PeImageRegion_t*)Node->Data;
+        uintptr_t        Address = Region->Address;
+
+        Status = AcquireImageMapping(MemorySpace, &Address, Region->Length, Region->Flags, &MapHandle);
+        if (Status != OsSuccess) {
+            dserror("%s: Failed to map region at 0x%" PRIxIN ": %u",
+                MStringRaw(Snapshot->Name), Region->Address, Status);
+            DestroyImageSpace(MemorySpace);
+            return Status;
+        }
+        memcpy((void*)Address, &Region->Data[0], Region->Length);
+        ReleaseImageMapping(MapHandle);
+    }
+
+    *ImageOut = PeCloneExecutable(Owner, Snapshot, MemorySpace);
+    return OsSuccess;
+}
+
+OsStatus_t
+PeUnloadSnapshot(
+    _In_ PeExecutable_t* Snapshot)
+{
+    if (Snapshot == NULL) {
+        return OsError;
+    }
+    if (Snapshot->MemorySpace != NULL) {
+        DestroyImageSpace(Snapshot->MemorySpace);
+    }
+    return PeUnloadImage(Snapshot);
+}
+
 OsStatus_t
 PeUnloadImage(
     _In_ PeExecutable_t* Image)
@@ -825,6 +1044,12 @@ PeUnloadImage(
         if (Image->ExportedFunctions != NULL) {
             dsfree(Image->ExportedFunctions);
         }
+        if (Image->ExportedFunctionNames != NULL) {
+            dsfree(Image->ExportedFunctionNames);
+        }
+        if (Image->Regions != NULL) {
+            PeDestroyRegions(Image);
+        }
         if (Image->Libraries != NULL) {
             _foreach(Node, Image->Libraries) {
                 PeUnloadImage((PeExecutable_t*)Node->Data);
@@ -51,6 +51,15 @@ typedef struct _PeExportedFunction {
     uintptr_t   Address;
 } PeExportedFunction_t;
 
+// Regions are only recorded for images loaded with PeLoadImageSnapshot, and contain
+// the final contents of a mapping after all relocations and imports have been resolved
+typedef struct _PeImageRegion {
+    uintptr_t             Address;
+    size_t                Length;
+    Flags_t               Flags;
+    uint8_t               Data[];
+} PeImageRegion_t;
+
 typedef struct _PeExecutable {
     UUId_t                Owner;
     MString_t*            Name;
@@ -70,7 +79,9 @@ typedef struct _PeExecutable {
     int                   NumberOfExportedFunctions;
     PeExportedFunction_t* ExportedFunctions;
     char*                 ExportedFunctionNames;
+    size_t                ExportedFunctionNamesLength;
     Collection_t*         Libraries;
+    Collection_t*         Regions;
 } PeExecutable_t;
 
 /*******************************************************************************
@@ -83,6 +94,8 @@ __EXTERN OsStatus_t ResolveFilePath(UUId_t, MString_t*, MString_t**);
 __EXTERN OsStatus_t LoadFile(MString_t*, void**, size_t*);
 __EXTERN void       UnloadFile(MString_t*, void*);
 __EXTERN OsStatus_t CreateImageSpace(MemorySpaceHandle_t*);
+__EXTERN OsStatus_t ForkImageSpace(MemorySpaceHandle_t, MemorySpaceHandle_t*);
+__EXTERN void       DestroyImageSpace(MemorySpaceHandle_t);
 __EXTERN OsStatus_t AcquireImageMapping(MemorySpaceHandle_t, uintptr_t*, size_t, Flags_t, MemoryMapHandle_t*);
 __EXTERN void       ReleaseImageMapping(MemoryMapHandle_t);
 
@@ -109,6 +122,33 @@ PeLoadImage(
     _In_  MString_t*       Path,
     _Out_ PeExecutable_t** ImageOut);
 
+/* PeLoadImageSnapshot
+ * Loads the executable like PeLoadImage, and keeps a copy-on-write copy of the loaded
+ * memory space as the snapshot. If the space can't be forked the final contents of all
+ * mapped regions are recorded instead. The image is recreated with PeCloneImage. */
+__EXTERN OsStatus_t
+PeLoadImageSnapshot(
+    _In_  UUId_t           Owner,
+    _In_  MString_t*       Path,
+    _Out_ PeExecutable_t** ImageOut,
+    _Out_ PeExecutable_t** SnapshotOut);
+
+/* PeCloneImage
+ * Recreates a snapshotted executable in a new memory space, without resolving, reading
+ * or relocating any of the files it was loaded from. The pages are shared copy-on-write
+ * with the snapshot when it has a template space. */
+__EXTERN OsStatus_t
+PeCloneImage(
+    _In_  UUId_t           Owner,
+    _In_  PeExecutable_t*  Snapshot,
+    _Out_ PeExecutable_t** ImageOut);
+
+/* PeUnloadSnapshot
+ * Releases a snapshot created by PeLoadImageSnapshot, including its template space. */
+__EXTERN OsStatus_t
+PeUnloadSnapshot(
+    _In_ PeExecutable_t* Snapshot);
+
 /* PeUnloadImage
  * Unload executables, all it's dependancies and free it's resources */
 __EXTERN OsStatus_t
@@ -273,6 +273,35 @@ OsStatus_t CreateImageSpace(MemorySpaceHandle_t* HandleOut)
     return OsSuccess;
 }
 
+// Creates a copy-on-write copy of the image regions of the given memory space. The kernel
+// loads images into its own space, so there is nothing to fork there.
+OsStatus_t ForkImageSpace(MemorySpaceHandle_t Source, MemorySpaceHandle_t* HandleOut)
+{
+#ifdef LIBC_KERNEL
+    _CRT_UNUSED(Source);
+    _CRT_UNUSED(HandleOut);
+    return OsNotSupported;
+#else
+    UUId_t     MemorySpaceHandle = UUID_INVALID;
+    OsStatus_t Status            = ForkMemorySpace((UUId_t)Source, &MemorySpaceHandle);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+    *HandleOut = (MemorySpaceHandle_t)MemorySpaceHandle;
+    return OsSuccess;
+#endif
+}
+
+// Destroys a memory space created by CreateImageSpace or ForkImageSpace
+void DestroyImageSpace(MemorySpaceHandle_t Handle)
+{
+#ifdef LIBC_KERNEL
+    _CRT_UNUSED(Handle);
+#else
+    Syscall_DestroyHandle((UUId_t)Handle);
+#endif
+}
+
 // Acquires (and creates) a memory mapping in the given memory space handle. The mapping is directly 
 // accessible in kernel mode, and in usermode a transfer-buffer is transparently provided as proxy.
 OsStatus_t AcquireImageMapping(MemorySpaceHandle_t Handle, uintptr_t* Address, size_t Length, Flags_t Flags, MemoryMapHandle_t* HandleOut)
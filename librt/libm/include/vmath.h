@@ -0,0 +1,65 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Vector Math Library
+ *  - Evaluates the math functions over arrays of values with SSE2 or AVX2,
+ *    the implementation is selected by the processor features on first use.
+ *
+ *  Every function computes Out[i] = f(In[i]) for i < Count. Out may be the
+ *  same array as In, but must not otherwise overlap it. Elements the vector
+ *  code does not cover (nan, infinities, zero/negative/subnormal arguments to
+ *  log and bases to pow, exponents below 2^-65 or above 2^63, negative
+ *  arguments to sqrt, |x| >= 2^19 for sin and cos, and results that could
+ *  overflow or underflow) are computed by the scalar function, including its
+ *  errno and exception behaviour. A result does not depend on its position in
+ *  the array.
+ *
+ *  Maximum error in ulp, measured against quad precision references. The
+ *  float functions are evaluated in double precision and rounded once:
+ *   vexp    0.51       vexpf   0.51
+ *   vlog    0.52       vlogf   0.51
+ *   vsin    0.80       vsinf   0.51
+ *   vcos    0.80       vcosf   0.51
+ *   vpow    0.52       vpowf   0.51
+ *   vsqrt   0.50       vsqrtf  0.50 (correctly rounded)
+ */
+
+#ifndef __VMATH_H__
+#define __VMATH_H__
+
+#include <crtdefs.h>
+#include <stddef.h>
+
+_CODE_BEGIN
+CRTDECL(void, vexp(double* Out, const double* In, size_t Count));
+CRTDECL(void, vexpf(float* Out, const float* In, size_t Count));
+CRTDECL(void, vlog(double* Out, const double* In, size_t Count));
+CRTDECL(void, vlogf(float* Out, const float* In, size_t Count));
+CRTDECL(void, vsin(double* Out, const double* In, size_t Count));
+CRTDECL(void, vsinf(float* Out, const float* In, size_t Count));
+CRTDECL(void, vcos(double* Out, const double* In, size_t Count));
+CRTDECL(void, vcosf(float* Out, const float* In, size_t Count));
+CRTDECL(void, vsincos(double* Sin, double* Cos, const double* In, size_t Count));
+CRTDECL(void, vsincosf(float* Sin, float* Cos, const float* In, size_t Count));
+CRTDECL(void, vpow(double* Out, const double* Base, const double* Exponent, size_t Count));
+CRTDECL(void, vpowf(float* Out, const float* Base, const float* Exponent, size_t Count));
+CRTDECL(void, vsqrt(double* Out, const double* In, size_t Count));
+CRTDECL(void, vsqrtf(float* Out, const float* In, size_t Count));
+_CODE_END
+
+#endif //!__VMATH_H__
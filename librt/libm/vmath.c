@@ -0,0 +1,186 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Vector Math Library
+ *  - Selects the implementation by the processor features on first use, and
+ *    provides the scalar loops used by processors without sse2.
+ */
+
+#include <math.h>
+#include <vmath.h>
+#include "vmath_private.h"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define VMATH_CPUID(Leaf, Subleaf, Registers) __cpuidex((int*)Registers, Leaf, Subleaf)
+#else
+#include <cpuid.h>
+#define VMATH_CPUID(Leaf, Subleaf, Registers) __cpuid_count(Leaf, Subleaf, Registers[0], Registers[1], Registers[2], Registers[3])
+#endif
+
+#define CPUID_FEAT_ECX_FMA          (1 << 12)
+#define CPUID_FEAT_ECX_OSXSAVE      (1 << 27)
+#define CPUID_FEAT_ECX_AVX          (1 << 28)
+#define CPUID_FEAT_EDX_SSE2         (1 << 26)
+#define CPUID_EXTFEAT_EBX_AVX2      (1 << 5)
+#define XCR0_SSE_AVX                0x6
+
+#define VMATH_SCALAR_UNARY(Name, Type, Function) \
+static void Name(Type* Out, const Type* In, size_t Count) { \
+    size_t i; \
+    for (i = 0; i < Count; i++) { Out[i] = Function(In[i]); } \
+}
+
+VMATH_SCALAR_UNARY(ExpScalar,   double, exp)
+VMATH_SCALAR_UNARY(ExpFScalar,  float,  expf)
+VMATH_SCALAR_UNARY(LogScalar,   double, log)
+VMATH_SCALAR_UNARY(LogFScalar,  float,  logf)
+VMATH_SCALAR_UNARY(SinScalar,   double, sin)
+VMATH_SCALAR_UNARY(SinFScalar,  float,  sinf)
+VMATH_SCALAR_UNARY(CosScalar,   double, cos)
+VMATH_SCALAR_UNARY(CosFScalar,  float,  cosf)
+VMATH_SCALAR_UNARY(SqrtScalar,  double, sqrt)
+VMATH_SCALAR_UNARY(SqrtFScalar, float,  sqrtf)
+
+static void
+SinCosScalar(double* Sin, double* Cos, const double* In, size_t Count)
+{
+    size_t i;
+    for (i = 0; i < Count; i++) {
+        sincos(In[i], &Sin[i], &Cos[i]);
+    }
+}
+
+static void
+SinCosFScalar(float* Sin, float* Cos, const float* In, size_t Count)
+{
+    size_t i;
+    for (i = 0; i < Count; i++) {
+        sincosf(In[i], &Sin[i], &Cos[i]);
+    }
+}
+
+static void
+PowScalar(double* Out, const double* Base, const double* Exponent, size_t Count)
+{
+    size_t i;
+    for (i = 0; i < Count; i++) {
+        Out[i] = pow(Base[i], Exponent[i]);
+    }
+}
+
+static void
+PowFScalar(float* Out, const float* Base, const float* Exponent, size_t Count)
+{
+    size_t i;
+    for (i = 0; i < Count; i++) {
+        Out[i] = powf(Base[i], Exponent[i]);
+    }
+}
+
+static const VMathImplementation_t VMathScalar = {
+    ExpScalar,    ExpFScalar,
+    LogScalar,    LogFScalar,
+    SinScalar,    SinFScalar,
+    CosScalar,    CosFScalar,
+    SinCosScalar, SinCosFScalar,
+    PowScalar,    PowFScalar,
+    SqrtScalar,   SqrtFScalar
+};
+
+static const VMathImplementation_t* __GlbVMath = NULL;
+
+static unsigned int
+VMathReadXcr0(void)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (unsigned int)_xgetbv(0);
+#else
+    unsigned int Low, High;
+    __asm__ __volatile__("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+    (void)High;
+    return Low;
+#endif
+}
+
+/* VMathSelect
+ * Reads the processor features once, racing initializers all store the same pointer.
+ * Avx2 also requires fma and that the os saves the ymm state. */
+static const VMathImplementation_t*
+VMathSelect(void)
+{
+    const VMathImplementation_t* Implementation = &VMathScalar;
+    unsigned int                 Registers[4]   = { 0 };
+    unsigned int                 MaxLeaf;
+    unsigned int                 FeatEcx;
+    unsigned int                 AvxMask = CPUID_FEAT_ECX_FMA | CPUID_FEAT_ECX_OSXSAVE | CPUID_FEAT_ECX_AVX;
+
+    if (__GlbVMath != NULL) {
+        return __GlbVMath;
+    }
+
+    VMATH_CPUID(0, 0, Registers);
+    MaxLeaf = Registers[0];
+
+    VMATH_CPUID(1, 0, Registers);
+    FeatEcx = Registers[2];
+    if (Registers[3] & CPUID_FEAT_EDX_SSE2) {
+        Implementation = &VMathSse2;
+    }
+
+    if (MaxLeaf >= 7 && (FeatEcx & AvxMask) == AvxMask) {
+        VMATH_CPUID(7, 0, Registers);
+        if ((Registers[1] & CPUID_EXTFEAT_EBX_AVX2) &&
+            (VMathReadXcr0() & XCR0_SSE_AVX) == XCR0_SSE_AVX) {
+            Implementation = &VMathAvx2;
+        }
+    }
+
+    __GlbVMath = Implementation;
+    return Implementation;
+}
+
+void vexp(double* Out, const double* In, size_t Count)   { VMathSelect()->Exp(Out, In, Count); }
+void vexpf(float* Out, const float* In, size_t Count)    { VMathSelect()->ExpF(Out, In, Count); }
+void vlog(double* Out, const double* In, size_t Count)   { VMathSelect()->Log(Out, In, Count); }
+void vlogf(float* Out, const float* In, size_t Count)    { VMathSelect()->LogF(Out, In, Count); }
+void vsin(double* Out, const double* In, size_t Count)   { VMathSelect()->Sin(Out, In, Count); }
+void vsinf(float* Out, const float* In, size_t Count)    { VMathSelect()->SinF(Out, In, Count); }
+void vcos(double* Out, const double* In, size_t Count)   { VMathSelect()->Cos(Out, In, Count); }
+void vcosf(float* Out, const float* In, size_t Count)    { VMathSelect()->CosF(Out, In, Count); }
+void vsqrt(double* Out, const double* In, size_t Count)  { VMathSelect()->Sqrt(Out, In, Count); }
+void vsqrtf(float* Out, const float* In, size_t Count)   { VMathSelect()->SqrtF(Out, In, Count); }
+
+void vsincos(double* Sin, double* Cos, const double* In, size_t Count)
+{
+    VMathSelect()->SinCos(Sin, Cos, In, Count);
+}
+
+void vsincosf(float* Sin, float* Cos, const float* In, size_t Count)
+{
+    VMathSelect()->SinCosF(Sin, Cos, In, Count);
+}
+
+void vpow(double* Out, const double* Base, const double* Exponent, size_t Count)
+{
+    VMathSelect()->Pow(Out, Base, Exponent, Count);
+}
+
+void vpowf(float* Out, const float* Base, const float* Exponent, size_t Count)
+{
+    VMathSelect()->PowF(Out, Base, Exponent, Count);
+}
@@ -0,0 +1,79 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Vector Math Library - AVX2
+ *  - Four double lanes per vector with hardware gathers, polynomials use fma.
+ *    Only selected when the os saves the ymm state.
+ */
+
+#include <immintrin.h>
+#include "vmath_private.h"
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+typedef __m256d vd_t;
+typedef __m256i vi_t;
+
+#define VD_LANES                4
+#define VMATH_NAME(Name)        Name##Avx2
+
+#define vd_set1(Value)          _mm256_set1_pd(Value)
+#define vd_loadu(Pointer)       _mm256_loadu_pd(Pointer)
+#define vd_storeu(Pointer, x)   _mm256_storeu_pd(Pointer, x)
+#define vd_loadf(Pointer)       _mm256_cvtps_pd(_mm_loadu_ps(Pointer))
+#define vd_storef(Pointer, x)   _mm_storeu_ps(Pointer, _mm256_cvtpd_ps(x))
+#define vd_add(a, b)            _mm256_add_pd(a, b)
+#define vd_sub(a, b)            _mm256_sub_pd(a, b)
+#define vd_mul(a, b)            _mm256_mul_pd(a, b)
+#define vd_madd(a, b, c)        _mm256_fmadd_pd(a, b, c)
+#define vd_cmpeq(a, b)          _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define vd_sqrt(x)              _mm256_sqrt_pd(x)
+#define vd_or(a, b)             _mm256_or_pd(a, b)
+#define vd_xor(a, b)            _mm256_xor_pd(a, b)
+#define vd_select(Mask, IfSet, IfClear) _mm256_blendv_pd(IfClear, IfSet, Mask)
+#define vd_mask(x)              _mm256_movemask_pd(x)
+#define vd_gather(Table, Index) _mm256_i64gather_pd(Table, Index, 8)
+#define vd_as_vi(x)             _mm256_castpd_si256(x)
+
+#define vi_set1_32(Value)       _mm256_set1_epi32(Value)
+#define vi_set1_64(Value)       _mm256_set1_epi64x((long long)(Value))
+#define vi_add64(a, b)          _mm256_add_epi64(a, b)
+#define vi_sub64(a, b)          _mm256_sub_epi64(a, b)
+#define vi_sub32(a, b)          _mm256_sub_epi32(a, b)
+#define vi_and(a, b)            _mm256_and_si256(a, b)
+#define vi_or(a, b)             _mm256_or_si256(a, b)
+#define vi_xor(a, b)            _mm256_xor_si256(a, b)
+#define vi_sll64(a, Count)      _mm256_slli_epi64(a, Count)
+#define vi_srl64(a, Count)      _mm256_srli_epi64(a, Count)
+#define vi_cmpgt32(a, b)        _mm256_cmpgt_epi32(a, b)
+#define vi_hiword(a)            _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 1, 1))
+#define vi_gather64(Table, Index) _mm256_i64gather_epi64((const long long*)(Table), Index, 8)
+#define vi_as_vd(a)             _mm256_castsi256_pd(a)
+
+#include "vmath_kernels.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,498 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Vector Math Library - Kernels
+ *  - Written once against the vd_ (double lanes) and vi_ (integer lanes of the
+ *    same width) operations, which the including file maps to an instruction
+ *    set together with VD_LANES and VMATH_NAME.
+ *  - The float functions load their values into double lanes and use the same
+ *    kernels, the result is rounded once when it is stored.
+ *  - Lanes a kernel does not cover are replaced by a harmless value before the
+ *    kernel runs, so they raise no exceptions, and are then recomputed by the
+ *    scalar function.
+ */
+
+#include <math.h>
+
+// The splits in the log and pow kernels rely on separately rounded operations
+#pragma STDC FP_CONTRACT OFF
+
+/* exp: x = k*ln2/N + r with |r| <= ln2/2N, exp(x) = 2^(k/N) * exp(r) */
+#define VMATH_INVLN2N       0x1.71547652b82fep+7
+#define VMATH_LN2N_HI       0x1.62e42ff000000p-8   // 29 bits, k*VMATH_LN2N_HI is exact
+#define VMATH_LN2N_LO       -0x1.718432a1b0e26p-42
+#define VMATH_SHIFT         0x1.8p52
+
+/* log: x = 2^k z with z in [OFF, 2*OFF), log(x) = k*ln2 + log(c) + log1p(z/c - 1) */
+#define VMATH_LOG_OFF       0x3fe6955500000000ULL
+#define VMATH_LN2_HI        0x1.62e42fefa3800p-1   // k*VMATH_LN2_HI + logc is exact
+#define VMATH_LN2_LO        0x1.ef35793c76730p-45
+
+/* sin/cos: x = n*pi/2 + y, pi/2 is split in 33 + 33 + 33 + 53 bits so n*part is exact */
+#define VMATH_INVPIO2       6.36619772367581382433e-01
+#define VMATH_PIO2_1        1.57079632673412561417e+00
+#define VMATH_PIO2_2        6.07710050630396597660e-11
+#define VMATH_PIO2_3        2.02226624871116645580e-21
+#define VMATH_PIO2_3T       8.47842766036889956997e-32
+
+/* High words of the range limits, |x| below them is handled by the vector code */
+#define VMATH_LIMIT_EXP     0x40800000  // 512, exp(x) and 2^(k/N) stay normal
+#define VMATH_LIMIT_EXPF    0x4055c000  // 87, the float result stays normal
+#define VMATH_LIMIT_TRIG    0x41200000  // 2^19, keeps n*VMATH_PIO2_1 exact
+
+/* Lanes where |x| >= asdouble(Limit << 32), including infinities and nan */
+static inline vd_t
+VMathAbsAtLeast(
+    _In_ vd_t    x,
+    _In_ int32_t Limit)
+{
+    vi_t High = vi_and(vi_hiword(vd_as_vi(x)), vi_set1_32(0x7fffffff));
+    return vi_as_vd(vi_cmpgt32(High, vi_set1_32(Limit - 1)));
+}
+
+/* Lanes that are not positive normal numbers */
+static inline vd_t
+VMathNotPositiveNormal(
+    _In_ vd_t x)
+{
+    // (High - 0x00100000) >= 0x7fe00000 unsigned, biased to use the signed compare
+    vi_t High = vi_xor(vi_sub32(vi_hiword(vd_as_vi(x)), vi_set1_32(0x00100000)),
+        vi_set1_32((int32_t)0x80000000));
+    return vi_as_vd(vi_cmpgt32(High, vi_set1_32((int32_t)(0x7fe00000 ^ 0x80000000) - 1)));
+}
+
+/* VMathExpCore
+ * exp(x + Tail) for |x| < 512 and |Tail| < 2^-16, the error is below 0.51 ulp. */
+static inline vd_t
+VMathExpCore(
+    _In_ vd_t x,
+    _In_ vd_t Tail)
+{
+    vd_t Kd, r, r2, TableTail, Scale, Poly;
+    vi_t Ki, Index, Top;
+
+    Kd = vd_add(vd_mul(x, vd_set1(VMATH_INVLN2N)), vd_set1(VMATH_SHIFT));
+    Ki = vd_as_vi(Kd);
+    Kd = vd_sub(Kd, vd_set1(VMATH_SHIFT));
+    r  = vd_add(vd_sub(x, vd_mul(Kd, vd_set1(VMATH_LN2N_HI))), vd_mul(Kd, vd_set1(-VMATH_LN2N_LO)));
+    r  = vd_add(r, Tail);
+
+    // 2^(k/N) ~= Scale * (1 + TableTail)
+    Index     = vi_sll64(vi_and(Ki, vi_set1_64(VMATH_EXP_TABLE_SIZE - 1)), 1);
+    Top       = vi_sll64(Ki, 52 - VMATH_EXP_TABLE_BITS);
+    TableTail = vi_as_vd(vi_gather64(&__vmath_exp_table[0], Index));
+    Scale     = vi_as_vd(vi_add64(vi_gather64(&__vmath_exp_table[1], Index), Top));
+
+    // exp(x) ~= Scale + Scale * (TableTail + exp(r) - 1)
+    r2   = vd_mul(r, r);
+    Poly = vd_add(vd_add(TableTail, r),
+        vd_madd(r2, vd_madd(r, vd_set1(1.0 / 6.0), vd_set1(0.5)),
+            vd_mul(vd_mul(r2, r2), vd_madd(r, vd_set1(1.0 / 120.0), vd_set1(1.0 / 24.0)))));
+    return vd_madd(Scale, Poly, Scale);
+}
+
+/* VMathLogCore
+ * log(x) for positive normal x as Result + Tail, with a relative error of the
+ * pair below 2^-66 so pow can build on it. */
+static inline vd_t
+VMathLogCore(
+    _In_  vd_t  x,
+    _Out_ vd_t* Tail)
+{
+    vd_t z, Kd, InvC, LogC, LogCTail, zHi, zLo, rHi, rLo, r, r2, r3;
+    vd_t t1, t2, Lo1, Lo2, Lo3, Lo4, ArHi, ArHi2, Hi, Lo, Poly, y;
+    vi_t ix, Tmp, Index;
+
+    // x = 2^k z, the subinterval of z selects c, k is the signed top 12 bits of Tmp
+    ix    = vd_as_vi(x);
+    Tmp   = vi_sub64(ix, vi_set1_64(VMATH_LOG_OFF));
+    Index = vi_sll64(vi_and(vi_srl64(Tmp, 52 - VMATH_LOG_TABLE_BITS), vi_set1_64(VMATH_LOG_TABLE_SIZE - 1)), 2);
+    z     = vi_as_vd(vi_sub64(ix, vi_and(Tmp, vi_set1_64(0xfffULL << 52))));
+    Kd    = vi_as_vd(vi_or(vi_xor(vi_srl64(Tmp, 52), vi_set1_64(0x800)), vd_as_vi(vd_set1(VMATH_SHIFT))));
+    Kd    = vd_sub(Kd, vd_set1(VMATH_SHIFT + 2048.0));
+
+    InvC     = vd_gather(&__vmath_log_table[0].InvC, Index);
+    LogC     = vd_gather(&__vmath_log_table[0].LogC, Index);
+    LogCTail = vd_gather(&__vmath_log_table[0].LogCTail, Index);
+
+    // r = z/c - 1 is exact, z is split so rHi, rLo and rHi*rHi are exact too
+    zHi = vi_as_vd(vi_and(vi_add64(vd_as_vi(z), vi_set1_64(1ULL << 31)), vi_set1_64(~0ULL << 32)));
+    zLo = vd_sub(z, zHi);
+    rHi = vd_sub(vd_mul(zHi, InvC), vd_set1(1.0));
+    rLo = vd_mul(zLo, InvC);
+    r   = vd_add(rHi, rLo);
+
+    // k*ln2 + log(c) + r - r*r/2 with the rounding errors collected in Lo
+    t1    = vd_add(vd_mul(Kd, vd_set1(VMATH_LN2_HI)), LogC);
+    t2    = vd_add(t1, r);
+    Lo1   = vd_add(vd_mul(Kd, vd_set1(VMATH_LN2_LO)), LogCTail);
+    Lo2   = vd_add(vd_sub(t1, t2), r);
+    ArHi  = vd_mul(rHi, vd_set1(-0.5));
+    ArHi2 = vd_mul(rHi, ArHi);
+    Hi    = vd_add(t2, ArHi2);
+    Lo3   = vd_mul(rLo, vd_add(vd_mul(r, vd_set1(-0.5)), ArHi));
+    Lo4   = vd_add(vd_sub(t2, Hi), ArHi2);
+
+    // log1p(r) - r + r*r/2 for |r| < 1/N
+    r2   = vd_mul(r, r);
+    r3   = vd_mul(r2, r);
+    Poly = vd_madd(r2,
+        vd_madd(r, vd_set1(-1.0 / 6.0), vd_set1(1.0 / 5.0)),
+        vd_madd(r, vd_set1(-1.0 / 4.0), vd_set1(1.0 / 3.0)));
+    Poly = vd_madd(vd_mul(r2, r2),
+        vd_madd(r2, vd_set1(1.0 / 9.0), vd_madd(r, vd_set1(-1.0 / 8.0), vd_set1(1.0 / 7.0))), Poly);
+    Poly = vd_mul(r3, Poly);
+
+    Lo    = vd_add(vd_add(vd_add(vd_add(Lo1, Lo2), Lo3), Lo4), Poly);
+    y     = vd_add(Hi, Lo);
+    *Tail = vd_add(vd_sub(Hi, y), Lo);
+    return y;
+}
+
+/* VMathReduce
+ * x = n*pi/2 + (Result + Tail) for |x| < 2^19, n is in the low bits of Quadrant.
+ * All three steps of the medium case in rempio.c are always taken, the
+ * rounding errors of the subtractions are carried into the tail. */
+static inline vd_t
+VMathReduce(
+    _In_  vd_t  x,
+    _Out_ vd_t* Tail,
+    _Out_ vi_t* Quadrant)
+{
+    vd_t Fn, t, w, r, e, y, Small;
+
+    Fn        = vd_add(vd_mul(x, vd_set1(VMATH_INVPIO2)), vd_set1(VMATH_SHIFT));
+    *Quadrant = vd_as_vi(Fn);
+    Fn        = vd_sub(Fn, vd_set1(VMATH_SHIFT));
+
+    t     = vd_sub(x, vd_mul(Fn, vd_set1(VMATH_PIO2_1)));
+    w     = vd_mul(Fn, vd_set1(VMATH_PIO2_2));
+    r     = vd_sub(t, w);
+    e     = vd_sub(vd_sub(t, r), w);
+    t     = r;
+    w     = vd_mul(Fn, vd_set1(VMATH_PIO2_3));
+    r     = vd_sub(t, w);
+    e     = vd_sub(vd_add(e, vd_sub(vd_sub(t, r), w)), vd_mul(Fn, vd_set1(VMATH_PIO2_3T)));
+    y     = vd_add(r, e);
+    *Tail = vd_add(vd_sub(r, y), e);
+
+    // Nothing to reduce below pi/4, this also keeps the sign of -0
+    Small = vd_cmpeq(Fn, vd_set1(0.0));
+    *Tail = vd_select(Small, vd_set1(0.0), *Tail);
+    return vd_select(Small, x, y);
+}
+
+/* VMathSinKernel, VMathCosKernel
+ * sin and cos of x + y for |x| <= pi/4, the polynomials of core_sin.c and core_cos.c */
+static inline vd_t
+VMathSinKernel(
+    _In_ vd_t x,
+    _In_ vd_t y)
+{
+    vd_t z = vd_mul(x, x);
+    vd_t w = vd_mul(z, z);
+    vd_t v = vd_mul(z, x);
+    vd_t r;
+
+    r = vd_madd(z, vd_madd(z, vd_set1(2.75573137070700676789e-06), vd_set1(-1.98412698298579493134e-04)),
+        vd_set1(8.33333333332248946124e-03));
+    r = vd_madd(vd_mul(z, w), vd_madd(z, vd_set1(1.58969099521155010221e-10), vd_set1(-2.50507602534068634195e-08)), r);
+    return vd_sub(x, vd_sub(vd_sub(vd_mul(z, vd_sub(vd_mul(y, vd_set1(0.5)), vd_mul(v, r))), y),
+        vd_mul(v, vd_set1(-1.66666666666666324348e-01))));
+}
+
+static inline vd_t
+VMathCosKernel(
+    _In_ vd_t x,
+    _In_ vd_t y)
+{
+    vd_t z = vd_mul(x, x);
+    vd_t w = vd_mul(z, z);
+    vd_t r, Hz, One;
+
+    r = vd_mul(z, vd_madd(z, vd_madd(z, vd_set1(2.48015872894767294178e-05), vd_set1(-1.38888888888741095749e-03)),
+        vd_set1(4.16666666666666019037e-02)));
+    r = vd_madd(vd_mul(w, w), vd_madd(z, vd_madd(z, vd_set1(-1.13596475577881948265e-11), vd_set1(2.08757232129817482790e-09)),
+        vd_set1(-2.75573143513906633035e-07)), r);
+    Hz  = vd_mul(z, vd_set1(0.5));
+    One = vd_sub(vd_set1(1.0), Hz);
+    return vd_add(One, vd_add(vd_sub(vd_sub(vd_set1(1.0), One), Hz), vd_sub(vd_mul(z, r), vd_mul(x, y))));
+}
+
+/* Odd quadrants swap the kernels, the sign of the result follows bit 1 */
+static inline vd_t
+VMathQuadrantSelect(
+    _In_ vi_t Quadrant,
+    _In_ vd_t Sin,
+    _In_ vd_t Cos)
+{
+    vd_t Odd  = vi_as_vd(vi_sub64(vi_set1_64(0), vi_and(Quadrant, vi_set1_64(1))));
+    vd_t Sign = vi_as_vd(vi_sll64(vi_and(Quadrant, vi_set1_64(2)), 62));
+    return vd_xor(vd_select(Odd, Cos, Sin), Sign);
+}
+
+/* Blocks evaluate one vector and return the lanes left to the scalar function */
+static inline vd_t
+VMathExpBlock(
+    _In_  vd_t    x,
+    _In_  int32_t Limit,
+    _Out_ int*    Special)
+{
+    vd_t Mask = VMathAbsAtLeast(x, Limit);
+    *Special  = vd_mask(Mask);
+    return VMathExpCore(vd_select(Mask, vd_set1(0.0), x), vd_set1(0.0));
+}
+
+static inline vd_t
+VMathLogBlock(
+    _In_  vd_t    x,
+    _In_  int32_t Limit,
+    _Out_ int*    Special)
+{
+    vd_t Mask = VMathNotPositiveNormal(x);
+    vd_t Tail;
+    (void)Limit;
+
+    *Special = vd_mask(Mask);
+    return VMathLogCore(vd_select(Mask, vd_set1(1.0), x), &Tail);
+}
+
+static inline vd_t
+VMathSinBlock(
+    _In_  vd_t    x,
+    _In_  int32_t Limit,
+    _Out_ int*    Special)
+{
+    vd_t Mask = VMathAbsAtLeast(x, Limit);
+    vd_t y, Tail;
+    vi_t Quadrant;
+
+    *Special = vd_mask(Mask);
+    y = VMathReduce(vd_select(Mask, vd_set1(0.0), x), &Tail, &Quadrant);
+    return VMathQuadrantSelect(Quadrant, VMathSinKernel(y, Tail), VMathCosKernel(y, Tail));
+}
+
+static inline vd_t
+VMathCosBlock(
+    _In_  vd_t    x,
+    _In_  int32_t Limit,
+    _Out_ int*    Special)
+{
+    vd_t Mask = VMathAbsAtLeast(x, Limit);
+    vd_t y, Tail;
+    vi_t Quadrant;
+
+    *Special = vd_mask(Mask);
+    y = VMathReduce(vd_select(Mask, vd_set1(0.0), x), &Tail, &Quadrant);
+    return VMathQuadrantSelect(vi_add64(Quadrant, vi_set1_64(1)), VMathSinKernel(y, Tail), VMathCosKernel(y, Tail));
+}
+
+static inline vd_t
+VMathSqrtBlock(
+    _In_  vd_t    x,
+    _In_  int32_t Limit,
+    _Out_ int*    Special)
+{
+    // Negative arguments go to sqrt so errno is set, -0 included for simplicity
+    vd_t Mask = vi_as_vd(vi_cmpgt32(vi_set1_32(0), vi_hiword(vd_as_vi(x))));
+    (void)Limit;
+
+    *Special = vd_mask(Mask);
+    return vd_sqrt(vd_select(Mask, vd_set1(0.0), x));
+}
+
+/* VMathPowBlock
+ * exp(y * log(x)) with the product kept as a double-double, only positive normal
+ * x, 2^-65 <= |y| < 2^63 and |y * log(x)| below Limit are evaluated. */
+static inline vd_t
+VMathPowBlock(
+    _In_  vd_t    x,
+    _In_  vd_t    y,
+    _In_  int32_t Limit,
+    _Out_ int*    Special)
+{
+    vd_t Mask, LogHi, LogLo, yHi, yLo, lHi, lLo, eHi, eLo, Range;
+    vi_t yHigh;
+
+    // (|y| high word - 2^-65) >= (2^63 - 2^-65) unsigned covers tiny, huge, inf and nan
+    yHigh = vi_and(vi_hiword(vd_as_vi(y)), vi_set1_32(0x7fffffff));
+    yHigh = vi_xor(vi_sub32(yHigh, vi_set1_32(0x3be00000)), vi_set1_32((int32_t)0x80000000));
+    Mask  = vd_or(VMathNotPositiveNormal(x),
+        vi_as_vd(vi_cmpgt32(yHigh, vi_set1_32((int32_t)((0x43e00000 - 0x3be00000) ^ 0x80000000) - 1))));
+    x = vd_select(Mask, vd_set1(1.0), x);
+    y = vd_select(Mask, vd_set1(1.0), y);
+
+    LogHi = VMathLogCore(x, &LogLo);
+
+    // y * log(x) as eHi + eLo, the halves are split to keep the products exact
+    yHi = vi_as_vd(vi_and(vd_as_vi(y), vi_set1_64(~0ULL << 27)));
+    yLo = vd_sub(y, yHi);
+    lHi = vi_as_vd(vi_and(vd_as_vi(LogHi), vi_set1_64(~0ULL << 27)));
+    lLo = vd_add(vd_sub(LogHi, lHi), LogLo);
+    eHi = vd_mul(yHi, lHi);
+    eLo = vd_add(vd_mul(yLo, lHi), vd_mul(y, lLo));
+
+    Range    = VMathAbsAtLeast(eHi, Limit);
+    Mask     = vd_or(Mask, Range);
+    *Special = vd_mask(Mask);
+    return VMathExpCore(vd_select(Mask, vd_set1(0.0), eHi), vd_select(Mask, vd_set1(0.0), eLo));
+}
+
+/* The array drivers, full vectors are loaded straight from the arrays and the last
+ * partial vector is padded with ones. The inputs of lanes that need the scalar
+ * function are saved before the store, as Out may be the same array as In. */
+#define VMATH_UNARY(Name, Type, Load, Store, Block, Limit, Scalar)                      \
+static void VMATH_NAME(Name)(Type* Out, const Type* In, size_t Count)                          \
+{                                                                                       \
+    Type   Source[VD_LANES];                                                            \
+    Type   Result[VD_LANES];                                                            \
+    size_t i, j;                                                                        \
+    int    Special;                                                                     \
+    vd_t   y;                                                                           \
+                                                                                        \
+    for (i = 0; i + VD_LANES <= Count; i += VD_LANES) {                                 \
+        y = Block(Load(&In[i]), Limit, &Special);                                       \
+        if (Special) {                                                                  \
+            for (j = 0; j < VD_LANES; j++) {                                            \
+                Source[j] = In[i + j];                                                  \
+            }                                                                           \
+            Store(&Out[i], y);                                                          \
+            for (j = 0; j < VD_LANES; j++) {                                            \
+                if (Special & (1 << j)) {                                               \
+                    Out[i + j] = Scalar(Source[j]);                                     \
+                }                                                                       \
+            }                                                                           \
+        }                                                                               \
+        else {                                                                          \
+            Store(&Out[i], y);                                                          \
+        }                                                                               \
+    }                                                                                   \
+                                                                                        \
+    if (i < Count) {                                                                    \
+        for (j = 0; j < VD_LANES; j++) {                                                \
+            Source[j] = (i + j < Count) ? In[i + j] : (Type)1;                          \
+        }                                                                               \
+        y = Block(Load(&Source[0]), Limit, &Special);                                   \
+        Store(&Result[0], y);                                                           \
+        for (j = 0; i + j < Count; j++) {                                               \
+            Out[i + j] = (Special & (1 << j)) ? Scalar(Source[j]) : Result[j];          \
+        }                                                                               \
+    }                                                                                   \
+}
+
+#define VMATH_POW(Name, Type, Load, Store, Limit, Scalar)                               \
+static void VMATH_NAME(Name)(Type* Out, const Type* Base, const Type* Exponent, size_t Count)  \
+{                                                                                       \
+    Type   SourceX[VD_LANES];                                                           \
+    Type   SourceY[VD_LANES];                                                           \
+    Type   Result[VD_LANES];                                                            \
+    size_t i, j;                                                                        \
+    int    Special;                                                                     \
+    vd_t   y;                                                                           \
+                                                                                        \
+    for (i = 0; i + VD_LANES <= Count; i += VD_LANES) {                                 \
+        y = VMathPowBlock(Load(&Base[i]), Load(&Exponent[i]), Limit, &Special);         \
+        if (Special) {                                                                  \
+            for (j = 0; j < VD_LANES; j++) {                                            \
+                SourceX[j] = Base[i + j];                                               \
+                SourceY[j] = Exponent[i + j];                                           \
+            }                                                                           \
+            Store(&Out[i], y);                                                          \
+            for (j = 0; j < VD_LANES; j++) {                                            \
+                if (Special & (1 << j)) {                                               \
+                    Out[i + j] = Scalar(SourceX[j], SourceY[j]);                        \
+                }                                                                       \
+            }                                                                           \
+        }                                                                               \
+        else {                                                                          \
+            Store(&Out[i], y);                                                          \
+        }                                                                               \
+    }                                                                                   \
+                                                                                        \
+    if (i < Count) {                                                                    \
+        for (j = 0; j < VD_LANES; j++) {                                                \
+            SourceX[j] = (i + j < Count) ? Base[i + j] : (Type)1;                       \
+            SourceY[j] = (i + j < Count) ? Exponent[i + j] : (Type)1;                   \
+        }                                                                               \
+        y = VMathPowBlock(Load(&SourceX[0]), Load(&SourceY[0]), Limit, &Special);       \
+        Store(&Result[0], y);                                                           \
+        for (j = 0; i + j < Count; j++) {                                               \
+            Out[i + j] = (Special & (1 << j)) ? Scalar(SourceX[j], SourceY[j]) : Result[j]; \
+        }                                                                               \
+    }                                                                                   \
+}
+
+#define VMATH_SINCOS(Name, Type, Load, Store, Scalar)                                   \
+static void VMATH_NAME(Name)(Type* Sin, Type* Cos, const Type* In, size_t Count)               \
+{                                                                                       \
+    Type   Source[VD_LANES];                                                            \
+    Type   ResultSin[VD_LANES];                                                         \
+    Type   ResultCos[VD_LANES];                                                         \
+    size_t i, j;                                                                        \
+    int    Special;                                                                     \
+    vd_t   x, y, Tail, Mask, s, c;                                                      \
+    vi_t   Quadrant;                                                                    \
+                                                                                        \
+    for (i = 0; i < Count; i += VD_LANES) {                                             \
+        for (j = 0; j < VD_LANES; j++) {                                                \
+            Source[j] = (i + j < Count) ? In[i + j] : (Type)1;                          \
+        }                                                                               \
+        x       = Load(&Source[0]);                                                     \
+        Mask    = VMathAbsAtLeast(x, VMATH_LIMIT_TRIG);                                 \
+        Special = vd_mask(Mask);                                                        \
+        y       = VMathReduce(vd_select(Mask, vd_set1(0.0), x), &Tail, &Quadrant);     \
+        s       = VMathSinKernel(y, Tail);                                              \
+        c       = VMathCosKernel(y, Tail);                                              \
+        Store(&ResultSin[0], VMathQuadrantSelect(Quadrant, s, c));                      \
+        Store(&ResultCos[0], VMathQuadrantSelect(vi_add64(Quadrant, vi_set1_64(1)), s, c)); \
+        for (j = 0; j < VD_LANES && i + j < Count; j++) {                               \
+            if (Special & (1 << j)) {                                                   \
+                Scalar(Source[j], &Sin[i + j], &Cos[i + j]);                            \
+            }                                                                           \
+            else {                                                                      \
+                Sin[i + j] = ResultSin[j];                                              \
+                Cos[i + j] = ResultCos[j];                                              \
+            }                                                                           \
+        }                                                                               \
+    }                                                                                   \
+}
+
+VMATH_UNARY(Exp,   double, vd_loadu, vd_storeu, VMathExpBlock,  VMATH_LIMIT_EXP,  exp)
+VMATH_UNARY(ExpF,  float,  vd_loadf, vd_storef, VMathExpBlock,  VMATH_LIMIT_EXPF, expf)
+VMATH_UNARY(Log,   double, vd_loadu, vd_storeu, VMathLogBlock,  0,                log)
+VMATH_UNARY(LogF,  float,  vd_loadf, vd_storef, VMathLogBlock,  0,                logf)
+VMATH_UNARY(Sin,   double, vd_loadu, vd_storeu, VMathSinBlock,  VMATH_LIMIT_TRIG, sin)
+VMATH_UNARY(SinF,  float,  vd_loadf, vd_storef, VMathSinBlock,  VMATH_LIMIT_TRIG, sinf)
+VMATH_UNARY(Cos,   double, vd_loadu, vd_storeu, VMathCosBlock,  VMATH_LIMIT_TRIG, cos)
+VMATH_UNARY(CosF,  float,  vd_loadf, vd_storef, VMathCosBlock,  VMATH_LIMIT_TRIG, cosf)
+VMATH_UNARY(Sqrt,  double, vd_loadu, vd_storeu, VMathSqrtBlock, 0,                sqrt)
+VMATH_UNARY(SqrtF, float,  vd_loadf, vd_storef, VMathSqrtBlock, 0,                sqrtf)
+VMATH_POW(Pow,     double, vd_loadu, vd_storeu, VMATH_LIMIT_EXP,  pow)
+VMATH_POW(PowF,    float,  vd_loadf, vd_storef, VMATH_LIMIT_EXPF, powf)
+VMATH_SINCOS(SinCos,  double, vd_loadu, vd_storeu, sincos)
+VMATH_SINCOS(SinCosF, float,  vd_loadf, vd_storef, sincosf)
+
+const VMathImplementation_t VMATH_NAME(VMath) = {
+    VMATH_NAME(Exp),    VMATH_NAME(ExpF),
+    VMATH_NAME(Log),    VMATH_NAME(LogF),
+    VMATH_NAME(Sin),    VMATH_NAME(SinF),
+    VMATH_NAME(Cos),    VMATH_NAME(CosF),
+    VMATH_NAME(SinCos), VMATH_NAME(SinCosF),
+    VMATH_NAME(Pow),    VMATH_NAME(PowF),
+    VMATH_NAME(Sqrt),   VMATH_NAME(SqrtF)
+};
@@ -0,0 +1,64 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Vector Math Library - Private definitions
+ *  - Tables and the per instruction set implementations.
+ */
+
+#ifndef __VMATH_PRIVATE_H__
+#define __VMATH_PRIVATE_H__
+
+#include <crtdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VMATH_EXP_TABLE_BITS    7
+#define VMATH_EXP_TABLE_SIZE    (1 << VMATH_EXP_TABLE_BITS)
+#define VMATH_LOG_TABLE_BITS    7
+#define VMATH_LOG_TABLE_SIZE    (1 << VMATH_LOG_TABLE_BITS)
+
+typedef struct VMathLogEntry {
+    double InvC;
+    double LogC;
+    double LogCTail;
+    double Pad;             // Entries are 4 doubles so the index scales by a shift
+} VMathLogEntry_t;
+
+typedef struct VMathImplementation {
+    void (*Exp)(double* Out, const double* In, size_t Count);
+    void (*ExpF)(float* Out, const float* In, size_t Count);
+    void (*Log)(double* Out, const double* In, size_t Count);
+    void (*LogF)(float* Out, const float* In, size_t Count);
+    void (*Sin)(double* Out, const double* In, size_t Count);
+    void (*SinF)(float* Out, const float* In, size_t Count);
+    void (*Cos)(double* Out, const double* In, size_t Count);
+    void (*CosF)(float* Out, const float* In, size_t Count);
+    void (*SinCos)(double* Sin, double* Cos, const double* In, size_t Count);
+    void (*SinCosF)(float* Sin, float* Cos, const float* In, size_t Count);
+    void (*Pow)(double* Out, const double* Base, const double* Exponent, size_t Count);
+    void (*PowF)(float* Out, const float* Base, const float* Exponent, size_t Count);
+    void (*Sqrt)(double* Out, const double* In, size_t Count);
+    void (*SqrtF)(float* Out, const float* In, size_t Count);
+} VMathImplementation_t;
+
+extern const uint64_t              __vmath_exp_table[2 * VMATH_EXP_TABLE_SIZE];
+extern const VMathLogEntry_t       __vmath_log_table[VMATH_LOG_TABLE_SIZE];
+extern const VMathImplementation_t VMathSse2;
+extern const VMathImplementation_t VMathAvx2;
+
+#endif //!__VMATH_PRIVATE_H__
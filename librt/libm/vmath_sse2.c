@@ -0,0 +1,106 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Vector Math Library - SSE2
+ *  - Two double lanes per vector, tables are read one lane at a time.
+ */
+
+#include <emmintrin.h>
+#include "vmath_private.h"
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+
+typedef __m128d vd_t;
+typedef __m128i vi_t;
+
+#define VD_LANES                2
+#define VMATH_NAME(Name)        Name##Sse2
+
+#define vd_set1(Value)          _mm_set1_pd(Value)
+#define vd_loadu(Pointer)       _mm_loadu_pd(Pointer)
+#define vd_storeu(Pointer, x)   _mm_storeu_pd(Pointer, x)
+#define vd_loadf(Pointer)       _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)(Pointer))))
+#define vd_storef(Pointer, x)   _mm_store_sd((double*)(Pointer), _mm_castps_pd(_mm_cvtpd_ps(x)))
+#define vd_add(a, b)            _mm_add_pd(a, b)
+#define vd_sub(a, b)            _mm_sub_pd(a, b)
+#define vd_mul(a, b)            _mm_mul_pd(a, b)
+#define vd_madd(a, b, c)        _mm_add_pd(_mm_mul_pd(a, b), c)
+#define vd_cmpeq(a, b)          _mm_cmpeq_pd(a, b)
+#define vd_sqrt(x)              _mm_sqrt_pd(x)
+#define vd_or(a, b)             _mm_or_pd(a, b)
+#define vd_xor(a, b)            _mm_xor_pd(a, b)
+#define vd_mask(x)              _mm_movemask_pd(x)
+#define vd_as_vi(x)             _mm_castpd_si128(x)
+
+#define vi_set1_32(Value)       _mm_set1_epi32(Value)
+#define vi_set1_64(Value)       _mm_set1_epi64x((long long)(Value))
+#define vi_add64(a, b)          _mm_add_epi64(a, b)
+#define vi_sub64(a, b)          _mm_sub_epi64(a, b)
+#define vi_sub32(a, b)          _mm_sub_epi32(a, b)
+#define vi_and(a, b)            _mm_and_si128(a, b)
+#define vi_or(a, b)             _mm_or_si128(a, b)
+#define vi_xor(a, b)            _mm_xor_si128(a, b)
+#define vi_sll64(a, Count)      _mm_slli_epi64(a, Count)
+#define vi_srl64(a, Count)      _mm_srli_epi64(a, Count)
+#define vi_cmpgt32(a, b)        _mm_cmpgt_epi32(a, b)
+#define vi_hiword(a)            _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 1, 1))
+#define vi_as_vd(a)             _mm_castsi128_pd(a)
+
+/* Mask lanes are all ones or all zeros, pick IfSet where the mask is set */
+static inline vd_t
+vd_select(
+    _In_ vd_t Mask,
+    _In_ vd_t IfSet,
+    _In_ vd_t IfClear)
+{
+    return _mm_or_pd(_mm_and_pd(Mask, IfSet), _mm_andnot_pd(Mask, IfClear));
+}
+
+/* Table indices are below 2^31, so the low word of each lane is enough */
+static inline vi_t
+vi_gather64(
+    _In_ const uint64_t* Table,
+    _In_ vi_t            Index)
+{
+    int Low  = _mm_cvtsi128_si32(Index);
+    int High = _mm_cvtsi128_si32(_mm_srli_si128(Index, 8));
+    return _mm_set_epi64x((long long)Table[High], (long long)Table[Low]);
+}
+
+static inline vd_t
+vd_gather(
+    _In_ const double* Table,
+    _In_ vi_t          Index)
+{
+    int Low  = _mm_cvtsi128_si32(Index);
+    int High = _mm_cvtsi128_si32(_mm_srli_si128(Index, 8));
+    return _mm_set_pd(Table[High], Table[Low]);
+}
+
+#include "vmath_kernels.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
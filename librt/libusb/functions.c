@@ -239,6 +239,17 @@ UsbTransferQueue(
     // Debug
     TRACE("UsbTransferQueue()");
 
+    // Setup packets from the shared pool are copied from our mapping of the pool, so
+    // controllers that embed the packet need not map the buffer themselves
+    if (Transfer->Type == ControlTransfer && __LibUsbBuffer != NULL &&
+        Transfer->Transactions[0].BufferAddress >= GetBufferDma(__LibUsbBuffer) &&
+        Transfer->Transactions[0].BufferAddress + sizeof(UsbPacket_t) <= 
+            GetBufferDma(__LibUsbBuffer) + GetBufferSize(__LibUsbBuffer)) {
+        memcpy(&Transfer->SetupPacket, (uint8_t*)GetBufferDataPointer(__LibUsbBuffer) + 
+            (Transfer->Transactions[0].BufferAddress - GetBufferDma(__LibUsbBuffer)), sizeof(UsbPacket_t));
+        Transfer->Flags |= USB_TRANSFER_SETUP_INLINE;
+    }
+
     // Setup contract stuff for request
     Contract.DriverId   = Driver;
     Contract.Type       = ContractController;
@@ -306,6 +317,29 @@ UsbTransferDequeuePeriodic(
     }
 }
 
+/* UsbTransferCancel
+ * Cancels a control or bulk transfer that is still pending on the controller. The caller
+ * waiting for the transfer is answered with TransferCancelled. */
+UsbTransferStatus_t
+UsbTransferCancel(
+	_In_ UUId_t                     Driver,
+	_In_ UUId_t                     Device,
+	_In_ UsbTransfer_t*             Transfer)
+{
+    UsbTransferStatus_t Result = TransferInvalid;
+    MContract_t         Contract;
+
+    Contract.DriverId   = Driver;
+    Contract.Type       = ContractController;
+    Contract.Version    = __USBMANAGER_INTERFACE_VERSION;
+    if (QueryDriver(&Contract, __USBHOST_CANCELTRANSFER,
+        &Device, sizeof(UUId_t), Transfer, sizeof(UsbTransfer_t), 
+        NULL, 0, &Result, sizeof(UsbTransferStatus_t)) != OsSuccess) {
+        return TransferInvalid;
+    }
+    return Result;
+}
+
 /* UsbHubResetPort
  * Resets the given port on the given controller and queries it's
  * status afterwards. This returns an updated status of the port after
@@ -113,7 +113,7 @@ PS2KeyboardHandleModifiers(
 }
 
 /* PS2KeyboardFastInterrupt 
- * Handles the ps2-keyboard interrupt and extracts the data for processing - fast interrupt */
+ * Handles the ps2-keyboard interrupt and assembles the scancode sequences - fast interrupt */
 InterruptStatus_t
 PS2KeyboardFastInterrupt(
     _In_ FastInterruptResources_t*  InterruptTable,
@@ -123,56 +123,84 @@ PS2KeyboardFastInterrupt(
     PS2Port_t* Port       = (PS2Port_t*)INTERRUPT_RESOURCE(InterruptTable, 0);
     uint8_t DataRecieved  = (uint8_t)InterruptTable->ReadIoSpace(IoSpace, PS2_REGISTER_DATA, 1);
     PS2Command_t* Command = &Port->ActiveCommand;
+    PS2Packet_t* Packet   = &Port->Assembly;
+    PS2Packet_t* Slot;
+    uint8_t i;
 
     if (Command->State != PS2Free) {
         Command->Buffer[Command->SyncObject] = DataRecieved;
         Command->SyncObject++;
         return InterruptHandledStop;
     }
-    else {
-        Port->ResponseBuffer[Port->ResponseWriteIndex++] = DataRecieved;
-        if (Port->ResponseWriteIndex == PS2_RINGBUFFER_SIZE) {
-            Port->ResponseWriteIndex = 0; // Start over
-        }
 
-        // Determine if it is an actual scancode or extension code
-        if (DataRecieved != PS2_CODE_EXTENDED && DataRecieved != PS2_CODE_RELEASED) {
-            return InterruptHandled;
-        }
+    // The key is stamped when the first byte of the sequence arrives
+    if (Packet->Length == 0) {
+        Packet->Timestamp = InterruptTable->ReadTimestamp();
+    }
+    Packet->Data[Packet->Length++] = DataRecieved;
+
+    // Determine if it is an actual scancode or extension code
+    if ((DataRecieved == PS2_CODE_EXTENDED || DataRecieved == PS2_CODE_RELEASED) &&
+        Packet->Length != PS2_PACKET_MAX_BYTES) {
+        return InterruptHandledStop;
     }
-    return InterruptHandledStop;
+
+    if ((uint8_t)(Port->PacketWriteIndex - Port->PacketReadIndex) == PS2_PACKET_QUEUE_SIZE) {
+        Port->PacketsDropped++;
+        Packet->Length = 0;
+        return InterruptHandledStop;
+    }
+
+    Slot = &Port->Packets[Port->PacketWriteIndex & PS2_PACKET_QUEUE_MASK];
+    for (i = 0; i < Packet->Length; i++) {
+        Slot->Data[i] = Packet->Data[i];
+    }
+    Slot->Length    = Packet->Length;
+    Slot->Timestamp = Packet->Timestamp;
+    Packet->Length  = 0;
+    MemoryBarrier();
+    Port->PacketWriteIndex++;
+    return InterruptHandled;
 }
 
 /* PS2KeyboardInterrupt 
- * Handles the ps2-keyboard interrupt and processes the captured data */
+ * Handles the ps2-keyboard interrupt and delivers all queued keys as one batch */
 InterruptStatus_t
 PS2KeyboardInterrupt(
     _In_ PS2Port_t* Port)
 {
-    OsStatus_t Status   = OsError;
-    uint8_t ScancodeSet = PS2_KEYBOARD_DATA_SCANCODESET(Port);
-    SystemKey_t Key     = { 0 };
+    PS2Packet_t Packets[PS2_PACKET_QUEUE_SIZE];
+    SystemKey_t Keys[PS2_PACKET_QUEUE_SIZE];
+    uint8_t     ScancodeSet = PS2_KEYBOARD_DATA_SCANCODESET(Port);
+    size_t      Count       = PS2PortReadPackets(Port, &Packets[0], PS2_PACKET_QUEUE_SIZE);
+    size_t      KeyCount    = 0;
+    size_t      i, j;
+
+    if (Count != 0 && ScancodeSet != 2) {
+        ERROR("PS2-Keyboard: Scancode set %u", ScancodeSet);
+        return InterruptHandled;
+    }
 
     // Perform scancode-translation
-    while (Status == OsError) {
-        uint8_t Scancode = Port->ResponseBuffer[Port->ResponseReadIndex++];
-        if (Port->ResponseReadIndex == PS2_RINGBUFFER_SIZE) {
-            Port->ResponseReadIndex = 0; // Start over
-        }
+    for (i = 0; i < Count; i++) {
+        SystemKey_t* Key   = &Keys[KeyCount];
+        OsStatus_t  Status = OsError;
 
-        if (ScancodeSet == 1) {
-            ERROR("PS2-Keyboard: Scancode set 1");
-            break;
+        memset(Key, 0, sizeof(SystemKey_t));
+        for (j = 0; j < Packets[i].Length && Status == OsError; j++) {
+            Status = ScancodeSet2ToVKey(Key, Packets[i].Data[j]);
         }
-        else if (ScancodeSet == 2) {
-            Status = ScancodeSet2ToVKey(&Key, Scancode);
+
+        // If the key was an actual key and not modifier, remove our flags and send
+        if (Status == OsSuccess && PS2KeyboardHandleModifiers(Port, Key) == OsSuccess) {
+            Key->Flags    &= ~(KEY_MODIFIER_EXTENDED);
+            Key->Timestamp = Packets[i].Timestamp;
+            KeyCount++;
         }
     }
 
-    // If the key was an actual key and not modifier, remove our flags and send
-    if (PS2KeyboardHandleModifiers(Port, &Key) == OsSuccess) {
-        Key.Flags &= ~(KEY_MODIFIER_EXTENDED);
-        Status    = WriteSystemKey(&Key);
+    if (KeyCount != 0) {
+        WriteSystemKeys(&Keys[0], KeyCount);
     }
     return InterruptHandled;
 }
@@ -278,6 +306,7 @@ PS2KeyboardInitialize(
     PS2_KEYBOARD_DATA_SCANCODESET(Instance) = 2;
     PS2_KEYBOARD_DATA_REPEAT(Instance)      = PS2_REPEATS_PERSEC(16);
     PS2_KEYBOARD_DATA_DELAY(Instance)       = PS2_DELAY_500MS;
+    Instance->Assembly.Length               = 0;
 
     // Start out by initializing the contract
     InitializeContract(&Instance->Contract, Instance->Contract.DeviceId, 1,
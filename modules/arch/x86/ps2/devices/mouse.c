@@ -28,7 +28,8 @@
 #include "mouse.h"
 
 /* PS2MouseFastInterrupt 
- * Handles the ps2-mouse interrupt and extracts the data for processing - fast interrupt */
+ * Handles the ps2-mouse interrupt and assembles the data into packets - fast interrupt. Motion
+ * is merged into the last queued packet while it has not been read and the buttons are unchanged. */
 InterruptStatus_t
 PS2MouseFastInterrupt(
     _In_ FastInterruptResources_t*  InterruptTable,
@@ -37,66 +38,124 @@ PS2MouseFastInterrupt(
     DeviceIo_t* IoSpace     = INTERRUPT_IOSPACE(InterruptTable, 0);
     PS2Port_t* Port         = (PS2Port_t*)INTERRUPT_RESOURCE(InterruptTable, 0);
     uint8_t DataRecieved    = (uint8_t)InterruptTable->ReadIoSpace(IoSpace, PS2_REGISTER_DATA, 1);
-    uint8_t BreakAtBytes    = PS2_MOUSE_DATA_MODE(Port) == 0 ? 3 : 4;
+    uint8_t BytesRequired   = PS2_MOUSE_DATA_MODE(Port) == 0 ? 3 : 4;
     PS2Command_t* Command   = &Port->ActiveCommand;
+    PS2Packet_t* Packet     = &Port->Assembly;
+    PS2Packet_t* Last;
+    uint8_t Queued;
+    int X, Y, Z;
 
     if (Command->State != PS2Free) {
         Command->Buffer[Command->SyncObject] = DataRecieved;
         Command->SyncObject++;
         return InterruptHandledStop;
     }
-    else {
-        Port->ResponseBuffer[Port->ResponseWriteIndex++] = DataRecieved;
-        if (!(Port->ResponseWriteIndex % BreakAtBytes)) {
-            if (Port->ResponseWriteIndex == PS2_RINGBUFFER_SIZE) {
-                Port->ResponseWriteIndex = 0; // Start over
+
+    // The first byte of a packet always has the sync bit set, drop bytes until
+    // we are aligned with the packets again
+    if (Packet->Length == 0) {
+        if (!(DataRecieved & PS2_MOUSE_SYNC)) {
+            return InterruptHandledStop;
+        }
+        Packet->Timestamp = InterruptTable->ReadTimestamp();
+    }
+    Packet->Data[Packet->Length++] = DataRecieved;
+    if (Packet->Length != BytesRequired) {
+        return InterruptHandledStop;
+    }
+    Packet->Length = 0;
+
+    // Decode the packet, motion is discarded on overflow
+    Packet->Buttons   = Packet->Data[0] & 0x7; // L-M-R buttons
+    Packet->RelativeX = 0;
+    Packet->RelativeY = 0;
+    Packet->RelativeZ = 0;
+    if (!(Packet->Data[0] & PS2_MOUSE_XOVERFLOW)) {
+        Packet->RelativeX = (int16_t)(Packet->Data[1] - ((Packet->Data[0] << 4) & 0x100));
+    }
+    if (!(Packet->Data[0] & PS2_MOUSE_YOVERFLOW)) {
+        Packet->RelativeY = (int16_t)(Packet->Data[2] - ((Packet->Data[0] << 3) & 0x100));
+    }
+    if (PS2_MOUSE_DATA_MODE(Port) == 1) {
+        Packet->RelativeZ = (int16_t)(int8_t)Packet->Data[3];
+    }
+    else if (PS2_MOUSE_DATA_MODE(Port) == 2) {
+        // 4 bit signed value
+        Packet->RelativeZ = (int16_t)((int8_t)(Packet->Data[3] << 4) >> 4);
+        if (Packet->Data[3] & PS2_MOUSE_4BTN) {
+            Packet->Buttons |= 0x8;
+        }
+        if (Packet->Data[3] & PS2_MOUSE_5BTN) {
+            Packet->Buttons |= 0x10;
+        }
+    }
+
+    // Merge the motion into the last packet if the driver has not taken it yet, the
+    // pending event will deliver it. The read index is checked again after the sequence
+    // is made odd, so the driver either sees the update or we queue a new packet.
+    Queued = (uint8_t)(Port->PacketWriteIndex - Port->PacketReadIndex);
+    if (Queued != 0) {
+        Last = &Port->Packets[(uint8_t)(Port->PacketWriteIndex - 1) & PS2_PACKET_QUEUE_MASK];
+        X    = Last->RelativeX + Packet->RelativeX;
+        Y    = Last->RelativeY + Packet->RelativeY;
+        Z    = Last->RelativeZ + Packet->RelativeZ;
+        if (Last->Buttons == Packet->Buttons && PS2_MOUSE_DELTA_VALID(X) &&
+            PS2_MOUSE_DELTA_VALID(Y) && PS2_MOUSE_DELTA_VALID(Z)) {
+            Last->Sequence++;
+            MemoryBarrier();
+            if (Port->PacketWriteIndex != Port->PacketReadIndex) {
+                Last->RelativeX = (int16_t)X;
+                Last->RelativeY = (int16_t)Y;
+                Last->RelativeZ = (int16_t)Z;
+                MemoryBarrier();
+                Last->Sequence++;
+                return InterruptHandledStop;
             }
-            return InterruptHandled;
+            Last->Sequence++;
+            Queued = 0;
         }
     }
-    return InterruptHandledStop;
+
+    if (Queued == PS2_PACKET_QUEUE_SIZE) {
+        Port->PacketsDropped++;
+        return InterruptHandledStop;
+    }
+
+    Last = &Port->Packets[Port->PacketWriteIndex & PS2_PACKET_QUEUE_MASK];
+    Last->Timestamp = Packet->Timestamp;
+    Last->Buttons   = Packet->Buttons;
+    Last->RelativeX = Packet->RelativeX;
+    Last->RelativeY = Packet->RelativeY;
+    Last->RelativeZ = Packet->RelativeZ;
+    MemoryBarrier();
+    Port->PacketWriteIndex++;
+    return InterruptHandled;
 }
 
 /* PS2MouseInterrupt 
- * Handles the ps2-mouse interrupt and processes the captured data */
+ * Handles the ps2-mouse interrupt and delivers all queued packets as one batch */
 InterruptStatus_t
 PS2MouseInterrupt(
     _In_ PS2Port_t*                 Port)
 {
-    SystemInput_t Input;
-    uint8_t BytesRequired = PS2_MOUSE_DATA_MODE(Port) == 0 ? 3 : 4;
-
-    // Set initial
-    Input.Type  = DeviceInputPointer;
-    Input.Flags = 0;
+    PS2Packet_t   Packets[PS2_PACKET_QUEUE_SIZE];
+    SystemInput_t Inputs[PS2_PACKET_QUEUE_SIZE];
+    size_t        Count = PS2PortReadPackets(Port, &Packets[0], PS2_PACKET_QUEUE_SIZE);
+    size_t        i;
 
-    // Update relative x and y
-    Input.RelativeX = (int16_t)(Port->ResponseBuffer[Port->ResponseReadIndex + 1] - ((Port->ResponseBuffer[Port->ResponseReadIndex] << 4) & 0x100));
-    Input.RelativeY = (int16_t)(Port->ResponseBuffer[Port->ResponseReadIndex + 2] - ((Port->ResponseBuffer[Port->ResponseReadIndex] << 3) & 0x100));
-    Input.Buttons   = Port->ResponseBuffer[0] & 0x7; // L-M-R buttons
-
-    // Check extended data modes
-    if (PS2_MOUSE_DATA_MODE(Port) == 1) {
-        Input.RelativeZ = (int16_t)(char)Port->ResponseBuffer[Port->ResponseReadIndex + 3];
+    for (i = 0; i < Count; i++) {
+        Inputs[i].Type      = DeviceInputPointer;
+        Inputs[i].Flags     = 0;
+        Inputs[i].RelativeX = Packets[i].RelativeX;
+        Inputs[i].RelativeY = Packets[i].RelativeY;
+        Inputs[i].RelativeZ = Packets[i].RelativeZ;
+        Inputs[i].Buttons   = Packets[i].Buttons;
+        Inputs[i].Timestamp = Packets[i].Timestamp;
     }
-    else if (PS2_MOUSE_DATA_MODE(Port) == 2) {
-        // 4 bit signed value
-        Input.RelativeZ = (int16_t)(char)(Port->ResponseBuffer[Port->ResponseReadIndex + 3] & 0xF);
-        if (Port->ResponseBuffer[Port->ResponseReadIndex + 3] & PS2_MOUSE_4BTN) {
-            Input.Buttons |= 0x8;
-        }
-        if (Port->ResponseBuffer[Port->ResponseReadIndex + 3] & PS2_MOUSE_5BTN) {
-            Input.Buttons |= 0x10;
-        }
-    }
-    else {
-        Input.RelativeZ = 0;
-    }
-    Port->ResponseReadIndex += BytesRequired;
-    if (Port->ResponseReadIndex == PS2_RINGBUFFER_SIZE) {
-        Port->ResponseReadIndex = 0;
+
+    if (Count != 0) {
+        WriteSystemInputs(&Inputs[0], Count);
     }
-    WriteSystemInput(&Input);
     return InterruptHandled;
 }
 
@@ -179,6 +238,7 @@ PS2MouseInitialize(
     // Set initial mouse sampling
     PS2_MOUSE_DATA_SAMPLING(Instance)   = 100;
     PS2_MOUSE_DATA_MODE(Instance)       = 0;
+    Instance->Assembly.Length           = 0;
 
     // Start out by initializing the contract
     InitializeContract(&Instance->Contract, 
@@ -40,6 +40,11 @@
 #define PS2_MOUSE_4BTN                  0x10
 #define PS2_MOUSE_5BTN                  0x20
 
+#define PS2_MOUSE_SYNC                  0x08
+#define PS2_MOUSE_XOVERFLOW             0x40
+#define PS2_MOUSE_YOVERFLOW             0x80
+#define PS2_MOUSE_DELTA_VALID(Value)    ((Value) >= INT16_MIN && (Value) <= INT16_MAX)
+
 #define PS2_MOUSE_DATA_SAMPLING(Port)   (Port)->DeviceData[0]
 #define PS2_MOUSE_DATA_MODE(Port)       (Port)->DeviceData[1]
 
@@ -235,6 +235,9 @@ OnInterrupt(
     _In_Opt_ size_t Arg2)
 {
     PS2Port_t* Port = (PS2Port_t*)InterruptData;
+
+    // Arg0 is the number of coalesced events, the device handlers
+    // always take every queued packet so it can be ignored
     _CRT_UNUSED(Arg0);
     _CRT_UNUSED(Arg1);
     _CRT_UNUSED(Arg2);
@@ -278,6 +278,53 @@ PS2PortFinishCommand(
     return OsSuccess;
 }
 
+/* PS2PortCopyPacket
+ * Copies a queued packet, retries if the fast interrupt handler updated it meanwhile. */
+static void
+PS2PortCopyPacket(
+    _In_ PS2Packet_t* Packet,
+    _In_ PS2Packet_t* Copy)
+{
+    uint32_t Sequence;
+    do {
+        Sequence = Packet->Sequence;
+        MemoryBarrier();
+        memcpy(Copy, Packet, sizeof(PS2Packet_t));
+        MemoryBarrier();
+    } while ((Sequence & 1) || Sequence != Packet->Sequence);
+}
+
+/* PS2PortReadPackets
+ * Takes up to <MaxPackets> completed packets from the port, in the order they were
+ * received. Returns the number of packets copied to <Packets>. */
+size_t
+PS2PortReadPackets(
+    _In_ PS2Port_t*   Port,
+    _In_ PS2Packet_t* Packets,
+    _In_ size_t       MaxPackets)
+{
+    uint8_t ReadIndex = Port->PacketReadIndex;
+    size_t  Count     = (uint8_t)(Port->PacketWriteIndex - ReadIndex);
+    size_t  i;
+
+    Count = MIN(Count, MaxPackets);
+    for (i = 0; i < Count; i++) {
+        PS2PortCopyPacket(&Port->Packets[(ReadIndex + i) & PS2_PACKET_QUEUE_MASK], &Packets[i]);
+    }
+
+    // Hand the packets back to the fast handler. It may have merged motion into the last
+    // packet after we copied it, once it sees the new read index it queues new packets instead
+    Port->PacketReadIndex = (uint8_t)(ReadIndex + Count);
+    MemoryBarrier();
+    if (Count != 0) {
+        PS2Packet_t* Last = &Port->Packets[(ReadIndex + Count - 1) & PS2_PACKET_QUEUE_MASK];
+        if (Last->Sequence != Packets[Count - 1].Sequence) {
+            PS2PortCopyPacket(Last, &Packets[Count - 1]);
+        }
+    }
+    return Count;
+}
+
 /* PS2PortInitialize
  * Initializes the given port and tries to identify the device on the port */
 OsStatus_t
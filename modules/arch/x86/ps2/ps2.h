@@ -37,7 +37,9 @@
  * like port count etc */
 #define PS2_MAXPORTS                2
 #define PS2_MAX_RETRIES             3
-#define PS2_RINGBUFFER_SIZE         36      // Should be divisable between 3 and 4
+#define PS2_PACKET_QUEUE_SIZE       16      // Must be a power of two
+#define PS2_PACKET_QUEUE_MASK       (PS2_PACKET_QUEUE_SIZE - 1)
+#define PS2_PACKET_MAX_BYTES        4
 
 /* Status definitons from reading the status
  * register in the PS2-Controller */
@@ -101,6 +103,21 @@ typedef struct _PS2Command {
     uint8_t*                    Response;
 } PS2Command_t;
 
+/* PS2Packet
+ * A complete device packet assembled by the fast interrupt handler. Mouse packets are
+ * decoded into motion and buttons, keyboard packets keep the scancode sequence. The
+ * sequence is odd while the fast handler merges motion into a queued packet. */
+typedef struct _PS2Packet {
+    volatile uint32_t           Sequence;
+    uint64_t                    Timestamp;
+    uint8_t                     Length;
+    uint8_t                     Data[PS2_PACKET_MAX_BYTES];
+    uint8_t                     Buttons;
+    int16_t                     RelativeX;
+    int16_t                     RelativeY;
+    int16_t                     RelativeZ;
+} PS2Packet_t;
+
 typedef enum _PS2PortState {
     PortStateDisabled,
     PortStateEnabled,
@@ -121,9 +138,14 @@ typedef struct _PS2Port {
 
     // Device state information
     uint8_t             DeviceData[6];
-    uint8_t             ResponseBuffer[PS2_RINGBUFFER_SIZE];
-    uint8_t             ResponseWriteIndex;
-    uint8_t             ResponseReadIndex;
+
+    // Packets completed by the fast interrupt handler, the write index is owned by the
+    // fast handler and the read index by PS2PortReadPackets
+    PS2Packet_t         Assembly;
+    PS2Packet_t         Packets[PS2_PACKET_QUEUE_SIZE];
+    volatile uint8_t    PacketWriteIndex;
+    volatile uint8_t    PacketReadIndex;
+    volatile size_t     PacketsDropped;
 } PS2Port_t;
 
 /* PS2Controller
@@ -160,6 +182,15 @@ __EXTERN OsStatus_t
 PS2PortFinishCommand(
     _In_ PS2Port_t*                 Port);
 
+/* PS2PortReadPackets
+ * Takes up to <MaxPackets> completed packets from the port, in the order they were
+ * received. Returns the number of packets copied to <Packets>. */
+__EXTERN size_t
+PS2PortReadPackets(
+    _In_ PS2Port_t*                 Port,
+    _In_ PS2Packet_t*               Packets,
+    _In_ size_t                     MaxPackets);
+
 /* PS2ReadData
  * Reads a byte from the PS2 controller data port */
 __EXTERN uint8_t PS2ReadData(int Dummy);
@@ -188,7 +219,7 @@ PS2MouseCleanup(
     _In_ int                        Port);
 
 /* PS2MouseInterrupt 
- * Handles the ps2-mouse interrupt and processes the captured data */
+ * Handles the ps2-mouse interrupt and delivers all queued packets as one batch */
 __EXTERN InterruptStatus_t
 PS2MouseInterrupt(
     _In_ PS2Port_t*                 Port);
@@ -211,7 +242,7 @@ PS2KeyboardCleanup(
     _In_ int                        Port);
 
 /* PS2KeyboardInterrupt 
- * Handles the ps2-keyboard interrupt and processes the captured data */
+ * Handles the ps2-keyboard interrupt and delivers all queued keys as one batch */
 __EXTERN InterruptStatus_t
 PS2KeyboardInterrupt(
     _In_ PS2Port_t*                 Port);
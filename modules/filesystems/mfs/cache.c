@@ -0,0 +1,265 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - General File System (MFS) Driver
+ *  - Directory entry cache, maps (directory, name) pairs to the file-records
+ *    they resolve to, or to the knowledge that the name does not exist.
+ */
+//#define __TRACE
+
+#include <ddk/utils.h>
+#include "mfs.h"
+#include <stdlib.h>
+#include <strings.h>
+#include <string.h>
+#include <ctype.h>
+
+static size_t
+MfsDentryHash(
+    _In_ uint32_t    DirectoryBucket,
+    _In_ const char* Name)
+{
+    size_t Hash = 5381 + DirectoryBucket;
+    while (*Name) {
+        Hash = ((Hash << 5) + Hash) + (size_t)tolower((unsigned char)*Name);
+        Name++;
+    }
+    return Hash;
+}
+
+static void
+MfsDentryUnlink(
+    _In_ MfsDentryCache_t* Cache,
+    _In_ MfsDentry_t*      Dentry)
+{
+    MfsDentry_t** Link = &Cache->Buckets[Dentry->Hash % MFS_DENTRY_HASH_SIZE];
+    while (*Link != NULL && *Link != Dentry) {
+        Link = &(*Link)->HashLink;
+    }
+    if (*Link != NULL) {
+        *Link = Dentry->HashLink;
+    }
+
+    if (Dentry->LruPrevious != NULL) Dentry->LruPrevious->LruNext = Dentry->LruNext;
+    else                             Cache->LruHead               = Dentry->LruNext;
+    if (Dentry->LruNext != NULL)     Dentry->LruNext->LruPrevious = Dentry->LruPrevious;
+    else                             Cache->LruTail               = Dentry->LruPrevious;
+    Dentry->HashLink    = NULL;
+    Dentry->LruPrevious = NULL;
+    Dentry->LruNext     = NULL;
+    Dentry->InUse       = 0;
+}
+
+static void
+MfsDentryTouch(
+    _In_ MfsDentryCache_t* Cache,
+    _In_ MfsDentry_t*      Dentry)
+{
+    if (Cache->LruHead == Dentry) {
+        return;
+    }
+
+    // Unlink from current position and insert at head
+    if (Dentry->LruPrevious != NULL) Dentry->LruPrevious->LruNext = Dentry->LruNext;
+    if (Dentry->LruNext != NULL)     Dentry->LruNext->LruPrevious = Dentry->LruPrevious;
+    else if (Cache->LruTail == Dentry) Cache->LruTail             = Dentry->LruPrevious;
+
+    Dentry->LruPrevious = NULL;
+    Dentry->LruNext     = Cache->LruHead;
+    if (Cache->LruHead != NULL) {
+        Cache->LruHead->LruPrevious = Dentry;
+    }
+    Cache->LruHead = Dentry;
+    if (Cache->LruTail == NULL) {
+        Cache->LruTail = Dentry;
+    }
+}
+
+/* MfsDentryCacheInitialize
+ * Allocates the directory entry cache for the filesystem instance. */
+OsStatus_t
+MfsDentryCacheInitialize(
+    _In_ MfsInstance_t* Mfs)
+{
+    Mfs->DentryCache = (MfsDentryCache_t*)malloc(sizeof(MfsDentryCache_t));
+    if (Mfs->DentryCache == NULL) {
+        return OsError;
+    }
+    memset(Mfs->DentryCache, 0, sizeof(MfsDentryCache_t));
+    return OsSuccess;
+}
+
+/* MfsDentryCacheDestroy
+ * Releases the directory entry cache of the filesystem instance. */
+void
+MfsDentryCacheDestroy(
+    _In_ MfsInstance_t* Mfs)
+{
+    if (Mfs->DentryCache != NULL) {
+        free(Mfs->DentryCache);
+        Mfs->DentryCache = NULL;
+    }
+}
+
+/* MfsDentryCacheLookup
+ * Looks up the name in the given directory. Returns NULL if the cache has no knowledge
+ * of the name, otherwise the entry which can be negative if the name does not exist. */
+MfsDentry_t*
+MfsDentryCacheLookup(
+    _In_ MfsInstance_t* Mfs,
+    _In_ uint32_t       DirectoryBucket,
+    _In_ const char*    Name)
+{
+    MfsDentryCache_t* Cache = Mfs->DentryCache;
+    MfsDentry_t*      Dentry;
+    size_t            Hash;
+
+    if (Cache == NULL || Name == NULL) {
+        return NULL;
+    }
+
+    Hash   = MfsDentryHash(DirectoryBucket, Name);
+    Dentry = Cache->Buckets[Hash % MFS_DENTRY_HASH_SIZE];
+    while (Dentry != NULL) {
+        if (Dentry->Hash == Hash && Dentry->DirectoryBucket == DirectoryBucket &&
+            !strcasecmp((const char*)&Dentry->Record.Name[0], Name)) {
+            MfsDentryTouch(Cache, Dentry);
+            Cache->Hits++;
+            return Dentry;
+        }
+        Dentry = Dentry->HashLink;
+    }
+    Cache->Misses++;
+    return NULL;
+}
+
+/* MfsDentryCacheInsert
+ * Inserts or replaces the entry for the name in the given directory. If <Record> is NULL
+ * a negative entry is inserted. The least recently used entry is evicted when full. */
+void
+MfsDentryCacheInsert(
+    _In_ MfsInstance_t* Mfs,
+    _In_ uint32_t       DirectoryBucket,
+    _In_ const char*    Name,
+    _In_ FileRecord_t*  Record,
+    _In_ uint32_t       RecordBucket,
+    _In_ uint32_t       RecordLength,
+    _In_ size_t         RecordIndex)
+{
+    MfsDentryCache_t* Cache = Mfs->DentryCache;
+    MfsDentry_t*      Dentry;
+    size_t            NameLength;
+    int               i;
+
+    if (Cache == NULL || Name == NULL) {
+        return;
+    }
+
+    NameLength = strlen(Name);
+    if (NameLength >= sizeof(Cache->Entries[0].Record.Name)) {
+        return;
+    }
+
+    // Replace any existing knowledge of the name
+    MfsDentryCacheInvalidate(Mfs, DirectoryBucket, Name);
+
+    // Find an unused entry or evict the least recently used one
+    Dentry = NULL;
+    for (i = 0; i < MFS_DENTRY_CACHE_SIZE; i++) {
+        if (!Cache->Entries[i].InUse) {
+            Dentry = &Cache->Entries[i];
+            break;
+        }
+    }
+    if (Dentry == NULL) {
+        Dentry = Cache->LruTail;
+        MfsDentryUnlink(Cache, Dentry);
+        Cache->Evictions++;
+    }
+
+    if (Record != NULL) {
+        memcpy(&Dentry->Record, Record, sizeof(FileRecord_t));
+        Dentry->Negative = 0;
+    }
+    else {
+        memset(&Dentry->Record, 0, sizeof(FileRecord_t));
+        memcpy(&Dentry->Record.Name[0], Name, NameLength);
+        Dentry->Negative = 1;
+    }
+    Dentry->InUse           = 1;
+    Dentry->DirectoryBucket = DirectoryBucket;
+    Dentry->RecordBucket    = RecordBucket;
+    Dentry->RecordLength    = RecordLength;
+    Dentry->RecordIndex     = RecordIndex;
+    Dentry->Hash            = MfsDentryHash(DirectoryBucket, Name);
+
+    Dentry->HashLink = Cache->Buckets[Dentry->Hash % MFS_DENTRY_HASH_SIZE];
+    Cache->Buckets[Dentry->Hash % MFS_DENTRY_HASH_SIZE] = Dentry;
+    MfsDentryTouch(Cache, Dentry);
+}
+
+/* MfsDentryCacheInvalidateDirectory
+ * Removes all entries that were looked up in the given directory, must be called when
+ * a directory is deleted as its buckets can be reused by a new directory. */
+void
+MfsDentryCacheInvalidateDirectory(
+    _In_ MfsInstance_t* Mfs,
+    _In_ uint32_t       DirectoryBucket)
+{
+    MfsDentryCache_t* Cache = Mfs->DentryCache;
+    int               i;
+
+    if (Cache == NULL) {
+        return;
+    }
+
+    for (i = 0; i < MFS_DENTRY_CACHE_SIZE; i++) {
+        if (Cache->Entries[i].InUse && Cache->Entries[i].DirectoryBucket == DirectoryBucket) {
+            MfsDentryUnlink(Cache, &Cache->Entries[i]);
+        }
+    }
+}
+
+/* MfsDentryCacheInvalidate
+ * Removes any knowledge of the name in the given directory, must be called whenever
+ * a record is created, deleted, moved or modified. */
+void
+MfsDentryCacheInvalidate(
+    _In_ MfsInstance_t* Mfs,
+    _In_ uint32_t       DirectoryBucket,
+    _In_ const char*    Name)
+{
+    MfsDentryCache_t* Cache = Mfs->DentryCache;
+    MfsDentry_t*      Dentry;
+    size_t            Hash;
+
+    if (Cache == NULL || Name == NULL) {
+        return;
+    }
+
+    Hash   = MfsDentryHash(DirectoryBucket, Name);
+    Dentry = Cache->Buckets[Hash % MFS_DENTRY_HASH_SIZE];
+    while (Dentry != NULL) {
+        if (Dentry->Hash == Hash && Dentry->DirectoryBucket == DirectoryBucket &&
+            !strcasecmp((const char*)&Dentry->Record.Name[0], Name)) {
+            MfsDentryUnlink(Cache, Dentry);
+            return;
+        }
+        Dentry = Dentry->HashLink;
+    }
+}
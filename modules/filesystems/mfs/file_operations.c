@@ -39,7 +39,7 @@ FsReadFromFile(
     MfsInstance_t*   Mfs             = (MfsInstance_t*)FileSystem->ExtensionData;
     MfsEntry_t*      Entry           = (MfsEntry_t*)Handle->Base.Entry;
     FileSystemCode_t Result          = FsOk;
-    uintptr_t        DataPointer     = GetBufferDma(BufferObject);
+    size_t           DataOffset      = 0;
     uint64_t         Position        = Handle->Base.Position;
     size_t           BucketSizeBytes = Mfs->SectorsPerBucket * FileSystem->Disk.Descriptor.SectorSize;
     size_t           BytesToRead     = Length;
@@ -59,7 +59,7 @@ FsReadFromFile(
     }
 
     // Debug counter values
-    TRACE(" > dma: 0x%x, fpos %u, bytes-total %u, bytes-at %u", DataPointer, 
+    TRACE(" > offset: %u, fpos %u, bytes-total %u, bytes-at %u", DataOffset, 
         LODWORD(Position), BytesToRead, *BytesAt);
 
     // Read the current sector, update index to where data starts
@@ -111,9 +111,10 @@ FsReadFromFile(
             break;
         }
 
-        // Perform the read (Raw - as we need to pass the datapointer)
+        // Perform the read (Raw - as we need to pass the buffer offset)
         if (StorageRead(FileSystem->Disk.Driver, FileSystem->Disk.Device, 
-            FileSystem->SectorStart + Sector, DataPointer, SectorCount, &SectorCount) != OsSuccess) {
+            FileSystem->SectorStart + Sector, GetBufferHandle(BufferObject), DataOffset, 
+            SectorCount, &SectorCount) != OsSuccess) {
             ERROR("Failed to read sector");
             Result = FsDiskError;
             break;
@@ -124,7 +125,7 @@ FsReadFromFile(
         if ((FileSystem->Disk.Descriptor.SectorSize * SectorCount) < ByteCount) {
             ByteCount = FileSystem->Disk.Descriptor.SectorSize * SectorCount;
         }
-        DataPointer += FileSystem->Disk.Descriptor.SectorSize * SectorCount;
+        DataOffset  += FileSystem->Disk.Descriptor.SectorSize * SectorCount;
         *BytesRead  += ByteCount;
         Position    += ByteCount;
         BytesToRead -= ByteCount;
@@ -271,6 +271,7 @@ FsDestroy(
     if (Mfs->BucketMap != NULL) {
         free(Mfs->BucketMap);
     }
+    MfsDentryCacheDestroy(Mfs);
 
     // Free structure and return
     free(Mfs);
@@ -399,6 +400,9 @@ FsInitialize(
         }
     }
     FsInitializeRootRecord(Mfs);
+    if (MfsDentryCacheInitialize(Mfs) != OsSuccess) {
+        WARNING("Failed to allocate the directory entry cache");
+    }
     return OsSuccess;
 
 Error:
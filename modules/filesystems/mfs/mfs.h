@@ -194,6 +194,7 @@ PACKED_TYPESTRUCT(MfsEntry, {
 
     uint64_t            AllocatedSize;
 
+    uint32_t            ParentBucket;       // First bucket of the parent directory
     uint32_t            DirectoryBucket;
     uint32_t            DirectoryLength;
     size_t              DirectoryIndex;
@@ -206,6 +207,36 @@ PACKED_TYPESTRUCT(MfsEntryHandle, {
     uint64_t                BucketByteBoundary;  // Support variadic bucket sizes
 });
 
+/* Directory entry cache
+ * Caches the result of looking up a name in a directory, identified by the first bucket
+ * of the directory. Negative entries record names that do not exist. */
+#define MFS_DENTRY_CACHE_SIZE           128
+#define MFS_DENTRY_HASH_SIZE            128
+
+typedef struct _MfsDentry {
+    struct _MfsDentry*  HashLink;
+    struct _MfsDentry*  LruPrevious;
+    struct _MfsDentry*  LruNext;
+    int                 InUse;
+    int                 Negative;
+    size_t              Hash;
+    uint32_t            DirectoryBucket;
+    uint32_t            RecordBucket;   // Where the record is stored in the directory
+    uint32_t            RecordLength;
+    size_t              RecordIndex;
+    FileRecord_t        Record;
+} MfsDentry_t;
+
+typedef struct _MfsDentryCache {
+    MfsDentry_t*        Buckets[MFS_DENTRY_HASH_SIZE];
+    MfsDentry_t*        LruHead;
+    MfsDentry_t*        LruTail;
+    size_t              Hits;
+    size_t              Misses;
+    size_t              Evictions;
+    MfsDentry_t         Entries[MFS_DENTRY_CACHE_SIZE];
+} MfsDentryCache_t;
+
 /* Mfs Instance data
  * Keeps track of the current state of an instance of
  * the mollenos-filesystem and keeps cached data as well */
@@ -225,6 +256,7 @@ typedef struct _MfsInstance {
     uint32_t*               BucketMap;
     MasterRecord_t          MasterRecord;
     FileRecord_t            RootRecord;
+    MfsDentryCache_t*       DentryCache;
 } MfsInstance_t;
 
 /* MfsReadSectors 
@@ -375,4 +407,55 @@ MfsFileRecordToVfsFile(
     _In_ FileRecord_t*              NativeEntry,
     _In_ MfsEntry_t*                VfsEntry);
 
+/* MfsDentryCacheInitialize
+ * Allocates the directory entry cache for the filesystem instance. */
+__EXTERN OsStatus_t
+MfsDentryCacheInitialize(
+    _In_ MfsInstance_t*             Mfs);
+
+/* MfsDentryCacheDestroy
+ * Releases the directory entry cache of the filesystem instance. */
+__EXTERN void
+MfsDentryCacheDestroy(
+    _In_ MfsInstance_t*             Mfs);
+
+/* MfsDentryCacheLookup
+ * Looks up the name in the given directory. Returns NULL if the cache has no knowledge
+ * of the name, otherwise the entry which can be negative if the name does not exist. */
+__EXTERN MfsDentry_t*
+MfsDentryCacheLookup(
+    _In_ MfsInstance_t*             Mfs,
+    _In_ uint32_t                   DirectoryBucket,
+    _In_ const char*                Name);
+
+/* MfsDentryCacheInsert
+ * Inserts or replaces the entry for the name in the given directory. If <Record> is NULL
+ * a negative entry is inserted. The least recently used entry is evicted when full. */
+__EXTERN void
+MfsDentryCacheInsert(
+    _In_ MfsInstance_t*             Mfs,
+    _In_ uint32_t                   DirectoryBucket,
+    _In_ const char*                Name,
+    _In_ FileRecord_t*              Record,
+    _In_ uint32_t                   RecordBucket,
+    _In_ uint32_t                   RecordLength,
+    _In_ size_t                     RecordIndex);
+
+/* MfsDentryCacheInvalidate
+ * Removes any knowledge of the name in the given directory, must be called whenever
+ * a record is created, deleted, moved or modified. */
+__EXTERN void
+MfsDentryCacheInvalidate(
+    _In_ MfsInstance_t*             Mfs,
+    _In_ uint32_t                   DirectoryBucket,
+    _In_ const char*                Name);
+
+/* MfsDentryCacheInvalidateDirectory
+ * Removes all entries that were looked up in the given directory, must be called when
+ * a directory is deleted as its buckets can be reused by a new directory. */
+__EXTERN void
+MfsDentryCacheInvalidateDirectory(
+    _In_ MfsInstance_t*             Mfs,
+    _In_ uint32_t                   DirectoryBucket);
+
 #endif //!_MFS_H_
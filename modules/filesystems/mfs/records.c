@@ -24,6 +24,7 @@
 #include <ddk/utils.h>
 #include "mfs.h"
 #include <stdlib.h>
+#include <strings.h>
 #include <string.h>
 
 OsStatus_t
@@ -60,6 +61,45 @@ MfsExtractToken(
     return OsSuccess;
 }
 
+/* MfsLocateRecordFollow
+ * Handles a matched record while locating a path, either the record is the final
+ * token of the path or it must be a directory that we continue the lookup in. */
+static FileSystemCode_t
+MfsLocateRecordFollow(
+    _In_ FileSystemDescriptor_t*    FileSystem,
+    _In_ uint32_t                   BucketOfDirectory,
+    _In_ MfsEntry_t*                Entry,
+    _In_ MString_t*                 Remaining,
+    _In_ FileRecord_t*              Record,
+    _In_ uint32_t                   RecordBucket,
+    _In_ uint32_t                   RecordLength,
+    _In_ size_t                     RecordIndex)
+{
+    // Two cases, if we are not at end of given path, then this
+    // entry must be a directory and it must have data
+    if (Remaining != NULL) {
+        if (!(Record->Flags & MFS_FILERECORD_DIRECTORY)) {
+            return FsPathIsNotDirectory;
+        }
+        if (Record->StartBucket == MFS_ENDOFCHAIN) {
+            return FsPathNotFound;
+        }
+
+        TRACE("Following the trail into bucket %u with the remaining path %s",
+            Record->StartBucket, MStringRaw(Remaining));
+        return MfsLocateRecord(FileSystem, Record->StartBucket, Entry, Remaining);
+    }
+    
+    MfsFileRecordToVfsFile(FileSystem, Record, Entry);
+
+    // Save where in the directory we found it
+    Entry->ParentBucket     = BucketOfDirectory;
+    Entry->DirectoryBucket  = RecordBucket;
+    Entry->DirectoryLength  = RecordLength;
+    Entry->DirectoryIndex   = RecordIndex;
+    return FsOk;
+}
+
 /* MfsLocateRecord
  * Locates a given file-record by the path given, all sub entries must be 
  * directories. File is only allocated and set if the function returns FsOk */
@@ -74,8 +114,8 @@ MfsLocateRecord(
     FileSystemCode_t    Result          = FsOk;
     MString_t*          Remaining       = NULL;
     MString_t*          Token           = NULL;
+    MfsDentry_t*        Dentry;
     uint32_t            CurrentBucket   = BucketOfDirectory;
-    int                 IsEndOfPath     = 0;
     int                 IsEndOfFolder   = 0;
     size_t              i;
     size_t              SectorsTransferred;
@@ -84,12 +124,9 @@ MfsLocateRecord(
 
     if (MStringLength(Path) != 0) {
         MfsExtractToken(Path, &Remaining, &Token);
-        if (Remaining == NULL) {
-            IsEndOfPath = 1;
-            if (Token == NULL) {
-                MfsFileRecordToVfsFile(FileSystem, &Mfs->RootRecord, Entry);
-                return FsOk;
-            }
+        if (Remaining == NULL && Token == NULL) {
+            MfsFileRecordToVfsFile(FileSystem, &Mfs->RootRecord, Entry);
+            return FsOk;
         }
     }
     else {
@@ -97,6 +134,19 @@ MfsLocateRecord(
         return FsOk;
     }
 
+    // Consult the directory entry cache before touching the disk
+    Dentry = MfsDentryCacheLookup(Mfs, BucketOfDirectory, MStringRaw(Token));
+    if (Dentry != NULL) {
+        if (Dentry->Negative) {
+            Result = FsPathNotFound;
+        }
+        else {
+            Result = MfsLocateRecordFollow(FileSystem, BucketOfDirectory, Entry, Remaining,
+                &Dentry->Record, Dentry->RecordBucket, Dentry->RecordLength, Dentry->RecordIndex);
+        }
+        goto Cleanup;
+    }
+
     // Iterate untill we reach end of folder
     while (!IsEndOfFolder) {
         FileRecord_t *Record = NULL;
@@ -124,55 +174,27 @@ MfsLocateRecord(
         // A record spans two sectors
         Record = (FileRecord_t*)GetBufferDataPointer(Mfs->TransferBuffer);
         for (i = 0; i < ((Mfs->SectorsPerBucket * Link.Length) / 2); i++) {
-            MString_t* Filename;
-            int CompareResult;
-
             if (!(Record->Flags & MFS_FILERECORD_INUSE)) { // Skip unused records
                 Record++;
                 continue;
             }
 
-            // Convert the filename into a mstring object
-            // and try to match it with our token (ignore case)
-            Filename        = MStringCreate((const char*)&Record->Name[0], StrUTF8);
-            CompareResult   = MStringCompare(Token, Filename, 1);
-            TRACE("Matching token %s == %s: %i", MStringRaw(Token), MStringRaw(Filename), CompareResult);
-            MStringDestroy(Filename);
-
-            if (CompareResult == MSTRING_FULL_MATCH) {
-                // Two cases, if we are not at end of given path, then this
-                // entry must be a directory and it must have data
-                if (IsEndOfPath == 0) {
-                    if (!(Record->Flags & MFS_FILERECORD_DIRECTORY)) {
-                        Result = FsPathIsNotDirectory;
-                        goto Cleanup;
-                    }
-                    if (Record->StartBucket == MFS_ENDOFCHAIN) {
-                        Result = FsPathNotFound;
-                        goto Cleanup;
-                    }
-
-                    TRACE("Following the trail into bucket %u with the remaining path %s",
-                        Record->StartBucket, MStringRaw(Remaining));
-                    Result = MfsLocateRecord(FileSystem, Record->StartBucket, Entry, Remaining);
-                    goto Cleanup;
-                }
-                else {
-                    MfsFileRecordToVfsFile(FileSystem, Record, Entry);
-
-                    // Save where in the directory we found it
-                    Entry->DirectoryBucket  = CurrentBucket;
-                    Entry->DirectoryLength  = Link.Length;
-                    Entry->DirectoryIndex   = i;
-                    Result                  = FsOk;
-                    goto Cleanup;
-                }
+            // Match the filename with our token (ignore case)
+            TRACE("Matching token %s == %s", MStringRaw(Token), (const char*)&Record->Name[0]);
+            if (!strcasecmp(MStringRaw(Token), (const char*)&Record->Name[0])) {
+                // Cache the record before following it, the transfer buffer is reused
+                MfsDentryCacheInsert(Mfs, BucketOfDirectory, MStringRaw(Token), 
+                    Record, CurrentBucket, Link.Length, i);
+                Result = MfsLocateRecordFollow(FileSystem, BucketOfDirectory, Entry, Remaining,
+                    Record, CurrentBucket, Link.Length, i);
+                goto Cleanup;
             }
             Record++;
         }
 
         // End of link?
         if (Link.Link == MFS_ENDOFCHAIN) {
+            MfsDentryCacheInsert(Mfs, BucketOfDirectory, MStringRaw(Token), NULL, 0, 0, 0);
             Result          = FsPathNotFound;
             IsEndOfFolder   = 1;
         }
@@ -246,9 +268,6 @@ MfsLocateFreeRecord(
         // A record spans two sectors
         Record = (FileRecord_t*)GetBufferDataPointer(Mfs->TransferBuffer);
         for (i = 0; i < ((Mfs->SectorsPerBucket * Link.Length) / 2); i++) {
-            MString_t* Filename;
-            int CompareResult;
-
             // Look for a file-record that's either deleted or
             // if we encounter the end of the file-record table
             if (!(Record->Flags & MFS_FILERECORD_INUSE)) {
@@ -257,6 +276,7 @@ MfsLocateFreeRecord(
                 if (IsEndOfPath) {
                     // Store initial stuff, like name
                     Entry->Base.Name        = MStringCreate((void*)MStringRaw(Token), StrUTF8);
+                    Entry->ParentBucket     = BucketOfDirectory;
                     Entry->DirectoryBucket  = CurrentBucket;
                     Entry->DirectoryLength  = Link.Length;
                     Entry->DirectoryIndex   = i;
@@ -270,14 +290,9 @@ MfsLocateFreeRecord(
                 }
             }
             
-            // Convert the filename into a mstring object
-            // and try to match it with our token (ignore case)
-            Filename        = MStringCreate((const char*)&Record->Name[0], StrUTF8);
-            CompareResult   = MStringCompare(Token, Filename, 1);
-            TRACE("Matching token %s == %s: %i", MStringRaw(Token), MStringRaw(Filename), CompareResult);
-            MStringDestroy(Filename);
-
-            if (CompareResult == MSTRING_FULL_MATCH) {
+            // Match the filename with our token (ignore case)
+            TRACE("Matching token %s == %s", MStringRaw(Token), (const char*)&Record->Name[0]);
+            if (!strcasecmp(MStringRaw(Token), (const char*)&Record->Name[0])) {
                 if (!IsEndOfPath) {
                     if (!(Record->Flags & MFS_FILERECORD_DIRECTORY)) {
                         Result = FsPathIsNotDirectory;
@@ -302,6 +317,7 @@ MfsLocateFreeRecord(
                             * FileSystem->Disk.Descriptor.SectorSize;
 
                         // Write back record bucket
+                        MfsDentryCacheInvalidate(Mfs, BucketOfDirectory, MStringRaw(Token));
                         if (MfsWriteSectors(FileSystem, Mfs->TransferBuffer,
                             MFS_GETSECTOR(Mfs, CurrentBucket), Mfs->SectorsPerBucket, &SectorsTransferred) != OsSuccess) {
                             ERROR("Failed to update bucket %u", CurrentBucket);
@@ -328,6 +344,7 @@ MfsLocateFreeRecord(
                     MfsFileRecordToVfsFile(FileSystem, Record, Entry);
 
                     // Save where in the directory we found it
+                    Entry->ParentBucket     = BucketOfDirectory;
                     Entry->DirectoryBucket  = CurrentBucket;
                     Entry->DirectoryLength  = Link.Length;
                     Entry->DirectoryIndex   = i;
@@ -36,7 +36,7 @@ MfsReadSectors(
 {
     uint64_t AbsoluteSector = FileSystem->SectorStart + Sector;
     return StorageRead(FileSystem->Disk.Driver, FileSystem->Disk.Device, 
-        AbsoluteSector, GetBufferDma(Buffer), Count, SectorsRead);
+        AbsoluteSector, GetBufferHandle(Buffer), 0, Count, SectorsRead);
 }
 
 OsStatus_t
@@ -49,7 +49,7 @@ MfsWriteSectors(
 {
     uint64_t AbsoluteSector = FileSystem->SectorStart + Sector;
     return StorageWrite(FileSystem->Disk.Driver, FileSystem->Disk.Device, 
-        AbsoluteSector, GetBufferDma(Buffer), Count, SectorsWritten);
+        AbsoluteSector, GetBufferHandle(Buffer), 0, Count, SectorsWritten);
 }
 
 /* MfsUpdateMasterRecord
@@ -438,6 +438,12 @@ MfsUpdateRecord(
 
     TRACE("MfsUpdateEntry(File %s)", MStringRaw(Entry->Base.Name));
 
+    // Drop any cached knowledge of the record before it changes
+    MfsDentryCacheInvalidate(Mfs, Entry->ParentBucket, MStringRaw(Entry->Base.Name));
+    if (Action == MFS_ACTION_DELETE && (Entry->NativeFlags & MFS_FILERECORD_DIRECTORY)) {
+        MfsDentryCacheInvalidateDirectory(Mfs, Entry->StartBucket);
+    }
+
     // Read the stored data bucket where the record is
     if (MfsReadSectors(FileSystem, Mfs->TransferBuffer, 
         MFS_GETSECTOR(Mfs, Entry->DirectoryBucket), 
@@ -23,34 +23,9 @@
 #include "hid.h"
 #include <ddk/services/usb.h>
 #include <ddk/utils.h>
+#include <os/mollenos.h>
 #include <stdlib.h>
 
-/* HidExtractValue
- * Retrieves a value from a buffer by the given bit-offset and the for a certain
- * number of bits, the extracted value will be treated unsigned */
-uint64_t
-HidExtractValue(
-    _In_ uint8_t *Buffer, 
-    _In_ uint32_t BitOffset, 
-    _In_ uint32_t NumBits)
-{
-    // Variables
-    uint64_t value = 0;
-    uint32_t i = 0;
-    uint32_t offset = BitOffset;
-
-    // Do it by loop
-    while (i < NumBits) {
-        uint8_t bits = ((offset % 8) + NumBits - i) < 8 ? NumBits % 8 : 8 - (offset % 8);
-        value |= ((Buffer[offset / 8] >> (offset % 8)) & ((1 << bits) - 1)) << i;
-        i += bits;
-        offset += bits;
-    }
-
-    // Return calculated value
-    return value;
-}
-
 /* HidCollectionCreate
  * Allocates a new collection and fills it from the current states. */
 UsbHidReportCollection_t*
@@ -525,6 +500,27 @@ HidParseReportDescriptor(
     }
 }
 
+/* HidCollectionUsesReportIds
+ * Recursively determines whether any input item in the collection has a report-id. */
+static int
+HidCollectionUsesReportIds(
+    _In_ UsbHidReportCollection_t *Collection)
+{
+    UsbHidReportCollectionItem_t *Itr = Collection->Childs;
+    while (Itr != NULL) {
+        if (Itr->CollectionType == HID_TYPE_COLLECTION && Itr->ItemPointer != NULL) {
+            if (HidCollectionUsesReportIds((UsbHidReportCollection_t*)Itr->ItemPointer)) {
+                return 1;
+            }
+        }
+        else if (Itr->CollectionType == HID_TYPE_INPUT && Itr->Stats.ReportId != UUID_INVALID) {
+            return 1;
+        }
+        Itr = Itr->Link;
+    }
+    return 0;
+}
+
 /* HidCollectionDestroy
  * Iteratively cleans up a collection and it's subitems. This call
  * is recursive. */
@@ -574,246 +570,304 @@ HidCollectionCleanup(
         return OsError;
     }
 
+    // Cleanup the compiled decoder
+    if (Device->Fields != NULL) {
+        free(Device->Fields);
+        Device->Fields = NULL;
+        Device->FieldCount = 0;
+    }
+
     // Recursively cleanup
     return HidCollectionDestroy(Device->Collection);
 }
 
-/* HidParseReportInput
- * Handles report data from a collection-item of the type input.
- * This means we have actual input data from the device */
-void
-HidParseReportInput(
-    _In_ HidDevice_t *Device,
-    _In_ UsbHidReportCollectionItem_t *CollectionItem,
-    _In_ size_t DataIndex)
+/* HidResolveUsage
+ * Resolves the usage of the n'th value in an input item. Explicit usages take
+ * precedence, then usage ranges and lastly the last usage is repeated. */
+static size_t
+HidResolveUsage(
+    _In_ UsbHidReportItemStats_t *ItemStats,
+    _In_ size_t Index)
 {
-    // Variables
-    uint8_t *DataPointer = NULL, *PreviousDataPointer = NULL;
-    UsbHidReportInputItem_t *InputItem = NULL;
-    uint64_t Value = 0, OldValue = 0;
-    size_t i, Offset, Length, Usage;
-
-    // Static buffers
-    SystemInput_t InputData = { 0 };
-
-    // Cast the input-item from the ItemPointer
-    InputItem = (UsbHidReportInputItem_t*)CollectionItem->ItemPointer;
+    size_t LastUsage = 0;
+    size_t i;
 
-    // Initiate pointers to new and previous data
-    DataPointer = &((uint8_t*)Device->Buffer)[DataIndex];
-    PreviousDataPointer = &((uint8_t*)Device->Buffer)[Device->PreviousDataIndex];
-
-    // Sanitize the type of input, if we are constant, it's padding
-    if (InputItem->Flags == REPORT_INPUT_TYPE_CONSTANT) {
-        return;
+    if (Index < 16 && ItemStats->Usages[Index] != 0) {
+        return ItemStats->Usages[Index];
     }
-
-    // If report-ids are active, we must make sure this data-packet
-    // is actually for this report
-    // The first byte of the data-report is the id
-    if (CollectionItem->Stats.ReportId != UUID_INVALID) {
-        uint8_t ReportId = DataPointer[0];
-        if (ReportId != (uint8_t)CollectionItem->Stats.ReportId) {
-            return;
+    if (ItemStats->UsageMax != 0 && (ItemStats->UsageMin + Index) <= ItemStats->UsageMax) {
+        return ItemStats->UsageMin + Index;
+    }
+    for (i = 0; i < 16; i++) {
+        if (ItemStats->Usages[i] != 0) {
+            LastUsage = ItemStats->Usages[i];
         }
     }
+    return LastUsage;
+}
 
-    // Initiate the mInputEvent data
-    InputData.Type = CollectionItem->InputType;
-
-    // Extract some of the state variables for parsing
-    Offset = InputItem->LocalState.BitOffset;
-    Length = CollectionItem->Stats.ReportSize;
-
-    // Iterate the data
-    for (i = 0; i < CollectionItem->Stats.ReportCount; i++, Offset += Length) {
-        Value = HidExtractValue(DataPointer, Offset, Length);
-        OldValue = HidExtractValue(PreviousDataPointer, Offset, Length);
-        
-        // We cant expect this to be correct though, it might be 0
-        Usage = InputItem->LocalState.Usages[i];
-
-        // Take action based on the type of input
-        // currently we only handle generic pc input devices
-        switch (CollectionItem->Stats.UsagePage) {
-            case HID_USAGE_PAGE_GENERIC_PC: {
-                switch (Usage) {
-                    // Calculating Device Bounds 
-                    // Resolution = (Logical Maximum � Logical Minimum) / 
-                    // ((Physical Maximum � Physical Minimum) * (10 Unit Exponent))
-
-                    // If physical min/max is not defined or are 0, 
-                    // we set them to be logical min/max
-
-                    // Grid updates like x, y or z coordinates have
-                    // changed. 
-                    case HID_REPORT_USAGE_X_AXIS:
-                    case HID_REPORT_USAGE_Y_AXIS:
-                    case HID_REPORT_USAGE_Z_AXIS: {
-                        // Variables
-                        int64_t Relative = (int64_t)Value;
-
-                        // Sanitize against no changes
-                        if (Value == 0) {
-                            break;
-                        }
-
-                        // If the value is absolute, we want to
-                        // make sure we calculate the relative
-                        if (InputItem->Flags == REPORT_INPUT_TYPE_ABSOLUTE) {
-                            Relative = (int64_t)(Value - OldValue);
-                        }
-
-                        // Handle sign-cases where we have to turn them negative
-                        if (Relative > CollectionItem->Stats.LogicalMax
-                            && CollectionItem->Stats.LogicalMin < 0) {
-                            if (Relative & (int64_t)(1 << (Length - 1))) {
-                                Relative -= (int64_t)(1 << Length);
-                            }
-                        }
-
-                        // Guard against relative = 0
-                        if (Relative != 0) {
-                            char *DebugAxis = NULL;
-                            if (Usage == HID_REPORT_USAGE_X_AXIS) {
-                                DebugAxis = "X";
-                                InputData.RelativeX = (int16_t)(Relative & 0xFFFF);
-                            }
-                            else if (Usage == HID_REPORT_USAGE_Y_AXIS) {
-                                DebugAxis = "Y";
-                                InputData.RelativeY = (int16_t)(Relative & 0xFFFF);
-                            }
-                            else { // HID_REPORT_USAGE_Z_AXIS
-                                DebugAxis = "Z";
-                                InputData.RelativeZ = (int16_t)(Relative & 0xFFFF);
-                            }
-                            
-                            // Debug
-                            TRACE("%s-Change: %i (Original 0x%x, Old 0x%x, LogMax %i)",
-                                DebugAxis, (int32_t)Relative, (uint32_t)Value, (uint32_t)OldValue, 
-                                CollectionItem->Stats.LogicalMax);
-                        }
+/* HidCompileField
+ * Determines the handler of a single value, returns OsError if the value
+ * is not something we can generate input events from. */
+static OsStatus_t
+HidCompileField(
+    _In_  UsbHidReportCollectionItem_t *CollectionItem,
+    _In_  size_t Usage,
+    _Out_ HidReportField_t *Field)
+{
+    switch (CollectionItem->Stats.UsagePage) {
+        case HID_USAGE_PAGE_GENERIC_PC: {
+            if (Usage == HID_REPORT_USAGE_X_AXIS) {
+                Field->Handler = HID_FIELD_AXIS_X;
+            }
+            else if (Usage == HID_REPORT_USAGE_Y_AXIS) {
+                Field->Handler = HID_FIELD_AXIS_Y;
+            }
+            else if (Usage == HID_REPORT_USAGE_Z_AXIS || Usage == HID_REPORT_USAGE_WHEEL) {
+                Field->Handler = HID_FIELD_AXIS_Z;
+            }
+            else {
+                return OsError;
+            }
+        } break;
 
-                    } break;
-                }
-            } break;
+        // Buttons are numbered from 1, and we can at most report 32 buttons
+        // in the button mask of the input event
+        case HID_REPORT_USAGE_PAGE_BUTTON: {
+            if (Usage == 0 || Usage > 32
+                || ((UsbHidReportInputItem_t*)CollectionItem->ItemPointer)->Flags == REPORT_INPUT_TYPE_ARRAY) {
+                return OsError;
+            }
+            Field->Handler = HID_FIELD_BUTTON;
+            Field->Index   = (int)(Usage - 1);
+        } break;
 
-            // Describes keyboard or keypad events
-            case HID_REPORT_USAGE_PAGE_KEYBOARD: {
+        // Keyboard and consumer pages are not handled by the generic driver
+        default:
+            TRACE("Usage Page 0x%x (Input Type 0x%x), Usage 0x%x is not compiled",
+                CollectionItem->Stats.UsagePage, CollectionItem->InputType, Usage);
+            return OsError;
+    }
+    return OsSuccess;
+}
 
-            } break;
+/* HidCompileCollection
+ * Recursively walks the collection tree in descriptor order and appends a field for
+ * every value that can generate input. Bit offsets are tracked per report-id. */
+static OsStatus_t
+HidCompileCollection(
+    _In_    UsbHidReportCollection_t *Collection,
+    _InOut_ HidReportField_t **Fields,
+    _InOut_ size_t *FieldCount,
+    _InOut_ size_t *FieldCapacity,
+    _InOut_ size_t *BitOffsets,
+    _In_    int ReportIdsUsed)
+{
+    UsbHidReportCollectionItem_t *Itr = Collection->Childs;
+    UsbHidReportInputItem_t *InputItem;
+    size_t i, Offset, Slot, Length;
 
-            // Generic Button events
-            case HID_REPORT_USAGE_PAGE_BUTTON: {
-                uint8_t KeystateChanged = 0;
+    while (Itr != NULL) {
+        if (Itr->CollectionType == HID_TYPE_COLLECTION && Itr->ItemPointer != NULL) {
+            if (HidCompileCollection((UsbHidReportCollection_t*)Itr->ItemPointer,
+                Fields, FieldCount, FieldCapacity, BitOffsets, ReportIdsUsed) != OsSuccess) {
+                return OsError;
+            }
+        }
+        else if (Itr->CollectionType == HID_TYPE_INPUT) {
+            InputItem = (UsbHidReportInputItem_t*)Itr->ItemPointer;
+            Slot      = (Itr->Stats.ReportId != UUID_INVALID) ? (Itr->Stats.ReportId & 0xFF) : 0;
+            Length    = Itr->Stats.ReportSize;
+            Offset    = BitOffsets[Slot];
+
+            // Reports prefixed with an id carry the id in the first byte
+            if (ReportIdsUsed && Offset == 0) {
+                Offset = 8;
+            }
+            BitOffsets[Slot] = Offset + (Itr->Stats.ReportCount * Length);
+
+            // Constant items are padding, and values wider than 32 bits
+            // can't be represented in an input event
+            if (InputItem->Flags == REPORT_INPUT_TYPE_CONSTANT || Length == 0 
+                || Length > 32 || Itr->InputType >= HID_MAX_INPUT_TYPES) {
+                Itr = Itr->Link;
+                continue;
+            }
 
-                // Check against old values if any changes are neccessary
-                if (Value != OldValue) {
-                    KeystateChanged = 1;
+            for (i = 0; i < Itr->Stats.ReportCount; i++, Offset += Length) {
+                HidReportField_t Field = { 0 };
+                if (HidCompileField(Itr, HidResolveUsage(&InputItem->LocalState, i), &Field) != OsSuccess) {
+                    continue;
                 }
-                else {
-                    break;
-                }
-
-                // Ok, so if we have multiple buttons (an array) 
-                // we will use the logical min & max to find out which
-                // button id this is
-                TRACE("Button %u: %u", i, (uint32_t)Value);
 
-                // Possible types are: Keyboard, keypad, mouse, gamepad or joystick
-                switch (CollectionItem->InputType) {
-                    // Mouse button event
-                    case DeviceInputPointer: {
-
-                    } break;
+                HidSetFieldLocation(&Field, Offset, Length);
+                Field.ReportId   = (Itr->Stats.ReportId != UUID_INVALID) ? (int)(Itr->Stats.ReportId & 0xFF) : -1;
+                Field.Flags      = InputItem->Flags;
+                Field.Signed     = (Itr->Stats.LogicalMin < 0) ? 1 : 0;
+                Field.InputType  = Itr->InputType;
+
+                if (*FieldCount == *FieldCapacity) {
+                    size_t NewCapacity = (*FieldCapacity == 0) ? 8 : (*FieldCapacity * 2);
+                    HidReportField_t *NewFields = (HidReportField_t*)realloc(*Fields, 
+                        NewCapacity * sizeof(HidReportField_t));
+                    if (NewFields == NULL) {
+                        return OsError;
+                    }
+                    *Fields        = NewFields;
+                    *FieldCapacity = NewCapacity;
+                }
+                (*Fields)[(*FieldCount)++] = Field;
+            }
+        }
+        Itr = Itr->Link;
+    }
+    return OsSuccess;
+}
 
-                    // Gamepad button event
-                    case DeviceInputGamePad: {
+/* HidCompileReportDecoder
+ * Flattens the parsed collection tree into a list of input fields with precomputed
+ * offsets and masks, this is done once and used for all reports. */
+OsStatus_t
+HidCompileReportDecoder(
+    _In_ HidDevice_t *Device)
+{
+    // Variables
+    HidReportField_t *Fields = NULL;
+    size_t FieldCount = 0, FieldCapacity = 0;
+    size_t *BitOffsets = NULL;
+    size_t LongestReport = 0;
+    int ReportIdsUsed = 0;
+    size_t i;
 
-                    } break;
+    // Sanitize
+    if (Device == NULL || Device->Collection == NULL) {
+        return OsError;
+    }
 
-                    // Joystick button event
-                    case DeviceInputJoystick: {
+    // Report-ids are used if any input item carries one, in which case
+    // every report is prefixed by its id
+    ReportIdsUsed = HidCollectionUsesReportIds(Device->Collection);
+    BitOffsets = (size_t*)malloc(256 * sizeof(size_t));
+    if (BitOffsets == NULL) {
+        return OsError;
+    }
+    memset(BitOffsets, 0, 256 * sizeof(size_t));
 
-                    } break;
+    if (HidCompileCollection(Device->Collection, &Fields, &FieldCount, 
+        &FieldCapacity, BitOffsets, ReportIdsUsed) != OsSuccess) {
+        free(BitOffsets);
+        free(Fields);
+        return OsError;
+    }
 
-                    // Ignore the rest of the input-types
-                    default:
-                        break;
-                }
-            } break;
+    // The per-id offsets tell us the real length of each report, make sure
+    // the device transfers are large enough for the longest
+    for (i = 0; i < 256; i++) {
+        LongestReport = MAX(LongestReport, DIVUP(BitOffsets[i], 8));
+    }
+    Device->ReportLength = MAX(Device->ReportLength, LongestReport);
+    free(BitOffsets);
 
-            // Consumer, this is device-specific
-            case HID_REPORT_USAGE_PAGE_CONSUMER: {
-                // Virtual box sends me 0x238 which means AC Pan 
-                // which actually is a kind of scrolling 
-                // From the HID Usage Table Specs:
-                // Sel - Set the horizontal offset of the display in the document. 
-            } break;
+    TRACE("Compiled %u fields, report length %u", FieldCount, Device->ReportLength);
+    Device->Fields     = Fields;
+    Device->FieldCount = FieldCount;
+    return OsSuccess;
+}
 
-            // We don't handle rest of usage-pages, but should be ok
-            default: {
-                TRACE("Usage Page 0x%x (Input Type 0x%x), Usage 0x%x, Value 0x%x",
-                    CollectionItem->Stats.UsagePage, CollectionItem->InputType, Usage, (uint32_t)Value);
-            } break;
-        }
+/* HidSignExtend
+ * Converts a field value to a signed value if the logical range is signed. */
+static inline int32_t
+HidSignExtend(
+    _In_ HidReportField_t *Field,
+    _In_ uint32_t Value)
+{
+    if (Field->Signed && Field->Size < 32 && (Value & (1U << (Field->Size - 1)))) {
+        Value |= ~Field->Mask;
     }
-    
-    // Create a new input report
-    // @todo
-
-    // Buttons @todo
+    return (int32_t)Value;
 }
 
-/* HidParseReport
- * Recursive report-parser that applies the given report-data
- * to the parsed report collection. */
-OsStatus_t
-HidParseReport(
+/* HidDecodeReport
+ * Decodes the report at the given data index against the previous report
+ * using the compiled fields, and delivers the resulting input events in one batch. 
+ * Returns the number of fields that applied to the report. */
+size_t
+HidDecodeReport(
     _In_ HidDevice_t *Device,
-    _In_ UsbHidReportCollection_t *Collection,
     _In_ size_t DataIndex)
 {
     // Variables
-    UsbHidReportCollectionItem_t *Itr = NULL;
-    int Calls = 0;
-
-    // Get the collection pointer
-    Itr = Collection->Childs;
-    
-    // Iterate over all the children elements of root
-    while (Itr != NULL) {
-        switch (Itr->CollectionType) {
+    SystemInput_t Inputs[HID_MAX_INPUT_TYPES];
+    SystemInput_t Batch[HID_MAX_INPUT_TYPES];
+    int32_t Relatives[HID_MAX_INPUT_TYPES][3];
+    int Changed[HID_MAX_INPUT_TYPES] = { 0 };
+    LargeInteger_t Timestamp = { { 0 } };
+    uint8_t *DataPointer, *PreviousDataPointer;
+    size_t i, Applied = 0, BatchCount = 0;
+
+    DataPointer         = &((uint8_t*)Device->Buffer)[DataIndex];
+    PreviousDataPointer = &((uint8_t*)Device->Buffer)[Device->PreviousDataIndex];
+    memset(&Inputs[0], 0, sizeof(Inputs));
+    memset(&Relatives[0], 0, sizeof(Relatives));
+
+    for (i = 0; i < Device->FieldCount; i++) {
+        HidReportField_t *Field = &Device->Fields[i];
+        uint32_t Value, OldValue = 0;
+
+        // Skip fields that belong to other reports, and only compare against the
+        // previous data if it was the same report
+        if (Field->ReportId != -1) {
+            if (DataPointer[0] != (uint8_t)Field->ReportId) {
+                continue;
+            }
+            if (PreviousDataPointer[0] == (uint8_t)Field->ReportId) {
+                OldValue = HidLoadField(PreviousDataPointer, Field);
+            }
+        }
+        else {
+            OldValue = HidLoadField(PreviousDataPointer, Field);
+        }
+        Value = HidLoadField(DataPointer, Field);
+        Applied++;
 
-            // Collections inside collections must be parsed
-            // recursively, so handle them
-            case HID_TYPE_COLLECTION: {
-                // Sanitize data attached
-                if (Itr->ItemPointer == NULL) {
-                    break;
-                }
-                
-                // Recursive parser for sub-collections
-                Calls += HidParseReport(Device, 
-                    (UsbHidReportCollection_t*)Itr->ItemPointer, DataIndex);
-            } break;
-            
-            // Input reports are interesting, that means we have an input event
-            case HID_TYPE_INPUT: {
-                HidParseReportInput(Device, Itr, DataIndex);
-                Calls++;
-            } break;
+        if (Field->Handler == HID_FIELD_BUTTON) {
+            if (Value != 0) {
+                Inputs[Field->InputType].Buttons |= (1U << Field->Index);
+            }
+            if (Value != OldValue) {
+                Changed[Field->InputType] = 1;
+            }
+        }
+        else if (Field->Flags == REPORT_INPUT_TYPE_ABSOLUTE) {
+            if (Value != OldValue) {
+                Relatives[Field->InputType][Field->Handler] += 
+                    HidSignExtend(Field, Value) - HidSignExtend(Field, OldValue);
+                Changed[Field->InputType] = 1;
+            }
+        }
+        else if (Value != 0) {
+            Relatives[Field->InputType][Field->Handler] += HidSignExtend(Field, Value);
+            Changed[Field->InputType] = 1;
+        }
+    }
 
-            // For now we don't handle feature-reports
-            // output reports are not handled here, but never should
-            default:
-                break;
+    // Build the batch of events, one per input type that changed
+    QueryPerformanceTimer(&Timestamp);
+    for (i = 0; i < HID_MAX_INPUT_TYPES; i++) {
+        if (Changed[i]) {
+            Inputs[i].Type      = (uint8_t)i;
+            Inputs[i].Timestamp = (uint64_t)Timestamp.QuadPart;
+            Inputs[i].RelativeX = (int16_t)(Relatives[i][HID_FIELD_AXIS_X] & 0xFFFF);
+            Inputs[i].RelativeY = (int16_t)(Relatives[i][HID_FIELD_AXIS_Y] & 0xFFFF);
+            Inputs[i].RelativeZ = (int16_t)(Relatives[i][HID_FIELD_AXIS_Z] & 0xFFFF);
+            TRACE("Input %u: X %i, Y %i, Z %i, Buttons 0x%x", i, Relatives[i][HID_FIELD_AXIS_X],
+                Relatives[i][HID_FIELD_AXIS_Y], Relatives[i][HID_FIELD_AXIS_Z], Inputs[i].Buttons);
+            memcpy(&Batch[BatchCount++], &Inputs[i], sizeof(SystemInput_t));
         }
-        
-        // Go to next collection item in the collection
-        Itr = Itr->Link;
     }
 
-    // Return the number of actual parses we made
-    return Calls;
+    if (BatchCount != 0) {
+        WriteSystemInputs(&Batch[0], BatchCount);
+    }
+    return Applied;
 }
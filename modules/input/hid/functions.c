@@ -167,7 +167,12 @@ HidSetupGeneric(
     // Cleanup unneeded descriptor
     free(ReportDescriptor);
 
-    // Store the length of the report
+    // Store the length of the report, and compile the collection tree
+    // into the decoder used for incoming reports
     Device->ReportLength = ReportLength;
+    if (HidCompileReportDecoder(Device) != OsSuccess) {
+        ERROR("Failed to compile the report decoder.");
+        return OsError;
+    }
     return OsSuccess;
 }
@@ -150,8 +150,8 @@ HidInterrupt(
         return InterruptHandled;
     }
 
-    // Perform the report parse
-    if (!HidParseReport(Device, Device->Collection, DataIndex)) {
+    // Decode the report with the compiled fields
+    if (!HidDecodeReport(Device, DataIndex)) {
         return InterruptHandled;
     }
 
@@ -26,6 +26,7 @@
 #include <ddk/contracts/base.h>
 #include <ddk/contracts/usbhost.h>
 #include <ddk/contracts/usbdevice.h>
+#include <ddk/usb/hid.h>
 #include <os/input.h>
 
 /* HID Class Definitions 
@@ -226,6 +227,10 @@ typedef struct _UsbHidReportCollection {
     UsbHidReportCollectionItem_t    *Childs;
 } UsbHidReportCollection_t;
 
+/* Maximum number of distinct input-types a single report can generate
+ * events for, corresponds to the number of DeviceInputType_t values. */
+#define HID_MAX_INPUT_TYPES                 5
+
 /* HidDevice
  * Represents a human input device. */
 typedef struct _HidDevice {
@@ -236,6 +241,8 @@ typedef struct _HidDevice {
 
     // Buffers
     UsbHidReportCollection_t    *Collection;
+    HidReportField_t            *Fields;
+    size_t                       FieldCount;
     uintptr_t                   *Buffer;
     uintptr_t                    BufferAddress;
     size_t                       PreviousDataIndex;
@@ -299,14 +306,22 @@ HidParseReportDescriptor(
     _In_ uint8_t *Descriptor,
     _In_ size_t DescriptorLength);
 
-/* HidParseReport
- * Recursive report-parser that applies the given report-data
- * to the parsed report collection. */
+/* HidCompileReportDecoder
+ * Flattens the parsed collection tree into a list of input fields with precomputed
+ * offsets and masks, this is done once and used for all reports. */
 __EXTERN
 OsStatus_t
-HidParseReport(
+HidCompileReportDecoder(
+    _In_ HidDevice_t *Device);
+
+/* HidDecodeReport
+ * Decodes the report at the given data index against the previous report
+ * using the compiled fields, and delivers the resulting input events in one batch. 
+ * Returns the number of fields that applied to the report. */
+__EXTERN
+size_t
+HidDecodeReport(
     _In_ HidDevice_t *Device,
-    _In_ UsbHidReportCollection_t *Collection,
     _In_ size_t DataIndex);
 
 /* HidCollectionCleanup
@@ -76,6 +76,10 @@ UsbManagerRegisterController(
     int         Retries = 3;
     OsStatus_t  Status = OsError;
 
+#ifdef __USB_BENCHMARK
+    UsbManagerBenchmark(Controller);
+#endif
+
     // Register controller with usbmanager service, sometimes the usb service is a tad
     // slow in starting up, so try 3 times, with 1 second between
     for (int i = 0; i < Retries; i++) {
@@ -244,6 +248,109 @@ UsbManagerSetToggle(
     return OsError;
 }
 
+/* UsbManagerPopCompletion
+ * Takes the oldest transfer off the completion queue, NULL if it's empty. */
+static UsbManagerTransfer_t*
+UsbManagerPopCompletion(
+    _In_ UsbManagerController_t* Controller)
+{
+    UsbManagerTransfer_t* Transfer;
+
+    SpinlockAcquire(&Controller->Lock);
+    Transfer = Controller->CompletionHead;
+    if (Transfer != NULL) {
+        Controller->CompletionHead = Transfer->CompletionLink;
+        if (Controller->CompletionHead == NULL) {
+            Controller->CompletionTail = NULL;
+        }
+        Transfer->CompletionLink   = NULL;
+        Transfer->CompletionQueued = 0;
+    }
+    SpinlockRelease(&Controller->Lock);
+    return Transfer;
+}
+
+/* UsbManagerCancelCompletion
+ * Removes a transfer from the completion queue before it's freed. */
+static void
+UsbManagerCancelCompletion(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer)
+{
+    UsbManagerTransfer_t* Previous = NULL;
+    UsbManagerTransfer_t* Current;
+
+    SpinlockAcquire(&Controller->Lock);
+    if (Transfer->CompletionQueued) {
+        Current = Controller->CompletionHead;
+        while (Current != NULL && Current != Transfer) {
+            Previous = Current;
+            Current  = Current->CompletionLink;
+        }
+        if (Current != NULL) {
+            if (Previous != NULL) {
+                Previous->CompletionLink = Transfer->CompletionLink;
+            }
+            else {
+                Controller->CompletionHead = Transfer->CompletionLink;
+            }
+            if (Controller->CompletionTail == Transfer) {
+                Controller->CompletionTail = Previous;
+            }
+        }
+        Transfer->CompletionLink   = NULL;
+        Transfer->CompletionQueued = 0;
+    }
+    SpinlockRelease(&Controller->Lock);
+}
+
+void
+UsbManagerCompleteTransfer(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer)
+{
+    SpinlockAcquire(&Controller->Lock);
+    if (!Transfer->CompletionQueued) {
+        Transfer->CompletionQueued = 1;
+        Transfer->CompletionLink   = NULL;
+        if (Controller->CompletionTail != NULL) {
+            Controller->CompletionTail->CompletionLink = Transfer;
+        }
+        else {
+            Controller->CompletionHead = Transfer;
+        }
+        Controller->CompletionTail = Transfer;
+    }
+    SpinlockRelease(&Controller->Lock);
+}
+
+void
+UsbManagerCompleteElement(
+    _In_ UsbManagerController_t* Controller,
+    _In_ uint8_t*                Element)
+{
+    UsbManagerTransfer_t* Transfer;
+
+    Transfer = (UsbManagerTransfer_t*)UsbSchedulerGetElementContext(Controller->Scheduler, Element);
+    if (Transfer != NULL) {
+        UsbManagerCompleteTransfer(Controller, Transfer);
+    }
+}
+
+void
+UsbManagerCompleteTransfers(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbTransferItemCallback RetiredCallback)
+{
+    foreach(Node, Controller->TransactionList) {
+        UsbManagerTransfer_t* Transfer = (UsbManagerTransfer_t*)Node->Data;
+        if ((Transfer->Flags & TransferFlagCleanup) || (Transfer->Status == TransferQueued &&
+                (RetiredCallback == NULL || RetiredCallback(Controller, Transfer, NULL)))) {
+            UsbManagerCompleteTransfer(Controller, Transfer);
+        }
+    }
+}
+
 OsStatus_t
 UsbManagerFinalizeTransfer(
     _In_ UsbManagerController_t* Controller,
@@ -283,6 +390,7 @@ UsbManagerFinalizeTransfer(
                 break;
             }
         }
+        UsbManagerCancelCompletion(Controller, Transfer);
         free(Transfer);
         return OsSuccess;
     }
@@ -324,10 +432,11 @@ UsbManagerSynchronizeTransfers(
 {
     UsbHcAddress_t* Address = (UsbHcAddress_t*)Context;
 
-    // Is this transfer relevant?
+    // Is this transfer relevant? Only queued transfers on the same endpoint
+    // carry toggles that depend on the transfer that ended early
     if (UsbManagerIsAddressesEqual(&Transfer->Transfer.Address, Address) != OsSuccess
-        && Transfer->Status != TransferQueued
-        && (Transfer->Transfer.Type != BulkTransfer || Transfer->Transfer.Type != InterruptTransfer)) {
+        || Transfer->Status != TransferQueued
+        || (Transfer->Transfer.Type != BulkTransfer && Transfer->Transfer.Type != InterruptTransfer)) {
         return ITERATOR_CONTINUE;
     }
 
@@ -349,6 +458,9 @@ UsbManagerScheduleTransfer(
         Transfer->Flags &= ~(TransferFlagUnschedule);
         HciTransactionFinalize(Controller, Transfer, 0);
         Transfer->Flags |= TransferFlagCleanup;
+        if (Controller->Scheduler->Settings.Flags & USB_SCHEDULER_COMPLETION_INDEX) {
+            UsbManagerCompleteTransfer(Controller, Transfer);
+        }
     }
 
     // Has the transfer been marked for schedule?
@@ -436,7 +548,23 @@ void
 UsbManagerProcessTransfers(
     _In_ UsbManagerController_t* Controller)
 {
-    UsbManagerIterateTransfers(Controller, UsbManagerProcessTransfer, NULL);
+    UsbManagerTransfer_t* Transfer;
+    DataKey_t             Key;
+
+    if (!(Controller->Scheduler->Settings.Flags & USB_SCHEDULER_COMPLETION_INDEX)) {
+        UsbManagerIterateTransfers(Controller, UsbManagerProcessTransfer, NULL);
+        return;
+    }
+
+    // Only transfers that were completed by the controller are processed, the rest
+    // still have elements in flight. A transfer that completes again while it's being
+    // processed is simply visited once more.
+    while ((Transfer = UsbManagerPopCompletion(Controller)) != NULL) {
+        Key.Value.Integer = (int)Transfer->Id;
+        if (UsbManagerProcessTransfer(Controller, Transfer, NULL) & ITERATOR_REMOVE) {
+            CollectionRemoveByKey(Controller->TransactionList, Key);
+        }
+    }
 }
 
 void
@@ -538,3 +666,190 @@ UsbManagerDumpSchedule(
             USB_CHAIN_BREATH, USB_REASON_DUMP, UsbManagerDumpScheduleElement, &PseudoTransferObject);
     }
 }
+
+#ifdef __USB_BENCHMARK
+#include <time.h>
+
+#define USB_BENCHMARK_CHAIN_LENGTH 3
+#define USB_BENCHMARK_ROUNDS       10000
+#define USB_BENCHMARK_ID_BASE      0x40000000
+
+static int
+UsbManagerBenchmarkElement(
+    _In_ UsbManagerController_t* Controller,
+    _In_ uint8_t*                Element,
+    _In_ int                     Reason,
+    _In_ void*                   Context)
+{
+    _CRT_UNUSED(Controller);
+    _CRT_UNUSED(Reason);
+
+    // Reading the status of the descriptor is what every scan does per element
+    *((reg32_t*)Context) += *((volatile reg32_t*)Element);
+    return ITERATOR_CONTINUE;
+}
+
+static int
+UsbManagerBenchmarkScan(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer,
+    _In_ void*                   Context)
+{
+    UsbManagerIterateChain(Controller, Transfer->EndpointDescriptor, 
+        USB_CHAIN_DEPTH, USB_REASON_SCAN, UsbManagerBenchmarkElement, Context);
+    return ITERATOR_CONTINUE;
+}
+
+// The retired callback of UsbManagerCompleteTransfers takes no context, so the walk
+// measurement keeps its state here
+static UsbManagerTransfer_t* BenchmarkRetired = NULL;
+static reg32_t               BenchmarkSum     = 0;
+
+static int
+UsbManagerBenchmarkRetired(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer,
+    _In_ void*                   Context)
+{
+    _CRT_UNUSED(Context);
+
+    // Like the uhci and ehci callbacks the chain is read to decide whether it retired
+    UsbManagerBenchmarkScan(Controller, Transfer, &BenchmarkSum);
+    return Transfer == BenchmarkRetired;
+}
+
+/* UsbManagerBenchmarkRun
+ * Measures the transfer processing of interrupts that each retired a single transfer, while
+ * <Count> transfers are active. Returns OsError if the pool can't hold the transfers. */
+static OsStatus_t
+UsbManagerBenchmarkRun(
+    _In_ UsbManagerController_t* Controller,
+    _In_ int                     Pool,
+    _In_ int                     Count)
+{
+    UsbManagerTransfer_t* Transfers;
+    UsbManagerTransfer_t* Transfer;
+    uint8_t**             Elements;
+    uint8_t*              Retired;
+    DataKey_t             Key;
+    reg32_t               Sum          = 0;
+    size_t                ElementCount = 0;
+    int                   Allocated    = 0;
+    clock_t               ScanTicks;
+    clock_t               IndexTicks;
+    clock_t               WalkTicks;
+    int                   i, j;
+
+    Transfers = (UsbManagerTransfer_t*)calloc(Count, sizeof(UsbManagerTransfer_t));
+    Elements  = (uint8_t**)calloc(Count * USB_BENCHMARK_CHAIN_LENGTH, sizeof(uint8_t*));
+    if (Transfers == NULL || Elements == NULL) {
+        free(Transfers);
+        free(Elements);
+        return OsError;
+    }
+
+    // Every transfer is an interrupt endpoint with a short chain that is never linked
+    // into the controller schedule
+    for (i = 0; i < Count; i++, Allocated++) {
+        Transfer                = &Transfers[i];
+        Transfer->Id            = (UUId_t)(USB_BENCHMARK_ID_BASE + i);
+        Transfer->Status        = TransferQueued;
+        Transfer->Transfer.Type = InterruptTransfer;
+        for (j = 0; j < USB_BENCHMARK_CHAIN_LENGTH; j++) {
+            uint8_t* Element;
+            if (UsbSchedulerAllocateElement(Controller->Scheduler, Pool, &Element) != OsSuccess) {
+                break;
+            }
+            Elements[ElementCount++] = Element;
+            UsbSchedulerSetElementContext(Controller->Scheduler, Element, Transfer);
+            if (Transfer->EndpointDescriptor == NULL) {
+                Transfer->EndpointDescriptor = Element;
+            }
+            else {
+                UsbSchedulerChainElement(Controller->Scheduler, Pool, Transfer->EndpointDescriptor,
+                    Pool, Element, USB_ELEMENT_NO_INDEX, USB_CHAIN_DEPTH);
+            }
+        }
+        if (j != USB_BENCHMARK_CHAIN_LENGTH) {
+            break;
+        }
+        Key.Value.Integer = (int)Transfer->Id;
+        CollectionAppend(Controller->TransactionList, CollectionCreateNode(Key, Transfer));
+    }
+
+    if (Allocated == Count) {
+        // The controller does not know what completed, so every chain is walked
+        ScanTicks = clock();
+        for (i = 0; i < USB_BENCHMARK_ROUNDS; i++) {
+            UsbManagerIterateTransfers(Controller, UsbManagerBenchmarkScan, &Sum);
+        }
+        ScanTicks = clock() - ScanTicks;
+
+        // The controller reports the retired element, only its transfer is walked
+        IndexTicks = clock();
+        for (i = 0; i < USB_BENCHMARK_ROUNDS; i++) {
+            Retired = Transfers[i % Count].EndpointDescriptor;
+            UsbManagerCompleteElement(Controller, Retired);
+            while ((Transfer = UsbManagerPopCompletion(Controller)) != NULL) {
+                UsbManagerBenchmarkScan(Controller, Transfer, &Sum);
+            }
+        }
+        IndexTicks = clock() - IndexTicks;
+
+        // The path uhci and ehci take, the transaction list is walked with a retired callback
+        WalkTicks = clock();
+        for (i = 0; i < USB_BENCHMARK_ROUNDS; i++) {
+            BenchmarkRetired = &Transfers[i % Count];
+            UsbManagerCompleteTransfers(Controller, UsbManagerBenchmarkRetired);
+            while ((Transfer = UsbManagerPopCompletion(Controller)) != NULL) {
+                UsbManagerBenchmarkScan(Controller, Transfer, &Sum);
+            }
+        }
+        WalkTicks = clock() - WalkTicks;
+        BenchmarkRetired = NULL;
+        Sum += BenchmarkSum;
+
+        WARNING("USB-Benchmark: %i endpoints, scan %u ns, completion index %u ns, retired walk %u ns per interrupt (0x%x)",
+            Count, (unsigned)(((unsigned long long)ScanTicks * 1000000000ULL) / CLOCKS_PER_SEC / USB_BENCHMARK_ROUNDS),
+            (unsigned)(((unsigned long long)IndexTicks * 1000000000ULL) / CLOCKS_PER_SEC / USB_BENCHMARK_ROUNDS),
+            (unsigned)(((unsigned long long)WalkTicks * 1000000000ULL) / CLOCKS_PER_SEC / USB_BENCHMARK_ROUNDS), Sum);
+    }
+
+    for (i = 0; i < Allocated; i++) {
+        Key.Value.Integer = (int)Transfers[i].Id;
+        CollectionRemoveByKey(Controller->TransactionList, Key);
+    }
+    UsbSchedulerFreeElements(Controller->Scheduler, Elements, ElementCount);
+    free(Elements);
+    free(Transfers);
+    return (Allocated == Count) ? OsSuccess : OsError;
+}
+
+void
+UsbManagerBenchmark(
+    _In_ UsbManagerController_t* Controller)
+{
+    static const int Counts[] = { 10, 50, 100 };
+    int              Pool     = 0;
+    int              i;
+
+    if (Controller->Scheduler == NULL) {
+        return;
+    }
+    UsbSchedulerBenchmark(Controller->Scheduler);
+
+    // The chains are taken from the largest pool so 100 endpoints fit on all controllers
+    for (i = 1; i < Controller->Scheduler->Settings.PoolCount; i++) {
+        if (Controller->Scheduler->Settings.Pools[i].ElementCount > 
+                Controller->Scheduler->Settings.Pools[Pool].ElementCount) {
+            Pool = i;
+        }
+    }
+
+    for (i = 0; i < (int)(sizeof(Counts) / sizeof(Counts[0])); i++) {
+        if (UsbManagerBenchmarkRun(Controller, Pool, Counts[i]) != OsSuccess) {
+            WARNING("USB-Benchmark: not enough elements for %i endpoints", Counts[i]);
+        }
+    }
+}
+#endif //__USB_BENCHMARK
@@ -55,6 +55,10 @@ typedef struct _UsbManagerController {
     Collection_t*       Endpoints;
     Collection_t*       TransactionList;
     Spinlock_t          Lock;
+
+    // Transfers that have retired elements, see USB_SCHEDULER_COMPLETION_INDEX
+    UsbManagerTransfer_t* CompletionHead;
+    UsbManagerTransfer_t* CompletionTail;
 } UsbManagerController_t;
 
 #define USB_OUT_OF_RESOURCES       (void*)0
@@ -177,8 +181,46 @@ UsbManagerSetToggle(
     _In_ UsbHcAddress_t*            Address,
     _In_ int                        Toggle);
 
+/* UsbManagerCompleteTransfer
+ * Queues a transfer for processing by the next UsbManagerProcessTransfers. Controllers
+ * using the completion index must do this for every transfer that needs attention. */
+__EXTERN void
+UsbManagerCompleteTransfer(
+    _In_ UsbManagerController_t*    Controller,
+    _In_ UsbManagerTransfer_t*      Transfer);
+
+/* UsbManagerCompleteElement
+ * Queues the transfer that owns the retired element for processing. The owner is
+ * looked up through the element context of the scheduler. */
+__EXTERN void
+UsbManagerCompleteElement(
+    _In_ UsbManagerController_t*    Controller,
+    _In_ uint8_t*                   Element);
+
+/* UsbManagerCompleteTransfers
+ * Queues the transfers the callback reports as retired, the callback returns non-zero for
+ * them. It's for controllers that only signal that something completed, the callback only
+ * looks at the queue head instead of the element chain. Transfers marked for cleanup are
+ * always queued, and all queued transfers are if the callback is NULL. */
+__EXTERN void
+UsbManagerCompleteTransfers(
+    _In_ UsbManagerController_t*    Controller,
+    _In_ UsbTransferItemCallback    RetiredCallback);
+
+#ifdef __USB_BENCHMARK
+/* UsbManagerBenchmark
+ * Measures the transfer processing per interrupt with 10, 50 and 100 active endpoints,
+ * by scanning every transfer, through the completion index and by walking the transfers
+ * with a retired callback, after the element pools of the scheduler are measured.
+ * Runs when the controller is registered, before any device is attached. */
+__EXTERN void
+UsbManagerBenchmark(
+    _In_ UsbManagerController_t*    Controller);
+#endif
+
 /* UsbManagerProcessTransfers
- * Processes all the associated transfers with the given usb controller.
+ * Processes all the associated transfers with the given usb controller. Controllers
+ * using the completion index only process the transfers that have been completed.
  * The iteration process will invoke <HciProcessElement> */
 __EXTERN void
 UsbManagerProcessTransfers(
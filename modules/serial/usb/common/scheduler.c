@@ -46,8 +46,17 @@ UsbSchedulerResetInternalData(
     // Start out by zeroing out memory
     if (ResetElements) {
         for (i = 0; i < Scheduler->Settings.PoolCount; i++) {
+            UsbSchedulerPool_t* sPool = &Scheduler->Settings.Pools[i];
             memset((void*)Scheduler->Settings.Pools[i].ElementPool, 0, (Scheduler->Settings.Pools[i].ElementCount * Scheduler->Settings.Pools[i].ElementAlignedSize));
             
+            // Rebuild the free stack, lowest indices are on top so they are handed out first
+            sPool->FreeCount = 0;
+            for (j = (int)sPool->ElementCount - 1; j >= (int)sPool->ElementCountReserved; j--) {
+                sPool->FreeStack[sPool->FreeCount++] = (uint16_t)j;
+            }
+            memset((void*)&sPool->Statistics, 0, sizeof(UsbSchedulerPoolStatistics_t));
+            memset((void*)sPool->ElementContexts, 0, sPool->ElementCount * sizeof(void*));
+            
             // Allocate and initialze all the reserved elements
             for (j = 0; j < Scheduler->Settings.Pools[i].ElementCountReserved; j++) {
                 uint8_t *Element              = USB_ELEMENT_INDEX((&Scheduler->Settings.Pools[i]), j);
@@ -61,11 +70,15 @@ UsbSchedulerResetInternalData(
     }
     if (ResetFramelist) {
         reg32_t NoLink = (Scheduler->Settings.Flags & USB_SCHEDULER_LINK_BIT_EOL) ? USB_ELEMENT_LINK_END : 0;
-        memset((void*)Scheduler->Settings.FrameList, 0, (Scheduler->Settings.FrameCount * 4));
         memset((void*)Scheduler->VirtualFrameList, 0, (Scheduler->Settings.FrameCount * sizeof(uintptr_t)));
         memset((void*)Scheduler->Bandwidth, 0, (Scheduler->Settings.FrameCount * Scheduler->Settings.SubframeCount * sizeof(size_t)));
-        for (i = 0; i < Scheduler->Settings.FrameCount; i++) {
-            Scheduler->Settings.FrameList[i] = NoLink;
+
+        // Controllers without a hardware framelist only use the bandwidth accounting
+        if (Scheduler->Settings.FrameList != NULL) {
+            memset((void*)Scheduler->Settings.FrameList, 0, (Scheduler->Settings.FrameCount * 4));
+            for (i = 0; i < Scheduler->Settings.FrameCount; i++) {
+                Scheduler->Settings.FrameList[i] = NoLink;
+            }
         }
     }
     return OsSuccess;
@@ -143,8 +156,13 @@ UsbSchedulerInitialize(
     }
 
     for (i = 0; i < Settings->PoolCount; i++) {
+        assert(Settings->Pools[i].ElementCount <= (USB_ELEMENT_INDEX_MASK + 1));
         Scheduler->Settings.Pools[i].ElementPoolPhysical = PoolPhysical;
         Scheduler->Settings.Pools[i].ElementPool         = Pool;
+        Scheduler->Settings.Pools[i].FreeStack           = (uint16_t*)malloc(Settings->Pools[i].ElementCount * sizeof(uint16_t));
+        assert(Scheduler->Settings.Pools[i].FreeStack != NULL);
+        Scheduler->Settings.Pools[i].ElementContexts     = (void**)malloc(Settings->Pools[i].ElementCount * sizeof(void*));
+        assert(Scheduler->Settings.Pools[i].ElementContexts != NULL);
         Pool            += Settings->Pools[i].ElementCount * Settings->Pools[i].ElementAlignedSize;
         PoolPhysical    += Settings->Pools[i].ElementCount * Settings->Pools[i].ElementAlignedSize;
     }
@@ -179,6 +197,14 @@ UsbSchedulerDestroy(
         }
     }
 
+    for (int i = 0; i < Scheduler->Settings.PoolCount; i++) {
+        if (Scheduler->Settings.Pools[i].FreeStack != NULL) {
+            free(Scheduler->Settings.Pools[i].FreeStack);
+        }
+        if (Scheduler->Settings.Pools[i].ElementContexts != NULL) {
+            free(Scheduler->Settings.Pools[i].ElementContexts);
+        }
+    }
     if (Scheduler->VirtualFrameList != NULL) {
         free(Scheduler->VirtualFrameList);
     }
@@ -281,46 +307,94 @@ UsbSchedulerGetPoolFromElementPhysical(
     return OsError;
 }
 
+OsStatus_t
+UsbSchedulerGetElementFromPhysical(
+    _In_  UsbScheduler_t* Scheduler,
+    _In_  uintptr_t       ElementPhysical,
+    _Out_ uint8_t**       ElementOut)
+{
+    UsbSchedulerPool_t* sPool = NULL;
+    size_t              Offset;
+
+    if (UsbSchedulerGetPoolFromElementPhysical(Scheduler, ElementPhysical, &sPool) != OsSuccess) {
+        return OsError;
+    }
+
+    // The pool range includes the address just past the last element
+    Offset = (size_t)(ElementPhysical - sPool->ElementPoolPhysical);
+    if ((Offset % sPool->ElementAlignedSize) != 0 || 
+        (Offset / sPool->ElementAlignedSize) >= (size_t)sPool->ElementCount) {
+        return OsError;
+    }
+    *ElementOut = &sPool->ElementPool[Offset];
+    return OsSuccess;
+}
+
+/* UsbSchedulerGetElementIndex
+ * Calculates the pool-local index of an element from its address. */
+static inline uint16_t
+UsbSchedulerGetElementIndex(
+    _In_ UsbSchedulerPool_t* sPool,
+    _In_ uint8_t*            Element)
+{
+    return (uint16_t)((size_t)(Element - sPool->ElementPool) / sPool->ElementAlignedSize);
+}
+
 OsStatus_t
 UsbSchedulerAllocateElement(
     _In_  UsbScheduler_t* Scheduler,
     _In_  int             Pool,
     _Out_ uint8_t**       ElementOut)
+{
+    return UsbSchedulerAllocateElements(Scheduler, Pool, 1, ElementOut);
+}
+
+OsStatus_t
+UsbSchedulerAllocateElements(
+    _In_  UsbScheduler_t* Scheduler,
+    _In_  int             Pool,
+    _In_  size_t          Count,
+    _Out_ uint8_t**       ElementsOut)
 {
     UsbSchedulerObject_t* sObject = NULL;
     UsbSchedulerPool_t*   sPool   = NULL;
     size_t                i;
 
     // Get pool
-    assert(ElementOut != NULL);
+    assert(ElementsOut != NULL);
     assert(Pool < Scheduler->Settings.PoolCount);
     sPool = &Scheduler->Settings.Pools[Pool];
     
     // Reset output value
-    *ElementOut = NULL;
+    *ElementsOut = NULL;
 
     // Now, we usually allocated new descriptors for interrupts
     // and isoc, but it doesn't make sense for us as we keep one
     // large pool of TDs, just allocate from that in any case
     SpinlockAcquire(&Scheduler->Lock);
-    for (i = sPool->ElementCountReserved; i < sPool->ElementCount; i++) {
-        uint8_t *Element = USB_ELEMENT_INDEX(sPool, i);
-        sObject          = USB_ELEMENT_OBJECT(sPool, Element);
-        if (sObject->Flags & USB_ELEMENT_ALLOCATED) {
-            continue;
-        }
+    if (sPool->FreeCount < Count) {
+        sPool->Statistics.Failures++;
+        SpinlockRelease(&Scheduler->Lock);
+        return OsError;
+    }
+    for (i = 0; i < Count; i++) {
+        ElementsOut[i] = USB_ELEMENT_INDEX(sPool, sPool->FreeStack[--sPool->FreeCount]);
+    }
+    sPool->Statistics.Allocations += Count;
+    sPool->Statistics.InUse       += Count;
+    sPool->Statistics.PeakInUse    = MAX(sPool->Statistics.PeakInUse, sPool->Statistics.InUse);
+    SpinlockRelease(&Scheduler->Lock);
 
-        // Found one, reset
-        memset((void*)Element, 0, sPool->ElementAlignedSize);
-        sObject->Index       = USB_ELEMENT_CREATE_INDEX(Pool, i);
+    // The elements are exclusively ours now, and elements on the free stack
+    // are always zeroed, so only the scheduler object must be initialized
+    for (i = 0; i < Count; i++) {
+        sObject              = USB_ELEMENT_OBJECT(sPool, ElementsOut[i]);
+        sObject->Index       = USB_ELEMENT_CREATE_INDEX(Pool, UsbSchedulerGetElementIndex(sPool, ElementsOut[i]));
         sObject->BreathIndex = USB_ELEMENT_NO_INDEX;
         sObject->DepthIndex  = USB_ELEMENT_NO_INDEX;
         sObject->Flags       = USB_ELEMENT_ALLOCATED;
-        *ElementOut          = Element;
-        break;
     }
-    SpinlockRelease(&Scheduler->Lock);
-    return (i == sPool->ElementCount) ? OsError : OsSuccess;
+    return OsSuccess;
 }
 
 OsStatus_t
@@ -504,23 +578,17 @@ UsbSchedulerAllocateBandwidth(
     return Result;
 }
 
-OsStatus_t
-UsbSchedulerFreeBandwidth(
-    _In_  UsbScheduler_t* Scheduler,
-    _In_  uint8_t*        Element)
+/* UsbSchedulerReleaseBandwidth
+ * Returns the bandwidth of the element to the frames it was allocated in, the
+ * scheduler lock must be held by the caller. */
+static void
+UsbSchedulerReleaseBandwidth(
+    _In_ UsbScheduler_t*       Scheduler,
+    _In_ UsbSchedulerObject_t* sObject)
 {
-    UsbSchedulerObject_t* sObject = NULL;
-    UsbSchedulerPool_t*   sPool   = NULL;
-    OsStatus_t            Result  = OsSuccess;
-    size_t                i, j;
-
-    // Validate element and lookup pool
-    Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
-    assert(Result == OsSuccess);
-    sObject = USB_ELEMENT_OBJECT(sPool, Element);
+    size_t i, j;
 
     // Iterate the requested period and clean up
-    SpinlockAcquire(&Scheduler->Lock);
     for (i = sObject->StartFrame; i < Scheduler->Settings.FrameCount; i += (sObject->FrameInterval * Scheduler->Settings.SubframeCount)) {
         // Reduce allocated bandwidth
         Scheduler->Bandwidth[i] -= MIN(sObject->Bandwidth, Scheduler->Bandwidth[i]);
@@ -537,6 +605,24 @@ UsbSchedulerFreeBandwidth(
             }
         }
     }
+}
+
+OsStatus_t
+UsbSchedulerFreeBandwidth(
+    _In_  UsbScheduler_t* Scheduler,
+    _In_  uint8_t*        Element)
+{
+    UsbSchedulerObject_t* sObject = NULL;
+    UsbSchedulerPool_t*   sPool   = NULL;
+    OsStatus_t            Result  = OsSuccess;
+
+    // Validate element and lookup pool
+    Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
+    assert(Result == OsSuccess);
+    sObject = USB_ELEMENT_OBJECT(sPool, Element);
+
+    SpinlockAcquire(&Scheduler->Lock);
+    UsbSchedulerReleaseBandwidth(Scheduler, sObject);
     SpinlockRelease(&Scheduler->Lock);
     return Result;
 }
@@ -545,19 +631,189 @@ void
 UsbSchedulerFreeElement(
     _In_ UsbScheduler_t* Scheduler,
     _In_ uint8_t*        Element)
+{
+    UsbSchedulerFreeElements(Scheduler, &Element, 1);
+}
+
+void
+UsbSchedulerFreeElements(
+    _In_ UsbScheduler_t* Scheduler,
+    _In_ uint8_t**       Elements,
+    _In_ size_t          Count)
 {
     UsbSchedulerObject_t* sObject = NULL;
     UsbSchedulerPool_t*   sPool   = NULL;
     OsStatus_t            Result  = OsSuccess;
-    
-    // Validate element and lookup pool
+    uint16_t              Index;
+    size_t                i;
+
+    // Release the bandwidth stored in the element and return the elements to their free
+    // stacks. The allocated flag is checked under the lock, so freeing an element twice
+    // never releases its bandwidth or pushes it twice. Reserved elements are never handed
+    // out by the allocator and must not be put on the stack
+    SpinlockAcquire(&Scheduler->Lock);
+    for (i = 0; i < Count; i++) {
+        Result = UsbSchedulerGetPoolFromElement(Scheduler, Elements[i], &sPool);
+        assert(Result == OsSuccess);
+        sObject = USB_ELEMENT_OBJECT(sPool, Elements[i]);
+        if (!(sObject->Flags & USB_ELEMENT_ALLOCATED)) {
+            continue;
+        }
+        if (sObject->Flags & USB_ELEMENT_BANDWIDTH) {
+            UsbSchedulerReleaseBandwidth(Scheduler, sObject);
+        }
+        memset((void*)Elements[i], 0, sPool->ElementAlignedSize);
+
+        Index = UsbSchedulerGetElementIndex(sPool, Elements[i]);
+        sPool->ElementContexts[Index] = NULL;
+        if (Index >= sPool->ElementCountReserved) {
+            assert(sPool->FreeCount < sPool->ElementCount);
+            sPool->FreeStack[sPool->FreeCount++] = Index;
+            sPool->Statistics.Frees++;
+            sPool->Statistics.InUse--;
+        }
+    }
+    SpinlockRelease(&Scheduler->Lock);
+}
+
+void
+UsbSchedulerBatchInitialize(
+    _In_ UsbSchedulerBatch_t* Batch,
+    _In_ int                  Pool)
+{
+    Batch->Pool  = Pool;
+    Batch->Count = 0;
+    Batch->Index = 0;
+}
+
+OsStatus_t
+UsbSchedulerBatchAllocate(
+    _In_  UsbScheduler_t*      Scheduler,
+    _In_  UsbSchedulerBatch_t* Batch,
+    _In_  size_t               Remaining,
+    _Out_ uint8_t**            ElementOut)
+{
+    size_t Count;
+
+    *ElementOut = NULL;
+    if (Batch->Index == Batch->Count) {
+        Count = MIN(MAX(Remaining, 1), USB_ELEMENT_BATCH_SIZE);
+        Batch->Count = 0;
+        Batch->Index = 0;
+        if (UsbSchedulerAllocateElements(Scheduler, Batch->Pool, Count, &Batch->Elements[0]) != OsSuccess) {
+            if (Count == 1 || UsbSchedulerAllocateElements(Scheduler, Batch->Pool, 1, &Batch->Elements[0]) != OsSuccess) {
+                return OsError;
+            }
+            Count = 1;
+        }
+        Batch->Count = Count;
+    }
+    *ElementOut = Batch->Elements[Batch->Index++];
+    return OsSuccess;
+}
+
+void
+UsbSchedulerBatchRelease(
+    _In_ UsbScheduler_t*      Scheduler,
+    _In_ UsbSchedulerBatch_t* Batch)
+{
+    if (Batch->Index < Batch->Count) {
+        UsbSchedulerFreeElements(Scheduler, &Batch->Elements[Batch->Index], Batch->Count - Batch->Index);
+    }
+    Batch->Count = 0;
+    Batch->Index = 0;
+}
+
+void
+UsbSchedulerSetElementContext(
+    _In_ UsbScheduler_t* Scheduler,
+    _In_ uint8_t*        Element,
+    _In_ void*           Context)
+{
+    UsbSchedulerPool_t* sPool = NULL;
+    OsStatus_t          Result;
+
     Result = UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool);
     assert(Result == OsSuccess);
-    sObject = USB_ELEMENT_OBJECT(sPool, Element);
+    sPool->ElementContexts[UsbSchedulerGetElementIndex(sPool, Element)] = Context;
+}
+
+void*
+UsbSchedulerGetElementContext(
+    _In_ UsbScheduler_t* Scheduler,
+    _In_ uint8_t*        Element)
+{
+    UsbSchedulerPool_t* sPool = NULL;
+
+    if (UsbSchedulerGetPoolFromElement(Scheduler, Element, &sPool) != OsSuccess) {
+        return NULL;
+    }
+    return sPool->ElementContexts[UsbSchedulerGetElementIndex(sPool, Element)];
+}
+
+OsStatus_t
+UsbSchedulerGetPoolStatistics(
+    _In_  UsbScheduler_t*               Scheduler,
+    _In_  int                           Pool,
+    _Out_ UsbSchedulerPoolStatistics_t* Statistics)
+{
+    assert(Statistics != NULL);
+    if (Pool >= Scheduler->Settings.PoolCount) {
+        return OsInvalidParameters;
+    }
+
+    SpinlockAcquire(&Scheduler->Lock);
+    memcpy((void*)Statistics, (void*)&Scheduler->Settings.Pools[Pool].Statistics, 
+        sizeof(UsbSchedulerPoolStatistics_t));
+    SpinlockRelease(&Scheduler->Lock);
+    return OsSuccess;
+}
+
+#ifdef __USB_BENCHMARK
+#include <time.h>
+
+#define USB_SCHEDULER_BENCHMARK_ROUNDS 10000
+
+void
+UsbSchedulerBenchmark(
+    _In_ UsbScheduler_t* Scheduler)
+{
+    uint8_t* Elements[USB_ELEMENT_BATCH_SIZE];
+    clock_t  SingleTicks;
+    clock_t  BatchTicks;
+    int      Pool;
+    int      i;
+
+    for (Pool = 0; Pool < Scheduler->Settings.PoolCount; Pool++) {
+        // Every element of a chain taken and returned on its own
+        SingleTicks = clock();
+        for (i = 0; i < USB_SCHEDULER_BENCHMARK_ROUNDS; i++) {
+            if (UsbSchedulerAllocateElement(Scheduler, Pool, &Elements[0]) != OsSuccess) {
+                break;
+            }
+            UsbSchedulerFreeElement(Scheduler, Elements[0]);
+        }
+        SingleTicks = clock() - SingleTicks;
+        if (i != USB_SCHEDULER_BENCHMARK_ROUNDS) {
+            WARNING("USB-Benchmark: pool %i has no free elements", Pool);
+            continue;
+        }
+
+        // The elements of a chain taken and returned a batch at a time
+        BatchTicks = clock();
+        for (i = 0; i < USB_SCHEDULER_BENCHMARK_ROUNDS; i++) {
+            if (UsbSchedulerAllocateElements(Scheduler, Pool, USB_ELEMENT_BATCH_SIZE, &Elements[0]) != OsSuccess) {
+                break;
+            }
+            UsbSchedulerFreeElements(Scheduler, &Elements[0], USB_ELEMENT_BATCH_SIZE);
+        }
+        BatchTicks = clock() - BatchTicks;
 
-    // Should we free bandwidth?
-    if (sObject->Flags & USB_ELEMENT_BANDWIDTH) {
-        UsbSchedulerFreeBandwidth(Scheduler, Element);
+        WARNING("USB-Benchmark: pool %i, single %u ns, batch of %i %u ns per element",
+            Pool, (unsigned)(((unsigned long long)SingleTicks * 1000000000ULL) / CLOCKS_PER_SEC / USB_SCHEDULER_BENCHMARK_ROUNDS),
+            USB_ELEMENT_BATCH_SIZE, (i != USB_SCHEDULER_BENCHMARK_ROUNDS) ? 0 :
+            (unsigned)(((unsigned long long)BatchTicks * 1000000000ULL) / CLOCKS_PER_SEC / 
+                (USB_SCHEDULER_BENCHMARK_ROUNDS * USB_ELEMENT_BATCH_SIZE)));
     }
-    memset((void*)Element, 0, sPool->ElementAlignedSize);
 }
+#endif
@@ -90,6 +90,26 @@ PACKED_TYPESTRUCT(UsbSchedulerObject, {
 #define USB_CHAIN_DEPTH                 1
 #define USB_POOL_MAXCOUNT               8
 
+typedef struct _UsbSchedulerPoolStatistics {
+    size_t    Allocations;                // Number of successful element allocations
+    size_t    Frees;                      // Number of element frees
+    size_t    Failures;                   // Number of allocations that failed
+    size_t    InUse;                      // Number of elements currently allocated
+    size_t    PeakInUse;                  // Highest number of elements allocated at once
+} UsbSchedulerPoolStatistics_t;
+
+/* UsbSchedulerBatch
+ * Elements allocated ahead for building a descriptor chain, so a chain costs
+ * one lock round-trip per USB_ELEMENT_BATCH_SIZE elements. */
+#define USB_ELEMENT_BATCH_SIZE          16
+
+typedef struct _UsbSchedulerBatch {
+    int       Pool;
+    size_t    Count;
+    size_t    Index;
+    uint8_t*  Elements[USB_ELEMENT_BATCH_SIZE];
+} UsbSchedulerBatch_t;
+
 typedef struct _UsbSchedulerPool {
     uint8_t*  ElementPool;                // Pool
     uintptr_t ElementPoolPhysical;        // Pool Physical
@@ -101,6 +121,11 @@ typedef struct _UsbSchedulerPool {
     size_t    ElementLinkBreathOffset;    // Offset to the physical breath link member
     size_t    ElementDepthBreathOffset;   // Offset to the physical breath link member
     size_t    ElementObjectOffset;        // Offset to the UsbSchedulerObject
+
+    uint16_t* FreeStack;                  // Stack of free element indices
+    size_t    FreeCount;                  // Number of indices on the free stack
+    void**    ElementContexts;            // Owner of each element, indexed like the pool
+    UsbSchedulerPoolStatistics_t Statistics;
 } UsbSchedulerPool_t;
 
 typedef struct _UsbSchedulerSettings {
@@ -121,6 +146,7 @@ typedef struct _UsbSchedulerSettings {
 #define USB_SCHEDULER_NULL_ELEMENT      (1 << 2) // If set, all chains make use of null-elements
 #define USB_SCHEDULER_DEFERRED_CLEAN    (1 << 3) // If set, cleanup must occur later than unlink
 #define USB_SCHEDULER_LINK_BIT_EOL      (1 << 4) // Specify that empty links must be marked with EOL
+#define USB_SCHEDULER_COMPLETION_INDEX  (1 << 5) // If set, the controller reports retired elements and transfers are not scanned
 
 typedef struct _UsbScheduler {
     // Meta
@@ -229,6 +255,15 @@ UsbSchedulerGetPoolFromElementPhysical(
     _In_  uintptr_t                 ElementPhysical,
     _Out_ UsbSchedulerPool_t**      Pool);
 
+/* UsbSchedulerGetElementFromPhysical
+ * Retrieves the element located at the physical address, used for the addresses the
+ * controller writes back. Returns OsError if the address is not inside any pool. */
+__EXTERN OsStatus_t
+UsbSchedulerGetElementFromPhysical(
+    _In_  UsbScheduler_t*           Scheduler,
+    _In_  uintptr_t                 ElementPhysical,
+    _Out_ uint8_t**                 ElementOut);
+
 /* UsbSchedulerAllocateElement
  * Allocates a new element for usage with the scheduler. If this returns
  * OsError we are out of elements and we should wait till next transfer. ElementOut
@@ -239,6 +274,16 @@ UsbSchedulerAllocateElement(
     _In_  int                       Pool,
     _Out_ uint8_t**                 ElementOut);
 
+/* UsbSchedulerAllocateElements
+ * Allocates <Count> elements from the pool in one operation. Either all elements
+ * are allocated or none, in which case OsError is returned. */
+__EXTERN OsStatus_t
+UsbSchedulerAllocateElements(
+    _In_  UsbScheduler_t*           Scheduler,
+    _In_  int                       Pool,
+    _In_  size_t                    Count,
+    _Out_ uint8_t**                 ElementsOut);
+
 /* UsbSchedulerFreeElement
  * Releases the previously allocated element by resetting it. This call automatically
  * frees any bandwidth associated with the element. */
@@ -247,6 +292,73 @@ UsbSchedulerFreeElement(
     _In_ UsbScheduler_t*            Scheduler,
     _In_ uint8_t*                   Element);
 
+/* UsbSchedulerFreeElements
+ * Releases a batch of previously allocated elements, see UsbSchedulerFreeElement.
+ * Elements that are already free are ignored. */
+__EXTERN void
+UsbSchedulerFreeElements(
+    _In_ UsbScheduler_t*            Scheduler,
+    _In_ uint8_t**                  Elements,
+    _In_ size_t                     Count);
+
+/* UsbSchedulerBatchInitialize
+ * Prepares an empty batch of elements from the given pool. */
+__EXTERN void
+UsbSchedulerBatchInitialize(
+    _In_ UsbSchedulerBatch_t*       Batch,
+    _In_ int                        Pool);
+
+/* UsbSchedulerBatchAllocate
+ * Hands out the next element of the batch. An empty batch is refilled with enough
+ * elements for <Remaining> more, and if the pool can't provide them all a single
+ * element is allocated instead, so the chain can be queued up partially. */
+__EXTERN OsStatus_t
+UsbSchedulerBatchAllocate(
+    _In_  UsbScheduler_t*           Scheduler,
+    _In_  UsbSchedulerBatch_t*      Batch,
+    _In_  size_t                    Remaining,
+    _Out_ uint8_t**                 ElementOut);
+
+/* UsbSchedulerBatchRelease
+ * Returns the elements of the batch that were never handed out. */
+__EXTERN void
+UsbSchedulerBatchRelease(
+    _In_ UsbScheduler_t*            Scheduler,
+    _In_ UsbSchedulerBatch_t*       Batch);
+
+/* UsbSchedulerSetElementContext
+ * Associates an allocated element with its owner, usually the transfer it belongs to.
+ * The association is dropped when the element is freed. */
+__EXTERN void
+UsbSchedulerSetElementContext(
+    _In_ UsbScheduler_t*            Scheduler,
+    _In_ uint8_t*                   Element,
+    _In_ void*                      Context);
+
+/* UsbSchedulerGetElementContext
+ * Retrieves the owner of an element by its index, NULL if none was set. */
+__EXTERN void*
+UsbSchedulerGetElementContext(
+    _In_ UsbScheduler_t*            Scheduler,
+    _In_ uint8_t*                   Element);
+
+/* UsbSchedulerGetPoolStatistics
+ * Retrieves a snapshot of the allocation counters for the given pool. */
+__EXTERN OsStatus_t
+UsbSchedulerGetPoolStatistics(
+    _In_  UsbScheduler_t*               Scheduler,
+    _In_  int                           Pool,
+    _Out_ UsbSchedulerPoolStatistics_t* Statistics);
+
+#ifdef __USB_BENCHMARK
+/* UsbSchedulerBenchmark
+ * Measures allocating and freeing elements from each pool, one element at a time
+ * and in batches of USB_ELEMENT_BATCH_SIZE. */
+__EXTERN void
+UsbSchedulerBenchmark(
+    _In_ UsbScheduler_t*            Scheduler);
+#endif
+
 /* UsbSchedulerAllocateBandwidth
  * Allocates bandwidth for a scheduler element. The bandwidth will automatically
  * be fitted into where is best place on schedule. If there is no more room it will
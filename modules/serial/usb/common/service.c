@@ -150,6 +150,50 @@ OnQuery(
             return RPCRespond(Address, (void*)&Status, sizeof(UsbTransferStatus_t));
         } break;
 
+        // Cancel a pending control or bulk transfer
+        case __USBHOST_CANCELTRANSFER: {
+            UsbTransfer_t*      Match  = (UsbTransfer_t*)Arg1->Data.Buffer;
+            UsbTransferStatus_t Status = TransferInvalid;
+            CollectionItem_t*   Node   = NULL;
+
+            // Transfers that are answered already have completed and can't be cancelled
+            foreach(tNode, Controller->TransactionList) {
+                UsbManagerTransfer_t* NodeTransfer = (UsbManagerTransfer_t*)tNode->Data;
+                if ((NodeTransfer->Transfer.Type == ControlTransfer || NodeTransfer->Transfer.Type == BulkTransfer) &&
+                    !(NodeTransfer->Flags & TransferFlagNotified) &&
+                    NodeTransfer->Transfer.StreamId == Match->StreamId &&
+                    NodeTransfer->Transfer.Transactions[0].BufferAddress == Match->Transactions[0].BufferAddress &&
+                    UsbManagerIsAddressesEqual(&NodeTransfer->Transfer.Address, &Match->Address) == OsSuccess) {
+                    Transfer = NodeTransfer;
+                    Node     = tNode;
+                    break;
+                }
+            }
+
+            // Transfers that never reached the controller are answered and dropped. Scheduled
+            // transfers are dequeued, and the waiting caller is answered with the cancelled
+            // status when the controller has retired them, as the hardware may still access
+            // the buffers until then. A repeated cancel leaves the pending dequeue alone
+            if (Transfer != NULL) {
+                if (Transfer->Status == TransferCancelled) {
+                    Status = TransferFinished;
+                }
+                else if (Transfer->Status != TransferNotProcessed) {
+                    Transfer->Status = TransferCancelled;
+                    Status           = HciDequeueTransfer(Transfer);
+                }
+                else {
+                    Transfer->Status = TransferCancelled;
+                    UsbManagerSendNotification(Transfer);
+                    CollectionRemoveByNode(Controller->TransactionList, Node);
+                    CollectionDestroyNode(Controller->TransactionList, Node);
+                    free(Transfer);
+                    Status = TransferFinished;
+                }
+            }
+            return RPCRespond(Address, (void*)&Status, sizeof(UsbTransferStatus_t));
+        } break;
+
         // Reset port
         case __USBHOST_RESETPORT: {
             // Call reset procedure, then let it fall through to QueryPort
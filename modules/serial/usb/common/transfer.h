@@ -39,7 +39,7 @@ typedef enum _UsbManagerTransferFlags {
     TransferFlagNotified    = 0x20
 } UsbManagerTransferFlags_t;
 
-typedef struct {
+typedef struct _UsbManagerTransfer {
     UsbTransfer_t               Transfer;
     MRemoteCallAddress_t        ResponseAddress;
 
@@ -56,6 +56,10 @@ typedef struct {
     int                         TransactionsTotal;
     size_t                      BytesTransferred[USB_TRANSACTIONCOUNT]; // In Total
     size_t                      CurrentDataIndex;    // Periodic Transfers
+
+    // Completion queue, protected by the controller lock
+    struct _UsbManagerTransfer* CompletionLink;
+    int                         CompletionQueued;
 } UsbManagerTransfer_t;
 
 /* UsbManagerCreateTransfer
@@ -788,6 +788,16 @@ void
 EhciRingDoorbell(
      _In_ EhciController_t*     Controller);
 
+/* EhciTransferRetired
+ * Determines from the queue head alone whether the controller is done with a transfer,
+ * used with UsbManagerCompleteTransfers. Returns non-zero if the transfer has retired. */
+__EXTERN
+int
+EhciTransferRetired(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer,
+    _In_ void*                   Context);
+
 /* EhciTransactionDispatch
  * Queues the transfer up in the controller hardware, after finalizing the
  * transactions and preparing them. */
@@ -88,6 +88,7 @@ ProcessInterrupt:
 
     // Transaction update, either error or completion
     if (InterruptStatus & (EHCI_STATUS_PROCESS | EHCI_STATUS_PROCESSERROR | EHCI_STATUS_ASYNC_DOORBELL)) {
+        UsbManagerCompleteTransfers(&Controller->Base, EhciTransferRetired);
         UsbManagerProcessTransfers(&Controller->Base);
     }
 
@@ -121,7 +121,8 @@ EhciQueueInitialize(
 
     // Initialize the scheduler
     TRACE(" > Configuring scheduler");
-    SchedulerFlags = USB_SCHEDULER_DEFERRED_CLEAN | USB_SCHEDULER_FRAMELIST | USB_SCHEDULER_LINK_BIT_EOL;
+    SchedulerFlags = USB_SCHEDULER_DEFERRED_CLEAN | USB_SCHEDULER_FRAMELIST | 
+        USB_SCHEDULER_LINK_BIT_EOL | USB_SCHEDULER_COMPLETION_INDEX;
     if (Controller->CParameters & EHCI_CPARAM_64BIT) {
 #ifdef __OSCONFIG_EHCI_ALLOW_64BIT
         SchedulerFlags |= USB_SCHEDULER_FL64;
@@ -334,6 +335,26 @@ EhciRingDoorbell(
     }
 }
 
+int
+EhciTransferRetired(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer,
+    _In_ void*                   Context)
+{
+    EhciQueueHead_t* Qh = (EhciQueueHead_t*)Transfer->EndpointDescriptor;
+    _CRT_UNUSED(Controller);
+    _CRT_UNUSED(Context);
+
+    // Isochronous transfers have no queue head, their descriptors retire every frame
+    if (Transfer->Transfer.Type == IsochronousTransfer || Qh == NULL) {
+        return 1;
+    }
+
+    // The overlay stays active while a descriptor is in progress or waits for its frame,
+    // it's inactive once the queue ran out of descriptors or halted
+    return (Qh->Overlay.Status & EHCI_TD_ACTIVE) ? 0 : 1;
+}
+
 /* HciProcessElement 
  * Proceses the element accordingly to the reason given. The transfer associated
  * will be provided in <Context> */
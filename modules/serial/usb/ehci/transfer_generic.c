@@ -99,11 +99,13 @@ EhciTransferFill(
     EhciTransferDescriptor_t *PreviousTd    = NULL;
     EhciTransferDescriptor_t *Td            = NULL;
     EhciQueueHead_t *Qh                     = (EhciQueueHead_t*)Transfer->EndpointDescriptor;
+    UsbSchedulerBatch_t Batch;
     int OutOfResources                      = 0;
     int i;
 
     // Debug
     TRACE("EhciTransferFill()");
+    UsbSchedulerBatchInitialize(&Batch, EHCI_TD_POOL);
 
     // Get next address from which we need to load
     for (i = 0; i < USB_TRANSACTIONCOUNT; i++) {
@@ -136,7 +138,8 @@ EhciTransferFill(
         TRACE(" > BytesToTransfer(%u)", BytesToTransfer);
         while (BytesToTransfer || Transfer->Transfer.Transactions[i].ZeroLength == 1) {
             Toggle          = UsbManagerGetToggle(Transfer->DeviceId, &Transfer->Transfer.Address);
-            if (UsbSchedulerAllocateElement(Controller->Base.Scheduler, EHCI_TD_POOL, (uint8_t**)&Td) == OsSuccess) {
+            if (UsbSchedulerBatchAllocate(Controller->Base.Scheduler, &Batch, (Type == SetupTransaction) ? 1 :
+                    DIVUP(BytesToTransfer, 0x4000), (uint8_t**)&Td) == OsSuccess) {
                 if (Type == SetupTransaction) {
                     TRACE(" > Creating setup packet");
                     Toggle      = 0; // Initial toggle must ALWAYS be 0 for setup
@@ -196,6 +199,8 @@ EhciTransferFill(
         }
     }
 
+    UsbSchedulerBatchRelease(Controller->Base.Scheduler, &Batch);
+
     // If we ran out of resources queue up later
     if (PreviousTd != NULL) {
         // Set last td to generate a interrupt (not null)
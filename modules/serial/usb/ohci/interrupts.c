@@ -67,9 +67,19 @@ OnFastInterrupt(
     }
 
     // Process Checks first
-    // This happens if a transaction has completed
+    // This happens if a transaction has completed, the head is kept for the interrupt
+    // thread as the controller reuses the field once the event is acknowledged
     if (InterruptStatus & OHCI_PROCESS_EVENT) {
-        //reg32_t TdAddress = (Hcca->HeadDone & ~(0x00000001));
+        reg32_t DoneHead = Hcca->HeadDone & ~(0x0000000F);
+        if (DoneHead != 0) {
+            if ((Controller->DoneWrite - Controller->DoneRead) < OHCI_DONE_QUEUE_COUNT) {
+                Controller->DoneHeads[Controller->DoneWrite % OHCI_DONE_QUEUE_COUNT] = DoneHead;
+                Controller->DoneWrite++;
+            }
+            else {
+                Controller->DoneOverflow = 1;
+            }
+        }
         Hcca->HeadDone = 0;
     }
 
@@ -86,6 +96,43 @@ OnFastInterrupt(
     return InterruptHandled;
 }
 
+/* OhciProcessDoneQueue
+ * Queues the transfers owning the descriptors on the done queues taken since the last call,
+ * the controller links retired descriptors through their next pointers. If the fast handler
+ * ran out of room for the heads, every queued transfer is processed instead. */
+static void
+OhciProcessDoneQueue(
+    _In_ OhciController_t* Controller)
+{
+    OhciTransferDescriptor_t* Td;
+    reg32_t                   Address;
+    unsigned                  DoneWrite = Controller->DoneWrite;
+    int                       Count;
+
+    if (Controller->DoneOverflow) {
+        Controller->DoneOverflow = 0;
+        Controller->DoneRead     = DoneWrite;
+        UsbManagerCompleteTransfers(&Controller->Base, NULL);
+        return;
+    }
+
+    while (Controller->DoneRead != DoneWrite) {
+        Address = Controller->DoneHeads[Controller->DoneRead % OHCI_DONE_QUEUE_COUNT];
+        Controller->DoneRead++;
+
+        // Isochronous descriptors share the layout of the next pointer, the count guards
+        // against a corrupted queue
+        for (Count = 0; Address != 0 && Count < (OHCI_TD_COUNT + OHCI_iTD_COUNT); Count++) {
+            if (UsbSchedulerGetElementFromPhysical(Controller->Base.Scheduler, 
+                    Address, (uint8_t**)&Td) != OsSuccess) {
+                break;
+            }
+            UsbManagerCompleteElement(&Controller->Base, (uint8_t*)Td);
+            Address = Td->Link & ~(0x0000000F);
+        }
+    }
+}
+
 /* OnInterrupt
  * Is called by external services to indicate an external interrupt.
  * This is to actually process the device interrupt */
@@ -111,6 +158,7 @@ ProcessInterrupt:
 
     // Process Checks
     if (InterruptStatus & OHCI_PROCESS_EVENT) {
+        OhciProcessDoneQueue(Controller);
         UsbManagerProcessTransfers(&Controller->Base);
     }
 
@@ -263,6 +263,9 @@ PACKED_ATYPESTRUCT(volatile, OhciRegisters, {
 #define OHCI_TD_NULL                        0
 #define OHCI_TD_START                       1
 
+// Done queue heads taken by the fast interrupt handler until the interrupt thread walks them
+#define OHCI_DONE_QUEUE_COUNT               8
+
 #define OHCI_iTD_NULL                       0
 #define OHCI_iTD_START                      1
 
@@ -288,6 +291,12 @@ typedef struct {
     OhciHCCA_t*             Hcca;
     reg32_t                 HccaPhysical;
 
+    // Done queue, written by the fast interrupt handler
+    reg32_t                 DoneHeads[OHCI_DONE_QUEUE_COUNT];
+    unsigned                DoneWrite;
+    unsigned                DoneRead;
+    int                     DoneOverflow;
+
     // State information
     size_t                  PowerOnDelayMs;
     OhciPowerMode_t         PowerMode;
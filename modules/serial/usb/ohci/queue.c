@@ -121,7 +121,8 @@ OhciQueueInitialize(
 
     // Initialize the scheduler
     TRACE(" > Configuring scheduler");
-    UsbSchedulerSettingsCreate(&Settings, OHCI_FRAMELIST_SIZE, 1, 900, USB_SCHEDULER_NULL_ELEMENT);
+    UsbSchedulerSettingsCreate(&Settings, OHCI_FRAMELIST_SIZE, 1, 900, 
+        USB_SCHEDULER_NULL_ELEMENT | USB_SCHEDULER_COMPLETION_INDEX);
 
     UsbSchedulerSettingsConfigureFrameList(&Settings, (reg32_t*)&Controller->Hcca->InterruptTable[0],
         Controller->HccaPhysical + offsetof(OhciHCCA_t, InterruptTable));
@@ -99,12 +99,14 @@ OhciTransferFill(
     OhciTransferDescriptor_t *PreviousTd    = NULL;
     OhciTransferDescriptor_t *Td            = NULL;
     OhciQueueHead_t *Qh                     = (OhciQueueHead_t*)Transfer->EndpointDescriptor;
+    UsbSchedulerBatch_t Batch;
     uint16_t ZeroIndex                      = Qh->Object.DepthIndex;
     int OutOfResources                      = 0;
     int i;
 
     // Debug
     TRACE("OhciTransferFill()");
+    UsbSchedulerBatchInitialize(&Batch, OHCI_TD_POOL);
 
     // Get next address from which we need to load
     for (i = 0; i < USB_TRANSACTIONCOUNT; i++) {
@@ -137,7 +139,8 @@ OhciTransferFill(
         TRACE(" > BytesToTransfer(%u)", BytesToTransfer);
         while (BytesToTransfer || Transfer->Transfer.Transactions[i].ZeroLength == 1) {
             Toggle          = UsbManagerGetToggle(Transfer->DeviceId, &Transfer->Transfer.Address);
-            if (UsbSchedulerAllocateElement(Controller->Base.Scheduler, OHCI_TD_POOL, (uint8_t**)&Td) == OsSuccess) {
+            if (UsbSchedulerBatchAllocate(Controller->Base.Scheduler, &Batch, (Type == SetupTransaction) ? 1 :
+                    DIVUP(BytesToTransfer, Transfer->Transfer.Endpoint.MaxPacketSize), (uint8_t**)&Td) == OsSuccess) {
                 if (Type == SetupTransaction) {
                     TRACE(" > Creating setup packet");
                     Toggle      = 0; // Initial toggle must ALWAYS be 0 for setup
@@ -167,6 +170,7 @@ OhciTransferFill(
             else {
                 UsbSchedulerChainElement(Controller->Base.Scheduler, 
                     OHCI_QH_POOL, (uint8_t*)Qh, OHCI_TD_POOL, (uint8_t*)Td, ZeroIndex, USB_CHAIN_DEPTH);
+                UsbSchedulerSetElementContext(Controller->Base.Scheduler, (uint8_t*)Td, Transfer);
                 PreviousTd = Td;
 
                 // Update toggle by flipping
@@ -199,6 +203,8 @@ OhciTransferFill(
         }
     }
 
+    UsbSchedulerBatchRelease(Controller->Base.Scheduler, &Batch);
+
     // If we ran out of resources queue up later
     if (PreviousTd != NULL) {
         // Enable ioc
@@ -111,6 +111,7 @@ OhciTransferFill(
         else {
             UsbSchedulerChainElement(Controller->Base.Scheduler, OHCI_QH_POOL, 
                 (uint8_t*)Qh, OHCI_iTD_POOL, (uint8_t*)Td, USB_ELEMENT_NO_INDEX, USB_CHAIN_DEPTH);
+            UsbSchedulerSetElementContext(Controller->Base.Scheduler, (uint8_t*)Td, Transfer);
             PreviousTd = Td;
         }
 
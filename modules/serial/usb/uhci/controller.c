@@ -42,6 +42,7 @@ HciTimerCallback(void* Context)
     foreach(cNode, UsbManagerGetControllers()) {
         UhciUpdateCurrentFrame((UhciController_t*)cNode->Data);
         UhciPortsCheck((UhciController_t*)cNode->Data);
+        UsbManagerCompleteTransfers((UsbManagerController_t*)cNode->Data, UhciTransferRetired);
         UsbManagerProcessTransfers((UsbManagerController_t*)cNode->Data);
     }
 }
@@ -75,6 +75,7 @@ HandleInterrupt:
     // in one of our transactions
     if (InterruptStatus & (UHCI_STATUS_USBINT | UHCI_STATUS_INTR_ERROR)) {
         UhciUpdateCurrentFrame(Controller);
+        UsbManagerCompleteTransfers(&Controller->Base, UhciTransferRetired);
         UsbManagerProcessTransfers(&Controller->Base);
     }
 
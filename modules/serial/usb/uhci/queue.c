@@ -200,7 +200,7 @@ UhciQueueInitialize(
 
     TRACE(" > Configuring scheduler");
     UsbSchedulerSettingsCreate(&Settings, UHCI_NUM_FRAMES, 1, 900, 
-        USB_SCHEDULER_FRAMELIST | USB_SCHEDULER_LINK_BIT_EOL);
+        USB_SCHEDULER_FRAMELIST | USB_SCHEDULER_LINK_BIT_EOL | USB_SCHEDULER_COMPLETION_INDEX);
 
     UsbSchedulerSettingsAddPool(&Settings, sizeof(UhciQueueHead_t), UHCI_QH_ALIGNMENT, UHCI_QH_COUNT, 
         UHCI_POOL_QH_START, offsetof(UhciQueueHead_t, Link), 
@@ -241,6 +241,35 @@ UhciQueueDestroy(
     return UsbSchedulerDestroy(Controller->Base.Scheduler);
 }
 
+int
+UhciTransferRetired(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer,
+    _In_ void*                   Context)
+{
+    UhciQueueHead_t*          Qh = (UhciQueueHead_t*)Transfer->EndpointDescriptor;
+    UhciTransferDescriptor_t* Td;
+    reg32_t                   Child;
+    _CRT_UNUSED(Context);
+
+    // Isochronous transfers have no queue head, their descriptors retire every frame
+    if (Transfer->Transfer.Type == IsochronousTransfer || Qh == NULL) {
+        return 1;
+    }
+
+    // The element pointer advances as descriptors retire, it either reaches the end of
+    // the chain or stays at the descriptor that stopped the queue on errors or short packets
+    Child = Qh->Child;
+    if (Child & (UHCI_LINK_END | UHCI_LINK_QH)) {
+        return 1;
+    }
+    if (UsbSchedulerGetElementFromPhysical(Controller->Scheduler, 
+            UHCI_LINK_ADDRESS(Child), (uint8_t**)&Td) != OsSuccess) {
+        return 1;
+    }
+    return (Td->Flags & UHCI_TD_ACTIVE) ? 0 : 1;
+}
+
 // This should be called regularly to keep the stored frame relevant
 void
 UhciUpdateCurrentFrame(
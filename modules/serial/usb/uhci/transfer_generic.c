@@ -157,9 +157,11 @@ UhciTransferFill(
     UhciTransferDescriptor_t* PreviousTd     = NULL;
     UhciTransferDescriptor_t* Td             = NULL;
     UhciQueueHead_t*          Qh             = (UhciQueueHead_t*)Transfer->EndpointDescriptor;
+    UsbSchedulerBatch_t       Batch;
     int                       OutOfResources = 0;
     int                       i;
     TRACE("UhciTransferFill()");
+    UsbSchedulerBatchInitialize(&Batch, UHCI_TD_POOL);
 
     // Get next address from which we need to load
     for (i = 0; i < USB_TRANSACTIONCOUNT; i++) {
@@ -193,7 +195,8 @@ UhciTransferFill(
         TRACE(" > BytesToTransfer(%u)", BytesToTransfer);
         while (BytesToTransfer || Transfer->Transfer.Transactions[i].ZeroLength == 1) {
             Toggle = UsbManagerGetToggle(Transfer->DeviceId, &Transfer->Transfer.Address);
-            if (UsbSchedulerAllocateElement(Controller->Base.Scheduler, UHCI_TD_POOL, (uint8_t**)&Td) == OsSuccess) {
+            if (UsbSchedulerBatchAllocate(Controller->Base.Scheduler, &Batch, (Type == SetupTransaction) ? 1 :
+                    DIVUP(BytesToTransfer, Transfer->Transfer.Endpoint.MaxPacketSize), (uint8_t**)&Td) == OsSuccess) {
                 if (Type == SetupTransaction) {
                     TRACE(" > Creating setup packet");
                     Toggle   = 0; // Initial toggle must ALWAYS be 0 for setup
@@ -260,6 +263,8 @@ UhciTransferFill(
         }
     }
     
+    UsbSchedulerBatchRelease(Controller->Base.Scheduler, &Batch);
+
     // End of <transfer>?
     if (PreviousTd != NULL) {
         PreviousTd->Flags |= UHCI_TD_IOC;
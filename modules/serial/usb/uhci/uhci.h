@@ -98,6 +98,7 @@
 #define UHCI_LINK_END                   0x1
 #define UHCI_LINK_QH                    0x2        // 1 => Qh, 0 => Td
 #define UHCI_LINK_DEPTH                 0x4        // 1 => Depth, 0 => Breadth
+#define UHCI_LINK_ADDRESS(Link)         ((Link) & ~(reg32_t)0xF)
 
 // 16 Byte alignment
 PACKED_TYPESTRUCT(UhciTransferDescriptor, {
@@ -288,6 +289,15 @@ __EXTERN OsStatus_t
 UhciPortsCheck(
     _In_ UhciController_t*          Controller);
 
+/* UhciTransferRetired
+ * Determines from the queue head alone whether the controller is done with a transfer,
+ * used with UsbManagerCompleteTransfers. Returns non-zero if the transfer has retired. */
+__EXTERN int
+UhciTransferRetired(
+    _In_ UsbManagerController_t*    Controller,
+    _In_ UsbManagerTransfer_t*      Transfer,
+    _In_ void*                      Context);
+
 /* UhciUpdateCurrentFrame
  * Updates the current frame and stores it in the controller given.
  * OBS: Needs to be called regularly */
@@ -0,0 +1,168 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <threads.h>
+
+void
+XhciRingDoorbell(
+    _In_ XhciController_t* Controller,
+    _In_ int               SlotId,
+    _In_ reg32_t           Target)
+{
+    MemoryBarrier();
+    WriteVolatile32(&Controller->Doorbells[SlotId], Target);
+}
+
+/* XhciCommandExecute
+ * Commands are executed one at the time. The completion is picked up by whichever thread
+ * processes the event ring, so the caller polls the event ring itself while it waits to
+ * not depend on the interrupt thread, which may be the caller. */
+int
+XhciCommandExecute(
+    _In_      XhciController_t* Controller,
+    _In_      reg32_t           ParameterLo,
+    _In_      reg32_t           ParameterHi,
+    _In_      reg32_t           Status,
+    _In_      reg32_t           Control,
+    _Out_Opt_ int*              SlotId)
+{
+    int Index;
+    int Timeout = XHCI_COMMAND_TIMEOUT;
+    int Code;
+
+    TRACE("XhciCommandExecute(Type %u)", XHCI_TRB_GET_TYPE(Control));
+
+    mtx_lock(&Controller->CommandLock);
+    Index = XhciRingEnqueue(Controller->CommandRing, ParameterLo, ParameterHi, Status, Control, 0);
+    Controller->CommandTrb  = Controller->CommandRing->Physical + (Index * sizeof(XhciTransferRequestBlock_t));
+    Controller->CommandDone = 0;
+
+    // The command ring is consumed as we go, nothing else tracks its dequeue
+    Controller->CommandRing->Dequeue = Controller->CommandRing->Enqueue;
+    XhciRingDoorbell(Controller, 0, 0);
+
+    while (1) {
+        XhciProcessEvents(Controller);
+        if (Controller->CommandDone || Timeout <= 0) {
+            break;
+        }
+        thrd_sleepex(1);
+        Timeout--;
+    }
+
+    if (!Controller->CommandDone) {
+        ERROR("XHCI-Failure: Command %u timed out", XHCI_TRB_GET_TYPE(Control));
+        Controller->CommandTrb = 0;
+        mtx_unlock(&Controller->CommandLock);
+        return 0;
+    }
+
+    Code = Controller->CommandCode;
+    if (SlotId != NULL) {
+        *SlotId = Controller->CommandSlot;
+    }
+    Controller->CommandTrb = 0;
+    mtx_unlock(&Controller->CommandLock);
+
+    if (Code != XHCI_CC_SUCCESS) {
+        WARNING("XHCI: Command %u completed with code %u", XHCI_TRB_GET_TYPE(Control), Code);
+    }
+    return Code;
+}
+
+/* XhciProcessEvent
+ * Handles a single event from the event ring, the event lock is held. */
+static void
+XhciProcessEvent(
+    _In_ XhciController_t*           Controller,
+    _In_ XhciTransferRequestBlock_t* Event)
+{
+    switch (XHCI_TRB_GET_TYPE(Event->Control)) {
+        case XHCI_TRB_TRANSFER_EVENT: {
+            XhciTransferEvent(Controller, Event);
+        } break;
+
+        case XHCI_TRB_COMMAND_COMPLETION: {
+            if (Controller->CommandTrb != 0 && Event->Parameter[0] == LODWORD(Controller->CommandTrb)) {
+                Controller->CommandCode = XHCI_TRB_COMPLETION_CODE(Event->Status);
+                Controller->CommandSlot = XHCI_TRB_GET_SLOT(Event->Control);
+                MemoryBarrier();
+                Controller->CommandDone = 1;
+            }
+        } break;
+
+        case XHCI_TRB_PORT_STATUS_CHANGE: {
+            // Port ids are 1-based
+            int Port = (int)((Event->Parameter[0] >> 24) & 0xFF) - 1;
+            if (Port >= 0 && Port < (int)Controller->Base.PortCount) {
+                Controller->PortChanges |= (1 << Port);
+            }
+        } break;
+
+        case XHCI_TRB_HOST_CONTROLLER: {
+            ERROR("XHCI-Failure: Host controller event, code %u", XHCI_TRB_COMPLETION_CODE(Event->Status));
+        } break;
+
+        default:
+            break;
+    }
+}
+
+void
+XhciProcessEvents(
+    _In_ XhciController_t* Controller)
+{
+    XhciTransferRequestBlock_t* Event;
+    int                         Processed = 0;
+    uintptr_t                   Dequeue;
+
+    mtx_lock(&Controller->EventLock);
+    while (1) {
+        Event = &Controller->EventRing[Controller->EventDequeue];
+        if ((ReadVolatile32(&Event->Control) & XHCI_TRB_CYCLE) != (reg32_t)Controller->EventCycle) {
+            break;
+        }
+
+        XhciProcessEvent(Controller, Event);
+        Processed++;
+
+        Controller->EventDequeue++;
+        if (Controller->EventDequeue == XHCI_EVENT_RING_SIZE) {
+            Controller->EventDequeue = 0;
+            Controller->EventCycle  ^= 1;
+        }
+    }
+
+    // Only tell the controller how far we got once per batch, this also clears
+    // the event handler busy flag
+    if (Processed != 0) {
+        Dequeue = Controller->EventRingPhysical + (Controller->EventDequeue * sizeof(XhciTransferRequestBlock_t));
+        WriteVolatile32(&Controller->RuntimeRegisters->Interrupters[0].DequeueHi, HIDWORD(Dequeue));
+        WriteVolatile32(&Controller->RuntimeRegisters->Interrupters[0].DequeueLo,
+            LODWORD(Dequeue) | XHCI_ERDP_BUSY);
+    }
+    mtx_unlock(&Controller->EventLock);
+}
@@ -0,0 +1,475 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <os/mollenos.h>
+#include <ddk/device.h>
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <threads.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Prototypes
+ * This is to keep the create/destroy at the top of the source file */
+OsStatus_t          XhciSetup(XhciController_t *Controller);
+void                XhciMemoryDestroy(XhciController_t *Controller);
+InterruptStatus_t   OnFastInterrupt(FastInterruptResources_t*, void*);
+
+/* HciControllerCreate
+ * Initializes and creates a new Hci Controller instance
+ * from a given new system device on the bus. */
+UsbManagerController_t*
+HciControllerCreate(
+    _In_ MCoreDevice_t*             Device)
+{
+    XhciController_t* Controller = NULL;
+    DeviceIo_t*       IoBase     = NULL;
+    int               Vectors    = 1;
+    int               i;
+
+    // Allocate a new instance of the controller
+    Controller = (XhciController_t*)malloc(sizeof(XhciController_t));
+    memset(Controller, 0, sizeof(XhciController_t));
+    memcpy(&Controller->Base.Device, Device, Device->Length);
+
+    // Fill in some basic stuff needed for init
+    Controller->Base.Contract.DeviceId  = Controller->Base.Device.Id;
+    Controller->Base.Type               = UsbXHCI;
+    Controller->Base.TransactionList    = CollectionCreate(KeyInteger);
+    Controller->Base.Endpoints          = CollectionCreate(KeyInteger);
+    SpinlockReset(&Controller->Base.Lock, 0);
+    mtx_init(&Controller->CommandLock, mtx_plain);
+    mtx_init(&Controller->EventLock, mtx_plain);
+    mtx_init(&Controller->RingLock, mtx_plain);
+
+    // Get I/O Base, and for XHCI it'll be the first address we encounter
+    // of type MMIO
+    for (i = 0; i < __DEVICEMANAGER_MAX_IOSPACES; i++) {
+        if (Controller->Base.Device.IoSpaces[i].Type == DeviceIoMemoryBased) {
+            IoBase = &Controller->Base.Device.IoSpaces[i];
+            break;
+        }
+    }
+
+    // Sanitize that we found the io-space
+    if (IoBase == NULL) {
+        ERROR("No memory space found for xhci-controller");
+        free(Controller);
+        return NULL;
+    }
+
+    // Acquire the io-space
+    if (AcquireDeviceIo(IoBase) != OsSuccess) {
+        ERROR("Failed to create and acquire the io-space for xhci-controller");
+        free(Controller);
+        return NULL;
+    }
+    else {
+        // Store information
+        Controller->Base.IoBase = IoBase;
+    }
+
+    // Start out by initializing the contract
+    InitializeContract(&Controller->Base.Contract, Controller->Base.Contract.DeviceId, 1,
+        ContractController, "XHCI Controller Interface");
+
+    // Trace
+    TRACE("Io-Space was assigned virtual address 0x%x", IoBase->Access.Memory.VirtualBase);
+
+    // Instantiate the register-access
+    Controller->CapRegisters     = (XhciCapabilityRegisters_t*)IoBase->Access.Memory.VirtualBase;
+    Controller->OpRegisters      = (XhciOperationalRegisters_t*)
+        (IoBase->Access.Memory.VirtualBase + Controller->CapRegisters->Length);
+    Controller->RuntimeRegisters = (XhciRuntimeRegisters_t*)(IoBase->Access.Memory.VirtualBase +
+        (ReadVolatile32(&Controller->CapRegisters->RuntimeOffset) & ~0x1F));
+    Controller->Doorbells        = (reg32_t*)(IoBase->Access.Memory.VirtualBase +
+        (ReadVolatile32(&Controller->CapRegisters->DoorbellOffset) & ~0x3));
+
+    // Initialize the interrupt settings
+    RegisterFastInterruptHandler(&Controller->Base.Device.Interrupt, OnFastInterrupt);
+    RegisterFastInterruptIoResource(&Controller->Base.Device.Interrupt, IoBase);
+    RegisterFastInterruptMemoryResource(&Controller->Base.Device.Interrupt, (uintptr_t)Controller, sizeof(XhciController_t), 0);
+
+    if (RegisterContract(&Controller->Base.Contract) != OsSuccess) {
+        ERROR("Failed to register contract for xhci-controller");
+        ReleaseDeviceIo(Controller->Base.IoBase);
+        free(Controller);
+        return NULL;
+    }
+
+    // Enable device, memory space must be enabled before the msi-x table is written
+    if (IoctlDevice(Controller->Base.Device.Id, __DEVICEMANAGER_IOCTL_BUS,
+        (__DEVICEMANAGER_IOCTL_ENABLE | __DEVICEMANAGER_IOCTL_MMIO_ENABLE
+            | __DEVICEMANAGER_IOCTL_BUSMASTER_ENABLE)) != OsSuccess) {
+        ERROR("Failed to enable the xhci-controller");
+        ReleaseDeviceIo(Controller->Base.IoBase);
+        free(Controller);
+        return NULL;
+    }
+
+    // Register interrupt, prefer message interrupts as they are never shared and
+    // avoids the status read in the fast handler on behalf of other devices. Only
+    // the primary interrupter is used, so one vector is enough
+    RegisterInterruptContext(&Controller->Base.Device.Interrupt, Controller);
+    if (RegisterMessageInterrupts(&Controller->Base.Device, &Controller->Base.Device.Interrupt,
+            INTERRUPT_USERSPACE, &Vectors, &Controller->Base.Interrupt) != OsSuccess) {
+        Controller->Base.Interrupt = RegisterInterruptSource(
+            &Controller->Base.Device.Interrupt, INTERRUPT_USERSPACE);
+    }
+    if (Controller->Base.Interrupt == UUID_INVALID) {
+        ERROR("Failed to register interrupt for the xhci-controller");
+        ReleaseDeviceIo(Controller->Base.IoBase);
+        free(Controller);
+        return NULL;
+    }
+
+    // Now that all formalities has been taken care
+    // off we can actually setup controller
+    if (XhciSetup(Controller) == OsSuccess) {
+        return &Controller->Base;
+    }
+    else {
+        HciControllerDestroy(&Controller->Base);
+        return NULL;
+    }
+}
+
+/* HciControllerDestroy
+ * Destroys an existing controller instance and cleans up
+ * any resources related to it */
+OsStatus_t
+HciControllerDestroy(
+    _In_ UsbManagerController_t*    Controller)
+{
+    XhciController_t* XhciHci = (XhciController_t*)Controller;
+    size_t            i;
+
+    // Unregister, then destroy
+    UsbManagerDestroyController(Controller);
+
+    // Cleanup scheduler and the devices, the controller is halted by the
+    // queue destroy
+    XhciQueueDestroy(XhciHci);
+    for (i = 0; i < Controller->PortCount; i++) {
+        XhciDeviceDestroy(XhciHci, (int)i);
+    }
+    XhciMemoryDestroy(XhciHci);
+
+    // Unregister the interrupt
+    UnregisterInterruptSource(Controller->Interrupt);
+
+    // Release the io-space
+    ReleaseDeviceIo(Controller->IoBase);
+
+    // Free the list of endpoints
+    CollectionDestroy(Controller->TransactionList);
+    CollectionDestroy(Controller->Endpoints);
+    mtx_destroy(&XhciHci->CommandLock);
+    mtx_destroy(&XhciHci->EventLock);
+    mtx_destroy(&XhciHci->RingLock);
+    free(Controller);
+    return OsSuccess;
+}
+
+/* XhciDisableLegacySupport
+ * Takes ownership of the controller from the bios through the usb legacy support
+ * extended capability, which is located in the mmio space on xhci. */
+void
+XhciDisableLegacySupport(
+    _In_ XhciController_t* Controller)
+{
+    uintptr_t Base   = (uintptr_t)Controller->CapRegisters;
+    size_t    Offset = XHCI_CPARAM1_XECP(Controller->CParameters1) << 2;
+    reg32_t*  Capability;
+    reg32_t   Value;
+    int       Fault  = 0;
+
+    TRACE("XhciDisableLegacySupport()");
+
+    while (Offset != 0) {
+        Capability = (reg32_t*)(Base + Offset);
+        Value      = ReadVolatile32(Capability);
+
+        // Usb Legacy Support has id 1
+        if ((Value & 0xFF) == 0x01) {
+            if (Value & (1 << 16)) {
+                // Request ownership by setting the os semaphore and wait for the
+                // bios semaphore to clear
+                WriteVolatile32(Capability, Value | (1 << 24));
+                WaitForConditionWithFault(Fault, (ReadVolatile32(Capability) & (1 << 16)) == 0, 250, 10);
+                if (Fault) {
+                    WARNING("XHCI: Failed to release BIOS Semaphore");
+                }
+            }
+
+            // Disable all smi's in the control and status register, the event
+            // bits are cleared by writing one
+            Value = ReadVolatile32(Capability + 1);
+            Value &= ~(0x0000E011);
+            Value |= 0xE0000000;
+            WriteVolatile32(Capability + 1, Value);
+            return;
+        }
+
+        if (((Value >> 8) & 0xFF) == 0) {
+            break;
+        }
+        Offset += ((Value >> 8) & 0xFF) << 2;
+    }
+}
+
+OsStatus_t
+XhciHalt(
+    _In_ XhciController_t* Controller)
+{
+    reg32_t Command;
+    int     Fault = 0;
+
+    TRACE("XhciHalt()");
+
+    Command = ReadVolatile32(&Controller->OpRegisters->UsbCommand);
+    Command &= ~(XHCI_COMMAND_RUN | XHCI_COMMAND_INTERRUPT_ENABLE | XHCI_COMMAND_HOSTERROR_ENABLE);
+    WriteVolatile32(&Controller->OpRegisters->UsbCommand, Command);
+
+    // The controller must halt within 16 micro frames
+    WaitForConditionWithFault(Fault, (ReadVolatile32(&Controller->OpRegisters->UsbStatus) & XHCI_STATUS_HALTED) != 0, 250, 10);
+    if (Fault) {
+        ERROR("XHCI-Failure: Failed to stop controller, Command Register: 0x%x - Status: 0x%x",
+            Controller->OpRegisters->UsbCommand, Controller->OpRegisters->UsbStatus);
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+OsStatus_t
+XhciReset(
+    _In_ XhciController_t* Controller)
+{
+    int Fault = 0;
+
+    TRACE("XhciReset()");
+
+    WriteVolatile32(&Controller->OpRegisters->UsbCommand,
+        ReadVolatile32(&Controller->OpRegisters->UsbCommand) | XHCI_COMMAND_HCRESET);
+
+    // Both the reset bit and the not ready bit must clear before any register
+    // other than these may be written
+    WaitForConditionWithFault(Fault, (ReadVolatile32(&Controller->OpRegisters->UsbCommand) & XHCI_COMMAND_HCRESET) == 0, 500, 10);
+    if (!Fault) {
+        WaitForConditionWithFault(Fault, (ReadVolatile32(&Controller->OpRegisters->UsbStatus) & XHCI_STATUS_NOT_READY) == 0, 500, 10);
+    }
+    if (Fault) {
+        ERROR("XHCI-Failure: Reset signal won't deassert, Command Register: 0x%x - Status: 0x%x",
+            Controller->OpRegisters->UsbCommand, Controller->OpRegisters->UsbStatus);
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+/* XhciMemoryInitialize
+ * Allocates the device context array, the scratchpads, the command ring and the
+ * event ring. These are never reallocated, a restart reuses them. */
+OsStatus_t
+XhciMemoryInitialize(
+    _In_ XhciController_t* Controller)
+{
+    size_t PageSize = 0x1000;
+    int    i;
+
+    TRACE("XhciMemoryInitialize()");
+
+    if (MemoryAllocate(NULL, PageSize, XHCI_MEMORY_FLAGS, (void**)&Controller->Dcbaa,
+            &Controller->DcbaaPhysical) != OsSuccess) {
+        return OsError;
+    }
+
+    // Scratchpads are pages the controller may use for itself, the array of them
+    // is stored in the first entry of the device context array
+    Controller->ScratchpadCount = XHCI_SPARAM2_SCRATCHPADS(Controller->SParameters2);
+    if (Controller->ScratchpadCount != 0) {
+        uintptr_t ScratchpadPhysical;
+        if (MemoryAllocate(NULL, Controller->ScratchpadCount * sizeof(reg64_t), XHCI_MEMORY_FLAGS,
+                (void**)&Controller->ScratchpadArray, &Controller->ScratchpadArrayPhysical) != OsSuccess) {
+            return OsError;
+        }
+        if (MemoryAllocate(NULL, Controller->ScratchpadCount * PageSize, XHCI_MEMORY_FLAGS,
+                &Controller->Scratchpads, &ScratchpadPhysical) != OsSuccess) {
+            return OsError;
+        }
+        for (i = 0; i < Controller->ScratchpadCount; i++) {
+            Controller->ScratchpadArray[i] = ScratchpadPhysical + (i * PageSize);
+        }
+    }
+
+    Controller->CommandRing = XhciRingCreate();
+    if (Controller->CommandRing == NULL) {
+        return OsError;
+    }
+
+    if (MemoryAllocate(NULL, XHCI_EVENT_RING_SIZE * sizeof(XhciTransferRequestBlock_t), XHCI_MEMORY_FLAGS,
+            (void**)&Controller->EventRing, &Controller->EventRingPhysical) != OsSuccess) {
+        return OsError;
+    }
+    if (MemoryAllocate(NULL, PageSize, XHCI_MEMORY_FLAGS, (void**)&Controller->EventRingTable,
+            &Controller->EventRingTablePhysical) != OsSuccess) {
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+void
+XhciMemoryDestroy(
+    _In_ XhciController_t* Controller)
+{
+    if (Controller->Dcbaa != NULL) {
+        MemoryFree((void*)Controller->Dcbaa, 0x1000);
+    }
+    if (Controller->ScratchpadArray != NULL) {
+        MemoryFree((void*)Controller->ScratchpadArray, Controller->ScratchpadCount * sizeof(reg64_t));
+    }
+    if (Controller->Scratchpads != NULL) {
+        MemoryFree(Controller->Scratchpads, Controller->ScratchpadCount * 0x1000);
+    }
+    XhciRingDestroy(Controller->CommandRing);
+    if (Controller->EventRing != NULL) {
+        MemoryFree((void*)Controller->EventRing, XHCI_EVENT_RING_SIZE * sizeof(XhciTransferRequestBlock_t));
+    }
+    if (Controller->EventRingTable != NULL) {
+        MemoryFree((void*)Controller->EventRingTable, 0x1000);
+    }
+}
+
+OsStatus_t
+XhciRestart(
+    _In_ XhciController_t* Controller)
+{
+    XhciInterrupterRegisters_t* Interrupter = &Controller->RuntimeRegisters->Interrupters[0];
+    reg32_t                     Command;
+
+    TRACE("XhciRestart()");
+
+    // Stop controller, unschedule everything
+    // and then reset it.
+    if (XhciHalt(Controller)  != OsSuccess ||
+        XhciReset(Controller) != OsSuccess) {
+        ERROR("Failed to halt or reset controller");
+        return OsError;
+    }
+
+    // Reset the software state of the rings, the devices are forgotten by
+    // the controller on reset
+    memset((void*)Controller->Dcbaa, 0, 0x1000);
+    if (Controller->ScratchpadCount != 0) {
+        Controller->Dcbaa[0] = Controller->ScratchpadArrayPhysical;
+    }
+    XhciRingReset(Controller->CommandRing);
+    memset((void*)Controller->EventRing, 0, XHCI_EVENT_RING_SIZE * sizeof(XhciTransferRequestBlock_t));
+    Controller->EventDequeue = 0;
+    Controller->EventCycle   = 1;
+
+    // Program the number of slots we use and the addresses of the structures
+    WriteVolatile32(&Controller->OpRegisters->Configure, (reg32_t)Controller->MaxSlots);
+    WriteVolatile32(&Controller->OpRegisters->DcbaaLo, LODWORD(Controller->DcbaaPhysical));
+    WriteVolatile32(&Controller->OpRegisters->DcbaaHi, HIDWORD(Controller->DcbaaPhysical));
+    WriteVolatile32(&Controller->OpRegisters->CommandRingLo,
+        LODWORD(Controller->CommandRing->Physical) | XHCI_CRCR_CYCLE);
+    WriteVolatile32(&Controller->OpRegisters->CommandRingHi, HIDWORD(Controller->CommandRing->Physical));
+
+    // Setup the primary interrupter with a single segment event ring, the moderation
+    // interval coalesces completions into fewer interrupts under load
+    Controller->EventRingTable[0].AddressLo = LODWORD(Controller->EventRingPhysical);
+    Controller->EventRingTable[0].AddressHi = HIDWORD(Controller->EventRingPhysical);
+    Controller->EventRingTable[0].Size      = XHCI_EVENT_RING_SIZE;
+    WriteVolatile32(&Interrupter->TableSize, 1);
+    WriteVolatile32(&Interrupter->DequeueLo, LODWORD(Controller->EventRingPhysical));
+    WriteVolatile32(&Interrupter->DequeueHi, HIDWORD(Controller->EventRingPhysical));
+    WriteVolatile32(&Interrupter->TableAddressLo, LODWORD(Controller->EventRingTablePhysical));
+    WriteVolatile32(&Interrupter->TableAddressHi, HIDWORD(Controller->EventRingTablePhysical));
+    WriteVolatile32(&Interrupter->Moderation, XHCI_INTERRUPT_MODERATION);
+    WriteVolatile32(&Interrupter->Management, XHCI_IMAN_ENABLE | XHCI_IMAN_PENDING);
+    WriteVolatile32(&Controller->OpRegisters->UsbStatus, XHCI_STATUS_RWC);
+
+    // Start the controller by enabling it
+    Command = ReadVolatile32(&Controller->OpRegisters->UsbCommand);
+    Command |= XHCI_COMMAND_RUN | XHCI_COMMAND_INTERRUPT_ENABLE | XHCI_COMMAND_HOSTERROR_ENABLE;
+    WriteVolatile32(&Controller->OpRegisters->UsbCommand, Command);
+    return OsSuccess;
+}
+
+OsStatus_t
+XhciSetup(
+    _In_ XhciController_t* Controller)
+{
+    reg32_t PortStatus;
+    size_t  i;
+
+    TRACE("XhciSetup()");
+
+    // Save some read-only but often accessed information
+    Controller->SParameters1   = ReadVolatile32(&Controller->CapRegisters->SParams1);
+    Controller->SParameters2   = ReadVolatile32(&Controller->CapRegisters->SParams2);
+    Controller->CParameters1   = ReadVolatile32(&Controller->CapRegisters->CParams1);
+    Controller->MaxSlots       = MIN(XHCI_SPARAM1_MAXSLOTS(Controller->SParameters1), XHCI_MAX_SLOTS);
+    Controller->ContextSize    = (Controller->CParameters1 & XHCI_CPARAM1_CSZ) ? 64 : 32;
+    Controller->Base.PortCount = MIN(XHCI_SPARAM1_MAXPORTS(Controller->SParameters1), USB_MAX_PORTS);
+
+    XhciDisableLegacySupport(Controller);
+
+    // We then stop the controller, reset it and
+    // initialize data-structures
+    if (XhciMemoryInitialize(Controller) != OsSuccess) {
+        ERROR("Failed to allocate memory for the xhci-controller");
+        return OsError;
+    }
+    XhciQueueInitialize(Controller);
+    if (XhciRestart(Controller) != OsSuccess) {
+        return OsError;
+    }
+
+    // Register the controller before starting
+    if (UsbManagerRegisterController(&Controller->Base) != OsSuccess) {
+        ERROR(" > failed to register xhci controller with the system.");
+    }
+
+    // Ports of controllers without power switches are always powered
+    if (Controller->CParameters1 & XHCI_CPARAM1_PPC) {
+        for (i = 0; i < Controller->Base.PortCount; i++) {
+            PortStatus = ReadVolatile32(&Controller->OpRegisters->Ports[i].Status);
+            WriteVolatile32(&Controller->OpRegisters->Ports[i].Status,
+                XHCI_PORT_NEUTRAL(PortStatus) | XHCI_PORT_POWER);
+        }
+        thrd_sleepex(20);
+    }
+
+    // Report the devices that are already connected
+    for (i = 0; i < Controller->Base.PortCount; i++) {
+        PortStatus = ReadVolatile32(&Controller->OpRegisters->Ports[i].Status);
+        WriteVolatile32(&Controller->OpRegisters->Ports[i].Status,
+            XHCI_PORT_NEUTRAL(PortStatus) | (PortStatus & XHCI_PORT_RWC));
+        if (PortStatus & XHCI_PORT_CONNECTED) {
+            UsbEventPort(Controller->Base.Device.Id, 0, (uint8_t)(i & 0xFF));
+        }
+    }
+    return OsSuccess;
+}
@@ -0,0 +1,578 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <os/mollenos.h>
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Device contexts
+ * The input context is kept in the first page of the device memory, and the output
+ * context that is owned by the controller is kept in the second page. */
+#define XHCI_CONTEXT_PAGE                   0x1000
+#define XHCI_CONTEXT_MEMORY                 (2 * XHCI_CONTEXT_PAGE)
+
+#define XHCI_INPUT_ADD(Device)              (((reg32_t*)(Device)->InputContext)[1])
+#define XHCI_INPUT_SLOT(Controller, Device) \
+    ((XhciSlotContext_t*)((Device)->InputContext + (Controller)->ContextSize))
+#define XHCI_INPUT_ENDPOINT(Controller, Device, Dci) \
+    ((XhciEndpointContext_t*)((Device)->InputContext + (((Dci) + 1) * (Controller)->ContextSize)))
+#define XHCI_OUTPUT_SLOT(Device)            ((XhciSlotContext_t*)(Device)->OutputContext)
+#define XHCI_OUTPUT_ENDPOINT(Controller, Device, Dci) \
+    ((XhciEndpointContext_t*)((Device)->OutputContext + ((Dci) * (Controller)->ContextSize)))
+
+/* XhciDefaultPacketSize
+ * The max packet size of the default control endpoint before the device descriptor
+ * has been read. */
+static size_t
+XhciDefaultPacketSize(
+    _In_ int Speed)
+{
+    switch (Speed) {
+        case XHCI_PORT_SPEED_LOW:
+        case XHCI_PORT_SPEED_FULL:
+            return 8;
+        case XHCI_PORT_SPEED_HIGH:
+            return 64;
+        default:
+            return 512;
+    }
+}
+
+/* XhciDequeuePointer
+ * Builds the dequeue pointer of an endpoint or stream context from the current
+ * enqueue position of the ring. */
+static reg32_t
+XhciDequeuePointer(
+    _In_ XhciRing_t* Ring)
+{
+    uintptr_t Dequeue = Ring->Physical + (Ring->Enqueue * sizeof(XhciTransferRequestBlock_t));
+    return LODWORD(Dequeue) | (reg32_t)Ring->Cycle;
+}
+
+/* XhciDeviceBuildAddress
+ * Prepares the input context for the address device command, the slot context and
+ * the default control endpoint context are added. */
+static void
+XhciDeviceBuildAddress(
+    _In_ XhciController_t* Controller,
+    _In_ XhciDevice_t*     Device)
+{
+    XhciSlotContext_t*     Slot     = XHCI_INPUT_SLOT(Controller, Device);
+    XhciEndpointContext_t* Endpoint = XHCI_INPUT_ENDPOINT(Controller, Device, 1);
+
+    memset(Device->InputContext, 0, XHCI_CONTEXT_PAGE);
+    XHCI_INPUT_ADD(Device) = (1 << 0) | (1 << 1);
+
+    Slot->Flags = XHCI_SLOT_SPEED(Device->Speed) | XHCI_SLOT_ENTRIES(1);
+    Slot->Port  = XHCI_SLOT_ROOTPORT(Device->Port + 1);
+
+    Endpoint->Configuration = XHCI_EP_ERRORCOUNT(3) | XHCI_EP_TYPE(XHCI_EP_TYPE_CONTROL) |
+        XHCI_EP_MAXPACKETSIZE(Device->Endpoints[1].MaxPacketSize);
+    Endpoint->DequeueLo = XhciDequeuePointer(Device->Endpoints[1].Ring);
+    Endpoint->DequeueHi = HIDWORD(Device->Endpoints[1].Ring->Physical);
+    Endpoint->Lengths   = XHCI_EP_AVERAGE_LENGTH(8);
+}
+
+XhciDevice_t*
+XhciDeviceFromSlot(
+    _In_ XhciController_t* Controller,
+    _In_ int               SlotId)
+{
+    size_t i;
+    for (i = 0; i < Controller->Base.PortCount; i++) {
+        if (Controller->Devices[i] != NULL && Controller->Devices[i]->SlotId == SlotId) {
+            return Controller->Devices[i];
+        }
+    }
+    return NULL;
+}
+
+OsStatus_t
+XhciDeviceCreate(
+    _In_ XhciController_t* Controller,
+    _In_ int               Port,
+    _In_ int               Speed)
+{
+    XhciDevice_t* Device;
+    int           SlotId = 0;
+    int           Code;
+
+    TRACE("XhciDeviceCreate(Port %i, Speed %i)", Port, Speed);
+
+    // A reset of the port always means a new device
+    XhciDeviceDestroy(Controller, Port);
+
+    Code = XhciCommandExecute(Controller, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_ENABLE_SLOT), &SlotId);
+    if (Code != XHCI_CC_SUCCESS || SlotId == 0 || SlotId > Controller->MaxSlots) {
+        ERROR("XHCI: Failed to enable a slot for port %i (code %i)", Port, Code);
+        return OsError;
+    }
+
+    Device = (XhciDevice_t*)malloc(sizeof(XhciDevice_t));
+    if (Device == NULL) {
+        XhciCommandExecute(Controller, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_DISABLE_SLOT) | XHCI_TRB_SLOT(SlotId), NULL);
+        return OsError;
+    }
+    memset(Device, 0, sizeof(XhciDevice_t));
+    Device->SlotId = SlotId;
+    Device->Port   = Port;
+    Device->Speed  = Speed;
+
+    if (MemoryAllocate(NULL, XHCI_CONTEXT_MEMORY, XHCI_MEMORY_FLAGS,
+            (void**)&Device->InputContext, &Device->InputContextPhysical) != OsSuccess) {
+        ERROR("XHCI: Failed to allocate device contexts");
+        XhciCommandExecute(Controller, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_DISABLE_SLOT) | XHCI_TRB_SLOT(SlotId), NULL);
+        free(Device);
+        return OsError;
+    }
+    Device->OutputContext         = Device->InputContext + XHCI_CONTEXT_PAGE;
+    Device->OutputContextPhysical = Device->InputContextPhysical + XHCI_CONTEXT_PAGE;
+
+    Device->Endpoints[1].Ring          = XhciRingCreate();
+    Device->Endpoints[1].Type          = XHCI_EP_TYPE_CONTROL;
+    Device->Endpoints[1].MaxPacketSize = XhciDefaultPacketSize(Speed);
+    Device->Endpoints[1].Configured    = 1;
+    Controller->Dcbaa[SlotId]          = Device->OutputContextPhysical;
+    Controller->Devices[Port]          = Device;
+    if (Device->Endpoints[1].Ring == NULL) {
+        XhciDeviceDestroy(Controller, Port);
+        return OsError;
+    }
+
+    // Address the device without sending SET_ADDRESS, this moves the slot to the default
+    // state and lets the usb stack talk to the device at address 0
+    XhciDeviceBuildAddress(Controller, Device);
+    Code = XhciCommandExecute(Controller, LODWORD(Device->InputContextPhysical), HIDWORD(Device->InputContextPhysical), 0,
+        XHCI_TRB_TYPE(XHCI_TRB_ADDRESS_DEVICE) | XHCI_TRB_BSR | XHCI_TRB_SLOT(SlotId), NULL);
+    if (Code != XHCI_CC_SUCCESS) {
+        ERROR("XHCI: Failed to setup the slot for port %i (code %i)", Port, Code);
+        XhciDeviceDestroy(Controller, Port);
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+void
+XhciDeviceDestroy(
+    _In_ XhciController_t* Controller,
+    _In_ int               Port)
+{
+    XhciDevice_t* Device = Controller->Devices[Port];
+    int           i, j;
+
+    if (Device == NULL) {
+        return;
+    }
+    TRACE("XhciDeviceDestroy(Port %i, Slot %i)", Port, Device->SlotId);
+
+    // Fail any transfers that are still on the rings of the device, they are picked up
+    // by the next processing of the completed transfers
+    mtx_lock(&Controller->RingLock);
+    foreach(Node, Controller->Base.TransactionList) {
+        UsbManagerTransfer_t*     Transfer = (UsbManagerTransfer_t*)Node->Data;
+        XhciTransferDescriptor_t* Td       = (XhciTransferDescriptor_t*)Transfer->EndpointDescriptor;
+        if (Td != NULL && Td->SlotId == Device->SlotId && Td->Ring != NULL) {
+            if (!(Td->Flags & XHCI_TD_COMPLETED)) {
+                Td->CompletionCode = XHCI_CC_TRANSACTION;
+                Td->Flags         |= XHCI_TD_COMPLETED;
+                UsbManagerCompleteTransfer(&Controller->Base, Transfer);
+            }
+            Td->Ring = NULL;
+        }
+    }
+    Controller->Devices[Port] = NULL;
+    mtx_unlock(&Controller->RingLock);
+
+    if (!(ReadVolatile32(&Controller->OpRegisters->UsbStatus) & XHCI_STATUS_HALTED)) {
+        XhciCommandExecute(Controller, 0, 0, 0,
+            XHCI_TRB_TYPE(XHCI_TRB_DISABLE_SLOT) | XHCI_TRB_SLOT(Device->SlotId), NULL);
+    }
+    Controller->Dcbaa[Device->SlotId] = 0;
+
+    for (i = 0; i < XHCI_MAX_ENDPOINTS; i++) {
+        XhciEndpoint_t* Endpoint = &Device->Endpoints[i];
+        XhciRingDestroy(Endpoint->Ring);
+        for (j = 1; j < Endpoint->StreamCount; j++) {
+            XhciRingDestroy(Endpoint->StreamRings[j]);
+        }
+        if (Endpoint->StreamContexts != NULL) {
+            MemoryFree((void*)Endpoint->StreamContexts, XHCI_CONTEXT_PAGE);
+        }
+    }
+    if (Device->InputContext != NULL) {
+        MemoryFree((void*)Device->InputContext, XHCI_CONTEXT_MEMORY);
+    }
+    free(Device);
+}
+
+UsbTransferStatus_t
+XhciDeviceAddress(
+    _In_ XhciController_t* Controller,
+    _In_ XhciDevice_t*     Device)
+{
+    int Code;
+
+    TRACE("XhciDeviceAddress(Slot %i)", Device->SlotId);
+    if (Device->Addressed) {
+        return TransferFinished;
+    }
+
+    // The control ring has been used since the first address command, the dequeue
+    // pointer must follow the ring
+    XhciDeviceBuildAddress(Controller, Device);
+    Code = XhciCommandExecute(Controller, LODWORD(Device->InputContextPhysical), HIDWORD(Device->InputContextPhysical), 0,
+        XHCI_TRB_TYPE(XHCI_TRB_ADDRESS_DEVICE) | XHCI_TRB_SLOT(Device->SlotId), NULL);
+    if (Code != XHCI_CC_SUCCESS) {
+        return (Code == 0) ? TransferNotResponding : XhciGetStatusCode(Code);
+    }
+    Device->Addressed = 1;
+    return TransferFinished;
+}
+
+OsStatus_t
+XhciDeviceUpdateControl(
+    _In_ XhciController_t* Controller,
+    _In_ XhciDevice_t*     Device,
+    _In_ size_t            MaxPacketSize)
+{
+    XhciEndpointContext_t* Endpoint = XHCI_INPUT_ENDPOINT(Controller, Device, 1);
+    int                    Code;
+
+    if (MaxPacketSize == 0 || Device->Endpoints[1].MaxPacketSize == MaxPacketSize) {
+        return OsSuccess;
+    }
+    TRACE("XhciDeviceUpdateControl(Slot %i, MaxPacketSize %u)", Device->SlotId, LODWORD(MaxPacketSize));
+
+    memset(Device->InputContext, 0, XHCI_CONTEXT_PAGE);
+    XHCI_INPUT_ADD(Device) = (1 << 1);
+    memcpy(Endpoint, XHCI_OUTPUT_ENDPOINT(Controller, Device, 1), sizeof(XhciEndpointContext_t));
+    Endpoint->Configuration &= ~(XHCI_EP_MAXPACKETSIZE(0xFFFF));
+    Endpoint->Configuration |= XHCI_EP_MAXPACKETSIZE(MaxPacketSize);
+
+    Code = XhciCommandExecute(Controller, LODWORD(Device->InputContextPhysical), HIDWORD(Device->InputContextPhysical), 0,
+        XHCI_TRB_TYPE(XHCI_TRB_EVALUATE_CONTEXT) | XHCI_TRB_SLOT(Device->SlotId), NULL);
+    if (Code != XHCI_CC_SUCCESS) {
+        return OsError;
+    }
+    Device->Endpoints[1].MaxPacketSize = MaxPacketSize;
+    return OsSuccess;
+}
+
+int
+XhciEndpointGetIndex(
+    _In_ UsbTransfer_t* Transfer)
+{
+    if (Transfer->Type == ControlTransfer) {
+        return (Transfer->Address.EndpointAddress * 2) + 1;
+    }
+    return (Transfer->Address.EndpointAddress * 2) +
+        ((Transfer->Endpoint.Direction == USB_ENDPOINT_IN) ? 1 : 0);
+}
+
+/* XhciEndpointInterval
+ * Converts the interval of the endpoint descriptor to the exponent used by the
+ * endpoint context, the interval is 2^n * 125us. */
+static int
+XhciEndpointInterval(
+    _In_ XhciDevice_t*  Device,
+    _In_ UsbTransfer_t* Transfer)
+{
+    int Interval = (int)MAX(Transfer->Endpoint.Interval, 1);
+    int Exponent = 0;
+
+    if (Device->Speed == XHCI_PORT_SPEED_HIGH || Device->Speed >= XHCI_PORT_SPEED_SUPER) {
+        return MIN(Interval, 16) - 1;
+    }
+    if (Transfer->Type == IsochronousTransfer) {
+        return MIN(Interval, 16) + 2;
+    }
+
+    // Full and low speed interrupt endpoints are given in frames
+    Interval *= 8;
+    while ((1 << (Exponent + 1)) <= Interval) {
+        Exponent++;
+    }
+    return MAX(3, MIN(Exponent, 10));
+}
+
+/* XhciEndpointCreateStreams
+ * Allocates the rings and the primary stream context array of a bulk endpoint. */
+static OsStatus_t
+XhciEndpointCreateStreams(
+    _In_ XhciController_t* Controller,
+    _In_ XhciEndpoint_t*   Endpoint,
+    _In_ size_t            MaxStreams)
+{
+    int MaxArraySize = 1 << (XHCI_CPARAM1_MAXPSASIZE(Controller->CParameters1) + 1);
+    int Count        = 4;
+    int i;
+
+    while (Count < XHCI_MAX_STREAMS && Count < MaxArraySize && (size_t)(Count - 1) < MaxStreams) {
+        Count <<= 1;
+    }
+
+    if (MemoryAllocate(NULL, XHCI_CONTEXT_PAGE, XHCI_MEMORY_FLAGS,
+            (void**)&Endpoint->StreamContexts, &Endpoint->StreamContextsPhysical) != OsSuccess) {
+        return OsError;
+    }
+
+    Endpoint->StreamCount = Count;
+    for (i = 1; i < Count; i++) {
+        Endpoint->StreamRings[i] = XhciRingCreate();
+        if (Endpoint->StreamRings[i] == NULL) {
+            return OsError;
+        }
+        Endpoint->StreamContexts[i].DequeueLo = XhciDequeuePointer(Endpoint->StreamRings[i]) |
+            XHCI_STREAM_PRIMARY_RING;
+        Endpoint->StreamContexts[i].DequeueHi = HIDWORD(Endpoint->StreamRings[i]->Physical);
+    }
+    return OsSuccess;
+}
+
+/* XhciEndpointFree
+ * Releases the rings of an endpoint that failed to configure. */
+static void
+XhciEndpointFree(
+    _In_ XhciEndpoint_t* Endpoint)
+{
+    int i;
+    XhciRingDestroy(Endpoint->Ring);
+    for (i = 1; i < Endpoint->StreamCount; i++) {
+        XhciRingDestroy(Endpoint->StreamRings[i]);
+    }
+    if (Endpoint->StreamContexts != NULL) {
+        MemoryFree((void*)Endpoint->StreamContexts, XHCI_CONTEXT_PAGE);
+    }
+    memset(Endpoint, 0, sizeof(XhciEndpoint_t));
+}
+
+OsStatus_t
+XhciEndpointConfigure(
+    _In_ XhciController_t* Controller,
+    _In_ XhciDevice_t*     Device,
+    _In_ UsbTransfer_t*    Transfer)
+{
+    XhciEndpointContext_t* Context;
+    XhciSlotContext_t*     Slot;
+    XhciEndpoint_t*        Endpoint;
+    int                    Dci = XhciEndpointGetIndex(Transfer);
+    int                    SuperSpeed = (Device->Speed >= XHCI_PORT_SPEED_SUPER);
+    size_t                 MaxPacketSize = Transfer->Endpoint.MaxPacketSize;
+    size_t                 MaxBurst = 0;
+    size_t                 Mult = 0;
+    size_t                 MaxEsit;
+    int                    Entries;
+    int                    Code;
+
+    if (Dci <= 0 || Dci >= XHCI_MAX_ENDPOINTS) {
+        return OsError;
+    }
+
+    Endpoint = &Device->Endpoints[Dci];
+    if (Endpoint->Configured) {
+        return OsSuccess;
+    }
+    TRACE("XhciEndpointConfigure(Slot %i, Dci %i)", Device->SlotId, Dci);
+
+    // Select the endpoint type
+    switch (Transfer->Type) {
+        case ControlTransfer:
+            Endpoint->Type = XHCI_EP_TYPE_CONTROL;
+            break;
+        case BulkTransfer:
+            Endpoint->Type = (Dci & 1) ? XHCI_EP_TYPE_BULK_IN : XHCI_EP_TYPE_BULK_OUT;
+            break;
+        case InterruptTransfer:
+            Endpoint->Type = (Dci & 1) ? XHCI_EP_TYPE_INTERRUPT_IN : XHCI_EP_TYPE_INTERRUPT_OUT;
+            break;
+        default:
+            Endpoint->Type = (Dci & 1) ? XHCI_EP_TYPE_ISOC_IN : XHCI_EP_TYPE_ISOC_OUT;
+            break;
+    }
+    Endpoint->MaxPacketSize = MaxPacketSize;
+
+    // Superspeed endpoints carry the burst size in the companion descriptor, highspeed
+    // periodic endpoints encode additional transactions in the max packet size
+    if (SuperSpeed) {
+        MaxBurst = Transfer->Endpoint.MaxBurst;
+        if (Transfer->Type == IsochronousTransfer) {
+            Mult = MAX(Transfer->Endpoint.Bandwidth, 1) - 1;
+        }
+    }
+    else if (Device->Speed == XHCI_PORT_SPEED_HIGH &&
+             (Transfer->Type == InterruptTransfer || Transfer->Type == IsochronousTransfer)) {
+        MaxBurst = MAX(Transfer->Endpoint.Bandwidth, 1) - 1;
+    }
+    MaxEsit = MaxPacketSize * (MaxBurst + 1) * (Mult + 1);
+
+    memset(Device->InputContext, 0, XHCI_CONTEXT_PAGE);
+    XHCI_INPUT_ADD(Device) = (1 << 0) | (1 << Dci);
+
+    // The slot context must describe the last valid endpoint context
+    Slot = XHCI_INPUT_SLOT(Controller, Device);
+    memcpy(Slot, XHCI_OUTPUT_SLOT(Device), sizeof(XhciSlotContext_t));
+    Entries      = MAX((int)XHCI_SLOT_GET_ENTRIES(Slot->Flags), Dci);
+    Slot->Flags  = (Slot->Flags & ~(XHCI_SLOT_ENTRIES(0x1F))) | XHCI_SLOT_ENTRIES(Entries);
+    Slot->State  = 0;
+
+    Context                = XHCI_INPUT_ENDPOINT(Controller, Device, Dci);
+    Context->Configuration = XHCI_EP_TYPE(Endpoint->Type) | XHCI_EP_MAXBURST(MaxBurst) |
+        XHCI_EP_MAXPACKETSIZE(MaxPacketSize);
+    if (Transfer->Type != IsochronousTransfer) {
+        Context->Configuration |= XHCI_EP_ERRORCOUNT(3);
+    }
+    if (Transfer->Type == InterruptTransfer || Transfer->Type == IsochronousTransfer) {
+        Context->Flags   = XHCI_EP_INTERVAL(XhciEndpointInterval(Device, Transfer)) |
+            XHCI_EP_MULT(Mult) | XHCI_EP_MAXESIT_HI(MaxEsit);
+        Context->Lengths = XHCI_EP_MAXESIT_LO(MaxEsit) |
+            XHCI_EP_AVERAGE_LENGTH((Transfer->Type == InterruptTransfer) ? 1024 : 3072);
+    }
+    else {
+        Context->Lengths = XHCI_EP_AVERAGE_LENGTH((Transfer->Type == ControlTransfer) ? 8 : 3072);
+    }
+
+    // Bulk endpoints of superspeed devices get a stream context array instead of a ring
+    // if both the endpoint and the controller support streams
+    if (SuperSpeed && Transfer->Type == BulkTransfer && Transfer->Endpoint.MaxStreams != 0 &&
+        XHCI_CPARAM1_MAXPSASIZE(Controller->CParameters1) != 0) {
+        int Exponent = 0;
+        if (XhciEndpointCreateStreams(Controller, Endpoint, Transfer->Endpoint.MaxStreams) != OsSuccess) {
+            XhciEndpointFree(Endpoint);
+            return OsError;
+        }
+        while ((1 << (Exponent + 1)) < Endpoint->StreamCount) {
+            Exponent++;
+        }
+        Context->Flags    |= XHCI_EP_MAXPSTREAMS(Exponent) | XHCI_EP_LSA;
+        Context->DequeueLo = LODWORD(Endpoint->StreamContextsPhysical);
+        Context->DequeueHi = HIDWORD(Endpoint->StreamContextsPhysical);
+    }
+    else {
+        Endpoint->Ring = XhciRingCreate();
+        if (Endpoint->Ring == NULL) {
+            XhciEndpointFree(Endpoint);
+            return OsError;
+        }
+        Context->DequeueLo = XhciDequeuePointer(Endpoint->Ring);
+        Context->DequeueHi = HIDWORD(Endpoint->Ring->Physical);
+    }
+
+    Code = XhciCommandExecute(Controller, LODWORD(Device->InputContextPhysical), HIDWORD(Device->InputContextPhysical), 0,
+        XHCI_TRB_TYPE(XHCI_TRB_CONFIGURE_ENDPOINT) | XHCI_TRB_SLOT(Device->SlotId), NULL);
+    if (Code != XHCI_CC_SUCCESS) {
+        ERROR("XHCI: Failed to configure endpoint %i of slot %i (code %i)", Dci, Device->SlotId, Code);
+        XhciEndpointFree(Endpoint);
+        return OsError;
+    }
+    Endpoint->Configured = 1;
+    return OsSuccess;
+}
+
+XhciRing_t*
+XhciEndpointGetRing(
+    _In_ XhciEndpoint_t* Endpoint,
+    _In_ int             StreamId)
+{
+    if (Endpoint->StreamCount == 0) {
+        return (StreamId == 0) ? Endpoint->Ring : NULL;
+    }
+    if (StreamId <= 0 || StreamId >= Endpoint->StreamCount) {
+        return NULL;
+    }
+    return Endpoint->StreamRings[StreamId];
+}
+
+void
+XhciEndpointRecover(
+    _In_ XhciController_t*         Controller,
+    _In_ XhciTransferDescriptor_t* Td)
+{
+    XhciDevice_t* Device = XhciDeviceFromSlot(Controller, Td->SlotId);
+    XhciRing_t*   Ring   = Td->Ring;
+    uintptr_t     Dequeue;
+    reg32_t       DequeueLo;
+    int           Index;
+
+    if (Device == NULL || Ring == NULL) {
+        return;
+    }
+    TRACE("XhciEndpointRecover(Slot %i, Dci %i)", Td->SlotId, Td->Endpoint);
+
+    XhciCommandExecute(Controller, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_RESET_ENDPOINT) |
+        XHCI_TRB_ENDPOINT(Td->Endpoint) | XHCI_TRB_SLOT(Td->SlotId), NULL);
+
+    // Move the dequeue pointer past the failed td, any tds queued after it
+    // are left untouched
+    Index     = XhciRingNext(Td->TrbLast);
+    Dequeue   = Ring->Physical + (Index * sizeof(XhciTransferRequestBlock_t));
+    DequeueLo = LODWORD(Dequeue) | Td->NextCycle;
+    if (Td->StreamId != 0) {
+        DequeueLo |= XHCI_STREAM_PRIMARY_RING;
+    }
+    XhciCommandExecute(Controller, DequeueLo, HIDWORD(Dequeue), XHCI_TRB_STREAM(Td->StreamId),
+        XHCI_TRB_TYPE(XHCI_TRB_SET_TR_DEQUEUE) | XHCI_TRB_ENDPOINT(Td->Endpoint) |
+        XHCI_TRB_SLOT(Td->SlotId), NULL);
+
+    mtx_lock(&Controller->RingLock);
+    Ring->Dequeue = Index;
+    Device->Endpoints[Td->Endpoint].Halted = 0;
+    mtx_unlock(&Controller->RingLock);
+    XhciRingDoorbell(Controller, Td->SlotId, Td->Endpoint | (Td->StreamId << 16));
+}
+
+void
+XhciEndpointCancel(
+    _In_ XhciController_t*         Controller,
+    _In_ XhciTransferDescriptor_t* Td)
+{
+    XhciRing_t* Ring;
+    int         Index;
+
+    TRACE("XhciEndpointCancel(Slot %i, Dci %i)", Td->SlotId, Td->Endpoint);
+    XhciCommandExecute(Controller, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_STOP_ENDPOINT) |
+        XHCI_TRB_ENDPOINT(Td->Endpoint) | XHCI_TRB_SLOT(Td->SlotId), NULL);
+
+    // The td might have completed while the endpoint was stopping. Otherwise the trbs
+    // are turned into no-ops, the last one still interrupts so the ring moves on
+    mtx_lock(&Controller->RingLock);
+    Ring = Td->Ring;
+    if (Ring != NULL && !(Td->Flags & XHCI_TD_COMPLETED)) {
+        Index = Td->TrbFirst;
+        while (1) {
+            reg32_t Control = Ring->Trbs[Index].Control & (XHCI_TRB_CYCLE | XHCI_TRB_CHAIN);
+            Control        |= XHCI_TRB_TYPE(XHCI_TRB_NOOP);
+            if (Index == Td->TrbLast) {
+                Ring->Trbs[Index].Control = Control | XHCI_TRB_IOC;
+                break;
+            }
+            Ring->Trbs[Index].Control = Control;
+            Index = XhciRingNext(Index);
+        }
+        Td->Flags |= XHCI_TD_CANCELLED | XHCI_TD_COMPLETED;
+    }
+    mtx_unlock(&Controller->RingLock);
+    XhciRingDoorbell(Controller, Td->SlotId, Td->Endpoint | (Td->StreamId << 16));
+}
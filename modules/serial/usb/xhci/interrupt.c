@@ -0,0 +1,129 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <os/mollenos.h>
+#include <ddk/utils.h>
+#include "../common/manager.h"
+#include "xhci.h"
+
+/* OnFastInterrupt
+ * Is called for the sole purpose to determine if this source
+ * has invoked an irq. If it has, silence and return (Handled) */
+InterruptStatus_t
+OnFastInterrupt(
+    _In_ FastInterruptResources_t*  InterruptTable,
+    _In_ void*                      NotUsed)
+{
+    XhciController_t*           Controller = (XhciController_t*)INTERRUPT_RESOURCE(InterruptTable, 0);
+    uintptr_t                   Base       = INTERRUPT_IOSPACE(InterruptTable, 0)->Access.Memory.VirtualBase;
+    XhciCapabilityRegisters_t*  Capabilities = (XhciCapabilityRegisters_t*)Base;
+    XhciOperationalRegisters_t* Registers;
+    XhciRuntimeRegisters_t*     Runtime;
+    reg32_t                     InterruptStatus;
+    _CRT_UNUSED(NotUsed);
+
+    Registers       = (XhciOperationalRegisters_t*)(Base + Capabilities->Length);
+    Runtime         = (XhciRuntimeRegisters_t*)(Base + (Capabilities->RuntimeOffset & ~0x1F));
+    InterruptStatus = Registers->UsbStatus & (XHCI_STATUS_INTERRUPT | XHCI_STATUS_HOSTERROR | XHCI_STATUS_PORTCHANGE);
+
+    // Was the interrupt even from this controller?
+    if (!InterruptStatus) {
+        return InterruptNotHandled;
+    }
+
+    // Acknowledge the interrupt by clearing, the pending bit of the interrupter
+    // must be cleared as well or no further interrupts will be raised
+    Registers->UsbStatus                    = InterruptStatus;
+    Runtime->Interrupters[0].Management     = XHCI_IMAN_ENABLE | XHCI_IMAN_PENDING;
+    Controller->Base.InterruptStatus       |= InterruptStatus;
+    return InterruptHandled;
+}
+
+/* OnInterrupt
+ * Is called by external services to indicate an external interrupt.
+ * This is to actually process the device interrupt */
+InterruptStatus_t
+OnInterrupt(
+    _In_Opt_ void*  InterruptData,
+    _In_Opt_ size_t Arg0,
+    _In_Opt_ size_t Arg1,
+    _In_Opt_ size_t Arg2)
+{
+    XhciController_t* Controller      = (XhciController_t*)InterruptData;
+    reg32_t           InterruptStatus = 0;
+    reg32_t           ChangeBits;
+    reg32_t           PortStatus;
+    size_t            i;
+
+    _CRT_UNUSED(Arg0);
+    _CRT_UNUSED(Arg1);
+    _CRT_UNUSED(Arg2);
+
+ProcessInterrupt:
+    InterruptStatus                     = Controller->Base.InterruptStatus;
+    Controller->Base.InterruptStatus    = 0;
+
+    // The event ring carries both transfer completions and port changes, so it's
+    // drained on any interrupt before acting on either
+    XhciProcessEvents(Controller);
+    mtx_lock(&Controller->EventLock);
+    ChangeBits              = Controller->PortChanges;
+    Controller->PortChanges = 0;
+    mtx_unlock(&Controller->EventLock);
+
+    // Removed devices must be released before the transfers are processed
+    if (ChangeBits != 0 || (InterruptStatus & XHCI_STATUS_PORTCHANGE)) {
+        XhciPortScan(Controller, (ChangeBits != 0) ? ChangeBits : (reg32_t)~0);
+    }
+    UsbManagerProcessTransfers(&Controller->Base);
+
+    // HC Fatal Error
+    // Clear all queued, reset controller and report the ports again as the
+    // device slots are lost
+    if (InterruptStatus & XHCI_STATUS_HOSTERROR) {
+        if (XhciQueueReset(Controller) != OsSuccess) {
+            ERROR("XHCI-Failure: Failed to reset queue after fatal error");
+        }
+        for (i = 0; i < Controller->Base.PortCount; i++) {
+            XhciDeviceDestroy(Controller, (int)i);
+        }
+        if (XhciRestart(Controller) != OsSuccess) {
+            ERROR("XHCI-Failure: Failed to reset controller after fatal error");
+        }
+        else {
+            for (i = 0; i < Controller->Base.PortCount; i++) {
+                PortStatus = ReadVolatile32(&Controller->OpRegisters->Ports[i].Status);
+                if (PortStatus & XHCI_PORT_CONNECTED) {
+                    UsbEventPort(Controller->Base.Device.Id, 0, (uint8_t)(i & 0xFF));
+                }
+            }
+        }
+    }
+
+    // In case an interrupt fired during processing
+    if (Controller->Base.InterruptStatus != 0) {
+        goto ProcessInterrupt;
+    }
+    return InterruptHandled;
+}
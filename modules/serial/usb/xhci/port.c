@@ -0,0 +1,135 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <threads.h>
+
+OsStatus_t
+HciPortReset(
+    _In_ UsbManagerController_t* Controller,
+    _In_ int                     Index)
+{
+    XhciController_t* Xhci   = (XhciController_t*)Controller;
+    reg32_t           Status = ReadVolatile32(&Xhci->OpRegisters->Ports[Index].Status);
+    reg32_t           Temp   = 0;
+
+    TRACE("HciPortReset(Index %i)", Index);
+
+    // If we are per-port handled, and power is not enabled
+    // then switch it on, and give it some time to recover
+    if (!(Status & XHCI_PORT_POWER)) {
+        WriteVolatile32(&Xhci->OpRegisters->Ports[Index].Status, XHCI_PORT_NEUTRAL(Status) | XHCI_PORT_POWER);
+        thrd_sleepex(20);
+        Status = ReadVolatile32(&Xhci->OpRegisters->Ports[Index].Status);
+    }
+
+    // The controller drives the reset signal itself and reports the end of it by
+    // the reset change bit, for usb3 ports this is a hot reset
+    WriteVolatile32(&Xhci->OpRegisters->Ports[Index].Status, XHCI_PORT_NEUTRAL(Status) | XHCI_PORT_RESET);
+    WaitForConditionWithFault(Temp, (ReadVolatile32(&Xhci->OpRegisters->Ports[Index].Status) & XHCI_PORT_RESET_EVENT) != 0, 250, 10);
+    Status = ReadVolatile32(&Xhci->OpRegisters->Ports[Index].Status);
+    WriteVolatile32(&Xhci->OpRegisters->Ports[Index].Status, XHCI_PORT_NEUTRAL(Status) | (Status & XHCI_PORT_RWC));
+    if (Temp != 0) {
+        ERROR("XHCI::Host controller failed to reset the port in time.");
+        return OsError;
+    }
+    if (!(Status & XHCI_PORT_ENABLED)) {
+        return OsError;
+    }
+
+    // A device slot is assigned to the port as soon as it's enabled, the device
+    // gets its address by the usb stack later on
+    return XhciDeviceCreate(Xhci, Index, XHCI_PORT_SPEED(Status));
+}
+
+void
+HciPortGetStatus(
+    _In_  UsbManagerController_t* Controller,
+    _In_  int                     Index,
+    _Out_ UsbHcPortDescriptor_t*  Port)
+{
+    XhciController_t* Xhci   = (XhciController_t*)Controller;
+    reg32_t           Status = ReadVolatile32(&Xhci->OpRegisters->Ports[Index].Status);
+
+    Port->Connected = (Status & XHCI_PORT_CONNECTED) == 0 ? 0 : 1;
+    Port->Enabled   = (Status & XHCI_PORT_ENABLED) == 0 ? 0 : 1;
+    switch (XHCI_PORT_SPEED(Status)) {
+        case XHCI_PORT_SPEED_LOW:
+            Port->Speed = LowSpeed;
+            break;
+        case XHCI_PORT_SPEED_HIGH:
+            Port->Speed = HighSpeed;
+            break;
+        case XHCI_PORT_SPEED_SUPER:
+        case XHCI_PORT_SPEED_SUPERPLUS:
+            Port->Speed = SuperSpeed;
+            break;
+        default:
+            Port->Speed = FullSpeed;
+            break;
+    }
+}
+
+OsStatus_t
+XhciPortCheck(
+    _In_ XhciController_t* Controller,
+    _In_ int               Index)
+{
+    reg32_t Status = ReadVolatile32(&Controller->OpRegisters->Ports[Index].Status);
+
+    // Clear all event bits
+    WriteVolatile32(&Controller->OpRegisters->Ports[Index].Status,
+        XHCI_PORT_NEUTRAL(Status) | (Status & XHCI_PORT_RWC));
+
+    // Over-current event. We should tell the usb-stack this port
+    // is now disabled and to disable anything related to this device
+    if (Status & XHCI_PORT_OVERCURRENT_EVENT) {
+        ERROR("Port %i reported over current. TODO", Index);
+        return OsSuccess;
+    }
+
+    // Connection event, the slot of a removed device is released right away
+    // so the rings stop being used before the usb stack catches up
+    if (Status & XHCI_PORT_CONNECT_EVENT) {
+        TRACE("XhciPortCheck(Index %i, Status 0x%x)", Index, Status);
+        if (!(Status & XHCI_PORT_CONNECTED)) {
+            XhciDeviceDestroy(Controller, Index);
+        }
+        return UsbEventPort(Controller->Base.Device.Id, 0, (uint8_t)(Index & 0xFF));
+    }
+    return OsError;
+}
+
+void
+XhciPortScan(
+    _In_ XhciController_t* Controller,
+    _In_ reg32_t           ChangeBits)
+{
+    for (size_t i = 0; i < Controller->Base.PortCount; i++) {
+        if (ChangeBits & (1 << i)) {
+            XhciPortCheck(Controller, (int)i);
+        }
+    }
+}
@@ -0,0 +1,250 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <os/mollenos.h>
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <stddef.h>
+#include <string.h>
+
+/* XhciQueueInitialize
+ * Initialize the controller's transfer descriptor pool. The controller has no
+ * framelist, the scheduler is only used for the pool and bandwidth accounting.
+ * Completions are reported by the event ring, so transfers are never scanned. */
+OsStatus_t
+XhciQueueInitialize(
+    _In_ XhciController_t* Controller)
+{
+    UsbSchedulerSettings_t Settings;
+
+    TRACE("XhciQueueInitialize()");
+
+    UsbSchedulerSettingsCreate(&Settings, 1, 1, XHCI_MAX_BANDWIDTH, USB_SCHEDULER_COMPLETION_INDEX);
+    UsbSchedulerSettingsAddPool(&Settings, sizeof(XhciTransferDescriptor_t), XHCI_TD_ALIGNMENT, XHCI_TD_COUNT,
+        XHCI_TD_START, offsetof(XhciTransferDescriptor_t, Link), offsetof(XhciTransferDescriptor_t, Link),
+        offsetof(XhciTransferDescriptor_t, Object));
+    return UsbSchedulerInitialize(&Settings, &Controller->Base.Scheduler);
+}
+
+/* XhciQueueReset
+ * Removes and cleans up any existing transfers, the rings are reset by the restart. */
+OsStatus_t
+XhciQueueReset(
+    _In_ XhciController_t* Controller)
+{
+    TRACE("XhciQueueReset()");
+
+    XhciHalt(Controller);
+    UsbManagerClearTransfers(&Controller->Base);
+    UsbSchedulerResetInternalData(Controller->Base.Scheduler, 1, 1);
+    return OsSuccess;
+}
+
+/* XhciQueueDestroy
+ * Cleans up any existing transfers and frees the transfer descriptor pool */
+OsStatus_t
+XhciQueueDestroy(
+    _In_ XhciController_t* Controller)
+{
+    TRACE("XhciQueueDestroy()");
+
+    XhciQueueReset(Controller);
+    return UsbSchedulerDestroy(Controller->Base.Scheduler);
+}
+
+/* XhciTdValidate
+ * Updates the transfer with the completion of the td once the event ring has
+ * reported it. */
+static void
+XhciTdValidate(
+    _In_ UsbManagerTransfer_t*     Transfer,
+    _In_ XhciTransferDescriptor_t* Td)
+{
+    int i;
+
+    if (!(Td->Flags & XHCI_TD_COMPLETED) || (Td->Flags & XHCI_TD_CANCELLED)) {
+        return;
+    }
+
+    Transfer->Status = XhciGetStatusCode(Td->CompletionCode);
+    if (Td->Flags & XHCI_TD_SHORT) {
+        Transfer->Flags |= TransferFlagShort;
+    }
+    for (i = 0; i < USB_TRANSACTIONCOUNT; i++) {
+        Transfer->BytesTransferred[i] = Td->Lengths[i];
+    }
+    Transfer->TransactionsExecuted = Transfer->TransactionsTotal;
+}
+
+/* XhciTdReleaseEntries
+ * Drops the ring references to the td, the ring lock must be held. */
+static void
+XhciTdReleaseEntries(
+    _In_ XhciTransferDescriptor_t* Td)
+{
+    int Index = Td->TrbFirst;
+
+    if (!(Td->Flags & XHCI_TD_QUEUED) || Td->Ring == NULL) {
+        return;
+    }
+    while (1) {
+        if (Td->Ring->Entries[Index].Td == Td) {
+            Td->Ring->Entries[Index].Td = NULL;
+        }
+        if (Index == Td->TrbLast) {
+            break;
+        }
+        Index = XhciRingNext(Index);
+    }
+}
+
+/* XhciTdRestart
+ * Queues the td of a periodic transfer again at the next offset of the buffer. */
+static void
+XhciTdRestart(
+    _In_ XhciController_t*         Controller,
+    _In_ UsbManagerTransfer_t*     Transfer,
+    _In_ XhciTransferDescriptor_t* Td)
+{
+    XhciDevice_t* Device;
+    size_t        Offset = 0;
+
+    if (Td->Ring == NULL) {
+        return;
+    }
+
+    // A periodic endpoint that halted must be recovered before it can be used again
+    Device = XhciDeviceFromSlot(Controller, Td->SlotId);
+    if (Device != NULL && Device->Endpoints[Td->Endpoint].Halted) {
+        XhciEndpointRecover(Controller, Td);
+    }
+
+    mtx_lock(&Controller->RingLock);
+    XhciTdReleaseEntries(Td);
+    Td->Flags         &= ~(XHCI_TD_COMPLETED | XHCI_TD_SHORT | XHCI_TD_QUEUED);
+    Td->CompletionCode = 0;
+    memset(&Td->Lengths[0], 0, sizeof(Td->Lengths));
+    mtx_unlock(&Controller->RingLock);
+
+    // The notification of the completed transfer has not been sent yet, so the
+    // data index still points to the buffer that was just filled
+    if (Transfer->Transfer.Type == InterruptTransfer) {
+        Offset = ADDLIMIT(0, Transfer->CurrentDataIndex,
+            Transfer->Transfer.Transactions[0].Length, Transfer->Transfer.PeriodicBufferSize);
+    }
+
+    if (Transfer->Transfer.Type == IsochronousTransfer) {
+        XhciTransferFillIsochronous(Controller, Transfer, Td, Offset);
+    }
+    else {
+        XhciTransferFill(Controller, Transfer, Td, Offset);
+    }
+}
+
+/* HciProcessElement
+ * Proceses the element accordingly to the reason given. The transfer associated
+ * will be provided in <Context> */
+int
+HciProcessElement(
+    _In_ UsbManagerController_t* Controller,
+    _In_ uint8_t*                Element,
+    _In_ int                     Reason,
+    _In_ void*                   Context)
+{
+    XhciController_t*         Xhci     = (XhciController_t*)Controller;
+    UsbManagerTransfer_t*     Transfer = (UsbManagerTransfer_t*)Context;
+    XhciTransferDescriptor_t* Td       = (XhciTransferDescriptor_t*)Element;
+
+    TRACE("XhciProcessElement(Reason %i)", Reason);
+
+    switch (Reason) {
+        case USB_REASON_DUMP: {
+            TRACE("Td(Slot %u, Dci %u, Stream %u): trbs %u-%u, flags 0x%x, code %u", Td->SlotId,
+                Td->Endpoint, Td->StreamId, Td->TrbFirst, Td->TrbLast, Td->Flags, Td->CompletionCode);
+        } break;
+
+        case USB_REASON_SCAN: {
+            XhciTdValidate(Transfer, Td);
+        } break;
+
+        case USB_REASON_RESET: {
+            XhciTdRestart(Xhci, Transfer, Td);
+        } break;
+
+        // The controller tracks the data toggles itself
+        case USB_REASON_FIXTOGGLE:
+            break;
+
+        case USB_REASON_LINK: {
+            XhciRingDoorbell(Xhci, Td->SlotId, Td->Endpoint | (Td->StreamId << 16));
+        } return ITERATOR_STOP;
+
+        case USB_REASON_UNLINK: {
+            if ((Td->Flags & XHCI_TD_QUEUED) && !(Td->Flags & XHCI_TD_COMPLETED) && Td->Ring != NULL) {
+                XhciEndpointCancel(Xhci, Td);
+            }
+        } break;
+
+        case USB_REASON_CLEANUP: {
+            // Drop the ring references to the td before it is returned to the pool
+            mtx_lock(&Xhci->RingLock);
+            XhciTdReleaseEntries(Td);
+            mtx_unlock(&Xhci->RingLock);
+            UsbSchedulerFreeElement(Controller->Scheduler, Element);
+        } break;
+
+        default:
+            break;
+    }
+    return ITERATOR_CONTINUE;
+}
+
+/* HciProcessEvent
+ * Invoked on different very specific events that require assistance. If a transfer
+ * is provided it's available in <Context> */
+void
+HciProcessEvent(
+    _In_ UsbManagerController_t* Controller,
+    _In_ int                     Event,
+    _In_ void*                   Context)
+{
+    UsbManagerTransfer_t*     Transfer = (UsbManagerTransfer_t*)Context;
+    XhciTransferDescriptor_t* Td;
+
+    TRACE("XhciProcessEvent(Event %i)", Event);
+
+    switch (Event) {
+        // The periodic td has been refilled on the ring, it must be rung in again
+        case USB_EVENT_RESTART_DONE: {
+            Td = (XhciTransferDescriptor_t*)Transfer->EndpointDescriptor;
+            if (Td != NULL && (Td->Flags & XHCI_TD_QUEUED)) {
+                XhciRingDoorbell((XhciController_t*)Controller, Td->SlotId,
+                    Td->Endpoint | (Td->StreamId << 16));
+            }
+        } break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,154 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <os/mollenos.h>
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define XHCI_RING_LINK (XHCI_RING_SIZE - 1)
+
+XhciRing_t*
+XhciRingCreate(void)
+{
+    XhciRing_t* Ring;
+
+    Ring = (XhciRing_t*)malloc(sizeof(XhciRing_t));
+    if (Ring == NULL) {
+        return NULL;
+    }
+    memset(Ring, 0, sizeof(XhciRing_t));
+
+    if (MemoryAllocate(NULL, XHCI_RING_SIZE * sizeof(XhciTransferRequestBlock_t), XHCI_MEMORY_FLAGS,
+            (void**)&Ring->Trbs, &Ring->Physical) != OsSuccess) {
+        ERROR("Failed to allocate memory for xhci ring");
+        free(Ring);
+        return NULL;
+    }
+    XhciRingReset(Ring);
+    return Ring;
+}
+
+void
+XhciRingDestroy(
+    _In_ XhciRing_t* Ring)
+{
+    if (Ring == NULL) {
+        return;
+    }
+    MemoryFree((void*)Ring->Trbs, XHCI_RING_SIZE * sizeof(XhciTransferRequestBlock_t));
+    free(Ring);
+}
+
+void
+XhciRingReset(
+    _In_ XhciRing_t* Ring)
+{
+    memset((void*)Ring->Trbs, 0, XHCI_RING_SIZE * sizeof(XhciTransferRequestBlock_t));
+    memset((void*)&Ring->Entries[0], 0, sizeof(Ring->Entries));
+    Ring->Enqueue = 0;
+    Ring->Dequeue = 0;
+    Ring->Cycle   = 1;
+
+    // The link trb is owned by the hardware once its cycle bit matches, it's
+    // handed over each time the enqueue position wraps
+    Ring->Trbs[XHCI_RING_LINK].Parameter[0] = LODWORD(Ring->Physical);
+    Ring->Trbs[XHCI_RING_LINK].Parameter[1] = HIDWORD(Ring->Physical);
+    Ring->Trbs[XHCI_RING_LINK].Control      = XHCI_TRB_TYPE(XHCI_TRB_LINK) | XHCI_TRB_TOGGLE_CYCLE;
+}
+
+int
+XhciRingNext(
+    _In_ int Index)
+{
+    Index++;
+    return (Index == XHCI_RING_LINK) ? 0 : Index;
+}
+
+int
+XhciRingFreeCount(
+    _In_ XhciRing_t* Ring)
+{
+    // One trb is kept unused to tell a full ring from an empty ring
+    int Used = Ring->Enqueue - Ring->Dequeue;
+    if (Used < 0) {
+        Used += XHCI_RING_LINK;
+    }
+    return XHCI_RING_LINK - 1 - Used;
+}
+
+int
+XhciRingEnqueue(
+    _In_ XhciRing_t* Ring,
+    _In_ reg32_t     ParameterLo,
+    _In_ reg32_t     ParameterHi,
+    _In_ reg32_t     Status,
+    _In_ reg32_t     Control,
+    _In_ int         Deferred)
+{
+    XhciTransferRequestBlock_t* Trb   = &Ring->Trbs[Ring->Enqueue];
+    int                         Index = Ring->Enqueue;
+    reg32_t                     Cycle = Deferred ? (Ring->Cycle ^ 1) : Ring->Cycle;
+
+    Trb->Parameter[0] = ParameterLo;
+    Trb->Parameter[1] = ParameterHi;
+    Trb->Status       = Status;
+    MemoryBarrier();
+    Trb->Control      = (Control & ~(XHCI_TRB_CYCLE)) | Cycle;
+
+    // Hand the link trb to the hardware when wrapping, the link carries the chain
+    // bit of the trb before it so a td can span the wrap
+    Ring->Enqueue++;
+    if (Ring->Enqueue == XHCI_RING_LINK) {
+        reg32_t LinkControl = XHCI_TRB_TYPE(XHCI_TRB_LINK) | XHCI_TRB_TOGGLE_CYCLE;
+        LinkControl        |= (Control & XHCI_TRB_CHAIN);
+        MemoryBarrier();
+        Ring->Trbs[XHCI_RING_LINK].Control = LinkControl | Ring->Cycle;
+        Ring->Enqueue = 0;
+        Ring->Cycle  ^= 1;
+    }
+    return Index;
+}
+
+void
+XhciRingPublish(
+    _In_ XhciRing_t* Ring,
+    _In_ int         Index)
+{
+    MemoryBarrier();
+    Ring->Trbs[Index].Control ^= XHCI_TRB_CYCLE;
+}
+
+int
+XhciRingGetIndex(
+    _In_ XhciRing_t* Ring,
+    _In_ uintptr_t   TrbPhysical)
+{
+    if (TrbPhysical < Ring->Physical ||
+        TrbPhysical >= (Ring->Physical + (XHCI_RING_LINK * sizeof(XhciTransferRequestBlock_t)))) {
+        return -1;
+    }
+    return (int)((TrbPhysical - Ring->Physical) / sizeof(XhciTransferRequestBlock_t));
+}
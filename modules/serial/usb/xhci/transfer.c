@@ -0,0 +1,370 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <ddk/utils.h>
+#include "xhci.h"
+#include <assert.h>
+#include <string.h>
+
+/* XhciGetStatusCode
+ * Converts a completion code to a transfer status. */
+UsbTransferStatus_t
+XhciGetStatusCode(
+    _In_ int CompletionCode)
+{
+    switch (CompletionCode) {
+        case XHCI_CC_SUCCESS:
+        case XHCI_CC_SHORT_PACKET:
+            return TransferFinished;
+        case XHCI_CC_STALL:
+            return TransferStalled;
+        case XHCI_CC_TRANSACTION:
+            return TransferNotResponding;
+        case XHCI_CC_BABBLE:
+            return TransferBabble;
+        case XHCI_CC_DATA_BUFFER:
+            return TransferBufferError;
+        case XHCI_CC_BANDWIDTH:
+        case XHCI_CC_BANDWIDTH_OVERRUN:
+        case XHCI_CC_SECONDARY_BANDWIDTH:
+            return TransferNoBandwidth;
+        default:
+            WARNING("XHCI-Error: Completion code %i", CompletionCode);
+            return TransferInvalid;
+    }
+}
+
+XhciDevice_t*
+XhciGetDevice(
+    _In_ XhciController_t* Controller,
+    _In_ UsbTransfer_t*    Transfer)
+{
+    // Devices behind hubs need their own slot with the route string and tt information
+    // of the hub chain, which the usb stack does not provide yet. Slots are only created
+    // for root ports, so these devices are rejected instead of being sent to the slot
+    // of the root port
+    if (Transfer->Address.HubAddress != 0) {
+        ERROR("XHCI: Device %u behind hub %u (port %u) is not supported, only devices on root ports are",
+            Transfer->Address.DeviceAddress, Transfer->Address.HubAddress, Transfer->Address.PortAddress);
+        return NULL;
+    }
+    if (Transfer->Address.PortAddress >= Controller->Base.PortCount) {
+        return NULL;
+    }
+    return Controller->Devices[Transfer->Address.PortAddress];
+}
+
+int
+XhciTransferTrbCount(
+    _In_ UsbManagerTransfer_t* Transfer)
+{
+    int Count = 0;
+    int i;
+
+    for (i = 0; i < Transfer->Transfer.TransactionCount; i++) {
+        UsbTransaction_t* Transaction = &Transfer->Transfer.Transactions[i];
+        size_t            Packets;
+        if (Transaction->Type == SetupTransaction || Transaction->Length == 0) {
+            Count++;
+            continue;
+        }
+
+        // Every packet may cross a 64kb boundary once
+        Packets = DIVUP(Transaction->Length, XHCI_TRB_MAX_LENGTH) + 1;
+        if (Transfer->Transfer.Type == IsochronousTransfer) {
+            Packets += DIVUP(Transaction->Length, MAX(Transfer->Transfer.Endpoint.MaxPacketSize, 1));
+        }
+        Count += (int)Packets + Transaction->ZeroLength;
+    }
+    return Count;
+}
+
+UsbTransferStatus_t
+XhciTransferQueue(
+    _In_ XhciController_t*     Controller,
+    _In_ UsbManagerTransfer_t* Transfer)
+{
+    XhciTransferDescriptor_t* Td;
+    XhciDevice_t*             Device;
+    XhciRing_t*               Ring;
+    UsbTransferStatus_t       Status;
+    DataKey_t                 Key;
+    int                       Dci;
+
+    TRACE("XhciTransferQueue(Id %u)", Transfer->Id);
+    Transfer->Status = TransferNotProcessed;
+
+    Device = XhciGetDevice(Controller, &Transfer->Transfer);
+    if (Device == NULL) {
+        return TransferInvalid;
+    }
+
+    Dci = XhciEndpointGetIndex(&Transfer->Transfer);
+    if (XhciEndpointConfigure(Controller, Device, &Transfer->Transfer) != OsSuccess) {
+        return TransferNoBandwidth;
+    }
+
+    Ring = XhciEndpointGetRing(&Device->Endpoints[Dci], (int)Transfer->Transfer.StreamId);
+    if (Ring == NULL || XhciTransferTrbCount(Transfer) > (XHCI_RING_SIZE - 2)) {
+        ERROR("XHCI: Transfer can not be queued on endpoint %i (stream %u)", Dci, Transfer->Transfer.StreamId);
+        return TransferInvalid;
+    }
+
+    // Tds are kept until the transfer is done, if we run out of them the transfer
+    // is queued up for later
+    Key.Value.Integer = (int)Transfer->Id;
+    if (CollectionGetDataByKey(Controller->Base.TransactionList, Key, 0) == NULL) {
+        CollectionAppend(Controller->Base.TransactionList, CollectionCreateNode(Key, Transfer));
+    }
+
+    Td = (XhciTransferDescriptor_t*)Transfer->EndpointDescriptor;
+    if (Td == NULL) {
+        if (UsbSchedulerAllocateElement(Controller->Base.Scheduler, XHCI_TD_POOL, (uint8_t**)&Td) != OsSuccess) {
+            return TransferQueued;
+        }
+        Td->SlotId   = (uint8_t)Device->SlotId;
+        Td->Endpoint = (uint8_t)Dci;
+        Td->StreamId = (uint16_t)Transfer->Transfer.StreamId;
+        if (Transfer->Transfer.Type == ControlTransfer) {
+            Td->Flags |= XHCI_TD_CONTROL;
+        }
+        else if (Transfer->Transfer.Type == IsochronousTransfer) {
+            Td->Flags |= XHCI_TD_ISOCHRONOUS;
+        }
+        Transfer->EndpointDescriptor = Td;
+        Transfer->TransactionsTotal  = 1;
+        UsbSchedulerSetElementContext(Controller->Base.Scheduler, (uint8_t*)Td, Transfer);
+    }
+
+    // A full ring keeps the transfer waiting for a transfer on the same endpoint to finish
+    if (Transfer->Transfer.Type == IsochronousTransfer) {
+        Status = XhciTransferFillIsochronous(Controller, Transfer, Td, 0);
+    }
+    else {
+        Status = XhciTransferFill(Controller, Transfer, Td, Transfer->CurrentDataIndex);
+    }
+    if (Status == TransferNotProcessed) {
+        return TransferQueued;
+    }
+    else if (Status != TransferQueued) {
+        return Status;
+    }
+
+    Transfer->Status = TransferQueued;
+#ifdef __TRACE
+    UsbManagerDumpChain(&Controller->Base, Transfer, (uint8_t*)Transfer->EndpointDescriptor, USB_CHAIN_DEPTH);
+#endif
+    UsbManagerIterateChain(&Controller->Base, Transfer->EndpointDescriptor,
+        USB_CHAIN_DEPTH, USB_REASON_LINK, HciProcessElement, Transfer);
+    return TransferQueued;
+}
+
+/* XhciTransferComplete
+ * Marks the td as completed and queues its transfer for processing, the ring lock
+ * must be held. */
+static void
+XhciTransferComplete(
+    _In_ XhciController_t*         Controller,
+    _In_ XhciTransferDescriptor_t* Td,
+    _In_ int                       CompletionCode)
+{
+    if (Td->CompletionCode == 0 || Td->CompletionCode == XHCI_CC_SUCCESS ||
+        Td->CompletionCode == XHCI_CC_SHORT_PACKET) {
+        Td->CompletionCode = (uint8_t)CompletionCode;
+    }
+    Td->Flags |= XHCI_TD_COMPLETED;
+    UsbManagerCompleteElement(&Controller->Base, (uint8_t*)Td);
+}
+
+void
+XhciTransferEvent(
+    _In_ XhciController_t*           Controller,
+    _In_ XhciTransferRequestBlock_t* Event)
+{
+    XhciTransferDescriptor_t* Td;
+    XhciEndpoint_t*           Endpoint;
+    XhciRingEntry_t*          Entry;
+    XhciDevice_t*             Device;
+    XhciRing_t*               Ring = NULL;
+    uintptr_t                 TrbPhysical = Event->Parameter[0];
+    size_t                    Residual = XHCI_TRB_EVENT_LENGTH(Event->Status);
+    int                       Code     = XHCI_TRB_COMPLETION_CODE(Event->Status);
+    int                       Dci      = XHCI_TRB_GET_ENDPOINT(Event->Control);
+    int                       Index    = -1;
+    int                       i;
+
+    TRACE("XhciTransferEvent(Slot %u, Dci %i, Code %i)", XHCI_TRB_GET_SLOT(Event->Control), Dci, Code);
+
+    // Stopped events only tell where the endpoint stopped
+    if (Code == XHCI_CC_STOPPED || Code == XHCI_CC_STOPPED_LENGTH_INVALID ||
+        Code == XHCI_CC_STOPPED_SHORT_PACKET) {
+        return;
+    }
+
+    mtx_lock(&Controller->RingLock);
+    Device = XhciDeviceFromSlot(Controller, XHCI_TRB_GET_SLOT(Event->Control));
+    if (Device == NULL || Dci <= 0 || Dci >= XHCI_MAX_ENDPOINTS) {
+        mtx_unlock(&Controller->RingLock);
+        return;
+    }
+
+    // Locate the ring of the trb, the event does not carry the stream
+    Endpoint = &Device->Endpoints[Dci];
+    if (Endpoint->StreamCount == 0) {
+        Ring  = Endpoint->Ring;
+        Index = (Ring != NULL) ? XhciRingGetIndex(Ring, TrbPhysical) : -1;
+    }
+    else {
+        for (i = 1; i < Endpoint->StreamCount && Index == -1; i++) {
+            Ring  = Endpoint->StreamRings[i];
+            Index = XhciRingGetIndex(Ring, TrbPhysical);
+        }
+    }
+    if (Index == -1) {
+        mtx_unlock(&Controller->RingLock);
+        return;
+    }
+
+    // Everything up to this trb has been consumed by the controller
+    Ring->Dequeue = XhciRingNext(Index);
+
+    Entry = &Ring->Entries[Index];
+    Td    = Entry->Td;
+    if (Td == NULL || (Td->Flags & XHCI_TD_COMPLETED)) {
+        mtx_unlock(&Controller->RingLock);
+        return;
+    }
+
+    // Account the trbs that completed silently before this one. After a short packet
+    // the controller skips to the end of the td, so they did not transfer anything
+    while (Td->TrbNext != Index) {
+        XhciRingEntry_t* Skipped = &Ring->Entries[Td->TrbNext];
+        if (!(Td->Flags & XHCI_TD_SHORT)) {
+            Td->Lengths[Skipped->Transaction] += Skipped->Length;
+        }
+        if (Td->TrbNext == Td->TrbLast) {
+            break;
+        }
+        Td->TrbNext = XhciRingNext(Td->TrbNext);
+    }
+    Td->Lengths[Entry->Transaction] += Entry->Length - MIN(Residual, Entry->Length);
+    Td->TrbNext = XhciRingNext(Index);
+
+    if (Code == XHCI_CC_SHORT_PACKET) {
+        Td->Flags |= XHCI_TD_SHORT;
+
+        // The data stage of control transfers and the packets of isochronous transfers
+        // are followed by trbs that still execute
+        if ((Td->Flags & (XHCI_TD_CONTROL | XHCI_TD_ISOCHRONOUS)) && Index != Td->TrbLast) {
+            mtx_unlock(&Controller->RingLock);
+            return;
+        }
+    }
+    else if (Code != XHCI_CC_SUCCESS) {
+        if (Td->Flags & XHCI_TD_ISOCHRONOUS) {
+            // Missed intervals are only reported, the remaining packets still execute
+            if (Code != XHCI_CC_MISSED_SERVICE) {
+                Td->CompletionCode = (uint8_t)Code;
+            }
+            if (Index != Td->TrbLast) {
+                mtx_unlock(&Controller->RingLock);
+                return;
+            }
+        }
+        else if (Code == XHCI_CC_STALL || Code == XHCI_CC_BABBLE || Code == XHCI_CC_TRANSACTION ||
+                 Code == XHCI_CC_DATA_BUFFER) {
+            Endpoint->Halted = 1;
+        }
+        XhciTransferComplete(Controller, Td, Code);
+        mtx_unlock(&Controller->RingLock);
+        return;
+    }
+    else if (Index != Td->TrbLast) {
+        mtx_unlock(&Controller->RingLock);
+        return;
+    }
+
+    XhciTransferComplete(Controller, Td, Code);
+    mtx_unlock(&Controller->RingLock);
+}
+
+/* HciTransactionFinalize
+ * Finalizes a transfer by cleaning up resources allocated. This should free
+ * all elements and unschedule elements. */
+OsStatus_t
+HciTransactionFinalize(
+    _In_ UsbManagerController_t* Controller,
+    _In_ UsbManagerTransfer_t*   Transfer,
+    _In_ int                     Reset)
+{
+    XhciController_t*         Xhci = (XhciController_t*)Controller;
+    XhciTransferDescriptor_t* Td   = (XhciTransferDescriptor_t*)Transfer->EndpointDescriptor;
+    XhciDevice_t*             Device;
+
+    TRACE("XhciTransactionFinalize(Id %u)", Transfer->Id);
+    if (Td == NULL) {
+        return OsSuccess;
+    }
+
+    // The rings are reset along with the controller, so there is nothing to unlink then
+    if (Reset == 0) {
+        UsbManagerIterateChain(Controller, Transfer->EndpointDescriptor,
+            USB_CHAIN_DEPTH, USB_REASON_UNLINK, HciProcessElement, Transfer);
+        Device = XhciDeviceFromSlot(Xhci, Td->SlotId);
+        if (Device != NULL && Device->Endpoints[Td->Endpoint].Halted) {
+            XhciEndpointRecover(Xhci, Td);
+        }
+    }
+    UsbManagerIterateChain(Controller, Transfer->EndpointDescriptor,
+        USB_CHAIN_DEPTH, USB_REASON_CLEANUP, HciProcessElement, Transfer);
+    Transfer->EndpointDescriptor = NULL;
+    return OsSuccess;
+}
+
+/* HciDequeueTransfer
+ * Removes a queued transfer from the controller's transfer list */
+UsbTransferStatus_t
+HciDequeueTransfer(
+    _In_ UsbManagerTransfer_t* Transfer)
+{
+    XhciController_t* Controller = (XhciController_t*)UsbManagerGetController(Transfer->DeviceId);
+    assert(Controller != NULL);
+
+    // The endpoint is stopped while the td is cancelled, so it can be freed right away
+    if (Transfer->EndpointDescriptor != NULL) {
+        UsbManagerIterateChain(&Controller->Base, Transfer->EndpointDescriptor,
+            USB_CHAIN_DEPTH, USB_REASON_UNLINK, HciProcessElement, Transfer);
+        UsbManagerIterateChain(&Controller->Base, Transfer->EndpointDescriptor,
+            USB_CHAIN_DEPTH, USB_REASON_CLEANUP, HciProcessElement, Transfer);
+        Transfer->EndpointDescriptor = NULL;
+    }
+    // Cancelled transfers still have a caller waiting for them, it's answered when the
+    // transfer is finalized
+    if (Transfer->Status != TransferCancelled) {
+        Transfer->Transfer.Flags |= USB_TRANSFER_NO_NOTIFICATION;
+    }
+    Transfer->Flags |= TransferFlagCleanup;
+    UsbManagerCompleteTransfer(&Controller->Base, Transfer);
+    return TransferFinished;
+}
@@ -0,0 +1,256 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <os/mollenos.h>
+#include <ddk/usb/definitions.h>
+#include <ddk/utils.h>
+#include <ddk/io.h>
+#include "xhci.h"
+#include <string.h>
+
+#define XHCI_SETUP_PAGE_SIZE 0x1000
+
+/* XhciReadSetupPacket
+ * The setup trb carries the setup packet itself. The packet is normally copied into the
+ * transfer by the sender from its own mapping of the buffer, only packets from elsewhere
+ * are read through a temporary mapping of their physical address. */
+static OsStatus_t
+XhciReadSetupPacket(
+    _In_  UsbTransfer_t* Transfer,
+    _Out_ reg32_t*       Packet)
+{
+    UsbTransaction_t* Transaction = &Transfer->Transactions[0];
+    DeviceIo_t        IoSpace;
+    uintptr_t         Base;
+    size_t            Offset;
+
+    if (Transfer->Flags & USB_TRANSFER_SETUP_INLINE) {
+        memcpy(Packet, &Transfer->SetupPacket, sizeof(UsbPacket_t));
+        return OsSuccess;
+    }
+
+    Base   = Transaction->BufferAddress & ~((uintptr_t)XHCI_SETUP_PAGE_SIZE - 1);
+    Offset = Transaction->BufferAddress - Base;
+    if (CreateDeviceMemoryIo(&IoSpace, Base, Offset + sizeof(UsbPacket_t)) != OsSuccess) {
+        return OsError;
+    }
+    if (AcquireDeviceIo(&IoSpace) != OsSuccess) {
+        DestroyDeviceIo(&IoSpace);
+        return OsError;
+    }
+    Packet[0] = (reg32_t)ReadDeviceIo(&IoSpace, Offset, 4);
+    Packet[1] = (reg32_t)ReadDeviceIo(&IoSpace, Offset + 4, 4);
+    ReleaseDeviceIo(&IoSpace);
+    DestroyDeviceIo(&IoSpace);
+    return OsSuccess;
+}
+
+void
+XhciTransferPush(
+    _In_    XhciRing_t*               Ring,
+    _In_    XhciTransferDescriptor_t* Td,
+    _In_    int                       Transaction,
+    _In_    reg32_t                   ParameterLo,
+    _In_    reg32_t                   ParameterHi,
+    _In_    reg32_t                   Status,
+    _In_    reg32_t                   Control,
+    _In_    size_t                    Length,
+    _InOut_ int*                      Count)
+{
+    int Index = XhciRingEnqueue(Ring, ParameterLo, ParameterHi, Status, Control, (*Count == 0));
+    if (*Count == 0) {
+        Td->TrbFirst = (uint16_t)Index;
+    }
+    Td->TrbLast                      = (uint16_t)Index;
+    Ring->Entries[Index].Td          = Td;
+    Ring->Entries[Index].Length      = (uint32_t)Length;
+    Ring->Entries[Index].Transaction = Transaction;
+    (*Count)++;
+}
+
+void
+XhciTransferPushBuffer(
+    _In_    XhciRing_t*               Ring,
+    _In_    XhciTransferDescriptor_t* Td,
+    _In_    int                       Transaction,
+    _In_    uintptr_t                 Address,
+    _In_    size_t                    Length,
+    _In_    size_t                    MaxPacketSize,
+    _In_    reg32_t                   FirstControl,
+    _In_    reg32_t                   Flags,
+    _InOut_ int*                      Count)
+{
+    reg32_t Type      = FirstControl;
+    size_t  Remaining = Length;
+
+    do {
+        size_t  Step    = MIN(Remaining, XHCI_TRB_MAX_LENGTH - (Address & (XHCI_TRB_MAX_LENGTH - 1)));
+        size_t  After   = Remaining - Step;
+        size_t  Packets = DIVUP(After, MaxPacketSize);
+        reg32_t Control = Type | Flags;
+        if (After != 0) {
+            Control |= XHCI_TRB_CHAIN;
+        }
+
+        XhciTransferPush(Ring, Td, Transaction, LODWORD(Address), HIDWORD(Address),
+            XHCI_TRB_LENGTH(Step) | XHCI_TRB_TDSIZE(Packets), Control, Step, Count);
+        Address  += Step;
+        Remaining = After;
+        Type      = XHCI_TRB_TYPE(XHCI_TRB_NORMAL);
+    } while (Remaining != 0);
+}
+
+UsbTransferStatus_t
+XhciTransferFill(
+    _In_ XhciController_t*         Controller,
+    _In_ UsbManagerTransfer_t*     Transfer,
+    _In_ XhciTransferDescriptor_t* Td,
+    _In_ size_t                    PeriodicOffset)
+{
+    XhciDevice_t* Device;
+    XhciRing_t*   Ring;
+    reg32_t       Setup[2] = { 0 };
+    size_t        MaxPacketSize;
+    int           Count = 0;
+    int           i;
+
+    TRACE("XhciTransferFill(Id %u)", Transfer->Id);
+
+    if (Transfer->Transfer.Type == ControlTransfer &&
+        XhciReadSetupPacket(&Transfer->Transfer, &Setup[0]) != OsSuccess) {
+        ERROR("XHCI: Failed to read the setup packet");
+        return TransferInvalid;
+    }
+
+    mtx_lock(&Controller->RingLock);
+    Device = XhciDeviceFromSlot(Controller, Td->SlotId);
+    Ring   = (Device != NULL) ? XhciEndpointGetRing(&Device->Endpoints[Td->Endpoint], Td->StreamId) : NULL;
+    if (Ring == NULL) {
+        mtx_unlock(&Controller->RingLock);
+        return TransferInvalid;
+    }
+    if (XhciRingFreeCount(Ring) < XhciTransferTrbCount(Transfer)) {
+        mtx_unlock(&Controller->RingLock);
+        return TransferNotProcessed;
+    }
+    MaxPacketSize = MAX(Device->Endpoints[Td->Endpoint].MaxPacketSize, 1);
+
+    for (i = 0; i < Transfer->Transfer.TransactionCount; i++) {
+        UsbTransaction_t* Transaction = &Transfer->Transfer.Transactions[i];
+        uintptr_t         Address     = Transaction->BufferAddress;
+        reg32_t           Flags       = (Transaction->Type == InTransaction) ? XHCI_TRB_ISP : 0;
+
+        if (Transaction->Type == SetupTransaction) {
+            reg32_t Trt = XHCI_TRT_NO_DATA;
+            if (Transfer->Transfer.TransactionCount > 2 && Transfer->Transfer.Transactions[1].Length != 0) {
+                Trt = (Transfer->Transfer.Transactions[1].Type == InTransaction) ? XHCI_TRT_IN_DATA : XHCI_TRT_OUT_DATA;
+            }
+            XhciTransferPush(Ring, Td, i, Setup[0], Setup[1], XHCI_TRB_LENGTH(8), XHCI_TRB_TYPE(XHCI_TRB_SETUP) |
+                XHCI_TRB_IDT | XHCI_TRB_TRT(Trt), sizeof(UsbPacket_t), &Count);
+            continue;
+        }
+
+        if (Transfer->Transfer.Type == ControlTransfer) {
+            if (Transaction->Handshake) {
+                XhciTransferPush(Ring, Td, i, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_STATUS) |
+                    ((Transaction->Type == InTransaction) ? XHCI_TRB_DIRECTION_IN : 0), 0, &Count);
+            }
+            else if (Transaction->Length != 0) {
+                XhciTransferPushBuffer(Ring, Td, i, Address, Transaction->Length, MaxPacketSize,
+                    XHCI_TRB_TYPE(XHCI_TRB_DATA) | ((Transaction->Type == InTransaction) ? XHCI_TRB_DIRECTION_IN : 0),
+                    Flags, &Count);
+            }
+            continue;
+        }
+
+        // Interrupt transfers move through the periodic buffer
+        if (Transfer->Transfer.Type == InterruptTransfer) {
+            Address += PeriodicOffset;
+        }
+        XhciTransferPushBuffer(Ring, Td, i, Address, Transaction->Length, MaxPacketSize,
+            XHCI_TRB_TYPE(XHCI_TRB_NORMAL), Flags, &Count);
+        if (Transaction->ZeroLength && Transaction->Length != 0) {
+            XhciTransferPush(Ring, Td, i, 0, 0, 0, XHCI_TRB_TYPE(XHCI_TRB_NORMAL), 0, &Count);
+        }
+    }
+
+    // The controller can't reach the last trb before the first one is published
+    Ring->Trbs[Td->TrbLast].Control |= XHCI_TRB_IOC;
+    Td->TrbNext   = Td->TrbFirst;
+    Td->NextCycle = (uint8_t)Ring->Cycle;
+    Td->Ring      = Ring;
+    Td->Flags    |= XHCI_TD_QUEUED;
+    XhciRingPublish(Ring, Td->TrbFirst);
+    mtx_unlock(&Controller->RingLock);
+    return TransferQueued;
+}
+
+/* HciQueueTransferGeneric
+ * Queues a new asynchronous/interrupt transfer for the given driver and pipe.
+ * The function does not block. */
+UsbTransferStatus_t
+HciQueueTransferGeneric(
+    _In_ UsbManagerTransfer_t* Transfer)
+{
+    XhciController_t* Controller = (XhciController_t*)UsbManagerGetController(Transfer->DeviceId);
+    XhciDevice_t*     Device;
+    UsbPacket_t       Packet;
+    DataKey_t         Key;
+
+    Device = XhciGetDevice(Controller, &Transfer->Transfer);
+    if (Device == NULL) {
+        return TransferInvalid;
+    }
+
+    if (Transfer->Transfer.Type == ControlTransfer && Transfer->Transfer.Address.EndpointAddress == 0) {
+        // The controller assigns the device address itself, SET_ADDRESS must never reach
+        // the device, the request is completed by the address device command instead
+        if (XhciReadSetupPacket(&Transfer->Transfer, (reg32_t*)&Packet) != OsSuccess) {
+            return TransferInvalid;
+        }
+        if (Packet.Type == USBPACKET_TYPE_SET_ADDRESS && (Packet.Direction & 0x60) == 0) {
+            Transfer->Status              = XhciDeviceAddress(Controller, Device);
+            Transfer->BytesTransferred[0] = sizeof(UsbPacket_t);
+            Transfer->TransactionsTotal   = 1;
+            Transfer->TransactionsExecuted = 1;
+            UsbManagerSendNotification(Transfer);
+
+            // The transfer is released by the next scan of the transfers
+            Transfer->Flags |= TransferFlagCleanup;
+            Key.Value.Integer = (int)Transfer->Id;
+            if (CollectionGetDataByKey(Controller->Base.TransactionList, Key, 0) == NULL) {
+                CollectionAppend(Controller->Base.TransactionList, CollectionCreateNode(Key, Transfer));
+            }
+            UsbManagerCompleteTransfer(&Controller->Base, Transfer);
+            return TransferQueued;
+        }
+
+        // Only full speed devices have a default control endpoint of variable size, it's
+        // updated once the usb stack has read it from the device descriptor
+        if (Device->Speed == XHCI_PORT_SPEED_FULL) {
+            XhciDeviceUpdateControl(Controller, Device, Transfer->Transfer.Endpoint.MaxPacketSize);
+        }
+    }
+    return XhciTransferQueue(Controller, Transfer);
+}
@@ -0,0 +1,96 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ */
+//#define __TRACE
+
+#include <ddk/utils.h>
+#include "xhci.h"
+
+UsbTransferStatus_t
+XhciTransferFillIsochronous(
+    _In_ XhciController_t*         Controller,
+    _In_ UsbManagerTransfer_t*     Transfer,
+    _In_ XhciTransferDescriptor_t* Td,
+    _In_ size_t                    PeriodicOffset)
+{
+    UsbTransaction_t* Transaction = &Transfer->Transfer.Transactions[0];
+    XhciDevice_t*     Device;
+    XhciRing_t*       Ring;
+    uintptr_t         Address   = Transaction->BufferAddress + PeriodicOffset;
+    size_t            Remaining = Transaction->Length;
+    size_t            MaxPacketSize;
+    size_t            PacketSize;
+    reg32_t           Flags = (Transaction->Type == InTransaction) ? XHCI_TRB_ISP : 0;
+    int               Count = 0;
+
+    TRACE("XhciTransferFillIsochronous(Id %u)", Transfer->Id);
+
+    mtx_lock(&Controller->RingLock);
+    Device = XhciDeviceFromSlot(Controller, Td->SlotId);
+    Ring   = (Device != NULL) ? XhciEndpointGetRing(&Device->Endpoints[Td->Endpoint], 0) : NULL;
+    if (Ring == NULL || Remaining == 0) {
+        mtx_unlock(&Controller->RingLock);
+        return TransferInvalid;
+    }
+    if (XhciRingFreeCount(Ring) < XhciTransferTrbCount(Transfer)) {
+        mtx_unlock(&Controller->RingLock);
+        return TransferNotProcessed;
+    }
+
+    // Each service interval moves up to a burst of max packets, multiplied by the
+    // number of transactions per interval
+    MaxPacketSize = MAX(Transfer->Transfer.Endpoint.MaxPacketSize, 1);
+    PacketSize    = MaxPacketSize * MAX(Transfer->Transfer.Endpoint.Bandwidth, 1);
+    if (Device->Speed >= XHCI_PORT_SPEED_SUPER) {
+        PacketSize *= (Transfer->Transfer.Endpoint.MaxBurst + 1);
+    }
+
+    // Each interval is a td of its own, that is scheduled as soon as possible
+    while (Remaining != 0) {
+        size_t Length = MIN(Remaining, PacketSize);
+        XhciTransferPushBuffer(Ring, Td, 0, Address, Length, MaxPacketSize,
+            XHCI_TRB_TYPE(XHCI_TRB_ISOCHRONOUS) | XHCI_TRB_SIA, Flags, &Count);
+        Address   += Length;
+        Remaining -= Length;
+    }
+
+    // The controller can't reach the last trb before the first one is published
+    Ring->Trbs[Td->TrbLast].Control |= XHCI_TRB_IOC;
+    Td->TrbNext   = Td->TrbFirst;
+    Td->NextCycle = (uint8_t)Ring->Cycle;
+    Td->Ring      = Ring;
+    Td->Flags    |= XHCI_TD_QUEUED;
+    XhciRingPublish(Ring, Td->TrbFirst);
+    mtx_unlock(&Controller->RingLock);
+    return TransferQueued;
+}
+
+/* HciQueueTransferIsochronous
+ * Queues a new isochronous transfer for the given driver and pipe.
+ * The function does not block. */
+UsbTransferStatus_t
+HciQueueTransferIsochronous(
+    _In_ UsbManagerTransfer_t* Transfer)
+{
+    XhciController_t* Controller = (XhciController_t*)UsbManagerGetController(Transfer->DeviceId);
+    return XhciTransferQueue(Controller, Transfer);
+}
@@ -0,0 +1,828 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - eXtensible Host Controller Interface Driver
+ * TODO:
+ * - Power Management
+ * - External Hub Support
+ */
+
+#ifndef __USB_XHCI__
+#define __USB_XHCI__
+
+#include <os/osdefs.h>
+#include <ddk/contracts/usbhost.h>
+#include <ds/collection.h>
+#include <threads.h>
+
+#include "../common/manager.h"
+#include "../common/scheduler.h"
+#include "../common/hci.h"
+
+/* XHCI Controller Definitions
+ * Contains generic magic constants and definitions */
+#define XHCI_MAX_PORTS              255
+#define XHCI_MAX_SLOTS              255
+#define XHCI_MAX_ENDPOINTS          32
+#define XHCI_MAX_STREAMS            16
+#define XHCI_MAX_BANDWIDTH          900
+#define XHCI_RING_SIZE              256     // Trbs per ring, the last one is the link trb
+#define XHCI_EVENT_RING_SIZE        256
+#define XHCI_TRB_MAX_LENGTH         0x10000 // Trb buffers must not cross a 64kb boundary
+#define XHCI_COMMAND_TIMEOUT        500     // Milliseconds
+#define XHCI_INTERRUPT_MODERATION   160     // 250ns units, 40us
+
+// All the memory shared with the controller is kept below 4gb
+#define XHCI_MEMORY_FLAGS           (MEMORY_COMMIT | MEMORY_CLEAN | MEMORY_CONTIGIOUS | MEMORY_LOWFIRST | \
+    MEMORY_UNCHACHEABLE | MEMORY_READ | MEMORY_WRITE)
+
+PACKED_ATYPESTRUCT(volatile, XhciCapabilityRegisters, {
+    uint8_t                     Length;
+    uint8_t                     Reserved;
+    uint16_t                    Version;
+    reg32_t                     SParams1;
+    reg32_t                     SParams2;
+    reg32_t                     SParams3;
+    reg32_t                     CParams1;
+    reg32_t                     DoorbellOffset;
+    reg32_t                     RuntimeOffset;
+    reg32_t                     CParams2;
+});
+
+/* XhciCapabilityRegisters::SParams1
+ * Bits 0-7: Number of device slots
+ * Bits 8-18: Number of interrupters
+ * Bits 24-31: Number of ports */
+#define XHCI_SPARAM1_MAXSLOTS(n)            (n & 0xFF)
+#define XHCI_SPARAM1_MAXINTRS(n)            ((n >> 8) & 0x7FF)
+#define XHCI_SPARAM1_MAXPORTS(n)            ((n >> 24) & 0xFF)
+
+/* XhciCapabilityRegisters::SParams2
+ * Bits 0-3: Isochronous Scheduling Threshold
+ * Bits 4-7: Event Ring Segment Table Max (2^n)
+ * Bits 21-25: Max Scratchpad Buffers (Hi)
+ * Bits 26: Scratchpad Restore
+ * Bits 27-31: Max Scratchpad Buffers (Lo) */
+#define XHCI_SPARAM2_IST(n)                 (n & 0xF)
+#define XHCI_SPARAM2_ERSTMAX(n)             ((n >> 4) & 0xF)
+#define XHCI_SPARAM2_SCRATCHPADS(n)         ((((n >> 21) & 0x1F) << 5) | ((n >> 27) & 0x1F))
+
+/* XhciCapabilityRegisters::CParams1
+ * Bits 0: 64 bit addressing capability
+ * Bits 2: Context size, if set all contexts are 64 bytes instead of 32
+ * Bits 3: Port power control
+ * Bits 12-15: Maximum primary stream array size (2^(n+1))
+ * Bits 16-31: Extended capabilities pointer in dwords */
+#define XHCI_CPARAM1_AC64                   (1 << 0)
+#define XHCI_CPARAM1_CSZ                    (1 << 2)
+#define XHCI_CPARAM1_PPC                    (1 << 3)
+#define XHCI_CPARAM1_MAXPSASIZE(n)          ((n >> 12) & 0xF)
+#define XHCI_CPARAM1_XECP(n)                ((n >> 16) & 0xFFFF)
+
+/* XhciPortRegisters
+ * Every root port has a register set of four registers in the operational space */
+PACKED_ATYPESTRUCT(volatile, XhciPortRegisters, {
+    reg32_t                     Status;
+    reg32_t                     PowerManagement;
+    reg32_t                     LinkInfo;
+    reg32_t                     HardwareLpm;
+});
+
+/* XhciOperationalRegisters
+ * Registers that are used to control and command the XHCI controller
+ * and its ports. */
+PACKED_ATYPESTRUCT(volatile, XhciOperationalRegisters, {
+    reg32_t                     UsbCommand;
+    reg32_t                     UsbStatus;
+    reg32_t                     PageSize;
+    reg32_t                     Reserved0[2];
+    reg32_t                     DeviceNotification;
+    reg32_t                     CommandRingLo;
+    reg32_t                     CommandRingHi;
+    reg32_t                     Reserved1[4];
+    reg32_t                     DcbaaLo;
+    reg32_t                     DcbaaHi;
+    reg32_t                     Configure;
+    reg32_t                     Reserved2[241];
+    XhciPortRegisters_t         Ports[XHCI_MAX_PORTS];
+});
+
+/* XhciOperationalRegisters::UsbCommand */
+#define XHCI_COMMAND_RUN                (1 << 0)
+#define XHCI_COMMAND_HCRESET            (1 << 1)
+#define XHCI_COMMAND_INTERRUPT_ENABLE   (1 << 2)
+#define XHCI_COMMAND_HOSTERROR_ENABLE   (1 << 3)
+
+/* XhciOperationalRegisters::UsbStatus */
+#define XHCI_STATUS_HALTED              (1 << 0)
+#define XHCI_STATUS_HOSTERROR           (1 << 2)
+#define XHCI_STATUS_INTERRUPT           (1 << 3)
+#define XHCI_STATUS_PORTCHANGE          (1 << 4)
+#define XHCI_STATUS_NOT_READY           (1 << 11)
+#define XHCI_STATUS_CONTROLLER_ERROR    (1 << 12)
+#define XHCI_STATUS_RWC                 (XHCI_STATUS_HOSTERROR | XHCI_STATUS_INTERRUPT | XHCI_STATUS_PORTCHANGE)
+
+/* XhciOperationalRegisters::CommandRing */
+#define XHCI_CRCR_CYCLE                 (1 << 0)
+#define XHCI_CRCR_STOP                  (1 << 1)
+#define XHCI_CRCR_ABORT                 (1 << 2)
+#define XHCI_CRCR_RUNNING               (1 << 3)
+
+/* XhciPortRegisters::Status
+ * The enabled bit and the change bits are cleared by writing one, so writes must
+ * be based on XHCI_PORT_NEUTRAL of the current value. */
+#define XHCI_PORT_CONNECTED             (1 << 0)
+#define XHCI_PORT_ENABLED               (1 << 1)
+#define XHCI_PORT_OVERCURRENT           (1 << 3)
+#define XHCI_PORT_RESET                 (1 << 4)
+#define XHCI_PORT_LINKSTATE(n)          ((n >> 5) & 0xF)
+#define XHCI_PORT_POWER                 (1 << 9)
+#define XHCI_PORT_SPEED(n)              ((n >> 10) & 0xF)
+#define XHCI_PORT_CONNECT_EVENT         (1 << 17)
+#define XHCI_PORT_ENABLE_EVENT          (1 << 18)
+#define XHCI_PORT_WARMRESET_EVENT       (1 << 19)
+#define XHCI_PORT_OVERCURRENT_EVENT     (1 << 20)
+#define XHCI_PORT_RESET_EVENT           (1 << 21)
+#define XHCI_PORT_LINK_EVENT            (1 << 22)
+#define XHCI_PORT_CONFIG_ERROR_EVENT    (1 << 23)
+#define XHCI_PORT_WARM_RESET            (1U << 31)
+#define XHCI_PORT_RWC                   (0x7F << 17)
+#define XHCI_PORT_NEUTRAL(n)            ((n) & 0x4E00FFE9 & ~(XHCI_PORT_ENABLED | XHCI_PORT_RESET))
+
+#define XHCI_PORT_SPEED_FULL            1
+#define XHCI_PORT_SPEED_LOW             2
+#define XHCI_PORT_SPEED_HIGH            3
+#define XHCI_PORT_SPEED_SUPER           4
+#define XHCI_PORT_SPEED_SUPERPLUS       5
+
+/* XhciInterrupterRegisters
+ * Each interrupter has its own event ring, we only make use of the primary interrupter. */
+PACKED_ATYPESTRUCT(volatile, XhciInterrupterRegisters, {
+    reg32_t                     Management;
+    reg32_t                     Moderation;
+    reg32_t                     TableSize;
+    reg32_t                     Reserved;
+    reg32_t                     TableAddressLo;
+    reg32_t                     TableAddressHi;
+    reg32_t                     DequeueLo;
+    reg32_t                     DequeueHi;
+});
+
+#define XHCI_IMAN_PENDING               (1 << 0)
+#define XHCI_IMAN_ENABLE                (1 << 1)
+#define XHCI_ERDP_BUSY                  (1 << 3)
+
+PACKED_ATYPESTRUCT(volatile, XhciRuntimeRegisters, {
+    reg32_t                     FrameIndex;
+    reg32_t                     Reserved[7];
+    XhciInterrupterRegisters_t  Interrupters[1];
+});
+
+/* XhciTransferRequestBlock
+ * The generic layout of all the trbs, the meaning of the parameter and status
+ * fields depend on the type of the trb. */
+PACKED_TYPESTRUCT(XhciTransferRequestBlock, {
+    reg32_t                     Parameter[2];
+    reg32_t                     Status;
+    reg32_t                     Control;
+});
+
+/* XhciTransferRequestBlock::Status */
+#define XHCI_TRB_LENGTH(n)              (n & 0x1FFFF)
+#define XHCI_TRB_TDSIZE(n)              ((MIN(n, 31) & 0x1F) << 17)
+#define XHCI_TRB_EVENT_LENGTH(n)        (n & 0xFFFFFF)
+#define XHCI_TRB_COMPLETION_CODE(n)     ((n >> 24) & 0xFF)
+#define XHCI_TRB_STREAM(n)              ((n & 0xFFFF) << 16)
+
+/* XhciTransferRequestBlock::Control */
+#define XHCI_TRB_CYCLE                  (1 << 0)
+#define XHCI_TRB_TOGGLE_CYCLE           (1 << 1)  // Link trbs
+#define XHCI_TRB_EVALUATE_NEXT          (1 << 1)
+#define XHCI_TRB_ISP                    (1 << 2)
+#define XHCI_TRB_CHAIN                  (1 << 4)
+#define XHCI_TRB_IOC                    (1 << 5)
+#define XHCI_TRB_IDT                    (1 << 6)
+#define XHCI_TRB_BSR                    (1 << 9)  // Address device command
+#define XHCI_TRB_TSP                    (1 << 9)  // Reset endpoint command
+#define XHCI_TRB_TYPE(n)                ((n & 0x3F) << 10)
+#define XHCI_TRB_GET_TYPE(n)            ((n >> 10) & 0x3F)
+#define XHCI_TRB_DIRECTION_IN           (1 << 16)
+#define XHCI_TRB_TRT(n)                 ((n & 0x3) << 16)
+#define XHCI_TRB_ENDPOINT(n)            ((n & 0x1F) << 16)
+#define XHCI_TRB_GET_ENDPOINT(n)        ((n >> 16) & 0x1F)
+#define XHCI_TRB_SLOT(n)                ((n & 0xFF) << 24)
+#define XHCI_TRB_GET_SLOT(n)            ((n >> 24) & 0xFF)
+#define XHCI_TRB_SIA                    (1U << 31)
+
+#define XHCI_TRT_NO_DATA                0
+#define XHCI_TRT_OUT_DATA               2
+#define XHCI_TRT_IN_DATA                3
+
+/* Trb types, transfer, command and event types */
+#define XHCI_TRB_NORMAL                 1
+#define XHCI_TRB_SETUP                  2
+#define XHCI_TRB_DATA                   3
+#define XHCI_TRB_STATUS                 4
+#define XHCI_TRB_ISOCHRONOUS            5
+#define XHCI_TRB_LINK                   6
+#define XHCI_TRB_NOOP                   8
+#define XHCI_TRB_ENABLE_SLOT            9
+#define XHCI_TRB_DISABLE_SLOT           10
+#define XHCI_TRB_ADDRESS_DEVICE         11
+#define XHCI_TRB_CONFIGURE_ENDPOINT     12
+#define XHCI_TRB_EVALUATE_CONTEXT       13
+#define XHCI_TRB_RESET_ENDPOINT         14
+#define XHCI_TRB_STOP_ENDPOINT          15
+#define XHCI_TRB_SET_TR_DEQUEUE         16
+#define XHCI_TRB_TRANSFER_EVENT         32
+#define XHCI_TRB_COMMAND_COMPLETION     33
+#define XHCI_TRB_PORT_STATUS_CHANGE     34
+#define XHCI_TRB_HOST_CONTROLLER        37
+
+/* Completion codes */
+#define XHCI_CC_SUCCESS                 1
+#define XHCI_CC_DATA_BUFFER             2
+#define XHCI_CC_BABBLE                  3
+#define XHCI_CC_TRANSACTION             4
+#define XHCI_CC_TRB                     5
+#define XHCI_CC_STALL                   6
+#define XHCI_CC_RESOURCE                7
+#define XHCI_CC_BANDWIDTH               8
+#define XHCI_CC_NO_SLOTS                9
+#define XHCI_CC_SHORT_PACKET            13
+#define XHCI_CC_RING_UNDERRUN           14
+#define XHCI_CC_RING_OVERRUN            15
+#define XHCI_CC_BANDWIDTH_OVERRUN       18
+#define XHCI_CC_MISSED_SERVICE          23
+#define XHCI_CC_STOPPED                 26
+#define XHCI_CC_STOPPED_LENGTH_INVALID  27
+#define XHCI_CC_STOPPED_SHORT_PACKET    28
+#define XHCI_CC_SECONDARY_BANDWIDTH     35
+
+/* XhciSlotContext
+ * Describes the device in a slot, a context is 32 bytes or 64 bytes depending
+ * on CSZ, the upper half is reserved in the latter case. */
+PACKED_TYPESTRUCT(XhciSlotContext, {
+    reg32_t                     Flags;
+    reg32_t                     Port;
+    reg32_t                     Tt;
+    reg32_t                     State;
+    reg32_t                     Reserved[4];
+});
+
+#define XHCI_SLOT_SPEED(n)              ((n & 0xF) << 20)
+#define XHCI_SLOT_ENTRIES(n)            ((n & 0x1F) << 27)
+#define XHCI_SLOT_GET_ENTRIES(n)        ((n >> 27) & 0x1F)
+#define XHCI_SLOT_ROOTPORT(n)           ((n & 0xFF) << 16)
+#define XHCI_SLOT_ADDRESS(n)            (n & 0xFF)
+
+PACKED_TYPESTRUCT(XhciEndpointContext, {
+    reg32_t                     Flags;
+    reg32_t                     Configuration;
+    reg32_t                     DequeueLo;
+    reg32_t                     DequeueHi;
+    reg32_t                     Lengths;
+    reg32_t                     Reserved[3];
+});
+
+/* XhciEndpointContext::Flags */
+#define XHCI_EP_STATE(n)                (n & 0x7)
+#define XHCI_EP_MULT(n)                 ((n & 0x3) << 8)
+#define XHCI_EP_MAXPSTREAMS(n)          ((n & 0x1F) << 10)
+#define XHCI_EP_LSA                     (1 << 15)
+#define XHCI_EP_INTERVAL(n)             ((n & 0xFF) << 16)
+#define XHCI_EP_MAXESIT_HI(n)           (((n >> 16) & 0xFF) << 24)
+
+/* XhciEndpointContext::Configuration */
+#define XHCI_EP_ERRORCOUNT(n)           ((n & 0x3) << 1)
+#define XHCI_EP_TYPE(n)                 ((n & 0x7) << 3)
+#define XHCI_EP_MAXBURST(n)             ((n & 0xFF) << 8)
+#define XHCI_EP_MAXPACKETSIZE(n)        ((n & 0xFFFF) << 16)
+
+/* XhciEndpointContext::Lengths */
+#define XHCI_EP_AVERAGE_LENGTH(n)       (n & 0xFFFF)
+#define XHCI_EP_MAXESIT_LO(n)           ((n & 0xFFFF) << 16)
+
+#define XHCI_EP_TYPE_ISOC_OUT           1
+#define XHCI_EP_TYPE_BULK_OUT           2
+#define XHCI_EP_TYPE_INTERRUPT_OUT      3
+#define XHCI_EP_TYPE_CONTROL            4
+#define XHCI_EP_TYPE_ISOC_IN            5
+#define XHCI_EP_TYPE_BULK_IN            6
+#define XHCI_EP_TYPE_INTERRUPT_IN       7
+
+#define XHCI_EP_STATE_HALTED            2
+
+/* XhciStreamContext
+ * Entries of the primary stream context array, entry 0 is reserved. */
+PACKED_TYPESTRUCT(XhciStreamContext, {
+    reg32_t                     DequeueLo;
+    reg32_t                     DequeueHi;
+    reg32_t                     Reserved[2];
+});
+
+#define XHCI_STREAM_PRIMARY_RING        (1 << 1)
+
+/* XhciEventRingSegment
+ * Entry of the event ring segment table, we use a single segment. */
+PACKED_TYPESTRUCT(XhciEventRingSegment, {
+    reg32_t                     AddressLo;
+    reg32_t                     AddressHi;
+    reg32_t                     Size;
+    reg32_t                     Reserved;
+});
+
+/* XhciTransferDescriptor
+ * The scheduler element for a transfer, it records the trbs on the ring that
+ * belong to the transfer and the completion reported by the event ring. */
+PACKED_TYPESTRUCT(XhciTransferDescriptor, {
+    reg32_t                     Link;
+    uint8_t                     SlotId;
+    uint8_t                     Endpoint;
+    uint16_t                    StreamId;
+    struct _XhciRing*           Ring;
+    uint16_t                    TrbFirst;
+    uint16_t                    TrbLast;
+    uint16_t                    TrbNext;        // First trb not yet accounted
+    uint8_t                     NextCycle;      // Cycle state after the last trb
+    uint8_t                     CompletionCode;
+    uint16_t                    Flags;
+    uint16_t                    Reserved;
+    uint32_t                    Lengths[USB_TRANSACTIONCOUNT];
+
+    // Software metadata
+    UsbSchedulerObject_t        Object;
+});
+
+/* XhciTransferDescriptor::Flags */
+#define XHCI_TD_CONTROL                 (1 << 0)
+#define XHCI_TD_ISOCHRONOUS             (1 << 1)
+#define XHCI_TD_QUEUED                  (1 << 2)
+#define XHCI_TD_SHORT                   (1 << 3)
+#define XHCI_TD_COMPLETED               (1 << 4)
+#define XHCI_TD_CANCELLED               (1 << 5)
+
+/* Xhci Pool Definitions
+ * The xhci controller keeps all the hardware structures in rings, so there is
+ * only a single pool of transfer descriptors that are used for bookkeeping. */
+#define XHCI_TD_ALIGNMENT               16
+#define XHCI_TD_POOL                    0
+#define XHCI_TD_COUNT                   512
+#define XHCI_TD_START                   0
+
+/* XhciRingEntry
+ * Maps each trb on a ring back to the transfer descriptor and transaction it
+ * belongs to, used when processing transfer events. */
+typedef struct _XhciRingEntry {
+    XhciTransferDescriptor_t*   Td;
+    uint32_t                    Length;
+    int                         Transaction;
+} XhciRingEntry_t;
+
+typedef struct _XhciRing {
+    XhciTransferRequestBlock_t* Trbs;
+    uintptr_t                   Physical;
+    int                         Enqueue;
+    int                         Dequeue;
+    int                         Cycle;
+    XhciRingEntry_t             Entries[XHCI_RING_SIZE];
+} XhciRing_t;
+
+/* XhciEndpoint
+ * Software state of an endpoint, an endpoint either has a single transfer ring
+ * or a ring for each of its streams. */
+typedef struct _XhciEndpoint {
+    int                         Configured;
+    int                         Halted;
+    int                         Type;
+    size_t                      MaxPacketSize;
+    XhciRing_t*                 Ring;
+    int                         StreamCount;    // Includes the reserved stream 0
+    XhciRing_t*                 StreamRings[XHCI_MAX_STREAMS];
+    XhciStreamContext_t*        StreamContexts;
+    uintptr_t                   StreamContextsPhysical;
+} XhciEndpoint_t;
+
+typedef struct _XhciDevice {
+    int                         SlotId;
+    int                         Port;
+    int                         Speed;
+    int                         Addressed;
+    uint8_t*                    InputContext;
+    uintptr_t                   InputContextPhysical;
+    uint8_t*                    OutputContext;
+    uintptr_t                   OutputContextPhysical;
+    XhciEndpoint_t              Endpoints[XHCI_MAX_ENDPOINTS];
+} XhciDevice_t;
+
+/* XhciController
+ * Contains all per-controller information that is
+ * needed to control, queue and handle devices on an xhci-controller. */
+typedef struct _XhciController {
+    UsbManagerController_t      Base;
+
+    // Registers and resources
+    XhciCapabilityRegisters_t*  CapRegisters;
+    XhciOperationalRegisters_t* OpRegisters;
+    XhciRuntimeRegisters_t*     RuntimeRegisters;
+    reg32_t*                    Doorbells;
+
+    // Copy of vital registers
+    reg32_t                     SParameters1;
+    reg32_t                     SParameters2;
+    reg32_t                     CParameters1;
+    int                         MaxSlots;
+    size_t                      ContextSize;
+
+    // Device context base address array and scratchpads
+    reg64_t*                    Dcbaa;
+    uintptr_t                   DcbaaPhysical;
+    int                         ScratchpadCount;
+    reg64_t*                    ScratchpadArray;
+    uintptr_t                   ScratchpadArrayPhysical;
+    void*                       Scratchpads;
+
+    // Command and event rings
+    XhciRing_t*                 CommandRing;
+    XhciTransferRequestBlock_t* EventRing;
+    uintptr_t                   EventRingPhysical;
+    XhciEventRingSegment_t*     EventRingTable;
+    uintptr_t                   EventRingTablePhysical;
+    int                         EventDequeue;
+    int                         EventCycle;
+
+    // Command completion, a single command is outstanding at the time
+    mtx_t                       CommandLock;
+    mtx_t                       EventLock;
+    mtx_t                       RingLock;
+    uintptr_t                   CommandTrb;
+    volatile int                CommandDone;
+    int                         CommandCode;
+    int                         CommandSlot;
+
+    // Root port state
+    reg32_t                     PortChanges;    // Protected by the event lock
+    XhciDevice_t*               Devices[USB_MAX_PORTS];
+} XhciController_t;
+
+/*******************************************************************************
+ * Controller Methods
+ *******************************************************************************/
+
+/* XhciQueueInitialize
+ * Initialize the controller's transfer descriptor pool */
+__EXTERN
+OsStatus_t
+XhciQueueInitialize(
+    _In_ XhciController_t*          Controller);
+
+/* XhciQueueReset
+ * Removes and cleans up any existing transfers, the rings are reset by the restart. */
+__EXTERN
+OsStatus_t
+XhciQueueReset(
+    _In_ XhciController_t*          Controller);
+
+/* XhciQueueDestroy
+ * Cleans up any existing transfers and frees the transfer descriptor pool */
+__EXTERN
+OsStatus_t
+XhciQueueDestroy(
+    _In_ XhciController_t*          Controller);
+
+/* XhciHalt
+ * Stops the controller and waits for it to report halted */
+__EXTERN
+OsStatus_t
+XhciHalt(
+    _In_ XhciController_t*          Controller);
+
+/* XhciRestart
+ * Halts and resets the controller, then reprograms the rings and runs it */
+__EXTERN
+OsStatus_t
+XhciRestart(
+    _In_ XhciController_t*          Controller);
+
+/*******************************************************************************
+ * Ring Methods
+ *******************************************************************************/
+
+/* XhciRingCreate
+ * Allocates a new transfer or command ring that is terminated by a link trb
+ * back to the start of the ring. */
+__EXTERN
+XhciRing_t*
+XhciRingCreate(void);
+
+/* XhciRingDestroy
+ * Frees the ring and its trbs. */
+__EXTERN
+void
+XhciRingDestroy(
+    _In_ XhciRing_t*                Ring);
+
+/* XhciRingReset
+ * Resets the ring to empty, the ring must not be in use by the hardware. */
+__EXTERN
+void
+XhciRingReset(
+    _In_ XhciRing_t*                Ring);
+
+/* XhciRingFreeCount
+ * Returns the number of trbs that can be enqueued on the ring. */
+__EXTERN
+int
+XhciRingFreeCount(
+    _In_ XhciRing_t*                Ring);
+
+/* XhciRingEnqueue
+ * Writes a trb at the enqueue position of the ring and returns its index. The cycle
+ * bit of the trb is written inverted if <Deferred> is set, and must then be published
+ * with XhciRingPublish when the rest of the td has been written. */
+__EXTERN
+int
+XhciRingEnqueue(
+    _In_ XhciRing_t*                Ring,
+    _In_ reg32_t                    ParameterLo,
+    _In_ reg32_t                    ParameterHi,
+    _In_ reg32_t                    Status,
+    _In_ reg32_t                    Control,
+    _In_ int                        Deferred);
+
+/* XhciRingPublish
+ * Hands the first trb of a td over to the hardware by writing its cycle bit. */
+__EXTERN
+void
+XhciRingPublish(
+    _In_ XhciRing_t*                Ring,
+    _In_ int                        Index);
+
+/* XhciRingNext
+ * Returns the index of the trb following <Index>, skipping the link trb. */
+__EXTERN
+int
+XhciRingNext(
+    _In_ int                        Index);
+
+/* XhciRingGetIndex
+ * Translates the physical address of a trb to its index on the ring, returns
+ * -1 if the trb is not on the ring. */
+__EXTERN
+int
+XhciRingGetIndex(
+    _In_ XhciRing_t*                Ring,
+    _In_ uintptr_t                  TrbPhysical);
+
+/*******************************************************************************
+ * Command and Event Methods
+ *******************************************************************************/
+
+/* XhciRingDoorbell
+ * Rings the doorbell of the given slot, slot 0 is the command doorbell. */
+__EXTERN
+void
+XhciRingDoorbell(
+    _In_ XhciController_t*          Controller,
+    _In_ int                        SlotId,
+    _In_ reg32_t                    Target);
+
+/* XhciCommandExecute
+ * Places a command on the command ring and waits for its completion. The completion
+ * code is returned, and the slot of the completion in <SlotId> if not NULL. */
+__EXTERN
+int
+XhciCommandExecute(
+    _In_      XhciController_t*     Controller,
+    _In_      reg32_t               ParameterLo,
+    _In_      reg32_t               ParameterHi,
+    _In_      reg32_t               Status,
+    _In_      reg32_t               Control,
+    _Out_Opt_ int*                  SlotId);
+
+/* XhciProcessEvents
+ * Consumes all the pending events on the event ring and updates the software
+ * state accordingly, may be called from any thread. */
+__EXTERN
+void
+XhciProcessEvents(
+    _In_ XhciController_t*          Controller);
+
+/*******************************************************************************
+ * Device Methods
+ *******************************************************************************/
+
+/* XhciDeviceCreate
+ * Enables a slot for the device on the given root port and addresses the device
+ * with the default control endpoint, the SET_ADDRESS request is blocked. */
+__EXTERN
+OsStatus_t
+XhciDeviceCreate(
+    _In_ XhciController_t*          Controller,
+    _In_ int                        Port,
+    _In_ int                        Speed);
+
+/* XhciDeviceFromSlot
+ * Retrieves the device that has been assigned the given slot. */
+__EXTERN
+XhciDevice_t*
+XhciDeviceFromSlot(
+    _In_ XhciController_t*          Controller,
+    _In_ int                        SlotId);
+
+/* XhciDeviceDestroy
+ * Disables the slot of the device on the given root port and frees all its rings. */
+__EXTERN
+void
+XhciDeviceDestroy(
+    _In_ XhciController_t*          Controller,
+    _In_ int                        Port);
+
+/* XhciDeviceAddress
+ * Issues the address device command without blocking SET_ADDRESS, this assigns the
+ * device its address on the bus. */
+__EXTERN
+UsbTransferStatus_t
+XhciDeviceAddress(
+    _In_ XhciController_t*          Controller,
+    _In_ XhciDevice_t*              Device);
+
+/* XhciDeviceUpdateControl
+ * Updates the max packet size of the default control endpoint if it changed. */
+__EXTERN
+OsStatus_t
+XhciDeviceUpdateControl(
+    _In_ XhciController_t*          Controller,
+    _In_ XhciDevice_t*              Device,
+    _In_ size_t                     MaxPacketSize);
+
+/* XhciEndpointGetIndex
+ * Returns the device context index of the endpoint targeted by the transfer. */
+__EXTERN
+int
+XhciEndpointGetIndex(
+    _In_ UsbTransfer_t*             Transfer);
+
+/* XhciEndpointConfigure
+ * Configures the endpoint targeted by the transfer if it has not been configured
+ * before. Bulk endpoints of superspeed devices are configured with streams if the
+ * endpoint supports them. */
+__EXTERN
+OsStatus_t
+XhciEndpointConfigure(
+    _In_ XhciController_t*          Controller,
+    _In_ XhciDevice_t*              Device,
+    _In_ UsbTransfer_t*             Transfer);
+
+/* XhciEndpointGetRing
+ * Retrieves the transfer ring of the endpoint for the given stream. */
+__EXTERN
+XhciRing_t*
+XhciEndpointGetRing(
+    _In_ XhciEndpoint_t*            Endpoint,
+    _In_ int                        StreamId);
+
+/* XhciEndpointRecover
+ * Resets a halted endpoint and moves the dequeue pointer past the failed td. */
+__EXTERN
+void
+XhciEndpointRecover(
+    _In_ XhciController_t*          Controller,
+    _In_ XhciTransferDescriptor_t*  Td);
+
+/* XhciEndpointCancel
+ * Stops the endpoint of a td that has not completed, turns its trbs into no-ops and
+ * restarts the endpoint. */
+__EXTERN
+void
+XhciEndpointCancel(
+    _In_ XhciController_t*          Controller,
+    _In_ XhciTransferDescriptor_t*  Td);
+
+/*******************************************************************************
+ * Port Methods
+ *******************************************************************************/
+
+/* XhciPortScan
+ * Checks the ports that reported a change and notifies the usb manager. */
+__EXTERN
+void
+XhciPortScan(
+    _In_ XhciController_t*          Controller,
+    _In_ reg32_t                    ChangeBits);
+
+/*******************************************************************************
+ * Transfer Methods
+ *******************************************************************************/
+
+/* XhciGetDevice
+ * Retrieves the device a transfer is destined for, only devices on root ports are
+ * supported. Transfers for devices behind a hub are rejected with an error. */
+__EXTERN
+XhciDevice_t*
+XhciGetDevice(
+    _In_ XhciController_t*          Controller,
+    _In_ UsbTransfer_t*             Transfer);
+
+/* XhciTransferTrbCount
+ * Returns the largest number of trbs the transfer can need on the ring. */
+__EXTERN
+int
+XhciTransferTrbCount(
+    _In_ UsbManagerTransfer_t*      Transfer);
+
+/* XhciTransferPush
+ * Writes a single trb of the td, the first trb of the td is written with an invalid
+ * cycle bit so the controller does not start on the td before it's complete. The ring
+ * lock must be held. */
+__EXTERN
+void
+XhciTransferPush(
+    _In_    XhciRing_t*                 Ring,
+    _In_    XhciTransferDescriptor_t*   Td,
+    _In_    int                         Transaction,
+    _In_    reg32_t                     ParameterLo,
+    _In_    reg32_t                     ParameterHi,
+    _In_    reg32_t                     Status,
+    _In_    reg32_t                     Control,
+    _In_    size_t                      Length,
+    _InOut_ int*                        Count);
+
+/* XhciTransferPushBuffer
+ * Writes the trbs for a buffer, buffers are split at 64kb boundaries. The trbs are
+ * chained, and the first trb is of type <FirstControl>. The ring lock must be held. */
+__EXTERN
+void
+XhciTransferPushBuffer(
+    _In_    XhciRing_t*                 Ring,
+    _In_    XhciTransferDescriptor_t*   Td,
+    _In_    int                         Transaction,
+    _In_    uintptr_t                   Address,
+    _In_    size_t                      Length,
+    _In_    size_t                      MaxPacketSize,
+    _In_    reg32_t                     FirstControl,
+    _In_    reg32_t                     Flags,
+    _InOut_ int*                        Count);
+
+/* XhciTransferFill
+ * Writes the trbs of the transfer onto the endpoint ring, the transfer descriptor
+ * must have been initialized with the slot, endpoint and stream. Interrupt transfers
+ * are filled at <PeriodicOffset> into the periodic buffer. */
+__EXTERN
+UsbTransferStatus_t
+XhciTransferFill(
+    _In_ XhciController_t*          Controller,
+    _In_ UsbManagerTransfer_t*      Transfer,
+    _In_ XhciTransferDescriptor_t*  Td,
+    _In_ size_t                     PeriodicOffset);
+
+/* XhciTransferFillIsochronous
+ * Writes the isochronous trbs of the transfer onto the endpoint ring. */
+__EXTERN
+UsbTransferStatus_t
+XhciTransferFillIsochronous(
+    _In_ XhciController_t*          Controller,
+    _In_ UsbManagerTransfer_t*      Transfer,
+    _In_ XhciTransferDescriptor_t*  Td,
+    _In_ size_t                     PeriodicOffset);
+
+/* XhciTransferQueue
+ * Allocates the transfer descriptor and queues the transfer on the endpoint ring,
+ * transfers that don't fit the ring are kept until another transfer completes. */
+__EXTERN
+UsbTransferStatus_t
+XhciTransferQueue(
+    _In_ XhciController_t*          Controller,
+    _In_ UsbManagerTransfer_t*      Transfer);
+
+/* XhciTransferEvent
+ * Records the completion of a trb reported by a transfer event. */
+__EXTERN
+void
+XhciTransferEvent(
+    _In_ XhciController_t*          Controller,
+    _In_ XhciTransferRequestBlock_t* Event);
+
+/* XhciGetStatusCode
+ * Converts a completion code to a transfer status. */
+__EXTERN
+UsbTransferStatus_t
+XhciGetStatusCode(
+    _In_ int                        CompletionCode);
+
+#endif //!__USB_XHCI__
@@ -33,6 +33,91 @@
 InterruptStatus_t OnFastInterrupt(FastInterruptResources_t*, void*);
 OsStatus_t        AhciSetup(AhciController_t* Controller);
 
+/* AhciInitializeVector
+ * Prepares the interrupt descriptor of a vector, the vector itself is passed to the
+ * fast handler as the second memory resource and to OnInterrupt as context. */
+static void
+AhciInitializeVector(
+    _In_ AhciController_t* Controller,
+    _In_ int               Index,
+    _In_ reg32_t           PortMask)
+{
+    AhciInterruptVector_t* Vector    = &Controller->Vectors[Index];
+    DeviceInterrupt_t*     Interrupt = &Controller->VectorInterrupts[Index];
+
+    Vector->Controller  = Controller;
+    Vector->InterruptId = UUID_INVALID;
+    Vector->PortMask    = PortMask;
+
+    memcpy(Interrupt, &Controller->Device.Interrupt, sizeof(DeviceInterrupt_t));
+    RegisterFastInterruptHandler(Interrupt, OnFastInterrupt);
+    RegisterFastInterruptIoResource(Interrupt, Controller->IoBase);
+    RegisterFastInterruptMemoryResource(Interrupt,
+        (uintptr_t)&Controller->InterruptResource, sizeof(AhciInterruptResource_t), 0);
+    RegisterFastInterruptMemoryResource(Interrupt,
+        (uintptr_t)Vector, sizeof(AhciInterruptVector_t), 0);
+    RegisterInterruptContext(Interrupt, Vector);
+}
+
+/* AhciRegisterInterrupts
+ * Registers a vector per port when msi-x provides enough of them, so completions of each
+ * port can be steered to their own core. Otherwise a single vector services all ports,
+ * with the legacy line as the last resort. */
+static OsStatus_t
+AhciRegisterInterrupts(
+    _In_ AhciController_t* Controller)
+{
+    UUId_t  Sources[AHCI_MAX_PORTS];
+    reg32_t Implemented = ReadVolatile32(&Controller->Registers->PortsImplemented);
+    int     Needed      = 1;
+    int     Count;
+    int     i;
+
+    // Port i is serviced by vector i, so enough vectors for the highest port are needed
+    for (i = 0; i < AHCI_MAX_PORTS; i++) {
+        if (Implemented & AHCI_IMPLEMENTED_PORT(i)) {
+            Needed = i + 1;
+        }
+    }
+
+    Count = Needed;
+    if (Controller->Device.MsiXCapability != 0 && Needed > 1) {
+        for (i = 0; i < Needed; i++) {
+            AhciInitializeVector(Controller, i, AHCI_IMPLEMENTED_PORT(i));
+        }
+        if (RegisterMessageInterrupts(&Controller->Device, &Controller->VectorInterrupts[0],
+                INTERRUPT_USERSPACE, &Count, &Sources[0]) == OsSuccess) {
+            if (Count == Needed) {
+                for (i = 0; i < Count; i++) {
+                    Controller->Vectors[i].InterruptId = Sources[i];
+                }
+                Controller->VectorCount = Count;
+                return OsSuccess;
+            }
+
+            // The table is too small to map every port, try again with a single vector
+            for (i = 0; i < Count; i++) {
+                UnregisterInterruptSource(Sources[i]);
+            }
+        }
+    }
+
+    // Single vector that services all ports
+    Count = 1;
+    AhciInitializeVector(Controller, 0, 0xFFFFFFFF);
+    if (RegisterMessageInterrupts(&Controller->Device, &Controller->VectorInterrupts[0],
+            INTERRUPT_USERSPACE, &Count, &Sources[0]) != OsSuccess) {
+        TRACE(" > ahci interrupt line is %u", Controller->Device.Interrupt.Line);
+        Sources[0] = RegisterInterruptSource(&Controller->VectorInterrupts[0], INTERRUPT_USERSPACE);
+        if (Sources[0] == UUID_INVALID) {
+            return OsError;
+        }
+    }
+    Controller->Vectors[0].InterruptId = Sources[0];
+    Controller->VectorCount            = 1;
+    return OsSuccess;
+}
+
 /* AhciControllerCreate
  * Registers a new controller with the AHCI driver */
 AhciController_t*
@@ -85,10 +170,6 @@ AhciControllerCreate(
 
     // Instantiate the register-access
     Controller->Registers = (AHCIGenericRegisters_t*)IoBase->Access.Memory.VirtualBase;
-    RegisterFastInterruptHandler(&Controller->Device.Interrupt, OnFastInterrupt);
-    RegisterFastInterruptIoResource(&Controller->Device.Interrupt, IoBase);
-    RegisterFastInterruptMemoryResource(&Controller->Device.Interrupt, 
-        (uintptr_t)&Controller->InterruptResource, sizeof(AhciInterruptResource_t), 0);
 
     // Register contract before interrupt
     Status = RegisterContract(&Controller->Contract);
@@ -99,17 +180,11 @@ AhciControllerCreate(
         return NULL;
     }
 
-    // Register interrupt
-    TRACE(" > ahci interrupt line is %u", Controller->Device.Interrupt.Line);
-    RegisterInterruptContext(&Controller->Device.Interrupt, Controller);
-    Controller->InterruptId = RegisterInterruptSource(&Controller->Device.Interrupt, INTERRUPT_USERSPACE);
-
-    // Enable device
+    // Enable device, memory space must be enabled before the msi-x table is written
     Status = IoctlDevice(Controller->Device.Id, __DEVICEMANAGER_IOCTL_BUS,
         (__DEVICEMANAGER_IOCTL_ENABLE | __DEVICEMANAGER_IOCTL_MMIO_ENABLE | __DEVICEMANAGER_IOCTL_BUSMASTER_ENABLE));
-    if (Status != OsSuccess || Controller->InterruptId == UUID_INVALID) {
+    if (Status != OsSuccess || AhciRegisterInterrupts(Controller) != OsSuccess) {
         ERROR("Failed to enable the ahci-controller");
-        UnregisterInterruptSource(Controller->InterruptId);
         ReleaseDeviceIo(Controller->IoBase);
         free(Controller);
         return NULL;
@@ -159,7 +234,9 @@ AhciControllerDestroy(
             MemoryFree(Controller->FisBase, 256 * Controller->PortCount);
         }
     }
-    UnregisterInterruptSource(Controller->InterruptId);
+    for (i = 0; i < Controller->VectorCount; i++) {
+        UnregisterInterruptSource(Controller->Vectors[i].InterruptId);
+    }
     ReleaseDeviceIo(Controller->IoBase);
 
     free(Controller);
@@ -339,10 +339,19 @@ typedef struct _AhciPort {
  * The shared interrupt resource that is used to store data from the fast interrupt
  * into process interrupt. */
 typedef struct _AhciInterruptResource {
-    reg32_t                 ControllerInterruptStatus;
     reg32_t                 PortInterruptStatus[AHCI_MAX_PORTS];
 } AhciInterruptResource_t;
 
+/* AhciInterruptVector
+ * A registered interrupt vector of the controller. With msi-x each port is serviced by
+ * its own vector, otherwise the single vector services all ports. */
+typedef struct _AhciInterruptVector {
+    struct _AhciController* Controller;
+    UUId_t                  InterruptId;
+    reg32_t                 PortMask;
+    reg32_t                 ControllerInterruptStatus;
+} AhciInterruptVector_t;
+
 /* The AHCI Controller 
  * It contains all information neccessary 
  * for us to use it for our functions */
@@ -350,7 +359,9 @@ typedef struct _AhciController {
     MCoreDevice_t           Device;
     MContract_t             Contract;
     AhciInterruptResource_t InterruptResource;
-    UUId_t                  InterruptId;
+    AhciInterruptVector_t   Vectors[AHCI_MAX_PORTS];
+    DeviceInterrupt_t       VectorInterrupts[AHCI_MAX_PORTS];
+    int                     VectorCount;
     Spinlock_t              Lock;
 
     DeviceIo_t*             IoBase;
@@ -75,17 +75,21 @@ AhciCommandDispatch(
     AHCICommandHeader_t* CommandHeader;
     AHCICommandTable_t*  CommandTable;
     uintptr_t            BufferPointer;
-    size_t               BytesLeft = Transaction->SectorCount * Transaction->Device->SectorSize;
-    int                  PrdtIndex = 0;
+    size_t               SegmentLeft;
+    size_t               BytesLeft    = Transaction->SectorCount * Transaction->Device->SectorSize;
+    int                  PrdtIndex    = 0;
+    int                  SegmentIndex = 0;
 
     TRACE("AhciCommandDispatch(Port %u, Flags 0x%x, Length %u, TransferSize 0x%x)",
         Transaction->Device->Port->Id, Flags, CommandLength, BytesLeft);
 
-    // Assert that buffer is DWORD aligned, this must be true
-    if (((uintptr_t)Transaction->Address & 0x3) != 0) {
-        ERROR("AhciCommandDispatch::Buffer was not dword aligned (0x%x)",
-            Transaction->Device->Port->Id, Transaction->Address);
-        goto Error;
+    // Assert that all segments are DWORD aligned, this must be true
+    for (SegmentIndex = 0; SegmentIndex < Transaction->SegmentCount; SegmentIndex++) {
+        if ((Transaction->Segments[SegmentIndex].Address & 0x3) != 0) {
+            ERROR("AhciCommandDispatch::Buffer was not dword aligned (0x%x)",
+                Transaction->Device->Port->Id, Transaction->Segments[SegmentIndex].Address);
+            goto Error;
+        }
     }
 
     // Assert that buffer length is an even byte-count requested
@@ -116,12 +120,22 @@ AhciCommandDispatch(
         memcpy(&CommandTable->FISAtapi[0], AtapiCommand, AtapiCommandLength);
     }
 
-    // Build PRDT entries
+    // Build PRDT entries, a segment is split into multiple entries if it exceeds the
+    // maximum entry length. The segments are trimmed to fit the table when queried.
     TRACE("Building PRDT Table");
-    BufferPointer = Transaction->Address;
+    SegmentIndex  = 0;
+    BufferPointer = Transaction->Segments[0].Address;
+    SegmentLeft   = Transaction->Segments[0].Length;
     while (BytesLeft > 0) {
         AHCIPrdtEntry_t* Prdt = &CommandTable->PrdtEntry[PrdtIndex];
-        size_t TransferLength = MIN(AHCI_PRDT_MAX_LENGTH, BytesLeft);
+        size_t TransferLength;
+
+        if (SegmentLeft == 0) {
+            SegmentIndex++;
+            BufferPointer = Transaction->Segments[SegmentIndex].Address;
+            SegmentLeft   = Transaction->Segments[SegmentIndex].Length;
+        }
+        TransferLength = MIN(AHCI_PRDT_MAX_LENGTH, MIN(SegmentLeft, BytesLeft));
 
         // Set buffer information and transfer sizes
         Prdt->DataBaseAddress      = LODWORD(BufferPointer);
@@ -132,6 +146,7 @@ AhciCommandDispatch(
 
         // Adjust counters
         BufferPointer += TransferLength;
+        SegmentLeft   -= TransferLength;
         BytesLeft     -= TransferLength;
         PrdtIndex++;
 
@@ -220,6 +235,51 @@ AhciVerifyRegisterFIS(
     return OsSuccess;
 }
 
+/* AhciTransactionQuerySegments
+ * Retrieves the physical segments of the transaction buffer. If the buffer is too fragmented
+ * to be described by the PRDT of a single command the number of sectors is reduced. */
+static OsStatus_t
+AhciTransactionQuerySegments(
+    _In_ AhciTransaction_t* Transaction)
+{
+    size_t SectorSize = Transaction->Device->SectorSize;
+    size_t Length     = 0;
+    int    PrdtCount  = 0;
+    int    i;
+
+    Transaction->SegmentCount = AHCI_COMMAND_TABLE_PRDT_COUNT;
+    if (GetBufferSegments(Transaction->BufferHandle, Transaction->BufferOffset, 
+            Transaction->SectorCount * SectorSize, &Transaction->Segments[0], 
+            &Transaction->SegmentCount) != OsSuccess) {
+        ERROR("AHCI::Failed to retrieve segments of buffer 0x%x", Transaction->BufferHandle);
+        return OsError;
+    }
+
+    // Count the bytes that can be described by the table, segments larger than
+    // the maximum entry length take up multiple entries
+    for (i = 0; i < Transaction->SegmentCount; i++) {
+        size_t SegmentLength = Transaction->Segments[i].Length;
+        int    Entries       = (int)DIVUP(SegmentLength, AHCI_PRDT_MAX_LENGTH);
+        if (PrdtCount + Entries > AHCI_COMMAND_TABLE_PRDT_COUNT) {
+            SegmentLength = (AHCI_COMMAND_TABLE_PRDT_COUNT - PrdtCount) * AHCI_PRDT_MAX_LENGTH;
+            Entries       = AHCI_COMMAND_TABLE_PRDT_COUNT - PrdtCount;
+        }
+        Length    += SegmentLength;
+        PrdtCount += Entries;
+        if (PrdtCount == AHCI_COMMAND_TABLE_PRDT_COUNT) {
+            break;
+        }
+    }
+
+    if (Length < (Transaction->SectorCount * SectorSize)) {
+        Transaction->SectorCount = Length / SectorSize;
+        if (Transaction->SectorCount == 0) {
+            return OsError;
+        }
+    }
+    return OsSuccess;
+}
+
 OsStatus_t 
 AhciCommandRegisterFIS(
     _In_ AhciTransaction_t* Transaction,
@@ -236,6 +296,11 @@ AhciCommandRegisterFIS(
     TRACE("AhciCommandRegisterFIS(Cmd 0x%x, Sector 0x%x)",
         LOBYTE(Command), LODWORD(SectorLBA));
 
+    // The sector count must be final before it's written to the FIS
+    if (AhciTransactionQuerySegments(Transaction) != OsSuccess) {
+        return OsError;
+    }
+
     // Fill out initial information
     Fis.Type    = LOBYTE(FISRegisterH2D);
     Fis.Flags  |= FIS_HOST_TO_DEVICE;
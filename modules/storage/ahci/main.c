@@ -41,13 +41,15 @@ OnFastInterrupt(
     _In_ void*                      Reserved)
 {
     AhciInterruptResource_t* Resource = (AhciInterruptResource_t*)INTERRUPT_RESOURCE(InterruptTable, 0);
+    AhciInterruptVector_t*   Vector   = (AhciInterruptVector_t*)INTERRUPT_RESOURCE(InterruptTable, 1);
     AHCIGenericRegisters_t* Registers = (AHCIGenericRegisters_t*)INTERRUPT_IOSPACE(InterruptTable, 0)->Access.Memory.VirtualBase;
     reg32_t InterruptStatus;
     int i;
     _CRT_UNUSED(Reserved);
 
-    // Skip processing immediately if the interrupt was not for us
-    InterruptStatus = Registers->InterruptStatus;
+    // Skip processing immediately if the interrupt was not for us, only the
+    // ports of this vector are serviced here
+    InterruptStatus = Registers->InterruptStatus & Vector->PortMask;
     if (!InterruptStatus) {
         return InterruptNotHandled;
     }
@@ -63,7 +65,7 @@ OnFastInterrupt(
 
     // Write clear interrupt register and return
     Registers->InterruptStatus              = InterruptStatus;
-    Resource->ControllerInterruptStatus    |= InterruptStatus;
+    Vector->ControllerInterruptStatus      |= InterruptStatus;
     return InterruptHandled;
 }
 
@@ -77,19 +79,21 @@ OnInterrupt(
     _In_Opt_ size_t Arg1,
     _In_Opt_ size_t Arg2)
 {
-    AhciController_t* Controller;
-    reg32_t           InterruptStatus;
-    int               i;
+    AhciInterruptVector_t* Vector;
+    AhciController_t*      Controller;
+    reg32_t                InterruptStatus;
+    int                    i;
 
     // Unused
     _CRT_UNUSED(Arg0);
     _CRT_UNUSED(Arg1);
     _CRT_UNUSED(Arg2);
-    Controller = (AhciController_t*)InterruptData;
+    Vector     = (AhciInterruptVector_t*)InterruptData;
+    Controller = Vector->Controller;
 
 HandleInterrupt:
-    InterruptStatus = Controller->InterruptResource.ControllerInterruptStatus;
-    Controller->InterruptResource.ControllerInterruptStatus = 0;
+    InterruptStatus = Vector->ControllerInterruptStatus;
+    Vector->ControllerInterruptStatus = 0;
     
     // Iterate the port-map and check if the interrupt
     // came from that port
@@ -100,7 +104,7 @@ HandleInterrupt:
     }
     
     // Re-handle?
-    if (Controller->InterruptResource.ControllerInterruptStatus != 0) {
+    if (Vector->ControllerInterruptStatus != 0) {
         goto HandleInterrupt;
     }
     return InterruptHandled;
@@ -225,9 +229,10 @@ OnQuery(
             Transaction  = (AhciTransaction_t*)malloc(sizeof(AhciTransaction_t));
             memset((void*)Transaction, 0, sizeof(AhciTransaction_t));
             memcpy((void*)&Transaction->ResponseAddress, Address, sizeof(MRemoteCallAddress_t));
-            Transaction->Address     = Operation->PhysicalBuffer;
-            Transaction->SectorCount = Operation->SectorCount;
-            Transaction->Device      = Device;
+            Transaction->BufferHandle = Operation->BufferHandle;
+            Transaction->BufferOffset = Operation->BufferOffset;
+            Transaction->SectorCount  = Operation->SectorCount;
+            Transaction->Device       = Device;
 
             // Determine the kind of operation
             if (Operation->Direction == __STORAGE_OPERATION_READ) {
@@ -124,7 +124,8 @@ AhciManagerCreateDevice(
     Device->Type           = (Signature == SATA_SIGNATURE_ATAPI) ? 1 : 0;
 
     Transaction->ResponseAddress.Thread = UUID_INVALID;
-    Transaction->Address        = GetBufferDma(Buffer);
+    Transaction->BufferHandle   = GetBufferHandle(Buffer);
+    Transaction->BufferOffset   = 0;
     Transaction->SectorCount    = 1;
     Transaction->Device         = Device;
     return AhciCommandRegisterFIS(Transaction, AtaPIOIdentifyDevice, 0, 0, 0);
@@ -40,11 +40,15 @@
 
 /* AhciTransaction 
  * Describes the ahci-transaction object and contains
- * information about the buffer and the requester */
+ * information about the buffer and the requester. The segments
+ * are the physical parts of the buffer the PRDT is built from. */
 typedef struct _AhciTransaction {
     CollectionItem_t     Header;
     MRemoteCallAddress_t ResponseAddress;
-    uintptr_t            Address;
+    UUId_t               BufferHandle;
+    size_t               BufferOffset;
+    DmaSegment_t         Segments[AHCI_COMMAND_TABLE_PRDT_COUNT];
+    int                  SegmentCount;
     size_t               SectorCount;
     AhciDevice_t*        Device;
     int                  Slot;
@@ -26,11 +26,13 @@
 
 extern MsdOperations_t BulkOperations;
 extern MsdOperations_t UfiOperations;
+extern MsdOperations_t UasOperations;
 static MsdOperations_t *ProtocolOperations[ProtocolCount] = {
     NULL,
     &UfiOperations,
     &UfiOperations,
-    &BulkOperations
+    &BulkOperations,
+    &UasOperations
 };
 
 const char* SenseKeys[] = {
@@ -109,29 +111,42 @@ MsdGetMaximumLunCount(
     return OsSuccess;
 }
 
-UsbTransferStatus_t 
-MsdScsiCommand(
-    _In_ MsdDevice_t* Device,
-    _In_ int          Direction,
-    _In_ uint8_t      ScsiCommand,
-    _In_ uint64_t     SectorStart,
-    _In_ uintptr_t    DataAddress,
-    _In_ size_t       DataLength)
+/* MsdScsiExecute
+ * Executes a scsi command and its data stage. Protocols that can run the stages back
+ * to back do so, the rest are executed stage by stage. The residue is the number
+ * of bytes the device did not transfer. */
+static UsbTransferStatus_t 
+MsdScsiExecute(
+    _In_  MsdDevice_t* Device,
+    _In_  int          Direction,
+    _In_  uint8_t      ScsiCommand,
+    _In_  uint64_t     SectorStart,
+    _In_  uintptr_t    DataAddress,
+    _In_  size_t       DataLength,
+    _Out_ size_t*      Residue)
 {
     UsbTransferStatus_t Status         = { 0 };
     size_t              DataToTransfer = DataLength;
     int                 RetryCount     = 3;
 
     // Debug
-    TRACE("MsdScsiCommand(Direction %i, Command %u, Start %u, Length %u)",
+    TRACE("MsdScsiExecute(Direction %i, Command %u, Start %u, Length %u)",
         Direction, ScsiCommand, LODWORD(SectorStart), DataLength);
 
     // It is invalid to send zero length packets for bulk
+    *Residue = 0;
     if (Direction == 1 && DataLength == 0) {
         ERROR("Cannot write data of length 0 to MSD devices.");
         return TransferInvalid;
     }
 
+    if (Device->Operations->ExecuteCommands != NULL) {
+        MsdCommand_t Command = { Direction, ScsiCommand, SectorStart, DataAddress, DataLength, 0, TransferNotProcessed };
+        Device->Operations->ExecuteCommands(Device, &Command, 1);
+        *Residue = Command.Residue;
+        return Command.Status;
+    }
+
     // Send the command
     Status = Device->Operations->SendCommand(Device, ScsiCommand, 
         SectorStart, DataAddress, DataLength);
@@ -162,6 +177,20 @@ MsdScsiCommand(
     return Device->Operations->GetStatus(Device);
 }
 
+UsbTransferStatus_t 
+MsdScsiCommand(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Direction,
+    _In_ uint8_t      ScsiCommand,
+    _In_ uint64_t     SectorStart,
+    _In_ uintptr_t    DataAddress,
+    _In_ size_t       DataLength)
+{
+    size_t Residue;
+    return MsdScsiExecute(Device, Direction, ScsiCommand, 
+        SectorStart, DataAddress, DataLength, &Residue);
+}
+
 /* MsdDevicePrepare
  * Ready's the device by performing TDR's and requesting sense-status. */
 OsStatus_t
@@ -332,136 +361,139 @@ MsdDeviceStart(
     return MsdReadCapabilities(Device);
 }
 
-OsStatus_t
-MsdReadSectors(
+/* MsdTransferSectors
+ * Moves the sectors in as many commands as needed. Each command is limited by the
+ * command set of the protocol and by the transfer length that suits the device. Protocols
+ * that queue commands are given them in batches. */
+static OsStatus_t
+MsdTransferSectors(
     _In_  MsdDevice_t* Device,
+    _In_  int          Direction,
     _In_  uint64_t     SectorStart, 
     _In_  uintptr_t    BufferAddress,
     _In_  size_t       SectorCount,
-    _Out_ size_t*      SectorsRead)
+    _Out_ size_t*      SectorsTransferred)
 {
-    UsbTransferStatus_t Result;
-    size_t              SectorsToBeRead;
-    uint8_t             ReadCommand;
-
-    // Debug
-    TRACE("MsdReadSectors(Sector %u, Length %u, Address 0x%x)",
-        LODWORD(SectorStart), BufferLength, BufferAddress);
+    size_t  SectorSize = Device->Descriptor.SectorSize;
+    size_t  SectorsLeft;
+    size_t  CommandLimit;
+    uint8_t Command;
 
     // Protect against bad start sector
+    *SectorsTransferred = 0;
     if (SectorStart >= Device->Descriptor.SectorCount) {
         return OsInvalidParameters;
     }
-
-    // Of course it's possible that the requester is requesting too much data in one
-    // go, so we will have to clamp some of the values. Is the sector valid first of all?
-    SectorsToBeRead = SectorCount;
-    if ((SectorStart + SectorsToBeRead) >= Device->Descriptor.SectorCount) {
-        SectorsToBeRead = Device->Descriptor.SectorCount - SectorStart;
-    }
+    SectorsLeft = (size_t)MIN(SectorCount, Device->Descriptor.SectorCount - SectorStart);
     
     // Detect limits based on type of device and protocol
     if (Device->Protocol == ProtocolCB || Device->Protocol == ProtocolCBI) {
-        ReadCommand     = SCSI_READ_6;
-		SectorsToBeRead = MIN(SectorsToBeRead, UINT8_MAX);
+        Command      = (Direction == 0) ? SCSI_READ_6 : SCSI_WRITE_6;
+        CommandLimit = UINT8_MAX;
     }
     else if (!Device->IsExtended) {
-        ReadCommand     = SCSI_READ;
-		SectorsToBeRead = MIN(SectorsToBeRead, UINT16_MAX);
+        Command      = (Direction == 0) ? SCSI_READ : SCSI_WRITE;
+        CommandLimit = UINT16_MAX;
     }
     else {
-        ReadCommand = SCSI_READ_16;
-    }
-    
-    // Update the sectors to be transferred
-    if (SectorsRead) {
-        *SectorsRead = SectorsToBeRead;
-    }
-    
-    // Put in the read request
-    Result = MsdScsiCommand(Device, 0, ReadCommand, SectorStart, 
-        BufferAddress, SectorsToBeRead * Device->Descriptor.SectorSize);
-        
-    // Convert between usb status to storage operating status
-    if (Result != TransferFinished) {
-        if (SectorsRead) {
-            *SectorsRead = 0;
+        Command      = (Direction == 0) ? SCSI_READ_16 : SCSI_WRITE_16;
+        CommandLimit = UINT32_MAX;
+    }
+    CommandLimit = MIN(CommandLimit, MAX(Device->MaxTransferLength / SectorSize, 1));
+
+    while (SectorsLeft != 0) {
+        MsdCommand_t Commands[MSD_COMMAND_BATCH];
+        int          Count = 0;
+        int          i;
+
+        while (SectorsLeft != 0 && Count < MSD_COMMAND_BATCH) {
+            size_t Sectors = MIN(SectorsLeft, CommandLimit);
+            Commands[Count].Direction   = Direction;
+            Commands[Count].ScsiCommand = Command;
+            Commands[Count].SectorStart = SectorStart;
+            Commands[Count].DataAddress = BufferAddress;
+            Commands[Count].DataLength  = Sectors * SectorSize;
+            Commands[Count].Residue     = 0;
+            Commands[Count].Status      = TransferNotProcessed;
+            SectorsLeft   -= Sectors;
+            SectorStart   += Sectors;
+            BufferAddress += Sectors * SectorSize;
+            Count++;
         }
-        return OsError;
-    }
-    else {
-        if (SectorsRead && Device->StatusBlock->DataResidue) {
-            // Data residue is in bytes not transferred as it does not seem
-            // required that we transfer in sectors
-            size_t SectorsNotRead = DIVUP(Device->StatusBlock->DataResidue, 
-                Device->Descriptor.SectorSize);
-            *SectorsRead -= SectorsNotRead;
+
+        if (Device->Operations->ExecuteCommands != NULL) {
+            Device->Operations->ExecuteCommands(Device, &Commands[0], Count);
+        }
+        else {
+            for (i = 0; i < Count; i++) {
+                Commands[i].Status = MsdScsiExecute(Device, Direction, Command, Commands[i].SectorStart,
+                    Commands[i].DataAddress, Commands[i].DataLength, &Commands[i].Residue);
+                if (Commands[i].Status != TransferFinished || Commands[i].Residue != 0) {
+                    break;
+                }
+            }
+        }
+
+        // Only the sectors up to the first failed or short command are reported. Data 
+        // residue is in bytes not transferred as it does not seem required that we 
+        // transfer in sectors
+        for (i = 0; i < Count; i++) {
+            size_t Sectors = Commands[i].DataLength / SectorSize;
+            if (Commands[i].Status != TransferFinished) {
+                return OsError;
+            }
+            if (Commands[i].Residue != 0) {
+                *SectorsTransferred += Sectors - MIN(Sectors, DIVUP(Commands[i].Residue, SectorSize));
+                return OsSuccess;
+            }
+            *SectorsTransferred += Sectors;
         }
     }
     return OsSuccess;
 }
 
 OsStatus_t
-MsdWriteSectors(
+MsdReadSectors(
     _In_  MsdDevice_t* Device,
     _In_  uint64_t     SectorStart, 
     _In_  uintptr_t    BufferAddress,
     _In_  size_t       SectorCount,
-    _Out_ size_t*      SectorsWritten)
+    _Out_ size_t*      SectorsRead)
 {
-    UsbTransferStatus_t Result;
-    size_t              SectorsToBeWritten;
-    uint8_t             WriteCommand;
+    size_t     SectorsTransferred;
+    OsStatus_t Status;
 
-    // Protect against bad start sector
-    if (SectorStart >= Device->Descriptor.SectorCount) {
-        return OsInvalidParameters;
-    }
+    // Debug
+    TRACE("MsdReadSectors(Sector %u, Count %u, Address 0x%x)",
+        LODWORD(SectorStart), SectorCount, BufferAddress);
 
-    // Of course it's possible that the requester is requesting too much data in one
-    // go, so we will have to clamp some of the values. Is the sector valid first of all?
-    SectorsToBeWritten = SectorCount;
-    if ((SectorStart + SectorsToBeWritten) >= Device->Descriptor.SectorCount) {
-        SectorsToBeWritten = Device->Descriptor.SectorCount - SectorStart;
-    }
-    
-    // Detect limits based on type of device and protocol
-    if (Device->Protocol == ProtocolCB || Device->Protocol == ProtocolCBI) {
-        WriteCommand       = SCSI_WRITE_6;
-		SectorsToBeWritten = MIN(SectorsToBeWritten, UINT8_MAX);
-    }
-    else if (!Device->IsExtended) {
-        WriteCommand       = SCSI_WRITE;
-		SectorsToBeWritten = MIN(SectorsToBeWritten, UINT16_MAX);
-    }
-    else {
-        WriteCommand = SCSI_WRITE_16;
-    }
-    
-    // Update the sectors to be transferred
-    if (SectorsWritten) {
-        *SectorsWritten = SectorsToBeWritten;
+    Status = MsdTransferSectors(Device, 0, SectorStart, 
+        BufferAddress, SectorCount, &SectorsTransferred);
+    if (SectorsRead) {
+        *SectorsRead = SectorsTransferred;
     }
+    return Status;
+}
+
+OsStatus_t
+MsdWriteSectors(
+    _In_  MsdDevice_t* Device,
+    _In_  uint64_t     SectorStart, 
+    _In_  uintptr_t    BufferAddress,
+    _In_  size_t       SectorCount,
+    _Out_ size_t*      SectorsWritten)
+{
+    size_t     SectorsTransferred;
+    OsStatus_t Status;
 
-    // Perform the write command
-    Result = MsdScsiCommand(Device, 1, WriteCommand, SectorStart, 
-        BufferAddress, SectorsToBeWritten * Device->Descriptor.SectorSize);
+    // Debug
+    TRACE("MsdWriteSectors(Sector %u, Count %u, Address 0x%x)",
+        LODWORD(SectorStart), SectorCount, BufferAddress);
 
-    // Convert between usb status to storage operating status
-    if (Result != TransferFinished) {
-        if (SectorsWritten) {
-            *SectorsWritten = 0;
-        }
-        return OsError;
-    }
-    else {
-        if (SectorsWritten && Device->StatusBlock->DataResidue) {
-            // Data residue is in bytes not transferred as it does not seem
-            // required that we transfer in sectors
-            size_t SectorsNotWritten = DIVUP(Device->StatusBlock->DataResidue, 
-                Device->Descriptor.SectorSize);
-            *SectorsWritten -= SectorsNotWritten;
-        }
+    Status = MsdTransferSectors(Device, 1, SectorStart, 
+        BufferAddress, SectorCount, &SectorsTransferred);
+    if (SectorsWritten) {
+        *SectorsWritten = SectorsTransferred;
     }
-    return OsSuccess;
+    return Status;
 }
@@ -28,8 +28,69 @@
 #include <string.h>
 #include <stdlib.h>
 
+#define MSD_SEGMENT_COUNT 16
+
 static Collection_t *GlbMsdDevices = NULL;
 
+/* MsdTransferOperation
+ * Executes the storage operation one buffer segment at the time, as each usb transfer
+ * must be physically contiguous. Every segment must hold a whole number of sectors,
+ * otherwise the operation is rejected with OsInvalidParameters. */
+static OsStatus_t
+MsdTransferOperation(
+    _In_  MsdDevice_t*        Device,
+    _In_  StorageOperation_t* Operation,
+    _Out_ size_t*             SectorsTransferred)
+{
+    DmaSegment_t Segments[MSD_SEGMENT_COUNT];
+    size_t       SectorSize  = Device->Descriptor.SectorSize;
+    uint64_t     Sector      = Operation->AbsoluteSector;
+    size_t       Offset      = Operation->BufferOffset;
+    size_t       SectorsLeft = Operation->SectorCount;
+    OsStatus_t   Status      = OsSuccess;
+    int          SegmentCount;
+    int          i;
+
+    *SectorsTransferred = 0;
+    while (SectorsLeft > 0) {
+        SegmentCount = MSD_SEGMENT_COUNT;
+        Status       = GetBufferSegments(Operation->BufferHandle, Offset, 
+            SectorsLeft * SectorSize, &Segments[0], &SegmentCount);
+        if (Status != OsSuccess) {
+            break;
+        }
+
+        for (i = 0; i < SegmentCount && SectorsLeft > 0; i++) {
+            size_t SectorCount = MIN(SectorsLeft, Segments[i].Length / SectorSize);
+            size_t Transferred = 0;
+
+            // A sector that spans two segments can't be moved by a single transfer, and
+            // skipping the tail of the segment would shift the rest of the data
+            if (SectorCount == 0 || (Segments[i].Length % SectorSize) != 0) {
+                ERROR("MSD: Buffer segment of %u bytes is not a multiple of the sector size %u",
+                    LODWORD(Segments[i].Length), LODWORD(SectorSize));
+                return OsInvalidParameters;
+            }
+
+            if (Operation->Direction == __STORAGE_OPERATION_READ) {
+                Status = MsdReadSectors(Device, Sector, Segments[i].Address, SectorCount, &Transferred);
+            }
+            else {
+                Status = MsdWriteSectors(Device, Sector, Segments[i].Address, SectorCount, &Transferred);
+            }
+
+            *SectorsTransferred += Transferred;
+            SectorsLeft         -= Transferred;
+            Sector              += Transferred;
+            Offset              += Transferred * SectorSize;
+            if (Status != OsSuccess || Transferred != SectorCount) {
+                return Status;
+            }
+        }
+    }
+    return Status;
+}
+
 /* OnInterrupt
  * Is called when one of the registered devices
  * produces an interrupt. On successful handled
@@ -171,13 +232,9 @@ OnQuery(
             }
 
             // Determine the kind of operation
-            if (Operation->Direction == __STORAGE_OPERATION_READ) {
-                Result.Status = MsdReadSectors(Device, Operation->AbsoluteSector, Operation->PhysicalBuffer, 
-                    Operation->SectorCount, &Result.SectorsTransferred);
-            }
-            else if (Operation->Direction == __STORAGE_OPERATION_WRITE) {
-                Result.Status = MsdWriteSectors(Device, Operation->AbsoluteSector, Operation->PhysicalBuffer, 
-                    Operation->SectorCount, &Result.SectorsTransferred);
+            if (Operation->Direction == __STORAGE_OPERATION_READ ||
+                Operation->Direction == __STORAGE_OPERATION_WRITE) {
+                Result.Status = MsdTransferOperation(Device, Operation, &Result.SectorsTransferred);
             }
             return RPCRespond(Address, (void*)&Result, sizeof(StorageOperationResult_t));
         } break;
@@ -33,9 +33,89 @@ static const char *DeviceProtocolStrings[ProtocolCount] = {
     "Unknown",
     "CB",
     "CBI",
-    "Bulk"
+    "Bulk",
+    "UAS"
 };
 
+/* MsdDeviceFindSetting
+ * Finds the interface setting that speaks the given protocol, returns -1 if none. */
+static int
+MsdDeviceFindSetting(
+    _In_ MsdDevice_t* Device,
+    _In_ size_t       Protocol)
+{
+    int i;
+    for (i = 0; i < USB_MAX_VERSIONS; i++) {
+        if (Device->Base.Interface.Versions[i].EndpointCount != 0 &&
+            Device->Base.Interface.Versions[i].Protocol == Protocol) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* MsdDeviceLoadSetting
+ * Finds the endpoints the protocols need among the endpoints of the given setting. */
+static void
+MsdDeviceLoadSetting(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Version)
+{
+    UsbHcInterfaceVersion_t* Setting = &Device->Base.Interface.Versions[Version];
+    int                      First   = MAX(Setting->EndpointIndex, 1);
+    int                      i;
+
+    Device->Interrupt   = NULL;
+    Device->In          = NULL;
+    Device->Out         = NULL;
+    Device->CommandPipe = NULL;
+    Device->StatusPipe  = NULL;
+    for (i = First; i < MIN(First + Setting->EndpointCount, USB_MAX_ENDPOINTS); i++) {
+        if (Device->Base.Endpoints[i].Type == EndpointInterrupt) {
+            Device->Interrupt = &Device->Base.Endpoints[i];
+        }
+        else if (Device->Base.Endpoints[i].Type == EndpointBulk) {
+            // Uas interfaces describe the role of each pipe, the data pipes are
+            // found by their direction like for the other protocols
+            if (Device->Base.Endpoints[i].PipeUsage == MSD_UAS_PIPE_COMMAND) {
+                Device->CommandPipe = &Device->Base.Endpoints[i];
+            }
+            else if (Device->Base.Endpoints[i].PipeUsage == MSD_UAS_PIPE_STATUS) {
+                Device->StatusPipe = &Device->Base.Endpoints[i];
+            }
+            else if (Device->Base.Endpoints[i].Direction == USB_ENDPOINT_IN) {
+                Device->In = &Device->Base.Endpoints[i];
+            }
+            else if (Device->Base.Endpoints[i].Direction == USB_ENDPOINT_OUT) {
+                Device->Out = &Device->Base.Endpoints[i];
+            }
+        }
+    }
+}
+
+/* MsdDeviceSelectDefault
+ * Switches the interface back to the default setting and its bulk-only protocol. */
+static OsStatus_t
+MsdDeviceSelectDefault(
+    _In_ MsdDevice_t* Device)
+{
+    if (Device->Base.Interface.Protocol != MSD_PROTOCOL_BULK_ONLY) {
+        return OsError;
+    }
+    if (UsbExecutePacket(Device->Base.DriverId, Device->Base.DeviceId, 
+            &Device->Base.Device, Device->Control, USBPACKET_DIRECTION_INTERFACE,
+            USBPACKET_TYPE_SET_INTERFACE, 0, 0, 
+            (uint16_t)Device->Base.Interface.Id, 0, NULL) != TransferFinished) {
+        ERROR("Failed to select the default setting");
+        return OsError;
+    }
+    MsdWorkersDestroy(Device);
+    MsdDeviceLoadSetting(Device, 0);
+    Device->Protocol    = ProtocolBulk;
+    Device->UsesStreams = 0;
+    return OsSuccess;
+}
+
 /* MsdDeviceCreate
  * Initializes a new msd-device from the given usb-device */
 MsdDevice_t*
@@ -43,7 +123,7 @@ MsdDeviceCreate(
     _In_ MCoreUsbDevice_t* UsbDevice)
 {
     MsdDevice_t* Device = NULL;
-    int          i;
+    int          Version;
 
     // Debug
     TRACE("MsdDeviceCreate(DeviceId %u)", UsbDevice->Base.Id);
@@ -61,27 +141,36 @@ MsdDeviceCreate(
     memset(Device, 0, sizeof(MsdDevice_t));
     memcpy(&Device->Base, UsbDevice, sizeof(MCoreUsbDevice_t));
     Device->Control = &Device->Base.Endpoints[0];
+    Device->Protocol = ProtocolUnknown;
 
-    // Find neccessary endpoints
-    for (i = 1; i < Device->Base.Interface.Versions[0].EndpointCount + 1; i++) {
-        if (Device->Base.Endpoints[i].Type == EndpointInterrupt) {
-            Device->Interrupt = &Device->Base.Endpoints[i];
+    // Uas is usually an alternate setting of a bulk-only interface, it is used when
+    // the setting has all four pipes and the device accepts the switch
+    Version = MsdDeviceFindSetting(Device, MSD_PROTOCOL_UAS);
+    if (Version != -1) {
+        MsdDeviceLoadSetting(Device, Version);
+        if (Device->CommandPipe != NULL && Device->StatusPipe != NULL && 
+            Device->In != NULL && Device->Out != NULL &&
+            (Version == 0 || UsbExecutePacket(Device->Base.DriverId, Device->Base.DeviceId, 
+                &Device->Base.Device, Device->Control, USBPACKET_DIRECTION_INTERFACE,
+                USBPACKET_TYPE_SET_INTERFACE, 0, (uint8_t)Version, 
+                (uint16_t)Device->Base.Interface.Id, 0, NULL) == TransferFinished)) {
+            Device->Protocol = ProtocolUAS;
         }
-        else if (Device->Base.Endpoints[i].Type == EndpointBulk) {
-            if (Device->Base.Endpoints[i].Direction == USB_ENDPOINT_IN) {
-                Device->In = &Device->Base.Endpoints[i];
-            }
-            else if (Device->Base.Endpoints[i].Direction == USB_ENDPOINT_OUT) {
-                Device->Out = &Device->Base.Endpoints[i];
-            }
+        else {
+            ERROR("Failed to select the uas setting %i, using the default setting", Version);
+            MsdDeviceLoadSetting(Device, 0);
         }
     }
+    else {
+        MsdDeviceLoadSetting(Device, 0);
+    }
 
     // Set initial shared stuff
-    Device->Protocol = ProtocolUnknown;
     Device->AlignedAccess = 0;
     Device->Descriptor.SectorsPerCylinder = 64;
     Device->Descriptor.SectorSize = 512;
+    Device->MaxTransferLength = (Device->Base.Device.Speed == SuperSpeed) ?
+        MSD_MAX_TRANSFER_LENGTH_SS : MSD_MAX_TRANSFER_LENGTH;
     
     // Determine type of msd
     if (Device->Base.Interface.Subclass == MSD_SUBCLASS_FLOPPY) {
@@ -114,10 +203,15 @@ MsdDeviceCreate(
         DeviceTypeStrings[Device->Type],
         DeviceProtocolStrings[Device->Protocol]);
 
-    // Initialize the kind of profile we discovered
+    // Initialize the kind of profile we discovered, a uas setting that turns out to be
+    // unusable leaves the bulk-only default setting to fall back on
     if (MsdDeviceInitialize(Device) != OsSuccess) {
-        ERROR("Failed to initialize the msd-device, missing support.");
-        goto Error;
+        if (Device->Protocol != ProtocolUAS || Version <= 0 ||
+            MsdDeviceSelectDefault(Device) != OsSuccess || 
+            MsdDeviceInitialize(Device) != OsSuccess) {
+            ERROR("Failed to initialize the msd-device, missing support.");
+            goto Error;
+        }
     }
 
     // Allocate reusable buffers
@@ -175,8 +269,8 @@ MsdDeviceDestroy(
         ERROR("Failed to unregister storage with storagemanager");
     }
 
-    // Flush existing requests?
-    // @todo
+    // Stop the workers, commands are only queued while a request is executed
+    MsdWorkersDestroy(Device);
 
     // Free reusable buffers
     if (Device->CommandBlock != NULL) {
@@ -185,6 +279,12 @@ MsdDeviceDestroy(
     if (Device->StatusBlock != NULL) {
         BufferPoolFree(UsbRetrievePool(), (uintptr_t*)Device->StatusBlock);
     }
+    if (Device->UasCommand != NULL) {
+        BufferPoolFree(UsbRetrievePool(), (uintptr_t*)Device->UasCommand);
+    }
+    if (Device->UasStatus != NULL) {
+        BufferPoolFree(UsbRetrievePool(), (uintptr_t*)Device->UasStatus);
+    }
 
     // Free data allocated
     free(Device);
@@ -30,6 +30,7 @@
 #include <ddk/contracts/usbdevice.h>
 #include <ddk/contracts/storage.h>
 #include <ddk/services/file.h>
+#include <threads.h>
 
 /* MSD Subclass Definitions 
  * Contains generic magic constants and definitions */
@@ -57,6 +58,19 @@
 
 #define MSD_TAG_SIGNATURE		        0xB00B1E00
 
+/* MSD Transfer Definitions
+ * The largest amount of data moved by a single command, larger requests are split
+ * into several commands. Superspeed devices burst and are given larger commands */
+#define MSD_MAX_TRANSFER_LENGTH         0x20000
+#define MSD_MAX_TRANSFER_LENGTH_SS      0x100000
+
+/* MSD Queue Definitions
+ * Bulk-only devices process one command at a time and the CSW of a command must be
+ * read before the next CBW is sent. Uas devices keep several tagged commands in flight. */
+#define MSD_UAS_QUEUE_DEPTH             4
+#define MSD_COMMAND_BATCH               16
+#define MSD_WORKER_COUNT                (1 + (2 * MSD_UAS_QUEUE_DEPTH))
+
 PACKED_TYPESTRUCT(MsdCommandBlock, {
 	uint32_t Signature; //Must Contain 0x43425355 (little-endian)
 	uint32_t Tag;
@@ -105,6 +119,69 @@ PACKED_TYPESTRUCT(MsdCommandStatus, {
 #define MSD_CSW_FAIL			        0x1
 #define MSD_CSW_PHASE_ERROR		        0x2
 
+/* UAS Pipe Usage Definitions
+ * Contains the pipe ids of the uas pipe usage descriptors */
+#define MSD_UAS_PIPE_COMMAND            0x01
+#define MSD_UAS_PIPE_STATUS             0x02
+#define MSD_UAS_PIPE_DATA_IN            0x03
+#define MSD_UAS_PIPE_DATA_OUT           0x04
+
+/* UAS Information Unit Definitions
+ * Contains the ids of the information units exchanged on the uas pipes */
+#define MSD_UAS_IU_COMMAND              0x01
+#define MSD_UAS_IU_SENSE                0x03
+#define MSD_UAS_IU_RESPONSE             0x04
+#define MSD_UAS_IU_TASK_MANAGEMENT      0x05
+#define MSD_UAS_IU_READ_READY           0x06
+#define MSD_UAS_IU_WRITE_READY          0x07
+
+/* UAS Task Management Definitions
+ * Contains the task management functions and the response codes */
+#define MSD_UAS_TM_ABORT_TASK           0x01
+#define MSD_UAS_TM_LOGICAL_UNIT_RESET   0x08
+#define MSD_UAS_RC_TM_COMPLETE          0x00
+#define MSD_UAS_RC_TM_SUCCEEDED         0x08
+
+/* Tags double as stream ids on superspeed devices, stream 0 is reserved. Commands
+ * that make no progress for MSD_UAS_TASK_TIMEOUT milliseconds are aborted */
+#define MSD_UAS_MAX_TAG                 15
+#define MSD_UAS_TASK_TIMEOUT            10000
+
+PACKED_TYPESTRUCT(MsdUasCommand, {
+	uint8_t  Id;
+	uint8_t  Reserved0;
+	uint16_t Tag;               // Big-endian
+	uint8_t  Attributes;        // Bits 0-2 task attribute, bits 3-6 priority
+	uint8_t  Reserved1;
+	uint8_t  AdditionalLength;  // Bits 2-7, in dwords beyond the 16 command bytes
+	uint8_t  Reserved2;
+	uint8_t  Lun[8];
+	uint8_t  CommandBytes[16];
+});
+
+PACKED_TYPESTRUCT(MsdUasTaskManagement, {
+	uint8_t  Id;
+	uint8_t  Reserved0;
+	uint16_t Tag;               // Big-endian
+	uint8_t  Function;
+	uint8_t  Reserved1;
+	uint16_t TaskTag;           // Big-endian, the tag of the command to abort
+	uint8_t  Lun[8];
+});
+
+// The sense, response and ready units share the header, the ready units end after the tag
+PACKED_TYPESTRUCT(MsdUasStatus, {
+	uint8_t  Id;
+	uint8_t  Reserved0;
+	uint16_t Tag;               // Big-endian
+	uint16_t StatusQualifier;   // Response unit: additional response information
+	uint8_t  Status;
+	uint8_t  ResponseCode;      // Response unit only
+	uint8_t  Reserved1[6];
+	uint16_t SenseLength;       // Big-endian
+	uint8_t  SenseData[18];
+});
+
 typedef enum _MsdDeviceType {
     TypeFloppy,
 	TypeDiskDrive,
@@ -117,16 +194,61 @@ typedef enum _MsdProtocolType {
     ProtocolCB,
 	ProtocolCBI,
 	ProtocolBulk,
+    ProtocolUAS,
     ProtocolCount
 } MsdProtocolType_t;
 
 typedef struct _MsdDevice MsdDevice_t;
+
+/* MsdCommand
+ * A scsi command with its data stage. Protocols that queue commands execute a list
+ * of these and report the status and residue of each. */
+typedef struct _MsdCommand {
+    int                 Direction;
+    uint8_t             ScsiCommand;
+    uint64_t            SectorStart;
+    uintptr_t           DataAddress;
+    size_t              DataLength;
+    size_t              Residue;
+    UsbTransferStatus_t Status;
+} MsdCommand_t;
+
+/* MsdStage
+ * A transfer that is executed by one of the device workers. */
+#define MSD_STAGE_IDLE                  0
+#define MSD_STAGE_QUEUED                1
+#define MSD_STAGE_RUNNING               2
+#define MSD_STAGE_DONE                  3
+
+typedef struct _MsdWorker MsdWorker_t;
+typedef struct _MsdStage {
+    UsbTransfer_t       Transfer;
+    UsbTransferResult_t Result;
+    int                 State;
+    MsdWorker_t*        Worker;
+    struct _MsdStage*   Link;
+} MsdStage_t;
+
+/* MsdWorker
+ * Executes the stages given to it in order, one at a time. A stage that fails halts
+ * the worker until it is resumed, so stages queued behind it are not started
+ * before the failure has been handled. */
+struct _MsdWorker {
+    MsdDevice_t*        Device;
+    thrd_t              Thread;
+    MsdStage_t*         Head;
+    MsdStage_t*         Tail;
+    int                 Halted;
+    int                 Running;
+};
+
 typedef struct _MsdOperations {
     OsStatus_t          (*Initialize)(MsdDevice_t*);
     UsbTransferStatus_t (*SendCommand)(MsdDevice_t*, uint8_t ScsiCommand, uint64_t SectorStart, uintptr_t DataAddress, size_t DataLength);
     UsbTransferStatus_t (*ReadData)(MsdDevice_t*, uintptr_t DataAddress, size_t DataLength, size_t* BytesRead);
     UsbTransferStatus_t (*WriteData)(MsdDevice_t*, uintptr_t DataAddress, size_t DataLength, size_t* BytesWritten);
     UsbTransferStatus_t (*GetStatus)(MsdDevice_t*);
+    UsbTransferStatus_t (*ExecuteCommands)(MsdDevice_t*, MsdCommand_t* Commands, int Count);
 } MsdOperations_t;
 
 typedef struct _MsdDevice {
@@ -140,18 +262,37 @@ typedef struct _MsdDevice {
 	int IsReady;
 	int IsExtended;
     int AlignedAccess;
+    int UsesStreams;
+    size_t   MaxTransferLength;
+    uint32_t Tag;
+
+    // Workers, all stages are synchronized by the stage lock
+    mtx_t               StageLock;
+    cnd_t               StageSignal;
+    size_t              StageCompletions;
+    MsdWorker_t         Workers[MSD_WORKER_COUNT];
+    int                 WorkerCount;
 
-    // Reusable buffers
+    // Reusable buffers, the uas buffers hold one unit per queued command
     MsdCommandBlock_t*  CommandBlock;
     uintptr_t           CommandBlockAddress;
     MsdCommandStatus_t* StatusBlock;
     uintptr_t           StatusBlockAddress;
+    MsdUasCommand_t*    UasCommand;
+    uintptr_t           UasCommandAddress;
+    MsdUasStatus_t*     UasStatus;
+    uintptr_t           UasStatusAddress;
+    int                 UasQueueDepth;
     
     // CBI Information
     UsbHcEndpointDescriptor_t* Control;
     UsbHcEndpointDescriptor_t* In;
 	UsbHcEndpointDescriptor_t* Out;
 	UsbHcEndpointDescriptor_t* Interrupt;
+
+    // UAS Information, the data pipes are In and Out
+    UsbHcEndpointDescriptor_t* CommandPipe;
+    UsbHcEndpointDescriptor_t* StatusPipe;
 } MsdDevice_t;
 
 /* MsdDeviceCreate
@@ -181,6 +322,65 @@ __EXTERN OsStatus_t
 MsdDeviceStart(
     _In_ MsdDevice_t *Device);
 
+/* MsdWorkersCreate
+ * Starts the given number of workers for the device. */
+__EXTERN OsStatus_t
+MsdWorkersCreate(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Count);
+
+/* MsdWorkersDestroy
+ * Stops all workers of the device, stages that were never started are cancelled. */
+__EXTERN void
+MsdWorkersDestroy(
+    _In_ MsdDevice_t* Device);
+
+/* MsdWorkerResume
+ * Resumes a worker that was halted by a failed stage. */
+__EXTERN void
+MsdWorkerResume(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Worker);
+
+/* MsdStageSubmit
+ * Queues the stage on the given worker, the transfer of the stage must be initialized. */
+__EXTERN void
+MsdStageSubmit(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Worker,
+    _In_ MsdStage_t*  Stage);
+
+/* MsdStageWait
+ * Waits for the stage to complete and returns the status of its transfer. */
+__EXTERN UsbTransferStatus_t
+MsdStageWait(
+    _In_ MsdDevice_t* Device,
+    _In_ MsdStage_t*  Stage);
+
+/* MsdStageIsDone
+ * Returns 1 when the stage has completed, its result may then be read without the lock. */
+__EXTERN int
+MsdStageIsDone(
+    _In_ MsdDevice_t* Device,
+    _In_ MsdStage_t*  Stage);
+
+/* MsdStageWaitAny
+ * Waits for any stage of the device to complete after <Completions> was read. Returns
+ * OsTimeout if nothing completed within <Timeout> milliseconds. */
+__EXTERN OsStatus_t
+MsdStageWaitAny(
+    _In_    MsdDevice_t* Device,
+    _InOut_ size_t*      Completions,
+    _In_    size_t       Timeout);
+
+/* MsdStageCancel
+ * Cancels a stage that has not completed and waits for it. Returns the status of the
+ * stage, which is TransferCancelled unless it completed before it could be cancelled. */
+__EXTERN UsbTransferStatus_t
+MsdStageCancel(
+    _In_ MsdDevice_t* Device,
+    _In_ MsdStage_t*  Stage);
+
 /* MsdReadSectors
  * Read a given amount of sectors (bytes/sector-size) from the MSD. */
 __EXTERN OsStatus_t
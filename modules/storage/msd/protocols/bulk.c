@@ -26,6 +26,9 @@
 #define BULK_RESET_OUT  0x4
 #define BULK_RESET_ALL  (BULK_RESET | BULK_RESET_IN | BULK_RESET_OUT)
 
+#define BULK_WORKER_OUT 0
+#define BULK_WORKER_IN  1
+
 #include <ddk/services/usb.h>
 #include <ddk/utils.h>
 #include "../msd.h"
@@ -363,6 +366,22 @@ BulkScsiCommandConstruct(
     }
 }
 
+/* BulkPrepareCommand
+ * Builds the CBW in the command buffer, each command is given its own tag so a
+ * status left over from an earlier command is never mistaken for the current. */
+static void
+BulkPrepareCommand(
+    _In_ MsdDevice_t* Device,
+    _In_ uint8_t      ScsiCommand,
+    _In_ uint64_t     SectorStart,
+    _In_ size_t       DataLength)
+{
+    MsdCommandBlock_t* CommandBlock = Device->CommandBlock;
+    BulkScsiCommandConstruct(CommandBlock, ScsiCommand, SectorStart, 
+        DataLength, (uint16_t)Device->Descriptor.SectorSize);
+    CommandBlock->Tag = MSD_TAG_SIGNATURE | (Device->Tag++ & 0xFF);
+}
+
 /* BulkInitialize 
  * Validates the available endpoints and initializes the device. */
 OsStatus_t
@@ -393,17 +412,20 @@ BulkInitialize(
         return OsError;
     }
 
-    // Done
-    return OsSuccess;
+    // The outgoing and incoming stages of the queued commands run side by side
+    return MsdWorkersCreate(Device, 2);
 }
 
 /* MsdSanitizeResponse
  * Used for making sure the CSW we get back is valid */
 UsbTransferStatus_t
 MsdSanitizeResponse(
-    _In_ MsdDevice_t *Device, 
-    _In_ MsdCommandStatus_t *Csw)
+    _In_ MsdDevice_t*        Device, 
+    _In_ MsdCommandStatus_t* Csw,
+    _In_ uint32_t            Tag)
 {
+    _CRT_UNUSED(Device);
+
     // Check for phase errors
     if (Csw->Status == MSD_CSW_PHASE_ERROR) {
         ERROR("Phase error returned in CSW.");
@@ -416,8 +438,8 @@ MsdSanitizeResponse(
         return TransferInvalid;
     }
     
-    // Sanitize tag/data integrity
-    if ((Csw->Tag & 0xFFFFFF00) != MSD_TAG_SIGNATURE) {
+    // Sanitize tag/data integrity, the status must belong to the command
+    if (Csw->Tag != Tag) {
         ERROR("CSW: Tag is invalid: 0x%x", Csw->Tag);
         return TransferInvalid;
     }
@@ -451,8 +473,7 @@ BulkSendCommand(
         ScsiCommand, LODWORD(SectorStart), DataLength);
 
     // Construct our command build the usb transfer
-    BulkScsiCommandConstruct(Device->CommandBlock, ScsiCommand, SectorStart, 
-        DataLength, (uint16_t)Device->Descriptor.SectorSize);
+    BulkPrepareCommand(Device, ScsiCommand, SectorStart, DataLength);
     UsbTransferInitialize(&CommandStage, &Device->Base.Device, 
         Device->Out, BulkTransfer, 0);
     UsbTransferOut(&CommandStage, Device->CommandBlockAddress, 
@@ -551,19 +572,16 @@ BulkWriteData(
     return Result.Status;
 }
 
-/* BulkGetStatus
- * Tries to retrieve a command-status response from the device. 
- * This will be retried up to MSD_CSW_RETRIES count. */
-UsbTransferStatus_t 
-BulkGetStatus(
-    _In_ MsdDevice_t *Device)
+/* BulkReadStatus
+ * Tries to retrieve the command-status response of the current command. */
+static UsbTransferStatus_t 
+BulkReadStatus(
+    _In_ MsdDevice_t* Device)
 {
-    // Variables
-    UsbTransferResult_t Result  = { 0 };
-    UsbTransfer_t StatusStage   = { 0 };
+    UsbTransferResult_t Result      = { 0 };
+    UsbTransfer_t       StatusStage = { 0 };
 
-    // Debug
-    TRACE("BulkGetStatus()");
+    TRACE("BulkReadStatus()");
 
     // Perform the transfer
     UsbTransferInitialize(&StatusStage, &Device->Base.Device, 
@@ -580,21 +598,194 @@ BulkGetStatus(
     if (Result.Status != TransferFinished) {
         if (Result.Status == TransferStalled) {
             BulkResetRecovery(Device, BULK_RESET_IN);
-            return BulkGetStatus(Device);
+            return BulkReadStatus(Device);
         }
         else {
             ERROR("Failed to retrieve the CSW block, transfer-code %u", Result.Status);
         }
     }
-    else {        
-        // If the host receives a CSW which is not valid, 
-        // then the host shall perform a Reset Recovery. If the host receives
-        // a CSW which is not meaningful, then the host may perform a Reset Recovery.
-        Result.Status = MsdSanitizeResponse(Device, Device->StatusBlock);
-    }
     return Result.Status;
 }
 
+/* BulkGetStatus
+ * Tries to retrieve a command-status response from the device. */
+UsbTransferStatus_t 
+BulkGetStatus(
+    _In_ MsdDevice_t *Device)
+{
+    UsbTransferStatus_t Status = BulkReadStatus(Device);
+
+    // If the host receives a CSW which is not valid, 
+    // then the host shall perform a Reset Recovery. If the host receives
+    // a CSW which is not meaningful, then the host may perform a Reset Recovery.
+    if (Status == TransferFinished) {
+        Status = MsdSanitizeResponse(Device, Device->StatusBlock, Device->CommandBlock->Tag);
+    }
+    return Status;
+}
+
+/* BulkSlot
+ * A command and its stages. The outgoing stage carries the CBW and the data when
+ * writing, the incoming stage the data when reading and the CSW. */
+typedef struct _BulkSlot {
+    MsdCommand_t* Command;
+    MsdStage_t    Out;
+    MsdStage_t    In;
+} BulkSlot_t;
+
+/* BulkQueueCommand
+ * Queues both stages of the command, the incoming stage is waiting on the in pipe by
+ * the time the device has accepted the CBW. */
+static void
+BulkQueueCommand(
+    _In_ MsdDevice_t*  Device,
+    _In_ BulkSlot_t*   Slot,
+    _In_ MsdCommand_t* Command)
+{
+    Slot->Command = Command;
+
+    BulkPrepareCommand(Device, Command->ScsiCommand, Command->SectorStart, Command->DataLength);
+    UsbTransferInitialize(&Slot->Out.Transfer, &Device->Base.Device, 
+        Device->Out, BulkTransfer, 0);
+    UsbTransferOut(&Slot->Out.Transfer, Device->CommandBlockAddress, sizeof(MsdCommandBlock_t), 0);
+    if (Command->Direction == 1 && Command->DataLength != 0) {
+        UsbTransferOut(&Slot->Out.Transfer, Command->DataAddress, Command->DataLength, 0);
+    }
+
+    Device->StatusBlock->Signature = 0;
+    UsbTransferInitialize(&Slot->In.Transfer, &Device->Base.Device, 
+        Device->In, BulkTransfer, 0);
+    if (Command->Direction == 0 && Command->DataLength != 0) {
+        UsbTransferIn(&Slot->In.Transfer, Command->DataAddress, Command->DataLength, 0);
+    }
+    UsbTransferIn(&Slot->In.Transfer, Device->StatusBlockAddress, sizeof(MsdCommandStatus_t), 0);
+
+    MsdStageSubmit(Device, BULK_WORKER_IN, &Slot->In);
+    MsdStageSubmit(Device, BULK_WORKER_OUT, &Slot->Out);
+}
+
+/* BulkAbortCommand
+ * Cancels the stages that are still pending and performs a reset recovery. */
+static void
+BulkAbortCommand(
+    _In_ MsdDevice_t* Device,
+    _In_ BulkSlot_t*  Slot)
+{
+    MsdStageCancel(Device, &Slot->Out);
+    MsdStageCancel(Device, &Slot->In);
+    if (BulkResetRecovery(Device, BULK_RESET_ALL) != OsSuccess) {
+        ERROR("Failed to reset device, it is now unusable.");
+    }
+    MsdWorkerResume(Device, BULK_WORKER_OUT);
+    MsdWorkerResume(Device, BULK_WORKER_IN);
+}
+
+/* BulkCompleteCommand
+ * Waits for the stages of the command and validates the CSW. A short data stage
+ * ends the incoming transfer before the CSW, which is then read on its own. */
+static UsbTransferStatus_t
+BulkCompleteCommand(
+    _In_ MsdDevice_t* Device,
+    _In_ BulkSlot_t*  Slot)
+{
+    MsdCommand_t*       Command          = Slot->Command;
+    MsdCommandStatus_t* Csw              = Device->StatusBlock;
+    uint32_t            Tag              = Device->CommandBlock->Tag;
+    size_t              BytesTransferred = 0;
+    UsbTransferStatus_t Status;
+
+    Status = MsdStageWait(Device, &Slot->Out);
+    if (Status != TransferFinished) {
+        // A stall after the CBW went through is the device refusing the data, the
+        // pipe is cleared and the CSW tells why. Anything else is fatal for the command
+        if (Status != TransferStalled || Command->Direction != 1 || 
+            Slot->Out.Result.BytesTransferred < sizeof(MsdCommandBlock_t)) {
+            ERROR("Failed to send the CBW command, transfer-code %u", Status);
+            BulkAbortCommand(Device, Slot);
+            return Status;
+        }
+        BulkResetRecovery(Device, BULK_RESET_OUT);
+        MsdWorkerResume(Device, BULK_WORKER_OUT);
+    }
+    if (Command->Direction == 1 && Slot->Out.Result.BytesTransferred > sizeof(MsdCommandBlock_t)) {
+        BytesTransferred = Slot->Out.Result.BytesTransferred - sizeof(MsdCommandBlock_t);
+    }
+
+    Status = MsdStageWait(Device, &Slot->In);
+    if (Status != TransferFinished && Status != TransferStalled) {
+        ERROR("Data-stage failed with status %u, cleaning up bulk-in", Status);
+        BulkAbortCommand(Device, Slot);
+        return Status;
+    }
+
+    // The host shall clear the Bulk-In pipe and then attempt to receive the CSW
+    if (Status == TransferStalled) {
+        BulkResetRecovery(Device, BULK_RESET_IN);
+        MsdWorkerResume(Device, BULK_WORKER_IN);
+    }
+
+    if (Csw->Signature == MSD_CSW_OK_SIGNATURE && Csw->Tag == Tag &&
+        Slot->In.Result.BytesTransferred >= sizeof(MsdCommandStatus_t)) {
+        if (Command->Direction == 0) {
+            BytesTransferred = Slot->In.Result.BytesTransferred - sizeof(MsdCommandStatus_t);
+        }
+    }
+    else {
+        if (Command->Direction == 0) {
+            BytesTransferred = MIN(Slot->In.Result.BytesTransferred, Command->DataLength);
+        }
+        Status = BulkReadStatus(Device);
+        if (Status != TransferFinished) {
+            BulkAbortCommand(Device, Slot);
+            return Status;
+        }
+    }
+
+    // If the host receives a CSW which is not valid, then the host shall perform a
+    // Reset Recovery. A failed command leaves the device in step with the host
+    Status = MsdSanitizeResponse(Device, Csw, Tag);
+    if (Status != TransferFinished) {
+        if (Csw->Status != MSD_CSW_FAIL || Csw->Signature != MSD_CSW_OK_SIGNATURE || Csw->Tag != Tag) {
+            BulkAbortCommand(Device, Slot);
+        }
+        return Status;
+    }
+
+    // Prefer the residue reported by the device, it knows what it did not process
+    Command->Residue = MAX((size_t)Csw->DataResidue, 
+        Command->DataLength - MIN(BytesTransferred, Command->DataLength));
+    return TransferFinished;
+}
+
+/* BulkExecuteCommands
+ * Executes the commands in order. The bulk-only transport requires the CSW of a command
+ * to be read before the next CBW is sent, so each command is completed before the next
+ * is queued. Nothing new is queued once a command has failed. */
+UsbTransferStatus_t
+BulkExecuteCommands(
+    _In_ MsdDevice_t*  Device,
+    _In_ MsdCommand_t* Commands,
+    _In_ int           Count)
+{
+    BulkSlot_t          Slot;
+    UsbTransferStatus_t Status = TransferFinished;
+    int                 i;
+
+    TRACE("BulkExecuteCommands(Count %i)", Count);
+
+    for (i = 0; i < Count; i++) {
+        Commands[i].Status  = TransferNotProcessed;
+        Commands[i].Residue = 0;
+    }
+
+    for (i = 0; i < Count && Status == TransferFinished; i++) {
+        BulkQueueCommand(Device, &Slot, &Commands[i]);
+        Commands[i].Status = BulkCompleteCommand(Device, &Slot);
+        Status             = Commands[i].Status;
+    }
+    return Status;
+}
+
 /* Global 
  * - Static function table */
 MsdOperations_t BulkOperations = {
@@ -602,5 +793,6 @@ MsdOperations_t BulkOperations = {
     BulkSendCommand,
     BulkReadData,
     BulkWriteData,
-    BulkGetStatus
+    BulkGetStatus,
+    BulkExecuteCommands
 };
@@ -0,0 +1,596 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - Mass Storage Device Driver (Generic)
+ *  - USB Attached SCSI Protocol Implementation
+ */
+//#define __TRACE
+
+#include <ddk/services/usb.h>
+#include <ddk/utils.h>
+#include "../msd.h"
+
+// The command pipe is shared by all commands. Without streams the device tells on
+// the status pipe which command may move its data, so one worker per pipe is enough.
+// With streams every command moves its data and status on its own stream
+#define UAS_WORKER_COMMAND          0
+#define UAS_WORKER_STATUS           1
+#define UAS_WORKER_IN               2
+#define UAS_WORKER_OUT              3
+#define UAS_WORKER_STREAM_STATUS(i) (1 + (2 * (i)))
+#define UAS_WORKER_STREAM_DATA(i)   (2 + (2 * (i)))
+
+// Information units are big-endian
+#define UAS_SWAP16(Value)   ((uint16_t)((((Value) & 0xFF) << 8) | (((Value) >> 8) & 0xFF)))
+
+extern const char* SenseKeys[];
+extern void BulkScsiCommandConstruct(MsdCommandBlock_t*, uint8_t, uint64_t, uint32_t, uint16_t);
+
+/* UasClearPipe
+ * Clears a stall condition on one of the pipes and resets its toggles. */
+static void
+UasClearPipe(
+    _In_ MsdDevice_t*               Device,
+    _In_ UsbHcEndpointDescriptor_t* Pipe)
+{
+    if (UsbClearFeature(Device->Base.DriverId, Device->Base.DeviceId,
+        &Device->Base.Device, Device->Control, USBPACKET_DIRECTION_ENDPOINT,
+        Pipe->Address, USB_FEATURE_HALT) != TransferFinished) {
+        ERROR("Failed to clear STALL on endpoint %u", Pipe->Address);
+    }
+    if (UsbEndpointReset(Device->Base.DriverId, Device->Base.DeviceId,
+        &Device->Base.Device, Pipe) != OsSuccess) {
+        ERROR("Failed to reset endpoint %u", Pipe->Address);
+    }
+}
+
+
+/* UasSlot
+ * A command in flight and its stages. The tag of the slot is its index plus one,
+ * the tag after the last slot is used for task management. */
+typedef struct _UasSlot {
+    MsdCommand_t*       Command;
+    uint16_t            Tag;
+    int                 Active;
+    int                 DataQueued;
+    int                 StatusDone;
+    size_t              BytesTransferred;
+    UsbTransferStatus_t Status;
+    MsdStage_t          CommandStage;
+    MsdStage_t          DataStage;
+    MsdStage_t          StatusStage;
+} UasSlot_t;
+
+/* UasPrepareStage
+ * Initializes the transfer of a stage on one of the pipes. The stages of a command
+ * are moved on the stream of the command when the device uses streams. */
+static void
+UasPrepareStage(
+    _In_ MsdDevice_t*               Device,
+    _In_ MsdStage_t*                Stage,
+    _In_ UsbHcEndpointDescriptor_t* Pipe,
+    _In_ int                        Direction,
+    _In_ uintptr_t                  Address,
+    _In_ size_t                     Length,
+    _In_ uint16_t                   Tag)
+{
+    UsbTransferInitialize(&Stage->Transfer, &Device->Base.Device, Pipe, BulkTransfer, 0);
+    if (Device->UsesStreams && Pipe != Device->CommandPipe) {
+        Stage->Transfer.StreamId = Tag;
+    }
+    if (Direction == 0) {
+        UsbTransferIn(&Stage->Transfer, Address, Length, 0);
+    }
+    else {
+        UsbTransferOut(&Stage->Transfer, Address, Length, 0);
+    }
+}
+
+/* UasStageFailed
+ * Handles a stage that did not finish. A stalled pipe is cleared, the worker of the
+ * stage was halted by the failure and is resumed. */
+static void
+UasStageFailed(
+    _In_ MsdDevice_t*               Device,
+    _In_ MsdStage_t*                Stage,
+    _In_ UsbHcEndpointDescriptor_t* Pipe,
+    _In_ int                        Worker)
+{
+    if (Stage->Result.Status == TransferStalled) {
+        UasClearPipe(Device, Pipe);
+    }
+    MsdWorkerResume(Device, Worker);
+}
+
+/* UasStatusAddress
+ * Retrieves the physical address of one of the status information unit buffers. */
+static uintptr_t
+UasStatusAddress(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Index)
+{
+    return Device->UasStatusAddress + (Index * sizeof(MsdUasStatus_t));
+}
+
+/* UasInitialize
+ * Validates the available pipes and initializes the device. */
+OsStatus_t
+UasInitialize(
+    _In_ MsdDevice_t *Device)
+{
+    UsbHcEndpointDescriptor_t* Pipes[4];
+    size_t                     Limit = MSD_UAS_MAX_TAG;
+    int                        i;
+
+    if (Device->CommandPipe == NULL || Device->StatusPipe == NULL ||
+        Device->In == NULL || Device->Out == NULL) {
+        ERROR("One or more of the uas pipes are not available on device");
+        return OsError;
+    }
+
+    // Superspeed devices move the data and status of each command on a stream, the
+    // tags are the stream ids. One stream is kept for task management
+    if (Device->Base.Device.Speed == SuperSpeed) {
+        Limit = MIN(Limit, Device->StatusPipe->MaxStreams - 1);
+        Limit = MIN(Limit, Device->In->MaxStreams - 1);
+        Limit = MIN(Limit, Device->Out->MaxStreams - 1);
+        if (Device->StatusPipe->MaxStreams < 3 || Device->In->MaxStreams < 3 ||
+            Device->Out->MaxStreams < 3) {
+            ERROR("Superspeed uas device does not support enough streams");
+            return OsError;
+        }
+        Device->UsesStreams = 1;
+    }
+    Device->UasQueueDepth = (int)MIN(MSD_UAS_QUEUE_DEPTH, Limit - 1);
+
+    // Reset data toggles for all pipes
+    Pipes[0] = Device->CommandPipe;
+    Pipes[1] = Device->StatusPipe;
+    Pipes[2] = Device->In;
+    Pipes[3] = Device->Out;
+    for (i = 0; i < 4; i++) {
+        if (UsbEndpointReset(Device->Base.DriverId, Device->Base.DeviceId,
+            &Device->Base.Device, Pipes[i]) != OsSuccess) {
+            ERROR("Failed to reset endpoint %u", Pipes[i]->Address);
+            return OsError;
+        }
+    }
+
+    // Allocate the information unit buffers, one per slot and one for task management
+    if (BufferPoolAllocate(UsbRetrievePool(), sizeof(MsdUasCommand_t) * (Device->UasQueueDepth + 1),
+        (uintptr_t**)&Device->UasCommand, &Device->UasCommandAddress) != OsSuccess) {
+        ERROR("Failed to allocate reusable buffer (command-iu)");
+        return OsError;
+    }
+    if (BufferPoolAllocate(UsbRetrievePool(), sizeof(MsdUasStatus_t) * (Device->UasQueueDepth + 1),
+        (uintptr_t**)&Device->UasStatus, &Device->UasStatusAddress) != OsSuccess) {
+        ERROR("Failed to allocate reusable buffer (status-iu)");
+        return OsError;
+    }
+    return MsdWorkersCreate(Device, Device->UsesStreams ? 
+        UAS_WORKER_STREAM_DATA(Device->UasQueueDepth - 1) + 1 : UAS_WORKER_OUT + 1);
+}
+
+/* UasTaskManagement
+ * Sends a task management unit and reads the response for it. The commands that
+ * are targeted must no longer have any stages pending on the host. */
+static OsStatus_t
+UasTaskManagement(
+    _In_ MsdDevice_t* Device,
+    _In_ uint8_t      Function,
+    _In_ uint16_t     TaskTag)
+{
+    MsdUasTaskManagement_t* Iu       = (MsdUasTaskManagement_t*)&Device->UasCommand[Device->UasQueueDepth];
+    MsdUasStatus_t*         Response = &Device->UasStatus[Device->UasQueueDepth];
+    uint16_t                Tag      = (uint16_t)(Device->UasQueueDepth + 1);
+    int                     Worker   = Device->UsesStreams ? 
+        UAS_WORKER_STREAM_STATUS(0) : UAS_WORKER_STATUS;
+    MsdStage_t              CommandStage;
+    MsdStage_t              StatusStage;
+    size_t                  Completions;
+    int                     Attempts;
+
+    TRACE("UasTaskManagement(Function 0x%x, Task %u)", Function, TaskTag);
+
+    memset((void*)Iu, 0, sizeof(MsdUasTaskManagement_t));
+    Iu->Id       = MSD_UAS_IU_TASK_MANAGEMENT;
+    Iu->Tag      = UAS_SWAP16(Tag);
+    Iu->Function = Function;
+    Iu->TaskTag  = UAS_SWAP16(TaskTag);
+
+    mtx_lock(&Device->StageLock);
+    Completions = Device->StageCompletions;
+    mtx_unlock(&Device->StageLock);
+
+    // Units of the aborted commands may still be on the status pipe, those are skipped
+    for (Attempts = 0; Attempts <= Device->UasQueueDepth; Attempts++) {
+        Response->Id = 0;
+        UasPrepareStage(Device, &StatusStage, Device->StatusPipe, 0,
+            UasStatusAddress(Device, Device->UasQueueDepth), sizeof(MsdUasStatus_t), Tag);
+        MsdStageSubmit(Device, Worker, &StatusStage);
+        if (Attempts == 0) {
+            UasPrepareStage(Device, &CommandStage, Device->CommandPipe, 1,
+                Device->UasCommandAddress + (Device->UasQueueDepth * sizeof(MsdUasCommand_t)),
+                sizeof(MsdUasTaskManagement_t), Tag);
+            MsdStageSubmit(Device, UAS_WORKER_COMMAND, &CommandStage);
+            if (MsdStageWait(Device, &CommandStage) != TransferFinished) {
+                ERROR("Failed to send the task management unit, transfer-code %u",
+                    CommandStage.Result.Status);
+                UasStageFailed(Device, &CommandStage, Device->CommandPipe, UAS_WORKER_COMMAND);
+                MsdStageCancel(Device, &StatusStage);
+                return OsError;
+            }
+        }
+
+        while (!MsdStageIsDone(Device, &StatusStage)) {
+            if (MsdStageWaitAny(Device, &Completions, MSD_UAS_TASK_TIMEOUT) == OsTimeout) {
+                MsdStageCancel(Device, &StatusStage);
+                break;
+            }
+        }
+        if (StatusStage.Result.Status != TransferFinished) {
+            ERROR("Failed to read the task management response, transfer-code %u",
+                StatusStage.Result.Status);
+            UasStageFailed(Device, &StatusStage, Device->StatusPipe, Worker);
+            return OsError;
+        }
+        if (UAS_SWAP16(Response->Tag) == Tag) {
+            break;
+        }
+    }
+
+    if (Response->Id != MSD_UAS_IU_RESPONSE || UAS_SWAP16(Response->Tag) != Tag ||
+        (Response->ResponseCode != MSD_UAS_RC_TM_COMPLETE && 
+         Response->ResponseCode != MSD_UAS_RC_TM_SUCCEEDED)) {
+        ERROR("Task management function 0x%x failed, unit 0x%x response code 0x%x",
+            Function, Response->Id, Response->ResponseCode);
+        return OsError;
+    }
+    return OsSuccess;
+}
+
+/* UasAbortCommands
+ * Cancels every stage of the commands in flight, and then aborts the commands on the
+ * device. The logical unit is reset if a command can not be aborted. */
+static void
+UasAbortCommands(
+    _In_ MsdDevice_t* Device,
+    _In_ UasSlot_t*   Slots,
+    _In_ MsdStage_t*  SharedStatus)
+{
+    int i;
+
+    for (i = 0; i < Device->UasQueueDepth; i++) {
+        if (Slots[i].Active) {
+            MsdStageCancel(Device, &Slots[i].CommandStage);
+            MsdStageCancel(Device, &Slots[i].DataStage);
+            MsdStageCancel(Device, &Slots[i].StatusStage);
+        }
+    }
+    MsdStageCancel(Device, SharedStatus);
+    for (i = 0; i < Device->WorkerCount; i++) {
+        MsdWorkerResume(Device, i);
+    }
+
+    for (i = 0; i < Device->UasQueueDepth; i++) {
+        if (Slots[i].Active && UasTaskManagement(Device, 
+                MSD_UAS_TM_ABORT_TASK, Slots[i].Tag) != OsSuccess) {
+            if (UasTaskManagement(Device, MSD_UAS_TM_LOGICAL_UNIT_RESET, 0) != OsSuccess) {
+                ERROR("Failed to reset the logical unit, it is now unusable.");
+            }
+            break;
+        }
+    }
+
+    // Data moved by the aborted commands leaves the sequence of the data pipes undefined
+    UasClearPipe(Device, Device->In);
+    UasClearPipe(Device, Device->Out);
+}
+
+/* UasQueueCommand
+ * Builds the command unit in the buffer of the slot and queues it. With streams the
+ * data and status stages are queued on the stream first, so the device finds them
+ * waiting when it has processed the command. */
+static void
+UasQueueCommand(
+    _In_ MsdDevice_t*  Device,
+    _In_ UasSlot_t*    Slot,
+    _In_ MsdCommand_t* Command,
+    _In_ int           Index)
+{
+    MsdUasCommand_t*  Iu = &Device->UasCommand[Index];
+    MsdCommandBlock_t CommandBlock;
+
+    TRACE("UasQueueCommand(Command %u, Start %u, Length %u, Tag %u)",
+        Command->ScsiCommand, LODWORD(Command->SectorStart), Command->DataLength, Index + 1);
+
+    memset(Slot, 0, sizeof(UasSlot_t));
+    Slot->Command = Command;
+    Slot->Tag     = (uint16_t)(Index + 1);
+    Slot->Active  = 1;
+    Slot->Status  = TransferNotProcessed;
+
+    // The command bytes are the same as those of the bulk protocol
+    BulkScsiCommandConstruct(&CommandBlock, Command->ScsiCommand, Command->SectorStart,
+        Command->DataLength, (uint16_t)Device->Descriptor.SectorSize);
+    memset((void*)Iu, 0, sizeof(MsdUasCommand_t));
+    Iu->Id  = MSD_UAS_IU_COMMAND;
+    Iu->Tag = UAS_SWAP16(Slot->Tag);
+    memcpy(&Iu->CommandBytes[0], &CommandBlock.CommandBytes[0], 16);
+
+    if (Device->UsesStreams) {
+        if (Command->DataLength != 0) {
+            UasPrepareStage(Device, &Slot->DataStage, (Command->Direction == 0) ? Device->In : Device->Out,
+                Command->Direction, Command->DataAddress, Command->DataLength, Slot->Tag);
+            MsdStageSubmit(Device, UAS_WORKER_STREAM_DATA(Index), &Slot->DataStage);
+            Slot->DataQueued = 1;
+        }
+        UasPrepareStage(Device, &Slot->StatusStage, Device->StatusPipe, 0,
+            UasStatusAddress(Device, Index), sizeof(MsdUasStatus_t), Slot->Tag);
+        MsdStageSubmit(Device, UAS_WORKER_STREAM_STATUS(Index), &Slot->StatusStage);
+    }
+
+    UasPrepareStage(Device, &Slot->CommandStage, Device->CommandPipe, 1,
+        Device->UasCommandAddress + (Index * sizeof(MsdUasCommand_t)), sizeof(MsdUasCommand_t), Slot->Tag);
+    MsdStageSubmit(Device, UAS_WORKER_COMMAND, &Slot->CommandStage);
+}
+
+/* UasHandleStatus
+ * Handles a unit read from the status pipe for the command of the slot. Ready units
+ * start the data stage, sense and response units complete the command. */
+static void
+UasHandleStatus(
+    _In_ MsdDevice_t*    Device,
+    _In_ UasSlot_t*      Slot,
+    _In_ MsdUasStatus_t* Iu)
+{
+    MsdCommand_t* Command = Slot->Command;
+
+    if (Iu->Id == MSD_UAS_IU_READ_READY || Iu->Id == MSD_UAS_IU_WRITE_READY) {
+        if (Device->UsesStreams || Slot->DataQueued || Command->DataLength == 0 ||
+            Iu->Id != ((Command->Direction == 0) ? MSD_UAS_IU_READ_READY : MSD_UAS_IU_WRITE_READY)) {
+            ERROR("Unexpected ready unit 0x%x for tag %u", Iu->Id, Slot->Tag);
+            return;
+        }
+        UasPrepareStage(Device, &Slot->DataStage, (Command->Direction == 0) ? Device->In : Device->Out,
+            Command->Direction, Command->DataAddress, Command->DataLength, Slot->Tag);
+        MsdStageSubmit(Device, (Command->Direction == 0) ? UAS_WORKER_IN : UAS_WORKER_OUT, &Slot->DataStage);
+        Slot->DataQueued = 1;
+        return;
+    }
+
+    Slot->StatusDone = 1;
+    if (Iu->Id == MSD_UAS_IU_RESPONSE) {
+        ERROR("Command 0x%x was rejected, response code 0x%x",
+            Command->ScsiCommand, Iu->ResponseCode);
+        Slot->Status = TransferInvalid;
+    }
+    else if (Iu->Id != MSD_UAS_IU_SENSE) {
+        ERROR("Unexpected information unit 0x%x", Iu->Id);
+        Slot->Status = TransferInvalid;
+    }
+    else if (Iu->Status != 0) {
+        ERROR("Command 0x%x failed with status 0x%x: %s", Command->ScsiCommand, Iu->Status,
+            (Iu->SenseLength != 0) ? SenseKeys[Iu->SenseData[2] & 0xF] : "No Sense");
+        Slot->Status = TransferInvalid;
+    }
+    else if (Slot->Status == TransferNotProcessed) {
+        Slot->Status = TransferFinished;
+    }
+}
+
+/* UasUpdateSlot
+ * Handles the stages of the slot that have completed. Returns 1 when the command of
+ * the slot has completed. */
+static int
+UasUpdateSlot(
+    _In_ MsdDevice_t* Device,
+    _In_ UasSlot_t*   Slot,
+    _In_ int          Index)
+{
+    int DataWorker = Device->UsesStreams ? UAS_WORKER_STREAM_DATA(Index) : 
+        ((Slot->Command->Direction == 0) ? UAS_WORKER_IN : UAS_WORKER_OUT);
+
+    if (Slot->CommandStage.State != MSD_STAGE_IDLE && MsdStageIsDone(Device, &Slot->CommandStage)) {
+        Slot->CommandStage.State = MSD_STAGE_IDLE;
+        if (Slot->CommandStage.Result.Status != TransferFinished) {
+            ERROR("Failed to send the command information unit, transfer-code %u",
+                Slot->CommandStage.Result.Status);
+            UasStageFailed(Device, &Slot->CommandStage, Device->CommandPipe, UAS_WORKER_COMMAND);
+            Slot->Status     = Slot->CommandStage.Result.Status;
+            Slot->StatusDone = 1;
+            if (Device->UsesStreams) {
+                MsdStageCancel(Device, &Slot->StatusStage);
+                Slot->StatusStage.State = MSD_STAGE_IDLE;
+            }
+        }
+    }
+
+    if (Device->UsesStreams && Slot->StatusStage.State != MSD_STAGE_IDLE && 
+        MsdStageIsDone(Device, &Slot->StatusStage)) {
+        Slot->StatusStage.State = MSD_STAGE_IDLE;
+        if (Slot->StatusStage.Result.Status != TransferFinished) {
+            ERROR("Failed to read the status information unit, transfer-code %u",
+                Slot->StatusStage.Result.Status);
+            UasStageFailed(Device, &Slot->StatusStage, Device->StatusPipe, UAS_WORKER_STREAM_STATUS(Index));
+            Slot->Status     = Slot->StatusStage.Result.Status;
+            Slot->StatusDone = 1;
+        }
+        else {
+            UasHandleStatus(Device, Slot, &Device->UasStatus[Index]);
+        }
+    }
+
+    // A command that fails before its data stage reports the status on its stream
+    // while the data stage is still waiting there, it will never be served
+    if (Device->UsesStreams && Slot->StatusDone && Slot->Status != TransferFinished &&
+        Slot->DataStage.State != MSD_STAGE_IDLE) {
+        MsdStageCancel(Device, &Slot->DataStage);
+    }
+
+    if (Slot->DataStage.State != MSD_STAGE_IDLE && MsdStageIsDone(Device, &Slot->DataStage)) {
+        Slot->DataStage.State  = MSD_STAGE_IDLE;
+        Slot->BytesTransferred = Slot->DataStage.Result.BytesTransferred;
+        if (Slot->DataStage.Result.Status != TransferFinished && 
+            Slot->DataStage.Result.Status != TransferCancelled) {
+            UasStageFailed(Device, &Slot->DataStage, 
+                (Slot->Command->Direction == 0) ? Device->In : Device->Out, DataWorker);
+            if (Slot->DataStage.Result.Status != TransferStalled) {
+                ERROR("Data-stage failed with status %u", Slot->DataStage.Result.Status);
+                Slot->Status = Slot->DataStage.Result.Status;
+            }
+        }
+    }
+
+    return Slot->StatusDone && Slot->CommandStage.State == MSD_STAGE_IDLE &&
+        Slot->DataStage.State == MSD_STAGE_IDLE && Slot->StatusStage.State == MSD_STAGE_IDLE;
+}
+
+/* UasExecuteCommands
+ * Executes the commands with up to the queue depth of them in flight, each with its
+ * own tag. Without streams a single read is kept on the status pipe and each unit is
+ * given to the command of its tag. Nothing new is queued once a command has failed,
+ * commands that make no progress are aborted on the device. */
+UsbTransferStatus_t
+UasExecuteCommands(
+    _In_ MsdDevice_t*  Device,
+    _In_ MsdCommand_t* Commands,
+    _In_ int           Count)
+{
+    UasSlot_t           Slots[MSD_UAS_QUEUE_DEPTH];
+    MsdStage_t          SharedStatus;
+    MsdUasStatus_t*     SharedIu  = &Device->UasStatus[Device->UasQueueDepth];
+    UsbTransferStatus_t Status    = TransferFinished;
+    size_t              Completions;
+    int                 Submitted = 0;
+    int                 Active    = 0;
+    int                 Waiting;
+    int                 i;
+
+    TRACE("UasExecuteCommands(Count %i)", Count);
+
+    for (i = 0; i < Count; i++) {
+        Commands[i].Status  = TransferNotProcessed;
+        Commands[i].Residue = 0;
+    }
+    memset(&Slots[0], 0, sizeof(Slots));
+    memset(&SharedStatus, 0, sizeof(MsdStage_t));
+
+    mtx_lock(&Device->StageLock);
+    Completions = Device->StageCompletions;
+    mtx_unlock(&Device->StageLock);
+
+    while (1) {
+        // Fill the free slots while no command has failed
+        for (i = 0; i < Device->UasQueueDepth && Status == TransferFinished && Submitted < Count; i++) {
+            if (!Slots[i].Active) {
+                UasQueueCommand(Device, &Slots[i], &Commands[Submitted++], i);
+                Active++;
+            }
+        }
+        if (Active == 0) {
+            break;
+        }
+
+        // Keep a read on the status pipe while a command waits for a unit
+        if (!Device->UsesStreams && SharedStatus.State == MSD_STAGE_IDLE) {
+            for (i = 0, Waiting = 0; i < Device->UasQueueDepth; i++) {
+                Waiting |= (Slots[i].Active && !Slots[i].StatusDone);
+            }
+            if (Waiting) {
+                UasPrepareStage(Device, &SharedStatus, Device->StatusPipe, 0,
+                    UasStatusAddress(Device, Device->UasQueueDepth), sizeof(MsdUasStatus_t), 0);
+                MsdStageSubmit(Device, UAS_WORKER_STATUS, &SharedStatus);
+            }
+        }
+
+        if (MsdStageWaitAny(Device, &Completions, MSD_UAS_TASK_TIMEOUT) == OsTimeout) {
+            ERROR("Commands made no progress for %u ms, aborting them", MSD_UAS_TASK_TIMEOUT);
+            UasAbortCommands(Device, &Slots[0], &SharedStatus);
+            for (i = 0; i < Device->UasQueueDepth; i++) {
+                if (Slots[i].Active) {
+                    Slots[i].Command->Status = TransferNotResponding;
+                    Slots[i].Active          = 0;
+                }
+            }
+            return TransferNotResponding;
+        }
+
+        if (SharedStatus.State != MSD_STAGE_IDLE && MsdStageIsDone(Device, &SharedStatus)) {
+            SharedStatus.State = MSD_STAGE_IDLE;
+            if (SharedStatus.Result.Status != TransferFinished) {
+                ERROR("Failed to read the status information unit, transfer-code %u",
+                    SharedStatus.Result.Status);
+                UasStageFailed(Device, &SharedStatus, Device->StatusPipe, UAS_WORKER_STATUS);
+                if (SharedStatus.Result.Status != TransferStalled) {
+                    UasAbortCommands(Device, &Slots[0], &SharedStatus);
+                    for (i = 0; i < Device->UasQueueDepth; i++) {
+                        if (Slots[i].Active) {
+                            Slots[i].Command->Status = SharedStatus.Result.Status;
+                            Slots[i].Active          = 0;
+                        }
+                    }
+                    return SharedStatus.Result.Status;
+                }
+            }
+            else {
+                for (i = 0; i < Device->UasQueueDepth; i++) {
+                    if (Slots[i].Active && Slots[i].Tag == UAS_SWAP16(SharedIu->Tag)) {
+                        UasHandleStatus(Device, &Slots[i], SharedIu);
+                        break;
+                    }
+                }
+                if (i == Device->UasQueueDepth) {
+                    ERROR("Status information unit 0x%x for unknown tag %u",
+                        SharedIu->Id, UAS_SWAP16(SharedIu->Tag));
+                }
+            }
+        }
+
+        for (i = 0; i < Device->UasQueueDepth; i++) {
+            if (Slots[i].Active && UasUpdateSlot(Device, &Slots[i], i)) {
+                MsdCommand_t* Command = Slots[i].Command;
+                Command->Status  = Slots[i].Status;
+                Command->Residue = Command->DataLength - MIN(Slots[i].BytesTransferred, Command->DataLength);
+                if (Command->Status != TransferFinished && Status == TransferFinished) {
+                    Status = Command->Status;
+                }
+                Slots[i].Active = 0;
+                Active--;
+            }
+        }
+    }
+
+    // The read on the status pipe outlives the commands when one failed to be sent
+    if (SharedStatus.State != MSD_STAGE_IDLE) {
+        MsdStageCancel(Device, &SharedStatus);
+        MsdWorkerResume(Device, UAS_WORKER_STATUS);
+    }
+    return Status;
+}
+
+/* Global
+ * - Static function table, the stages are never executed individually */
+MsdOperations_t UasOperations = {
+    UasInitialize,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    UasExecuteCommands
+};
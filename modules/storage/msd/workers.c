@@ -0,0 +1,284 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS MCore - Mass Storage Device Driver (Generic)
+ * - Stage workers, a usb transfer blocks the caller until it completes, so stages that
+ *   must be in flight at the same time are executed by their own worker. The stages
+ *   given to a worker are executed in order.
+ */
+//#define __TRACE
+
+#include <ddk/services/usb.h>
+#include <ddk/utils.h>
+#include "msd.h"
+#include <string.h>
+#include <time.h>
+
+static int
+MsdWorkerMain(
+    _In_ void* Context)
+{
+    MsdWorker_t* Worker = (MsdWorker_t*)Context;
+    MsdDevice_t* Device = Worker->Device;
+    MsdStage_t*  Stage;
+
+    while (1) {
+        mtx_lock(&Device->StageLock);
+        while ((Worker->Head == NULL || Worker->Halted) && Worker->Running) {
+            cnd_wait(&Device->StageSignal, &Device->StageLock);
+        }
+        if (!Worker->Running) {
+            mtx_unlock(&Device->StageLock);
+            break;
+        }
+
+        Stage        = Worker->Head;
+        Worker->Head = Stage->Link;
+        if (Worker->Head == NULL) {
+            Worker->Tail = NULL;
+        }
+        Stage->State = MSD_STAGE_RUNNING;
+        mtx_unlock(&Device->StageLock);
+
+        memset(&Stage->Result, 0, sizeof(UsbTransferResult_t));
+        if (UsbTransferQueue(Device->Base.DriverId, Device->Base.DeviceId,
+                &Stage->Transfer, &Stage->Result) != OsSuccess) {
+            Stage->Result.Status = TransferNotProcessed;
+        }
+
+        // Cancelled stages were cancelled by the owner, who already knows
+        mtx_lock(&Device->StageLock);
+        if (Stage->Result.Status != TransferFinished && Stage->Result.Status != TransferCancelled) {
+            Worker->Halted = 1;
+        }
+        Stage->State = MSD_STAGE_DONE;
+        Device->StageCompletions++;
+        cnd_broadcast(&Device->StageSignal);
+        mtx_unlock(&Device->StageLock);
+    }
+    return 0;
+}
+
+OsStatus_t
+MsdWorkersCreate(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Count)
+{
+    int i;
+
+    mtx_init(&Device->StageLock, mtx_plain);
+    if (cnd_init(&Device->StageSignal) != thrd_success) {
+        return OsError;
+    }
+
+    for (i = 0; i < MIN(Count, MSD_WORKER_COUNT); i++) {
+        MsdWorker_t* Worker = &Device->Workers[i];
+        memset(Worker, 0, sizeof(MsdWorker_t));
+        Worker->Device  = Device;
+        Worker->Running = 1;
+        if (thrd_create(&Worker->Thread, MsdWorkerMain, Worker) != thrd_success) {
+            ERROR("Failed to create worker %i", i);
+            return OsError;
+        }
+        Device->WorkerCount++;
+    }
+    return OsSuccess;
+}
+
+void
+MsdWorkersDestroy(
+    _In_ MsdDevice_t* Device)
+{
+    MsdStage_t* Stage;
+    int         i;
+
+    if (Device->WorkerCount == 0) {
+        return;
+    }
+
+    mtx_lock(&Device->StageLock);
+    for (i = 0; i < Device->WorkerCount; i++) {
+        Device->Workers[i].Running = 0;
+        for (Stage = Device->Workers[i].Head; Stage != NULL; Stage = Stage->Link) {
+            Stage->Result.Status = TransferCancelled;
+            Stage->State         = MSD_STAGE_DONE;
+        }
+        Device->Workers[i].Head = NULL;
+        Device->Workers[i].Tail = NULL;
+    }
+    cnd_broadcast(&Device->StageSignal);
+    mtx_unlock(&Device->StageLock);
+
+    for (i = 0; i < Device->WorkerCount; i++) {
+        thrd_join(Device->Workers[i].Thread, NULL);
+    }
+    cnd_destroy(&Device->StageSignal);
+    mtx_destroy(&Device->StageLock);
+    Device->WorkerCount = 0;
+}
+
+void
+MsdWorkerResume(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Worker)
+{
+    mtx_lock(&Device->StageLock);
+    Device->Workers[Worker].Halted = 0;
+    cnd_broadcast(&Device->StageSignal);
+    mtx_unlock(&Device->StageLock);
+}
+
+void
+MsdStageSubmit(
+    _In_ MsdDevice_t* Device,
+    _In_ int          Worker,
+    _In_ MsdStage_t*  Stage)
+{
+    MsdWorker_t* Target = &Device->Workers[Worker];
+    TRACE("MsdStageSubmit(Worker %i, Endpoint %u)", Worker, Stage->Transfer.Address.EndpointAddress);
+
+    mtx_lock(&Device->StageLock);
+    Stage->State  = MSD_STAGE_QUEUED;
+    Stage->Worker = Target;
+    Stage->Link   = NULL;
+    memset(&Stage->Result, 0, sizeof(UsbTransferResult_t));
+    if (Target->Tail == NULL) {
+        Target->Head = Stage;
+    }
+    else {
+        Target->Tail->Link = Stage;
+    }
+    Target->Tail = Stage;
+    cnd_broadcast(&Device->StageSignal);
+    mtx_unlock(&Device->StageLock);
+}
+
+UsbTransferStatus_t
+MsdStageWait(
+    _In_ MsdDevice_t* Device,
+    _In_ MsdStage_t*  Stage)
+{
+    UsbTransferStatus_t Status;
+
+    mtx_lock(&Device->StageLock);
+    while (Stage->State == MSD_STAGE_QUEUED || Stage->State == MSD_STAGE_RUNNING) {
+        cnd_wait(&Device->StageSignal, &Device->StageLock);
+    }
+    Status = Stage->Result.Status;
+    mtx_unlock(&Device->StageLock);
+    return Status;
+}
+
+int
+MsdStageIsDone(
+    _In_ MsdDevice_t* Device,
+    _In_ MsdStage_t*  Stage)
+{
+    int Done;
+
+    mtx_lock(&Device->StageLock);
+    Done = (Stage->State == MSD_STAGE_DONE);
+    mtx_unlock(&Device->StageLock);
+    return Done;
+}
+
+/* MsdStageDeadline
+ * Converts a timeout in milliseconds to the point in time it expires. */
+static void
+MsdStageDeadline(
+    _In_  size_t           Timeout,
+    _Out_ struct timespec* Deadline)
+{
+    timespec_get(Deadline, TIME_UTC);
+    Deadline->tv_sec  += Timeout / MSEC_PER_SEC;
+    Deadline->tv_nsec += (Timeout % MSEC_PER_SEC) * (NSEC_PER_SEC / MSEC_PER_SEC);
+    if (Deadline->tv_nsec >= NSEC_PER_SEC) {
+        Deadline->tv_nsec -= NSEC_PER_SEC;
+        Deadline->tv_sec++;
+    }
+}
+
+OsStatus_t
+MsdStageWaitAny(
+    _In_    MsdDevice_t* Device,
+    _InOut_ size_t*      Completions,
+    _In_    size_t       Timeout)
+{
+    struct timespec Deadline;
+    OsStatus_t      Status = OsSuccess;
+
+    MsdStageDeadline(Timeout, &Deadline);
+    mtx_lock(&Device->StageLock);
+    while (Device->StageCompletions == *Completions) {
+        if (cnd_timedwait(&Device->StageSignal, &Device->StageLock, &Deadline) == thrd_timedout) {
+            Status = OsTimeout;
+            break;
+        }
+    }
+    *Completions = Device->StageCompletions;
+    mtx_unlock(&Device->StageLock);
+    return Status;
+}
+
+UsbTransferStatus_t
+MsdStageCancel(
+    _In_ MsdDevice_t* Device,
+    _In_ MsdStage_t*  Stage)
+{
+    UsbTransferStatus_t Status;
+    struct timespec     Deadline;
+    MsdStage_t*         Previous = NULL;
+    MsdStage_t*         Current;
+
+    mtx_lock(&Device->StageLock);
+    if (Stage->State == MSD_STAGE_QUEUED) {
+        Current = Stage->Worker->Head;
+        while (Current != NULL && Current != Stage) {
+            Previous = Current;
+            Current  = Current->Link;
+        }
+        if (Previous == NULL) {
+            Stage->Worker->Head = Stage->Link;
+        }
+        else {
+            Previous->Link = Stage->Link;
+        }
+        if (Stage->Worker->Tail == Stage) {
+            Stage->Worker->Tail = Previous;
+        }
+        Stage->Result.Status = TransferCancelled;
+        Stage->State         = MSD_STAGE_DONE;
+    }
+
+    // The worker may not have reached the controller yet when the cancel arrives,
+    // so it is repeated until the worker has been answered
+    while (Stage->State == MSD_STAGE_RUNNING) {
+        mtx_unlock(&Device->StageLock);
+        UsbTransferCancel(Device->Base.DriverId, Device->Base.DeviceId, &Stage->Transfer);
+        MsdStageDeadline(10, &Deadline);
+        mtx_lock(&Device->StageLock);
+        while (Stage->State == MSD_STAGE_RUNNING) {
+            if (cnd_timedwait(&Device->StageSignal, &Device->StageLock, &Deadline) == thrd_timedout) {
+                break;
+            }
+        }
+    }
+    Status = Stage->Result.Status;
+    mtx_unlock(&Device->StageLock);
+    return Status;
+}
@@ -81,6 +81,14 @@
 #define PCI_COMMAND_FASTBTB             0x200
 #define PCI_COMMAND_INTDISABLE          0x400
 
+/* The capability list is present when the status has bit 4
+ * set, and the list starts at the capability pointer */
+#define PCI_STATUS_CAPABILITIES         0x10
+#define PCI_CAPABILITIES_POINTER        0x34
+
+#define PCI_CAPABILITY_MSI              0x05
+#define PCI_CAPABILITY_MSIX             0x11
+
 /* The PCI base entry on the pci-databus
  * It describes a device on the pci-bus, the resources
  * its command register, status and its system bars */
@@ -226,6 +234,12 @@ __EXTERN uint8_t PciReadSecondaryBusNumber(PciBus_t *BusIo,
 __EXTERN uint8_t PciReadHeaderType(PciBus_t *BusIo,
     DevInfo_t Bus, DevInfo_t Device, DevInfo_t Function);
 
+/* PciFindCapability
+ * Walks the capability list of the function for the given capability id,
+ * returns the config space offset of it or 0 if it's not present */
+__EXTERN uint8_t PciFindCapability(PciBus_t *BusIo,
+    DevInfo_t Bus, DevInfo_t Device, DevInfo_t Function, uint8_t Capability);
+
 /* PciToString
  * Converts the given class, subclass and interface into
  * descriptive string to give the pci-entry a description */
@@ -391,6 +391,12 @@ PciCreateDeviceFromPci(
     Device.Interrupt.Vectors[0]     = INTERRUPT_NONE;
     Device.Interrupt.AcpiConform    = PciDevice->AcpiConform;
 
+    // Message signaled interrupts are set up by the driver through the ioctls
+    Device.MsiCapability  = PciFindCapability(PciDevice->BusIo, PciDevice->Bus,
+        PciDevice->Slot, PciDevice->Function, PCI_CAPABILITY_MSI);
+    Device.MsiXCapability = PciFindCapability(PciDevice->BusIo, PciDevice->Bus,
+        PciDevice->Slot, PciDevice->Function, PCI_CAPABILITY_MSIX);
+
     // Handle bars attached to device
     PciReadBars(PciDevice->BusIo, &Device, PciDevice->Header->HeaderType);
 
@@ -86,3 +86,27 @@ uint8_t PciReadHeaderType(PciBus_t *BusIo, DevInfo_t Bus, DevInfo_t Device, DevI
 		return 0xFF;
 	}
 }
+
+/* PciFindCapability
+ * Walks the capability list of the function for the given capability id,
+ * returns the config space offset of it or 0 if it's not present */
+uint8_t PciFindCapability(PciBus_t *BusIo, DevInfo_t Bus, DevInfo_t Device, DevInfo_t Function, uint8_t Capability)
+{
+	uint8_t Pointer;
+	int Iterations = 0;
+
+	if (!(PciRead16(BusIo, Bus, Device, Function, 0x06) & PCI_STATUS_CAPABILITIES)) {
+		return 0;
+	}
+
+	/* Entries are dword aligned and live after the header, a
+	 * malformed list could loop so limit the number of entries */
+	Pointer = PciRead8(BusIo, Bus, Device, Function, PCI_CAPABILITIES_POINTER) & 0xFC;
+	while (Pointer >= 0x40 && Iterations++ < 48) {
+		if (PciRead8(BusIo, Bus, Device, Function, Pointer) == Capability) {
+			return Pointer;
+		}
+		Pointer = PciRead8(BusIo, Bus, Device, Function, Pointer + 1) & 0xFC;
+	}
+	return 0;
+}
@@ -0,0 +1,212 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - File Manager Service
+ * - Path index of the open entries, provides lookup of open entries by path and
+ *   lookup of whether any entries are open beneath a given path.
+ */
+//#define __TRACE
+
+#include "include/vfs.h"
+#include <ddk/utils.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <string.h>
+#include <ctype.h>
+
+#define VFS_PATH_INDEX_SIZE 256
+
+typedef struct _VfsPathNode {
+    struct _VfsPathNode* Link;
+    size_t               Hash;
+    size_t               Length;
+    int                  References;
+    FileSystemEntry_t*   Entry;
+    char                 Path[];
+} VfsPathNode_t;
+
+// Open entries are indexed by their full path, and every directory above an open
+// entry is indexed in the prefix table with the number of open entries beneath it
+static VfsPathNode_t* OpenEntries[VFS_PATH_INDEX_SIZE]  = { 0 };
+static VfsPathNode_t* OpenPrefixes[VFS_PATH_INDEX_SIZE] = { 0 };
+static mtx_t          IndexLock                         = MUTEX_INIT(mtx_plain);
+
+/* VfsPathHash
+ * Case-insensitive hash of the first <Length> bytes of the path, this matches
+ * the value produced by MStringHash for the full path. */
+static size_t
+VfsPathHash(
+    _In_ const char* Path,
+    _In_ size_t      Length)
+{
+    size_t Hash = 5381;
+    size_t i;
+    for (i = 0; i < Length; i++) {
+        Hash = ((Hash << 5) + Hash) + (size_t)tolower((unsigned char)Path[i]);
+    }
+    return Hash;
+}
+
+static VfsPathNode_t**
+VfsPathIndexFind(
+    _In_ VfsPathNode_t** Table,
+    _In_ const char*     Path,
+    _In_ size_t          Length,
+    _In_ size_t          Hash)
+{
+    VfsPathNode_t** Link = &Table[Hash % VFS_PATH_INDEX_SIZE];
+    while (*Link != NULL) {
+        if ((*Link)->Hash == Hash && (*Link)->Length == Length &&
+            !strncasecmp(&(*Link)->Path[0], Path, Length)) {
+            break;
+        }
+        Link = &(*Link)->Link;
+    }
+    return Link;
+}
+
+static VfsPathNode_t*
+VfsPathIndexAcquire(
+    _In_ VfsPathNode_t** Table,
+    _In_ const char*     Path,
+    _In_ size_t          Length)
+{
+    size_t          Hash = VfsPathHash(Path, Length);
+    VfsPathNode_t** Link = VfsPathIndexFind(Table, Path, Length, Hash);
+    VfsPathNode_t*  Node = *Link;
+
+    if (Node == NULL) {
+        Node = (VfsPathNode_t*)malloc(sizeof(VfsPathNode_t) + Length + 1);
+        if (Node == NULL) {
+            return NULL;
+        }
+        memcpy(&Node->Path[0], Path, Length);
+        Node->Path[Length] = '\0';
+        Node->Hash         = Hash;
+        Node->Length       = Length;
+        Node->References   = 0;
+        Node->Entry        = NULL;
+        Node->Link         = NULL;
+        *Link              = Node;
+    }
+    Node->References++;
+    return Node;
+}
+
+static void
+VfsPathIndexRelease(
+    _In_ VfsPathNode_t** Table,
+    _In_ const char*     Path,
+    _In_ size_t          Length)
+{
+    VfsPathNode_t** Link = VfsPathIndexFind(Table, Path, Length, VfsPathHash(Path, Length));
+    VfsPathNode_t*  Node = *Link;
+    if (Node != NULL && --Node->References == 0) {
+        *Link = Node->Link;
+        free(Node);
+    }
+}
+
+/* VfsPathIndexAdd
+ * Adds the open entry to the path index, and registers all the directories
+ * above it in the prefix index. */
+void
+VfsPathIndexAdd(
+    _In_ FileSystemEntry_t* Entry)
+{
+    const char*    Path   = MStringRaw(Entry->Path);
+    size_t         Length = strlen(Path);
+    VfsPathNode_t* Node;
+    size_t         i;
+
+    mtx_lock(&IndexLock);
+    Node = VfsPathIndexAcquire(OpenEntries, Path, Length);
+    if (Node != NULL) {
+        Node->Entry = Entry;
+    }
+
+    for (i = 1; i + 1 < Length; i++) {
+        if (Path[i] == '/') {
+            VfsPathIndexAcquire(OpenPrefixes, Path, i);
+        }
+    }
+    mtx_unlock(&IndexLock);
+}
+
+/* VfsPathIndexRemove
+ * Removes the open entry from the path index, must be called before the entry
+ * is released by the filesystem. */
+void
+VfsPathIndexRemove(
+    _In_ FileSystemEntry_t* Entry)
+{
+    const char* Path   = MStringRaw(Entry->Path);
+    size_t      Length = strlen(Path);
+    size_t      i;
+
+    mtx_lock(&IndexLock);
+    VfsPathIndexRelease(OpenEntries, Path, Length);
+    for (i = 1; i + 1 < Length; i++) {
+        if (Path[i] == '/') {
+            VfsPathIndexRelease(OpenPrefixes, Path, i);
+        }
+    }
+    mtx_unlock(&IndexLock);
+}
+
+/* VfsPathIndexLookup
+ * Retrieves the open entry for the given path, NULL if the path is not open. The entry
+ * may only be used by the worker of the filesystem it belongs to. */
+FileSystemEntry_t*
+VfsPathIndexLookup(
+    _In_ MString_t* Path)
+{
+    const char*        Raw    = MStringRaw(Path);
+    size_t             Length = strlen(Raw);
+    FileSystemEntry_t* Entry  = NULL;
+    VfsPathNode_t*     Node;
+
+    mtx_lock(&IndexLock);
+    Node = *VfsPathIndexFind(OpenEntries, Raw, Length, VfsPathHash(Raw, Length));
+    if (Node != NULL) {
+        Entry = Node->Entry;
+    }
+    mtx_unlock(&IndexLock);
+    return Entry;
+}
+
+/* VfsPathIndexHasDescendants
+ * Returns whether or not any entries are open beneath the given path. */
+int
+VfsPathIndexHasDescendants(
+    _In_ MString_t* Path)
+{
+    const char* Raw    = MStringRaw(Path);
+    size_t      Length = strlen(Raw);
+    int         Result;
+
+    // Ignore trailing seperators, they are not part of the indexed prefixes
+    while (Length > 1 && Raw[Length - 1] == '/') {
+        Length--;
+    }
+
+    mtx_lock(&IndexLock);
+    Result = *VfsPathIndexFind(OpenPrefixes, Raw, Length, VfsPathHash(Raw, Length)) != NULL;
+    mtx_unlock(&IndexLock);
+    return Result;
+}
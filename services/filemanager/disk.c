@@ -67,8 +67,19 @@ VfsResolveQueueExecute(void)
             continue;
         }
 
+        // Start the worker that will process all requests for the filesystem
+        if (VfsWorkerCreate(Fs) != OsSuccess) {
+            Fs->Module->Destroy(&Fs->Descriptor, 0);
+            MStringDestroy(Fs->Identifier);
+            VfsIdentifierFree(&Fs->Descriptor.Disk, Fs->Id);
+            free(Fs);
+            continue;
+        }
+
         // Add to list, by using the disk id as identifier
+        VfsLockFileSystems();
         CollectionAppend(VfsGetFileSystems(), CollectionCreateNode(Key, Fs));
+        VfsUnlockFileSystems();
     }
     return OsSuccess;
 }
@@ -107,6 +118,7 @@ DiskRegisterFileSystem(
     Fs->Id = Id;
     Fs->Type = Type;
     Fs->Identifier = MStringCreate(&IdentBuffer[0], StrASCII);
+    Fs->Worker = NULL;
     Fs->Descriptor.Flags = 0;
     Fs->Descriptor.SectorStart = Sector;
     Fs->Descriptor.SectorCount = SectorCount;
@@ -141,8 +153,20 @@ DiskRegisterFileSystem(
             return OsError;
         }
 
+        // Start the worker that will process all requests for the filesystem
+        if (VfsWorkerCreate(Fs) != OsSuccess) {
+            ERROR("Failed to start worker for filesystem");
+            Fs->Module->Destroy(&Fs->Descriptor, 0);
+            MStringDestroy(Fs->Identifier);
+            VfsIdentifierFree(&Fs->Descriptor.Disk, Fs->Id);
+            free(Fs);
+            return OsError;
+        }
+
         // Add to list, by using the disk id as identifier
+        VfsLockFileSystems();
         CollectionAppend(VfsGetFileSystems(), CollectionCreateNode(Key, Fs));
+        VfsUnlockFileSystems();
 
         // Send notification to sessionmanager
         SessionCheckDisk(&IdentBuffer[0]);
@@ -211,6 +235,12 @@ VfsUnregisterDisk(
     while (lNode != NULL) {
         FileSystem_t *Fs = (FileSystem_t*)lNode->Data;
 
+        // Take the filesystem offline before waiting for its pending requests
+        VfsLockFileSystems();
+        CollectionRemoveByNode(VfsGetFileSystems(), lNode);
+        VfsUnlockFileSystems();
+        VfsWorkerDestroy(Fs);
+
         // Close all open files that relate to this filesystem
         // @todo
 
@@ -230,8 +260,6 @@ VfsUnregisterDisk(
         VfsIdentifierFree(&Fs->Descriptor.Disk, Fs->Id);
         MStringDestroy(Fs->Identifier);
         free(Fs);
-
-        CollectionRemoveByNode(VfsGetFileSystems(), lNode);
         lNode = CollectionGetNodeByKey(VfsGetFileSystems(), Key, 0);
     }
 
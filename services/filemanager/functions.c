@@ -65,51 +65,118 @@ VfsGetFileSystemFromPath(
 
     // Iterate all the filesystems and find the one
     // that matches
+    VfsLockFileSystems();
     _foreach(Node, VfsGetFileSystems()) {
         FileSystem_t *Filesystem = (FileSystem_t*)Node->Data;
         if (MStringCompare(Identifier, Filesystem->Identifier, 1)) {
+            VfsUnlockFileSystems();
             MStringDestroy(Identifier);
             return Filesystem;
         }
     }
+    VfsUnlockFileSystems();
     MStringDestroy(Identifier);
     MStringDestroy(*SubPath);
     return NULL;
 }
 
-/* VfsIsHandleValid
- * Checks for both owner permission and verification of the handle. */
+/* VfsAcquireHandle
+ * Validates the handle like VfsIsHandleValid and keeps it locked, so it can be
+ * accessed from outside of the worker of its filesystem until it is released. */
 FileSystemCode_t
-VfsIsHandleValid(
+VfsAcquireHandle(
     _In_  UUId_t                    Requester,
     _In_  UUId_t                    Handle,
     _In_  Flags_t                   RequiredAccess,
     _Out_ FileSystemEntryHandle_t** EntryHandle)
 {
     CollectionItem_t *Node;
+    FileSystemCode_t Code = FsOk;
+    UUId_t LockOwner;
     DataKey_t Key = { .Value.Id = Handle };
+
+    VfsLockHandles();
     Node       = CollectionGetNodeByKey(VfsGetOpenHandles(), Key, 0);
     if (Node == NULL) {
+        VfsUnlockHandles();
         ERROR("Invalid handle given for file");
         return FsInvalidParameters;
     }
 
+    // Lock the handle before leaving the list, it can't be destroyed while we hold it
     *EntryHandle = (FileSystemEntryHandle_t*)Node->Data;
+    VfsLockHandle(*EntryHandle);
+    VfsUnlockHandles();
+
+    VfsLockEntry((*EntryHandle)->Entry);
+    LockOwner = (*EntryHandle)->Entry->IsLocked;
+    VfsUnlockEntry((*EntryHandle)->Entry);
+
     if ((*EntryHandle)->Owner != Requester) {
         ERROR("Owner of the handle did not match the requester. Access Denied.");
-        return FsAccessDenied;
+        Code = FsAccessDenied;
     }
-
-    if ((*EntryHandle)->Entry->IsLocked != UUID_INVALID && (*EntryHandle)->Entry->IsLocked != Requester) {
+    else if (LockOwner != UUID_INVALID && LockOwner != Requester) {
         ERROR("Entry is locked and lock is not held by requester. Access Denied.");
-        return FsAccessDenied;
+        Code = FsAccessDenied;
     }
-
-    if (RequiredAccess != 0 && ((*EntryHandle)->Access & RequiredAccess) != RequiredAccess) {
+    else if (RequiredAccess != 0 && ((*EntryHandle)->Access & RequiredAccess) != RequiredAccess) {
         ERROR("Handle was not opened with the required access parameter. Access Denied.");
-        return FsAccessDenied;
+        Code = FsAccessDenied;
     }
-    return FsOk;
+
+    if (Code != FsOk) {
+        VfsUnlockHandle(*EntryHandle);
+    }
+    return Code;
+}
+
+/* VfsReleaseHandle
+ * Releases a handle acquired by VfsAcquireHandle. */
+void
+VfsReleaseHandle(
+    _In_ FileSystemEntryHandle_t* EntryHandle)
+{
+    VfsUnlockHandle(EntryHandle);
+}
+
+/* VfsIsHandleValid
+ * Checks for both owner permission and verification of the handle. The handle
+ * may only be used by the worker of the filesystem it belongs to afterwards. */
+FileSystemCode_t
+VfsIsHandleValid(
+    _In_  UUId_t                    Requester,
+    _In_  UUId_t                    Handle,
+    _In_  Flags_t                   RequiredAccess,
+    _Out_ FileSystemEntryHandle_t** EntryHandle)
+{
+    FileSystemCode_t Code = VfsAcquireHandle(Requester, Handle, RequiredAccess, EntryHandle);
+    if (Code == FsOk) {
+        VfsReleaseHandle(*EntryHandle);
+    }
+    return Code;
+}
+
+/* VfsRemoveHandle
+ * Removes the handle from the list of open handles and waits for anyone that
+ * has acquired it, after this the handle can be safely destroyed. */
+static CollectionItem_t*
+VfsRemoveHandle(
+    _In_ FileSystemEntryHandle_t* EntryHandle)
+{
+    CollectionItem_t* Node;
+    DataKey_t Key = { .Value.Id = EntryHandle->Id };
+
+    VfsLockHandles();
+    Node = CollectionGetNodeByKey(VfsGetOpenHandles(), Key, 0);
+    if (Node != NULL) {
+        CollectionRemoveByNode(VfsGetOpenHandles(), Node);
+    }
+    VfsUnlockHandles();
+
+    VfsLockHandle(EntryHandle);
+    VfsUnlockHandle(EntryHandle);
+    return Node;
 }
 
 /* VfsOpenHandleInternal
@@ -155,7 +222,9 @@ VfsOpenHandleInternal(
 
     // Entry locked for access?
     if ((*Handle)->Access & __FILE_WRITE_ACCESS && !((*Handle)->Access & __FILE_WRITE_SHARE)) {
+        VfsLockEntry(Entry);
         Entry->IsLocked = (*Handle)->Owner;
+        VfsUnlockEntry(Entry);
     }
     return Code;
 }
@@ -169,41 +238,33 @@ VfsVerifyAccessToPath(
     _In_  Flags_t                   Access,
     _Out_ FileSystemEntry_t**       ExistingEntry)
 {
-    CollectionItem_t* Node;
-    int PathHash = (int)MStringHash(Path);
-
-    _foreach(Node, VfsGetOpenFiles()) {
-        FileSystemEntry_t *Entry = (FileSystemEntry_t*)Node->Data;
-        // If our requested mode is exclusive, then we must verify
-        // none in our sub-path is opened in exclusive
-        if (Access & __FILE_WRITE_ACCESS && !(Access & __FILE_WRITE_SHARE) &&
-            Node->Key.Value.Id != PathHash) {
-            // Check if <Entry> contains the entirety of <Path>, if it does then deny
-            // the request as we try to open a higher-level entry in exclusive mode
-            if (MStringCompare(Entry->Path, Path, 0) != MSTRING_NO_MATCH) {
-                ERROR("Entry is blocked from exclusive access, access denied.");
-                return FsAccessDenied;
-            }
+    FileSystemEntry_t* Entry;
+
+    // If our requested mode is exclusive, then we must verify
+    // none in our sub-path is opened
+    if (Access & __FILE_WRITE_ACCESS && !(Access & __FILE_WRITE_SHARE)) {
+        if (VfsPathIndexHasDescendants(Path)) {
+            ERROR("Entry is blocked from exclusive access, access denied.");
+            return FsAccessDenied;
         }
+    }
 
-        // Have we found the existing already opened file?
-        if (Node->Key.Value.Id == PathHash) {
-            if (Entry->IsLocked != UUID_INVALID) {
-                ERROR("File is opened in exclusive mode already, access denied.");
-                return FsAccessDenied;
-            }
-            else {
-                // It's important here that we check if the flag
-                // __FILE_FAILONEXIST has been set, then we return
-                // the appropriate code instead of opening a new handle
-                if (Options & __FILE_FAILONEXIST) {
-                    ERROR("File already exists - open mode specifies this to be failure.");
-                    return FsPathExists;
-                }
-                *ExistingEntry = Entry;
-                break;
-            }
+    // Have we found the existing already opened file?
+    Entry = VfsPathIndexLookup(Path);
+    if (Entry != NULL) {
+        if (Entry->IsLocked != UUID_INVALID) {
+            ERROR("File is opened in exclusive mode already, access denied.");
+            return FsAccessDenied;
+        }
+        
+        // It's important here that we check if the flag
+        // __FILE_FAILONEXIST has been set, then we return
+        // the appropriate code instead of opening a new handle
+        if (Options & __FILE_FAILONEXIST) {
+            ERROR("File already exists - open mode specifies this to be failure.");
+            return FsPathExists;
         }
+        *ExistingEntry = Entry;
     }
     return FsOk;
 }
@@ -268,6 +329,7 @@ VfsOpenInternal(
                     }
                     Key.Value.Id = Entry->Hash;
                     CollectionAppend(VfsGetOpenFiles(), CollectionCreateNode(Key, Entry));
+                    VfsPathIndexAdd(Entry);
                 }
             }
             else {
@@ -282,7 +344,9 @@ VfsOpenInternal(
         if (Entry != NULL) {
             Code = VfsOpenHandleInternal(Entry, Handle);
             if (Code == FsOk) {
+                VfsLockEntry(Entry);
                 Entry->References++;
+                VfsUnlockEntry(Entry);
             }
         }
     }
@@ -390,7 +454,9 @@ VfsOpenEntry(
         Handle->Options = Options;
         
         Key.Value.Id = Handle->Id;
+        VfsLockHandles();
         CollectionAppend(VfsGetOpenHandles(), CollectionCreateNode(Key, Handle));
+        VfsUnlockHandles();
         *FileId = Handle->Id;
     }
     return Code;
@@ -409,7 +475,9 @@ VfsCloseEntry(
     FileSystemCode_t            Code;
     CollectionItem_t* Node;
     FileSystem_t *Fs;
-    DataKey_t Key = { .Value.Id = Handle };
+    void* OutBuffer = NULL;
+    int References;
+    DataKey_t Key;
 
     TRACE("VfsCloseEntry(Handle %u)", Handle);
 
@@ -417,7 +485,6 @@ VfsCloseEntry(
     if (Code != FsOk) {
         return Code;
     }
-    Node        = CollectionGetNodeByKey(VfsGetOpenHandles(), Key, 0);
     Entry       = EntryHandle->Entry;
 
     // Handle file specific flags
@@ -426,30 +493,39 @@ VfsCloseEntry(
         // be flushed and cleaned up 
         if (!(EntryHandle->Options & __FILE_VOLATILE)) {
             VfsFlushFile(Requester, Handle);
-            free(EntryHandle->OutBuffer);
+            OutBuffer = EntryHandle->OutBuffer;
         }
     }
 
+    // Take the handle out of circulation before it is destroyed by the filesystem
+    Node    = VfsRemoveHandle(EntryHandle);
+
     // Call the filesystem close-handle to cleanup
     Fs      = (FileSystem_t*)EntryHandle->Entry->System;
     Code    = Fs->Module->CloseHandle(&Fs->Descriptor, EntryHandle);
     if (Code != FsOk) {
+        VfsLockHandles();
+        CollectionAppend(VfsGetOpenHandles(), Node);
+        VfsUnlockHandles();
         return Code;
     }
-    CollectionRemoveByNode(VfsGetOpenHandles(), Node);
+    free(OutBuffer);
     free(Node);
 
     // Take care of any entry cleanup / reduction
-    Entry->References--;
+    VfsLockEntry(Entry);
+    References = --Entry->References;
     if (Entry->IsLocked == Requester) {
         Entry->IsLocked = UUID_INVALID;
     }
+    VfsUnlockEntry(Entry);
 
     // Last reference?
     // Cleanup the file in case of no refs
-    if (Entry->References == 0) {
+    if (References == 0) {
         Key.Value.Id = Entry->Hash;
         CollectionRemoveByKey(VfsGetOpenFiles(), Key);
+        VfsPathIndexRemove(Entry);
         Code = Fs->Module->CloseEntry(&Fs->Descriptor, Entry);
     }
     return Code;
@@ -466,6 +542,7 @@ VfsDeletePath(
 {
     FileSystemEntryHandle_t* EntryHandle;
     FileSystemCode_t Code;
+    CollectionItem_t* Node;
     FileSystem_t *Fs;
     MString_t *SubPath = NULL;
     MString_t *mPath;
@@ -496,13 +573,21 @@ VfsDeletePath(
         if (Code != FsOk) {
             return Code;
         }
+        // The entry and handle are released by the filesystem on success
         Key.Value.Id    = EntryHandle->Entry->Hash;
+        Node            = VfsRemoveHandle(EntryHandle);
+        VfsPathIndexRemove(EntryHandle->Entry);
         Code            = Fs->Module->DeleteEntry(&Fs->Descriptor, EntryHandle);
-        if (Code == FsOk) {
-            // Cleanup handles and open file
+        if (Code != FsOk) {
+            VfsPathIndexAdd(EntryHandle->Entry);
+            VfsLockHandles();
+            CollectionAppend(VfsGetOpenHandles(), Node);
+            VfsUnlockHandles();
+        }
+        else {
+            // Cleanup the open file
             CollectionRemoveByKey(VfsGetOpenFiles(), Key);
-            Key.Value.Id = Handle;
-            CollectionRemoveByKey(VfsGetOpenHandles(), Key);
+            free(Node);
         }
     }
     return Code;
@@ -550,8 +635,10 @@ VfsReadEntry(
     Fs      = (FileSystem_t*)EntryHandle->Entry->System;
     Code    = Fs->Module->ReadEntry(&Fs->Descriptor, EntryHandle, Buffer, Length, BytesIndex, BytesRead);
     if (Code == FsOk) {
+        VfsLockHandle(EntryHandle);
         EntryHandle->LastOperation  = __FILE_OPERATION_READ;
         EntryHandle->Position       += *BytesRead;
+        VfsUnlockHandle(EntryHandle);
     }
     DestroyBuffer(Buffer);
     return Code;
@@ -600,11 +687,15 @@ VsfWriteEntry(
     Fs      = (FileSystem_t*)EntryHandle->Entry->System;
     Code    = Fs->Module->WriteEntry(&Fs->Descriptor, EntryHandle, Buffer, Length, BytesWritten);
     if (Code == FsOk) {
+        VfsLockHandle(EntryHandle);
         EntryHandle->LastOperation  = __FILE_OPERATION_WRITE;
         EntryHandle->Position       += *BytesWritten;
+        VfsLockEntry(EntryHandle->Entry);
         if (EntryHandle->Position > EntryHandle->Entry->Descriptor.Size.QuadPart) {
             EntryHandle->Entry->Descriptor.Size.QuadPart = EntryHandle->Position;
         }
+        VfsUnlockEntry(EntryHandle->Entry);
+        VfsUnlockHandle(EntryHandle);
     }
     DestroyBuffer(Buffer);
     return Code;
@@ -651,8 +742,10 @@ VfsSeekInEntry(
     Fs      = (FileSystem_t*)EntryHandle->Entry->System;
     Code    = Fs->Module->SeekInEntry(&Fs->Descriptor, EntryHandle, SeekAbs.Full);
     if (Code == FsOk) {
+        VfsLockHandle(EntryHandle);
         EntryHandle->LastOperation      = __FILE_OPERATION_NONE;
         EntryHandle->OutBufferPosition  = 0;
+        VfsUnlockHandle(EntryHandle);
     }
     return Code;
 }
@@ -726,13 +819,14 @@ VfsGetEntryPosition(
     FileSystemEntryHandle_t *EntryHandle = NULL;
     FileSystemCode_t Code;
 
-    Code = VfsIsHandleValid(Requester, Handle, 0, &EntryHandle);
+    Code = VfsAcquireHandle(Requester, Handle, 0, &EntryHandle);
     if (Code != FsOk) {
         return OsError;
     }
 
     Result->Value.Full  = EntryHandle->Position;
     Result->Code        = Code;
+    VfsReleaseHandle(EntryHandle);
     return OsSuccess;
 }
 
@@ -747,7 +841,7 @@ VfsGetEntryOptions(
     FileSystemEntryHandle_t *EntryHandle = NULL;
     FileSystemCode_t Code;
 
-    Code = VfsIsHandleValid(Requester, Handle, 0, &EntryHandle);
+    Code = VfsAcquireHandle(Requester, Handle, 0, &EntryHandle);
     if (Code != FsOk) {
         return OsError;
     }
@@ -755,6 +849,7 @@ VfsGetEntryOptions(
     Result->Options = EntryHandle->Options;
     Result->Access  = EntryHandle->Access;
     Result->Code    = Code;
+    VfsReleaseHandle(EntryHandle);
     return OsSuccess;
 }
 
@@ -771,13 +866,14 @@ VfsSetEntryOptions(
     FileSystemEntryHandle_t *EntryHandle = NULL;
     FileSystemCode_t Code;
 
-    Code = VfsIsHandleValid(Requester, Handle, 0, &EntryHandle);
+    Code = VfsAcquireHandle(Requester, Handle, 0, &EntryHandle);
     if (Code != FsOk) {
         return OsError;
     }
 
     EntryHandle->Options    = Options;
     EntryHandle->Access     = Access;
+    VfsReleaseHandle(EntryHandle);
     return OsSuccess;
 }
 
@@ -794,13 +890,16 @@ VfsGetEntrySize(
     FileSystemEntryHandle_t *EntryHandle = NULL;
     FileSystemCode_t Code;
 
-    Code = VfsIsHandleValid(Requester, Handle, 0, &EntryHandle);
+    Code = VfsAcquireHandle(Requester, Handle, 0, &EntryHandle);
     if (Code != FsOk) {
         return OsError;
     }
     
+    VfsLockEntry(EntryHandle->Entry);
     Result->Value.Full  = EntryHandle->Entry->Descriptor.Size.QuadPart;
+    VfsUnlockEntry(EntryHandle->Entry);
     Result->Code        = Code;
+    VfsReleaseHandle(EntryHandle);
     return OsSuccess;
 }
 
@@ -816,13 +915,14 @@ VfsGetEntryPath(
     FileSystemEntryHandle_t *EntryHandle = NULL;
     FileSystemCode_t Code;
 
-    Code = VfsIsHandleValid(Requester, Handle, 0, &EntryHandle);
+    Code = VfsAcquireHandle(Requester, Handle, 0, &EntryHandle);
     if (Code != FsOk) {
         return OsError;
     }
     
-    *Path = EntryHandle->Entry->Path;
-    return OsSuccess;
+    *Path = MStringClone(EntryHandle->Entry->Path);
+    VfsReleaseHandle(EntryHandle);
+    return (*Path != NULL) ? OsSuccess : OsError;
 }
 
 /* VfsQueryEntryPath
@@ -856,9 +956,12 @@ VfsQueryEntryHandle(
     FileSystemEntryHandle_t *EntryHandle = NULL;
     FileSystemCode_t Code;
 
-    Code = VfsIsHandleValid(Requester, Handle, 0, &EntryHandle);
+    Code = VfsAcquireHandle(Requester, Handle, 0, &EntryHandle);
     if (Code == FsOk) {
+        VfsLockEntry(EntryHandle->Entry);
         memcpy((void*)Information, (const void*)&EntryHandle->Entry->Descriptor, sizeof(OsFileDescriptor_t));
+        VfsUnlockEntry(EntryHandle->Entry);
+        VfsReleaseHandle(EntryHandle);
     }
     return Code;
 }
@@ -32,11 +32,13 @@
 #include <os/mollenos.h>
 #include <ddk/buffer.h>
 #include <ds/mstring.h>
+#include <threads.h>
 
 /* VFS Definitions 
  * - General identifiers can be used in paths */
 #define __FILEMANAGER_RESOLVEQUEUE      IPC_DECL_FUNCTION(10000)
 #define __FILEMANAGER_MAXDISKS          64
+#define __FILEMANAGER_LOCK_STRIPES      64
 
 #define __FILE_OPERATION_NONE           0x00000000
 #define __FILE_OPERATION_READ           0x00000001
@@ -86,8 +88,31 @@ typedef struct _FileSystem {
     MString_t*                  Identifier;
     FileSystemDescriptor_t      Descriptor;
     FileSystemModule_t*         Module;
+    struct _VfsWorker*          Worker;
 } FileSystem_t;
 
+/* VFS Request structure
+ * A copy of a rpc message that has been queued for a filesystem worker, all buffer
+ * arguments are copied into the request as the listener reuses its argument buffer. */
+typedef struct _VfsRequest {
+    struct _VfsRequest*         Link;
+    MRemoteCall_t               Message;
+    uint8_t                     Arguments[];
+} VfsRequest_t;
+
+/* VFS Worker structure
+ * Each mounted filesystem has a worker thread that executes all requests targetting
+ * that filesystem in order, which allows independent filesystems to run in parallel. */
+typedef struct _VfsWorker {
+    mtx_t                       SyncObject;
+    cnd_t                       Signal;
+    thrd_t                      Thread;
+    int                         Running;
+    VfsRequest_t*               Head;
+    VfsRequest_t*               Tail;
+    size_t                      Queued;
+} VfsWorker_t;
+
 /* DiskRegisterFileSystem 
  * Registers a new filesystem of the given type, on
  * the given disk with the given position on the disk 
@@ -158,6 +183,66 @@ __EXTERN UUId_t VfsIdentifierFileGet(void);
 __EXTERN Collection_t* VfsGetOpenFiles(void);
 __EXTERN Collection_t* VfsGetOpenHandles(void);
 
+/* VfsLockFileSystems / VfsUnlockFileSystems
+ * Protects the list of filesystems against modification while it is being searched. */
+__EXTERN void VfsLockFileSystems(void);
+__EXTERN void VfsUnlockFileSystems(void);
+
+/* VfsLockHandles / VfsUnlockHandles
+ * Protects the list of open handles, a handle must be removed from the list while
+ * this lock is held before it can be destroyed. */
+__EXTERN void VfsLockHandles(void);
+__EXTERN void VfsUnlockHandles(void);
+
+/* VfsLockHandle / VfsUnlockHandle
+ * Protects the state of the handle (position, options and access) */
+__EXTERN void VfsLockHandle(FileSystemEntryHandle_t* Handle);
+__EXTERN void VfsUnlockHandle(FileSystemEntryHandle_t* Handle);
+
+/* VfsLockEntry / VfsUnlockEntry
+ * Protects the state of the entry (descriptor, lock owner and references) */
+__EXTERN void VfsLockEntry(FileSystemEntry_t* Entry);
+__EXTERN void VfsUnlockEntry(FileSystemEntry_t* Entry);
+
+/* VfsPathIndexAdd / VfsPathIndexRemove
+ * Adds or removes an open entry from the path index. Entries must be removed before
+ * they are released by the filesystem. */
+__EXTERN void VfsPathIndexAdd(FileSystemEntry_t* Entry);
+__EXTERN void VfsPathIndexRemove(FileSystemEntry_t* Entry);
+
+/* VfsPathIndexLookup
+ * Retrieves the open entry for the given path, NULL if the path is not open. */
+__EXTERN FileSystemEntry_t* VfsPathIndexLookup(MString_t* Path);
+
+/* VfsPathIndexHasDescendants
+ * Returns whether or not any entries are open beneath the given path. */
+__EXTERN int VfsPathIndexHasDescendants(MString_t* Path);
+
+/* VfsWorkerCreate
+ * Starts the worker thread that processes requests for the given filesystem. */
+__EXTERN OsStatus_t
+VfsWorkerCreate(
+    _In_ FileSystem_t*              FileSystem);
+
+/* VfsWorkerDestroy
+ * Completes all queued requests for the filesystem and stops the worker thread. */
+__EXTERN void
+VfsWorkerDestroy(
+    _In_ FileSystem_t*              FileSystem);
+
+/* VfsWorkerDispatch
+ * Queues the message for the worker of the filesystem it targets. Returns OsError
+ * if the message must be handled by the caller instead. */
+__EXTERN OsStatus_t
+VfsWorkerDispatch(
+    _In_ MRemoteCall_t*             Message);
+
+/* VfsHandleRequest
+ * Executes the request and responds to the caller. */
+__EXTERN OsStatus_t
+VfsHandleRequest(
+    _In_ MRemoteCall_t*             Message);
+
 /* VfsIdentifierAllocate 
  * Allocates a free identifier index for the
  * given disk, it varies based upon disk type */
@@ -190,6 +275,33 @@ VfsUnregisterDisk(
     _In_ UUId_t                     Device, 
     _In_ Flags_t                    Flags);
 
+/* VfsGetFileSystemFromPath
+ * Retrieves the filesystem handle associated with the given path. */
+__EXTERN FileSystem_t*
+VfsGetFileSystemFromPath(
+    _In_  MString_t*                Path,
+    _Out_ MString_t**               SubPath);
+
+/* VfsResolvePath
+ * Resolves the undetermined abs or relative path. */
+__EXTERN MString_t*
+VfsResolvePath(
+    _In_ UUId_t                     Requester,
+    _In_ const char*                Path);
+
+/* VfsAcquireHandle / VfsReleaseHandle
+ * Validates the handle like VfsIsHandleValid and keeps it locked, so it can be
+ * accessed from outside of the worker of its filesystem until it is released. */
+__EXTERN FileSystemCode_t
+VfsAcquireHandle(
+    _In_  UUId_t                    Requester,
+    _In_  UUId_t                    Handle,
+    _In_  Flags_t                   RequiredAccess,
+    _Out_ FileSystemEntryHandle_t** EntryHandle);
+__EXTERN void
+VfsReleaseHandle(
+    _In_ FileSystemEntryHandle_t*   EntryHandle);
+
 /* VfsOpenEntry
  * Opens or creates the given file path based on
  * the given <Access> and <Options> flags. See the top of this file */
@@ -309,7 +421,8 @@ VfsGetEntrySize(
 
 /* VfsGetEntryPath 
  * Queries the full path of a file-entry that the given handle
- * has, it returns it as a UTF8 string with max length of _MAXPATH */
+ * has, it returns it as a UTF8 string with max length of _MAXPATH.
+ * The returned string is a copy and must be destroyed by the caller. */
 __EXTERN OsStatus_t
 VfsGetEntryPath(
     _In_  UUId_t                    Requester,
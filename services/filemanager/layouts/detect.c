@@ -43,7 +43,7 @@ OsStatus_t DiskDetectFileSystem(FileSystemDisk_t *Disk,
 
 	// Make sure the MBR is loaded
 	if (StorageRead(Disk->Driver, Disk->Device, Sector, 
-		GetBufferDma(Buffer), 1, &SectorsRead) != OsSuccess) {
+		GetBufferHandle(Buffer), 0, 1, &SectorsRead) != OsSuccess) {
 		return OsError;
 	}
 
@@ -108,7 +108,7 @@ OsStatus_t DiskDetectLayout(FileSystemDisk_t *Disk)
 	// for the disk - we can easily just read sector LBA 1
 	// and look for the GPT signature
 	if (StorageRead(Disk->Driver, Disk->Device, 1, 
-		GetBufferDma(Buffer), 1, &SectorsRead) != OsSuccess) {
+		GetBufferHandle(Buffer), 0, 1, &SectorsRead) != OsSuccess) {
 		DestroyBuffer(Buffer);
 		return OsError;
 	}
@@ -43,7 +43,7 @@ OsStatus_t MbrEnumeratePartitions(FileSystemDisk_t *Disk,
     // Start out by reading the mbr to detect whether
     // or not there is a partition table
     if (StorageRead(Disk->Driver, Disk->Device, Sector, 
-        GetBufferDma(Buffer), 1, &SectorsRead) != OsSuccess) {
+        GetBufferHandle(Buffer), 0, 1, &SectorsRead) != OsSuccess) {
         return OsError;
     }
 
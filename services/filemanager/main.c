@@ -27,6 +27,7 @@
 #include <ddk/utils.h>
 
 #include <ds/collection.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -71,8 +72,15 @@ static Collection_t OpenFiles       = COLLECTION_INIT(KeyId);
 static Collection_t Modules         = COLLECTION_INIT(KeyId);
 static Collection_t Disks           = COLLECTION_INIT(KeyId);
 
+// Handles and entries are locked by striping on their identifiers, as the structures
+// are shared with the filesystem modules
+static mtx_t FileSystemsLock;
+static mtx_t HandlesLock;
+static mtx_t HandleLocks[__FILEMANAGER_LOCK_STRIPES];
+static mtx_t EntryLocks[__FILEMANAGER_LOCK_STRIPES];
+
 //static UUId_t FileSystemIdGenerator = 0;
-static UUId_t FileIdGenerator = 0;
+static _Atomic(UUId_t) FileIdGenerator = ATOMIC_VAR_INIT(0);
 
 /* VfsGetOpenFiles / VfsGetOpenHandles
  * Retrieves the list of open files /handles and allows access and manipulation of the list */
@@ -116,11 +124,64 @@ VfsGetResolverQueue(void) {
     return &ResolveQueue;
 }
 
+/* VfsLockFileSystems / VfsUnlockFileSystems
+ * Protects the list of filesystems against modification while it is being searched. */
+void
+VfsLockFileSystems(void) {
+    mtx_lock(&FileSystemsLock);
+}
+
+void
+VfsUnlockFileSystems(void) {
+    mtx_unlock(&FileSystemsLock);
+}
+
+/* VfsLockHandles / VfsUnlockHandles
+ * Protects the list of open handles, a handle must be removed from the list while
+ * this lock is held before it can be destroyed. */
+void
+VfsLockHandles(void) {
+    mtx_lock(&HandlesLock);
+}
+
+void
+VfsUnlockHandles(void) {
+    mtx_unlock(&HandlesLock);
+}
+
+/* VfsLockHandle / VfsUnlockHandle
+ * Protects the state of the handle (position, options and access) */
+void
+VfsLockHandle(
+    _In_ FileSystemEntryHandle_t* Handle) {
+    mtx_lock(&HandleLocks[Handle->Id % __FILEMANAGER_LOCK_STRIPES]);
+}
+
+void
+VfsUnlockHandle(
+    _In_ FileSystemEntryHandle_t* Handle) {
+    mtx_unlock(&HandleLocks[Handle->Id % __FILEMANAGER_LOCK_STRIPES]);
+}
+
+/* VfsLockEntry / VfsUnlockEntry
+ * Protects the state of the entry (descriptor, lock owner and references) */
+void
+VfsLockEntry(
+    _In_ FileSystemEntry_t* Entry) {
+    mtx_lock(&EntryLocks[Entry->Hash % __FILEMANAGER_LOCK_STRIPES]);
+}
+
+void
+VfsUnlockEntry(
+    _In_ FileSystemEntry_t* Entry) {
+    mtx_unlock(&EntryLocks[Entry->Hash % __FILEMANAGER_LOCK_STRIPES]);
+}
+
 /* VfsIdentifierFileGet
  * Retrieves a new identifier for a file-handle that is system-wide unique */
 UUId_t
 VfsIdentifierFileGet(void) {
-    return FileIdGenerator++;
+    return atomic_fetch_add(&FileIdGenerator, 1);
 }
 
 /* VfsIdentifierAllocate 
@@ -176,6 +237,14 @@ VfsIdentifierFree(
 OsStatus_t
 OnLoad(void)
 {
+    int i;
+
+    mtx_init(&FileSystemsLock, mtx_plain);
+    mtx_init(&HandlesLock, mtx_plain);
+    for (i = 0; i < __FILEMANAGER_LOCK_STRIPES; i++) {
+        mtx_init(&HandleLocks[i], mtx_plain);
+        mtx_init(&EntryLocks[i], mtx_plain);
+    }
     return RegisterService(__FILEMANAGER_TARGET);
 }
 
@@ -190,10 +259,23 @@ OnUnload(void)
 
 /* OnEvent
  * This is called when the server recieved an external evnet
- * and should handle the given event*/
+ * and should handle the given event. Requests that target a filesystem
+ * are handed to the worker of that filesystem. */
 OsStatus_t
 OnEvent(
     _In_ MRemoteCall_t *Message)
+{
+    if (VfsWorkerDispatch(Message) == OsSuccess) {
+        return OsSuccess;
+    }
+    return VfsHandleRequest(Message);
+}
+
+/* VfsHandleRequest
+ * Executes the request and responds to the caller. */
+OsStatus_t
+VfsHandleRequest(
+    _In_ MRemoteCall_t *Message)
 {
     // Variables
     OsStatus_t Result = OsSuccess;
@@ -351,6 +433,7 @@ OnEvent(
             }
             else {
                 Result = RPCRespond(&Message->From, MStringRaw(FilePath), MStringSize(FilePath) + 1);
+                MStringDestroy(FilePath);
             }
         } break;
 
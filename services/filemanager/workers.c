@@ -0,0 +1,287 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - File Manager Service
+ * - Filesystem workers, requests that target a filesystem are executed in order by
+ *   the worker of that filesystem, so independent filesystems proceed in parallel.
+ *   Filesystems are only mounted and unmounted by the listener thread, which is also
+ *   the only thread that dispatches requests, so a filesystem found during dispatch
+ *   stays valid until the request has been queued.
+ */
+//#define __TRACE
+
+#include "include/vfs.h"
+#include <os/services/file.h>
+#include <ddk/services/file.h>
+#include <ddk/utils.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int
+VfsWorkerMain(
+    _In_ void* Context)
+{
+    VfsWorker_t*  Worker = (VfsWorker_t*)Context;
+    VfsRequest_t* Request;
+
+    while (1) {
+        mtx_lock(&Worker->SyncObject);
+        while (Worker->Head == NULL && Worker->Running) {
+            cnd_wait(&Worker->Signal, &Worker->SyncObject);
+        }
+
+        // Drain the queue completely before honoring a stop
+        Request = Worker->Head;
+        if (Request == NULL) {
+            mtx_unlock(&Worker->SyncObject);
+            break;
+        }
+        Worker->Head = Request->Link;
+        if (Worker->Head == NULL) {
+            Worker->Tail = NULL;
+        }
+        Worker->Queued--;
+        mtx_unlock(&Worker->SyncObject);
+
+        VfsHandleRequest(&Request->Message);
+        free(Request);
+    }
+    return 0;
+}
+
+/* VfsRequestCreate
+ * Copies the message and all its buffer arguments. If <Path> is given it replaces the
+ * first argument of the message. */
+static VfsRequest_t*
+VfsRequestCreate(
+    _In_ MRemoteCall_t* Message,
+    _In_ MString_t*     Path)
+{
+    VfsRequest_t* Request;
+    size_t        Length = 0;
+    size_t        Offset = 0;
+    int           i;
+
+    if (Path != NULL) {
+        Length += MStringSize(Path) + 1;
+    }
+    for (i = (Path != NULL) ? 1 : 0; i < IPC_MAX_ARGUMENTS; i++) {
+        if (Message->Arguments[i].Type == ARGUMENT_BUFFER) {
+            Length += Message->Arguments[i].Length;
+        }
+    }
+
+    Request = (VfsRequest_t*)malloc(sizeof(VfsRequest_t) + Length);
+    if (Request == NULL) {
+        return NULL;
+    }
+    memcpy(&Request->Message, Message, sizeof(MRemoteCall_t));
+    Request->Link = NULL;
+
+    if (Path != NULL) {
+        memcpy(&Request->Arguments[0], MStringRaw(Path), MStringSize(Path) + 1);
+        Request->Message.Arguments[0].Type        = ARGUMENT_BUFFER;
+        Request->Message.Arguments[0].Data.Buffer = &Request->Arguments[0];
+        Request->Message.Arguments[0].Length      = MStringSize(Path) + 1;
+        Offset = MStringSize(Path) + 1;
+    }
+    for (i = (Path != NULL) ? 1 : 0; i < IPC_MAX_ARGUMENTS; i++) {
+        if (Message->Arguments[i].Type == ARGUMENT_BUFFER) {
+            memcpy(&Request->Arguments[Offset], Message->Arguments[i].Data.Buffer,
+                Message->Arguments[i].Length);
+            Request->Message.Arguments[i].Data.Buffer = &Request->Arguments[Offset];
+            Offset += Message->Arguments[i].Length;
+        }
+    }
+    return Request;
+}
+
+/* VfsWorkerQueue
+ * Appends the request to the queue of the worker and wakes it up. */
+static void
+VfsWorkerQueue(
+    _In_ VfsWorker_t*  Worker,
+    _In_ VfsRequest_t* Request)
+{
+    mtx_lock(&Worker->SyncObject);
+    if (Worker->Tail == NULL) {
+        Worker->Head = Request;
+    }
+    else {
+        Worker->Tail->Link = Request;
+    }
+    Worker->Tail = Request;
+    Worker->Queued++;
+    cnd_signal(&Worker->Signal);
+    mtx_unlock(&Worker->SyncObject);
+}
+
+/* VfsWorkerCreate
+ * Starts the worker thread that processes requests for the given filesystem. */
+OsStatus_t
+VfsWorkerCreate(
+    _In_ FileSystem_t* FileSystem)
+{
+    VfsWorker_t* Worker = (VfsWorker_t*)malloc(sizeof(VfsWorker_t));
+    if (Worker == NULL) {
+        return OsError;
+    }
+
+    memset(Worker, 0, sizeof(VfsWorker_t));
+    Worker->Running = 1;
+    mtx_init(&Worker->SyncObject, mtx_plain);
+    if (cnd_init(&Worker->Signal) != thrd_success) {
+        free(Worker);
+        return OsError;
+    }
+
+    if (thrd_create(&Worker->Thread, VfsWorkerMain, Worker) != thrd_success) {
+        ERROR("Failed to create worker for filesystem %s", MStringRaw(FileSystem->Identifier));
+        cnd_destroy(&Worker->Signal);
+        free(Worker);
+        return OsError;
+    }
+    FileSystem->Worker = Worker;
+    return OsSuccess;
+}
+
+/* VfsWorkerDestroy
+ * Completes all queued requests for the filesystem and stops the worker thread. */
+void
+VfsWorkerDestroy(
+    _In_ FileSystem_t* FileSystem)
+{
+    VfsWorker_t* Worker = FileSystem->Worker;
+    if (Worker == NULL) {
+        return;
+    }
+
+    mtx_lock(&Worker->SyncObject);
+    Worker->Running = 0;
+    cnd_signal(&Worker->Signal);
+    mtx_unlock(&Worker->SyncObject);
+
+    thrd_join(Worker->Thread, NULL);
+    cnd_destroy(&Worker->Signal);
+    FileSystem->Worker = NULL;
+    free(Worker);
+}
+
+/* VfsWorkerRouteHandle
+ * Retrieves the filesystem of the entry the handle is opened on. */
+static FileSystem_t*
+VfsWorkerRouteHandle(
+    _In_ UUId_t Handle)
+{
+    FileSystemEntryHandle_t* EntryHandle;
+    CollectionItem_t*        Node;
+    FileSystem_t*            FileSystem = NULL;
+    DataKey_t                Key = { .Value.Id = Handle };
+
+    VfsLockHandles();
+    Node = CollectionGetNodeByKey(VfsGetOpenHandles(), Key, 0);
+    if (Node != NULL) {
+        EntryHandle = (FileSystemEntryHandle_t*)Node->Data;
+        FileSystem  = (FileSystem_t*)EntryHandle->Entry->System;
+    }
+    VfsUnlockHandles();
+    return FileSystem;
+}
+
+/* VfsWorkerRoutePath
+ * Resolves the path of the message and retrieves the filesystem it belongs to. The
+ * resolved path is returned so the worker does not need to resolve it again. */
+static FileSystem_t*
+VfsWorkerRoutePath(
+    _In_  MRemoteCall_t* Message,
+    _Out_ MString_t**    Resolved)
+{
+    const char*   Path = RPCGetStringArgument(Message, 0);
+    FileSystem_t* FileSystem;
+    MString_t*    SubPath;
+
+    *Resolved = NULL;
+    if (Path == NULL) {
+        return NULL;
+    }
+
+    *Resolved = VfsResolvePath(Message->From.Process, Path);
+    if (*Resolved == NULL) {
+        return NULL;
+    }
+
+    FileSystem = VfsGetFileSystemFromPath(*Resolved, &SubPath);
+    if (FileSystem != NULL) {
+        MStringDestroy(SubPath);
+    }
+    return FileSystem;
+}
+
+/* VfsWorkerDispatch
+ * Queues the message for the worker of the filesystem it targets. Returns OsError
+ * if the message must be handled by the caller instead. */
+OsStatus_t
+VfsWorkerDispatch(
+    _In_ MRemoteCall_t* Message)
+{
+    FileSystem_t* FileSystem = NULL;
+    MString_t*    Path       = NULL;
+    VfsRequest_t* Request;
+
+    switch (Message->Function) {
+        // Operations that access the filesystem through a handle
+        case __FILEMANAGER_CLOSE:
+        case __FILEMANAGER_READ:
+        case __FILEMANAGER_WRITE:
+        case __FILEMANAGER_SEEK:
+        case __FILEMANAGER_FLUSH: {
+            FileSystem = VfsWorkerRouteHandle((UUId_t)Message->Arguments[0].Data.Value);
+        } break;
+
+        // Operations that access the filesystem through a path
+        case __FILEMANAGER_OPEN:
+        case __FILEMANAGER_GETSTATSBYPATH:
+        case __FILEMANAGER_DELETEPATH: {
+            FileSystem = VfsWorkerRoutePath(Message, &Path);
+        } break;
+
+        // Handle queries only access the state of the handle and are answered directly,
+        // and disk registration and path resolving are not bound to a filesystem
+        default: {
+        } break;
+    }
+
+    if (FileSystem == NULL || FileSystem->Worker == NULL) {
+        if (Path != NULL) {
+            MStringDestroy(Path);
+        }
+        return OsError;
+    }
+
+    Request = VfsRequestCreate(Message, Path);
+    if (Path != NULL) {
+        MStringDestroy(Path);
+    }
+    if (Request == NULL) {
+        return OsError;
+    }
+
+    TRACE("VfsWorkerDispatch(%i) => %s", Message->Function, MStringRaw(FileSystem->Identifier));
+    VfsWorkerQueue(FileSystem->Worker, Request);
+    return OsSuccess;
+}
@@ -261,7 +261,7 @@ LoadFile(
 
     Size = (size_t)QueriedSize.QuadPart;
     if (Size != 0) {
-        DmaBuffer_t* TransferBuffer = CreateBuffer(UUID_INVALID, Size);
+        DmaBuffer_t* TransferBuffer = CreateScatterGatherBuffer(Size);
         if (TransferBuffer != NULL) {
             Buffer = dsalloc(Size);
             if (Buffer != NULL) {
@@ -325,7 +325,6 @@ CreateProcess(
 {
     ThreadParameters_t Paramaters;
     Process_t*         Process;
-    MString_t*         PathAsMString;
     size_t             PathLength;
     char*              ArgumentsPointer;
     int                Index;
@@ -346,9 +345,7 @@ CreateProcess(
     SpinlockReset(&Process->SyncObject, SPINLOCK_RECURSIVE);
 
     // Load the executable
-    PathAsMString = MStringCreate((void*)Path, StrUTF8);
-    Status        = PeLoadImage(Owner, NULL, PathAsMString, &Process->Executable);
-    MStringDestroy(PathAsMString);
+    Status = LoadProcessImage(Owner, Path, &Process->Executable);
     if (Status != OsSuccess) {
         ERROR(" > failed to load executable");
         free(Process);
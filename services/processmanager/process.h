@@ -85,6 +85,15 @@ CreateProcess(
     _In_  size_t                       InheritationBlockLength,
     _Out_ UUId_t*                      Handle);
 
+/* LoadProcessImage
+ * Creates the image for a new process of the executable at the given path, the image
+ * is cloned from a cached snapshot of the executable when possible. */
+__EXTERN OsStatus_t
+LoadProcessImage(
+    _In_  UUId_t           Owner,
+    _In_  const char*      Path,
+    _Out_ PeExecutable_t** ImageOut);
+
 /* JoinProcess
  * Waits for the process to exit and returns the exit code. A timeout can optionally be specified. */
 __EXTERN OsStatus_t
@@ -0,0 +1,241 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Process Manager
+ * - Spawn snapshots, keeps the fully linked image of recently spawned executables
+ *   so new processes of the same executable can be created without loading,
+ *   relocating and linking the executable and its libraries again.
+ */
+//#define __TRACE
+
+#include "../../librt/libds/pe/pe.h"
+#include <os/services/file.h>
+#include "process.h"
+#include <ds/mstring.h>
+#include <ddk/utils.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#define SNAPSHOT_CACHE_SIZE 16
+
+typedef struct _ProcessSnapshotFile {
+    long            Id;
+    LargeUInteger_t Size;
+    struct timespec ModifiedAt;
+} ProcessSnapshotFile_t;
+
+typedef struct _ProcessSnapshot {
+    MString_t*             Path;
+    PeExecutable_t*        Image;
+    clock_t                LastUsed;
+    int                    FileCount;
+    ProcessSnapshotFile_t* Files;
+} ProcessSnapshot_t;
+
+static ProcessSnapshot_t* Snapshots[SNAPSHOT_CACHE_SIZE] = { 0 };
+static mtx_t              SnapshotLock                   = MUTEX_INIT(mtx_plain);
+
+static void
+DestroySnapshot(
+    _In_ ProcessSnapshot_t* Snapshot)
+{
+    MStringDestroy(Snapshot->Path);
+    PeUnloadSnapshot(Snapshot->Image);
+    free(Snapshot->Files);
+    free(Snapshot);
+}
+
+static int
+CompareSnapshotFile(
+    _In_ ProcessSnapshotFile_t* File,
+    _In_ ProcessSnapshotFile_t* Recorded)
+{
+    return File->Id == Recorded->Id && File->Size.QuadPart == Recorded->Size.QuadPart &&
+        File->ModifiedAt.tv_sec == Recorded->ModifiedAt.tv_sec &&
+        File->ModifiedAt.tv_nsec == Recorded->ModifiedAt.tv_nsec;
+}
+
+static OsStatus_t
+QuerySnapshotFile(
+    _In_  PeExecutable_t*        Image,
+    _Out_ ProcessSnapshotFile_t* File)
+{
+    OsFileDescriptor_t FileStats;
+    if (GetFileStatsByPath(MStringRaw(Image->FullPath), &FileStats) != FsOk) {
+        return OsError;
+    }
+    File->Id         = FileStats.Id;
+    File->Size       = FileStats.Size;
+    File->ModifiedAt = FileStats.ModifiedAt;
+    return OsSuccess;
+}
+
+/* ValidateSnapshot
+ * A snapshot is only valid as long as none of the files in the image graph has
+ * been replaced or modified since the snapshot was taken. */
+static int
+ValidateSnapshot(
+    _In_ ProcessSnapshot_t* Snapshot)
+{
+    ProcessSnapshotFile_t File;
+    int                   Index = 0;
+
+    if (QuerySnapshotFile(Snapshot->Image, &File) != OsSuccess ||
+        !CompareSnapshotFile(&File, &Snapshot->Files[Index++])) {
+        return 0;
+    }
+
+    foreach(Node, Snapshot->Image->Libraries) {
+        if (QuerySnapshotFile((PeExecutable_t*)Node->Data, &File) != OsSuccess ||
+            !CompareSnapshotFile(&File, &Snapshot->Files[Index++])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* CreateSnapshot
+ * Records the identity of every file in the image graph, the snapshot is discarded
+ * if any of the files can't be queried as it could then never be validated. */
+static ProcessSnapshot_t*
+CreateSnapshot(
+    _In_ MString_t*      Path,
+    _In_ PeExecutable_t* Image)
+{
+    ProcessSnapshot_t* Snapshot;
+    int                Index = 0;
+
+    Snapshot = (ProcessSnapshot_t*)malloc(sizeof(ProcessSnapshot_t));
+    if (Snapshot == NULL) {
+        PeUnloadImage(Image);
+        return NULL;
+    }
+
+    Snapshot->Path      = MStringClone(Path);
+    Snapshot->Image     = Image;
+    Snapshot->LastUsed  = clock();
+    Snapshot->FileCount = 1 + CollectionLength(Image->Libraries);
+    Snapshot->Files     = (ProcessSnapshotFile_t*)malloc(
+        sizeof(ProcessSnapshotFile_t) * Snapshot->FileCount);
+    memset(Snapshot->Files, 0, sizeof(ProcessSnapshotFile_t) * Snapshot->FileCount);
+
+    if (QuerySnapshotFile(Image, &Snapshot->Files[Index++]) != OsSuccess) {
+        DestroySnapshot(Snapshot);
+        return NULL;
+    }
+    foreach(Node, Image->Libraries) {
+        if (QuerySnapshotFile((PeExecutable_t*)Node->Data, &Snapshot->Files[Index++]) != OsSuccess) {
+            DestroySnapshot(Snapshot);
+            return NULL;
+        }
+    }
+    return Snapshot;
+}
+
+/* InsertSnapshot
+ * Stores the snapshot in a free slot, or replaces the least recently used snapshot. An
+ * existing snapshot of the same executable is always replaced. */
+static void
+InsertSnapshot(
+    _In_ ProcessSnapshot_t* Snapshot)
+{
+    int Victim = 0;
+    int i;
+
+    for (i = 0; i < SNAPSHOT_CACHE_SIZE; i++) {
+        if (Snapshots[i] == NULL ||
+            MStringCompare(Snapshots[i]->Path, Snapshot->Path, 1) == MSTRING_FULL_MATCH) {
+            Victim = i;
+            break;
+        }
+        if (Snapshots[i]->LastUsed < Snapshots[Victim]->LastUsed) {
+            Victim = i;
+        }
+    }
+
+    if (Snapshots[Victim] != NULL) {
+        TRACE("InsertSnapshot evicting %s", MStringRaw(Snapshots[Victim]->Path));
+        DestroySnapshot(Snapshots[Victim]);
+    }
+    Snapshots[Victim] = Snapshot;
+}
+
+/* LoadProcessImage
+ * Creates the image for a new process of the executable at the given path. The image
+ * is cloned from a snapshot if one exists, otherwise the executable is loaded and a
+ * snapshot of the result is kept for the next process of the executable. */
+OsStatus_t
+LoadProcessImage(
+    _In_  UUId_t           Owner,
+    _In_  const char*      Path,
+    _Out_ PeExecutable_t** ImageOut)
+{
+    ProcessSnapshot_t* Snapshot = NULL;
+    PeExecutable_t*    SnapshotImage;
+    MString_t*         PathAsMString;
+    MString_t*         FullPath;
+    OsStatus_t         Status;
+    int                i;
+
+    PathAsMString = MStringCreate((void*)Path, StrUTF8);
+    Status        = ResolveFilePath(Owner, PathAsMString, &FullPath);
+    MStringDestroy(PathAsMString);
+    if (Status != OsSuccess) {
+        return Status;
+    }
+
+    mtx_lock(&SnapshotLock);
+    for (i = 0; i < SNAPSHOT_CACHE_SIZE; i++) {
+        if (Snapshots[i] != NULL &&
+            MStringCompare(Snapshots[i]->Path, FullPath, 1) == MSTRING_FULL_MATCH) {
+            if (ValidateSnapshot(Snapshots[i])) {
+                Snapshot = Snapshots[i];
+            }
+            else {
+                TRACE("LoadProcessImage %s was modified, discarding snapshot", MStringRaw(FullPath));
+                DestroySnapshot(Snapshots[i]);
+                Snapshots[i] = NULL;
+            }
+            break;
+        }
+    }
+
+    if (Snapshot != NULL) {
+        Snapshot->LastUsed = clock();
+        Status = PeCloneImage(Owner, Snapshot->Image, ImageOut);
+        mtx_unlock(&SnapshotLock);
+        MStringDestroy(FullPath);
+        return Status;
+    }
+    mtx_unlock(&SnapshotLock);
+
+    // The identities of the files are recorded after the load, as the libraries are
+    // not known before, so a file replaced during the load itself goes unnoticed
+    Status = PeLoadImageSnapshot(Owner, FullPath, ImageOut, &SnapshotImage);
+    if (Status == OsSuccess) {
+        Snapshot = CreateSnapshot(FullPath, SnapshotImage);
+        if (Snapshot != NULL) {
+            mtx_lock(&SnapshotLock);
+            InsertSnapshot(Snapshot);
+            mtx_unlock(&SnapshotLock);
+        }
+    }
+    MStringDestroy(FullPath);
+    return Status;
+}
@@ -247,9 +247,14 @@ UsbQueryConfigurationDescriptors(
                     Interface->NumInterface, Interface->AlternativeSetting, Interface->NumEndpoints, Interface->Class,
                     Interface->Subclass, Interface->Protocol);
 
-                // Store number of endpoints and generate an id
+                // Store number of endpoints and generate an id, alternate settings may
+                // speak another protocol than the default setting
                 UsbIfVersionMeta->Base.Id = Interface->AlternativeSetting;
                 UsbIfVersionMeta->Base.EndpointCount = Interface->NumEndpoints;
+                UsbIfVersionMeta->Base.Protocol = Interface->Protocol;
+                UsbIfVersionMeta->Exists = 1;
+                UsbInterface->Base.VersionCount = MAX(UsbInterface->Base.VersionCount, 
+                    Interface->AlternativeSetting + 1);
 
                 // Setup some state-machine variables
                 CurrentIfVersion = Interface->AlternativeSetting;
@@ -318,6 +323,39 @@ UsbQueryConfigurationDescriptors(
             // Increase the EP index
             EpIterator++;
         }
+        else if (Length == 6 && Type == USB_DESCRIPTOR_SS_EP_CPN) {
+            UsbSsEndpointCompanionDescriptor_t *Companion = (UsbSsEndpointCompanionDescriptor_t*)BufferPointer;
+            UsbHcEndpointDescriptor_t *HcEndpoint = NULL;
+
+            // The companion describes the endpoint that was parsed just before it
+            if (Device->Base.InterfaceCount == 0 || EpIterator == 0) {
+                goto NextEntry;
+            }
+            HcEndpoint = &Device->Interfaces[
+                Device->Base.InterfaceCount - 1].
+                    Versions[CurrentIfVersion].Endpoints[EpIterator - 1];
+
+            TRACE("Endpoint %u companion - MaxBurst %u, Attributes 0x%x",
+                HcEndpoint->Address, Companion->MaxBurst, Companion->Attributes);
+
+            HcEndpoint->MaxBurst = Companion->MaxBurst;
+            if (HcEndpoint->Type == EndpointBulk && USB_SS_COMPANION_MAXSTREAMS(Companion->Attributes) != 0) {
+                HcEndpoint->MaxStreams = (size_t)1 << USB_SS_COMPANION_MAXSTREAMS(Companion->Attributes);
+            }
+            else if (HcEndpoint->Type == EndpointIsochronous) {
+                HcEndpoint->Bandwidth = USB_SS_COMPANION_MULT(Companion->Attributes) + 1;
+            }
+        }
+        else if (Length == 4 && Type == USB_DESCRIPTOR_PIPE_USAGE) {
+            UsbPipeUsageDescriptor_t *PipeUsage = (UsbPipeUsageDescriptor_t*)BufferPointer;
+
+            // The pipe usage describes the endpoint that was parsed just before it
+            if (Device->Base.InterfaceCount == 0 || EpIterator == 0) {
+                goto NextEntry;
+            }
+            Device->Interfaces[Device->Base.InterfaceCount - 1].
+                Versions[CurrentIfVersion].Endpoints[EpIterator - 1].PipeUsage = PipeUsage->PipeId;
+        }
 
         // Go to next descriptor entry
     NextEntry:
@@ -430,7 +468,8 @@ UsbDeviceLoadDrivers(
     _In_ UsbDevice_t*           Device)
 {
     MCoreUsbDevice_t CoreDevice;
-    int              i;
+    int              EndpointIndex;
+    int              i, j;
 
     // Debug
     TRACE("UsbDeviceLoadDrivers()");
@@ -463,8 +502,23 @@ UsbDeviceLoadDrivers(
             const char *Identification = UsbGetIdentificationString(Device->Interfaces[i].Base.Class);
             memcpy(&CoreDevice.Interface, &Device->Interfaces[i].Base, 
                 sizeof(UsbHcInterface_t));
-            memcpy(&CoreDevice.Endpoints[1], &Device->Interfaces[i].Versions[0].Endpoints[0],
-                sizeof(UsbHcEndpointDescriptor_t) * Device->Interfaces[i].Versions[0].Base.EndpointCount);
+
+            // The endpoints of the default setting come first, the endpoints of the
+            // alternate settings follow so drivers can switch setting
+            EndpointIndex = 1;
+            for (j = 0; j < USB_MAX_VERSIONS; j++) {
+                UsbInterfaceVersion_t* Version = &Device->Interfaces[i].Versions[j];
+                int                    Count   = MIN(Version->Base.EndpointCount, USB_MAX_ENDPOINTS - EndpointIndex);
+                if (!Version->Exists) {
+                    continue;
+                }
+                memcpy(&CoreDevice.Interface.Versions[j], &Version->Base, sizeof(UsbHcInterfaceVersion_t));
+                CoreDevice.Interface.Versions[j].EndpointCount = Count;
+                CoreDevice.Interface.Versions[j].EndpointIndex = EndpointIndex;
+                memcpy(&CoreDevice.Endpoints[EndpointIndex], &Version->Endpoints[0],
+                    sizeof(UsbHcEndpointDescriptor_t) * Count);
+                EndpointIndex += Count;
+            }
 
             // Let interface determine the class/subclass
             memcpy(&CoreDevice.Base.Name[0], Identification, strlen(Identification));
@@ -603,9 +657,12 @@ UsbDeviceSetup(
     Device->Base.StringIndexSerialNumber    = DeviceDescriptor.StringIndexSerialNumber;
     Device->Base.ConfigurationCount         = DeviceDescriptor.ConfigurationCount;
     
-    // Update MPS
+    // Update MPS, superspeed devices report it as an exponent
     Device->Base.MaxPacketSize              = DeviceDescriptor.MaxPacketSize;
-    Device->ControlEndpoint.MaxPacketSize   = DeviceDescriptor.MaxPacketSize;
+    if (Device->Base.Speed == SuperSpeed) {
+        Device->Base.MaxPacketSize          = 1 << (DeviceDescriptor.MaxPacketSize & 0xF);
+    }
+    Device->ControlEndpoint.MaxPacketSize   = Device->Base.MaxPacketSize;
 
     // Query Config Descriptor
     if (UsbQueryConfigurationDescriptors(Controller, Device) != OsSuccess) {
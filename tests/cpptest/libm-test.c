@@ -4345,8 +4345,12 @@ check_ulp (void)
 }
 #endif
 
+#ifndef TEST_MAIN
+# define TEST_MAIN libm_main
+#endif
+
 int
-libm_main (int argc, char **argv)
+TEST_MAIN (int argc, char **argv)
 {
 #if 0 /* XXX scp XXX */
   int remaining;
@@ -4389,6 +4393,16 @@ libm_main (int argc, char **argv)
   check_ulp ();
 #endif
 
+#ifdef TEST_VECTOR
+  /* The array variants only cover these functions.  */
+  cos_test ();
+  sin_test ();
+  sincos_test ();
+  exp_test ();
+  log_test ();
+  pow_test ();
+  sqrt_test ();
+#else
   /* Keep the tests a wee bit ordered (according to ISO C99).  */
   /* Classification macros:  */
   fpclassify_test ();
@@ -4513,10 +4527,15 @@ libm_main (int argc, char **argv)
   y0_test ();
   y1_test ();
   yn_test ();
+#endif
 
   if (output_ulps)
     fclose (ulps_file);
 
+#ifdef TEST_EXTRA_ERRORS
+  noErrors += TEST_EXTRA_ERRORS;
+#endif
+
    TRACE("\nTest suite completed:\n");
    TRACE("  %d test cases plus %d tests for exception flags executed.\n",
 	  noTests, noExcTests);
@@ -25,8 +25,12 @@
 #include "test.hpp"
 #include "test_constreams.hpp"
 #include "test_filestreams.hpp"
+#include "test_hid.hpp"
+#include "test_memory.hpp"
 #include "test_processes.hpp"
 #include "test_so.hpp"
+#include "test_strings.hpp"
+#include "test_vmath.hpp"
 #include <cstdlib>
 #include <thread>
 
@@ -106,6 +110,10 @@ int main(int argc, char **argv) {
     //RUN_TEST_SUITE(ErrorCounter, SharedObjectTests);
     RUN_TEST_SUITE(ErrorCounter, FileStreamTests);
     RUN_TEST_SUITE(ErrorCounter, ProcessTests);
+    RUN_TEST_SUITE(ErrorCounter, MemoryTests);
+    RUN_TEST_SUITE(ErrorCounter, StringTests);
+    RUN_TEST_SUITE(ErrorCounter, VectorMathTests);
+    RUN_TEST_SUITE(ErrorCounter, HidFieldTests);
 
     // Run libm test
     //libm_main(argc, argv);
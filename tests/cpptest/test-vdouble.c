@@ -0,0 +1,122 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * C/C++ Test Suite for Userspace
+ *  - Runs the libm tests against the double array functions. Every argument
+ *    is evaluated as an array long enough for full vectors and a tail, and
+ *    again in place, all elements must agree with the first one.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <vmath.h>
+
+#define VMATH_TEST_COUNT 9
+
+static int VMathTestMismatches = 0;
+
+static double
+VMathTestCheck(
+    double* Out,
+    double* InPlace)
+{
+    int i;
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {
+        if (memcmp(&Out[i], &Out[0], sizeof(double)) ||
+            memcmp(&InPlace[i], &Out[0], sizeof(double))) {
+            VMathTestMismatches++;
+            break;
+        }
+    }
+    return Out[0];
+}
+
+#define VMATH_TEST_UNARY(Name, Function)                                \
+static double Name(double x)                                            \
+{                                                                       \
+    double In[VMATH_TEST_COUNT], Out[VMATH_TEST_COUNT];                 \
+    double InPlace[VMATH_TEST_COUNT];                                   \
+    int    i;                                                           \
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {                            \
+        In[i] = InPlace[i] = x;                                         \
+    }                                                                   \
+    Function(Out, In, VMATH_TEST_COUNT);                                \
+    Function(InPlace, InPlace, VMATH_TEST_COUNT);                       \
+    return VMathTestCheck(Out, InPlace);                                \
+}
+
+VMATH_TEST_UNARY(VMathTestExp,  vexp)
+VMATH_TEST_UNARY(VMathTestLog,  vlog)
+VMATH_TEST_UNARY(VMathTestSin,  vsin)
+VMATH_TEST_UNARY(VMathTestCos,  vcos)
+VMATH_TEST_UNARY(VMathTestSqrt, vsqrt)
+
+static double
+VMathTestPow(double x, double y)
+{
+    double Base[VMATH_TEST_COUNT], Exponent[VMATH_TEST_COUNT];
+    double Out[VMATH_TEST_COUNT], InPlace[VMATH_TEST_COUNT];
+    int    i;
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {
+        Base[i]     = InPlace[i] = x;
+        Exponent[i] = y;
+    }
+    vpow(Out, Base, Exponent, VMATH_TEST_COUNT);
+    vpow(InPlace, InPlace, Exponent, VMATH_TEST_COUNT);
+    return VMathTestCheck(Out, InPlace);
+}
+
+static void
+VMathTestSinCos(double x, double* Sin, double* Cos)
+{
+    double In[VMATH_TEST_COUNT], OutSin[VMATH_TEST_COUNT], OutCos[VMATH_TEST_COUNT];
+    int    i;
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {
+        In[i] = x;
+    }
+    vsincos(OutSin, OutCos, In, VMATH_TEST_COUNT);
+    *Sin = VMathTestCheck(OutSin, OutSin);
+    *Cos = VMathTestCheck(OutCos, OutCos);
+}
+
+#define exp(x)              VMathTestExp(x)
+#define log(x)              VMathTestLog(x)
+#define sin(x)              VMathTestSin(x)
+#define cos(x)              VMathTestCos(x)
+#define sqrt(x)             VMathTestSqrt(x)
+#define pow(x, y)           VMathTestPow(x, y)
+#define sincos(x, s, c)     VMathTestSinCos(x, s, c)
+
+#define FUNC(function) function
+#define FLOAT double
+#define TEST_MSG "testing double array functions\n"
+#define MATHCONST(x) x
+#define CHOOSE(Clongdouble,Cdouble,Cfloat,Cinlinelongdouble,Cinlinedouble,Cinlinefloat) Cdouble
+#define PRINTF_EXPR "e"
+#define PRINTF_XEXPR "a"
+#define PRINTF_NEXPR "f"
+#define TEST_DOUBLE 1
+#define TEST_VECTOR 1
+#define TEST_MAIN vmath_double_main
+#define TEST_EXTRA_ERRORS VMathTestMismatches
+
+#ifndef __NO_MATH_INLINES
+# define __NO_MATH_INLINES
+#endif
+
+#include "libm-test.c"
@@ -0,0 +1,121 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * C/C++ Test Suite for Userspace
+ *  - Runs the libm tests against the float array functions, in the same way
+ *    as test-vdouble.c.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <vmath.h>
+
+#define VMATH_TEST_COUNT 9
+
+static int VMathTestMismatches = 0;
+
+static float
+VMathTestCheck(
+    float* Out,
+    float* InPlace)
+{
+    int i;
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {
+        if (memcmp(&Out[i], &Out[0], sizeof(float)) ||
+            memcmp(&InPlace[i], &Out[0], sizeof(float))) {
+            VMathTestMismatches++;
+            break;
+        }
+    }
+    return Out[0];
+}
+
+#define VMATH_TEST_UNARY(Name, Function)                                \
+static float Name(float x)                                              \
+{                                                                       \
+    float In[VMATH_TEST_COUNT], Out[VMATH_TEST_COUNT];                  \
+    float InPlace[VMATH_TEST_COUNT];                                    \
+    int   i;                                                            \
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {                            \
+        In[i] = InPlace[i] = x;                                         \
+    }                                                                   \
+    Function(Out, In, VMATH_TEST_COUNT);                                \
+    Function(InPlace, InPlace, VMATH_TEST_COUNT);                       \
+    return VMathTestCheck(Out, InPlace);                                \
+}
+
+VMATH_TEST_UNARY(VMathTestExpF,  vexpf)
+VMATH_TEST_UNARY(VMathTestLogF,  vlogf)
+VMATH_TEST_UNARY(VMathTestSinF,  vsinf)
+VMATH_TEST_UNARY(VMathTestCosF,  vcosf)
+VMATH_TEST_UNARY(VMathTestSqrtF, vsqrtf)
+
+static float
+VMathTestPowF(float x, float y)
+{
+    float Base[VMATH_TEST_COUNT], Exponent[VMATH_TEST_COUNT];
+    float Out[VMATH_TEST_COUNT], InPlace[VMATH_TEST_COUNT];
+    int   i;
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {
+        Base[i]     = InPlace[i] = x;
+        Exponent[i] = y;
+    }
+    vpowf(Out, Base, Exponent, VMATH_TEST_COUNT);
+    vpowf(InPlace, InPlace, Exponent, VMATH_TEST_COUNT);
+    return VMathTestCheck(Out, InPlace);
+}
+
+static void
+VMathTestSinCosF(float x, float* Sin, float* Cos)
+{
+    float In[VMATH_TEST_COUNT], OutSin[VMATH_TEST_COUNT], OutCos[VMATH_TEST_COUNT];
+    int   i;
+    for (i = 0; i < VMATH_TEST_COUNT; i++) {
+        In[i] = x;
+    }
+    vsincosf(OutSin, OutCos, In, VMATH_TEST_COUNT);
+    *Sin = VMathTestCheck(OutSin, OutSin);
+    *Cos = VMathTestCheck(OutCos, OutCos);
+}
+
+#define expf(x)             VMathTestExpF(x)
+#define logf(x)             VMathTestLogF(x)
+#define sinf(x)             VMathTestSinF(x)
+#define cosf(x)             VMathTestCosF(x)
+#define sqrtf(x)            VMathTestSqrtF(x)
+#define powf(x, y)          VMathTestPowF(x, y)
+#define sincosf(x, s, c)    VMathTestSinCosF(x, s, c)
+
+#define FUNC(function) function ## f
+#define FLOAT float
+#define TEST_MSG "testing float array functions\n"
+#define MATHCONST(x) x
+#define CHOOSE(Clongdouble,Cdouble,Cfloat,Cinlinelongdouble,Cinlinedouble,Cinlinefloat) Cfloat
+#define PRINTF_EXPR "e"
+#define PRINTF_XEXPR "a"
+#define PRINTF_NEXPR "f"
+#define TEST_FLOAT 1
+#define TEST_VECTOR 1
+#define TEST_MAIN vmath_float_main
+#define TEST_EXTRA_ERRORS VMathTestMismatches
+
+#ifndef __NO_MATH_INLINES
+# define __NO_MATH_INLINES
+#endif
+
+#include "libm-test.c"
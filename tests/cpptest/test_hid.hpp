@@ -0,0 +1,97 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - C/C++ Test Suite for Userspace
+ *  - Runs a variety of userspace tests against the libc/libc++ to verify
+ *    the stability and integrity of the operating system.
+ */
+#pragma once
+
+#include <cstring>
+#include <ddk/usb/hid.h>
+#include "test.hpp"
+
+class HidFieldTests : public OSTest {
+public:
+    HidFieldTests() : OSTest("HidFieldTests") { }
+
+    // The field location must only span the bytes the bits actually cover
+    int TestFieldLocation()
+    {
+        TestLog("TestFieldLocation");
+        HidReportField_t Field;
+        int              Errors = 0;
+
+        // Shift 4, Length 12 spans exactly two bytes
+        std::memset(&Field, 0, sizeof(Field));
+        HidSetFieldLocation(&Field, 12, 12);
+        if (Field.ByteOffset != 1 || Field.Shift != 4 || Field.ByteCount != 2) {
+            TestLog(">> offset 12 length 12: byte %u, shift %u, count %u",
+                (unsigned)Field.ByteOffset, Field.Shift, (unsigned)Field.ByteCount);
+            Errors++;
+        }
+
+        // Shift 7, Length 32 spans five bytes
+        HidSetFieldLocation(&Field, 7, 32);
+        if (Field.ByteOffset != 0 || Field.Shift != 7 || Field.ByteCount != 5) {
+            TestLog(">> offset 7 length 32: byte %u, shift %u, count %u",
+                (unsigned)Field.ByteOffset, Field.Shift, (unsigned)Field.ByteCount);
+            Errors++;
+        }
+
+        // Single bits never span more than one byte
+        HidSetFieldLocation(&Field, 3, 1);
+        if (Field.ByteOffset != 0 || Field.Shift != 3 || Field.ByteCount != 1) {
+            TestLog(">> offset 3 length 1: count %u", (unsigned)Field.ByteCount);
+            Errors++;
+        }
+        return Errors;
+    }
+
+    // Values of unaligned fields are loaded without touching bytes past the field
+    int TestFieldLoad()
+    {
+        TestLog("TestFieldLoad");
+        HidReportField_t Field;
+        uint8_t          Report[4] = { 0x00, 0xB0, 0xCA, 0xFF };
+        int              Errors = 0;
+
+        // 0xCAB at bit offset 12, the trailing 0xFF must not leak into the value
+        std::memset(&Field, 0, sizeof(Field));
+        HidSetFieldLocation(&Field, 12, 12);
+        if (HidLoadField(Report, &Field) != 0xCAB) {
+            TestLog(">> offset 12 length 12: 0x%x", HidLoadField(Report, &Field));
+            Errors++;
+        }
+
+        // The last nibble of the report, the field ends exactly at the report end
+        HidSetFieldLocation(&Field, 28, 4);
+        if (Field.ByteOffset + Field.ByteCount != sizeof(Report) || HidLoadField(Report, &Field) != 0xF) {
+            TestLog(">> offset 28 length 4: 0x%x", HidLoadField(Report, &Field));
+            Errors++;
+        }
+        return Errors;
+    }
+
+    int RunTests() {
+        int Errors = 0;
+        Errors += TestFieldLocation();
+        Errors += TestFieldLoad();
+        return Errors;
+    }
+};
@@ -0,0 +1,219 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - C/C++ Test Suite for Userspace
+ *  - Runs a variety of userspace tests against the libc/libc++ to verify
+ *    the stability and integrity of the operating system.
+ */
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include "test.hpp"
+
+// Sizes swept by the benchmark, the mem* routines switch implementation at
+// 64 bytes, 2kb and at the non-temporal threshold (a fraction of the cache size)
+static const size_t MemoryBenchmarkSizes[] = {
+    8, 16, 32, 48, 64, 96, 128, 256, 512, 1024, 2048, 4096, 8192,
+    16384, 65536, 262144, 1048576, 4194304, 16777216
+};
+#define MEMORY_TEST_BUFFER_SIZE     (16777216 + 4096)
+#define MEMORY_BENCHMARK_MIN_TICKS  (CLOCKS_PER_SEC / 20)
+
+class MemoryTests : public OSTest {
+public:
+    MemoryTests() : OSTest("MemoryTests") { }
+
+    // Verifies memcpy, memset and memcmp against byte loops for every size up to 512
+    // bytes at a spread of source and destination alignments, plus a few large sizes
+    int TestMemoryRoutines()
+    {
+        TestLog("TestMemoryRoutines");
+        size_t Sizes[520];
+        int    SizeCount = 0;
+        int    Errors    = 0;
+
+        for (size_t i = 0; i <= 512; i++) {
+            Sizes[SizeCount++] = i;
+        }
+        Sizes[SizeCount++] = 4095;
+        Sizes[SizeCount++] = 65537;
+        Sizes[SizeCount++] = 4194311;
+
+        for (int i = 0; i < SizeCount && Errors == 0; i++) {
+            for (size_t Offset = 0; Offset < 64 && Errors == 0; Offset += 7) {
+                size_t Length = Sizes[i];
+
+                std::memset(m_Destination, 0xCC, Length + 128);
+                std::memcpy(m_Destination + Offset, m_Source + (Offset / 2), Length);
+                Errors += Verify(m_Destination, 0xCC, Offset, m_Source + (Offset / 2), Length, "memcpy");
+
+                std::memset(m_Destination + Offset, 0x5A, Length);
+                for (size_t j = 0; j < Length; j++) {
+                    if (m_Destination[Offset + j] != 0x5A) {
+                        TestLog(">> memset(%u, offset %u) failed at %u", Length, Offset, j);
+                        Errors++;
+                        break;
+                    }
+                }
+
+                std::memcpy(m_Destination + Offset, m_Source, Length);
+                if (std::memcmp(m_Destination + Offset, m_Source, Length) != 0) {
+                    TestLog(">> memcmp(%u, offset %u) failed on equal buffers", Length, Offset);
+                    Errors++;
+                }
+                if (Length != 0) {
+                    m_Destination[Offset + (Length / 2)] ^= 0x80;
+                    if ((std::memcmp(m_Destination + Offset, m_Source, Length) > 0) !=
+                        (m_Destination[Offset + (Length / 2)] > m_Source[Length / 2])) {
+                        TestLog(">> memcmp(%u, offset %u) has the wrong sign", Length, Offset);
+                        Errors++;
+                    }
+                }
+            }
+        }
+        return Errors;
+    }
+
+    // Verifies memmove for overlaps in both directions
+    int TestMemoryMove()
+    {
+        TestLog("TestMemoryMove");
+        const long Shifts[] = { -129, -64, -33, -1, 1, 31, 64, 200 };
+        const size_t Base   = 4096;
+        int Errors          = 0;
+
+        for (size_t Length = 0; Length < 1200 && Errors == 0; Length += 13) {
+            for (size_t i = 0; i < sizeof(Shifts) / sizeof(Shifts[0]); i++) {
+                std::memcpy(m_Destination, m_Source, Base * 2 + Length);
+                std::memmove(m_Destination + Base + Shifts[i], m_Destination + Base, Length);
+                for (size_t j = 0; j < Length; j++) {
+                    if (m_Destination[Base + Shifts[i] + j] != m_Source[Base + j]) {
+                        TestLog(">> memmove(%u, shift %i) failed at %u", Length, (int)Shifts[i], j);
+                        Errors++;
+                        break;
+                    }
+                }
+            }
+        }
+        return Errors;
+    }
+
+    // Reports the throughput of each routine for each of the benchmark sizes
+    int BenchmarkMemoryRoutines()
+    {
+        TestLog("BenchmarkMemoryRoutines");
+        TestLog("%10s %12s %12s %12s %12s", "size", "memcpy", "memmove", "memset", "memcmp");
+        for (size_t i = 0; i < sizeof(MemoryBenchmarkSizes) / sizeof(MemoryBenchmarkSizes[0]); i++) {
+            size_t Length = MemoryBenchmarkSizes[i];
+            TestLog("%10u %9u MB/s %7u MB/s %7u MB/s %7u MB/s", Length,
+                Measure(0, Length), Measure(1, Length), Measure(2, Length), Measure(3, Length));
+        }
+        return 0;
+    }
+
+    int RunTests() {
+        int Errors = 0;
+
+        m_Source      = (unsigned char*)std::malloc(MEMORY_TEST_BUFFER_SIZE);
+        m_Destination = (unsigned char*)std::malloc(MEMORY_TEST_BUFFER_SIZE);
+        if (m_Source == nullptr || m_Destination == nullptr) {
+            TestLog(">> failed to allocate the test buffers");
+            std::free(m_Source);
+            std::free(m_Destination);
+            return 1;
+        }
+
+        for (size_t i = 0; i < MEMORY_TEST_BUFFER_SIZE; i++) {
+            m_Source[i] = (unsigned char)(std::rand() & 0xFF);
+        }
+
+        Errors += TestMemoryRoutines();
+        Errors += TestMemoryMove();
+        if (Errors == 0) {
+            BenchmarkMemoryRoutines();
+        }
+
+        std::free(m_Source);
+        std::free(m_Destination);
+        return Errors;
+    }
+
+private:
+    int Verify(const unsigned char* Buffer, unsigned char Fill, size_t Offset,
+        const unsigned char* Expected, size_t Length, const char* Routine)
+    {
+        for (size_t i = 0; i < Offset; i++) {
+            if (Buffer[i] != Fill) {
+                TestLog(">> %s(%u, offset %u) wrote before the destination", Routine, Length, Offset);
+                return 1;
+            }
+        }
+        for (size_t i = 0; i < Length; i++) {
+            if (Buffer[Offset + i] != Expected[i]) {
+                TestLog(">> %s(%u, offset %u) failed at %u", Routine, Length, Offset, i);
+                return 1;
+            }
+        }
+        for (size_t i = 0; i < 64; i++) {
+            if (Buffer[Offset + Length + i] != Fill) {
+                TestLog(">> %s(%u, offset %u) wrote past the destination", Routine, Length, Offset);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // Repeats the routine until enough ticks have passed to be measurable, returns MB/s
+    unsigned int Measure(int Routine, size_t Length)
+    {
+        volatile int Sink       = 0;
+        size_t       Iterations = 0;
+        size_t       Batch      = (Length < 65536) ? (1048576 / Length) : 16;
+        clock_t      Start;
+        clock_t      Elapsed;
+
+        if (Routine == 3) {
+            std::memcpy(m_Destination, m_Source, Length);
+        }
+
+        Start = clock();
+
+        do {
+            for (size_t i = 0; i < Batch; i++) {
+                switch (Routine) {
+                    case 0: std::memcpy(m_Destination, m_Source, Length); break;
+                    case 1: std::memmove(m_Destination + 1, m_Destination, Length); break;
+                    case 2: std::memset(m_Destination, (int)i, Length); break;
+                    default: Sink += std::memcmp(m_Source, m_Destination, Length); break;
+                }
+            }
+            Iterations += Batch;
+            Elapsed     = clock() - Start;
+        } while (Elapsed < MEMORY_BENCHMARK_MIN_TICKS);
+        (void)Sink;
+
+        return (unsigned int)(((double)Length * Iterations * CLOCKS_PER_SEC) /
+            ((double)Elapsed * 1024.0 * 1024.0));
+    }
+
+    unsigned char* m_Source;
+    unsigned char* m_Destination;
+};
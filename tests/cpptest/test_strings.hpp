@@ -0,0 +1,277 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - C/C++ Test Suite for Userspace
+ *  - Runs a variety of userspace tests against the libc/libc++ to verify
+ *    the stability and integrity of the operating system.
+ */
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <internal/_mem.h>
+#include "test.hpp"
+
+static const size_t StringBenchmarkSizes[] = {
+    8, 16, 32, 64, 128, 256, 1024, 4096, 16384, 65536, 1048576
+};
+#define STRING_TEST_PAGE_SIZE       4096
+#define STRING_TEST_BUFFER_SIZE     (1048576 + (4 * STRING_TEST_PAGE_SIZE))
+#define STRING_FUZZ_ITERATIONS      100000
+#define STRING_BENCHMARK_MIN_TICKS  (CLOCKS_PER_SEC / 20)
+
+class StringTests : public OSTest {
+public:
+    StringTests() : OSTest("StringTests") { }
+
+    // Fuzzes the string routines against byte loops. Half of the strings are placed so
+    // their terminator is the last byte of a page, and small alphabets are used so that
+    // the characters searched for are both present and absent
+    int TestStringRoutines()
+    {
+        TestLog("TestStringRoutines");
+        volatile size_t Unbounded = SIZE_MAX;
+        int             Errors    = 0;
+
+        for (int i = 0; i < STRING_FUZZ_ITERATIONS && Errors < 8; i++) {
+            size_t Length   = (size_t)(std::rand() % ((i % 16) == 0 ? 3000 : 300));
+            int    Alphabet = 1 + (std::rand() % ((i % 3) == 0 ? 2 : 16));
+            char*  First    = PlaceString(m_First, Length, Alphabet);
+            char*  Second   = PlaceString(m_Second, Length, 0);
+            int    Character = 'a' + (std::rand() % (Alphabet + 1));
+            size_t Limit     = (Length != 0) ? (size_t)(std::rand() % (Length + 1)) : 0;
+
+            if (std::strlen(First) != Length) {
+                TestLog(">> strlen(%u) failed", Length);
+                Errors++;
+            }
+
+            if (std::strchr(First, Character) != ReferenceStrchr(First, Character) ||
+                std::strchr(First, 0) != First + Length) {
+                TestLog(">> strchr(%u, '%c') failed", Length, Character);
+                Errors++;
+            }
+
+            if (std::memchr(First, Character, Limit) != ReferenceMemchr(First, Character, Limit) ||
+                std::memchr(First, 0, Unbounded) != First + Length) {
+                TestLog(">> memchr(%u, '%c', %u) failed", Length, Character, Limit);
+                Errors++;
+            }
+
+            // Copy the string to a different alignment and maybe change or cut it
+            std::memcpy(Second, First, Length + 1);
+            if (Length != 0 && (std::rand() & 1)) {
+                size_t Index = std::rand() % Length;
+                Second[Index] = (std::rand() % 3) ? (char)(Second[Index] + 1 + (std::rand() % 200)) : '\0';
+            }
+            if (Sign(std::strcmp(First, Second)) != Sign(ReferenceStrcmp(First, Second))) {
+                TestLog(">> strcmp(%u) failed", Length);
+                Errors++;
+            }
+
+            // Search for a needle cut from the haystack or made up from the same alphabet
+            char   Needle[80];
+            size_t NeedleLength = (size_t)(std::rand() % ((i % 8) == 0 ? 70 : 8));
+            if (NeedleLength <= Length && (std::rand() & 1)) {
+                std::memcpy(Needle, First + (std::rand() % (Length - NeedleLength + 1)), NeedleLength);
+            }
+            else {
+                for (size_t j = 0; j < NeedleLength; j++) {
+                    Needle[j] = (char)('a' + (std::rand() % Alphabet));
+                }
+            }
+            Needle[NeedleLength] = '\0';
+            if (std::strstr(First, Needle) != ReferenceStrstr(First, Needle)) {
+                TestLog(">> strstr(%u, needle %u) failed", Length, NeedleLength);
+                Errors++;
+            }
+        }
+
+        // strstr measures long haystacks a window at the time, matches must be found
+        // across the window boundaries and the terminator must end the search
+        for (size_t Offset = 4000; Offset < 4200 && Errors < 8; Offset += 13) {
+            std::memset(m_First, 'a', 12288);
+            m_First[12288]    = '\0';
+            m_First[Offset]   = 'b';
+            m_First[Offset+1] = 'c';
+            if (std::strstr(m_First, "aabc") != ReferenceStrstr(m_First, "aabc") ||
+                std::strstr(m_First, "bca") != m_First + Offset ||
+                std::strstr(m_First, "aad") != nullptr) {
+                TestLog(">> strstr(window, offset %u) failed", Offset);
+                Errors++;
+            }
+        }
+        return Errors;
+    }
+
+    // Reports the throughput of the routines next to the word at the time versions
+    // they replaced, which libc keeps for cpus without vector support
+    int BenchmarkStringRoutines()
+    {
+        TestLog("BenchmarkStringRoutines");
+        TestLog("%9s %14s %14s %14s %14s %14s", "size", "strlen", "strchr", "memchr", "strcmp", "strstr");
+        for (size_t i = 0; i < sizeof(StringBenchmarkSizes) / sizeof(StringBenchmarkSizes[0]); i++) {
+            size_t Length = StringBenchmarkSizes[i];
+
+            std::memset(m_First, 'a', Length);
+            m_First[Length] = '\0';
+            m_First[Length - 1] = 'b';
+            std::memcpy(m_Second, m_First, Length + 1);
+            TestLog("%9u %6u / %5u %6u / %5u %6u / %5u %6u / %5u %6u / %5u MB/s", Length,
+                Measure(0, Length), Measure(1, Length), Measure(2, Length), Measure(3, Length),
+                Measure(4, Length), Measure(5, Length), Measure(6, Length), Measure(7, Length),
+                Measure(8, Length), Measure(9, Length));
+        }
+        return 0;
+    }
+
+    int RunTests() {
+        int Errors = 0;
+
+        m_Buffer = (char*)std::malloc(STRING_TEST_BUFFER_SIZE * 2);
+        if (m_Buffer == nullptr) {
+            TestLog(">> failed to allocate the test buffers");
+            return 1;
+        }
+
+        // Page align both halves so strings can be placed against the end of a page
+        m_First  = (char*)(((uintptr_t)m_Buffer + STRING_TEST_PAGE_SIZE - 1) & ~(uintptr_t)(STRING_TEST_PAGE_SIZE - 1));
+        m_Second = m_First + STRING_TEST_BUFFER_SIZE;
+
+        Errors += TestStringRoutines();
+        if (Errors == 0) {
+            BenchmarkStringRoutines();
+        }
+
+        std::free(m_Buffer);
+        return Errors;
+    }
+
+private:
+    // Fills a string of the given length, ending either right at the end of the second
+    // page or at a random offset. An alphabet of 0 leaves the contents to the caller
+    char* PlaceString(char* Buffer, size_t Length, int Alphabet)
+    {
+        char* String;
+        if (std::rand() & 1) {
+            String = Buffer + (2 * STRING_TEST_PAGE_SIZE) - (Length + 1);
+        }
+        else {
+            String = Buffer + (std::rand() % (2 * STRING_TEST_PAGE_SIZE));
+        }
+
+        for (size_t i = 0; Alphabet != 0 && i < Length; i++) {
+            String[i] = (char)('a' + (std::rand() % Alphabet));
+        }
+        String[Length] = '\0';
+        return String;
+    }
+
+    static int Sign(int Value) { return (Value > 0) - (Value < 0); }
+
+    static const char* ReferenceStrchr(const char* String, int Character)
+    {
+        for (;; String++) {
+            if (*String == (char)Character) {
+                return String;
+            }
+            if (!*String) {
+                return nullptr;
+            }
+        }
+    }
+
+    static const void* ReferenceMemchr(const void* Memory, int Character, size_t Length)
+    {
+        const unsigned char* Pointer = (const unsigned char*)Memory;
+        for (size_t i = 0; i < Length; i++) {
+            if (Pointer[i] == (unsigned char)Character) {
+                return Pointer + i;
+            }
+        }
+        return nullptr;
+    }
+
+    static int ReferenceStrcmp(const char* First, const char* Second)
+    {
+        while (*First && *First == *Second) {
+            First++;
+            Second++;
+        }
+        return (*(const unsigned char*)First) - (*(const unsigned char*)Second);
+    }
+
+    static const char* ReferenceStrstr(const char* Haystack, const char* Needle)
+    {
+        for (;; Haystack++) {
+            size_t i = 0;
+            while (Needle[i] && Haystack[i] == Needle[i]) {
+                i++;
+            }
+            if (!Needle[i]) {
+                return Haystack;
+            }
+            if (!*Haystack) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Repeats the routine until enough ticks have passed to be measurable, returns MB/s.
+    // Even routines are the libc ones, odd routines the word at the time versions
+    unsigned int Measure(int Routine, size_t Length)
+    {
+        volatile size_t Sink       = 0;
+        size_t          Iterations = 0;
+        size_t          Batch      = (Length < 65536) ? (1048576 / Length) : 16;
+        clock_t         Start;
+        clock_t         Elapsed;
+
+        Start = clock();
+
+        do {
+            for (size_t i = 0; i < Batch; i++) {
+                switch (Routine) {
+                    case 0: Sink += std::strlen(m_First); break;
+                    case 1: Sink += __strlen_base(m_First); break;
+                    case 2: Sink += (size_t)std::strchr(m_First, 'b'); break;
+                    case 3: Sink += (size_t)__strchr_base(m_First, 'b'); break;
+                    case 4: Sink += (size_t)std::memchr(m_First, 'b', Length); break;
+                    case 5: Sink += (size_t)__memchr_base(m_First, 'b', Length); break;
+                    case 6: Sink += (size_t)std::strcmp(m_First, m_Second); break;
+                    case 7: Sink += (size_t)__strcmp_base(m_First, m_Second); break;
+                    case 8: Sink += (size_t)std::strstr(m_First, "aaab"); break;
+                    default: Sink += (size_t)__strstr_base(m_First, "aaab"); break;
+                }
+            }
+            Iterations += Batch;
+            Elapsed     = clock() - Start;
+        } while (Elapsed < STRING_BENCHMARK_MIN_TICKS);
+        (void)Sink;
+
+        return (unsigned int)(((double)Length * Iterations * CLOCKS_PER_SEC) /
+            ((double)Elapsed * 1024.0 * 1024.0));
+    }
+
+    char* m_Buffer;
+    char* m_First;
+    char* m_Second;
+};
@@ -0,0 +1,180 @@
+/* MollenOS
+ *
+ * Copyright 2019, Philip Meulengracht
+ *
+ * This program is free software : you can redistribute it and / or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation ? , either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * MollenOS - C/C++ Test Suite for Userspace
+ *  - Runs a variety of userspace tests against the libc/libc++ to verify
+ *    the stability and integrity of the operating system.
+ */
+#pragma once
+
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <vmath.h>
+#include "test.hpp"
+
+extern "C" int vmath_double_main(int argc, char **argv);
+extern "C" int vmath_float_main(int argc, char **argv);
+
+#define VMATH_BENCHMARK_COUNT       4096
+#define VMATH_BENCHMARK_MIN_TICKS   (CLOCKS_PER_SEC / 20)
+
+class VectorMathTests : public OSTest {
+public:
+    VectorMathTests() : OSTest("VectorMathTests") { }
+
+    // Runs the libm test tables against the array functions, see test-vdouble.c
+    int TestVectorMath()
+    {
+        TestLog("TestVectorMath");
+        int Errors = 0;
+
+        if (vmath_double_main(0, nullptr) != 0) {
+            TestLog(">> double array functions failed the libm tests");
+            Errors++;
+        }
+        if (vmath_float_main(0, nullptr) != 0) {
+            TestLog(">> float array functions failed the libm tests");
+            Errors++;
+        }
+        return Errors;
+    }
+
+    // Reports millions of elements per second for the scalar loop and the array function
+    int BenchmarkVectorMath()
+    {
+        TestLog("BenchmarkVectorMath");
+        TestLog("%9s %16s %16s", "function", "double", "float");
+        for (int Function = 0; Function < 6; Function++) {
+            TestLog("%9s %7u / %6u %7u / %6u Melem/s", FunctionName(Function),
+                Measure(Function, false, false), Measure(Function, false, true),
+                Measure(Function, true, false), Measure(Function, true, true));
+        }
+        return 0;
+    }
+
+    int RunTests() {
+        int Errors = 0;
+
+        // Arguments inside the range of every function, so the vector code is measured
+        for (int i = 0; i < VMATH_BENCHMARK_COUNT; i++) {
+            m_Input[i]     = 0.5 + (double)std::rand() / RAND_MAX * 20.0;
+            m_Exponent[i]  = -4.0 + (double)std::rand() / RAND_MAX * 8.0;
+            m_InputF[i]    = (float)m_Input[i];
+            m_ExponentF[i] = (float)m_Exponent[i];
+        }
+
+        Errors += TestVectorMath();
+        if (Errors == 0) {
+            BenchmarkVectorMath();
+        }
+        return Errors;
+    }
+
+private:
+    static const char* FunctionName(int Function)
+    {
+        static const char* Names[] = { "exp", "log", "sin", "cos", "pow", "sqrt" };
+        return Names[Function];
+    }
+
+    void RunScalar(int Function)
+    {
+        for (int i = 0; i < VMATH_BENCHMARK_COUNT; i++) {
+            switch (Function) {
+                case 0: m_Output[i] = std::exp(m_Input[i]); break;
+                case 1: m_Output[i] = std::log(m_Input[i]); break;
+                case 2: m_Output[i] = std::sin(m_Input[i]); break;
+                case 3: m_Output[i] = std::cos(m_Input[i]); break;
+                case 4: m_Output[i] = std::pow(m_Input[i], m_Exponent[i]); break;
+                default: m_Output[i] = std::sqrt(m_Input[i]); break;
+            }
+        }
+    }
+
+    void RunScalarF(int Function)
+    {
+        for (int i = 0; i < VMATH_BENCHMARK_COUNT; i++) {
+            switch (Function) {
+                case 0: m_OutputF[i] = expf(m_InputF[i]); break;
+                case 1: m_OutputF[i] = logf(m_InputF[i]); break;
+                case 2: m_OutputF[i] = sinf(m_InputF[i]); break;
+                case 3: m_OutputF[i] = cosf(m_InputF[i]); break;
+                case 4: m_OutputF[i] = powf(m_InputF[i], m_ExponentF[i]); break;
+                default: m_OutputF[i] = sqrtf(m_InputF[i]); break;
+            }
+        }
+    }
+
+    void RunVector(int Function)
+    {
+        switch (Function) {
+            case 0: vexp(m_Output, m_Input, VMATH_BENCHMARK_COUNT); break;
+            case 1: vlog(m_Output, m_Input, VMATH_BENCHMARK_COUNT); break;
+            case 2: vsin(m_Output, m_Input, VMATH_BENCHMARK_COUNT); break;
+            case 3: vcos(m_Output, m_Input, VMATH_BENCHMARK_COUNT); break;
+            case 4: vpow(m_Output, m_Input, m_Exponent, VMATH_BENCHMARK_COUNT); break;
+            default: vsqrt(m_Output, m_Input, VMATH_BENCHMARK_COUNT); break;
+        }
+    }
+
+    void RunVectorF(int Function)
+    {
+        switch (Function) {
+            case 0: vexpf(m_OutputF, m_InputF, VMATH_BENCHMARK_COUNT); break;
+            case 1: vlogf(m_OutputF, m_InputF, VMATH_BENCHMARK_COUNT); break;
+            case 2: vsinf(m_OutputF, m_InputF, VMATH_BENCHMARK_COUNT); break;
+            case 3: vcosf(m_OutputF, m_InputF, VMATH_BENCHMARK_COUNT); break;
+            case 4: vpowf(m_OutputF, m_InputF, m_ExponentF, VMATH_BENCHMARK_COUNT); break;
+            default: vsqrtf(m_OutputF, m_InputF, VMATH_BENCHMARK_COUNT); break;
+        }
+    }
+
+    // Repeats the function over the arrays until enough ticks have passed to be measurable
+    unsigned int Measure(int Function, bool Float, bool Vector)
+    {
+        size_t  Iterations = 0;
+        clock_t Start;
+        clock_t Elapsed;
+
+        Start = clock();
+        do {
+            if (Float) {
+                if (Vector) RunVectorF(Function);
+                else        RunScalarF(Function);
+            }
+            else {
+                if (Vector) RunVector(Function);
+                else        RunScalar(Function);
+            }
+            Iterations++;
+            Elapsed = clock() - Start;
+        } while (Elapsed < VMATH_BENCHMARK_MIN_TICKS);
+
+        return (unsigned int)(((double)VMATH_BENCHMARK_COUNT * Iterations * CLOCKS_PER_SEC) /
+            ((double)Elapsed * 1000000.0));
+    }
+
+    double m_Input[VMATH_BENCHMARK_COUNT];
+    double m_Exponent[VMATH_BENCHMARK_COUNT];
+    double m_Output[VMATH_BENCHMARK_COUNT];
+    float  m_InputF[VMATH_BENCHMARK_COUNT];
+    float  m_ExponentF[VMATH_BENCHMARK_COUNT];
+    float  m_OutputF[VMATH_BENCHMARK_COUNT];
+};
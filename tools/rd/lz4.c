@@ -0,0 +1,211 @@
+/* Ramdisk Builder Utility
+ * Author: Philip Meulengracht
+ * Date: 19-10-19
+ * LZ4 block compression of the ramdisk chunks, greedy single-pass matcher */
+
+#include "lz4.h"
+#include <string.h>
+
+#define LZ4_MINMATCH     4
+#define LZ4_LASTLITERALS 5  // The last 5 bytes of a block are always literals
+#define LZ4_MFLIMIT      12 // Matches must start at least 12 bytes before the end
+#define LZ4_MAXDISTANCE  65535
+#define LZ4_HASHLOG      12
+
+static uint32_t
+Lz4Read32(const uint8_t* Pointer)
+{
+    uint32_t Value;
+    memcpy(&Value, Pointer, sizeof(uint32_t));
+    return Value;
+}
+
+static uint32_t
+Lz4Hash(uint32_t Sequence)
+{
+    return (Sequence * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+static uint8_t*
+Lz4WriteLength(
+    uint8_t* Output,
+    size_t   Length)
+{
+    while (Length >= 255) {
+        *Output++ = 255;
+        Length   -= 255;
+    }
+    *Output++ = (uint8_t)Length;
+    return Output;
+}
+
+static uint8_t*
+Lz4WriteSequence(
+    uint8_t*       Output,
+    const uint8_t* Literals,
+    size_t         LiteralLength,
+    size_t         Offset,
+    size_t         MatchLength)
+{
+    uint8_t* Token = Output++;
+
+    *Token = (uint8_t)((LiteralLength >= 15 ? 15 : LiteralLength) << 4);
+    if (LiteralLength >= 15) {
+        Output = Lz4WriteLength(Output, LiteralLength - 15);
+    }
+    memcpy(Output, Literals, LiteralLength);
+    Output += LiteralLength;
+
+    // The last sequence of a block carries no match
+    if (MatchLength != 0) {
+        MatchLength -= LZ4_MINMATCH;
+        *Output++    = (uint8_t)(Offset & 0xFF);
+        *Output++    = (uint8_t)(Offset >> 8);
+        *Token      |= (uint8_t)(MatchLength >= 15 ? 15 : MatchLength);
+        if (MatchLength >= 15) {
+            Output = Lz4WriteLength(Output, MatchLength - 15);
+        }
+    }
+    return Output;
+}
+
+size_t
+Lz4Compress(
+    const uint8_t* Source,
+    size_t         SourceLength,
+    uint8_t*       Destination)
+{
+    uint32_t       Table[1 << LZ4_HASHLOG];
+    const uint8_t* Anchor = Source;
+    const uint8_t* Input  = Source;
+    const uint8_t* Limit  = Source + SourceLength - LZ4_MFLIMIT;
+    const uint8_t* End    = Source + SourceLength - LZ4_LASTLITERALS;
+    uint8_t*       Output = Destination;
+
+    if (SourceLength < LZ4_MFLIMIT + 1) {
+        Output = Lz4WriteSequence(Output, Source, SourceLength, 0, 0);
+        return (size_t)(Output - Destination);
+    }
+
+    // Entries are offsets from the start of the source, the first position of a
+    // block can never be a match candidate for itself
+    memset(&Table[0], 0xFF, sizeof(Table));
+    while (Input < Limit) {
+        uint32_t       Sequence = Lz4Read32(Input);
+        uint32_t       Hash     = Lz4Hash(Sequence);
+        uint32_t       Previous = Table[Hash];
+        const uint8_t* Match;
+        size_t         Length;
+
+        Table[Hash] = (uint32_t)(Input - Source);
+        if (Previous == 0xFFFFFFFF) {
+            Input++;
+            continue;
+        }
+
+        Match = Source + Previous;
+        if ((size_t)(Input - Match) > LZ4_MAXDISTANCE || Lz4Read32(Match) != Sequence) {
+            Input++;
+            continue;
+        }
+
+        // Extend the match backwards over pending literals and forwards up to the
+        // part of the block that must be literals
+        while (Input > Anchor && Match > Source && Input[-1] == Match[-1]) {
+            Input--;
+            Match--;
+        }
+        Length = LZ4_MINMATCH;
+        while (Input + Length < End && Input[Length] == Match[Length]) {
+            Length++;
+        }
+
+        Output = Lz4WriteSequence(Output, Anchor, (size_t)(Input - Anchor), 
+            (size_t)(Input - Match), Length);
+        Input += Length;
+        Anchor = Input;
+
+        // Keep the table warm over the match so the next search has close candidates
+        if (Input < Limit) {
+            Table[Lz4Hash(Lz4Read32(Input - 2))] = (uint32_t)(Input - 2 - Source);
+        }
+    }
+
+    Output = Lz4WriteSequence(Output, Anchor, (size_t)(Source + SourceLength - Anchor), 0, 0);
+    return (size_t)(Output - Destination);
+}
+
+int
+Lz4Decompress(
+    const uint8_t* Source,
+    size_t         SourceLength,
+    uint8_t*       Destination,
+    size_t         DestinationLength)
+{
+    const uint8_t* SourceEnd = Source + SourceLength;
+    uint8_t*       Output    = Destination;
+    uint8_t*       OutputEnd = Destination + DestinationLength;
+
+    while (Source < SourceEnd) {
+        unsigned int   Token  = *Source++;
+        size_t         Length = Token >> 4;
+        size_t         Offset;
+        const uint8_t* Match;
+        unsigned int   Byte;
+
+        if (Length == 15) {
+            do {
+                if (Source == SourceEnd) {
+                    return -1;
+                }
+                Byte    = *Source++;
+                Length += Byte;
+            } while (Byte == 255);
+        }
+        if (Length > (size_t)(SourceEnd - Source) || Length > (size_t)(OutputEnd - Output)) {
+            return -1;
+        }
+        memcpy(Output, Source, Length);
+        Output += Length;
+        Source += Length;
+
+        if (Source == SourceEnd) {
+            break;
+        }
+        if ((SourceEnd - Source) < 2) {
+            return -1;
+        }
+        Offset  = (size_t)Source[0] | ((size_t)Source[1] << 8);
+        Source += 2;
+        if (Offset == 0 || Offset > (size_t)(Output - Destination)) {
+            return -1;
+        }
+
+        Length = Token & 0xF;
+        if (Length == 15) {
+            do {
+                if (Source == SourceEnd) {
+                    return -1;
+                }
+                Byte    = *Source++;
+                Length += Byte;
+            } while (Byte == 255);
+        }
+        Length += LZ4_MINMATCH;
+        if (Length > (size_t)(OutputEnd - Output)) {
+            return -1;
+        }
+
+        Match = Output - Offset;
+        if (Offset >= Length) {
+            memcpy(Output, Match, Length);
+            Output += Length;
+        }
+        else {
+            while (Length--) {
+                *Output++ = *Match++;
+            }
+        }
+    }
+    return (Output == OutputEnd) ? 0 : -1;
+}
@@ -0,0 +1,35 @@
+/* Ramdisk Builder Utility
+ * Author: Philip Meulengracht
+ * Date: 19-10-19
+ * LZ4 block compression of the ramdisk chunks, the kernel only implements the decoder */
+
+#ifndef _RD_LZ4_H_
+#define _RD_LZ4_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lz4CompressBound
+ * Returns the largest size a block of the given length can compress to. */
+#define Lz4CompressBound(Length) ((Length) + ((Length) / 255) + 16)
+
+/* Lz4Compress
+ * Compresses the source into a single lz4 block, the destination must be at least
+ * Lz4CompressBound(SourceLength) bytes. Returns the length of the block. */
+size_t
+Lz4Compress(
+    const uint8_t* Source,
+    size_t         SourceLength,
+    uint8_t*       Destination);
+
+/* Lz4Decompress
+ * Decompresses a single lz4 block, the block must decompress to exactly the length
+ * of the destination. Returns 0 on success, -1 if the block is corrupt. */
+int
+Lz4Decompress(
+    const uint8_t* Source,
+    size_t         SourceLength,
+    uint8_t*       Destination,
+    size_t         DestinationLength);
+
+#endif //!_RD_LZ4_H_
@@ -13,11 +13,17 @@
 #define PACKED_TYPESTRUCT(name, body) __pragma(pack(push, 1)) typedef struct _##name body name##_t __pragma(pack(pop))
 #else
 #include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
 #define PACKED_TYPESTRUCT(name, body) typedef struct __attribute__((packed)) _##name body name##_t
 #endif
 #include <sys/stat.h>
+#include <time.h>
+#include "lz4.h"
 
 #define POLYNOMIAL 0x04c11db7L      // Standard CRC-32 ppolynomial
+#define CHUNK_SIZE 0x10000          // Uncompressed size of every chunk but the last
+#define CHUNK_LZ4  0x1
 
 PACKED_TYPESTRUCT(BitmapFileHeader, {
     uint16_t bfType;  //specifies the file type
@@ -76,11 +82,21 @@ PACKED_TYPESTRUCT(MCoreRamDiskModuleHeader, {
     uint32_t    DeviceSubType;
 });
 
+/* MCoreRamDiskChunk
+ * The chunk table follows the module header, the data of every chunk
+ * is compressed on its own so modules can be unpacked in parallel. */
+PACKED_TYPESTRUCT(MCoreRamDiskChunk, {
+    uint32_t    Flags;
+    uint32_t    Offset; // Offset from the module header
+    uint32_t    Length; // Length of the stored data
+    uint32_t    Crc32OfData;
+});
+
 // Statics
-uint32_t CrcTable[256] = { 0 };
+uint32_t CrcTable[8][256] = { { 0 } };
 MCoreRamDiskHeader_t RdHeaderStatic = {
 	0x3144524D,
-	0x00000001,
+	0x00000002,
 	0, 0
 };
 
@@ -88,11 +104,13 @@ MCoreRamDiskHeader_t RdHeaderStatic = {
 static void ShowSyntax(void)
 {
 	printf("  Syntax:\n\n"
-           "    Build    :  rd <arch> <output>\n\n");
+           "    Build    :  rd <arch> <output> [--clean]\n"
+           "    Benchmark:  rd bench <file> [file ...]\n\n");
 }
 
 /* Crc32GenerateTable
- * Generates a dynamic crc-32 table. */
+ * Generates a dynamic crc-32 table. The additional tables hold the crc of
+ * a byte followed by 1-7 zero bytes, so 8 bytes can be processed at once. */
 void
 Crc32GenerateTable(void)
 {
@@ -111,7 +129,13 @@ Crc32GenerateTable(void)
                 CrcAccumulator = (CrcAccumulator << 1);
             }
         }
-        CrcTable[i] = CrcAccumulator;
+        CrcTable[0][i] = CrcAccumulator;
+    }
+
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) {
+            CrcTable[j][i] = (CrcTable[j - 1][i] << 8) ^ CrcTable[0][CrcTable[j - 1][i] >> 24];
+        }
     }
 }
 
@@ -127,15 +151,185 @@ Crc32Generate(
     // Variables
     register size_t i, j;
 
-    // Iterate each byte and accumulate crc
-    for (j = 0; j < DataSize; j++) {
+    // Process 8 bytes at a time, the crc is most significant bit first
+    for (j = 0; j + 8 <= DataSize; j += 8, DataPointer += 8) {
+        CrcAccumulator ^= ((uint32_t)DataPointer[0] << 24) | ((uint32_t)DataPointer[1] << 16) 
+            | ((uint32_t)DataPointer[2] << 8) | DataPointer[3];
+        CrcAccumulator = CrcTable[7][CrcAccumulator >> 24] ^ CrcTable[6][(CrcAccumulator >> 16) & 0xFF]
+            ^ CrcTable[5][(CrcAccumulator >> 8) & 0xFF] ^ CrcTable[4][CrcAccumulator & 0xFF]
+            ^ CrcTable[3][DataPointer[4]] ^ CrcTable[2][DataPointer[5]]
+            ^ CrcTable[1][DataPointer[6]] ^ CrcTable[0][DataPointer[7]];
+    }
+
+    // Iterate each remaining byte and accumulate crc
+    for (; j < DataSize; j++) {
         i = ((int) (CrcAccumulator >> 24) ^ *DataPointer++) & 0xFF;
-        CrcAccumulator = (CrcAccumulator << 8) ^ CrcTable[i];
+        CrcAccumulator = (CrcAccumulator << 8) ^ CrcTable[0][i];
     }
     CrcAccumulator = ~CrcAccumulator;
     return CrcAccumulator;
 }
 
+/* PackChunk
+ * Compresses a single chunk into the output, which must be able to hold
+ * Lz4CompressBound(Length) bytes. Chunks that do not shrink are stored as is. */
+void
+PackChunk(
+    uint8_t*             Data,
+    long                 Length,
+    uint8_t*             Output,
+    MCoreRamDiskChunk_t* Chunk)
+{
+    size_t Compressed = Lz4Compress(Data, Length, Output);
+
+    if (Compressed < (size_t)Length) {
+        Chunk->Flags  = CHUNK_LZ4;
+        Chunk->Length = (uint32_t)Compressed;
+    }
+    else {
+        memcpy(Output, Data, Length);
+        Chunk->Flags  = 0;
+        Chunk->Length = (uint32_t)Length;
+    }
+    Chunk->Crc32OfData = Crc32Generate(-1, Output, Chunk->Length);
+}
+
+/* PackModuleData
+ * Packs the file data into chunks, the chunk table is followed by the data of
+ * every chunk. Returns the packed buffer, and the length of it in PackedLength. */
+uint8_t*
+PackModuleData(
+    uint8_t* Data,
+    long     Length,
+    long*    PackedLength)
+{
+    // Chunk offsets are relative to the start of the packed buffer
+    long                ChunkCount = (Length + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    long                TableLength = ChunkCount * sizeof(MCoreRamDiskChunk_t);
+    long                Offset;
+    MCoreRamDiskChunk_t *Chunks;
+    uint8_t*            Packed;
+    long                i;
+
+    Packed = (uint8_t*)malloc(TableLength + (ChunkCount * Lz4CompressBound(CHUNK_SIZE)));
+    Chunks = (MCoreRamDiskChunk_t*)Packed;
+    Offset = TableLength;
+    for (i = 0; i < ChunkCount; i++) {
+        long ChunkLength = (Length - (i * CHUNK_SIZE)) < CHUNK_SIZE ? (Length - (i * CHUNK_SIZE)) : CHUNK_SIZE;
+        PackChunk(Data + (i * CHUNK_SIZE), ChunkLength, Packed + Offset, &Chunks[i]);
+        Chunks[i].Offset = (uint32_t)Offset;
+        Offset          += Chunks[i].Length;
+    }
+    *PackedLength = Offset;
+    return Packed;
+}
+
+/* UnpackModuleData
+ * Unpacks and validates the chunks of a module packed by PackModuleData like the
+ * kernel does, used to verify the packed data. Returns 0 if all chunks were unpacked. */
+int
+UnpackModuleData(
+    uint8_t* Packed,
+    long     Length,
+    uint8_t* Data)
+{
+    long                ChunkCount = (Length + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    MCoreRamDiskChunk_t *Chunks    = (MCoreRamDiskChunk_t*)Packed;
+    long                i;
+
+    for (i = 0; i < ChunkCount; i++) {
+        uint8_t* ChunkData   = Packed + Chunks[i].Offset;
+        long     ChunkLength = (Length - (i * CHUNK_SIZE)) < CHUNK_SIZE ? (Length - (i * CHUNK_SIZE)) : CHUNK_SIZE;
+
+        if (Crc32Generate(-1, ChunkData, Chunks[i].Length) != Chunks[i].Crc32OfData) {
+            return -1;
+        }
+        if (Chunks[i].Flags & CHUNK_LZ4) {
+            if (Lz4Decompress(ChunkData, Chunks[i].Length, Data + (i * CHUNK_SIZE), ChunkLength)) {
+                return -1;
+            }
+        }
+        else {
+            memcpy(Data + (i * CHUNK_SIZE), ChunkData, ChunkLength);
+        }
+    }
+    return 0;
+}
+
+/* Benchmark
+ * Packs and unpacks the given files a number of times and reports the
+ * throughput of both and the achieved ratio. */
+int
+Benchmark(
+    int    FileCount,
+    char** Files)
+{
+    double TotalPack   = 0.0;
+    double TotalUnpack = 0.0;
+    long   TotalLength = 0;
+    long   TotalPacked = 0;
+    int    Passes      = 8;
+    int    i, j;
+
+    for (i = 0; i < FileCount; i++) {
+        FILE*    entry = fopen(Files[i], "rb");
+        uint8_t* data;
+        uint8_t* packed = NULL;
+        uint8_t* unpacked;
+        long     fsize;
+        long     psize = 0;
+        clock_t  start;
+        double   pack, unpack;
+
+        if (entry == NULL) {
+            printf("Unable to open file: %s\n", Files[i]);
+            return 1;
+        }
+        fseek(entry, 0, SEEK_END);
+        fsize = ftell(entry);
+        rewind(entry);
+        data = malloc(fsize + 1);
+        unpacked = malloc(fsize + 1);
+        fread(data, 1, fsize, entry);
+        fclose(entry);
+
+        start = clock();
+        for (j = 0; j < Passes; j++) {
+            free(packed);
+            packed = PackModuleData(data, fsize, &psize);
+        }
+        pack = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        for (j = 0; j < Passes; j++) {
+            if (UnpackModuleData(packed, fsize, unpacked) || memcmp(data, unpacked, fsize)) {
+                printf("%s: unpacked data does not match\n", Files[i]);
+                return 1;
+            }
+        }
+        unpack = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("%s: %li -> %li bytes (%.1f%%), pack %.1f MB/s, unpack %.1f MB/s\n", Files[i],
+            fsize, psize, fsize ? (100.0 * psize) / fsize : 0.0,
+            pack > 0.0 ? ((double)fsize * Passes) / (pack * 1048576.0) : 0.0,
+            unpack > 0.0 ? ((double)fsize * Passes) / (unpack * 1048576.0) : 0.0);
+
+        TotalPack   += pack;
+        TotalUnpack += unpack;
+        TotalLength += fsize;
+        TotalPacked += psize;
+        free(packed);
+        free(unpacked);
+        free(data);
+    }
+
+    printf("total: %li -> %li bytes (%.1f%%), pack %.1f MB/s, unpack %.1f MB/s\n",
+        TotalLength, TotalPacked, TotalLength ? (100.0 * TotalPacked) / TotalLength : 0.0,
+        TotalPack > 0.0 ? ((double)TotalLength * Passes) / (TotalPack * 1048576.0) : 0.0,
+        TotalUnpack > 0.0 ? ((double)TotalLength * Passes) / (TotalUnpack * 1048576.0) : 0.0);
+    return 0;
+}
+
 // Determines if a file has a corresponding driver descriptor
 static FILE *GetDriver(const char *path)
 {
@@ -321,102 +515,410 @@ char *PerformRLE(char *data, long length, long *new_length)
     return rledata;
 }
 
-// main
-int main(int argc, char *argv[])
+/* RdKey
+ * Identifies a chunk by its unpacked data, shared by the chunks of the image
+ * being built and the chunks of the previous image. */
+typedef struct RdKey {
+    uint8_t* Data;
+    long     Length;
+    uint32_t Crc;
+} RdKey_t;
+
+/* RdChunk
+ * A chunk of file data. Identical chunks are packed and stored once, the
+ * duplicates refer to the first of them through Original. */
+typedef struct RdChunk {
+    RdKey_t             Key;
+    long                Original;
+    uint8_t*            Packed;
+    MCoreRamDiskChunk_t Descriptor;
+    int                 Reused;  // The packed data is taken from the previous image
+    int                 Placed;  // An offset in the image has been assigned
+    int                 Written;
+} RdChunk_t;
+
+/* RdCacheEntry
+ * A chunk of the previous image, the packed data of unchanged chunks is
+ * reused instead of compressing them again. */
+typedef struct RdCacheEntry {
+    RdKey_t             Key;
+    uint8_t*            Packed;
+    MCoreRamDiskChunk_t Descriptor;
+} RdCacheEntry_t;
+
+/* RdFile
+ * A file that goes into the ramdisk, files are written in boot order. Order
+ * is 0 for services, 1 for files (libraries are loaded by the services) and
+ * 2 for drivers that are loaded when their devices are found. */
+typedef struct RdFile {
+    char                       Path[512];
+    char                       Name[64];
+    uint32_t                   Type;
+    int                        Order;
+    MCoreRamDiskModuleHeader_t Header;
+    uint8_t*                   Data;
+    long                       Length;
+    long                       FirstChunk;
+    long                       ChunkCount;
+    uint32_t                   Offset; // Of the module header in the image
+} RdFile_t;
+
+typedef struct RdIndex {
+    RdKey_t** Slots;
+    long      Size;
+} RdIndex_t;
+
+typedef void (*RdWorkFunction_t)(void* Context, long Index);
+
+typedef struct RdWork {
+    RdWorkFunction_t Function;
+    void*            Context;
+    long             Count;
+    long             Next;
+#ifndef _MSC_VER
+    pthread_mutex_t  Lock;
+#endif
+} RdWork_t;
+
+static int ThreadCount = 1;
+
+#ifndef _MSC_VER
+static void*
+RdWorker(
+    void* Context)
 {
-	// Variables
-	struct dirent *dp = NULL;
-	char *filename_buffer;
-	char *dataptr = NULL;
-	FILE *out = NULL;
-	DIR *dfd = NULL;
-	long fentrypos = 0;
-	long fdatapos = 0;
-	char **tokens;
-	int tokencount;
+    RdWork_t* Work = (RdWork_t*)Context;
+    long      Index;
+
+    while (1) {
+        pthread_mutex_lock(&Work->Lock);
+        Index = Work->Next++;
+        pthread_mutex_unlock(&Work->Lock);
+        if (Index >= Work->Count) {
+            break;
+        }
+        Work->Function(Work->Context, Index);
+    }
+    return NULL;
+}
+#endif
 
-	// Print header
-	printf("MollenOS Ramdisk Builder\n"
-           "Copyright 2017 Philip Meulengracht (www.mollenos.com)\n\n");
+/* RunParallel
+ * Calls the function for every index in [0, Count) from all worker threads, and
+ * returns when all calls have completed. Runs on the calling thread only if
+ * threads are not available. */
+void
+RunParallel(
+    RdWorkFunction_t Function,
+    void*            Context,
+    long             Count)
+{
+#ifndef _MSC_VER
+    pthread_t Threads[64];
+    RdWork_t  Work;
+    int       Started = 0;
+    int       i;
+
+    Work.Function = Function;
+    Work.Context  = Context;
+    Work.Count    = Count;
+    Work.Next     = 0;
+    pthread_mutex_init(&Work.Lock, NULL);
+    for (i = 1; i < ThreadCount && i < Count; i++) {
+        if (pthread_create(&Threads[Started], NULL, RdWorker, &Work) == 0) {
+            Started++;
+        }
+    }
+    RdWorker(&Work);
+    for (i = 0; i < Started; i++) {
+        pthread_join(Threads[i], NULL);
+    }
+    pthread_mutex_destroy(&Work.Lock);
+#else
+    long i;
+    for (i = 0; i < Count; i++) {
+        Function(Context, i);
+    }
+#endif
+}
 
-	// Validate the number of arguments
-	// format: rd $(arch) $(out)
-	if (argc != 3) {
-		ShowSyntax();
-		return 1;
-	}
+static int
+GetThreadCount(void)
+{
+#ifndef _MSC_VER
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (Count > 64) {
+        Count = 64;
+    }
+    return Count > 0 ? (int)Count : 1;
+#else
+    return 1;
+#endif
+}
 
-	// Create the output file
-	out = fopen(argv[2], "wb+");
-	if (out == NULL) {
-		printf("%s was an invalid output file\n", argv[2]);
-		return 1;
+static void
+IndexCreate(
+    RdIndex_t* Index,
+    long       Count)
+{
+    Index->Size = 16;
+    while (Index->Size < (Count * 2)) {
+        Index->Size <<= 1;
     }
-    
-    // Initialize CRC
-    printf("Generating crc-table\n");
-    Crc32GenerateTable();
+    Index->Slots = (RdKey_t**)calloc(Index->Size, sizeof(RdKey_t*));
+}
 
-	// Fill in architecture
-	// Arch - x86_32 = 0x08, x86_64 = 0x10
-    if (!strcmp(argv[1], "i386") || !strcmp(argv[1], "__i386__")) {
-	    RdHeaderStatic.Architecture = 0x08;
+/* IndexFindOrInsert
+ * Looks up a key with identical data, the key is inserted if none exist. Returns
+ * the key that is in the index. */
+static RdKey_t*
+IndexFindOrInsert(
+    RdIndex_t* Index,
+    RdKey_t*   Key,
+    int        Insert)
+{
+    long Slot = (long)((Key->Crc ^ ((uint32_t)Key->Length * 2654435761U)) & (Index->Size - 1));
+    while (Index->Slots[Slot] != NULL) {
+        RdKey_t* Existing = Index->Slots[Slot];
+        if (Existing->Crc == Key->Crc && Existing->Length == Key->Length &&
+            !memcmp(Existing->Data, Key->Data, Key->Length)) {
+            return Existing;
+        }
+        Slot = (Slot + 1) & (Index->Size - 1);
     }
-    else if (!strcmp(argv[1], "amd64") || !strcmp(argv[1], "__amd64__")) {
-	    RdHeaderStatic.Architecture = 0x10;
+    if (Insert) {
+        Index->Slots[Slot] = Key;
+        return Key;
     }
+    return NULL;
+}
 
-	RdHeaderStatic.FileCount = 0;
+static void
+LoadFileWork(
+    void* Context,
+    long  Index)
+{
+    RdFile_t* File  = &((RdFile_t*)Context)[Index];
+    FILE*     entry = fopen(File->Path, "rb");
 
-    // Open directory
-    printf("Counting available files for rd\n");
-	if ((dfd = opendir("initrd")) == NULL) {
-		fprintf(stderr, "Can't open initrd folder\n");
-		return 1;
-	}
+    File->Length = 0;
+    File->Data   = NULL;
+    if (entry == NULL) {
+        return;
+    }
+    fseek(entry, 0, SEEK_END);
+    File->Length = ftell(entry);
+    rewind(entry);
+    File->Data = (uint8_t*)malloc(File->Length + 1);
+    if (fread(File->Data, 1, File->Length, entry) != (size_t)File->Length) {
+        File->Length = -1;
+    }
+    fclose(entry);
+}
 
-	// Count files of type .dll
-	while ((dp = readdir(dfd)) != NULL) {
-		char *dot = strrchr(dp->d_name, '.');
-		if (dot && !strcmp(dot, ".dll")) {
-			RdHeaderStatic.FileCount++;
-		}
-	}
+static void
+HashChunkWork(
+    void* Context,
+    long  Index)
+{
+    RdChunk_t* Chunk = &((RdChunk_t*)Context)[Index];
+    Chunk->Key.Crc = Crc32Generate(-1, Chunk->Key.Data, Chunk->Key.Length);
+}
 
-	// Rewind
-	rewinddir(dfd);
+static void
+PackChunkWork(
+    void* Context,
+    long  Index)
+{
+    RdChunk_t* Chunk = &((RdChunk_t*)Context)[Index];
+    if (Chunk->Original != Index || Chunk->Reused) {
+        return;
+    }
+    Chunk->Packed = (uint8_t*)malloc(Lz4CompressBound(CHUNK_SIZE));
+    PackChunk(Chunk->Key.Data, Chunk->Key.Length, Chunk->Packed, &Chunk->Descriptor);
+}
 
-    // Write header
-    printf("Generating ramdisk header\n");
-	fwrite(&RdHeaderStatic, 1, sizeof(MCoreRamDiskHeader_t), out);
-	fflush(out);
+static void
+UnpackCacheWork(
+    void* Context,
+    long  Index)
+{
+    RdCacheEntry_t* Entry = &((RdCacheEntry_t*)Context)[Index];
 
-	// Store current position
-	fentrypos = ftell(out);
+    Entry->Key.Data = (uint8_t*)malloc(Entry->Key.Length + 1);
+    if (Crc32Generate(-1, Entry->Packed, Entry->Descriptor.Length) != Entry->Descriptor.Crc32OfData) {
+        Entry->Key.Length = -1;
+        return;
+    }
+    if (Entry->Descriptor.Flags & CHUNK_LZ4) {
+        if (Lz4Decompress(Entry->Packed, Entry->Descriptor.Length, Entry->Key.Data, Entry->Key.Length)) {
+            Entry->Key.Length = -1;
+            return;
+        }
+    }
+    else if (Entry->Descriptor.Length == (uint32_t)Entry->Key.Length) {
+        memcpy(Entry->Key.Data, Entry->Packed, Entry->Key.Length);
+    }
+    else {
+        Entry->Key.Length = -1;
+        return;
+    }
+    Entry->Key.Crc = Crc32Generate(-1, Entry->Key.Data, Entry->Key.Length);
+}
+
+/* LoadPreviousImage
+ * Loads the chunks of a previously built image into the cache, all chunks are
+ * validated and unpacked. Images that are not version 2 provide no chunks. Returns
+ * the number of chunks in the cache. */
+long
+LoadPreviousImage(
+    const char*      Path,
+    RdIndex_t*       Index,
+    uint8_t**        ImageOut,
+    RdCacheEntry_t** EntriesOut)
+{
+    MCoreRamDiskHeader_t* Header;
+    MCoreRamDiskEntry_t*  Entries;
+    RdCacheEntry_t*       Cache;
+    uint8_t*              Image;
+    FILE*                 File = fopen(Path, "rb");
+    long                  Size;
+    long                  Count = 0;
+    long                  i, j, Pass;
+
+    if (File == NULL) {
+        return 0;
+    }
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File);
+    rewind(File);
+    Image = (uint8_t*)malloc(Size + 1);
+    if (fread(Image, 1, Size, File) != (size_t)Size) {
+        Size = 0;
+    }
+    fclose(File);
+
+    Header  = (MCoreRamDiskHeader_t*)Image;
+    Entries = (MCoreRamDiskEntry_t*)(Image + sizeof(MCoreRamDiskHeader_t));
+    if (Size < (long)sizeof(MCoreRamDiskHeader_t) || Header->Magic != RdHeaderStatic.Magic ||
+        Header->Version != RdHeaderStatic.Version || Header->FileCount < 0 ||
+        (long)(sizeof(MCoreRamDiskHeader_t) + (Header->FileCount * sizeof(MCoreRamDiskEntry_t))) > Size) {
+        free(Image);
+        return 0;
+    }
 
-	// Fill rest of entry space with 0
-	dataptr = malloc(0x1000 - sizeof(MCoreRamDiskHeader_t));
-	memset(dataptr, 0, 0x1000 - sizeof(MCoreRamDiskHeader_t));
-	fwrite(dataptr, 1, 0x1000 - sizeof(MCoreRamDiskHeader_t), out);
-	free(dataptr);
-	fflush(out);
-	fdatapos = ftell(out);
+    // Count the chunks of valid entries in the first pass, and fill the cache in the second
+    Cache = NULL;
+    for (Pass = 0; Pass < 2; Pass++) {
+        for (i = 0; i < Header->FileCount; i++) {
+            MCoreRamDiskModuleHeader_t* Module;
+            MCoreRamDiskChunk_t*        Chunks;
+            long                        ChunkCount;
+
+            if ((long)Entries[i].DataHeaderOffset + (long)sizeof(MCoreRamDiskModuleHeader_t) > Size) {
+                continue;
+            }
+            Module     = (MCoreRamDiskModuleHeader_t*)(Image + Entries[i].DataHeaderOffset);
+            Chunks     = (MCoreRamDiskChunk_t*)(Module + 1);
+            ChunkCount = ((long)Module->LengthOfData + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            if ((long)((uint8_t*)(Chunks + ChunkCount) - Image) > Size ||
+                Crc32Generate(-1, (uint8_t*)Chunks, ChunkCount * sizeof(MCoreRamDiskChunk_t)) != Module->Crc32OfData) {
+                continue;
+            }
+
+            for (j = 0; j < ChunkCount; j++) {
+                if ((long)Chunks[j].Offset + (long)Chunks[j].Length > Size) {
+                    continue;
+                }
+                if (Pass == 1) {
+                    Cache[Count].Key.Length = ((long)Module->LengthOfData - (j * CHUNK_SIZE)) < CHUNK_SIZE ? 
+                        ((long)Module->LengthOfData - (j * CHUNK_SIZE)) : CHUNK_SIZE;
+                    Cache[Count].Packed     = Image + Chunks[j].Offset;
+                    Cache[Count].Descriptor = Chunks[j];
+                }
+                Count++;
+            }
+        }
+        if (Pass == 0) {
+            Cache = (RdCacheEntry_t*)calloc(Count + 1, sizeof(RdCacheEntry_t));
+            Count = 0;
+        }
+    }
+
+    RunParallel(UnpackCacheWork, Cache, Count);
+    IndexCreate(Index, Count);
+    for (i = 0; i < Count; i++) {
+        if (Cache[i].Key.Length >= 0) {
+            IndexFindOrInsert(Index, &Cache[i].Key, 1);
+        }
+    }
+    *ImageOut   = Image;
+    *EntriesOut = Cache;
+    return Count;
+}
+
+static int
+CompareFiles(
+    const void* First,
+    const void* Second)
+{
+    const RdFile_t* FirstFile  = (const RdFile_t*)First;
+    const RdFile_t* SecondFile = (const RdFile_t*)Second;
+    if (FirstFile->Order != SecondFile->Order) {
+        return FirstFile->Order - SecondFile->Order;
+    }
+    return strcmp(FirstFile->Name, SecondFile->Name);
+}
+
+/* CollectFiles
+ * Collects the files from the initrd folder and reads their driver descriptors,
+ * the files are sorted in the order they are loaded during boot. */
+RdFile_t*
+CollectFiles(
+    int* FileCount)
+{
+	struct dirent *dp = NULL;
+	RdFile_t *files = NULL;
+	DIR *dfd = NULL;
+	char **tokens;
+	int tokencount;
+	int count = 0;
+	int capacity = 0;
+
+	if ((dfd = opendir("initrd")) == NULL) {
+		fprintf(stderr, "Can't open initrd folder\n");
+		return NULL;
+	}
 
 	// Init token storage
 	tokens = (char**)malloc(sizeof(char*) * 24);
 	for (int i = 0; i < 24; i++)
 		tokens[i] = (char*)malloc(64);
 
-    // Iterate entries
-    printf("Generating ramdisk entries\n");
-    filename_buffer = malloc(512);
 	while ((dp = readdir(dfd)) != NULL) {
 		struct stat stbuf;
+		RdFile_t *file;
+
+		// Skip everything that is not dll's or .bmp's
+		char *dot = strrchr(dp->d_name, '.');
+		if (!dot || (strcmp(dot, ".dll") && strcmp(dot, ".bmp"))) {
+			continue;
+		}
+		if (strlen(dp->d_name) >= sizeof(files->Name)) {
+			printf("Skipping %s, the name is too long\n", dp->d_name);
+			continue;
+		}
 
-		// Build path string
-		sprintf(filename_buffer, "initrd/%s", dp->d_name);
-		if (stat(filename_buffer, &stbuf) == -1) {
-			printf("Unable to stat file: %s\n", filename_buffer);
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			files = (RdFile_t*)realloc(files, capacity * sizeof(RdFile_t));
+		}
+		file = &files[count];
+		memset(file, 0, sizeof(RdFile_t));
+		snprintf(file->Path, sizeof(file->Path), "initrd/%s", dp->d_name);
+		strcpy(file->Name, dp->d_name);
+		if (stat(file->Path, &stbuf) == -1) {
+			printf("Unable to stat file: %s\n", file->Path);
 			continue;
 		}
 
@@ -424,131 +926,284 @@ int main(int argc, char *argv[])
 		if ((stbuf.st_mode & S_IFMT) == S_IFDIR) {
 			continue;
 		}
-		else {
-            // Variables
-            MCoreRamDiskEntry_t rdentry = { { 0 }, 0 };
-            MCoreRamDiskModuleHeader_t rddataheader = { 0 };
-            
-            // Skip everything that is not dll's or .bmp's
-            char *dot = strrchr(dp->d_name, '.');
-			if (!dot || (strcmp(dot, ".dll") && strcmp(dot, ".bmp"))) {
-				continue;
-			}
-
-			// Is it a driver? check if file exists with .drvm extension
-			FILE *drvdata = GetDriver(filename_buffer);
-			FILE *entry = NULL;
-			char *name = NULL;
-			uint32_t type = drvdata == NULL ? 0x1 : 0x4;
-			uint32_t vendorid = 0;
-			uint32_t deviceid = 0;
-			uint32_t dclass = 0;
-			uint32_t dsubclass = 0;
-			uint32_t dflags = 0;
-			long fsize = 0;
-
-			// Debug print
-			if (drvdata != NULL) {
-				printf("writing %s to rd (driver)\n", dp->d_name);
-			}
-			else {
-				printf("writing %s to rd (file)\n", dp->d_name);
-			}
 
-			// Seek to entry pos
-            fseek(out, fentrypos, SEEK_SET);
-            
-            // fill entry
-            memcpy(&rdentry.Name[0], dp->d_name, strlen(dp->d_name));
-            rdentry.Type = type;
-            rdentry.DataHeaderOffset = fdatapos;
-
-			// Write header data
-			fwrite(&rdentry, sizeof(MCoreRamDiskEntry_t), 1, out);
-			fflush(out);
-
-			// Update entry
-			fentrypos = ftell(out);
-
-			// Seek to data
-            fseek(out, fdatapos, SEEK_SET);
-            
-			// Load driver data?
-			if (drvdata != NULL) {
-				while (1) {
-					int result = GetNextLine(drvdata, tokens, &tokencount);
-					if (tokencount >= 3) {
-						// Skip comments
-						if (strncmp(tokens[0], "#", 1)) {
-							if (!strcmp(tokens[0], "VendorId")) {
-								vendorid = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "DeviceId")) {
-								deviceid = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "Class")) {
-								dclass = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "SubClass")) {
-								dsubclass = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
-							if (!strcmp(tokens[0], "Flags")) {
-								dflags = (uint32_t)strtol(tokens[2], NULL, 16);
-							}
+		// Is it a driver? check if file exists with .drvm extension
+		FILE *drvdata = GetDriver(file->Path);
+		file->Type  = drvdata == NULL ? 0x1 : 0x4;
+		file->Order = 1;
+		if (drvdata != NULL) {
+			while (1) {
+				int result = GetNextLine(drvdata, tokens, &tokencount);
+				if (tokencount >= 3) {
+					// Skip comments
+					if (strncmp(tokens[0], "#", 1)) {
+						if (!strcmp(tokens[0], "VendorId")) {
+							file->Header.VendorId = (uint32_t)strtol(tokens[2], NULL, 16);
+						}
+						if (!strcmp(tokens[0], "DeviceId")) {
+							file->Header.DeviceId = (uint32_t)strtol(tokens[2], NULL, 16);
+						}
+						if (!strcmp(tokens[0], "Class")) {
+							file->Header.DeviceType = (uint32_t)strtol(tokens[2], NULL, 16);
+						}
+						if (!strcmp(tokens[0], "SubClass")) {
+							file->Header.DeviceSubType = (uint32_t)strtol(tokens[2], NULL, 16);
+						}
+						if (!strcmp(tokens[0], "Flags")) {
+							file->Header.Flags = (uint32_t)strtol(tokens[2], NULL, 16);
 						}
 					}
+				}
 
-					// Break on end of file
-					if (result) {
-						break;
-					}
+				// Break on end of file
+				if (result) {
+					break;
 				}
-				
-				// Cleanup
-				fclose(drvdata);
-            }
-            
-            // Update rest of header
-            rddataheader.VendorId       = vendorid;
-            rddataheader.DeviceId       = deviceid;
-            rddataheader.DeviceType     = dclass;
-            rddataheader.DeviceSubType  = dsubclass;
-            rddataheader.Flags          = dflags;
-
-			// Load file data
-            entry = fopen(filename_buffer, "rb+");
-            fseek(entry, 0, SEEK_END);
-            fsize = ftell(entry);
-            dataptr = malloc(fsize);
-            rewind(entry);
-            fread(dataptr, 1, fsize, entry);
-            fclose(entry);
-
-            // Bmp is the only supported image form, which we automatically run RLE on
-            if (!strcmp(dot, ".bmp")) {
+			}
+			fclose(drvdata);
 
-            }
-            
-			// Write data header
-            rddataheader.LengthOfData   = fsize;
-            rddataheader.Crc32OfData    = Crc32Generate(-1, (uint8_t*)dataptr, fsize);
-			fwrite(&rddataheader, sizeof(MCoreRamDiskModuleHeader_t), 1, out);
-
-			// Write file data
-			fwrite(dataptr, 1, fsize, out);
-			fflush(out);
-			free(dataptr);
-
-			// Update data
-			fdatapos = ftell(out);
+			// Services are spawned first, drivers when their device is found
+			file->Order = (file->Header.Flags & 0x2) ? 0 : 2;
 		}
+		count++;
 	}
-
-	// Close directory
 	closedir(dfd);
+	for (int i = 0; i < 24; i++)
+		free(tokens[i]);
+	free(tokens);
+
+	qsort(files, count, sizeof(RdFile_t), CompareFiles);
+	*FileCount = count;
+	return files;
+}
+
+/* IsDuplicateModule
+ * Modules with the same descriptor that consist of the same chunks can share the
+ * module header and chunk table. */
+static int
+IsDuplicateModule(
+    RdFile_t*  File,
+    RdFile_t*  Other,
+    RdChunk_t* Chunks)
+{
+    long i;
+    if (File->Length != Other->Length || File->Header.Flags != Other->Header.Flags ||
+        File->Header.VendorId != Other->Header.VendorId || File->Header.DeviceId != Other->Header.DeviceId ||
+        File->Header.DeviceType != Other->Header.DeviceType || 
+        File->Header.DeviceSubType != Other->Header.DeviceSubType) {
+        return 0;
+    }
+    for (i = 0; i < File->ChunkCount; i++) {
+        if (Chunks[File->FirstChunk + i].Original != Chunks[Other->FirstChunk + i].Original) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// main
+int main(int argc, char *argv[])
+{
+	// Variables
+	MCoreRamDiskEntry_t *entries;
+	MCoreRamDiskChunk_t *table;
+	RdCacheEntry_t *cache = NULL;
+	RdChunk_t *chunks;
+	RdFile_t *files;
+	RdIndex_t cacheindex = { 0 };
+	RdIndex_t chunkindex = { 0 };
+	uint8_t *previous = NULL;
+	FILE *out = NULL;
+	long entryarea;
+	long fdatapos;
+	long chunkcount = 0;
+	long cachecount = 0;
+	long duplicates = 0;
+	long reused = 0;
+	int filecount = 0;
+	int clean = 0;
+
+	// Print header
+	printf("MollenOS Ramdisk Builder\n"
+           "Copyright 2017 Philip Meulengracht (www.mollenos.com)\n\n");
+
+	// Validate the number of arguments
+	// format: rd $(arch) $(out) [--clean]
+	Crc32GenerateTable();
+	ThreadCount = GetThreadCount();
+	if (argc >= 3 && !strcmp(argv[1], "bench")) {
+		return Benchmark(argc - 2, &argv[2]);
+	}
+	if (argc == 4 && !strcmp(argv[3], "--clean")) {
+		clean = 1;
+	}
+	else if (argc != 3) {
+		ShowSyntax();
+		return 1;
+	}
+
+	// Fill in architecture
+	// Arch - x86_32 = 0x08, x86_64 = 0x10
+    if (!strcmp(argv[1], "i386") || !strcmp(argv[1], "__i386__")) {
+	    RdHeaderStatic.Architecture = 0x08;
+    }
+    else if (!strcmp(argv[1], "amd64") || !strcmp(argv[1], "__amd64__")) {
+	    RdHeaderStatic.Architecture = 0x10;
+    }
+
+    // Collect and load the files
+    printf("Loading files for rd (%i threads)\n", ThreadCount);
+    files = CollectFiles(&filecount);
+    if (files == NULL) {
+        return 1;
+    }
+    RunParallel(LoadFileWork, files, filecount);
+    for (int i = 0; i < filecount; i++) {
+        if (files[i].Length < 0 || (files[i].Length != 0 && files[i].Data == NULL)) {
+            printf("Unable to read file: %s\n", files[i].Path);
+            return 1;
+        }
+        files[i].FirstChunk = chunkcount;
+        files[i].ChunkCount = (files[i].Length + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunkcount         += files[i].ChunkCount;
+    }
+
+    // Split the files into chunks and hash them
+    chunks = (RdChunk_t*)calloc(chunkcount + 1, sizeof(RdChunk_t));
+    for (int i = 0; i < filecount; i++) {
+        for (long j = 0; j < files[i].ChunkCount; j++) {
+            RdChunk_t *chunk = &chunks[files[i].FirstChunk + j];
+            chunk->Key.Data   = files[i].Data + (j * CHUNK_SIZE);
+            chunk->Key.Length = (files[i].Length - (j * CHUNK_SIZE)) < CHUNK_SIZE ? 
+                (files[i].Length - (j * CHUNK_SIZE)) : CHUNK_SIZE;
+        }
+    }
+    RunParallel(HashChunkWork, chunks, chunkcount);
+
+    // Load the previous image, its packed chunks are reused for unchanged data
+    if (!clean) {
+        cachecount = LoadPreviousImage(argv[2], &cacheindex, &previous, &cache);
+        if (cachecount != 0) {
+            printf("Loaded %li chunks from previous image\n", cachecount);
+        }
+    }
+
+    // Deduplicate the chunks, only the first of identical chunks is packed and stored
+    IndexCreate(&chunkindex, chunkcount);
+    for (long i = 0; i < chunkcount; i++) {
+        RdChunk_t *original = (RdChunk_t*)IndexFindOrInsert(&chunkindex, &chunks[i].Key, 1);
+        chunks[i].Original = (long)(original - chunks);
+        if (original != &chunks[i]) {
+            duplicates++;
+            continue;
+        }
+
+        if (cachecount != 0) {
+            RdCacheEntry_t *cached = (RdCacheEntry_t*)IndexFindOrInsert(&cacheindex, &chunks[i].Key, 0);
+            if (cached != NULL) {
+                chunks[i].Packed     = cached->Packed;
+                chunks[i].Descriptor = cached->Descriptor;
+                chunks[i].Reused     = 1;
+                reused++;
+            }
+        }
+    }
+    printf("Packing %li chunks (%li duplicate, %li reused)\n", 
+        chunkcount - duplicates - reused, duplicates, reused);
+    RunParallel(PackChunkWork, chunks, chunkcount);
+
+	// Create the output file, the previous image is no longer read from disk
+	out = fopen(argv[2], "wb+");
+	if (out == NULL) {
+		printf("%s was an invalid output file\n", argv[2]);
+		return 1;
+    }
+
+    // Write header and entries, the entry area is padded to a page
+    printf("Generating ramdisk\n");
+    entryarea = sizeof(MCoreRamDiskHeader_t) + (filecount * sizeof(MCoreRamDiskEntry_t));
+    entryarea = (entryarea + 0xFFF) & ~0xFFFL;
+    entries   = (MCoreRamDiskEntry_t*)calloc(filecount + 1, sizeof(MCoreRamDiskEntry_t));
+    fdatapos  = entryarea;
+    fseek(out, entryarea, SEEK_SET);
+
+    for (int i = 0; i < filecount; i++) {
+        RdFile_t *file = &files[i];
+        long tablelength = file->ChunkCount * sizeof(MCoreRamDiskChunk_t);
+        long position;
+        int duplicate = -1;
+
+        memcpy(&entries[i].Name[0], file->Name, strlen(file->Name));
+        entries[i].Type = file->Type;
+
+        for (int j = 0; j < i; j++) {
+            if (IsDuplicateModule(file, &files[j], chunks)) {
+                duplicate = j;
+                break;
+            }
+        }
+        if (duplicate != -1) {
+            printf("writing %s to rd (same as %s)\n", file->Name, files[duplicate].Name);
+            file->Offset = files[duplicate].Offset;
+            entries[i].DataHeaderOffset = file->Offset;
+            continue;
+        }
+        printf("writing %s to rd (%s)\n", file->Name, file->Type == 0x4 ? "driver" : "file");
+
+        // Place chunks that have not been written yet after the chunk table
+        table    = (MCoreRamDiskChunk_t*)malloc(tablelength + 1);
+        position = fdatapos + sizeof(MCoreRamDiskModuleHeader_t) + tablelength;
+        for (long j = 0; j < file->ChunkCount; j++) {
+            RdChunk_t *chunk = &chunks[chunks[file->FirstChunk + j].Original];
+            if (!chunk->Placed) {
+                chunk->Descriptor.Offset = (uint32_t)position;
+                chunk->Placed            = 1;
+                position += chunk->Descriptor.Length;
+            }
+            table[j] = chunk->Descriptor;
+        }
+
+        file->Offset                = (uint32_t)fdatapos;
+        file->Header.LengthOfData   = (uint32_t)file->Length;
+        file->Header.Crc32OfData    = Crc32Generate(-1, (uint8_t*)table, tablelength);
+        entries[i].DataHeaderOffset = file->Offset;
+        fwrite(&file->Header, sizeof(MCoreRamDiskModuleHeader_t), 1, out);
+        fwrite(table, 1, tablelength, out);
+        for (long j = 0; j < file->ChunkCount; j++) {
+            RdChunk_t *chunk = &chunks[chunks[file->FirstChunk + j].Original];
+            if (!chunk->Written) {
+                fwrite(chunk->Packed, 1, chunk->Descriptor.Length, out);
+                chunk->Written = 1;
+            }
+        }
+        free(table);
+        fdatapos = position;
+    }
+
+    RdHeaderStatic.FileCount = filecount;
+    fseek(out, 0, SEEK_SET);
+	fwrite(&RdHeaderStatic, 1, sizeof(MCoreRamDiskHeader_t), out);
+	fwrite(entries, sizeof(MCoreRamDiskEntry_t), filecount, out);
+	printf("Wrote %i files, %li bytes\n", filecount, fdatapos);
 
 	// Close and cleanup
-	fflush(out);
-    free(tokens);
+	for (long i = 0; i < chunkcount; i++) {
+		if (chunks[i].Original == i && !chunks[i].Reused) {
+			free(chunks[i].Packed);
+		}
+	}
+	for (long i = 0; i < cachecount; i++) {
+		free(cache[i].Key.Data);
+	}
+	for (int i = 0; i < filecount; i++) {
+		free(files[i].Data);
+	}
+	free(cacheindex.Slots);
+	free(chunkindex.Slots);
+	free(previous);
+	free(cache);
+	free(chunks);
+	free(entries);
+	free(files);
 	return fclose(out);
 }